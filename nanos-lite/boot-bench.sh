@@ -0,0 +1,42 @@
+#!/bin/bash
+
+# Measure the boot of Nanos-lite with each of APPS as the single program in
+# the ramdisk, on NEMU of ISA (x86 by default):
+#
+#   ./boot-bench.sh [ISA]
+#
+# The kernel is built with BOOT_BENCH=1, so it halts at the first frame of
+# the app, or when the app exits. For each app, the host time NEMU takes
+# to start and to load the image is printed, followed by the guest
+# instructions and the host time of each region of the boot, which are
+# measured by the marker device of NEMU (see include/marker.h).
+
+ISA=${1:-x86}
+APPS=${APPS:-"tests/dummy tests/hello apps/nterm apps/pal"}
+NEMU=$NEMU_HOME/build/$ISA-nemu
+
+if ! make -C $NEMU_HOME ISA=$ISA &> /dev/null; then
+  echo "$ISA: NEMU compile error"
+  exit 1
+fi
+
+for app in $APPS; do
+  name=$(basename $app)
+  if ! make ARCH=$ISA-nemu BOOT_BENCH=1 SINGLE_APP=$NAVY_HOME/$app &> /dev/null; then
+    echo "$name: compile error"
+    continue
+  fi
+  out=$(mktemp)
+  $NEMU -b -N build/nanos-lite-$ISA-nemu.bin &> $out
+
+  echo "== $name"
+  # strip the colors and the prefix of Log()
+  sed -e 's/\x1b\[[0-9;]*m//g' -e 's/^\[[^]]*\] //' $out | awk '
+    /^Initialized in/ {
+      printf "  %-14s %12s %10d us\n", "nemu", "", $3
+      if (match($0, /load_img [0-9]+/)) printf "  %-14s %12s %10d us\n", "load_img", "", substr($0, RSTART + 9, RLENGTH - 9)
+    }
+    / times, .* instructions and / { sub(":", "", $1); printf "  %-14s %12d %10d us\n", $1, $4, $7 }
+    /^total guest instructions/ { printf "  %-14s %12d\n", "total", $5 }'
+  rm -f $out
+done
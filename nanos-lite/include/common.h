@@ -4,6 +4,7 @@
 /* Uncomment these macros to enable corresponding functionality. */
 //#define HAS_CTE
 //#define HAS_VME
+//#define HAS_STRACE
 
 #include <am.h>
 #include <klib.h>
@@ -7,4 +7,13 @@
 enum {SEEK_SET, SEEK_CUR, SEEK_END};
 #endif
 
+int fs_open(const char *pathname, int flags, int mode);
+size_t fs_read(int fd, void *buf, size_t len);
+size_t fs_write(int fd, const void *buf, size_t len);
+size_t fs_lseek(int fd, size_t offset, int whence);
+int fs_close(int fd);
+size_t fs_filesz(int fd);
+size_t fs_disk_offset(const char *pathname);
+const void* fs_ptr(int fd, size_t offset, size_t len);
+
 #endif
@@ -0,0 +1,36 @@
+#ifndef __LZDISK_H__
+#define __LZDISK_H__
+
+#include <stdint.h>
+
+/* The compressed ramdisk made by tools/lzpack. The ramdisk is cut into
+ * blocks of LZDISK_BLOCK bytes, each compressed alone, so a block can be
+ * decompressed without the ones before it. The header is followed by the
+ * offsets of the blocks from the start of the image, with one more for
+ * the end of the last block, and then the blocks.
+ *
+ * A block is a sequence of
+ *
+ *   token    the number of literals in the high 4 bits, and the length
+ *            of the match minus LZDISK_MIN_MATCH in the low 4 bits
+ *   [more literal length bytes if the high 4 bits are 15]
+ *   literals
+ *   offset   2 bytes, how far back the match starts
+ *   [more match length bytes if the low 4 bits are 15]
+ *
+ * where a length of 15 is followed by bytes which are added to it, until
+ * one is less than 255. The last sequence ends after the literals.
+ */
+
+#define LZDISK_MAGIC 0x315a4c4e  // "NLZ1"
+#define LZDISK_BLOCK 4096
+#define LZDISK_MIN_MATCH 4
+
+typedef struct {
+  uint32_t magic;
+  uint32_t size;      // of the ramdisk when decompressed
+  uint32_t nr_block;
+  uint32_t offset[];  // nr_block + 1
+} LZDiskHeader;
+
+#endif
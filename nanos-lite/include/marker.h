@@ -0,0 +1,50 @@
+#ifndef __MARKER_H__
+#define __MARKER_H__
+
+#include "common.h"
+
+/* The regions of the boot measured by the marker device of NEMU, see
+ * nemu/src/device/marker.c. NEMU reports the guest instructions and the
+ * host time of each region at exit. Nothing is measured on native. */
+
+enum {
+  MARKER_BOOT,         // from main() to the first frame of the app
+  MARKER_INIT_MM,
+  MARKER_INIT_RAMDISK,
+  MARKER_INIT_DEVICE,
+  MARKER_INIT_FS,
+  MARKER_INIT_PROC,
+  MARKER_LOAD,         // loading a program
+  MARKER_FIRST_FRAME,  // from the end of the first load to the first sync
+};
+
+#define MARKER_MMIO 0xa1000600
+enum { MARKER_REG_BEGIN, MARKER_REG_END, MARKER_REG_NAME_ADDR, MARKER_REG_NAME,
+  MARKER_REG_INSTR_LO, MARKER_REG_INSTR_HI };
+
+static inline void marker_write(int reg, uint32_t val) {
+#ifndef __ISA_AM_NATIVE__
+  ((volatile uint32_t *)MARKER_MMIO)[reg] = val;
+#endif
+}
+
+static inline void marker_begin(int id) { marker_write(MARKER_REG_BEGIN, id); }
+static inline void marker_end(int id) { marker_write(MARKER_REG_END, id); }
+
+/* the number of guest instructions executed by NEMU, 0 on native */
+static inline uint64_t marker_instr(void) {
+#ifndef __ISA_AM_NATIVE__
+  volatile uint32_t *reg = (volatile uint32_t *)MARKER_MMIO;
+  uint32_t lo = reg[MARKER_REG_INSTR_LO];  // latches the count
+  return ((uint64_t)reg[MARKER_REG_INSTR_HI] << 32) | lo;
+#else
+  return 0;
+#endif
+}
+
+static inline void marker_name(int id, const char *name) {
+  marker_write(MARKER_REG_NAME_ADDR, (uintptr_t)name);
+  marker_write(MARKER_REG_NAME, id);
+}
+
+#endif
@@ -14,5 +14,9 @@
 #define PGROUNDDOWN(a)  (((a)) & ~PGMASK)
 
 void* new_page(size_t);
+void free_page(void *p);
+void mm_stat(void);
+int mm_brk(uintptr_t brk, intptr_t increment);
+uintptr_t mm_mmap(uintptr_t addr, size_t len, int fd, size_t offset);
 
 #endif
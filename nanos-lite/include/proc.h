@@ -3,19 +3,72 @@
 
 #include "common.h"
 #include "memory.h"
+#include "sysring.h"
 
 #define STACK_SIZE (8 * PGSIZE)
 
-typedef union {
+/* a PT_LOAD segment of the program, see loader.c */
+typedef struct {
+  uintptr_t vaddr, filesz, memsz;
+  size_t disk_offset;
+  bool writable;
+} Segment;
+
+/* the pages allocated for a process, freed when its program is replaced */
+typedef struct PageList {
+  struct PageList *next;
+  int nr;
+  void *pa[PGSIZE / sizeof(void *) - 2];
+} PageList;
+
+#define MAX_NR_SEG 8
+
+/* the priorities of the processes, the smaller the higher */
+#define NR_PRIO 8
+enum { PRIO_FOREGROUND = 0, PRIO_NORMAL = 4, PRIO_BACKGROUND = NR_PRIO - 1 };
+
+typedef union PCB {
   uint8_t stack[STACK_SIZE] PG_ALIGN;
   struct {
     _Context *cp;
     _AddressSpace as;
     // we do not free memory, so use `max_brk' to determine when to call _map()
     uintptr_t max_brk;
+    // the heap is [heap_start, max_brk), mapped on the first touch
+    uintptr_t heap_start;
+    PageList *pages;
+    // the files are mapped by mmap() downwards from `mmap_top'
+    uintptr_t mmap_top;
+    // the pages of the segments are loaded on the first touch
+    size_t image;  // the offset of the program in the ramdisk
+    Segment seg[MAX_NR_SEG];
+    int nr_seg;
+    // scheduling, see proc.c
+    int prio, slice;
+    bool blocked;
+    union PCB *next;  // in a run queue, or a wait queue if blocked
+    uint32_t nr_tick, nr_switch;
+    // when a reader of /dev/events without a key wakes up, see device.c
+    uint32_t evt_deadline;
+    // the ring of the batched system calls, NULL if not set up
+    SysRing *ring;
   };
 } PCB;
 
 extern PCB *current;
 
+void sched_add(PCB *pcb, int prio);
+bool sched_block(PCB **waitq);
+void sched_wakeup(PCB **waitq);
+bool sched_tick(void);
+_Context* schedule(_Context *prev);
+void proc_stat(void);
+
+bool loader_pgfault(PCB *pcb, uintptr_t vaddr);
+bool mm_pgfault(PCB *pcb, uintptr_t vaddr);
+void mm_map(PCB *pcb, uintptr_t va, void *pa, bool owned);
+void mm_release(PCB *pcb);
+void context_uload(PCB *pcb, const char *filename);
+_Context* proc_execve(const char *filename);
+
 #endif
@@ -0,0 +1,18 @@
+#ifndef __SYSMMAP_H__
+#define __SYSMMAP_H__
+
+/* mmap() is not in syscall.h, so like the calls of the ring in sysring.h
+ * it has a number apart from the ones there:
+ *
+ *   SYS_mmap(len, fd, offset)  map [offset, offset + len) of the file `fd'
+ *                              at an address chosen by the kernel, and
+ *                              return the address, or -1 on failure
+ *
+ * A system call has three arguments, so the address can not be given.
+ * See mm_mmap() for what is mapped in place. The process side is in
+ * navy-apps/libs/libos/src/mmap.c, which must use the same number.
+ */
+
+#define SYS_mmap 0x102
+
+#endif
@@ -0,0 +1,43 @@
+#ifndef __SYSRING_H__
+#define __SYSRING_H__
+
+#include <stdint.h>
+
+/* A process may queue system calls in a ring shared with the kernel, and
+ * trap once with SYSRING_ENTER for the whole batch:
+ *
+ *   SYSRING_SETUP(ring)  register `ring', 0 to unregister
+ *   SYSRING_ENTER()      run the queued calls, and return how many ran
+ *
+ * The process fills `sq[sq_tail % NR_SYSRING]' and then advances
+ * `sq_tail'. The kernel runs the calls from `sq_head' in order, and puts
+ * the results with the `user_data' of the requests at `cq_tail', stopping
+ * early if the completion queue is full. The process consumes the results
+ * by advancing `cq_head'. Only read, write and lseek can be queued.
+ *
+ * The numbers of these two calls are apart from the ones in syscall.h.
+ */
+
+#define SYSRING_SETUP 0x100
+#define SYSRING_ENTER 0x101
+
+#define NR_SYSRING 64
+
+typedef struct {
+  uint32_t id, a[3];
+  uint32_t user_data;
+} SysReq;
+
+typedef struct {
+  uint32_t user_data;
+  int32_t ret;
+} SysRes;
+
+typedef struct {
+  uint32_t sq_head, sq_tail;
+  uint32_t cq_head, cq_tail;
+  SysReq sq[NR_SYSRING];
+  SysRes cq[NR_SYSRING];
+} SysRing;
+
+#endif
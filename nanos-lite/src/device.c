@@ -1,4 +1,6 @@
 #include "common.h"
+#include "proc.h"
+#include "marker.h"
 #include <amdev.h>
 
 size_t serial_write(const void *buf, size_t offset, size_t len) {
@@ -13,28 +15,176 @@ static const char *keyname[256] __attribute__((used)) = {
   _KEYS(NAME)
 };
 
+#define KEYDOWN_MASK 0x8000
+
+/* A reader of /dev/events without a pending key is blocked instead of
+ * spinning on the keyboard, and then gets the key which has arrived, or a
+ * time event. When a time event is due is set by writing "w N" to
+ * /dev/events, and kept until the next write:
+ *   N = 0  at the next timer interrupt (the default)
+ *   N > 0  N ms from now, and at once after that
+ *   N < 0  never, only a key wakes it up
+ * So a process waiting for the user is not run at all until a key. */
+#define EVT_NEXT_TICK 0
+#define EVT_NEVER ((uint32_t)-1)
+
+static int key_pending = _KEY_NONE;
+static PCB *event_waitq = NULL;
+
+static inline bool evt_expired(uint32_t deadline, uint32_t now) {
+  return deadline == EVT_NEXT_TICK || (deadline != EVT_NEVER && now >= deadline);
+}
+
+/* called on each timer interrupt */
+void device_tick(void) {
+  if (key_pending == _KEY_NONE) key_pending = read_key();
+  if (key_pending != _KEY_NONE) {
+    sched_wakeup(&event_waitq);
+    return;
+  }
+
+  /* wake up the readers whose time is up */
+  uint32_t now = uptime();
+  PCB **pp = &event_waitq, *wake = NULL;
+  while (*pp != NULL) {
+    PCB *p = *pp;
+    if (evt_expired(p->evt_deadline, now)) {
+      *pp = p->next;
+      p->next = wake;
+      wake = p;
+    }
+    else pp = &p->next;
+  }
+  sched_wakeup(&wake);
+}
+
 size_t events_read(void *buf, size_t offset, size_t len) {
-  return 0;
+  /* nothing to hold an event, so keep it for the next read */
+  if (len == 0) return 0;
+  if (key_pending == _KEY_NONE) key_pending = read_key();
+#ifdef HAS_CTE
+  /* a deadline which has passed gives a time event at once */
+  uint32_t deadline = current->evt_deadline;
+  if (key_pending == _KEY_NONE && (deadline == EVT_NEXT_TICK || !evt_expired(deadline, uptime())) &&
+      sched_block(&event_waitq)) {
+    _yield();
+  }
+#endif
+
+  int key = key_pending, n;
+  key_pending = _KEY_NONE;
+  if (key != _KEY_NONE) {
+    n = snprintf(buf, len, "k%c %s\n", (key & KEYDOWN_MASK ? 'd' : 'u'), keyname[key & ~KEYDOWN_MASK]);
+  }
+  else n = snprintf(buf, len, "t %d\n", uptime());
+  /* the event is truncated to the buffer */
+  return ((size_t)n < len ? n : len - 1);
+}
+
+size_t events_write(const void *buf, size_t offset, size_t len) {
+  char cmd[16];
+  len = (len < sizeof(cmd) - 1 ? len : sizeof(cmd) - 1);
+  memcpy(cmd, buf, len);
+  cmd[len] = '\0';
+  if (cmd[0] != 'w') return len;
+
+  int ms = atoi(cmd + 1);
+  current->evt_deadline = (ms == 0 ? EVT_NEXT_TICK : ms < 0 ? EVT_NEVER : uptime() + ms);
+  return len;
 }
 
 static char dispinfo[128] __attribute__((used)) = {};
 
 size_t dispinfo_read(void *buf, size_t offset, size_t len) {
-  return 0;
+  size_t size = strlen(dispinfo);
+  if (offset >= size) return 0;
+  if (len > size - offset) len = size - offset;
+  memcpy(buf, dispinfo + offset, len);
+  return len;
+}
+
+/* The region of the screen written since the last sync, empty if
+ * dirty_x0 >= dirty_x1. */
+static int dirty_x0 = 0, dirty_y0 = 0, dirty_x1 = 0, dirty_y1 = 0;
+
+static void fb_blit(const uint32_t *pixels, int x, int y, int w, int h) {
+  if (w <= 0 || h <= 0) return;
+  draw_rect((uint32_t *)pixels, x, y, w, h);
+  if (dirty_x0 >= dirty_x1) {
+    dirty_x0 = x; dirty_y0 = y; dirty_x1 = x + w; dirty_y1 = y + h;
+    return;
+  }
+  if (x < dirty_x0) dirty_x0 = x;
+  if (y < dirty_y0) dirty_y0 = y;
+  if (x + w > dirty_x1) dirty_x1 = x + w;
+  if (y + h > dirty_y1) dirty_y1 = y + h;
 }
 
+/* A write of pixels in row-major order is drawn as at most three
+ * rectangles: the rest of the first row, the whole rows in the middle,
+ * and the head of the last row. So a full frame is a single blit. */
 size_t fb_write(const void *buf, size_t offset, size_t len) {
-  return 0;
+  int w = screen_width(), h = screen_height();
+  size_t size = w * h * sizeof(uint32_t);
+  if (offset >= size) return 0;
+  if (len > size - offset) len = size - offset;
+
+  const uint32_t *pixels = buf;
+  int idx = offset / sizeof(uint32_t), n = len / sizeof(uint32_t);
+  int x = idx % w, y = idx / w;
+  if (x != 0) {
+    int k = (n < w - x ? n : w - x);
+    fb_blit(pixels, x, y, k, 1);
+    pixels += k; n -= k; y ++;
+  }
+  fb_blit(pixels, 0, y, w, n / w);
+  pixels += n / w * w; y += n / w;
+  fb_blit(pixels, 0, y, n % w, 1);
+  return len;
 }
 
+/* The framebuffer of NEMU, which is mapped into the processes by mmap() of
+ * /dev/fb, so they draw in place without write(). Since such drawing is
+ * not seen, every sync is done once it is mapped. */
+#define FB_ADDR 0xa0000000
+
+static bool fb_mapped = false;
+
+const void* fb_ptr(size_t offset, size_t len) {
+#ifdef __ISA_AM_NATIVE__
+  return NULL;
+#else
+  fb_mapped = true;
+  return (void *)FB_ADDR + offset;
+#endif
+}
+
+/* Only sync the screen when some region has been drawn since the last
+ * sync. NEMU presents the dirty rows of vmem, so the cost of a sync
+ * follows the size of the region. */
 size_t fbsync_write(const void *buf, size_t offset, size_t len) {
-  return 0;
+  static bool first = true;
+  if (first) {
+    first = false;
+    marker_end(MARKER_FIRST_FRAME);
+    marker_end(MARKER_BOOT);
+#ifdef HAS_BOOT_BENCH
+    /* the boot-time benchmark stops at the first frame */
+    draw_sync();
+    _halt(0);
+#endif
+  }
+
+  if (fb_mapped || dirty_x0 < dirty_x1) {
+    draw_sync();
+    dirty_x0 = dirty_x1 = 0;
+  }
+  return len;
 }
 
 void init_device() {
   Log("Initializing devices...");
   _ioe_init();
 
-  // TODO: print the string to array `dispinfo` with the format
-  // described in the Navy-apps convention
+  sprintf(dispinfo, "WIDTH:%d\nHEIGHT:%d\n", screen_width(), screen_height());
 }
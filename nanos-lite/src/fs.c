@@ -2,6 +2,8 @@
 
 typedef size_t (*ReadFn) (void *buf, size_t offset, size_t len);
 typedef size_t (*WriteFn) (const void *buf, size_t offset, size_t len);
+/* the memory of a device for mapping it, see fs_ptr() */
+typedef const void* (*PtrFn) (size_t offset, size_t len);
 
 typedef struct {
   char *name;
@@ -9,6 +11,7 @@ typedef struct {
   size_t disk_offset;
   ReadFn read;
   WriteFn write;
+  PtrFn ptr;
 } Finfo;
 
 enum {FD_STDIN, FD_STDOUT, FD_STDERR, FD_FB};
@@ -23,16 +26,167 @@ size_t invalid_write(const void *buf, size_t offset, size_t len) {
   return 0;
 }
 
+size_t fb_write(const void *buf, size_t offset, size_t len);
+size_t fbsync_write(const void *buf, size_t offset, size_t len);
+size_t events_read(void *buf, size_t offset, size_t len);
+size_t events_write(const void *buf, size_t offset, size_t len);
+size_t dispinfo_read(void *buf, size_t offset, size_t len);
+const void* fb_ptr(size_t offset, size_t len);
+
 /* This is the information about all files in disk. */
 static Finfo file_table[] __attribute__((used)) = {
   {"stdin", 0, 0, invalid_read, invalid_write},
   {"stdout", 0, 0, invalid_read, invalid_write},
   {"stderr", 0, 0, invalid_read, invalid_write},
+  {"/dev/fb", 0, 0, invalid_read, fb_write, fb_ptr},
+  {"/dev/fbsync", 0, 0, invalid_read, fbsync_write},
+  {"/dev/events", 0, 0, events_read, events_write},
+  {"/proc/dispinfo", 0, 0, dispinfo_read, invalid_write},
 #include "files.h"
 };
 
 #define NR_FILES (sizeof(file_table) / sizeof(file_table[0]))
 
+size_t ramdisk_read(void *buf, size_t offset, size_t len);
+size_t ramdisk_write(const void *buf, size_t offset, size_t len);
+const void* ramdisk_ptr(size_t offset, size_t len);
+
+/* The files are found by name through a hash index with open addressing,
+ * which is built by init_fs(). */
+
+#define NR_INDEX 1024  // a power of 2, more than twice NR_FILES
+
+static int16_t file_index[NR_INDEX];
+
+static uint32_t name_hash(const char *s) {
+  uint32_t h = 2166136261u;
+  for (; *s != '\0'; s ++) h = (h ^ (uint8_t)*s) * 16777619u;
+  return h;
+}
+
+/* the index of the file `pathname' in file_table, -1 if it is not found */
+static int file_lookup(const char *pathname) {
+  uint32_t i;
+  for (i = name_hash(pathname); file_index[i % NR_INDEX] != -1; i ++) {
+    int f = file_index[i % NR_INDEX];
+    if (strcmp(file_table[f].name, pathname) == 0) return f;
+  }
+  return -1;
+}
+
+/* A file descriptor is an entry of the open-file table, which keeps its
+ * own offset, so a file may be opened more than once. The free entries
+ * are kept in a stack, the lowest one at the top. */
+
+#define MAX_NR_OPEN 64
+
+typedef struct {
+  int file;  // the index in file_table, -1 if free
+  size_t offset;
+} OpenFile;
+
+static OpenFile open_table[MAX_NR_OPEN];
+static int free_fd[MAX_NR_OPEN];
+static int nr_free_fd = 0;
+
+static inline OpenFile* get_open(int fd) {
+  assert(fd >= 0 && fd < MAX_NR_OPEN && open_table[fd].file != -1);
+  return &open_table[fd];
+}
+
+/* Return -1 if the file is not found, since the processes probe for files,
+ * or if no descriptor is free. */
+int fs_open(const char *pathname, int flags, int mode) {
+  int f = file_lookup(pathname);
+  if (f == -1 || nr_free_fd == 0) return -1;
+  int fd = free_fd[-- nr_free_fd];
+  open_table[fd] = (OpenFile) { .file = f, .offset = 0 };
+  return fd;
+}
+
+int fs_close(int fd) {
+  get_open(fd)->file = -1;
+  free_fd[nr_free_fd ++] = fd;
+  return 0;
+}
+
+size_t fs_filesz(int fd) {
+  return file_table[get_open(fd)->file].size;
+}
+
+/* the number of bytes left in a file of the ramdisk, which does not grow */
+static inline size_t avail(Finfo *f, size_t offset, size_t len) {
+  if (offset >= f->size) return 0;
+  return (len < f->size - offset ? len : f->size - offset);
+}
+
+size_t fs_read(int fd, void *buf, size_t len) {
+  OpenFile *o = get_open(fd);
+  Finfo *f = &file_table[o->file];
+  size_t n = (f->read != NULL ? f->read(buf, o->offset, len) :
+      ramdisk_read(buf, f->disk_offset + o->offset, avail(f, o->offset, len)));
+  o->offset += n;
+  return n;
+}
+
+size_t fs_write(int fd, const void *buf, size_t len) {
+  OpenFile *o = get_open(fd);
+  Finfo *f = &file_table[o->file];
+  size_t n = (f->write != NULL ? f->write(buf, o->offset, len) :
+      ramdisk_write(buf, f->disk_offset + o->offset, avail(f, o->offset, len)));
+  o->offset += n;
+  return n;
+}
+
+size_t fs_lseek(int fd, size_t offset, int whence) {
+  OpenFile *o = get_open(fd);
+  switch (whence) {
+    case SEEK_SET: o->offset = offset; break;
+    case SEEK_CUR: o->offset += offset; break;
+    case SEEK_END: o->offset = file_table[o->file].size + offset; break;
+    default: panic("invalid whence = %d", whence);
+  }
+  return o->offset;
+}
+
+/* The data of [offset, offset + len) of the file in the ramdisk, or the
+ * memory of a device like /dev/fb, for accessing without a copy. NULL if
+ * it is a device without memory, the range is beyond the file, or the
+ * ramdisk is not in memory. */
+const void* fs_ptr(int fd, size_t offset, size_t len) {
+  Finfo *f = &file_table[get_open(fd)->file];
+  if (offset + len > f->size) return NULL;
+  if (f->ptr != NULL) return f->ptr(offset, len);
+  if (f->read != NULL) return NULL;
+  return ramdisk_ptr(f->disk_offset + offset, len);
+}
+
+/* the offset of the file `pathname' in the ramdisk */
+size_t fs_disk_offset(const char *pathname) {
+  int f = file_lookup(pathname);
+  if (f == -1) panic("file '%s' is not found", pathname);
+  return file_table[f].disk_offset;
+}
+
 void init_fs() {
-  // TODO: initialize the size of /dev/fb
+  file_table[FD_FB].size = screen_width() * screen_height() * sizeof(uint32_t);
+
+  assert(NR_FILES * 2 <= NR_INDEX);
+  memset(file_index, -1, sizeof(file_index));
+  int f;
+  for (f = 0; f < NR_FILES; f ++) {
+    uint32_t i = name_hash(file_table[f].name);
+    while (file_index[i % NR_INDEX] != -1) i ++;
+    file_index[i % NR_INDEX] = f;
+  }
+
+  /* stdin, stdout and stderr are always open */
+  int fd;
+  for (fd = MAX_NR_OPEN - 1; fd >= 0; fd --) {
+    if (fd <= FD_STDERR) open_table[fd] = (OpenFile) { .file = fd, .offset = 0 };
+    else {
+      open_table[fd].file = -1;
+      free_fd[nr_free_fd ++] = fd;
+    }
+  }
 }
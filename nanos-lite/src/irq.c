@@ -1,7 +1,23 @@
 #include "common.h"
+#include "proc.h"
+
+_Context* do_syscall(_Context *c);
+void device_tick(void);
 
 static _Context* do_event(_Event e, _Context* c) {
   switch (e.event) {
+    case _EVENT_PAGEFAULT:
+      /* a page of the program or the heap touched for the first time */
+      if (!loader_pgfault(current, e.ref) && !mm_pgfault(current, e.ref)) {
+        panic("page fault at %p", e.ref);
+      }
+      return c;
+    case _EVENT_IRQ_TIMER:
+      device_tick();
+      if (!sched_tick()) return c;
+      return schedule(c);
+    case _EVENT_YIELD: return schedule(c);
+    case _EVENT_SYSCALL: return do_syscall(c);
     default: panic("Unhandled event ID = %d", e.event);
   }
 
@@ -1,4 +1,6 @@
 #include "proc.h"
+#include "fs.h"
+#include "marker.h"
 #include <elf.h>
 
 #ifdef __ISA_AM_NATIVE__
@@ -9,13 +11,211 @@
 # define Elf_Phdr Elf32_Phdr
 #endif
 
+size_t ramdisk_read(void *buf, size_t offset, size_t len);
+const void* ramdisk_ptr(size_t offset, size_t len);
+
+/* With paging, the segments are only recorded in the PCB, and each page
+ * is filled by loader_pgfault() when the program touches it for the
+ * first time, so launching a program does not copy the whole binary. The
+ * part of a segment beyond the file (.bss) is zero-filled in the same
+ * way. Without paging, the segments are read at once.
+ *
+ * Launching a program again is cheap, since
+ * - the segments and the entry of the recent programs are kept in
+ *   `prog_cache', so the headers are not parsed again;
+ * - the pristine contents of the pages of the programs are kept in
+ *   `page_cache' by the program and the address, so the ramdisk is not
+ *   read again. A page inside a read-only segment (code and read-only
+ *   data) is mapped from there, so all the processes running the
+ *   program share it, while the other pages are copied from there. A
+ *   read-only page in one piece in the ramdisk in memory is mapped in
+ *   place without the cache.
+ * Both caches are never invalidated, since the programs in the ramdisk
+ * are not rewritten. */
+
+#define NR_PROG_CACHE 16
+#define NR_PAGE_CACHE 1024
+
+typedef struct {
+  size_t image;  // -1 if invalid
+  uintptr_t entry;
+  Segment seg[MAX_NR_SEG];
+  int nr_seg;
+} ProgCache;
+
+static ProgCache prog_cache[NR_PROG_CACHE];
+static int prog_cache_next = 0;
+
+static struct {
+  size_t image;
+  uintptr_t page;
+  void *pa;  // NULL if empty
+} page_cache[NR_PAGE_CACHE];
+
+static void add_segment(PCB *pcb, const Elf_Phdr *ph, size_t base) {
+  assert(pcb->nr_seg < MAX_NR_SEG);
+  pcb->seg[pcb->nr_seg ++] = (Segment) { .vaddr = ph->p_vaddr, .filesz = ph->p_filesz,
+    .memsz = ph->p_memsz, .disk_offset = base + ph->p_offset, .writable = (ph->p_flags & PF_W) != 0 };
+}
+
+static ProgCache* prog_cache_find(size_t image) {
+  int i;
+  for (i = 0; i < NR_PROG_CACHE; i ++) {
+    if (prog_cache[i].nr_seg > 0 && prog_cache[i].image == image) return &prog_cache[i];
+  }
+  return NULL;
+}
+
+static void prog_cache_add(PCB *pcb, uintptr_t entry) {
+  ProgCache *c = &prog_cache[prog_cache_next];
+  prog_cache_next = (prog_cache_next + 1) % NR_PROG_CACHE;
+  c->image = pcb->image;
+  c->entry = entry;
+  c->nr_seg = pcb->nr_seg;
+  memcpy(c->seg, pcb->seg, sizeof(c->seg));
+}
+
 static uintptr_t loader(PCB *pcb, const char *filename) {
-  TODO();
-  return 0;
+  /* the single program in the ramdisk without a file system */
+  size_t base = (filename == NULL ? 0 : fs_disk_offset(filename));
+
+#ifdef HAS_VME
+  if (pcb != NULL) {
+    pcb->image = base;
+    ProgCache *c = prog_cache_find(base);
+    if (c != NULL) {
+      pcb->nr_seg = c->nr_seg;
+      memcpy(pcb->seg, c->seg, sizeof(pcb->seg));
+      goto done;
+    }
+  }
+#endif
+
+  /* the headers are parsed in place if the ramdisk is in memory */
+  Elf_Ehdr eh_buf;
+  const Elf_Ehdr *eh = ramdisk_ptr(base, sizeof(eh_buf));
+  if (eh == NULL) {
+    ramdisk_read(&eh_buf, base, sizeof(eh_buf));
+    eh = &eh_buf;
+  }
+  assert(*(uint32_t *)eh->e_ident == 0x464c457f);
+
+  int i;
+  for (i = 0; i < eh->e_phnum; i ++) {
+    size_t off = base + eh->e_phoff + i * eh->e_phentsize;
+    Elf_Phdr ph_buf;
+    const Elf_Phdr *ph = ramdisk_ptr(off, sizeof(ph_buf));
+    if (ph == NULL) {
+      ramdisk_read(&ph_buf, off, sizeof(ph_buf));
+      ph = &ph_buf;
+    }
+    if (ph->p_type != PT_LOAD) continue;
+#ifdef HAS_VME
+    if (pcb != NULL) {
+      add_segment(pcb, ph, base);
+      continue;
+    }
+#endif
+    ramdisk_read((void *)ph->p_vaddr, base + ph->p_offset, ph->p_filesz);
+    memset((void *)(ph->p_vaddr + ph->p_filesz), 0, ph->p_memsz - ph->p_filesz);
+  }
+  if (pcb == NULL) return eh->e_entry;
+#ifdef HAS_VME
+  prog_cache_add(pcb, eh->e_entry);
+
+done:
+  for (i = 0; i < pcb->nr_seg; i ++) {
+    uintptr_t end = PGROUNDUP(pcb->seg[i].vaddr + pcb->seg[i].memsz);
+    if (end > pcb->max_brk) pcb->max_brk = end;
+  }
+  return prog_cache_find(base)->entry;
+#else
+  return eh->e_entry;
+#endif
 }
 
-void naive_uload(PCB *pcb, const char *filename) {
+/* fill `pa' with the contents of `page' in all the segments, which may share it */
+static void fill_page(PCB *pcb, uintptr_t page, void *pa) {
+  memset(pa, 0, PGSIZE);
+  int i;
+  for (i = 0; i < pcb->nr_seg; i ++) {
+    Segment *s = &pcb->seg[i];
+    /* the part of the page read from the file */
+    uintptr_t lo = (page > s->vaddr ? page : s->vaddr);
+    uintptr_t hi = (page + PGSIZE < s->vaddr + s->filesz ? page + PGSIZE : s->vaddr + s->filesz);
+    if (lo < hi) ramdisk_read(pa + (lo - page), s->disk_offset + (lo - s->vaddr), hi - lo);
+  }
+}
+
+/* the pristine contents of `page', NULL if the cache is full */
+static void* page_cache_get(PCB *pcb, uintptr_t page) {
+  uint32_t h = pcb->image / PGSIZE + page / PGSIZE, i;
+  for (i = 0; i < NR_PAGE_CACHE; i ++) {
+    int k = (h + i) % NR_PAGE_CACHE;
+    if (page_cache[k].pa == NULL) {
+      page_cache[k].image = pcb->image;
+      page_cache[k].page = page;
+      page_cache[k].pa = new_page(1);
+      fill_page(pcb, page, page_cache[k].pa);
+      return page_cache[k].pa;
+    }
+    if (page_cache[k].image == pcb->image && page_cache[k].page == page) return page_cache[k].pa;
+  }
+  return NULL;
+}
+
+/* Map the page of `vaddr' with its contents in the segments. Return false
+ * if it is not inside a segment. */
+bool loader_pgfault(PCB *pcb, uintptr_t vaddr) {
+  uintptr_t page = PGROUNDDOWN(vaddr);
+  const Segment *found = NULL;
+  bool shared = true;
+  int i;
+  for (i = 0; i < pcb->nr_seg; i ++) {
+    const Segment *s = &pcb->seg[i];
+    if (page >= s->vaddr + s->memsz || page + PGSIZE <= s->vaddr) continue;
+    /* only a page inside a single read-only segment is shared */
+    if (found != NULL || s->writable) shared = false;
+    found = s;
+  }
+  if (found == NULL) return false;
+
+  if (shared && page >= found->vaddr && page + PGSIZE <= found->vaddr + found->filesz) {
+    const void *p = ramdisk_ptr(found->disk_offset + (page - found->vaddr), PGSIZE);
+    if (p != NULL && (uintptr_t)p % PGSIZE == 0) {
+      mm_map(pcb, page, (void *)p, false);
+      return true;
+    }
+  }
+
+  void *pristine = page_cache_get(pcb, page);
+  if (shared && pristine != NULL) {
+    mm_map(pcb, page, pristine, false);
+    return true;
+  }
+  void *pa = new_page(1);
+  if (pristine != NULL) memcpy(pa, pristine, PGSIZE);
+  else fill_page(pcb, page, pa);
+  mm_map(pcb, page, pa, true);
+  return true;
+}
+
+/* loader() measured by the marker device, see marker.h */
+static uintptr_t marked_loader(PCB *pcb, const char *filename) {
+  static bool first = true;
+  marker_begin(MARKER_LOAD);
   uintptr_t entry = loader(pcb, filename);
+  marker_end(MARKER_LOAD);
+  if (first) {
+    first = false;
+    marker_begin(MARKER_FIRST_FRAME);
+  }
+  return entry;
+}
+
+/* load the segments at once, since there is no address space */
+void naive_uload(PCB *pcb, const char *filename) {
+  uintptr_t entry = marked_loader(NULL, filename);
   Log("Jump to entry = %x", entry);
   ((void(*)())entry) ();
 }
@@ -29,7 +229,19 @@ void context_kload(PCB *pcb, void *entry) {
 }
 
 void context_uload(PCB *pcb, const char *filename) {
-  uintptr_t entry = loader(pcb, filename);
+#ifdef HAS_VME
+  _protect(&pcb->as);
+  pcb->pages = NULL;
+  pcb->nr_seg = 0;
+  pcb->max_brk = 0;
+  pcb->mmap_top = (uintptr_t)pcb->as.area.end - STACK_SIZE;
+#endif
+  pcb->ring = NULL;
+  pcb->evt_deadline = 0;
+  uintptr_t entry = marked_loader(pcb, filename);
+#ifdef HAS_VME
+  pcb->heap_start = pcb->max_brk;
+#endif
 
   _Area stack;
   stack.start = pcb->stack;
@@ -37,3 +249,24 @@ void context_uload(PCB *pcb, const char *filename) {
 
   pcb->cp = _ucontext(&pcb->as, stack, stack, (void *)entry, NULL);
 }
+
+/* Replace the program of the current process. Its PCB, priority and
+ * time accounting are kept, while its pages and address space are freed
+ * and the new ones are built on demand as usual. Return NULL if the
+ * program is not found, and the old one goes on. */
+_Context* proc_execve(const char *filename) {
+  /* `filename' is in the old address space */
+  static char path[128];
+  strncpy(path, filename, sizeof(path) - 1);
+  path[sizeof(path) - 1] = '\0';
+
+  int fd = fs_open(path, 0, 0);
+  if (fd < 0) return NULL;
+  fs_close(fd);
+
+#ifdef HAS_VME
+  mm_release(current);
+#endif
+  context_uload(current, path);
+  return current->cp;
+}
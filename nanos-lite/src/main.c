@@ -1,4 +1,5 @@
 #include "common.h"
+#include "marker.h"
 
 void init_mm(void);
 void init_ramdisk(void);
@@ -7,25 +8,49 @@ void init_irq(void);
 void init_fs(void);
 void init_proc(void);
 
+static void init_marker(void) {
+  marker_name(MARKER_BOOT, "boot");
+  marker_name(MARKER_INIT_MM, "init_mm");
+  marker_name(MARKER_INIT_RAMDISK, "init_ramdisk");
+  marker_name(MARKER_INIT_DEVICE, "init_device");
+  marker_name(MARKER_INIT_FS, "init_fs");
+  marker_name(MARKER_INIT_PROC, "init_proc");
+  marker_name(MARKER_LOAD, "load");
+  marker_name(MARKER_FIRST_FRAME, "first_frame");
+}
+
 int main() {
+  init_marker();
+  marker_begin(MARKER_BOOT);
+
 #ifdef HAS_VME
+  marker_begin(MARKER_INIT_MM);
   init_mm();
+  marker_end(MARKER_INIT_MM);
 #endif
 
   Log("'Hello World!' from Nanos-lite");
   Log("Build time: %s, %s", __TIME__, __DATE__);
 
+  marker_begin(MARKER_INIT_RAMDISK);
   init_ramdisk();
+  marker_end(MARKER_INIT_RAMDISK);
 
+  marker_begin(MARKER_INIT_DEVICE);
   init_device();
+  marker_end(MARKER_INIT_DEVICE);
 
 #ifdef HAS_CTE
   init_irq();
 #endif
 
+  marker_begin(MARKER_INIT_FS);
   init_fs();
+  marker_end(MARKER_INIT_FS);
 
+  marker_begin(MARKER_INIT_PROC);
   init_proc();
+  marker_end(MARKER_INIT_PROC);
 
   Log("Finish initialization");
 
@@ -1,26 +1,209 @@
 #include "memory.h"
+#include "proc.h"
+#include "fs.h"
 
-static void *pf = NULL;
+/* The physical pages in _heap are managed by a buddy allocator. A block
+ * of order k has 2^k pages and starts at a multiple of 2^k pages from
+ * `base'. The free blocks of each order are kept in a doubly linked list
+ * inside the blocks themselves, so a buddy is taken off its list in O(1)
+ * when it is merged. `page_info' has a byte for each page, giving the
+ * order of the block starting at the page, and whether it is free. The
+ * byte of a page inside a block is meaningless. */
 
+#define MAX_ORDER 20
+#define PAGE_FREE 0x80
+
+typedef struct FreeBlock {
+  struct FreeBlock *prev, *next;
+} FreeBlock;
+
+static void *base = NULL;
+static size_t nr_page_total = 0;
+static uint8_t *page_info = NULL;
+static FreeBlock free_list[MAX_ORDER + 1];
+static size_t nr_free_block[MAX_ORDER + 1];
+static size_t nr_free_page = 0;
+
+static inline size_t page_idx(void *p) { return (p - base) / PGSIZE; }
+static inline FreeBlock* page_ptr(size_t idx) { return base + idx * PGSIZE; }
+
+static void push_block(size_t idx, int order) {
+  FreeBlock *b = page_ptr(idx), *head = &free_list[order];
+  b->next = head->next;
+  b->prev = head;
+  head->next->prev = b;
+  head->next = b;
+  page_info[idx] = PAGE_FREE | order;
+  nr_free_block[order] ++;
+  nr_free_page += (1 << order);
+}
+
+static void remove_block(size_t idx, int order) {
+  FreeBlock *b = page_ptr(idx);
+  b->prev->next = b->next;
+  b->next->prev = b->prev;
+  page_info[idx] = order;
+  nr_free_block[order] --;
+  nr_free_page -= (1 << order);
+}
+
+/* Allocate `nr_page' contiguous pages, rounded up to a power of 2. */
 void* new_page(size_t nr_page) {
-  void *p = pf;
-  pf += PGSIZE * nr_page;
-  assert(pf < (void *)_heap.end);
-  return p;
+  int order = 0;
+  while ((1 << order) < nr_page) order ++;
+  int o;
+  for (o = order; o <= MAX_ORDER && free_list[o].next == &free_list[o]; o ++) ;
+  if (o > MAX_ORDER) panic("out of physical pages for %d pages", nr_page);
+
+  size_t idx = page_idx(free_list[o].next);
+  remove_block(idx, o);
+  /* return the upper halves to the free lists */
+  while (o > order) {
+    o --;
+    push_block(idx + (1 << o), o);
+  }
+  page_info[idx] = order;
+  return page_ptr(idx);
 }
 
 void free_page(void *p) {
-  panic("not implement yet");
+  assert(p >= base && (p - base) % PGSIZE == 0);
+  size_t idx = page_idx(p);
+  int order = page_info[idx];
+  assert(!(order & PAGE_FREE));
+
+  /* merge with the buddy while it is a free block of the same order */
+  while (order < MAX_ORDER) {
+    size_t buddy = idx ^ (1 << order);
+    if (buddy + (1 << order) > nr_page_total || page_info[buddy] != (PAGE_FREE | order)) break;
+    remove_block(buddy, order);
+    idx &= ~(1 << order);
+    order ++;
+  }
+  push_block(idx, order);
+}
+
+/* the number of free blocks of each order */
+void mm_stat(void) {
+  Log("%d of %d physical pages are free", nr_free_page, nr_page_total);
+  int o;
+  for (o = 0; o <= MAX_ORDER; o ++) {
+    if (nr_free_block[o] != 0) Log("  order %d: %d free blocks", o, nr_free_block[o]);
+  }
+}
+
+/* Map the page `pa' at `va' of `pcb'. An owned page is freed by
+ * mm_release(), while the others, e.g. the pages of the ramdisk, are
+ * shared and never freed. */
+void mm_map(PCB *pcb, uintptr_t va, void *pa, bool owned) {
+  _map(&pcb->as, (void *)va, pa, 0);
+  if (!owned) return;
+  PageList *l = pcb->pages;
+  if (l == NULL || l->nr == sizeof(l->pa) / sizeof(l->pa[0])) {
+    l = new_page(1);
+    l->next = pcb->pages;
+    l->nr = 0;
+    pcb->pages = l;
+  }
+  l->pa[l->nr ++] = pa;
 }
 
-/* The brk() system call handler. */
+/* free the pages and the address space of `pcb' */
+void mm_release(PCB *pcb) {
+  while (pcb->pages != NULL) {
+    PageList *l = pcb->pages;
+    pcb->pages = l->next;
+    int i;
+    for (i = 0; i < l->nr; i ++) free_page(l->pa[i]);
+    free_page(l);
+  }
+  _unprotect(&pcb->as);
+}
+
+/* The brk() system call handler, which moves the program break from
+ * `brk' by `increment'. The heap between the end of the program and
+ * `max_brk' is only reserved, and each page of it is allocated and zeroed
+ * by mm_pgfault() when it is touched for the first time, so growing the
+ * heap costs nothing until the memory is used. Since memory is not freed,
+ * the pages stay mapped when the heap shrinks. */
 int mm_brk(uintptr_t brk, intptr_t increment) {
+#ifdef HAS_VME
+  uintptr_t new_brk = brk + increment;
+  if (new_brk < current->heap_start || new_brk > current->mmap_top) return -1;
+  if (new_brk > current->max_brk) current->max_brk = PGROUNDUP(new_brk);
+#endif
   return 0;
 }
 
+/* Map a zeroed page at `vaddr' if it is in the heap reserved by brk().
+ * Return false if it is not. */
+bool mm_pgfault(PCB *pcb, uintptr_t vaddr) {
+  if (vaddr < pcb->heap_start || vaddr >= pcb->max_brk) return false;
+  void *pa = new_page(1);
+  memset(pa, 0, PGSIZE);
+  mm_map(pcb, PGROUNDDOWN(vaddr), pa, true);
+  return true;
+}
+
+/* The mmap() system call handler. It maps [offset, offset + len) of the
+ * file `fd' at `addr', or below the last mapping if `addr' is 0, and
+ * returns the address, or -1 on failure.
+ *
+ * The pages of a file in the ramdisk starting at a page boundary are
+ * mapped in place, so they are never copied, and writes to them reach the
+ * file. The others are copied into new pages. Without paging, the
+ * processes share the address space of the kernel, so only the files
+ * which can be read in place are mapped. */
+uintptr_t mm_mmap(uintptr_t addr, size_t len, int fd, size_t offset) {
+  const void *p = fs_ptr(fd, offset, len);
+#ifndef HAS_VME
+  return (p == NULL || (addr != 0 && addr != (uintptr_t)p) ? -1 : (uintptr_t)p);
+#else
+  if (len == 0 || addr % PGSIZE != 0) return -1;
+  if (addr == 0) {
+    current->mmap_top -= PGROUNDUP(len);
+    addr = current->mmap_top;
+  }
+  bool in_place = (p != NULL && (uintptr_t)p % PGSIZE == 0);
+  size_t file_offset = fs_lseek(fd, 0, SEEK_CUR);
+
+  size_t i;
+  for (i = 0; i < len; i += PGSIZE) {
+    void *pa;
+    if (in_place) pa = (void *)p + i;
+    else {
+      pa = new_page(1);
+      memset(pa, 0, PGSIZE);
+      fs_lseek(fd, offset + i, SEEK_SET);
+      fs_read(fd, pa, (len - i < PGSIZE ? len - i : PGSIZE));
+    }
+    mm_map(current, addr + i, pa, !in_place);
+  }
+  fs_lseek(fd, file_offset, SEEK_SET);
+  return addr;
+#endif
+}
+
 void init_mm() {
-  pf = (void *)PGROUNDUP((uintptr_t)_heap.start);
-  Log("free physical pages starting from %p", pf);
+  /* `page_info' is at the start of the heap, before the pages */
+  page_info = (void *)_heap.start;
+  uintptr_t end = PGROUNDDOWN((uintptr_t)_heap.end);
+  size_t nr = (end - (uintptr_t)_heap.start) / PGSIZE;
+  base = (void *)PGROUNDUP((uintptr_t)_heap.start + nr);
+  nr_page_total = (end - (uintptr_t)base) / PGSIZE;
+  memset(page_info, 0, nr_page_total);
+
+  int o;
+  for (o = 0; o <= MAX_ORDER; o ++) free_list[o].prev = free_list[o].next = &free_list[o];
+  /* the largest aligned blocks covering all the pages */
+  size_t idx = 0;
+  while (idx < nr_page_total) {
+    for (o = MAX_ORDER; (idx & ((1 << o) - 1)) != 0 || idx + (1 << o) > nr_page_total; o --) ;
+    push_block(idx, o);
+    idx += (1 << o);
+  }
+  Log("free physical pages starting from %p", base);
+  mm_stat();
 
   _vme_init(new_page, free_page);
 }
@@ -1,11 +1,14 @@
 #include "proc.h"
 
-#define MAX_NR_PROC 4
+#define MAX_NR_PROC 16
 
 static PCB pcb[MAX_NR_PROC] __attribute__((used)) = {};
 static PCB pcb_boot = {};
+static PCB pcb_idle = {};
 PCB *current = NULL;
 
+void context_kload(PCB *pcb, void *entry);
+
 void switch_boot_pcb() {
   current = &pcb_boot;
 }
@@ -19,15 +22,139 @@ void hello_fun(void *arg) {
   }
 }
 
+/* Runs when all the processes are blocked, until an interrupt wakes one.
+ * `hlt' lets NEMU sleep instead of executing the loop. */
+static void idle_fun(void *arg) {
+  while (1) {
+#ifdef __ISA_X86__
+    asm volatile ("hlt");
+#endif
+  }
+}
+
 void init_proc() {
   switch_boot_pcb();
 
   Log("Initializing processes...");
 
-  // load program here
+#ifdef HAS_CTE
+  context_kload(&pcb_idle, idle_fun);
+#endif
+
+  // load program here, and add it to the run queues with sched_add()
+
+}
+
+/* The runnable processes are kept in a FIFO queue for each priority, and
+ * the bit of a priority in `ready' is set when its queue is not empty, so
+ * the highest runnable priority is found by the lowest set bit. A process
+ * runs until it yields or uses up its time slice of timer interrupts, or
+ * a process with a higher priority becomes runnable, then it is put at
+ * the tail of its queue. The processes of a lower priority only run when
+ * all of the higher ones are blocked, so the foreground process is not
+ * slowed down by the background ones however many there are.
+ *
+ * A blocked process is not queued, but kept in the wait queue of what it
+ * waits for, until sched_wakeup() makes it runnable again.
+ *
+ * The boot and the idle PCBs are never queued, and the idle one runs
+ * when no process is runnable. */
+
+/* the number of timer interrupts in a time slice of each priority */
+static const int slice_len[NR_PRIO] = { 8, 6, 5, 4, 4, 3, 2, 2 };
+
+static PCB *rq_head[NR_PRIO], *rq_tail[NR_PRIO];
+static uint32_t ready = 0;
+
+static void rq_push(PCB *p) {
+  p->next = NULL;
+  if (rq_head[p->prio] == NULL) rq_head[p->prio] = p;
+  else rq_tail[p->prio]->next = p;
+  rq_tail[p->prio] = p;
+  ready |= 1u << p->prio;
+}
+
+static PCB* rq_pop(void) {
+  if (ready == 0) return NULL;
+  int prio = __builtin_ctz(ready);
+  PCB *p = rq_head[prio];
+  rq_head[prio] = p->next;
+  if (rq_head[prio] == NULL) ready &= ~(1u << prio);
+  return p;
+}
+
+/* make the loaded process `pcb' runnable */
+void sched_add(PCB *pcb, int prio) {
+  assert(prio >= 0 && prio < NR_PRIO);
+  pcb->prio = prio;
+  pcb->slice = slice_len[prio];
+  pcb->nr_tick = pcb->nr_switch = 0;
+  rq_push(pcb);
+}
+
+static inline bool is_idle(PCB *p) {
+  return p == &pcb_boot || p == &pcb_idle;
+}
+
+/* Block the current process in `waitq', and return whether it is blocked,
+ * which is not possible for the boot and the idle PCBs. The caller should
+ * then _yield() to give up the CPU. */
+bool sched_block(PCB **waitq) {
+  if (is_idle(current)) return false;
+  current->blocked = true;
+  current->next = *waitq;
+  *waitq = current;
+  return true;
+}
 
+/* make all the processes in `waitq' runnable */
+void sched_wakeup(PCB **waitq) {
+  while (*waitq != NULL) {
+    PCB *p = *waitq;
+    *waitq = p->next;
+    p->blocked = false;
+    rq_push(p);
+  }
+}
+
+/* Account a timer interrupt to the current process. Return whether it
+ * should give up the CPU. */
+bool sched_tick(void) {
+  if (is_idle(current)) return ready != 0;
+  current->nr_tick ++;
+  current->slice --;
+  /* some process with a higher priority is runnable */
+  if (ready & ((1u << current->prio) - 1)) return true;
+  if (current->slice > 0) return false;
+  /* a new time slice if no other process has the same priority */
+  if (ready & (1u << current->prio)) return true;
+  current->slice = slice_len[current->prio];
+  return false;
 }
 
 _Context* schedule(_Context *prev) {
-  return NULL;
+  current->cp = prev;
+  if (!is_idle(current) && !current->blocked) {
+    if (current->slice <= 0) current->slice = slice_len[current->prio];
+    rq_push(current);
+  }
+
+  PCB *next = rq_pop();
+  if (next == NULL) {
+    if (!current->blocked) return prev;
+    next = &pcb_idle;
+  }
+  if (next != current) next->nr_switch ++;
+  current = next;
+  return current->cp;
+}
+
+/* the CPU time of the processes in timer interrupts */
+void proc_stat(void) {
+  int i;
+  for (i = 0; i < MAX_NR_PROC; i ++) {
+    PCB *p = &pcb[i];
+    if (p->cp == NULL) continue;
+    Log("process %d: priority %d, %d ticks, %d switches", i, p->prio, p->nr_tick, p->nr_switch);
+  }
 }
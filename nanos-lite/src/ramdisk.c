@@ -1,5 +1,7 @@
 #include "common.h"
 
+#if !defined(HAS_DISK) && !defined(HAS_LZ_RAMDISK)
+
 extern uint8_t ramdisk_start;
 extern uint8_t ramdisk_end;
 #define RAMDISK_SIZE ((&ramdisk_end) - (&ramdisk_start))
@@ -23,6 +25,17 @@ size_t ramdisk_write(const void *buf, size_t offset, size_t len) {
   return len;
 }
 
+/* the ramdisk is written in place */
+void ramdisk_sync(void) {
+}
+
+/* The data of [offset, offset + len) for reading in place, without
+ * copying it out of the ramdisk. */
+const void* ramdisk_ptr(size_t offset, size_t len) {
+  assert(offset + len <= RAMDISK_SIZE);
+  return &ramdisk_start + offset;
+}
+
 void init_ramdisk() {
   Log("ramdisk info: start = %p, end = %p, size = %d bytes",
       &ramdisk_start, &ramdisk_end, RAMDISK_SIZE);
@@ -31,3 +44,305 @@ void init_ramdisk() {
 size_t get_ramdisk_size() {
   return RAMDISK_SIZE;
 }
+
+#elif defined(HAS_LZ_RAMDISK)
+
+/* The ramdisk linked into the kernel is compressed by tools/lzpack, see
+ * include/lzdisk.h. Only the blocks touched are decompressed, into a
+ * small direct-mapped cache of blocks. The compressed ramdisk is
+ * read-only. */
+
+#include "lzdisk.h"
+
+extern uint8_t ramdisk_start;
+#define LZ_HDR ((const LZDiskHeader *)&ramdisk_start)
+
+#define NR_LZ_CACHE 16
+
+static struct {
+  uint32_t block;  // -1 if invalid
+  uint8_t data[LZDISK_BLOCK];
+} lz_cache[NR_LZ_CACHE];
+
+static inline size_t get_len(const uint8_t **in, size_t len) {
+  if (len == 15) {
+    uint8_t b;
+    do {
+      b = *(*in) ++;
+      len += b;
+    } while (b == 255);
+  }
+  return len;
+}
+
+/* decompress the block in [in, end) into `len' bytes of `out' */
+static void lz_decode(const uint8_t *in, const uint8_t *end, uint8_t *out, size_t len) {
+  uint8_t *out_end = out + len;
+  while (in < end) {
+    int token = *in ++;
+    size_t n = get_len(&in, token >> 4);
+    memcpy(out, in, n);
+    out += n;
+    in += n;
+    if (in >= end) break;
+
+    size_t off = in[0] | (in[1] << 8);
+    in += 2;
+    n = get_len(&in, token & 0xf) + LZDISK_MIN_MATCH;
+    /* the match may overlap the bytes it produces */
+    const uint8_t *m = out - off;
+    while (n -- > 0) *out ++ = *m ++;
+  }
+  assert(out == out_end);
+}
+
+size_t get_ramdisk_size() {
+  return LZ_HDR->size;
+}
+
+static const uint8_t* get_block(uint32_t block) {
+  int k = block % NR_LZ_CACHE;
+  if (lz_cache[k].block != block) {
+    size_t len = get_ramdisk_size() - block * LZDISK_BLOCK;
+    if (len > LZDISK_BLOCK) len = LZDISK_BLOCK;
+    lz_decode(&ramdisk_start + LZ_HDR->offset[block], &ramdisk_start + LZ_HDR->offset[block + 1],
+        lz_cache[k].data, len);
+    lz_cache[k].block = block;
+  }
+  return lz_cache[k].data;
+}
+
+size_t ramdisk_read(void *buf, size_t offset, size_t len) {
+  assert(offset + len <= get_ramdisk_size());
+  size_t left = len;
+  while (left > 0) {
+    size_t skip = offset % LZDISK_BLOCK;
+    size_t n = LZDISK_BLOCK - skip;
+    if (n > left) n = left;
+    memcpy(buf, get_block(offset / LZDISK_BLOCK) + skip, n);
+    buf += n;
+    offset += n;
+    left -= n;
+  }
+  return len;
+}
+
+size_t ramdisk_write(const void *buf, size_t offset, size_t len) {
+  panic("the compressed ramdisk is read-only");
+  return 0;
+}
+
+void ramdisk_sync(void) {
+}
+
+/* the data must be decompressed by ramdisk_read() */
+const void* ramdisk_ptr(size_t offset, size_t len) {
+  return NULL;
+}
+
+void init_ramdisk() {
+  assert(LZ_HDR->magic == LZDISK_MAGIC);
+  int i;
+  for (i = 0; i < NR_LZ_CACHE; i ++) lz_cache[i].block = -1;
+  Log("ramdisk info: compressed, %d blocks, size = %d bytes from %d bytes",
+      LZ_HDR->nr_block, get_ramdisk_size(), LZ_HDR->offset[LZ_HDR->nr_block]);
+}
+
+#else
+
+/* The ramdisk is read from the disk device of NEMU on demand instead of
+ * being linked into the kernel, see nemu/src/device/disk.c. The disk
+ * copies sectors by DMA to a physical address, so the transfers go
+ * through `sector_buf' in the kernel, since `buf' may be an address of
+ * the user process.
+ */
+
+#define DISK_MMIO 0xa1000300
+enum { DISK_ADDR, DISK_SECTOR, DISK_COUNT, DISK_CMD, DISK_STATUS, DISK_NR_SECTOR };
+enum { DISK_CMD_READ = 1, DISK_CMD_WRITE = 2 };
+
+#define SECTOR_SIZE 512
+#define NR_BUF_SECTOR 16
+
+static volatile uint32_t *disk = (void *)DISK_MMIO;
+static uint8_t sector_buf[NR_BUF_SECTOR * SECTOR_SIZE] __attribute((aligned(SECTOR_SIZE)));
+
+static void disk_transfer(int cmd, size_t sector, size_t count) {
+  disk[DISK_ADDR] = (uintptr_t)sector_buf;
+  disk[DISK_SECTOR] = sector;
+  disk[DISK_COUNT] = count;
+  disk[DISK_CMD] = cmd;
+  assert(disk[DISK_STATUS] == 0);
+}
+
+size_t get_ramdisk_size() {
+  return disk[DISK_NR_SECTOR] * SECTOR_SIZE;
+}
+
+/* The blocks of the disk are kept in a buffer cache, so small reads and
+ * writes of the files do not go to the device each time. The least
+ * recently used block is evicted first. Written blocks are only marked
+ * dirty, and written back when they are evicted or by ramdisk_sync().
+ * A miss right after the previous block is read together with the blocks
+ * following it (read-ahead), since the files are mostly read in order.
+ */
+
+#define BLOCK_SIZE 1024
+#define BLOCK_NR_SECTOR (BLOCK_SIZE / SECTOR_SIZE)
+#define NR_BLOCK_BUF 64
+#define NR_HASH 128
+#define NR_READ_AHEAD (NR_BUF_SECTOR / BLOCK_NR_SECTOR)
+
+typedef struct BlockBuf {
+  size_t block;  // -1 if invalid
+  bool dirty;
+  struct BlockBuf *prev, *next;  // the LRU list, the most recent at the head
+  struct BlockBuf *hnext;        // the chain of the hash bucket
+  uint8_t data[BLOCK_SIZE];
+} BlockBuf;
+
+static BlockBuf bufs[NR_BLOCK_BUF];
+static BlockBuf lru = { .prev = &lru, .next = &lru };
+static BlockBuf *hash[NR_HASH];
+static size_t last_block = -1;
+
+static inline void lru_remove(BlockBuf *b) {
+  b->prev->next = b->next;
+  b->next->prev = b->prev;
+}
+
+static inline void lru_push(BlockBuf *b) {
+  b->next = lru.next;
+  b->prev = &lru;
+  lru.next->prev = b;
+  lru.next = b;
+}
+
+static BlockBuf* hash_find(size_t block) {
+  BlockBuf *b;
+  for (b = hash[block % NR_HASH]; b != NULL; b = b->hnext) {
+    if (b->block == block) return b;
+  }
+  return NULL;
+}
+
+static void hash_remove(BlockBuf *b) {
+  BlockBuf **p;
+  for (p = &hash[b->block % NR_HASH]; *p != b; p = &(*p)->hnext) ;
+  *p = b->hnext;
+}
+
+/* the number of sectors in `nr' blocks from `block', short at the end of the disk */
+static inline size_t nr_sector(size_t block, int nr) {
+  size_t left = disk[DISK_NR_SECTOR] - block * BLOCK_NR_SECTOR;
+  return (nr * BLOCK_NR_SECTOR < left ? nr * BLOCK_NR_SECTOR : left);
+}
+
+static void write_back(BlockBuf *b) {
+  memcpy(sector_buf, b->data, BLOCK_SIZE);
+  disk_transfer(DISK_CMD_WRITE, b->block * BLOCK_NR_SECTOR, nr_sector(b->block, 1));
+  b->dirty = false;
+}
+
+/* take the least recently used buffer for `block' */
+static BlockBuf* evict(size_t block) {
+  BlockBuf *b = lru.prev;
+  if (b->block != -1) {
+    if (b->dirty) write_back(b);
+    hash_remove(b);
+  }
+  b->block = block;
+  b->dirty = false;
+  b->hnext = hash[block % NR_HASH];
+  hash[block % NR_HASH] = b;
+  lru_remove(b);
+  lru_push(b);
+  return b;
+}
+
+/* Read `block' and the blocks following it which are not cached, up to
+ * `nr' blocks in total, in one transfer. */
+static BlockBuf* fill(size_t block, int nr) {
+  size_t nr_block = (get_ramdisk_size() + BLOCK_SIZE - 1) / BLOCK_SIZE;
+  int n;
+  for (n = 1; n < nr && block + n < nr_block && hash_find(block + n) == NULL; n ++) ;
+
+  /* The buffers are taken before the transfer, since writing back the
+   * evicted blocks goes through `sector_buf'. The read-ahead blocks are
+   * less recent than the one asked for. */
+  BlockBuf *b[NR_READ_AHEAD];
+  int i;
+  for (i = n - 1; i >= 0; i --) b[i] = evict(block + i);
+  disk_transfer(DISK_CMD_READ, block * BLOCK_NR_SECTOR, nr_sector(block, n));
+  for (i = 0; i < n; i ++) memcpy(b[i]->data, sector_buf + i * BLOCK_SIZE, BLOCK_SIZE);
+  return b[0];
+}
+
+static BlockBuf* get_block(size_t block) {
+  BlockBuf *b = hash_find(block);
+  if (b != NULL) {
+    lru_remove(b);
+    lru_push(b);
+  }
+  else b = fill(block, (block == last_block + 1 ? NR_READ_AHEAD : 1));
+  last_block = block;
+  return b;
+}
+
+/* Copy [offset, offset + len) of the disk from or to `buf' through the
+ * buffer cache. */
+static void ramdisk_rw(void *buf, size_t offset, size_t len, bool is_write) {
+  assert(offset + len <= get_ramdisk_size());
+  while (len > 0) {
+    size_t skip = offset % BLOCK_SIZE;
+    size_t n = BLOCK_SIZE - skip;
+    if (n > len) n = len;
+
+    BlockBuf *b = get_block(offset / BLOCK_SIZE);
+    if (is_write) {
+      memcpy(b->data + skip, buf, n);
+      b->dirty = true;
+    }
+    else memcpy(buf, b->data + skip, n);
+
+    buf += n;
+    offset += n;
+    len -= n;
+  }
+}
+
+size_t ramdisk_read(void *buf, size_t offset, size_t len) {
+  ramdisk_rw(buf, offset, len, false);
+  return len;
+}
+
+size_t ramdisk_write(const void *buf, size_t offset, size_t len) {
+  ramdisk_rw((void *)buf, offset, len, true);
+  return len;
+}
+
+/* write all the dirty blocks back to the disk */
+void ramdisk_sync(void) {
+  int i;
+  for (i = 0; i < NR_BLOCK_BUF; i ++) {
+    if (bufs[i].block != -1 && bufs[i].dirty) write_back(&bufs[i]);
+  }
+}
+
+/* the disk is not in memory, so the data must be copied by ramdisk_read() */
+const void* ramdisk_ptr(size_t offset, size_t len) {
+  return NULL;
+}
+
+void init_ramdisk() {
+  int i;
+  for (i = 0; i < NR_BLOCK_BUF; i ++) {
+    bufs[i].block = -1;
+    lru_push(&bufs[i]);
+  }
+
+  Log("ramdisk info: disk device with %d sectors, size = %d bytes",
+      disk[DISK_NR_SECTOR], get_ramdisk_size());
+}
+
+#endif
@@ -1,13 +1,160 @@
 #include "common.h"
 #include "syscall.h"
+#include "fs.h"
+#include "proc.h"
+#include "memory.h"
+#include "sysmmap.h"
+#include "marker.h"
 
-_Context* do_syscall(_Context *c) {
-  uintptr_t a[4];
-  a[0] = c->GPR1;
+/* the system calls which may also be queued in the ring */
+static uintptr_t do_call(uintptr_t id, uintptr_t a1, uintptr_t a2, uintptr_t a3) {
+  switch (id) {
+    case SYS_read: return fs_read(a1, (void *)a2, a3);
+    case SYS_write: return fs_write(a1, (void *)a2, a3);
+    case SYS_lseek: return fs_lseek(a1, a2, a3);
+    default: return -1;
+  }
+}
+
+/* run the requests queued in the ring of the current process */
+static uintptr_t ring_enter(void) {
+  SysRing *r = current->ring;
+  if (r == NULL) return -1;
+  uintptr_t n = 0;
+  while (r->sq_head != r->sq_tail && r->cq_tail - r->cq_head < NR_SYSRING) {
+    SysReq *req = &r->sq[r->sq_head % NR_SYSRING];
+    SysRes *res = &r->cq[r->cq_tail % NR_SYSRING];
+    res->user_data = req->user_data;
+    res->ret = do_call(req->id, req->a[0], req->a[1], req->a[2]);
+    r->sq_head ++;
+    r->cq_tail ++;
+    n ++;
+  }
+  return n;
+}
+
+/* Each system call is counted by its ID, which is a single increment.
+ * With HAS_STRACE, the cost of each call is also measured, and the calls
+ * are recorded in a ring of the last NR_TRACE ones, which strace_dump()
+ * prints. The cost is in microseconds of the RTC of NEMU, which is read
+ * directly, so with the virtual clock of NEMU (`-t virtual:N') it is the
+ * number of guest instructions divided by N. strace_summary() prints the
+ * calls made most often, and is called at exit.
+ *
+ * The IDs from NR_SYS_SLOT on, e.g. the ones of the ring in sysring.h
+ * and SYS_mmap, share the last slot. */
+
+#define NR_SYS_SLOT 32
+#define NR_TRACE 256
+
+static uint32_t sys_count[NR_SYS_SLOT];
+
+#ifdef HAS_STRACE
+#define RTC_US_MMIO 0xa100004c
+
+typedef struct {
+  uint32_t id, a1, ret, cost;
+} TraceEvent;
+
+static uint64_t sys_cost[NR_SYS_SLOT];
+static TraceEvent trace_ring[NR_TRACE];
+static uint32_t nr_trace = 0;
+
+static inline uint32_t strace_clock(void) {
+#ifdef __ISA_AM_NATIVE__
+  return uptime() * 1000;
+#else
+  return *(volatile uint32_t *)RTC_US_MMIO;
+#endif
+}
+
+void strace_dump(void) {
+  uint32_t i = (nr_trace > NR_TRACE ? nr_trace - NR_TRACE : 0);
+  for (; i < nr_trace; i ++) {
+    TraceEvent *e = &trace_ring[i % NR_TRACE];
+    Log("syscall %d(0x%x) = %d, %d us", e->id, e->a1, e->ret, e->cost);
+  }
+}
+#endif
 
+static inline int sys_slot(uintptr_t id) {
+  return (id < NR_SYS_SLOT ? id : NR_SYS_SLOT - 1);
+}
+
+void strace_summary(void) {
+  bool done[NR_SYS_SLOT] = {};
+  int k;
+  for (k = 0; k < 8; k ++) {
+    int i, top = -1;
+    for (i = 0; i < NR_SYS_SLOT; i ++) {
+      if (!done[i] && sys_count[i] != 0 && (top == -1 || sys_count[i] > sys_count[top])) top = i;
+    }
+    if (top == -1) break;
+    done[top] = true;
+#ifdef HAS_STRACE
+    Log("syscall %d: %d calls, %d us", top, sys_count[top], (uint32_t)sys_cost[top]);
+#else
+    Log("syscall %d: %d calls", top, sys_count[top]);
+#endif
+  }
+}
+
+/* Run the system call and put its return value into `*ret'. It is also
+ * returned in `c', unless execve() succeeds and the context of the new
+ * program is returned instead. */
+static _Context* dispatch(_Context *c, uintptr_t a[4], uintptr_t *ret) {
   switch (a[0]) {
+    case SYS_read:
+    case SYS_write:
+    case SYS_lseek: *ret = do_call(a[0], a[1], a[2], a[3]); break;
+    case SYS_open: *ret = fs_open((const char *)a[1], a[2], a[3]); break;
+    case SYS_close: *ret = fs_close(a[1]); break;
+    /* either the old break and the increment, or the new break and 0 */
+    case SYS_brk: *ret = mm_brk(a[1], a[2]); break;
+    case SYS_execve: {
+      _Context *cp = proc_execve((const char *)a[1]);
+      *ret = (cp != NULL ? 0 : -1);
+      if (cp != NULL) return cp;
+      break;
+    }
+    case SYS_mmap: *ret = mm_mmap(0, a[1], a[2], a[3]); break;
+    case SYSRING_SETUP:
+      current->ring = (void *)a[1];
+      *ret = 0;
+      break;
+    case SYSRING_ENTER: *ret = ring_enter(); break;
+    case SYS_exit:
+      /* for the apps which exit without drawing */
+      marker_end(MARKER_BOOT);
+      strace_summary();
+      _halt(a[1]);
+      break;
     default: panic("Unhandled syscall ID = %d", a[0]);
   }
 
-  return NULL;
+  c->GPRx = *ret;
+  return c;
+}
+
+_Context* do_syscall(_Context *c) {
+  uintptr_t a[4];
+  a[0] = c->GPR1;
+  a[1] = c->GPR2;
+  a[2] = c->GPR3;
+  a[3] = c->GPR4;
+
+  int slot = sys_slot(a[0]);
+  sys_count[slot] ++;
+  uintptr_t ret = 0;
+#ifndef HAS_STRACE
+  return dispatch(c, a, &ret);
+#else
+  uint32_t start = strace_clock();
+  _Context *next = dispatch(c, a, &ret);
+  uint32_t cost = strace_clock() - start;
+  sys_cost[slot] += cost;
+  trace_ring[nr_trace ++ % NR_TRACE] = (TraceEvent) {
+    .id = a[0], .a1 = a[1], .ret = ret, .cost = cost };
+  return next;
+#endif
 }
@@ -0,0 +1,123 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include "lzdisk.h"
+
+/* Compress a ramdisk into the format of include/lzdisk.h:
+ *
+ *   lzpack RAMDISK OUTPUT
+ *
+ * Each block is compressed greedily, finding the matches with a hash of
+ * the next 4 bytes. */
+
+#define HASH_BITS 12
+
+static inline uint32_t hash4(const uint8_t *p) {
+  uint32_t v;
+  memcpy(&v, p, 4);
+  return (v * 2654435761u) >> (32 - HASH_BITS);
+}
+
+static uint8_t *put_len(uint8_t *out, size_t len) {
+  for (; len >= 255; len -= 255) *out ++ = 255;
+  *out ++ = len;
+  return out;
+}
+
+static uint8_t *put_seq(uint8_t *out, const uint8_t *lit, size_t nr_lit, size_t off, size_t match) {
+  uint8_t *token = out ++;
+  *token = (nr_lit < 15 ? nr_lit : 15) << 4;
+  if (nr_lit >= 15) out = put_len(out, nr_lit - 15);
+  memcpy(out, lit, nr_lit);
+  out += nr_lit;
+  if (match == 0) return out;
+
+  *out ++ = off & 0xff;
+  *out ++ = off >> 8;
+  match -= LZDISK_MIN_MATCH;
+  *token |= (match < 15 ? match : 15);
+  if (match >= 15) out = put_len(out, match - 15);
+  return out;
+}
+
+/* compress `len' bytes of `in' into `out', return the size */
+static size_t compress_block(const uint8_t *in, size_t len, uint8_t *out) {
+  static int32_t last[1 << HASH_BITS];
+  memset(last, -1, sizeof(last));
+  uint8_t *start = out;
+  size_t i = 0, lit = 0;
+  while (i + LZDISK_MIN_MATCH <= len) {
+    uint32_t h = hash4(in + i);
+    int32_t cand = last[h];
+    last[h] = i;
+    if (cand < 0 || memcmp(in + cand, in + i, LZDISK_MIN_MATCH) != 0) {
+      i ++;
+      continue;
+    }
+    size_t match = LZDISK_MIN_MATCH;
+    while (i + match < len && in[cand + match] == in[i + match]) match ++;
+    out = put_seq(out, in + lit, i - lit, i - cand, match);
+    i += match;
+    lit = i;
+  }
+  out = put_seq(out, in + lit, len - lit, 0, 0);
+  return out - start;
+}
+
+static uint8_t *read_file(const char *path, size_t *size) {
+  FILE *fp = fopen(path, "rb");
+  if (fp == NULL) {
+    perror(path);
+    exit(1);
+  }
+  fseek(fp, 0, SEEK_END);
+  *size = ftell(fp);
+  fseek(fp, 0, SEEK_SET);
+  uint8_t *buf = malloc(*size + 1);
+  assert(buf != NULL);
+  if (fread(buf, 1, *size, fp) != *size) {
+    perror(path);
+    exit(1);
+  }
+  fclose(fp);
+  return buf;
+}
+
+int main(int argc, char *argv[]) {
+  if (argc != 3) {
+    fprintf(stderr, "usage: %s RAMDISK OUTPUT\n", argv[0]);
+    return 1;
+  }
+  size_t size;
+  uint8_t *in = read_file(argv[1], &size);
+
+  uint32_t nr_block = (size + LZDISK_BLOCK - 1) / LZDISK_BLOCK;
+  size_t hdr_size = sizeof(LZDiskHeader) + (nr_block + 1) * sizeof(uint32_t);
+  /* a block grows by at most a few bytes when it does not compress */
+  uint8_t *out = malloc(hdr_size + nr_block * (LZDISK_BLOCK + LZDISK_BLOCK / 255 + 16));
+  assert(out != NULL);
+  LZDiskHeader *h = (LZDiskHeader *)out;
+  h->magic = LZDISK_MAGIC;
+  h->size = size;
+  h->nr_block = nr_block;
+
+  size_t pos = hdr_size;
+  uint32_t b;
+  for (b = 0; b < nr_block; b ++) {
+    h->offset[b] = pos;
+    size_t len = (size - b * LZDISK_BLOCK < LZDISK_BLOCK ? size - b * LZDISK_BLOCK : LZDISK_BLOCK);
+    pos += compress_block(in + b * LZDISK_BLOCK, len, out + pos);
+  }
+  h->offset[nr_block] = pos;
+
+  FILE *fp = fopen(argv[2], "wb");
+  if (fp == NULL || fwrite(out, 1, pos, fp) != pos) {
+    perror(argv[2]);
+    return 1;
+  }
+  fclose(fp);
+  printf("%s: %zu -> %zu bytes in %u blocks\n", argv[1], size, pos, nr_block);
+  return 0;
+}
@@ -0,0 +1,89 @@
+#include <ndl.h>
+#include <font.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/* The launcher: a menu of the apps, chosen with the arrow keys and
+ * started with RETURN. It only waits for the keys, so it is not run at
+ * all while the user does nothing. */
+
+#define FONT "/share/fonts/Courier-7.bdf"
+#define W 400
+#define H 300
+
+static const uint32_t COLOR_FG = 0xeeeeee, COLOR_BG = 0x000000;
+
+static const struct {
+  const char *name, *path;
+} apps[] = {
+  { "Terminal", "/bin/nterm" },
+  { "Slider", "/bin/slider" },
+  { "PAL", "/bin/pal" },
+  { "LiteNES", "/bin/litenes" },
+  { "BMP test", "/bin/bmptest" },
+  { "Hello", "/bin/hello" },
+};
+#define NR_APPS (int)(sizeof(apps) / sizeof(apps[0]))
+
+static BDF_Font *font = NULL;
+static uint32_t canvas[W * H];
+
+/* draw the item `i', with the colors swapped if it is chosen */
+static void draw_item(int i, bool chosen) {
+  GlyphAtlas *atlas = (chosen ? glyph_atlas(font, COLOR_BG, COLOR_FG) : glyph_atlas(font, COLOR_FG, COLOR_BG));
+  char line[48];
+  snprintf(line, sizeof(line), " %d. %-20s", i + 1, apps[i].name);
+  int y = (i + 2) * font->h;
+  atlas->draw_str(canvas, W, 0, y, line);
+  NDL_DrawRect(&canvas[y * W], 0, y, W, font->h);
+}
+
+static void start(int i) {
+  char *argv[] = { (char *)apps[i].path, NULL };
+  char *envp[] = { NULL };
+  execve(apps[i].path, argv, envp);
+  fprintf(stderr, "init: can not start %s\n", apps[i].path);
+}
+
+int main() {
+  font = new BDF_Font(FONT);
+  if (font->w <= 0) {
+    fprintf(stderr, "init: can not load %s\n", FONT);
+    return 1;
+  }
+  if (NDL_OpenDisplay(W, H) != 0) {
+    fprintf(stderr, "init: can not open the display\n");
+    return 1;
+  }
+
+  glyph_atlas(font, COLOR_FG, COLOR_BG)->draw_str(canvas, W, 0, 0, "Choose an app with UP/DOWN and RETURN");
+  NDL_DrawRect(canvas, 0, 0, W, H);
+  int chosen = 0;
+  for (int i = 0; i < NR_APPS; i ++) draw_item(i, i == chosen);
+  NDL_Render();
+
+  while (1) {
+    NDL_Event e;
+    NDL_WaitEventTimeout(&e, -1);
+    if (e.type != NDL_EVENT_KEYDOWN) continue;
+
+    int next = chosen;
+    switch (e.data) {
+      case NDL_SCANCODE_UP: case NDL_SCANCODE_K: next = (chosen + NR_APPS - 1) % NR_APPS; break;
+      case NDL_SCANCODE_DOWN: case NDL_SCANCODE_J: next = (chosen + 1) % NR_APPS; break;
+      case NDL_SCANCODE_RETURN: start(chosen); continue;
+      default:
+        if (e.data >= NDL_SCANCODE_1 && e.data < NDL_SCANCODE_1 + NR_APPS) start(e.data - NDL_SCANCODE_1);
+        continue;
+    }
+    if (next == chosen) continue;
+    /* only the two items changed are drawn again */
+    draw_item(chosen, false);
+    draw_item(next, true);
+    chosen = next;
+    NDL_Render();
+  }
+  return 0;
+}
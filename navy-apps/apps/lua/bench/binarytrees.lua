@@ -0,0 +1,22 @@
+-- allocation of many short-lived tables
+local function make(depth)
+  if depth == 0 then return {} end
+  depth = depth - 1
+  return { make(depth), make(depth) }
+end
+
+local function check(tree)
+  if tree[1] == nil then return 1 end
+  return 1 + check(tree[1]) + check(tree[2])
+end
+
+local maxdepth = ... or 10
+local longlived = make(maxdepth)
+local sum = 0
+for depth = 4, maxdepth, 2 do
+  local iters = 2 ^ (maxdepth - depth + 4)
+  for i = 1, iters do
+    sum = sum + check(make(depth))
+  end
+end
+return sum + check(longlived)
@@ -0,0 +1,8 @@
+-- recursive calls
+local function fib(n)
+  if n < 2 then return n end
+  return fib(n - 1) + fib(n - 2)
+end
+
+local n = ... or 24
+return fib(n)
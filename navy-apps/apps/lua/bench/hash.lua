@@ -0,0 +1,22 @@
+-- tables hashed by strings and by numbers
+local n = ... or 20000
+local t = {}
+for i = 1, n do
+  t["key" .. i] = i
+end
+local sum = 0
+for i = 1, n do
+  sum = sum + t["key" .. i]
+end
+for k, v in pairs(t) do
+  if v % 2 == 0 then t[k] = nil end
+end
+
+local h = {}
+for i = 1, n do
+  h[i * 7919 % 65521] = i
+end
+for k, v in pairs(h) do
+  sum = sum + k - v
+end
+return sum
@@ -0,0 +1,29 @@
+-- Run the benchmarks, and print the time taken by each of them:
+--
+--   lua run.lua [dir [scale]]
+--
+-- The time is os.clock(), which is the uptime on Navy.
+
+local dir = arg and arg[1] or "/share/lua/bench"
+local scale = tonumber(arg and arg[2]) or 1
+
+-- name, argument at scale 1, expected result at scale 1
+local benches = {
+  { "fib", 24, 46368 },
+  { "binarytrees", 10, nil },
+  { "strbuild", 2000, nil },
+  { "hash", 20000, nil },
+}
+
+local total = 0
+print(string.format("%-12s %10s  %s", "BENCH", "MS", "RESULT"))
+for _, b in ipairs(benches) do
+  local f = assert(loadfile(dir .. "/" .. b[1] .. ".lua"))
+  local start = os.clock()
+  local result = f(math.floor(b[2] * scale))
+  local ms = math.floor((os.clock() - start) * 1000 + 0.5)
+  total = total + ms
+  local ok = (scale ~= 1 or b[3] == nil or result == b[3])
+  print(string.format("%-12s %10d  %s%s", b[1], ms, tostring(result), ok and "" or " (WRONG)"))
+end
+print(string.format("%-12s %10d", "total", total))
@@ -0,0 +1,13 @@
+-- string building, by concatenation and by table.concat()
+local n = ... or 2000
+local s = ""
+for i = 1, n do
+  s = s .. tostring(i % 10)
+end
+
+local parts = {}
+for i = 1, n * 10 do
+  parts[#parts + 1] = string.format("%d,", i)
+end
+local t = table.concat(parts)
+return #s + #t + #string.rep("ab", n):upper()
@@ -0,0 +1,33 @@
+#ifndef __NTERM_H__
+#define __NTERM_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* The text of the terminal in cells of characters. Each change marks the
+ * cells it touches dirty, and scrolling is counted in `scrolled' instead
+ * of marking the whole screen, so the screen is redrawn by moving the
+ * pixels and drawing the dirty cells only. */
+struct Terminal {
+  int w, h;
+  char *buf;
+  bool *dirty;
+  int cursor_x, cursor_y;
+  int scrolled;  // the lines scrolled up since the last redraw
+
+  Terminal(int w, int h);
+  ~Terminal();
+  char getch(int x, int y) { return buf[y * w + x]; }
+  bool is_dirty(int x, int y) { return dirty[y * w + x]; }
+  void write(const char *s, size_t count);
+  void clear_dirty();
+
+private:
+  void putch(char ch);
+  void set(int x, int y, char ch);
+  void scroll_up();
+};
+
+extern Terminal *term;
+
+#endif
@@ -0,0 +1,159 @@
+#include <nterm.h>
+#include <ndl.h>
+#include <font.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define TERM_W 64
+#define TERM_H 24
+#define FONT "/share/fonts/Courier-7.bdf"
+
+static const uint32_t COLOR_FG = 0xeeeeee, COLOR_BG = 0x000000;
+
+Terminal *term = NULL;
+static BDF_Font *font = NULL;
+static uint32_t *canvas = NULL;
+static int canvas_w, canvas_h;
+/* the pixels of a cell, since NDL_DrawRect() takes a pitch of the width */
+static uint32_t *cell = NULL;
+
+/* Redraw what has changed since the last time: the pixels of the lines
+ * scrolled are moved up at once, then only the dirty cells are drawn. */
+static void refresh() {
+  int fw = font->w, fh = font->h;
+  int scrolled = term->scrolled;
+  if (scrolled > 0 && scrolled < term->h) {
+    memmove(canvas, canvas + scrolled * fh * canvas_w,
+        (term->h - scrolled) * fh * canvas_w * sizeof(canvas[0]));
+  }
+
+  GlyphAtlas *normal = glyph_atlas(font, COLOR_FG, COLOR_BG);
+  GlyphAtlas *cursor = glyph_atlas(font, COLOR_BG, COLOR_FG);
+  for (int y = 0; y < term->h; y ++) {
+    for (int x = 0; x < term->w; x ++) {
+      if (!term->is_dirty(x, y)) continue;
+      bool is_cursor = (x == term->cursor_x && y == term->cursor_y);
+      (is_cursor ? cursor : normal)->draw(canvas, canvas_w, x * fw, y * fh, term->getch(x, y));
+      /* after a scroll, the whole canvas is drawn below */
+      if (scrolled == 0) {
+        for (int i = 0; i < fh; i ++) {
+          memcpy(&cell[i * fw], &canvas[(y * fh + i) * canvas_w + x * fw], fw * sizeof(cell[0]));
+        }
+        NDL_DrawRect(cell, x * fw, y * fh, fw, fh);
+      }
+    }
+  }
+  if (scrolled > 0) NDL_DrawRect(canvas, 0, 0, canvas_w, canvas_h);
+  term->clear_dirty();
+  NDL_Render();
+}
+
+static void print(const char *s) {
+  term->write(s, strlen(s));
+}
+
+/* the characters of the keys without and with shift */
+static char keychar(int scancode, bool shift) {
+  static const struct { int code; char ch, shift_ch; } map[] = {
+#define LETTER(k, c) { NDL_SCANCODE_##k, c, c - 'a' + 'A' },
+    LETTER(A, 'a') LETTER(B, 'b') LETTER(C, 'c') LETTER(D, 'd') LETTER(E, 'e') LETTER(F, 'f')
+    LETTER(G, 'g') LETTER(H, 'h') LETTER(I, 'i') LETTER(J, 'j') LETTER(K, 'k') LETTER(L, 'l')
+    LETTER(M, 'm') LETTER(N, 'n') LETTER(O, 'o') LETTER(P, 'p') LETTER(Q, 'q') LETTER(R, 'r')
+    LETTER(S, 's') LETTER(T, 't') LETTER(U, 'u') LETTER(V, 'v') LETTER(W, 'w') LETTER(X, 'x')
+    LETTER(Y, 'y') LETTER(Z, 'z')
+    { NDL_SCANCODE_1, '1', '!' }, { NDL_SCANCODE_2, '2', '@' }, { NDL_SCANCODE_3, '3', '#' },
+    { NDL_SCANCODE_4, '4', '$' }, { NDL_SCANCODE_5, '5', '%' }, { NDL_SCANCODE_6, '6', '^' },
+    { NDL_SCANCODE_7, '7', '&' }, { NDL_SCANCODE_8, '8', '*' }, { NDL_SCANCODE_9, '9', '(' },
+    { NDL_SCANCODE_0, '0', ')' }, { NDL_SCANCODE_MINUS, '-', '_' }, { NDL_SCANCODE_EQUALS, '=', '+' },
+    { NDL_SCANCODE_GRAVE, '`', '~' }, { NDL_SCANCODE_LEFTBRACKET, '[', '{' },
+    { NDL_SCANCODE_RIGHTBRACKET, ']', '}' }, { NDL_SCANCODE_BACKSLASH, '\\', '|' },
+    { NDL_SCANCODE_SEMICOLON, ';', ':' }, { NDL_SCANCODE_APOSTROPHE, '\'', '"' },
+    { NDL_SCANCODE_COMMA, ',', '<' }, { NDL_SCANCODE_PERIOD, '.', '>' },
+    { NDL_SCANCODE_SLASH, '/', '?' }, { NDL_SCANCODE_SPACE, ' ', ' ' },
+    { NDL_SCANCODE_TAB, '\t', '\t' }, { NDL_SCANCODE_RETURN, '\n', '\n' },
+    { NDL_SCANCODE_BACKSPACE, '\b', '\b' },
+  };
+  for (size_t i = 0; i < sizeof(map) / sizeof(map[0]); i ++) {
+    if (map[i].code == scancode) return (shift ? map[i].shift_ch : map[i].ch);
+  }
+  return '\0';
+}
+
+static void run(char *cmd) {
+  char *argv[16];
+  int argc = 0;
+  for (char *p = strtok(cmd, " "); p && argc < 15; p = strtok(NULL, " ")) argv[argc ++] = p;
+  argv[argc] = NULL;
+  if (argc == 0) return;
+
+  if (strcmp(argv[0], "echo") == 0) {
+    for (int i = 1; i < argc; i ++) {
+      print(argv[i]);
+      print(i + 1 < argc ? " " : "");
+    }
+    print("\n");
+    return;
+  }
+  char *envp[] = { NULL };
+  execve(argv[0], argv, envp);
+  print("sh: command not found: ");
+  print(argv[0]);
+  print("\n");
+}
+
+int main(int argc, char *argv[]) {
+  font = new BDF_Font(FONT);
+  if (font->w <= 0) {
+    fprintf(stderr, "nterm: can not load %s\n", FONT);
+    return 1;
+  }
+  canvas_w = TERM_W * font->w;
+  canvas_h = TERM_H * font->h;
+  canvas = (uint32_t *)calloc(canvas_w * canvas_h, sizeof(uint32_t));
+  cell = (uint32_t *)malloc(font->w * font->h * sizeof(uint32_t));
+  if (NDL_OpenDisplay(canvas_w, canvas_h) != 0) {
+    fprintf(stderr, "nterm: can not open the display\n");
+    return 1;
+  }
+  term = new Terminal(TERM_W, TERM_H);
+
+  char line[256];
+  int len = 0;
+  bool shift = false;
+  print("$ ");
+  refresh();
+  while (1) {
+    NDL_Event e;
+    /* nothing to do until a key */
+    NDL_WaitEventTimeout(&e, -1);
+    if (e.type == NDL_EVENT_TIMER) continue;
+    if (e.data == NDL_SCANCODE_LSHIFT || e.data == NDL_SCANCODE_RSHIFT) {
+      shift = (e.type == NDL_EVENT_KEYDOWN);
+      continue;
+    }
+    if (e.type != NDL_EVENT_KEYDOWN) continue;
+
+    char ch = keychar(e.data, shift);
+    if (ch == '\0') continue;
+    if (ch == '\b') {
+      if (len == 0) continue;
+      len --;
+    }
+    else if (ch == '\n') {
+      print("\n");
+      line[len] = '\0';
+      len = 0;
+      run(line);
+      print("$ ");
+      refresh();
+      continue;
+    }
+    else if (len < (int)sizeof(line) - 1) line[len ++] = ch;
+    else continue;
+    term->write(&ch, 1);
+    refresh();
+  }
+  return 0;
+}
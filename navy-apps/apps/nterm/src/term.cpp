@@ -0,0 +1,71 @@
+#include <nterm.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+Terminal::Terminal(int w, int h): w(w), h(h) {
+  buf = (char *)malloc(w * h);
+  dirty = (bool *)malloc(w * h * sizeof(bool));
+  assert(buf && dirty);
+  memset(buf, ' ', w * h);
+  memset(dirty, true, w * h * sizeof(bool));
+  cursor_x = cursor_y = 0;
+  scrolled = 0;
+}
+
+Terminal::~Terminal() {
+  free(buf);
+  free(dirty);
+}
+
+void Terminal::set(int x, int y, char ch) {
+  if (buf[y * w + x] == ch) return;
+  buf[y * w + x] = ch;
+  dirty[y * w + x] = true;
+}
+
+/* The cells move up with their dirty marks, since their pixels are
+ * moved up in the same way when they are redrawn. */
+void Terminal::scroll_up() {
+  memmove(buf, buf + w, (h - 1) * w);
+  memmove(dirty, dirty + w, (h - 1) * w * sizeof(bool));
+  memset(buf + (h - 1) * w, ' ', w);
+  memset(dirty + (h - 1) * w, true, w * sizeof(bool));
+  scrolled ++;
+}
+
+void Terminal::putch(char ch) {
+  switch (ch) {
+    case '\n': cursor_x = 0; cursor_y ++; break;
+    case '\r': cursor_x = 0; break;
+    case '\b':
+      if (cursor_x > 0) {
+        cursor_x --;
+        set(cursor_x, cursor_y, ' ');
+      }
+      break;
+    case '\t':
+      do { putch(' '); } while (cursor_x % 8 != 0);
+      return;
+    default:
+      set(cursor_x, cursor_y, ch);
+      if (++ cursor_x == w) { cursor_x = 0; cursor_y ++; }
+      break;
+  }
+  if (cursor_y == h) {
+    scroll_up();
+    cursor_y = h - 1;
+  }
+}
+
+void Terminal::write(const char *s, size_t count) {
+  /* the cell of the cursor is drawn differently */
+  dirty[cursor_y * w + cursor_x] = true;
+  for (size_t i = 0; i < count; i ++) putch(s[i]);
+  dirty[cursor_y * w + cursor_x] = true;
+}
+
+void Terminal::clear_dirty() {
+  memset(dirty, false, w * h * sizeof(bool));
+  scrolled = 0;
+}
@@ -0,0 +1,52 @@
+#ifndef __NWM_H__
+#define __NWM_H__
+
+#include <stdint.h>
+
+struct Rect {
+  int x, y, w, h;
+
+  bool empty() const { return w <= 0 || h <= 0; }
+  Rect intersect(const Rect &r) const;
+  Rect unite(const Rect &r) const;
+  bool overlaps(const Rect &r) const { return !intersect(r).empty(); }
+};
+
+struct Window {
+  Rect rect;  // on the screen
+  uint32_t *pixels;
+  Window *below;  // the next one in the stacking order
+};
+
+/* The windows are composited into the screen only where they are damaged.
+ * The damaged rectangles of the screen are merged when they overlap, and
+ * each pixel of them is copied once from the topmost window there, so
+ * what is covered by the windows above is skipped. present() writes the
+ * composited rectangles to /dev/fb and syncs once. */
+struct Compositor {
+  int screen_w, screen_h;
+  uint32_t bg;
+  uint32_t *screen;  // the composited screen
+  Window *top;
+
+  Compositor(int w, int h, uint32_t bg);
+  ~Compositor();
+  void add(Window *win);     // at the top
+  void remove(Window *win);
+  void raise(Window *win);
+  void move(Window *win, int x, int y);
+  /* the pixels of `r' in the window (its own coordinates) have changed */
+  void damage(Window *win, const Rect &r);
+  void damage_screen(const Rect &r);
+  void present();
+
+private:
+  static const int NR_DAMAGE = 16;
+  Rect damaged[NR_DAMAGE];
+  int nr_damaged;
+  int fb_fd, fbsync_fd;
+
+  void compose(const Rect &r);
+};
+
+#endif
@@ -0,0 +1,139 @@
+#include <nwm.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+static inline int min(int a, int b) { return a < b ? a : b; }
+static inline int max(int a, int b) { return a > b ? a : b; }
+
+Rect Rect::intersect(const Rect &r) const {
+  int x0 = max(x, r.x), y0 = max(y, r.y);
+  int x1 = min(x + w, r.x + r.w), y1 = min(y + h, r.y + r.h);
+  return Rect { x0, y0, x1 - x0, y1 - y0 };
+}
+
+Rect Rect::unite(const Rect &r) const {
+  if (empty()) return r;
+  if (r.empty()) return *this;
+  int x0 = min(x, r.x), y0 = min(y, r.y);
+  int x1 = max(x + w, r.x + r.w), y1 = max(y + h, r.y + r.h);
+  return Rect { x0, y0, x1 - x0, y1 - y0 };
+}
+
+Compositor::Compositor(int w, int h, uint32_t bg): screen_w(w), screen_h(h), bg(bg) {
+  screen = (uint32_t *)malloc(w * h * sizeof(uint32_t));
+  assert(screen);
+  top = NULL;
+  nr_damaged = 0;
+  fb_fd = open("/dev/fb", O_WRONLY);
+  fbsync_fd = open("/dev/fbsync", O_WRONLY);
+  damage_screen(Rect { 0, 0, w, h });
+}
+
+Compositor::~Compositor() {
+  free(screen);
+  if (fb_fd >= 0) close(fb_fd);
+  if (fbsync_fd >= 0) close(fbsync_fd);
+}
+
+void Compositor::add(Window *win) {
+  win->below = top;
+  top = win;
+  damage_screen(win->rect);
+}
+
+void Compositor::remove(Window *win) {
+  Window **p;
+  for (p = &top; *p && *p != win; p = &(*p)->below) ;
+  if (*p == NULL) return;
+  *p = win->below;
+  damage_screen(win->rect);
+}
+
+void Compositor::raise(Window *win) {
+  if (top == win) return;
+  remove(win);
+  add(win);
+}
+
+/* only the parts uncovered and covered by the move are composited */
+void Compositor::move(Window *win, int x, int y) {
+  damage_screen(win->rect);
+  win->rect.x = x;
+  win->rect.y = y;
+  damage_screen(win->rect);
+}
+
+void Compositor::damage(Window *win, const Rect &r) {
+  damage_screen(Rect { win->rect.x + r.x, win->rect.y + r.y, r.w, r.h }.intersect(win->rect));
+}
+
+/* Merge `r' with the damaged rectangles it overlaps, and again with those
+ * overlapping the result. When there is no room, it is merged into the
+ * first one. */
+void Compositor::damage_screen(const Rect &rect) {
+  Rect r = rect.intersect(Rect { 0, 0, screen_w, screen_h });
+  if (r.empty()) return;
+  bool merged = true;
+  while (merged) {
+    merged = false;
+    for (int i = 0; i < nr_damaged; i ++) {
+      if (!damaged[i].overlaps(r)) continue;
+      r = r.unite(damaged[i]);
+      damaged[i] = damaged[-- nr_damaged];
+      merged = true;
+      break;
+    }
+  }
+  if (nr_damaged == NR_DAMAGE) {
+    damaged[0] = damaged[0].unite(r);
+    return;
+  }
+  damaged[nr_damaged ++] = r;
+}
+
+/* Each row of `r' is cut into spans, each from the topmost window there
+ * up to its right edge or to the left edge of a window above it. */
+void Compositor::compose(const Rect &r) {
+  for (int y = r.y; y < r.y + r.h; y ++) {
+    int x = r.x, x_end = r.x + r.w;
+    while (x < x_end) {
+      Window *win;
+      int end = x_end;
+      for (win = top; win; win = win->below) {
+        const Rect &wr = win->rect;
+        if (y < wr.y || y >= wr.y + wr.h) continue;
+        if (x >= wr.x && x < wr.x + wr.w) break;
+        /* a window above starting later ends the span of those below */
+        if (wr.x > x) end = min(end, wr.x);
+      }
+      uint32_t *dst = &screen[y * screen_w + x];
+      if (win) {
+        end = min(end, win->rect.x + win->rect.w);
+        const Rect &wr = win->rect;
+        memcpy(dst, &win->pixels[(y - wr.y) * wr.w + (x - wr.x)], (end - x) * sizeof(uint32_t));
+      }
+      else {
+        for (int i = 0; i < end - x; i ++) dst[i] = bg;
+      }
+      x = end;
+    }
+  }
+}
+
+void Compositor::present() {
+  if (nr_damaged == 0) return;
+  for (int i = 0; i < nr_damaged; i ++) {
+    const Rect &r = damaged[i];
+    compose(r);
+    if (fb_fd < 0) continue;
+    for (int y = r.y; y < r.y + r.h; y ++) {
+      lseek(fb_fd, (y * screen_w + r.x) * sizeof(uint32_t), SEEK_SET);
+      write(fb_fd, &screen[y * screen_w + r.x], r.w * sizeof(uint32_t));
+    }
+  }
+  nr_damaged = 0;
+  if (fbsync_fd >= 0) write(fbsync_fd, "0", 1);
+}
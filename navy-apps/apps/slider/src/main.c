@@ -0,0 +1,136 @@
+#include <ndl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#define W 400
+#define H 300
+
+#define PATH "/share/slides/slides-%d.bmp"
+
+/* The slides around the current one are decoded ahead of time, so that
+ * turning a page is one NDL_DrawRect() of decoded pixels. The cache keeps
+ * NR_CACHE slides, and is refilled with the next and the previous slide
+ * on the timer events, i.e. while the user is reading the current one.
+ * The slide farthest from the current one is evicted first. */
+
+#define NR_CACHE 3
+
+typedef struct {
+  int id;     // -1 if empty
+  int w, h;
+  uint32_t *pixels;
+} Slide;
+
+static Slide cache[NR_CACHE];
+static int cur = 0, nr_slides = 0;
+
+static Slide *lookup(int id) {
+  int i;
+  for (i = 0; i < NR_CACHE; i ++) {
+    if (cache[i].id == id) return &cache[i];
+  }
+  return NULL;
+}
+
+static Slide *load(int id) {
+  Slide *s = lookup(id);
+  if (s != NULL) return s;
+
+  /* evict an empty entry, or the one farthest from the current slide */
+  s = &cache[0];
+  int i;
+  for (i = 0; i < NR_CACHE && s->id >= 0; i ++) {
+    if (cache[i].id < 0 || abs(cache[i].id - cur) > abs(s->id - cur)) s = &cache[i];
+  }
+  free(s->pixels);
+  s->id = -1;
+
+  char path[64];
+  sprintf(path, PATH, id);
+  s->pixels = NULL;
+  if (NDL_LoadBMP(path, NULL, 0, &s->w, &s->h) != 0) return NULL;
+  s->pixels = malloc(s->w * s->h * sizeof(uint32_t));
+  if (s->pixels == NULL) return NULL;
+  if (NDL_LoadBMP(path, s->pixels, s->w, NULL, NULL) != 0) return NULL;
+  s->id = id;
+  return s;
+}
+
+static int count_slides() {
+  int n = 0;
+  char path[64];
+  for (;; n ++) {
+    sprintf(path, PATH, n);
+    FILE *fp = fopen(path, "r");
+    if (!fp) return n;
+    fclose(fp);
+  }
+}
+
+static void render() {
+  Slide *s = load(cur);
+  if (s == NULL) return;
+  NDL_DrawRect(s->pixels, (W - s->w) / 2, (H - s->h) / 2, s->w, s->h);
+  NDL_Render();
+}
+
+static bool need_next() { return cur + 1 < nr_slides && lookup(cur + 1) == NULL; }
+static bool need_prev() { return cur > 0 && lookup(cur - 1) == NULL; }
+
+/* decode at most one neighbour of the current slide, not to delay the
+ * next key too long */
+static void prefetch() {
+  if (need_next()) load(cur + 1);
+  else if (need_prev()) load(cur - 1);
+}
+
+static void go(int id) {
+  if (id < 0) id = 0;
+  if (id >= nr_slides) id = nr_slides - 1;
+  if (id == cur) return;
+  cur = id;
+  render();
+}
+
+int main() {
+  int i;
+  for (i = 0; i < NR_CACHE; i ++) cache[i].id = -1;
+
+  nr_slides = count_slides();
+  if (nr_slides == 0) {
+    printf("no slides found in " PATH "\n", 0);
+    return 1;
+  }
+  if (NDL_OpenDisplay(W, H) != 0) {
+    printf("cannot open the display\n");
+    return 1;
+  }
+  render();
+
+  NDL_Event e;
+  /* wake up at the next timer interrupt only while there is something
+   * to prefetch, otherwise sleep until a key */
+  while (NDL_WaitEventTimeout(&e, (need_next() || need_prev() ? 0 : -1)) == 0) {
+    if (e.type == NDL_EVENT_TIMER) {
+      prefetch();
+      continue;
+    }
+    if (e.type != NDL_EVENT_KEYDOWN) continue;
+    switch (e.data) {
+      case NDL_SCANCODE_J: case NDL_SCANCODE_DOWN: case NDL_SCANCODE_PAGEDOWN:
+      case NDL_SCANCODE_SPACE: go(cur + 1); break;
+      case NDL_SCANCODE_K: case NDL_SCANCODE_UP: case NDL_SCANCODE_PAGEUP:
+        go(cur - 1); break;
+      case NDL_SCANCODE_G: case NDL_SCANCODE_HOME: go(0); break;
+      case NDL_SCANCODE_END: go(nr_slides - 1); break;
+      case NDL_SCANCODE_Q: case NDL_SCANCODE_ESCAPE:
+        NDL_CloseDisplay();
+        return 0;
+    }
+  }
+
+  NDL_CloseDisplay();
+  return 0;
+}
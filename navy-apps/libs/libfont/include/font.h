@@ -0,0 +1,40 @@
+#ifndef __FONT_H__
+#define __FONT_H__
+
+#include <stdint.h>
+
+/* A fixed-width font in the BDF format. The rows of a glyph are bit
+ * masks, with bit i for the i-th pixel from the left. */
+struct BDF_Font {
+  char *name;
+  int w, h, count;
+  int off_x, off_y;  // of the bounding box of the font
+  uint32_t *font[256];
+
+  BDF_Font(const char *fname);
+  ~BDF_Font();
+  void create(uint32_t ch, int *bbx, uint32_t *bitmap, int count);
+};
+
+/* The glyphs of a font in one pair of colors, rendered into pixels the
+ * first time they are drawn, so drawing a character is copying h rows of
+ * w pixels. */
+struct GlyphAtlas {
+  BDF_Font *font;
+  uint32_t fg, bg;
+  uint32_t *pixels;  // 256 glyphs of w * h pixels each
+  bool rendered[256];
+
+  GlyphAtlas(BDF_Font *font, uint32_t fg, uint32_t bg);
+  ~GlyphAtlas();
+  const uint32_t *glyph(uint8_t ch);
+  /* draw at (x, y) of `dst' with `pitch' pixels in a row */
+  void draw(uint32_t *dst, int pitch, int x, int y, uint8_t ch);
+  void draw_str(uint32_t *dst, int pitch, int x, int y, const char *s);
+};
+
+/* The atlas of `font' in `fg' on `bg', kept for the later calls. It is
+ * dropped when 8 other pairs of colors have been used since. */
+GlyphAtlas *glyph_atlas(BDF_Font *font, uint32_t fg, uint32_t bg);
+
+#endif
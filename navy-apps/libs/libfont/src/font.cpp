@@ -0,0 +1,134 @@
+#include <font.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+BDF_Font::BDF_Font(const char *fname) {
+  name = NULL;
+  w = h = count = off_x = off_y = 0;
+  memset(font, 0, sizeof(font));
+
+  FILE *fp = fopen(fname, "r");
+  if (!fp) return;
+
+  char line[256];
+  uint32_t ch = 0, bitmap[32];
+  int bbx[4] = {}, nr_row = 0;
+  bool in_bitmap = false;
+  while (fgets(line, sizeof(line), fp)) {
+    if (in_bitmap) {
+      if (strncmp(line, "ENDCHAR", 7) == 0) {
+        create(ch, bbx, bitmap, nr_row);
+        in_bitmap = false;
+      }
+      else if (nr_row < 32) {
+        bitmap[nr_row ++] = strtoul(line, NULL, 16);
+      }
+      continue;
+    }
+
+    if (strncmp(line, "FONT ", 5) == 0) {
+      line[strcspn(line, "\r\n")] = '\0';
+      name = strdup(line + 5);
+    }
+    else if (strncmp(line, "FONTBOUNDINGBOX", 15) == 0) {
+      sscanf(line + 15, "%d%d%d%d", &w, &h, &off_x, &off_y);
+    }
+    else if (strncmp(line, "CHARS ", 6) == 0) count = atoi(line + 6);
+    else if (strncmp(line, "ENCODING", 8) == 0) ch = atoi(line + 8);
+    else if (strncmp(line, "BBX", 3) == 0) {
+      sscanf(line + 3, "%d%d%d%d", &bbx[0], &bbx[1], &bbx[2], &bbx[3]);
+    }
+    else if (strncmp(line, "BITMAP", 6) == 0) {
+      in_bitmap = true;
+      nr_row = 0;
+    }
+  }
+  fclose(fp);
+}
+
+BDF_Font::~BDF_Font() {
+  free(name);
+  for (int i = 0; i < 256; i ++) free(font[i]);
+}
+
+/* place the glyph of `bbx' (w, h, x, y) into the bounding box of the font */
+void BDF_Font::create(uint32_t ch, int *bbx, uint32_t *bitmap, int count) {
+  if (ch >= 256 || w <= 0 || h <= 0 || w > 32) return;
+  uint32_t *g = (uint32_t *)calloc(h, sizeof(uint32_t));
+  assert(g);
+  int bits = (bbx[0] + 7) / 8 * 8;  // the hex digits of a row are whole bytes
+  int top = (h + off_y) - (bbx[1] + bbx[3]);
+  for (int r = 0; r < count && r < bbx[1]; r ++) {
+    int y = top + r;
+    if (y < 0 || y >= h) continue;
+    for (int c = 0; c < bbx[0]; c ++) {
+      int x = bbx[2] - off_x + c;
+      if (x < 0 || x >= w) continue;
+      if ((bitmap[r] >> (bits - 1 - c)) & 1) g[y] |= 1u << x;
+    }
+  }
+  free(font[ch]);
+  font[ch] = g;
+}
+
+GlyphAtlas::GlyphAtlas(BDF_Font *font, uint32_t fg, uint32_t bg):
+  font(font), fg(fg), bg(bg) {
+  pixels = (uint32_t *)malloc(256 * font->w * font->h * sizeof(uint32_t));
+  assert(pixels);
+  memset(rendered, 0, sizeof(rendered));
+}
+
+GlyphAtlas::~GlyphAtlas() {
+  free(pixels);
+}
+
+const uint32_t *GlyphAtlas::glyph(uint8_t ch) {
+  int w = font->w, h = font->h;
+  uint32_t *p = &pixels[ch * w * h];
+  if (!rendered[ch]) {
+    const uint32_t *g = font->font[ch];
+    for (int y = 0; y < h; y ++) {
+      uint32_t row = (g ? g[y] : 0);
+      for (int x = 0; x < w; x ++) p[y * w + x] = ((row >> x) & 1 ? fg : bg);
+    }
+    rendered[ch] = true;
+  }
+  return p;
+}
+
+void GlyphAtlas::draw(uint32_t *dst, int pitch, int x, int y, uint8_t ch) {
+  int w = font->w, h = font->h;
+  const uint32_t *p = glyph(ch);
+  for (int i = 0; i < h; i ++) {
+    memcpy(&dst[(y + i) * pitch + x], &p[i * w], w * sizeof(uint32_t));
+  }
+}
+
+void GlyphAtlas::draw_str(uint32_t *dst, int pitch, int x, int y, const char *s) {
+  for (; *s; s ++, x += font->w) draw(dst, pitch, x, y, *s);
+}
+
+/* The atlases are few, one for each pair of colors in use. The least
+ * recently used one is dropped when there are too many. */
+#define NR_ATLAS 8
+
+static GlyphAtlas *atlases[NR_ATLAS];
+
+GlyphAtlas *glyph_atlas(BDF_Font *font, uint32_t fg, uint32_t bg) {
+  int i;
+  for (i = 0; i < NR_ATLAS && atlases[i]; i ++) {
+    GlyphAtlas *a = atlases[i];
+    if (a->font == font && a->fg == fg && a->bg == bg) {
+      /* move to the front */
+      memmove(&atlases[1], &atlases[0], i * sizeof(atlases[0]));
+      atlases[0] = a;
+      return a;
+    }
+  }
+  if (i == NR_ATLAS) delete atlases[-- i];
+  memmove(&atlases[1], &atlases[0], i * sizeof(atlases[0]));
+  atlases[0] = new GlyphAtlas(font, fg, bg);
+  return atlases[0];
+}
@@ -0,0 +1,60 @@
+#ifndef __NDL_H__
+#define __NDL_H__
+
+#include <stdint.h>
+
+#define NDL_KEYS(_) \
+  _(ESCAPE) _(F1) _(F2) _(F3) _(F4) _(F5) _(F6) _(F7) _(F8) _(F9) _(F10) _(F11) _(F12) \
+  _(GRAVE) _(1) _(2) _(3) _(4) _(5) _(6) _(7) _(8) _(9) _(0) _(MINUS) _(EQUALS) _(BACKSPACE) \
+  _(TAB) _(Q) _(W) _(E) _(R) _(T) _(Y) _(U) _(I) _(O) _(P) _(LEFTBRACKET) _(RIGHTBRACKET) _(BACKSLASH) \
+  _(CAPSLOCK) _(A) _(S) _(D) _(F) _(G) _(H) _(J) _(K) _(L) _(SEMICOLON) _(APOSTROPHE) _(RETURN) \
+  _(LSHIFT) _(Z) _(X) _(C) _(V) _(B) _(N) _(M) _(COMMA) _(PERIOD) _(SLASH) _(RSHIFT) \
+  _(LCTRL) _(APPLICATION) _(LALT) _(SPACE) _(RALT) _(RCTRL) \
+  _(UP) _(DOWN) _(LEFT) _(RIGHT) _(INSERT) _(DELETE) _(HOME) _(END) _(PAGEUP) _(PAGEDOWN)
+
+#define NDL_KEYNAME(k) NDL_SCANCODE_##k,
+
+enum {
+  NDL_SCANCODE_NONE = 0,
+  NDL_KEYS(NDL_KEYNAME)
+};
+
+enum {
+  NDL_EVENT_TIMER = 1,
+  NDL_EVENT_KEYDOWN,
+  NDL_EVENT_KEYUP,
+};
+
+typedef struct {
+  int type;
+  int data;  // the scancode of a key, or the time in ms
+} NDL_Event;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Open a canvas of w x h pixels in the middle of the screen, the whole
+ * screen if w and h are 0. */
+int NDL_OpenDisplay(int w, int h);
+int NDL_CloseDisplay();
+/* Draw the pixels into the canvas, shown by the next NDL_Render(). */
+int NDL_DrawRect(uint32_t *pixels, int x, int y, int w, int h);
+int NDL_Render();
+/* Wait for a key, or a timer event at the next timer interrupt. */
+int NDL_WaitEvent(NDL_Event *event);
+/* Wait for a key, or a timer event after `timeout_ms', which never comes
+ * if it is negative. The process is not run while it waits. */
+int NDL_WaitEventTimeout(NDL_Event *event, int timeout_ms);
+
+/* Decode a 24-bit BMP into `dst' of `pitch' pixels per row, and return
+ * its size in *w and *h. With `dst' NULL, only the size is returned. */
+int NDL_LoadBMP(const char *filename, uint32_t *dst, int pitch, int *w, int *h);
+/* Decode a 24-bit BMP row by row into the canvas at (x, y). */
+int NDL_DrawBMP(const char *filename, int x, int y);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,105 @@
+#include <ndl.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/* The BMP is decoded one row at a time as it is read: the 24-bit pixels
+ * of a row are read into the end of the destination row, then converted
+ * to 32-bit in place from its end backwards, 4 pixels (3 words) at a
+ * time. No buffer of the whole image is needed, and NDL_DrawBMP() only
+ * needs one row. */
+
+struct BitmapHeader {
+  uint16_t type;
+  uint32_t filesize;
+  uint32_t resv_1;
+  uint32_t offset;
+  uint32_t ih_size;
+  int32_t width;
+  int32_t height;   // negative for top-down rows
+  uint16_t planes;
+  uint16_t bitcount; // 1, 4, 8, or 24
+  uint32_t compression;
+  uint32_t sizeimg;
+  uint32_t xres, yres;
+  uint32_t clrused, clrimportant;
+} __attribute__((packed));
+
+static FILE *bmp_open(const char *filename, struct BitmapHeader *hdr) {
+  FILE *fp = fopen(filename, "r");
+  if (!fp) return NULL;
+  if (fread(hdr, sizeof(*hdr), 1, fp) != 1 || hdr->type != 0x4d42 ||
+      hdr->bitcount != 24 || hdr->compression != 0 || hdr->width <= 0 ||
+      hdr->height == 0 || fseek(fp, hdr->offset, SEEK_SET) != 0) {
+    fclose(fp);
+    return NULL;
+  }
+  return fp;
+}
+
+/* read the next row of `w' pixels into `row', which has room for them
+ * in 32-bit */
+static int bmp_read_row(FILE *fp, uint32_t *row, int w) {
+  int raw = w * 3;
+  int pad = ((raw + 3) & ~0x3) - raw;
+  if (fread(row, 1, raw, fp) != raw) return -1;
+  if (pad > 0) fseek(fp, pad, SEEK_CUR);
+
+  uint8_t *b = (uint8_t *)row;
+  int j = w;
+  for (; j % 4 != 0; ) {
+    j --;
+    uint8_t blue = b[j * 3], green = b[j * 3 + 1], red = b[j * 3 + 2];
+    row[j] = (red << 16) | (green << 8) | blue;
+  }
+  /* B0 G0 R0 B1 | G1 R1 B2 G2 | R2 B3 G3 R3 in little endian words */
+  for (j -= 4; j >= 0; j -= 4) {
+    uint32_t *src = &row[j / 4 * 3];
+    uint32_t w0 = src[0], w1 = src[1], w2 = src[2];
+    row[j + 3] = w2 >> 8;
+    row[j + 2] = (w1 >> 16) | ((w2 & 0xff) << 16);
+    row[j + 1] = (w0 >> 24) | ((w1 & 0xffff) << 8);
+    row[j + 0] = w0 & 0xffffff;
+  }
+  return 0;
+}
+
+int NDL_LoadBMP(const char *filename, uint32_t *dst, int pitch, int *w, int *h) {
+  struct BitmapHeader hdr;
+  FILE *fp = bmp_open(filename, &hdr);
+  if (!fp) return -1;
+
+  int width = hdr.width, height = abs(hdr.height);
+  if (w) *w = width;
+  if (h) *h = height;
+  if (dst != NULL) {
+    int i;
+    for (i = 0; i < height; i ++) {
+      int y = (hdr.height > 0 ? height - 1 - i : i);
+      if (bmp_read_row(fp, &dst[y * pitch], width) != 0) {
+        fclose(fp);
+        return -1;
+      }
+    }
+  }
+  fclose(fp);
+  return 0;
+}
+
+int NDL_DrawBMP(const char *filename, int x, int y) {
+  struct BitmapHeader hdr;
+  FILE *fp = bmp_open(filename, &hdr);
+  if (!fp) return -1;
+
+  int width = hdr.width, height = abs(hdr.height);
+  uint32_t *row = malloc(width * sizeof(row[0]));
+  int ret = (row == NULL ? -1 : 0);
+  int i;
+  for (i = 0; i < height && ret == 0; i ++) {
+    int dy = (hdr.height > 0 ? height - 1 - i : i);
+    ret = bmp_read_row(fp, row, width);
+    if (ret == 0) NDL_DrawRect(row, x, y + dy, width, 1);
+  }
+  free(row);
+  fclose(fp);
+  return ret;
+}
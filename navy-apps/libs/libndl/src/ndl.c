@@ -0,0 +1,213 @@
+#include <ndl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+/* The canvas is a region of /dev/fb mapped by mmap() if the kernel maps
+ * it, or else a back buffer in the memory of the application. Drawing only
+ * copies the pixels into it and grows the dirty rectangle, and
+ * NDL_Render() presents the frame. With the mapping, the pixels are in the
+ * framebuffer already. Without it, only the rows of the dirty rectangle
+ * are written to /dev/fb, as one write() when they span the whole width
+ * of the screen. Then /dev/fbsync is written once. Nothing is written for
+ * a frame which has not changed. */
+
+/* from libos, which ignores `prot' and `flags' */
+void *mmap(void *addr, size_t len, int prot, int flags, int fd, off_t offset);
+int munmap(void *addr, size_t len);
+#define MAP_FAILED ((void *)-1)
+
+static int fb_fd = -1, fbsync_fd = -1, evt_fd = -1;
+/* the timeout of /dev/events last set, see evt_set_timeout() */
+static int evt_timeout = 0;
+static int screen_w = 0, screen_h = 0;
+static int canvas_w = 0, canvas_h = 0, pad_x = 0, pad_y = 0;
+static uint32_t *canvas = NULL;
+/* the pixels between two rows of the canvas */
+static int canvas_pitch = 0;
+/* the mapping of /dev/fb, MAP_FAILED if it is not mapped */
+static uint32_t *fb = MAP_FAILED;
+
+/* the dirty rectangle of the canvas, empty if dirty_x0 >= dirty_x1 */
+static int dirty_x0 = 0, dirty_y0 = 0, dirty_x1 = 0, dirty_y1 = 0;
+
+static const char *keys[] = {
+  "NONE",
+#define NDL_KEYSTR(k) #k,
+  NDL_KEYS(NDL_KEYSTR)
+};
+
+static void get_display_info() {
+  char buf[128];
+  int fd = open("/proc/dispinfo", O_RDONLY);
+  if (fd < 0) return;
+  int n = read(fd, buf, sizeof(buf) - 1);
+  close(fd);
+  if (n <= 0) return;
+  buf[n] = '\0';
+
+  char *p;
+  for (p = strtok(buf, "\n"); p != NULL; p = strtok(NULL, "\n")) {
+    char key[32];
+    int val;
+    if (sscanf(p, " %31[^: ] : %d", key, &val) != 2) continue;
+    if (strcmp(key, "WIDTH") == 0) screen_w = val;
+    else if (strcmp(key, "HEIGHT") == 0) screen_h = val;
+  }
+}
+
+int NDL_OpenDisplay(int w, int h) {
+  get_display_info();
+  if (screen_w <= 0 || screen_h <= 0) return -1;
+  if (w == 0 && h == 0) {
+    w = screen_w;
+    h = screen_h;
+  }
+  if (w > screen_w || h > screen_h) return -1;
+
+  if (canvas != NULL) NDL_CloseDisplay();
+  canvas_w = w;
+  canvas_h = h;
+  pad_x = (screen_w - w) / 2;
+  pad_y = (screen_h - h) / 2;
+  dirty_x0 = dirty_x1 = 0;
+
+  fb_fd = open("/dev/fb", O_RDWR);
+  if (fb_fd >= 0) {
+    fb = mmap(NULL, screen_w * screen_h * sizeof(fb[0]), 0, 0, fb_fd, 0);
+  }
+  if (fb != MAP_FAILED) {
+    canvas = &fb[pad_y * screen_w + pad_x];
+    canvas_pitch = screen_w;
+  }
+  else {
+    canvas = calloc(w * h, sizeof(canvas[0]));
+    canvas_pitch = w;
+  }
+  if (canvas == NULL) {
+    NDL_CloseDisplay();
+    return -1;
+  }
+
+  fbsync_fd = open("/dev/fbsync", O_WRONLY);
+  evt_fd = open("/dev/events", O_RDWR);
+  evt_timeout = 0;
+  return 0;
+}
+
+int NDL_CloseDisplay() {
+  if (fb != MAP_FAILED) munmap(fb, screen_w * screen_h * sizeof(fb[0]));
+  else free(canvas);
+  fb = MAP_FAILED;
+  canvas = NULL;
+  if (fb_fd >= 0) close(fb_fd);
+  if (fbsync_fd >= 0) close(fbsync_fd);
+  if (evt_fd >= 0) close(evt_fd);
+  fb_fd = fbsync_fd = evt_fd = -1;
+  return 0;
+}
+
+int NDL_DrawRect(uint32_t *pixels, int x, int y, int w, int h) {
+  if (canvas == NULL) return -1;
+  /* clip by the canvas, keeping the pitch of `pixels' */
+  int pitch = w;
+  if (x < 0) { pixels -= x; w += x; x = 0; }
+  if (y < 0) { pixels -= y * pitch; h += y; y = 0; }
+  if (x + w > canvas_w) w = canvas_w - x;
+  if (y + h > canvas_h) h = canvas_h - y;
+  if (w <= 0 || h <= 0) return 0;
+
+  int i;
+  for (i = 0; i < h; i ++) {
+    memcpy(&canvas[(y + i) * canvas_pitch + x], &pixels[i * pitch], w * sizeof(canvas[0]));
+  }
+
+  if (dirty_x0 >= dirty_x1) {
+    dirty_x0 = x; dirty_y0 = y; dirty_x1 = x + w; dirty_y1 = y + h;
+    return 0;
+  }
+  if (x < dirty_x0) dirty_x0 = x;
+  if (y < dirty_y0) dirty_y0 = y;
+  if (x + w > dirty_x1) dirty_x1 = x + w;
+  if (y + h > dirty_y1) dirty_y1 = y + h;
+  return 0;
+}
+
+/* write the dirty rows of the back buffer to /dev/fb */
+static void write_dirty() {
+  int w = dirty_x1 - dirty_x0, h = dirty_y1 - dirty_y0;
+  if (w == screen_w) {
+    /* the rows are contiguous in /dev/fb */
+    lseek(fb_fd, (dirty_y0 + pad_y) * screen_w * sizeof(canvas[0]), SEEK_SET);
+    write(fb_fd, &canvas[dirty_y0 * canvas_w], w * h * sizeof(canvas[0]));
+  }
+  else {
+    int y;
+    for (y = dirty_y0; y < dirty_y1; y ++) {
+      lseek(fb_fd, ((y + pad_y) * screen_w + dirty_x0 + pad_x) * sizeof(canvas[0]), SEEK_SET);
+      write(fb_fd, &canvas[y * canvas_w + dirty_x0], w * sizeof(canvas[0]));
+    }
+  }
+}
+
+int NDL_Render() {
+  if (canvas == NULL || fb_fd < 0) return -1;
+  if (dirty_x0 >= dirty_x1) return 0;
+
+  if (fb == MAP_FAILED) write_dirty();
+  if (fbsync_fd >= 0) write(fbsync_fd, "0", 1);
+  dirty_x0 = dirty_x1 = 0;
+  return 0;
+}
+
+/* Tell the kernel when a read of /dev/events without a key returns: at
+ * the next timer interrupt (0), after `ms' (> 0), or never (< 0). */
+static void evt_set_timeout(int ms, int force) {
+  if (!force && ms == evt_timeout) return;
+  char buf[16];
+  int n = sprintf(buf, "w %d\n", ms);
+  write(evt_fd, buf, n);
+  evt_timeout = ms;
+}
+
+static int wait_event(NDL_Event *event) {
+  char buf[64];
+  while (1) {
+    int n = read(evt_fd, buf, sizeof(buf) - 1);
+    if (n <= 0) continue;
+    buf[n] = '\0';
+    char *nl = strchr(buf, '\n');
+    if (nl != NULL) *nl = '\0';
+
+    if (buf[0] == 'k' && (buf[1] == 'd' || buf[1] == 'u')) {
+      int i;
+      for (i = 0; i < sizeof(keys) / sizeof(keys[0]); i ++) {
+        if (strcmp(keys[i], buf + 3) == 0) {
+          event->type = (buf[1] == 'd' ? NDL_EVENT_KEYDOWN : NDL_EVENT_KEYUP);
+          event->data = i;
+          return 0;
+        }
+      }
+    }
+    else if (buf[0] == 't') {
+      event->type = NDL_EVENT_TIMER;
+      event->data = atoi(buf + 2);
+      return 0;
+    }
+  }
+}
+
+int NDL_WaitEvent(NDL_Event *event) {
+  if (evt_fd < 0) return -1;
+  evt_set_timeout(0, 0);
+  return wait_event(event);
+}
+
+int NDL_WaitEventTimeout(NDL_Event *event, int timeout_ms) {
+  if (evt_fd < 0) return -1;
+  /* a new deadline each time for a positive timeout */
+  evt_set_timeout(timeout_ms, timeout_ms > 0);
+  return wait_event(event);
+}
@@ -0,0 +1,22 @@
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+/* mmap() is not a system call of syscall.h, and Nanos-lite serves it
+ * with a number of its own, see nanos-lite/include/sysmmap.h. The kernel
+ * chooses the address, so `addr' must be NULL, and `prot' and `flags' are
+ * ignored: a mapping is always readable, writable and shared with the
+ * file. */
+#define SYS_mmap 0x102
+
+intptr_t _syscall_(intptr_t type, intptr_t a0, intptr_t a1, intptr_t a2);
+
+void *mmap(void *addr, size_t len, int prot, int flags, int fd, off_t offset) {
+  if (addr != NULL) return (void *)-1;
+  return (void *)_syscall_(SYS_mmap, len, fd, offset);
+}
+
+int munmap(void *addr, size_t len) {
+  /* a mapping is kept until the process exits or calls execve() */
+  return 0;
+}
@@ -0,0 +1,22 @@
+#include <ndl.h>
+#include <stdio.h>
+
+#define W 400
+#define H 300
+
+int main() {
+  if (NDL_OpenDisplay(W, H) != 0) {
+    printf("cannot open the display\n");
+    return 1;
+  }
+  int w, h;
+  if (NDL_LoadBMP("/share/pictures/projectn.bmp", NULL, 0, &w, &h) != 0 ||
+      NDL_DrawBMP("/share/pictures/projectn.bmp", (W - w) / 2, (H - h) / 2) != 0) {
+    printf("cannot load the picture\n");
+    return 1;
+  }
+  NDL_Render();
+  printf("Test ends! Spinning...\n");
+  while (1);
+  return 0;
+}
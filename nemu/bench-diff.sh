@@ -0,0 +1,194 @@
+#!/bin/bash
+
+# Compare the performance of two revisions of NEMU on the same machine:
+#
+#   ./bench-diff.sh ISA BASE [HEAD] REPORT
+#
+# BASE and HEAD are git revisions, and HEAD is the working tree if it is
+# empty. Each revision is checked out to a worktree in BENCH_DIFF_DIR and
+# built there, and both run the same images of BENCH_APPS and the
+# primitives of '-U BENCH_OPS' (see src/monitor/debug/nemu-bench.c), for
+# BENCH_TRIALS trials pinned to the core BENCH_CPU. The two revisions take
+# turns in each trial, so a drift of the machine hits both of them.
+#
+# The MIPS of each benchmark and the ns/op of each primitive are compared
+# by Welch's t-test. A change is significant if it is at the level of 95%,
+# and it fails when a significant change is worse by more than
+# BENCH_TOLERANCE percent. REPORT is written in JSON, with one line for
+# each metric.
+
+ISA=$1
+BASE=$2
+if [ $# -ge 4 ]; then
+  HEAD=$3
+  REPORT=$4
+else
+  HEAD=
+  REPORT=$3
+fi
+BENCH_APPS=${BENCH_APPS:-"microbench coremark dhrystone"}
+BENCH_OPS=${BENCH_OPS:-1000000}
+BENCH_TRIALS=${BENCH_TRIALS:-5}
+BENCH_TOLERANCE=${BENCH_TOLERANCE:-2}
+BENCH_CPU=${BENCH_CPU:-$(($(nproc) - 1))}
+BENCH_DIFF_DIR=${BENCH_DIFF_DIR:-build/bench-diff}
+MAINARGS=${MAINARGS:-ref}
+
+if [ -z "$ISA" ] || [ -z "$BASE" ] || [ -z "$REPORT" ]; then
+  echo "Usage: $0 ISA BASE [HEAD] REPORT"
+  exit 1
+fi
+
+PIN=
+if command -v taskset &> /dev/null; then
+  PIN="taskset -c $BENCH_CPU"
+else
+  echo "taskset is not found, the runs are not pinned"
+fi
+
+# the path of NEMU in the repository, e.g. "nemu/"
+PREFIX=$(git rev-parse --show-prefix)
+mkdir -p $BENCH_DIFF_DIR
+git worktree prune
+
+# Build the revision $1 and print the path of its binary, reusing the
+# worktree of an earlier comparison.
+build_rev() {
+  local dir=$(pwd)
+  if [ -n "$1" ]; then
+    local sha=$(git rev-parse --verify -q "$1^{commit}")
+    if [ -z "$sha" ]; then
+      echo "$1: not a revision" >&2
+      return 1
+    fi
+    dir=$(realpath $BENCH_DIFF_DIR)/$sha
+    if [ ! -d $dir ]; then
+      git worktree add -f --detach $dir $sha > /dev/null || return 1
+    fi
+    dir=$dir/$PREFIX
+  fi
+  make -s -C $dir ISA=$ISA > /dev/null || return 1
+  echo $dir/build/$ISA-nemu
+}
+
+BIN_BASE=$(build_rev $BASE) || { echo "$BASE: build error"; exit 1; }
+BIN_HEAD=$(build_rev "$HEAD") || { echo "${HEAD:-working tree}: build error"; exit 1; }
+
+IMAGES=
+for app in $BENCH_APPS; do
+  if ! make -s -C $AM_HOME/apps/$app ARCH=$ISA-nemu mainargs=$MAINARGS &> /dev/null; then
+    echo "$app: compile error"
+    exit 1
+  fi
+  IMAGES="$IMAGES $AM_HOME/apps/$app/build/$app-$ISA-nemu.bin"
+done
+
+# the samples, as lines of "SIDE METRIC VALUE BETTER", where BETTER is 1
+# if higher is better
+SAMPLES=$(mktemp)
+trap "rm -f $SAMPLES" EXIT
+
+# Run the side $1 by the binary $2 once, and append its samples.
+run_once() {
+  local perf=$(mktemp)
+  local out=$(mktemp)
+  local img
+  for img in $IMAGES; do
+    local app=$(basename $img -$ISA-nemu.bin)
+    $PIN $2 -b -j $perf $img &> $out
+    if ! grep -q "HIT GOOD TRAP" $out; then
+      echo "$app: fail on $1"
+      rm -f $perf $out
+      return 1
+    fi
+    local mips=$(grep -o '"mips": [-0-9.e+]*' $perf | head -1 | awk '{ print $2 }')
+    echo "$1 $app.mips $mips 1" >> $SAMPLES
+  done
+  $PIN $2 -U $BENCH_OPS -j $perf &> $out
+  sed -n '/"nemu_bench"/,/}/p' $perf | grep -o '"[a-z_]*_ns": [-0-9.e+]*' | \
+    tr -d '":' | awk -v side=$1 '{ print side, $1, $2, -1 }' >> $SAMPLES
+  rm -f $perf $out
+}
+
+for t in $(seq $BENCH_TRIALS); do
+  echo "trial $t/$BENCH_TRIALS"
+  # take turns to go first
+  if [ $((t % 2)) -eq 1 ]; then
+    run_once base $BIN_BASE && run_once head $BIN_HEAD || exit 1
+  else
+    run_once head $BIN_HEAD && run_once base $BIN_BASE || exit 1
+  fi
+done
+
+mkdir -p $(dirname $REPORT)
+# the working tree is the commit checked out with "+"
+if [ -n "$HEAD" ]; then HEAD_NAME=$(git rev-parse --short $HEAD); else HEAD_NAME=$(git rev-parse --short HEAD)+; fi
+awk -v tol=$BENCH_TOLERANCE -v isa=$ISA -v report=$REPORT -v trials=$BENCH_TRIALS \
+    -v base=$(git rev-parse --short $BASE) -v head=$HEAD_NAME '
+# the critical value of the two-sided t-test at 95% for `df` degrees of freedom
+function tcrit(df) {
+  if (df < 2) return 12.71
+  if (df < 3) return 4.30
+  if (df < 4) return 3.18
+  if (df < 5) return 2.78
+  if (df < 6) return 2.57
+  if (df < 7) return 2.45
+  if (df < 8) return 2.36
+  if (df < 9) return 2.31
+  if (df < 10) return 2.26
+  if (df < 12) return 2.23
+  if (df < 15) return 2.18
+  if (df < 20) return 2.13
+  if (df < 30) return 2.09
+  if (df < 60) return 2.04
+  return 1.96
+}
+function abs(x) { return x < 0 ? -x : x }
+{
+  if (!(($2) in better)) order[++nr_metric] = $2
+  better[$2] = $4
+  n[$1, $2] ++; s[$1, $2] += $3; ss[$1, $2] += $3 * $3
+}
+END {
+  status = 0
+  printf "%-22s %12s %12s %9s %8s  %s\n", "METRIC", "BASE", "HEAD", "CHANGE", "T", "RESULT"
+  printf "{\n  \"isa\": \"%s\",\n  \"base\": \"%s\",\n  \"head\": \"%s\",\n  \"trials\": %d,\n  \"metrics\": {\n",
+    isa, base, head, trials > report
+  sep = ""
+  for (i = 1; i <= nr_metric; i ++) {
+    m = order[i]
+    na = n["base", m]; nb = n["head", m]
+    if (na < 2 || nb < 2) continue
+    ma = s["base", m] / na; mb = s["head", m] / nb
+    va = (ss["base", m] - na * ma * ma) / (na - 1); if (va < 0) va = 0
+    vb = (ss["head", m] - nb * mb * mb) / (nb - 1); if (vb < 0) vb = 0
+    se = sqrt(va / na + vb / nb)
+    change = (ma != 0 ? (mb - ma) / ma * 100 : 0)
+    if (se > 0) {
+      t = (mb - ma) / se
+      df = (va / na + vb / nb) ^ 2 / ((va / na) ^ 2 / (na - 1) + (vb / nb) ^ 2 / (nb - 1))
+      sig = (abs(t) > tcrit(df))
+    }
+    else {
+      t = 0
+      sig = (mb != ma)
+    }
+    # positive if HEAD is better
+    gain = change * better[m]
+    result = "-"
+    if (sig) result = (gain > 0 ? "faster" : "slower")
+    if (sig && gain < -tol) {
+      result = "REGRESSION"
+      status = 1
+    }
+    printf "%-22s %12.2f %12.2f %8.2f%% %8.2f  %s\n", m, ma, mb, change, t, result
+    printf "%s    \"%s\": { \"base\": %g, \"head\": %g, \"change\": %.2f, \"t\": %.2f, \"significant\": %s }",
+      sep, m, ma, mb, change, t, (sig ? "true" : "false") > report
+    sep = ",\n"
+  }
+  printf "\n  }\n}\n" > report
+  exit status
+}' $SAMPLES
+status=$?
+echo "The report is written to $REPORT"
+exit $status
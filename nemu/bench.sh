@@ -0,0 +1,72 @@
+#!/bin/bash
+
+# Run the benchmarks of BENCH_APPS on NEMU in batch mode, and report the
+# score of each, the guest instructions, the host time and the MIPS:
+#
+#   ./bench.sh ISA NEMU REPORT [BASELINE]
+#
+# REPORT is written in JSON, with one line for each benchmark. With a
+# BASELINE in the same format, e.g. an earlier REPORT, it fails when the
+# MIPS of a benchmark drops more than BENCH_TOLERANCE percent below it.
+
+ISA=$1
+NEMU=$2
+REPORT=$3
+BASELINE=$4
+BENCH_APPS=${BENCH_APPS:-"microbench coremark dhrystone"}
+BENCH_TOLERANCE=${BENCH_TOLERANCE:-10}
+MAINARGS=${MAINARGS:-ref}
+
+# the value of "key" in the JSON of $2
+json_val() {
+  grep -o "\"$1\": [-0-9.e+]*" $2 | head -1 | awk '{ print $2 }'
+}
+
+mkdir -p $(dirname $REPORT)
+echo "{" > $REPORT
+echo "  \"isa\": \"$ISA\"," >> $REPORT
+echo "  \"commit\": \"$(git rev-parse --short HEAD 2> /dev/null)\"," >> $REPORT
+echo "  \"apps\": {" >> $REPORT
+
+status=0
+sep=""
+printf "%-12s %10s %14s %10s %10s\n" APP SCORE INSTRUCTIONS SECONDS MIPS
+for app in $BENCH_APPS; do
+  if ! make -s -C $AM_HOME/apps/$app ARCH=$ISA-nemu mainargs=$MAINARGS &> /dev/null; then
+    echo "$app: compile error"
+    status=1
+    continue
+  fi
+  out=$(mktemp)
+  perf=$(mktemp)
+  $NEMU -b -j $perf $AM_HOME/apps/$app/build/$app-$ISA-nemu.bin &> $out
+  if ! grep -q "HIT GOOD TRAP" $out; then
+    echo "$app: fail"
+    status=1
+    rm -f $out $perf
+    continue
+  fi
+
+  # e.g. "CoreMark PASS   123 Marks"
+  score=$(grep -o "PASS *[0-9]* Marks" $out | awk '{ print $2 }')
+  instr=$(json_val instructions $perf)
+  secs=$(json_val host_seconds $perf)
+  mips=$(json_val mips $perf)
+  rm -f $out $perf
+  printf "%-12s %10s %14s %10s %10s\n" $app ${score:-?} $instr $secs $mips
+  printf "$sep    \"%s\": { \"score\": %s, \"instructions\": %s, \"host_seconds\": %s, \"mips\": %s }" \
+    $app ${score:-0} $instr $secs $mips >> $REPORT
+  sep=",\n"
+
+  if [ -n "$BASELINE" ] && [ -f "$BASELINE" ]; then
+    base=$(grep "\"$app\":" $BASELINE | grep -o '"mips": [-0-9.e+]*' | awk '{ print $2 }')
+    if [ -n "$base" ] && awk -v m=$mips -v b=$base -v t=$BENCH_TOLERANCE 'BEGIN { exit !(m < b * (1 - t / 100)) }'; then
+      echo "$app: REGRESSION, $mips MIPS is more than $BENCH_TOLERANCE% below $base MIPS of $BASELINE"
+      status=1
+    fi
+  fi
+done
+
+printf "\n  }\n}\n" >> $REPORT
+echo "The report is written to $REPORT"
+exit $status
@@ -10,6 +10,76 @@
 #undef DEBUG
 #endif
 
+/* Cache the decoding results of instructions */
+#define DECODE_CACHE
+
+/* Execute instructions by basic blocks from a translation cache.
+ * It requires DECODE_CACHE, and is only used without DEBUG and DIFF_TEST,
+ * since they need to do something after every instruction. It is off by
+ * default, since it runs no faster than DECODE_CACHE alone: the time goes
+ * to decoding the operands and executing each instruction, which a block
+ * still does one by one, not to finding the next instruction. */
+//#define TB_CACHE
+
+/* Dispatch instructions by threaded code with labels as values instead of
+ * `idex()'. It is only used without DEBUG and DIFF_TEST, and it takes
+ * precedence over TB_CACHE. Not supported by x86 yet. */
+//#define THREADED_DISPATCH
+
+/* Translate blocks of RTL into x86-64 host code. It requires DECODE_CACHE,
+ * is only used without DEBUG and DIFF_TEST, and takes precedence over the
+ * other engines. Not supported by x86 yet. */
+//#define RTL_JIT
+
+/* Evaluate x86 EFLAGS from the last flag-producing operation on demand */
+#define LAZY_CC
+
+/* Simulate a cache hierarchy on instruction fetching and accesses to pmem,
+ * see src/memory/cache.c. Like DEBUG, it executes instructions one by one
+ * without the other engines. */
+//#define CACHE_SIM
+
+/* Count reads, writes and fetches for each page of pmem, see
+ * src/memory/heatmap.c. Like CACHE_SIM, it executes instructions one by one. */
+//#define PMEM_HEATMAP
+
+/* Trace the loads and stores of the guest in the address ranges given by
+ * '-M', see src/memory/mtrace.c. Like CACHE_SIM, it executes instructions
+ * one by one. */
+//#define MTRACE
+
+/* Count the instructions executed by their opcodes for 'info perf'.
+ * Like CACHE_SIM, it executes instructions one by one. */
+//#define OPCODE_STAT
+
+#if _SHARE
+#undef CACHE_SIM
+#undef PMEM_HEATMAP
+#undef MTRACE
+#undef OPCODE_STAT
+// the reference design is the plain interpreter, so the other engines
+// can be checked against it
+#undef TB_CACHE
+#undef THREADED_DISPATCH
+#undef RTL_JIT
+#endif
+
+#if _PERF
+// the build for production runs by 'make perf', nothing is checked or
+// instrumented, and assert() is disabled by NDEBUG
+#undef DIFF_TEST
+#undef DEBUG
+#undef CACHE_SIM
+#undef PMEM_HEATMAP
+#undef MTRACE
+#undef OPCODE_STAT
+#endif
+
+#if defined(CACHE_SIM) || defined(PMEM_HEATMAP) || defined(MTRACE) || defined(OPCODE_STAT)
+/* some memory accesses or instructions are instrumented */
+#define MEM_INSTRUMENT
+#endif
+
 /* You will define this macro in PA2 */
 //#define HAS_IOE
 
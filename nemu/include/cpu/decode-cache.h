@@ -0,0 +1,88 @@
+#ifndef __CPU_DECODE_CACHE_H__
+#define __CPU_DECODE_CACHE_H__
+
+#include "cpu/exec.h"
+
+/* Fetch the instruction at `*pc' into `decinfo' and return the entry
+ * in the top-level opcode table. This is provided by each ISA. */
+OpcodeEntry* isa_fetch(vaddr_t *pc);
+
+/* stop the guest before an instruction at a breakpoint, see src/monitor/debug/breakpoint.c */
+extern OpcodeEntry bp_trap_entry;
+
+#ifdef DECODE_CACHE
+
+#define NR_PMEM_PAGE (pmem_size / PAGE_SIZE)
+
+/* A decoded instruction, i.e. the result of `isa_fetch()'. */
+typedef struct {
+  vaddr_t pc;
+  vaddr_t fetch_pc;  // the pc after `isa_fetch()'
+  OpcodeEntry *e;
+  uint32_t page;     // the page of pmem containing this instruction
+  uint32_t gen;      // the generation of the page when decoding
+  bool trap;         // a breakpoint, `e' is `bp_trap_entry'
+
+  uint32_t opcode;
+  uint32_t width;
+  int src_width, dest_width, src2_width;
+  struct ISADecodeInfo isa;
+} DCEntry;
+
+/* see memory.h for `dcache_code_page' */
+extern uint32_t *dcache_page_gen;
+
+/* allocate the tables above after the size of pmem is known */
+void init_dcache(void);
+/* [pmem_offset, pmem_offset + len) inside one page holds code decoded, to be invalidated when written */
+void dcache_mark(uint32_t pmem_offset, int len);
+/* invalidate the code decoded at `pc', or everything if it is not in pmem */
+void dcache_invalidate_pc(vaddr_t pc);
+void dcache_flush(void);
+void dcache_statistic(void);
+bool dcache_fetch(DCEntry *dc, vaddr_t pc);
+void dcache_exec(vaddr_t *pc);
+
+/* Try to fuse the decoded instruction `b' which follows `a' into one
+ * superinstruction with the same architectural result. Return its opcode
+ * table entry, or NULL if they can not be fused. The entry is executed
+ * with the decoding result of `a' restored, so the ISA may record what
+ * it needs from `b' in `a->isa'. This is provided by each ISA. */
+OpcodeEntry* isa_fuse(DCEntry *a, const DCEntry *b);
+
+static inline bool dcache_is_valid(DCEntry *dc) {
+  return dc->gen == dcache_page_gen[dc->page];
+}
+
+/* restore the decoding result to `decinfo' */
+static inline void dcache_restore(DCEntry *dc) {
+  decinfo.opcode = dc->opcode;
+  decinfo.width = dc->width;
+  decinfo.src.width = dc->src_width;
+  decinfo.dest.width = dc->dest_width;
+  decinfo.src2.width = dc->src2_width;
+  decinfo.isa = dc->isa;
+}
+
+/* restore the decoding result to `decinfo' and execute it */
+static inline void dcache_idex(vaddr_t *pc, DCEntry *dc) {
+  *pc = dc->fetch_pc;
+  dcache_restore(dc);
+
+#ifdef DEBUG
+  /* fetch the bytes again for the log, but not as data accesses */
+  vaddr_t p = dc->pc;
+  while (p < dc->fetch_pc) instr_fetch(&p, 1);
+#endif
+
+  idex(pc, dc->e);
+}
+
+#else
+
+#define dcache_invalidate_pc(pc)
+#define dcache_flush()
+
+#endif
+
+#endif
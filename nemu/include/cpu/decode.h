@@ -39,12 +39,16 @@ void operand_write(Operand *, rtlreg_t *);
 /* shared by all helper functions */
 extern DecodeInfo decinfo;
 
+/* The length in bytes of the instruction at `pc' without fetching it, or
+ * 0 if it is unknown. This is provided by each ISA. */
+int isa_instr_len(vaddr_t pc);
+
 #define id_src (&decinfo.src)
 #define id_src2 (&decinfo.src2)
 #define id_dest (&decinfo.dest)
 
 #ifdef DEBUG
-#define print_Dop(...) snprintf(__VA_ARGS__)
+#define print_Dop(...) do { if (log_asm) snprintf(__VA_ARGS__); } while (0)
 #else
 #define print_Dop(...)
 #endif
@@ -23,13 +23,19 @@ typedef struct {
 #define EMPTY              EX(inv)
 
 static inline uint32_t instr_fetch(vaddr_t *pc, int len) {
-  uint32_t instr = vaddr_read(*pc, len);
+  uint32_t instr;
+  uint32_t offset = *pc & PAGE_MASK;
+  if (*pc / PAGE_SIZE == ifetch_vpn && offset <= PAGE_SIZE - len) {
+    instr = host_read(ifetch_host + offset, len);
+  }
+  else {
+    instr = ifetch_slow(*pc, len);
+  }
 #ifdef DEBUG
   uint8_t *p_instr = (void *)&instr;
   int i;
-  for (i = 0; i < len; i ++) {
-    extern char log_bytebuf[];
-    strcatf(log_bytebuf, "%02x ", p_instr[i]);
+  for (i = 0; i < len && log_instr_len < LOG_INSTR_MAX; i ++) {
+    log_instr[log_instr_len ++] = p_instr[i];
   }
 #endif
   (*pc) += len;
@@ -54,7 +60,7 @@ void display_inv_msg(vaddr_t pc);
 #define print_asm(...) \
   do { \
     extern char log_asmbuf[]; \
-    strcatf(log_asmbuf, __VA_ARGS__); \
+    if (log_asm) strcatf(log_asmbuf, __VA_ARGS__); \
   } while (0)
 #else
 #define print_asm(...)
@@ -0,0 +1,21 @@
+#ifndef __CPU_HART_H__
+#define __CPU_HART_H__
+
+#include "common.h"
+
+/* The harts of SMP take turns on the host thread, `hart_quantum' guest
+ * instructions each. Only the running one is in `cpu', see hart.c. */
+#define MAX_HART 8
+#define HART_QUANTUM_DEFAULT 4096
+
+extern int nr_hart, cur_hart;
+extern uint64_t hart_quantum;
+/* the instructions left in the quantum of the running hart */
+extern uint64_t hart_quantum_left;
+
+void init_hart(int n, uint64_t quantum);
+void hart_switch(int id);
+/* Switch to the next hart if the running one has used up its quantum. */
+void hart_schedule(void);
+
+#endif
@@ -0,0 +1,18 @@
+#ifndef __CPU_TB_H__
+#define __CPU_TB_H__
+
+#include "common.h"
+
+#if defined(TB_CACHE) && defined(DECODE_CACHE) && !defined(DEBUG) && !defined(DIFF_TEST) && !defined(MEM_INSTRUMENT)
+#define TB_ENGINE
+
+void tb_flush(void);
+uint64_t tb_run(uint64_t n);
+
+#else
+
+#define tb_flush()
+
+#endif
+
+#endif
@@ -0,0 +1,58 @@
+#ifndef __CPU_THREADED_H__
+#define __CPU_THREADED_H__
+
+#include "common.h"
+
+#if defined(THREADED_DISPATCH) && !defined(DEBUG) && !defined(DIFF_TEST) && !defined(MEM_INSTRUMENT)
+#define THREADED_ENGINE
+#endif
+
+/* An opcode table is defined by an X-macro, e.g.
+ *
+ *   #define OPCODE_TABLE(_) _(0, IDEX(ld, load)) _(1, EMPTY) ...
+ *
+ * OPCODE_TABLE(OPCODE_ENTRY) expands it into the initializer of an
+ * `OpcodeEntry' array as usual. With THREADED_ENGINE, the same table is
+ * also expanded into the labels of a threaded interpreter loop with
+ * THREADED_LABEL_ADDR and THREADED_LABEL. Each label runs the helpers of
+ * its entry with direct calls and jumps to the label of the next
+ * instruction by itself, so the host sees a separate indirect branch
+ * for every opcode instead of one shared by all instructions in `idex()'.
+ *
+ * THREADED_LABEL requires the following to be defined before expanding:
+ *   dispatch[]          - the array from THREADED_LABEL_ADDR
+ *   i, n                - the instruction counter and its limit
+ *   THREADED_FETCH()    - fetch at `decinfo.seq_pc', return the index
+ *   threaded_idex(e)    - decode and execute the static entry `e'
+ */
+
+#define OPCODE_ENTRY(idx, e) [idx] = e,
+
+#ifdef THREADED_ENGINE
+
+#include "monitor/monitor.h"
+
+uint64_t isa_exec_threaded(uint64_t n);
+
+#define THREADED_LABEL_ADDR(idx, e) [idx] = &&concat(threaded_, idx),
+
+#define THREADED_GOTO_NEXT() \
+  do { \
+    decinfo.seq_pc = cpu.pc; \
+    iring_push(cpu.pc); \
+    goto *dispatch[THREADED_FETCH()]; \
+  } while (0)
+
+#define THREADED_LABEL(idx, e) \
+  concat(threaded_, idx): { \
+    static const OpcodeEntry ent = e; \
+    threaded_idex(&ent); \
+    update_pc(); \
+    g_nr_guest_instr ++; \
+    if (++ i == n || (nemu_event_pending() && nemu_handle_event())) return i; \
+    THREADED_GOTO_NEXT(); \
+  }
+
+#endif
+
+#endif
@@ -4,8 +4,20 @@
 #include "common.h"
 #include <stdio.h>
 #include <assert.h>
+#include <stdlib.h>
 #include "monitor/log.h"
 
+#ifdef NDEBUG
+/* In the build of 'make perf', a condition asserted is not checked, but
+ * the compiler may assume that it holds, e.g. the index of a register is
+ * below 8. Assert() and panic() still stop NEMU. */
+#undef assert
+#define assert(cond) do { if (!(cond)) __builtin_unreachable(); } while (0)
+#define assert_stop(cond) abort()
+#else
+#define assert_stop(cond) assert(cond)
+#endif
+
 #define Log(format, ...) \
     _Log("\33[1;34m[%s,%d,%s] " format "\33[0m\n", \
         __FILE__, __LINE__, __func__, ## __VA_ARGS__)
@@ -14,10 +26,11 @@
   do { \
     if (!(cond)) { \
       fflush(stdout); \
+      log_flush(); \
       fprintf(stderr, "\33[1;31m"); \
       fprintf(stderr, __VA_ARGS__); \
       fprintf(stderr, "\33[0m\n"); \
-      assert(cond); \
+      assert_stop(cond); \
     } \
   } while (0)
 
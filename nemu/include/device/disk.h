@@ -0,0 +1,10 @@
+#ifndef __DEVICE_DISK_H__
+#define __DEVICE_DISK_H__
+
+#include "common.h"
+
+/* Back the disk with the host file `img_file', which may be NULL for no
+ * disk. Called before init_device(). */
+void disk_config(const char *img_file);
+
+#endif
@@ -0,0 +1,20 @@
+#ifndef __DEVICE_EVENT_H__
+#define __DEVICE_EVENT_H__
+
+#include "common.h"
+
+/* Devices schedule periodic events in virtual time, which is counted in
+ * guest instructions. `device_instr_per_us' guest instructions take 1 us
+ * of virtual time, which is also the rate of the virtual clock of the RTC. */
+extern uint64_t device_instr_per_us;
+
+typedef void (*event_handler_t)(void);
+
+/* Call `handler' every `period_us' us of virtual time. */
+void add_device_event(const char *name, uint64_t period_us, event_handler_t handler);
+/* Call `handler' every `period' guest instructions. */
+void add_instr_event(const char *name, uint64_t period, event_handler_t handler);
+/* Call the handlers of the events which are due. */
+void device_run_events(void);
+
+#endif
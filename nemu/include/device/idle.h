@@ -0,0 +1,20 @@
+#ifndef __DEVICE_IDLE_H__
+#define __DEVICE_IDLE_H__
+
+#include "common.h"
+
+/* A device register which the guest may poll in a busy-waiting loop. */
+typedef struct {
+  vaddr_t pc;    // the instruction polling the register
+  uint32_t val;  // the value read last time
+  int nr;        // the number of consecutive polls by `pc' reading `val'
+  uint32_t nr_write;
+} IdlePoll;
+
+/* the number of writes to devices, the guest is not idle if it writes to devices */
+extern uint32_t device_nr_write;
+
+bool device_poll_is_idle(IdlePoll *p, uint32_t val);
+void device_idle_sleep(uint32_t usec);
+
+#endif
@@ -3,8 +3,11 @@
 
 #include "common.h"
 #include "monitor/diff-test.h"
+#include "monitor/perf.h"
 
 typedef void(*io_callback_t)(uint32_t, int, bool);
+
+#define NR_IO_BUCKET 24
 uint8_t* new_space(int size);
 
 typedef struct {
@@ -14,6 +17,15 @@ typedef struct {
   paddr_t high;
   uint8_t *space;
   io_callback_t callback;
+  uint64_t nr_read, nr_write;  // the accesses, including those without a callback
+  uint64_t read_bytes, write_bytes;
+  /* the host time in the callback, in total and as a histogram of the
+   * calls in buckets of powers of 2 nanoseconds */
+  uint64_t nr_callback, callback_ns;
+  uint64_t callback_hist[NR_IO_BUCKET];
+  /* bit i: a read of the i-th word is a plain load from `space', without
+   * the callback, since the device keeps the word up to date itself */
+  uint32_t static_read;
 } IOMap;
 
 static inline bool map_inside(IOMap *map, paddr_t addr) {
@@ -31,10 +43,28 @@ static inline int find_mapid_by_addr(IOMap *maps, int size, paddr_t addr) {
   return -1;
 }
 
-void add_pio_map(char *name, ioaddr_t addr, uint8_t *space, int len, io_callback_t callback);
-void add_mmio_map(char *name, paddr_t addr, uint8_t* space, int len, io_callback_t callback);
+IOMap* add_pio_map(char *name, ioaddr_t addr, uint8_t *space, int len, io_callback_t callback);
+IOMap* add_mmio_map(char *name, paddr_t addr, uint8_t* space, int len, io_callback_t callback);
+/* the words in [offset, offset + len) of `map' are read without the callback */
+void map_static_read(IOMap *map, uint32_t offset, int len);
+/* the map of MMIO at `addr', NULL if there is none */
+IOMap* fetch_mmio_map(paddr_t addr);
+/* return whether the page of MMIO at `addr' is written since the last call */
+bool mmio_test_and_clear_dirty(paddr_t addr);
+/* mark the pages of [addr, addr + len) written by a device itself */
+void mmio_set_dirty(paddr_t addr, size_t len);
 
 uint32_t map_read(paddr_t addr, int len, IOMap *map);
 void map_write(paddr_t addr, uint32_t data, int len, IOMap *map);
 
+/* report the accesses to each of the `nr' maps */
+void map_perf(PerfOut *o, IOMap *maps, int nr);
+/* print the accesses to the maps used, with the histograms if `hist' */
+void map_display(const char *kind, IOMap *maps, int nr, bool hist);
+void pio_display(bool hist);
+void mmio_display(bool hist);
+/* 'info io', and the summary at exit */
+void io_display(void);
+void io_statistic(void);
+
 #endif
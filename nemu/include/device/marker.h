@@ -0,0 +1,9 @@
+#ifndef __DEVICE_MARKER_H__
+#define __DEVICE_MARKER_H__
+
+#include "common.h"
+
+/* summarize the regions marked by the guest, see src/device/marker.c */
+void marker_statistic(void);
+
+#endif
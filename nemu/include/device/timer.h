@@ -0,0 +1,10 @@
+#ifndef __DEVICE_TIMER_H__
+#define __DEVICE_TIMER_H__
+
+#include "common.h"
+
+/* Select the clock of the RTC with "host", "cached" or "virtual[:N]",
+ * see src/device/timer.c. Called before init_device(). */
+void timer_config(const char *spec);
+
+#endif
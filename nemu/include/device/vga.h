@@ -0,0 +1,19 @@
+#ifndef __DEVICE_VGA_H__
+#define __DEVICE_VGA_H__
+
+#include "common.h"
+
+/* Called before init_device(). Without a window, vmem and the screen
+ * registers still work, but nothing is presented. `size' is the size of
+ * the screen as "WxH", 400x300 if NULL. If `dump_file' is not NULL, a
+ * hash of every `dump_every'-th frame synced is written to it. */
+void vga_config(bool headless, const char *size, const char *dump_file, int dump_every);
+
+/* Open the window if it is not opened yet, at the first use of the screen
+ * or the keyboard. Nothing is done in headless mode. */
+void vga_open_window();
+
+/* the frames synced and presented, at exit */
+void vga_statistic(void);
+
+#endif
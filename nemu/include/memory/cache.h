@@ -0,0 +1,23 @@
+#ifndef __MEMORY_CACHE_H__
+#define __MEMORY_CACHE_H__
+
+#include "common.h"
+
+#ifdef CACHE_SIM
+
+enum { CACHE_FETCH, CACHE_READ, CACHE_WRITE };
+
+/* Configure the hierarchy with a spec like "l1i=32K:8:64,l2=256K:8:64,sample=1000/10000",
+ * see src/memory/cache.c. Called before any access. */
+void init_cache(const char *spec);
+/* simulate an access to pmem at the physical address `addr' */
+void cache_access(paddr_t addr, int len, int type);
+void cache_statistic(void);
+
+#else
+
+#define cache_access(addr, len, type)
+
+#endif
+
+#endif
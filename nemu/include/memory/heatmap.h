@@ -0,0 +1,29 @@
+#ifndef __MEMORY_HEATMAP_H__
+#define __MEMORY_HEATMAP_H__
+
+#include "common.h"
+#include "monitor/sample.h"
+
+#ifdef PMEM_HEATMAP
+
+enum { HEAT_READ, HEAT_WRITE, HEAT_FETCH, NR_HEAT_TYPE };
+
+/* the number of accesses to each page of pmem */
+extern uint64_t *pmem_heat[NR_HEAT_TYPE];
+
+/* count an access to pmem at `offset', only in the detailed windows of sampling */
+#define heatmap_count(offset, type) \
+  do { if (sample_detailed) pmem_heat[type][(offset) / PAGE_SIZE] ++; } while (0)
+
+/* called after pmem is allocated, the counters are written to `csv_file' at exit if it is not NULL */
+void init_heatmap(const char *csv_file);
+void heatmap_dump(int n);
+void heatmap_statistic(void);
+
+#else
+
+#define heatmap_count(offset, type)
+
+#endif
+
+#endif
@@ -2,9 +2,14 @@
 #define __MEMORY_H__
 
 #include "common.h"
+#include "memory/cache.h"
+#include "memory/heatmap.h"
+#include <sys/types.h>
 
-#define PMEM_SIZE (128 * 1024 * 1024)
-extern uint8_t pmem[];
+#define PMEM_SIZE_DEFAULT (128 * 1024 * 1024)
+/* allocated by register_pmem() */
+extern uint8_t *pmem;
+extern uint32_t pmem_size;
 
 #define IMAGE_START 0x100000
 
@@ -13,19 +18,182 @@ extern uint8_t pmem[];
 /* convert the host virtual address in NEMU to guest physical address in the guest program */
 #define host_to_guest(p) ((paddr_t)((void *)p - (void *)pmem))
 
+void pmem_config(uint32_t size, bool hugepage);
 void register_pmem(paddr_t base);
+int pmem_offset(paddr_t addr);
+paddr_t pmem_base(void);
+/* Discard everything in pmem, which reads as 0 afterwards. */
+void pmem_reset(void);
+bool pmem_page_is_zero(uint32_t page);
+/* Search pmem from `offset' for the `len' bytes of `pat' at an offset
+ * aligned to `align', which is 1, or `len' for 2 and 4 bytes. Return the
+ * offset of the first match, or -1 if there is not any. */
+int64_t pmem_find(uint32_t offset, const void *pat, uint32_t len, int align);
+/* Map `nr_page' pages of the file `fd' from `offset' copy-on-write into
+ * pmem from `page', or read them if the file can not be mapped. */
+void pmem_map_file(uint32_t page, uint32_t nr_page, int fd, off_t offset);
+
+/* The pmem of a machine which is not running, see monitor/machine.c. */
+typedef struct {
+  uint8_t *pmem, *dirty, *watch;
+} PmemSpace;
+
+/* allocate an empty pmem of the same size, which is not in use */
+void pmem_space_alloc(PmemSpace *sp);
+void pmem_space_free(PmemSpace *sp);
+/* use the pmem of `sp', and put the one in use into `sp' */
+void pmem_swap(PmemSpace *sp);
 
 uint32_t isa_vaddr_read(vaddr_t, int);
 void isa_vaddr_write(vaddr_t, uint32_t, int);
+/* translate the address of an instruction to fetch */
+paddr_t isa_fetch_paddr(vaddr_t);
+/* the same as isa_fetch_paddr() without side effects, `*success' is set
+ * to false if the address is not mapped */
+paddr_t isa_fetch_probe(vaddr_t, bool *success);
+/* forget the translations cached by the ISA, e.g. a TLB */
+void isa_mmu_flush(void);
+/* whether an address inside pmem may be translated to another one, i.e.
+ * a virtual address can not be taken as the physical one */
+bool isa_vm_enabled(void);
 
+#ifdef MTRACE
+/* see memory/mtrace.h */
+#define vaddr_read mtrace_vaddr_read
+#define vaddr_write mtrace_vaddr_write
+#else
 #define vaddr_read isa_vaddr_read
 #define vaddr_write isa_vaddr_write
+#endif
 
 uint32_t paddr_read(paddr_t, int);
 void paddr_write(paddr_t, uint32_t, int);
 
+/* Bulk accesses to guest physical memory. The parts of a range inside pmem
+ * are accessed with the host memory functions, and the others go through
+ * MMIO byte by byte. paddr_memcpy() copies forward byte by byte, so the
+ * result of an overlapping copy is the same as that of `rep movsb'. */
+void paddr_memcpy(paddr_t dest, paddr_t src, size_t n);
+void paddr_memset(paddr_t dest, int c, size_t n);
+int paddr_memcmp(paddr_t s1, paddr_t s2, size_t n);
+/* copy between host memory and guest physical memory, e.g. for DMA */
+void paddr_write_host(paddr_t dest, const void *src, size_t n);
+void paddr_read_host(void *dest, paddr_t src, size_t n);
+/* [addr, addr + n) of pmem has been written by the host directly */
+void pmem_host_written(paddr_t addr, size_t n);
+
+/* return the offset in pmem of the instruction at `pc', or -1 if it is not inside pmem */
+static inline int ifetch_pmem_offset(vaddr_t pc) {
+  return pmem_offset(isa_fetch_paddr(pc));
+}
+
 #define PAGE_SIZE         4096
 #define PAGE_MASK         (PAGE_SIZE - 1)
 #define PG_ALIGN __attribute((aligned(PAGE_SIZE)))
 
+/* Access exactly `len' bytes of host memory, which may be unaligned, e.g.
+ * the instructions of x86. `len' is usually a constant at the call sites,
+ * so the switch is resolved at compile time, and memcpy() becomes a single
+ * load or store. */
+static inline uint32_t host_read(const void *p, int len) {
+  switch (len) {
+    case 4: { uint32_t v; memcpy(&v, p, 4); return v; }
+    case 2: { uint16_t v; memcpy(&v, p, 2); return v; }
+    case 1: return *(uint8_t *)p;
+    default: assert(0);
+  }
+}
+
+static inline void host_write(void *p, uint32_t data, int len) {
+  switch (len) {
+    case 4: memcpy(p, &data, 4); return;
+    case 2: { uint16_t v = data; memcpy(p, &v, 2); return; }
+    case 1: *(uint8_t *)p = data; return;
+    default: assert(0);
+  }
+}
+
+/* Read the aligned word at `addr' of the guest without side effects,
+ * e.g. to walk the stack. Return false if it is not in pmem. */
+static inline bool vaddr_probe_word(vaddr_t addr, uint32_t *data) {
+  bool success;
+  paddr_t paddr = isa_fetch_probe(addr, &success);
+  int offset = (success && (addr & 3) == 0 ? pmem_offset(paddr) : -1);
+  if (offset < 0 || pmem_offset(paddr + 3) < 0) return false;
+  *data = host_read(pmem + offset, 4);
+  return true;
+}
+
+/* Dirty page tracking of pmem. Every write to pmem sets all the bits in
+ * the entry of the pages it touches, and each user only clears its own bit
+ * with pmem_clear_dirty(). One more entry for writes crossing the end. */
+extern uint8_t *pmem_dirty;
+
+/* the users of the dirty bits */
+#define PMEM_DIRTY_DIFFTEST 0x1
+#define PMEM_DIRTY_REVERSE  0x2
+#define PMEM_DIRTY_PREDECODE 0x4
+#define PMEM_DIRTY_IDT      0x8
+#define PMEM_DIRTY_ALL      0xff
+
+/* The number of memory watchpoints on each page of pmem, so a write only
+ * checks the watchpoints when it touches a watched page. */
+extern uint8_t *pmem_watch;
+void wp_mem_check(uint32_t offset, int len);
+
+/* called by every write of at most PAGE_SIZE bytes to pmem, after it */
+static inline void pmem_dirty_write(uint32_t offset, int len) {
+  pmem_dirty[offset / PAGE_SIZE] = PMEM_DIRTY_ALL;
+  pmem_dirty[(offset + len - 1) / PAGE_SIZE] = PMEM_DIRTY_ALL;
+  if (pmem_watch[offset / PAGE_SIZE] | pmem_watch[(offset + len - 1) / PAGE_SIZE]) {
+    wp_mem_check(offset, len);
+  }
+}
+
+#ifdef DECODE_CACHE
+/* non-zero if some decoded instructions come from this page of pmem,
+ * one more entry for accesses crossing the end of pmem, see
+ * cpu/decode-cache.h */
+extern uint8_t *dcache_code_page;
+void dcache_invalidate(uint32_t pmem_offset, int len);
+
+/* called by every write to pmem, see dcache_invalidate() for the writes
+ * to a page with code */
+static inline void dcache_check_write(uint32_t pmem_offset, int len) {
+  if (dcache_code_page[pmem_offset / PAGE_SIZE] |
+      dcache_code_page[(pmem_offset + len - 1) / PAGE_SIZE]) {
+    dcache_invalidate(pmem_offset, len);
+  }
+}
+#else
+#define dcache_check_write(pmem_offset, len)
+#endif
+
+/* Everything to do after writing [offset, offset + len) of pmem from the
+ * guest or the host, which is at most PAGE_SIZE bytes. */
+static inline void pmem_after_write(uint32_t offset, int len) {
+  cache_access(pmem_base() + offset, len, CACHE_WRITE);
+  heatmap_count(offset, HEAT_WRITE);
+  pmem_dirty_write(offset, len);
+  dcache_check_write(offset, len);
+}
+
+void pmem_dirty_range(uint32_t offset, size_t len);
+bool pmem_is_dirty(uint32_t page, int user);
+/* return the first page dirty for `user' not below `page', or -1 if there is not any */
+int pmem_next_dirty(uint32_t page, int user);
+void pmem_clear_dirty(uint32_t page, uint32_t nr_page, int user);
+
+/* Instruction fetch reads the page of pmem containing the last fetched
+ * instruction through a host pointer, see instr_fetch(). The pointer
+ * should be flushed when the translation of fetches changes. */
+extern vaddr_t ifetch_vpn;
+extern uint8_t *ifetch_host;
+uint32_t ifetch_slow(vaddr_t addr, int len);
+void ifetch_flush(void);
+
+#ifdef MTRACE
+#include "memory/mtrace.h"
+#endif
+
 #endif
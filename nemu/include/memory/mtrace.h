@@ -0,0 +1,39 @@
+#ifndef __MEMORY_MTRACE_H__
+#define __MEMORY_MTRACE_H__
+
+#include "memory/memory.h"
+
+#ifdef MTRACE
+
+enum { MTRACE_READ = 1, MTRACE_WRITE = 2 };
+
+/* The types of the accesses traced on each page of the virtual address
+ * space, so an access outside the ranges only costs a lookup. */
+extern uint8_t mtrace_page[];
+
+/* check the ranges and write the record of an access done */
+void mtrace_record(vaddr_t addr, uint32_t data, int len, int type);
+
+static inline bool mtrace_hit(vaddr_t addr, int len, int type) {
+  return (mtrace_page[addr / PAGE_SIZE] | mtrace_page[(vaddr_t)(addr + len - 1) / PAGE_SIZE]) & type;
+}
+
+/* the loads and stores of the guest, see vaddr_read() */
+static inline uint32_t mtrace_vaddr_read(vaddr_t addr, int len) {
+  uint32_t data = isa_vaddr_read(addr, len);
+  if (mtrace_hit(addr, len, MTRACE_READ)) mtrace_record(addr, data, len, MTRACE_READ);
+  return data;
+}
+
+static inline void mtrace_vaddr_write(vaddr_t addr, uint32_t data, int len) {
+  isa_vaddr_write(addr, data, len);
+  if (mtrace_hit(addr, len, MTRACE_WRITE)) mtrace_record(addr, data, len, MTRACE_WRITE);
+}
+
+/* `spec' is FILE[:r|w][:LO-HI,...], nothing is traced if it is NULL */
+void init_mtrace(const char *spec);
+void mtrace_statistic(void);
+
+#endif
+
+#endif
@@ -0,0 +1,22 @@
+#ifndef __BREAKPOINT_H__
+#define __BREAKPOINT_H__
+
+#include "common.h"
+
+/* the number of breakpoints set */
+extern int nr_bp;
+/* set when the trap of a breakpoint stops the guest before the instruction */
+extern bool bp_trapped;
+
+/* Return false if there are too many breakpoints. */
+bool bp_add(vaddr_t pc);
+void bp_remove(vaddr_t pc);
+void bp_clear(void);
+void bp_display(void);
+/* whether the instruction at `pc' should be decoded into a trap */
+bool bp_is_trap(vaddr_t pc);
+/* Execute at most `n' instructions, starting with the one at a breakpoint
+ * if the guest is stopped there. Return true if a breakpoint is reached. */
+bool bp_exec(uint64_t n);
+
+#endif
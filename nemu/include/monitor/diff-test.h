@@ -8,6 +8,10 @@
 void difftest_skip_ref(void);
 void difftest_skip_dut(int nr_ref, int nr_dut);
 void difftest_step(vaddr_t ori_pc, vaddr_t next_pc);
+void difftest_detach(void);
+void difftest_attach(void);
+void difftest_reset_ref(void);
+bool difftest_run_once(const void *before, paddr_t addr, void *code, size_t len);
 #else
 #define difftest_skip_ref()
 #define difftest_skip_dut(nr_ref, nr_dut)
@@ -19,4 +23,13 @@ extern void (*ref_difftest_getregs)(void *c);
 extern void (*ref_difftest_setregs)(const void *c);
 extern void (*ref_difftest_exec)(uint64_t n);
 
+/* Optional, to compare memory. NULL if REF does not provide them. */
+extern uint64_t (*ref_difftest_memhash)(paddr_t addr, size_t n);
+extern void (*ref_difftest_memcpy_to_dut)(void *dest, paddr_t src, size_t n);
+extern int (*ref_difftest_dirty_next)(uint32_t page);
+extern void (*ref_difftest_dirty_clear)(void);
+
+/* the hash of memory compared by difftest, used by both DUT and REF */
+uint64_t difftest_hash(const void *p, size_t n);
+
 #endif
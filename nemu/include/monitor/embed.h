@@ -0,0 +1,64 @@
+#ifndef __EMBED_H__
+#define __EMBED_H__
+
+/* The API to embed NEMU into another program, exported by the shared
+ * library of `make SHARE=1' (and by the binary itself). This header only
+ * depends on the C library, so it can be copied into the program.
+ *
+ *   nemu_init(128 << 20);
+ *   nemu_load(nemu_get_pc(), image, size);
+ *   uint8_t *regs = nemu_add_mmio("dev", 0xa1000000, 8, dev_callback, NULL);
+ *   while (nemu_run(100000, &nr) == NEMU_EMBED_STOP) { ... }
+ *
+ * There is one machine in a process, see also monitor/machine.h. The
+ * shared library is built as the reference of differential testing, so
+ * it runs the plain interpreter. */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+enum { NEMU_EMBED_STOP = 0, NEMU_EMBED_END = 2, NEMU_EMBED_ABORT = 3 };
+
+/* Create the machine with `mem_size' bytes of physical memory, and reset
+ * it. Only called once, before the others. */
+void nemu_init(uint32_t mem_size);
+
+/* Copy `n' bytes from `buf' to the guest physical address `paddr', e.g.
+ * an image to the pc after reset. */
+void nemu_load(uint32_t paddr, const void *buf, size_t n);
+
+/* Run at most `n' instructions, and return NEMU_EMBED_STOP when they are
+ * done or nemu_stop() is called, or NEMU_EMBED_END or NEMU_EMBED_ABORT
+ * when the guest ends. The number of instructions executed is written to
+ * `*nr_done' if it is not NULL. */
+int nemu_run(uint64_t n, uint64_t *nr_done);
+/* make nemu_run() return after the current instruction, e.g. from an MMIO
+ * callback */
+void nemu_stop(void);
+/* the exit code of the guest after NEMU_EMBED_END */
+uint32_t nemu_halt_ret(void);
+
+/* The registers in the layout of differential testing of the ISA, i.e.
+ * the general purpose registers then pc for riscv32 and x86. */
+size_t nemu_regs_size(void);
+void nemu_get_regs(void *regs);
+void nemu_set_regs(const void *regs);
+uint32_t nemu_get_pc(void);
+void nemu_set_pc(uint32_t pc);
+
+/* The host address of the guest physical address `paddr', where at most
+ * `*len' bytes are contiguous, or NULL if it is not in the memory. Reading
+ * through it needs no copy. After writing through it, call
+ * nemu_mem_written() so the decoded instructions are dropped. */
+void* nemu_mem_map(uint32_t paddr, size_t *len);
+void nemu_mem_written(uint32_t paddr, size_t n);
+
+/* Map a device of `len' bytes at `paddr'. Its registers are the returned
+ * bytes: `callback' is called with the offset and the length of each
+ * access before a read and after a write. */
+typedef void (*nemu_mmio_callback_t)(void *opaque, uint32_t offset, int len, bool is_write);
+uint8_t* nemu_add_mmio(const char *name, uint32_t paddr, int len,
+    nemu_mmio_callback_t callback, void *opaque);
+
+#endif
@@ -11,4 +11,34 @@ typedef struct token {
 
 uint32_t expr(char *, bool *);
 
+/* An expression compiled to postfix code by expr_compile(), so it can be
+ * evaluated by expr_run() without parsing it again. The operands are
+ * numbers and pointers to registers, and the operators are those of
+ * the tokens. */
+typedef struct {
+  int type;
+  union {
+    uint32_t imm;
+    const uint32_t *reg;
+  };
+} ExprInst;
+
+typedef struct {
+  int len;
+  ExprInst *inst;
+} ExprCode;
+
+bool expr_compile(char *e, ExprCode *code);
+/* the two phases of expr_compile(), separated for the benchmark:
+ * return the number of tokens of `e', or -1 if it is invalid */
+int expr_tokenize(char *e);
+/* parse the tokens of the last expr_tokenize() into `code' */
+bool expr_parse(ExprCode *code);
+void expr_free(ExprCode *code);
+uint32_t expr_run(const ExprCode *code);
+/* whether `code' is `*ADDR' with a constant ADDR, which is stored into `addr' */
+bool expr_is_const_deref(const ExprCode *code, uint32_t *addr);
+/* whether `code' is a register alone, which is stored into `reg' */
+bool expr_is_reg(const ExprCode *code, const uint32_t **reg);
+
 #endif
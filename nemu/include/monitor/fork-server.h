@@ -0,0 +1,12 @@
+#ifndef __FORK_SERVER_H__
+#define __FORK_SERVER_H__
+
+#include "common.h"
+
+/* Serve the jobs on the UNIX socket of `spec' (PATH[:N]) instead of the
+ * monitor, after running N instructions first. */
+void init_fork_server(char *spec);
+/* Return false if NEMU is not started with '-k'. */
+bool fork_server_mainloop(void);
+
+#endif
@@ -0,0 +1,14 @@
+#ifndef __FTRACE_H__
+#define __FTRACE_H__
+
+#include "common.h"
+
+/* the kinds of instructions returned by isa_ftrace_kind() */
+enum { FT_CALL = 1, FT_RET };
+
+void init_ftrace(const char *file);
+/* called under DEBUG after executing the instruction at `pc' */
+void ftrace_step(vaddr_t pc, vaddr_t seq_pc);
+void ftrace_statistic(void);
+
+#endif
@@ -0,0 +1,13 @@
+#ifndef __FUZZ_H__
+#define __FUZZ_H__
+
+#include "common.h"
+
+/* Fuzz the decoders from the state after the start of NEMU instead of
+ * running the monitor, with the inputs kept in the directory of `spec'
+ * (DIR[:N[:JOBS]]), see fuzz.c. */
+void init_fuzz(char *spec);
+/* Return false if NEMU is not started with '-Z'. */
+bool fuzz_mainloop(void);
+
+#endif
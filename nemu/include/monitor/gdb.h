@@ -0,0 +1,11 @@
+#ifndef __GDB_H__
+#define __GDB_H__
+
+#include "common.h"
+
+/* Serve the remote protocol of GDB on `port' instead of the monitor. */
+void init_gdb(int port);
+/* Return false if NEMU is not started with '-G'. */
+bool gdb_mainloop(void);
+
+#endif
@@ -5,17 +5,20 @@
 
 #ifdef DEBUG
 extern FILE* log_fp;
+void log_printf(const char *fmt, ...) __attribute__((format(printf, 1, 2)));
 #	define log_write(...) \
   do { \
     if (log_fp != NULL) { \
-      fprintf(log_fp, __VA_ARGS__); \
-      fflush(log_fp); \
+      log_printf(__VA_ARGS__); \
     } \
   } while (0)
 #else
 #	define log_write(...)
 #endif
 
+/* Write the records logged so far to the log file, see log.c. */
+void log_flush(void);
+
 #define _Log(...) \
   do { \
     printf(__VA_ARGS__); \
@@ -24,4 +27,13 @@ extern FILE* log_fp;
 
 void strcatf(char *buf, const char *fmt, ...);
 
+/* The bytes of the current instruction, recorded by instr_fetch(). */
+#define LOG_INSTR_MAX 16
+extern uint8_t log_instr[LOG_INSTR_MAX];
+extern int log_instr_len;
+
+/* Whether the text of the current instruction is needed by the log or
+ * the screen. The operands and the instruction are only formatted if so. */
+extern bool log_asm;
+
 #endif
@@ -0,0 +1,20 @@
+#ifndef __MACHINE_H__
+#define __MACHINE_H__
+
+#include "common.h"
+
+/* A machine which is not running: the state of the CPU, the devices and
+ * the monitor in an in-memory checkpoint, with its own pmem. Several
+ * guests are run in one process by swapping them in and out of the
+ * running machine, one at a time. */
+typedef struct Machine Machine;
+
+/* Take the state at the reset, before the image is loaded. */
+void init_machine(void);
+/* a new machine at the reset with the image `img_file' loaded */
+Machine *machine_new(const char *img_file);
+/* Run the machine in `m', and save the running one into `m'. */
+void machine_swap(Machine *m);
+void machine_free(Machine *m);
+
+#endif
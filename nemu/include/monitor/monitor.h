@@ -13,4 +13,61 @@ typedef struct {
 
 extern NEMUState nemu_state;
 
+/* Set when something outside the running instructions needs service,
+ * e.g. a change of `nemu_state'. */
+extern volatile int nemu_event;
+
+/* The number of guest instructions executed. It is kept up to date by
+ * every engine, so a device can read it in the middle of a run, when it
+ * counts the instructions before the current one. */
+extern uint64_t g_nr_guest_instr;
+
+/* the value of `g_nr_guest_instr' when the next device event is due */
+extern uint64_t nemu_deadline;
+
+/* The fast loops in cpu_exec() only check this after each instruction,
+ * and call nemu_handle_event() if it is true. */
+static inline bool nemu_event_pending(void) {
+  return nemu_event || g_nr_guest_instr >= nemu_deadline;
+}
+
+bool nemu_handle_event(void);
+
+/* With DEBUG, DIFF_TEST or the memory instrumentation, the instructions
+ * are run by the instrumented loop of cpu_exec(), which traces them,
+ * checks the watchpoints and tests them against REF. The fast loop of the
+ * builds without them is built as well, and exec_set_fast() switches to
+ * it and back in the middle of a run. Differential testing is detached
+ * while it is fast. exec_fast_until() runs fast until `nr_instr'
+ * instructions have been executed in total, or the next pc is `pc'.
+ * Every build without the instrumented loop is always fast. */
+void exec_set_fast(bool fast);
+void exec_fast_until(uint64_t nr_instr, vaddr_t pc);
+bool exec_is_fast(void);
+
+/* The interrupt line raised by the devices. It is not polled after each
+ * instruction: nemu_event is set when the line is raised while the ISA
+ * accepts interrupts, and the ISA calls intr_update() when it changes
+ * its interrupt enable bit. Then the interrupt is delivered by
+ * isa_query_intr() in nemu_handle_event(). */
+extern bool nemu_intr;
+void intr_update(void);
+/* does the ISA accept an interrupt now */
+bool isa_intr_enabled(void);
+/* deliver the interrupt if the ISA accepts it, return true if it does */
+bool isa_query_intr(void);
+
+/* The pcs of the last NR_IRING instructions executed, recorded by every
+ * engine (only the first instruction of each block with RTL_JIT). They
+ * are printed by iring_dump() when NEMU aborts. */
+#define NR_IRING 4096
+extern vaddr_t iring[NR_IRING];
+extern uint32_t iring_idx;
+
+static inline void iring_push(vaddr_t pc) {
+  iring[iring_idx ++ % NR_IRING] = pc;
+}
+
+void iring_dump(void);
+
 #endif
@@ -0,0 +1,42 @@
+#ifndef __PERF_H__
+#define __PERF_H__
+
+#include "common.h"
+#include <stdio.h>
+
+/* The performance counters are reported by each module through these
+ * functions, as indented text by 'info perf', or as a JSON object with
+ * '-j FILE' at exit. */
+typedef struct {
+  FILE *fp;
+  bool json;
+  int depth;
+  bool first;  // nothing is written in the current group yet
+} PerfOut;
+
+void perf_begin(PerfOut *o, const char *group);
+void perf_end(PerfOut *o);
+void perf_u64(PerfOut *o, const char *name, uint64_t val);
+void perf_double(PerfOut *o, const char *name, double val);
+
+/* the host time in us since NEMU starts */
+uint64_t perf_host_us(void);
+
+void init_perf(const char *json_file);
+void perf_dump(FILE *fp, bool json);
+void perf_statistic(void);
+
+/* the counters of each module */
+void cpu_perf(PerfOut *o);
+void hart_perf(PerfOut *o);
+void pio_perf(PerfOut *o);
+void mmio_perf(PerfOut *o);
+void difftest_perf(PerfOut *o);
+void cache_perf(PerfOut *o);
+void isa_perf(PerfOut *o);
+void expr_bench_perf(PerfOut *o);
+void nemu_bench_perf(PerfOut *o);
+void marker_perf(PerfOut *o);
+void vga_perf(PerfOut *o);
+
+#endif
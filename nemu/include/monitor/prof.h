@@ -0,0 +1,16 @@
+#ifndef __PROF_H__
+#define __PROF_H__
+
+#include "common.h"
+
+/* set by the timer of the host when a sample is due */
+extern volatile int prof_pending;
+
+/* Sample the pc every `spec' guest instructions, or every `spec' us of
+ * host CPU time if it ends with "us". `backtrace' also samples the
+ * callers by the frame pointer. The profile is written to `file' at exit. */
+void init_prof(const char *file, const char *spec, bool backtrace);
+void prof_sample(void);
+void prof_statistic(void);
+
+#endif
@@ -0,0 +1,53 @@
+#ifndef __REVERSE_H__
+#define __REVERSE_H__
+
+#include "common.h"
+#include "monitor/monitor.h"
+
+/* Reverse execution. While recording, a checkpoint of the machine is kept
+ * every interval of instructions, and the inputs from the host are logged.
+ * Going backwards restores the nearest checkpoint before the target, and
+ * executes forward again with the inputs read back from the log. */
+
+/* Start recording with a checkpoint every `interval' instructions. */
+void rev_start(uint64_t interval);
+void rev_stop(void);
+/* Called when the machine is changed by other means, e.g. loading a
+ * snapshot. The recording starts again from here. */
+void rev_reset(void);
+
+/* Go back `n' instructions. */
+void rev_step(uint64_t n);
+/* Go back to the last instruction which changes a watchpoint, and stop
+ * before it. */
+void rev_continue(void);
+
+/* Before `rev_replay_end', the instructions have been executed while
+ * recording, and they are executed again with the logged inputs. */
+extern uint64_t rev_replay_end;
+
+static inline bool rev_is_replaying(void) {
+  return g_nr_guest_instr < rev_replay_end;
+}
+
+/* set while going backwards, so what is executed again is not shown */
+extern bool rev_quiet;
+
+/* Log an input from the host when it is not replaying, e.g. a key. */
+void rev_input_record(uint64_t val);
+/* the next input in the log when replaying */
+uint64_t rev_input_replay(void);
+
+/* Save the inputs of the whole run into `file', or replay them from it,
+ * and check the state at the end with rev_input_finish(). */
+void rev_input_save(const char *file);
+void rev_input_load(const char *file);
+void rev_input_finish(void);
+extern bool rev_input_loaded;
+
+/* whether the inputs come from a log instead of the host */
+static inline bool rev_input_is_logged(void) {
+  return rev_is_replaying() || rev_input_loaded;
+}
+
+#endif
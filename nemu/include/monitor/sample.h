@@ -0,0 +1,34 @@
+#ifndef __SAMPLE_H__
+#define __SAMPLE_H__
+
+#include "common.h"
+
+/* Sampled simulation, configured by a spec like
+ * "interval=100000000,window=1000000,bbv=FILE", see src/monitor/sample.c.
+ * Called after the devices are initialized. */
+void init_sample(const char *spec);
+
+/* true inside a detailed window, when the cache simulator, the heat map,
+ * the opcode statistics and the profiler count; always true without
+ * sampling */
+extern bool sample_detailed;
+
+/* set when the basic block vectors are collected */
+extern bool bbv_on;
+/* `nr' instructions of the block from `pc' have been executed */
+void bbv_count(vaddr_t pc, uint64_t nr);
+
+/* Called after each instruction by the engines running one instruction at
+ * a time, which end a block at each taken jump, i.e. when the next pc is
+ * not `seq_pc'. */
+static inline void bbv_step(vaddr_t pc, vaddr_t seq_pc, vaddr_t next_pc) {
+  extern vaddr_t bbv_block_pc;
+  extern uint64_t bbv_block_len;
+  if (bbv_block_len ++ == 0) bbv_block_pc = pc;
+  if (next_pc != seq_pc) {
+    bbv_count(bbv_block_pc, bbv_block_len);
+    bbv_block_len = 0;
+  }
+}
+
+#endif
@@ -0,0 +1,16 @@
+#ifndef __SCRIPT_H__
+#define __SCRIPT_H__
+
+#include "common.h"
+
+/* Run the commands of the monitor in the file of `spec' (SCRIPT[:JSON])
+ * instead of reading them, and write the results as JSON to the file
+ * JSON, or to stdout. */
+void init_script(char *spec);
+/* Return false if NEMU is not started with '-B'. */
+bool script_mainloop(void);
+
+/* Execute a command line of the monitor. Return a negative value for 'q'. */
+int ui_exec(char *line);
+
+#endif
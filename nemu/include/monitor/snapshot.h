@@ -0,0 +1,40 @@
+#ifndef __SNAPSHOT_H__
+#define __SNAPSHOT_H__
+
+#include "common.h"
+
+/* A snapshot of the machine is saved and restored by the same code in
+ * each module, which calls snapshot_sync() for each piece of its state.
+ * The state is written to the snapshot when saving, and copied back when
+ * restoring. Restoring is done twice, first only to check that every
+ * section is there with the same size, so a bad snapshot changes nothing. */
+typedef struct Snapshot Snapshot;
+
+/* Save or restore `size' bytes at `data' as the section `name'. */
+void snapshot_sync(Snapshot *s, const char *name, void *data, size_t size);
+/* whether the section `name' is there, always true when saving */
+bool snapshot_has(Snapshot *s, const char *name);
+/* true if the state has just been restored, to update what depends on it */
+bool snapshot_is_restoring(Snapshot *s);
+/* true for the in-memory checkpoints of reverse execution, which leave out
+ * the state coming from the host, e.g. the keys queued */
+bool snapshot_is_checkpoint(Snapshot *s);
+
+bool snapshot_save(const char *file);
+bool snapshot_load(const char *file);
+
+/* An in-memory checkpoint has the same sections as a snapshot file, but
+ * not pmem, which is kept by its user, see src/monitor/reverse.c. */
+Snapshot *snapshot_take(void);
+void snapshot_restore(Snapshot *s);
+void snapshot_free(Snapshot *s);
+
+/* the snapshots of the devices, see src/device/device.c */
+void device_snapshot(Snapshot *s);
+void io_snapshot(Snapshot *s);
+void event_snapshot(Snapshot *s);
+void key_snapshot(Snapshot *s);
+void timer_snapshot(Snapshot *s);
+void vga_snapshot(Snapshot *s);
+
+#endif
@@ -0,0 +1,23 @@
+#ifndef __SYMBOL_H__
+#define __SYMBOL_H__
+
+#include "common.h"
+
+/* The functions in `.symtab' of the guest ELF given by '-e', sorted by
+ * their addresses. */
+typedef struct {
+  vaddr_t addr;
+  uint32_t size;
+  const char *name;
+} Symbol;
+
+extern Symbol *symtab;
+extern int nr_symbol;
+
+void init_symbol(const char *elf_file);
+/* the index in `symtab' of the function containing `addr', or -1 */
+int symbol_find(vaddr_t addr);
+/* the name of the function containing `addr', or NULL */
+const char *symbol_name(vaddr_t addr);
+
+#endif
@@ -11,13 +11,32 @@ typedef struct watchpoint {
   /* TODO: Add more members if necessary */
   uint32_t val;
   char expression[64];
+  /* `expression' compiled, evaluated after every instruction */
+  ExprCode code;
+  /* a memory watchpoint, on the 4 bytes at `pmem_offset' */
+  bool is_mem;
+  uint32_t pmem_offset;
+  /* a register watchpoint, compared with `val' without evaluating `code' */
+  bool is_reg;
+  const uint32_t *reg;
 
 } WP;
 
 WP* new_wp();
+void arm_wp(WP *wp);
 void free_wp(WP *wp);
 WP* wp_no2ptr(int NO);
 void wp_display();
 bool wp_check();
+void wp_update();
+
+/* the number of register watchpoints */
+extern int nr_reg_wp;
+bool wp_reg_watched(const void *reg);
+/* check the register watchpoints only, after some instructions writing them */
+void wp_reg_check(void);
+
+/* the number of times the watchpoints are found changed */
+extern uint64_t wp_nr_hit;
 
 #endif
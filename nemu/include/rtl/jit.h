@@ -0,0 +1,140 @@
+#ifndef __RTL_JIT_H__
+#define __RTL_JIT_H__
+
+#include "common.h"
+
+#if defined(RTL_JIT) && defined(DECODE_CACHE) && !defined(DEBUG) && !defined(DIFF_TEST) && !defined(MEM_INSTRUMENT)
+#define JIT_ENGINE
+#endif
+
+#ifdef JIT_ENGINE
+
+#ifndef __x86_64__
+#error "the RTL JIT only emits x86-64 code"
+#endif
+
+/* RTL instructions recorded for a block, see src/cpu/jit.c */
+enum {
+  JOP_li, JOP_mv,
+  JOP_add, JOP_sub, JOP_and, JOP_or, JOP_xor, JOP_shl, JOP_shr, JOP_sar,
+  JOP_mul_lo, JOP_mul_hi, JOP_imul_lo, JOP_imul_hi,
+  JOP_lm, JOP_sm, JOP_setrelop, JOP_j, JOP_jr, JOP_jrelop,
+  JOP_unsupported,
+  /* boundaries of guest instructions */
+  JOP_insn, JOP_end,
+};
+
+extern bool jit_recording;
+void jit_record(int op, const rtlreg_t *dest, const rtlreg_t *src1,
+    const rtlreg_t *src2, uint32_t imm, uint32_t imm2);
+
+#define JIT_REC(...) do { if (jit_recording) jit_record(__VA_ARGS__); } while (0)
+
+/* The JIT backend of RTL. Each instruction is still interpreted, and it
+ * is also recorded while a block is being built. */
+
+#define jit_rtl_li(dest, imm) do { \
+    rtlreg_t *_d = (dest); uint32_t _imm = (imm); \
+    JIT_REC(JOP_li, _d, NULL, NULL, _imm, 0); \
+    interpret_rtl_li(_d, _imm); \
+  } while (0)
+
+#define jit_rtl_mv(dest, src1) do { \
+    rtlreg_t *_d = (dest); const rtlreg_t *_s1 = (src1); \
+    JIT_REC(JOP_mv, _d, _s1, NULL, 0, 0); \
+    interpret_rtl_mv(_d, _s1); \
+  } while (0)
+
+#define JIT_RTL_BINARY(name, dest, src1, src2) do { \
+    rtlreg_t *_d = (dest); const rtlreg_t *_s1 = (src1), *_s2 = (src2); \
+    JIT_REC(concat(JOP_, name), _d, _s1, _s2, 0, 0); \
+    concat(interpret_rtl_, name)(_d, _s1, _s2); \
+  } while (0)
+
+#define jit_rtl_add(...)     JIT_RTL_BINARY(add, __VA_ARGS__)
+#define jit_rtl_sub(...)     JIT_RTL_BINARY(sub, __VA_ARGS__)
+#define jit_rtl_and(...)     JIT_RTL_BINARY(and, __VA_ARGS__)
+#define jit_rtl_or(...)      JIT_RTL_BINARY(or, __VA_ARGS__)
+#define jit_rtl_xor(...)     JIT_RTL_BINARY(xor, __VA_ARGS__)
+#define jit_rtl_shl(...)     JIT_RTL_BINARY(shl, __VA_ARGS__)
+#define jit_rtl_shr(...)     JIT_RTL_BINARY(shr, __VA_ARGS__)
+#define jit_rtl_sar(...)     JIT_RTL_BINARY(sar, __VA_ARGS__)
+#define jit_rtl_mul_lo(...)  JIT_RTL_BINARY(mul_lo, __VA_ARGS__)
+#define jit_rtl_mul_hi(...)  JIT_RTL_BINARY(mul_hi, __VA_ARGS__)
+#define jit_rtl_imul_lo(...) JIT_RTL_BINARY(imul_lo, __VA_ARGS__)
+#define jit_rtl_imul_hi(...) JIT_RTL_BINARY(imul_hi, __VA_ARGS__)
+
+/* the host does not raise the same exception as the guest on division,
+ * so instructions using them are left to the interpreter */
+#define JIT_RTL_UNSUPPORTED(name, ...) do { \
+    JIT_REC(JOP_unsupported, NULL, NULL, NULL, 0, 0); \
+    concat(interpret_rtl_, name)(__VA_ARGS__); \
+  } while (0)
+
+#define jit_rtl_div_q(...)    JIT_RTL_UNSUPPORTED(div_q, __VA_ARGS__)
+#define jit_rtl_div_r(...)    JIT_RTL_UNSUPPORTED(div_r, __VA_ARGS__)
+#define jit_rtl_idiv_q(...)   JIT_RTL_UNSUPPORTED(idiv_q, __VA_ARGS__)
+#define jit_rtl_idiv_r(...)   JIT_RTL_UNSUPPORTED(idiv_r, __VA_ARGS__)
+#define jit_rtl_div64_q(...)  JIT_RTL_UNSUPPORTED(div64_q, __VA_ARGS__)
+#define jit_rtl_div64_r(...)  JIT_RTL_UNSUPPORTED(div64_r, __VA_ARGS__)
+#define jit_rtl_idiv64_q(...) JIT_RTL_UNSUPPORTED(idiv64_q, __VA_ARGS__)
+#define jit_rtl_idiv64_r(...) JIT_RTL_UNSUPPORTED(idiv64_r, __VA_ARGS__)
+#define jit_rtl_host_lm(...)  JIT_RTL_UNSUPPORTED(host_lm, __VA_ARGS__)
+#define jit_rtl_host_sm(...)  JIT_RTL_UNSUPPORTED(host_sm, __VA_ARGS__)
+#define jit_rtl_exit(...)     JIT_RTL_UNSUPPORTED(exit, __VA_ARGS__)
+
+#define jit_rtl_lm(dest, addr, len) do { \
+    rtlreg_t *_d = (dest); const rtlreg_t *_a = (addr); int _len = (len); \
+    JIT_REC(JOP_lm, _d, _a, NULL, _len, 0); \
+    interpret_rtl_lm(_d, _a, _len); \
+  } while (0)
+
+#define jit_rtl_sm(addr, src1, len) do { \
+    const rtlreg_t *_a = (addr), *_s1 = (src1); int _len = (len); \
+    JIT_REC(JOP_sm, NULL, _a, _s1, _len, 0); \
+    interpret_rtl_sm(_a, _s1, _len); \
+  } while (0)
+
+#define jit_rtl_setrelop(relop, dest, src1, src2) do { \
+    uint32_t _r = (relop); rtlreg_t *_d = (dest); \
+    const rtlreg_t *_s1 = (src1), *_s2 = (src2); \
+    JIT_REC(JOP_setrelop, _d, _s1, _s2, _r, 0); \
+    interpret_rtl_setrelop(_r, _d, _s1, _s2); \
+  } while (0)
+
+#define jit_rtl_j(target) do { \
+    vaddr_t _t = (target); \
+    JIT_REC(JOP_j, NULL, NULL, NULL, _t, 0); \
+    interpret_rtl_j(_t); \
+  } while (0)
+
+#define jit_rtl_jr(target) do { \
+    rtlreg_t *_t = (target); \
+    JIT_REC(JOP_jr, NULL, _t, NULL, 0, 0); \
+    interpret_rtl_jr(_t); \
+  } while (0)
+
+#define jit_rtl_jrelop(relop, src1, src2, target) do { \
+    uint32_t _r = (relop); const rtlreg_t *_s1 = (src1), *_s2 = (src2); \
+    vaddr_t _t = (target); \
+    JIT_REC(JOP_jrelop, NULL, _s1, _s2, _t, _r); \
+    interpret_rtl_jrelop(_r, _s1, _s2, _t); \
+  } while (0)
+
+uint64_t jit_run(uint64_t n);
+/* report the traces formed and optimized */
+void jit_statistic(void);
+/* write the blocks translated into C to FILE, or load them from FILE.so */
+void jit_aot_config(const char *file);
+
+/* an instruction with effects outside RTL, e.g. on the CSRs or the TLB,
+ * is called back into the interpreter every time */
+#define jit_interpret_only() JIT_REC(JOP_unsupported, NULL, NULL, NULL, 0, 0)
+
+#else
+
+#define jit_interpret_only()
+
+#endif
+
+#endif
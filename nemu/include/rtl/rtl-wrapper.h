@@ -2,8 +2,13 @@
 #define __RTL_RTL_WRAPPER_H__
 
 #include "macro.h"
+#include "rtl/jit.h"
 
+#ifdef JIT_ENGINE
+#define RTL_PREFIX jit
+#else
 #define RTL_PREFIX interpret
+#endif
 
 #define rtl_li        concat(RTL_PREFIX, _rtl_li      )
 #define rtl_mv        concat(RTL_PREFIX, _rtl_mv      )
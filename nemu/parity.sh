@@ -0,0 +1,73 @@
+#!/bin/bash
+
+# Run the benchmarks of APPS natively and on NEMU of each ISA given (all of
+# them by default), and report how many times slower NEMU is:
+#
+#   ./parity.sh [ISA...]
+#
+# Each result is also appended to $PARITY_LOG with the date and the commit,
+# so the slowdown can be tracked over time. The wall-clock time of the whole
+# run is measured for both, including the start of the process.
+
+APPS=${APPS:-"microbench coremark dhrystone"}
+MAINARGS=${MAINARGS:-train}
+PARITY_LOG=${PARITY_LOG:-$NEMU_HOME/parity.csv}
+ISAS=${@:-$(ls src/isa/)}
+
+now() {
+  date +%s.%N
+}
+
+# run "$@", and print the seconds taken if it succeeds and the output
+# has `$1'
+timed_run() {
+  pattern=$1
+  shift
+  out=$(mktemp)
+  start=$(now)
+  "$@" &> $out
+  status=$?
+  end=$(now)
+  if [ $status -eq 0 ] && { [ -z "$pattern" ] || grep -q "$pattern" $out; }; then
+    echo "$end $start" | awk '{ printf "%.3f", $1 - $2 }'
+  fi
+  rm -f $out
+}
+
+commit=$(git rev-parse --short HEAD 2> /dev/null)
+date=$(date +%F)
+[ -f $PARITY_LOG ] || echo "date,commit,isa,app,native,nemu,slowdown" > $PARITY_LOG
+
+declare -A native
+for app in $APPS; do
+  if ! make -C $AM_HOME/apps/$app ARCH=native mainargs=$MAINARGS &> /dev/null; then
+    echo "$app: native compile error"
+    continue
+  fi
+  native[$app]=$(timed_run "" $AM_HOME/apps/$app/build/$app-native)
+done
+
+printf "%-10s %-12s %10s %10s %10s\n" ISA APP NATIVE NEMU SLOWDOWN
+for isa in $ISAS; do
+  if ! make ISA=$isa PERF=1 &> /dev/null; then
+    echo "$isa: NEMU compile error"
+    continue
+  fi
+  nemu=build/$isa-nemu-perf
+
+  for app in $APPS; do
+    [ -n "${native[$app]}" ] || continue
+    if ! make -C $AM_HOME/apps/$app ARCH=$isa-nemu mainargs=$MAINARGS &> /dev/null; then
+      echo "$app: $isa-nemu compile error"
+      continue
+    fi
+    t=$(timed_run "HIT GOOD TRAP" $nemu -b $AM_HOME/apps/$app/build/$app-$isa-nemu.bin)
+    if [ -z "$t" ]; then
+      printf "%-10s %-12s %10s %10s\n" $isa $app ${native[$app]} fail
+      continue
+    fi
+    slowdown=$(echo "$t ${native[$app]}" | awk '{ printf "%.1f", ($2 > 0 ? $1 / $2 : 0) }')
+    printf "%-10s %-12s %10s %10s %9sx\n" $isa $app ${native[$app]} $t $slowdown
+    echo "$date,$commit,$isa,$app,${native[$app]},$t,$slowdown" >> $PARITY_LOG
+  done
+done
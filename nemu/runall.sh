@@ -20,22 +20,7 @@ else
 fi
 
 files=`ls $AM_HOME/tests/cputest/build/*-$ISA-nemu.bin`
-ori_log="build/nemu-log.txt"
 
-for file in $files; do
-  base=`basename $file | sed -e "s/-$ISA-nemu.bin//"`
-  printf "[%14s] " $base
-  logfile=$base-log.txt
-  make ISA=$ISA run ARGS="-b -l $ori_log $file" &> $logfile
-
-  if (grep 'nemu: .*HIT GOOD TRAP' $logfile > /dev/null) then
-    echo -e "\033[1;32mPASS!\033[0m"
-    rm $logfile
-  else
-    echo -e "\033[1;31mFAIL!\033[0m see $logfile for more information"
-    if (test -e $ori_log) then
-      echo -e "\n\n===== the original log.txt =====\n" >> $logfile
-      cat $ori_log >> $logfile
-    fi
-  fi
-done
+# all the testcases at once, the outputs of the failed ones are kept in
+# build/batch-$ISA
+make ISA=$ISA batch IMAGES="$files"
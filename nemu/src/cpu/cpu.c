@@ -1,4 +1,6 @@
 #include "cpu/exec.h"
+#include "cpu/decode-cache.h"
+#include "monitor/monitor.h"
 
 CPU_state cpu;
 
@@ -14,8 +16,13 @@ void decinfo_set_jmp(bool is_jmp) {
 void isa_exec(vaddr_t *pc);
 
 vaddr_t exec_once(void) {
+  iring_push(cpu.pc);
   decinfo.seq_pc = cpu.pc;
+#ifdef DECODE_CACHE
+  dcache_exec(&decinfo.seq_pc);
+#else
   isa_exec(&decinfo.seq_pc);
+#endif
   update_pc();
 
   return decinfo.seq_pc;
@@ -0,0 +1,162 @@
+#include "cpu/decode-cache.h"
+#include "monitor/breakpoint.h"
+#include <stdlib.h>
+
+#ifdef DECODE_CACHE
+
+/* A direct-mapped cache of decoded instructions keyed by guest pc.
+ * An entry records the result of `isa_fetch()', i.e. the raw instruction
+ * fields in `decinfo.isa' and the resolved opcode table entry, so a hit
+ * skips the instruction fetch and the table walk. The operands still
+ * have to be decoded by the decode helper, since their values depend
+ * on the register state. The helpers take about a fifth of the time of
+ * a hot loop, but most of it is reading the registers and filling the
+ * operands, which a cached operand would do again on every hit: caching
+ * the operands of the loads, stores and branches of mips32 and loading
+ * only their registers on a hit saved no more than 4%, within the noise.
+ *
+ * Each page of pmem has a generation number which is bumped when the
+ * code decoded from the page is written. An entry is valid only if its
+ * generation matches the current one of its page. Entries are keyed by
+ * virtual address, so everything should be flushed with dcache_flush()
+ * when the translation of fetches changes. An instruction crossing the
+ * end of a page (e.g. of x86, or a 4-byte one after a compressed one of
+ * riscv32) is never cached, since its tail may be in another physical
+ * page whose writes would not invalidate the entry. Such instructions
+ * are rare enough to be decoded every time.
+ *
+ * The bytes decoded are tracked in chunks of DC_CHUNK bytes. A write to a
+ * page without code costs a test of `dcache_code_page' only, and a write
+ * to the data of a page with code, e.g. a variable next to the code or a
+ * new program loaded over the old one, bumps the generation only if it
+ * hits a chunk holding decoded bytes. The chunks are cleared with the
+ * page, and marked again as the code of the page is decoded again.
+ */
+
+#define NR_DC_ENTRY (1 << 14)
+#define DC_CHUNK 64
+#define NR_DC_CHUNK (PAGE_SIZE / DC_CHUNK)
+
+static DCEntry dcache[NR_DC_ENTRY];
+uint32_t *dcache_page_gen = NULL;
+uint8_t *dcache_code_page = NULL;
+/* the chunks of each page holding decoded bytes */
+static uint64_t *code_chunk = NULL;
+
+static uint64_t nr_code_write = 0, nr_invalidate = 0;
+
+void init_dcache(void) {
+  dcache_page_gen = calloc(NR_PMEM_PAGE + 1, sizeof(dcache_page_gen[0]));
+  dcache_code_page = calloc(NR_PMEM_PAGE + 1, sizeof(dcache_code_page[0]));
+  code_chunk = calloc(NR_PMEM_PAGE + 1, sizeof(code_chunk[0]));
+  assert(dcache_page_gen != NULL && dcache_code_page != NULL && code_chunk != NULL);
+}
+
+static inline uint32_t dc_idx(vaddr_t pc) {
+  return (pc ^ (pc >> 2)) & (NR_DC_ENTRY - 1);
+}
+
+/* the chunks covered by [pmem_offset, pmem_offset + len), which is inside one page */
+static inline uint64_t chunk_mask(uint32_t pmem_offset, int len) {
+  int first = (pmem_offset & PAGE_MASK) / DC_CHUNK;
+  int last = ((pmem_offset & PAGE_MASK) + len - 1) / DC_CHUNK;
+  assert(last < NR_DC_CHUNK);
+  uint64_t upto_last = (last == 63 ? ~0ull : (1ull << (last + 1)) - 1);
+  return upto_last & ~((1ull << first) - 1);
+}
+
+static inline bool invalidate(uint32_t page, uint64_t mask) {
+  if (!(code_chunk[page] & mask)) return false;
+  dcache_code_page[page] = 0;
+  code_chunk[page] = 0;
+  dcache_page_gen[page] ++;
+  return true;
+}
+
+void dcache_invalidate(uint32_t pmem_offset, int len) {
+  uint32_t end = pmem_offset + len - 1;
+  bool hit;
+  if (pmem_offset / PAGE_SIZE == end / PAGE_SIZE) {
+    hit = invalidate(pmem_offset / PAGE_SIZE, chunk_mask(pmem_offset, len));
+  }
+  else {
+    int len0 = PAGE_SIZE - (pmem_offset & PAGE_MASK);
+    hit = invalidate(pmem_offset / PAGE_SIZE, chunk_mask(pmem_offset, len0));
+    hit |= invalidate(end / PAGE_SIZE, chunk_mask(end & ~PAGE_MASK, len - len0));
+  }
+  nr_code_write ++;
+  if (hit) nr_invalidate ++;
+}
+
+void dcache_mark(uint32_t pmem_offset, int len) {
+  uint32_t page = pmem_offset / PAGE_SIZE;
+  dcache_code_page[page] = 1;
+  code_chunk[page] |= chunk_mask(pmem_offset, len);
+}
+
+void dcache_statistic(void) {
+  if (nr_code_write == 0) return;
+  Log("%ld writes to the pages with decoded code, %ld of them invalidate it",
+      nr_code_write, nr_invalidate);
+}
+
+void dcache_invalidate_pc(vaddr_t pc) {
+  int offset = ifetch_pmem_offset(pc);
+  if (offset < 0) dcache_flush();
+  else invalidate(offset / PAGE_SIZE, ~0ull);
+}
+
+/* Invalidate everything decoded from pmem, including translation blocks. */
+void dcache_flush(void) {
+  int i;
+  for (i = 0; i < NR_PMEM_PAGE + 1; i ++) {
+    dcache_code_page[i] = 0;
+    code_chunk[i] = 0;
+    dcache_page_gen[i] ++;
+  }
+}
+
+/* Decode the instruction at `pc' into `dc'. The result is left in `decinfo'
+ * as well. Return false if the instruction can not be cached, but `dc->e'
+ * and `dc->fetch_pc' are still valid for executing it once. */
+bool dcache_fetch(DCEntry *dc, vaddr_t pc) {
+  vaddr_t fetch_pc = pc;
+  dc->e = isa_fetch(&fetch_pc);
+  dc->fetch_pc = fetch_pc;
+  dc->trap = (nr_bp > 0 && bp_is_trap(pc));
+  if (dc->trap) dc->e = &bp_trap_entry;
+
+  int offset = ifetch_pmem_offset(pc);
+  if (offset < 0) return false;
+  int len = fetch_pc - pc;
+  if ((pc & PAGE_MASK) + len > PAGE_SIZE) return false;
+
+  dc->pc = pc;
+  dc->page = offset / PAGE_SIZE;
+  dc->gen = dcache_page_gen[dc->page];
+  dc->opcode = decinfo.opcode;
+  dc->width = decinfo.width;
+  dc->src_width = decinfo.src.width;
+  dc->dest_width = decinfo.dest.width;
+  dc->src2_width = decinfo.src2.width;
+  dc->isa = decinfo.isa;
+  dcache_mark(offset, len);
+  return true;
+}
+
+void dcache_exec(vaddr_t *pc) {
+  DCEntry *dc = &dcache[dc_idx(*pc)];
+
+  if (dc->e != NULL && dc->pc == *pc && dcache_is_valid(dc)) {
+    dcache_idex(pc, dc);
+    return;
+  }
+
+  /* the result of fetching is already in `decinfo' */
+  bool ok = dcache_fetch(dc, *pc);
+  *pc = dc->fetch_pc;
+  idex(pc, dc->e);
+  if (!ok) dc->e = NULL;
+}
+
+#endif
@@ -0,0 +1,79 @@
+#include "nemu.h"
+#include "cpu/hart.h"
+#include "monitor/perf.h"
+
+/* The state of each hart is saved here when another one is running, and
+ * only the running hart is in `cpu', so the engines, the decode helpers
+ * and the RTL temporaries are all used by one hart at a time. The memory
+ * and the devices are shared by all the harts.
+ *
+ * Since the harts do not run at the same time on the host, an atomic
+ * instruction of the guest is also atomic to the other harts. The ISA is
+ * told about a switch by isa_hart_switch(), to drop what it caches of the
+ * state of the previous hart, e.g. the reservation of lr/sc.
+ *
+ * The harts are switched only by the number of instructions, which is
+ * kept across the calls of cpu_exec(), so the order of the harts is the
+ * same in every run, however the guest is stepped by the monitor. A run
+ * is then the same every time if the devices are, e.g. with a virtual
+ * clock of '-t'. */
+
+int nr_hart = 1, cur_hart = 0;
+uint64_t hart_quantum = HART_QUANTUM_DEFAULT;
+uint64_t hart_quantum_left = HART_QUANTUM_DEFAULT;
+
+static CPU_state harts[MAX_HART];
+static uint64_t nr_hart_switch = 0;
+
+#ifdef ISA_SMP
+void isa_hart_init(int id);
+void isa_hart_switch(const CPU_state *prev);
+#endif
+
+/* Start `n' harts with the state of `cpu' after the reset. */
+void init_hart(int n, uint64_t quantum) {
+  Assert(n >= 1 && n <= MAX_HART, "the number of harts should be 1 to %d", MAX_HART);
+  Assert(quantum > 0, "the quantum of the harts should not be 0");
+#ifndef ISA_SMP
+  Assert(n == 1, "SMP is not supported by %s", str(__ISA__));
+#else
+  CPU_state reset = cpu;
+  int i;
+  for (i = 1; i < n; i ++) {
+    cpu = reset;
+    isa_hart_init(i);
+    harts[i] = cpu;
+  }
+  cpu = reset;
+  isa_hart_init(0);
+#endif
+  nr_hart = n;
+  cur_hart = 0;
+  hart_quantum = hart_quantum_left = quantum;
+}
+
+void hart_switch(int id) {
+  if (id == cur_hart) return;
+  nr_hart_switch ++;
+  int prev = cur_hart;
+  harts[prev] = cpu;
+  cpu = harts[id];
+  cur_hart = id;
+#ifdef ISA_SMP
+  isa_hart_switch(&harts[prev]);
+#endif
+}
+
+void hart_schedule(void) {
+  if (hart_quantum_left > 0) return;
+  hart_switch((cur_hart + 1) % nr_hart);
+  hart_quantum_left = hart_quantum;
+}
+
+void hart_perf(PerfOut *o) {
+  perf_begin(o, "hart");
+  perf_u64(o, "harts", nr_hart);
+  perf_u64(o, "quantum", hart_quantum);
+  perf_u64(o, "switch", nr_hart_switch);
+  perf_end(o);
+}
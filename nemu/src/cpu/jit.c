@@ -0,0 +1,1237 @@
+#include "cpu/exec.h"
+#include "cpu/decode-cache.h"
+#include "monitor/monitor.h"
+#include "monitor/watchpoint.h"
+
+#ifdef JIT_ENGINE
+
+#include <sys/mman.h>
+#include <dlfcn.h>
+
+/* A block is built by interpreting its instructions one by one while
+ * recording the RTL instructions they emit. It ends at the first
+ * control transfer, at the end of a page, or at an instruction which
+ * uses something the backend does not translate (e.g. rtl_exit() or
+ * division). Such an instruction is called back into the interpreter
+ * from the translated code and ends the block.
+ *
+ * The recorded RTL is then translated into x86-64 code. The RTL
+ * registers (guest registers, temporaries and operands in `decinfo')
+ * are cached in host registers inside the block, and written back at
+ * every exit. Loads and stores go to pmem directly, and call out to
+ * vaddr_read()/vaddr_write() for MMIO or for stores to pages holding
+ * decoded code. A translated block returns the number of instructions
+ * it has executed with `cpu.pc' pointing to the next one. Around a call
+ * out, `g_nr_guest_instr' also counts the instructions executed before
+ * in the block, for devices reading it.
+ *
+ * Since the addresses of the guest are taken as physical ones, blocks
+ * are only built and looked up in the AOT table while isa_vm_enabled()
+ * is false, and the instructions are interpreted one by one with paging.
+ * The blocks built before are dropped when paging is turned on, since
+ * the write to satp flushes the decoded code of every page, which bumps
+ * the generations of the blocks.
+ *
+ * A block executed JIT_HOT times is built again as a trace: recording
+ * goes on across direct and conditional jumps in the same page, along
+ * the path taken while recording, until an indirect jump, the return to
+ * an instruction already in the trace, or JIT_MAX_TRACE instructions.
+ * A conditional jump inside the trace leaves it by a side exit for the
+ * other direction. The RTL of a trace is optimized before it is
+ * translated, see opt_trace().
+ */
+
+#define JIT_MAX_INSTR 32
+#define JIT_MAX_TRACE 256
+#define JIT_HOT 64
+#define JIT_MAX_OPS 4096
+#define NR_JIT_HASH 4096
+#define JIT_CODE_SIZE (16 * 1024 * 1024)
+
+typedef struct {
+  uint8_t op;
+  bool src2_k;      // `src2' is replaced by the constant `k' by opt_trace()
+  uint32_t imm, imm2, k;
+  const rtlreg_t *dest, *src1, *src2;
+} JitOp;
+
+typedef uint32_t (*JitCode)(void);
+
+typedef struct {
+  vaddr_t pc;
+  uint32_t page, gen;
+  int nr_instr;
+  uint32_t nr_exec;
+  bool trace;
+  bool watch;   // ends with an instruction writing a watched register
+  JitCode code;
+} JitBlock;
+
+bool jit_recording = false;
+static JitOp ops[JIT_MAX_OPS];
+static int nr_op;
+static bool insn_unsupported;
+static int insn_ctrl;   // the control transfer of the instruction, 0 if none
+static bool insn_watch;
+
+static JitBlock blocks[NR_JIT_HASH];
+static uint8_t *code_buf = NULL;
+static uint8_t *code_ptr;
+
+void jit_record(int op, const rtlreg_t *dest, const rtlreg_t *src1,
+    const rtlreg_t *src2, uint32_t imm, uint32_t imm2) {
+  switch (op) {
+    case JOP_unsupported: insn_unsupported = true; return;
+    case JOP_j: case JOP_jr: case JOP_jrelop: insn_ctrl = op; break;
+  }
+  if (nr_reg_wp > 0 && dest != NULL && wp_reg_watched(dest)) insn_watch = true;
+  if (nr_op == JIT_MAX_OPS) { insn_unsupported = true; return; }
+  ops[nr_op ++] = (JitOp) { .op = op, .dest = dest, .src1 = src1, .src2 = src2,
+    .imm = imm, .imm2 = imm2 };
+}
+
+/* ---------------------- optimizer of traces ---------------------- */
+
+/* The temporaries of RTL, i.e. everything outside `cpu' (s0, t0, ir, the
+ * operands in `decinfo', ...) and the sink of the writes to $0, are
+ * always written by an instruction before it reads them, so they are
+ * dead at the end of each instruction. Over the RTL of a trace,
+ *
+ * - constant propagation folds the ops with constant sources into li,
+ *   decides the conditional jumps on constants, and gives a constant
+ *   `src2' to the host instruction as an immediate;
+ * - dead temporary elimination then drops the ops writing a temporary
+ *   which is not read later in the same instruction. The temporaries
+ *   are not written back at the exits of a trace either.
+ *
+ * RTL has no flags to eliminate: the ISAs translated have none, and the
+ * EFLAGS of x86 (not translated yet) are computed outside RTL. */
+
+#define NR_OPT_REG 64
+
+static struct {
+  uint32_t nr_trace, nr_op, nr_folded, nr_dead;
+} opt_stat;
+/* counted by the translated code */
+static uint64_t nr_side_exit;
+
+static inline bool is_temp(const rtlreg_t *p) {
+  if ((uintptr_t)p - (uintptr_t)&cpu >= sizeof(cpu)) return true;
+#ifdef SINK_INDEX
+  /* only the ISAs with $0 have a sink */
+  if (p == &cpu.sink) return true;
+#endif
+  return false;
+}
+
+/* the registers holding known constants at the current op */
+static struct {
+  const rtlreg_t *p;
+  uint32_t val;
+} known[NR_OPT_REG];
+static int nr_known;
+
+static bool known_val(const rtlreg_t *p, uint32_t *val) {
+  int i;
+  for (i = 0; i < nr_known; i ++) {
+    if (known[i].p == p) { *val = known[i].val; return true; }
+  }
+  return false;
+}
+
+/* `p' holds `*val' after the current op, or something unknown if `val' is NULL */
+static void set_known(const rtlreg_t *p, const uint32_t *val) {
+  int i;
+  for (i = 0; i < nr_known && known[i].p != p; i ++) ;
+  if (val == NULL) {
+    if (i < nr_known) known[i] = known[-- nr_known];
+    return;
+  }
+  if (i == nr_known) {
+    if (nr_known == NR_OPT_REG) return;
+    nr_known ++;
+  }
+  known[i].p = p;
+  known[i].val = *val;
+}
+
+static uint32_t eval_binary(int op, uint32_t a, uint32_t b) {
+  switch (op) {
+    case JOP_add: return c_add(a, b);
+    case JOP_sub: return c_sub(a, b);
+    case JOP_and: return c_and(a, b);
+    case JOP_or:  return c_or(a, b);
+    case JOP_xor: return c_xor(a, b);
+    /* the shifts of the host only take the low 5 bits */
+    case JOP_shl: return c_shl(a, b & 31);
+    case JOP_shr: return c_shr(a, b & 31);
+    case JOP_sar: return c_sar(a, b & 31);
+    case JOP_mul_lo: return c_mul_lo(a, b);
+    case JOP_mul_hi: return c_mul_hi(a, b);
+    case JOP_imul_lo: return c_imul_lo(a, b);
+    case JOP_imul_hi: return c_imul_hi(a, b);
+    default: assert(0);
+  }
+}
+
+/* mul_hi and imul_hi take both sources from registers */
+static inline bool has_imm_form(int op) {
+  return op != JOP_mul_hi && op != JOP_imul_hi;
+}
+
+static inline bool is_commutative(int op) {
+  switch (op) {
+    case JOP_add: case JOP_and: case JOP_or: case JOP_xor:
+    case JOP_mul_lo: case JOP_imul_lo: return true;
+    default: return false;
+  }
+}
+
+static void fold_li(JitOp *o, uint32_t val) {
+  *o = (JitOp) { .op = JOP_li, .dest = o->dest, .imm = val };
+  set_known(o->dest, &val);
+  opt_stat.nr_folded ++;
+}
+
+static void opt_const(void) {
+  nr_known = 0;
+  int i;
+  for (i = 0; i < nr_op; i ++) {
+    JitOp *o = &ops[i];
+    uint32_t a = 0, b = 0;
+    bool ka = (o->src1 != NULL && known_val(o->src1, &a));
+    bool kb = (o->src2 != NULL && known_val(o->src2, &b));
+    switch (o->op) {
+      case JOP_insn: case JOP_end: case JOP_sm: case JOP_j: case JOP_jr: break;
+      case JOP_li: set_known(o->dest, &o->imm); break;
+      case JOP_lm: set_known(o->dest, NULL); break;
+      case JOP_mv:
+        if (o->dest == o->src1) break;
+        if (ka) fold_li(o, a);
+        else set_known(o->dest, NULL);
+        break;
+      case JOP_setrelop:
+        if ((ka && kb) || o->imm == RELOP_FALSE || o->imm == RELOP_TRUE) {
+          fold_li(o, interpret_relop(o->imm, a, b));
+          break;
+        }
+        if (kb) { o->src2_k = true; o->k = b; }
+        set_known(o->dest, NULL);
+        break;
+      case JOP_jrelop:
+        if (o->imm2 == RELOP_FALSE || o->imm2 == RELOP_TRUE) break;
+        if (ka && kb) {
+          o->imm2 = (interpret_relop(o->imm2, a, b) ? RELOP_TRUE : RELOP_FALSE);
+          opt_stat.nr_folded ++;
+        }
+        else if (kb) { o->src2_k = true; o->k = b; }
+        break;
+      default:
+        if (ka && kb) {
+          fold_li(o, eval_binary(o->op, a, b));
+          break;
+        }
+        if (kb && has_imm_form(o->op)) { o->src2_k = true; o->k = b; }
+        else if (ka && has_imm_form(o->op) && is_commutative(o->op)) {
+          o->src1 = o->src2;
+          o->src2_k = true;
+          o->k = a;
+        }
+        set_known(o->dest, NULL);
+        break;
+    }
+  }
+}
+
+/* the temporaries live at the current op, all of them if `live_all' */
+static const rtlreg_t *live[NR_OPT_REG];
+static int nr_live;
+static bool live_all;
+
+static bool is_live(const rtlreg_t *p) {
+  int i;
+  if (live_all) return true;
+  for (i = 0; i < nr_live; i ++) {
+    if (live[i] == p) return true;
+  }
+  return false;
+}
+
+static void use(const rtlreg_t *p) {
+  if (p == NULL || !is_temp(p) || is_live(p)) return;
+  if (nr_live == NR_OPT_REG) live_all = true;
+  else live[nr_live ++] = p;
+}
+
+static void kill(const rtlreg_t *p) {
+  int i;
+  for (i = 0; i < nr_live; i ++) {
+    if (live[i] == p) { live[i] = live[-- nr_live]; return; }
+  }
+}
+
+static void opt_dead(void) {
+  int i, j;
+  nr_live = 0;
+  live_all = false;
+  for (i = nr_op - 1; i >= 0; i --) {
+    JitOp *o = &ops[i];
+    switch (o->op) {
+      case JOP_insn: continue;
+      case JOP_end: nr_live = 0; live_all = false; continue;
+      /* a load may read MMIO */
+      case JOP_lm: case JOP_sm: case JOP_j: case JOP_jr: case JOP_jrelop: break;
+      default:
+        if ((is_temp(o->dest) && !is_live(o->dest)) || (o->op == JOP_mv && o->dest == o->src1)) {
+          o->op = JOP_unsupported;  // dropped below
+          opt_stat.nr_dead ++;
+          continue;
+        }
+        break;
+    }
+    if (o->dest != NULL) kill(o->dest);
+    use(o->src1);
+    if (!o->src2_k) use(o->src2);
+  }
+
+  for (i = j = 0; i < nr_op; i ++) {
+    if (ops[i].op != JOP_unsupported) ops[j ++] = ops[i];
+  }
+  nr_op = j;
+}
+
+static void opt_trace(void) {
+  opt_stat.nr_trace ++;
+  opt_stat.nr_op += nr_op;
+  opt_const();
+  opt_dead();
+}
+
+void jit_statistic(void) {
+  if (opt_stat.nr_trace == 0) return;
+  Log("%u hot blocks are rebuilt as traces, %ld side exits are taken",
+      opt_stat.nr_trace, nr_side_exit);
+  Log("%u RTL ops in the traces, %u are folded into constants, %u dead ones are dropped",
+      opt_stat.nr_op, opt_stat.nr_folded, opt_stat.nr_dead);
+}
+
+/* ------------------------ x86-64 emitter ------------------------ */
+
+enum { RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI, R8, R9, R10, R11, R12, R13, R14, R15 };
+
+static inline void emit8(uint8_t b) { *code_ptr ++ = b; }
+static inline void emit32(uint32_t w) { memcpy(code_ptr, &w, 4); code_ptr += 4; }
+static inline void emit64(uint64_t w) { memcpy(code_ptr, &w, 8); code_ptr += 8; }
+
+static inline void emit_rex(bool w, int reg, int rm) {
+  uint8_t rex = 0x40 | (w << 3) | ((reg >> 3) << 2) | (rm >> 3);
+  if (rex != 0x40) emit8(rex);
+}
+
+static inline void emit_modrm_rr(int reg, int rm) {
+  emit8(0xc0 | ((reg & 7) << 3) | (rm & 7));
+}
+
+/* RTL registers are addressed relative to `cpu', which is kept in r15 */
+static inline int32_t disp_of(const void *p) {
+  intptr_t disp = (intptr_t)p - (intptr_t)&cpu;
+  Assert(disp == (int32_t)disp, "%p is too far from cpu", p);
+  return disp;
+}
+
+/* op r32, [r15 + disp32] */
+static inline void emit_op_mem(uint8_t opcode, int reg, const void *p) {
+  emit_rex(false, reg, R15);
+  emit8(opcode);
+  emit8(0x80 | ((reg & 7) << 3) | (R15 & 7));
+  emit32(disp_of(p));
+}
+
+static inline void emit_load(int reg, const void *p) { emit_op_mem(0x8b, reg, p); }
+static inline void emit_store(const void *p, int reg) { emit_op_mem(0x89, reg, p); }
+
+static inline void emit_store_imm(const void *p, uint32_t imm) {
+  emit8(0x41); emit8(0xc7); emit8(0x87); emit32(disp_of(p)); emit32(imm);
+}
+
+/* add qword [r15 + disp32], imm32 */
+static inline void emit_add64_imm(const void *p, int32_t imm) {
+  emit8(0x49); emit8(0x81); emit8(0x87); emit32(disp_of(p)); emit32(imm);
+}
+
+/* op dst, src, for 32-bit ALU operations in the form of `op r/m32, r32' */
+static inline void emit_alu_rr(uint8_t opcode, int dst, int src) {
+  emit_rex(false, src, dst);
+  emit8(opcode);
+  emit_modrm_rr(src, dst);
+}
+
+static inline void emit_mov_rr(int dst, int src) {
+  if (dst != src) emit_alu_rr(0x89, dst, src);
+}
+
+static inline void emit_mov_ri(int dst, uint32_t imm) {
+  if (imm == 0) { emit_alu_rr(0x31, dst, dst); return; }
+  emit_rex(false, 0, dst);
+  emit8(0xb8 + (dst & 7));
+  emit32(imm);
+}
+
+static inline void emit_movabs(int dst, const void *p) {
+  emit_rex(true, 0, dst);
+  emit8(0xb8 + (dst & 7));
+  emit64((uintptr_t)p);
+}
+
+/* group F7 /ext r32, e.g. mul and imul with one operand */
+static inline void emit_f7(int ext, int rm) {
+  emit_rex(false, 0, rm);
+  emit8(0xf7);
+  emit_modrm_rr(ext, rm);
+}
+
+static inline void emit_push(int reg) { emit_rex(false, 0, reg); emit8(0x50 + (reg & 7)); }
+static inline void emit_pop(int reg) { emit_rex(false, 0, reg); emit8(0x58 + (reg & 7)); }
+
+static inline void emit_call(const void *fn) {
+  emit_movabs(RAX, fn);
+  emit8(0xff); emit8(0xd0);
+}
+
+/* jcc/jmp rel32 with the target to be patched later */
+static inline uint8_t* emit_jcc(uint8_t cc) { emit8(0x0f); emit8(0x80 | cc); emit32(0); return code_ptr; }
+static inline uint8_t* emit_jmp(void) { emit8(0xe9); emit32(0); return code_ptr; }
+static inline void patch(uint8_t *after_jmp) {
+  int32_t rel = code_ptr - after_jmp;
+  memcpy(after_jmp - 4, &rel, 4);
+}
+
+enum { CC_B = 0x2, CC_AE = 0x3, CC_E = 0x4, CC_NE = 0x5, CC_BE = 0x6, CC_A = 0x7,
+  CC_L = 0xc, CC_GE = 0xd, CC_LE = 0xe, CC_G = 0xf };
+
+static int relop2cc(uint32_t relop) {
+  switch (relop) {
+    case RELOP_EQ: return CC_E;   case RELOP_NE: return CC_NE;
+    case RELOP_LT: return CC_L;   case RELOP_LE: return CC_LE;
+    case RELOP_GT: return CC_G;   case RELOP_GE: return CC_GE;
+    case RELOP_LTU: return CC_B;  case RELOP_LEU: return CC_BE;
+    case RELOP_GTU: return CC_A;  case RELOP_GEU: return CC_AE;
+    default: panic("unsupported relop %d", relop);
+  }
+}
+
+/* --------------------- host register allocation --------------------- */
+
+static const int alloc_order[] = { RBX, RBP, R12, R13, R14, RSI, RDI, R8, R9, R10, R11 };
+#define NR_ALLOC (sizeof(alloc_order) / sizeof(alloc_order[0]))
+#define NR_CALLEE_SAVED 5
+
+static struct {
+  const rtlreg_t *p;
+  bool dirty;
+  uint32_t stamp;
+} hreg[NR_ALLOC];
+static uint32_t stamp;
+/* leave the temporaries in the host registers at the exits, see opt_trace() */
+static bool skip_temp;
+
+static void writeback(int i) {
+  if (hreg[i].p != NULL && hreg[i].dirty) emit_store(hreg[i].p, alloc_order[i]);
+}
+
+static void writeback_all(void) {
+  int i;
+  for (i = 0; i < NR_ALLOC; i ++) {
+    if (!(skip_temp && hreg[i].p != NULL && is_temp(hreg[i].p))) writeback(i);
+  }
+}
+
+static void flush_all(void) {
+  writeback_all();
+  memset(hreg, 0, sizeof(hreg));
+}
+
+/* Find or allocate a host register for `p'. Registers touched by the
+ * current RTL instruction are never evicted. */
+static int hreg_of(const rtlreg_t *p, bool load) {
+  int i, victim = -1;
+  for (i = 0; i < NR_ALLOC; i ++) {
+    if (hreg[i].p == p) { hreg[i].stamp = stamp; return i; }
+  }
+  for (i = 0; i < NR_ALLOC; i ++) {
+    if (hreg[i].p == NULL) { victim = i; break; }
+    if (hreg[i].stamp != stamp && (victim == -1 || hreg[i].stamp < hreg[victim].stamp)) victim = i;
+  }
+  assert(victim != -1);
+  writeback(victim);
+  hreg[victim].p = p;
+  hreg[victim].dirty = false;
+  hreg[victim].stamp = stamp;
+  if (load) emit_load(alloc_order[victim], p);
+  return victim;
+}
+
+static inline int get(const rtlreg_t *p) { return alloc_order[hreg_of(p, true)]; }
+
+static inline int def(const rtlreg_t *p) {
+  int i = hreg_of(p, false);
+  hreg[i].dirty = true;
+  return alloc_order[i];
+}
+
+/* ------------------------ code generation ------------------------ */
+
+static const int callee_saved[] = { RBX, RBP, R12, R13, R14, R15 };
+static vaddr_t cur_pc;
+static int nr_insn;
+static uint32_t pmem_low;
+
+/* account the instructions before the current one around a call out */
+static inline void emit_count_before(void) {
+  if (nr_insn > 1) emit_add64_imm(&g_nr_guest_instr, nr_insn - 1);
+}
+
+static inline void emit_count_after(void) {
+  if (nr_insn > 1) emit_add64_imm(&g_nr_guest_instr, -(nr_insn - 1));
+}
+
+static void emit_ret(uint32_t count) {
+  int i;
+  emit_mov_ri(RAX, count);
+  emit8(0x48); emit8(0x83); emit8(0xc4); emit8(0x08);    // add rsp, 8
+  for (i = 5; i >= 0; i --) emit_pop(callee_saved[i]);
+  emit8(0xc3);
+}
+
+/* leave the block, `cpu.pc' is already set */
+static void emit_exit(void) {
+  writeback_all();
+  emit_ret(nr_insn);
+}
+
+static void emit_exit_to(vaddr_t pc) {
+  writeback_all();
+  emit_store_imm(&cpu.pc, pc);
+  emit_ret(nr_insn);
+}
+
+/* Call `fn(arg0, arg1, imm)' keeping all cached registers, `arg1' may be -1
+ * if it is unused. `cpu.pc' is set for the error messages of the callee. */
+static void emit_callout(const void *fn, int arg0, int arg1, uint32_t imm) {
+  int saved[NR_ALLOC], nr_saved = 0, i;
+  for (i = NR_CALLEE_SAVED; i < NR_ALLOC; i ++) {
+    if (hreg[i].p != NULL) emit_push(saved[nr_saved ++] = alloc_order[i]);
+  }
+  if (nr_saved & 1) { emit8(0x48); emit8(0x83); emit8(0xec); emit8(0x08); } // sub rsp, 8
+
+  emit_store_imm(&cpu.pc, cur_pc);
+  emit_count_before();
+  if (arg1 != -1) emit_mov_rr(RCX, arg1);
+  emit_mov_rr(RDI, arg0);
+  if (arg1 != -1) emit_mov_rr(RSI, RCX);
+  emit_mov_ri(RDX, imm);
+  if (arg1 == -1) emit_mov_ri(RSI, imm);
+  emit_call(fn);
+  emit_count_after();
+
+  if (nr_saved & 1) { emit8(0x48); emit8(0x83); emit8(0xc4); emit8(0x08); } // add rsp, 8
+  while (nr_saved > 0) emit_pop(saved[-- nr_saved]);
+}
+
+/* eax <- offset of the guest address in `addr' inside pmem,
+ * jump to the returned patch point if it is out of pmem */
+static uint8_t* emit_pmem_check(int addr, int len) {
+  emit_mov_rr(RAX, addr);
+  emit8(0x2d); emit32(pmem_low);                    // sub eax, pmem_low
+  emit8(0x3d); emit32(pmem_size - len);             // cmp eax, pmem_size - len
+  return emit_jcc(CC_A);
+}
+
+static void emit_lm(const JitOp *o) {
+  int len = o->imm;
+  int addr = get(o->src1);
+  uint8_t *slow = emit_pmem_check(addr, len);
+  emit_movabs(RDX, pmem);
+  switch (len) {
+    case 4: emit8(0x8b); break;                     // mov eax, [rdx + rax]
+    case 2: emit8(0x0f); emit8(0xb7); break;        // movzx eax, word [rdx + rax]
+    case 1: emit8(0x0f); emit8(0xb6); break;        // movzx eax, byte [rdx + rax]
+    default: assert(0);
+  }
+  emit8(0x04); emit8(0x02);
+  uint8_t *done = emit_jmp();
+
+  patch(slow);
+  emit_callout(vaddr_read, addr, -1, len);   // vaddr_read(addr, len)
+  patch(done);
+
+  stamp ++;
+  emit_mov_rr(def(o->dest), RAX);
+}
+
+static void emit_sm(const JitOp *o) {
+  int len = o->imm;
+  int addr = get(o->src1);
+  int data = get(o->src2);
+  uint8_t *slow = emit_pmem_check(addr, len);
+  /* let vaddr_write() invalidate decoded code */
+  emit_mov_rr(RCX, RAX);
+  emit8(0xc1); emit8(0xe9); emit8(12);              // shr ecx, 12
+  emit_movabs(RDX, dcache_code_page);
+  emit8(0x80); emit8(0x3c); emit8(0x0a); emit8(0);  // cmp byte [rdx + rcx], 0
+  uint8_t *slow2 = emit_jcc(CC_NE);
+  emit_movabs(RDX, pmem_dirty);
+  emit8(0xc6); emit8(0x04); emit8(0x0a); emit8(PMEM_DIRTY_ALL);  // mov byte [rdx + rcx], PMEM_DIRTY_ALL
+  if (len > 1) {
+    emit8(0x8d); emit8(0x48); emit8(len - 1);       // lea ecx, [rax + len - 1]
+    emit8(0xc1); emit8(0xe9); emit8(12);            // shr ecx, 12
+    emit8(0xc6); emit8(0x04); emit8(0x0a); emit8(PMEM_DIRTY_ALL);// mov byte [rdx + rcx], PMEM_DIRTY_ALL
+  }
+  emit_mov_rr(RCX, data);
+  emit_movabs(RDX, pmem);
+  switch (len) {
+    case 4: emit8(0x89); break;                     // mov [rdx + rax], ecx
+    case 2: emit8(0x66); emit8(0x89); break;        // mov [rdx + rax], cx
+    case 1: emit8(0x88); break;                     // mov [rdx + rax], cl
+    default: assert(0);
+  }
+  emit8(0x0c); emit8(0x02);
+  uint8_t *done = emit_jmp();
+
+  patch(slow);
+  patch(slow2);
+  emit_callout(vaddr_write, addr, data, len); // vaddr_write(addr, data, len)
+  patch(done);
+}
+
+/* op eax, k */
+static void emit_binary_imm(const JitOp *o) {
+  uint32_t k = o->k;
+  switch (o->op) {
+    case JOP_add: emit8(0x81); emit8(0xc0); emit32(k); break;
+    case JOP_sub: emit8(0x81); emit8(0xe8); emit32(k); break;
+    case JOP_and: emit8(0x81); emit8(0xe0); emit32(k); break;
+    case JOP_or:  emit8(0x81); emit8(0xc8); emit32(k); break;
+    case JOP_xor: emit8(0x81); emit8(0xf0); emit32(k); break;
+    case JOP_shl: emit8(0xc1); emit8(0xe0); emit8(k & 31); break;
+    case JOP_shr: emit8(0xc1); emit8(0xe8); emit8(k & 31); break;
+    case JOP_sar: emit8(0xc1); emit8(0xf8); emit8(k & 31); break;
+    case JOP_mul_lo: case JOP_imul_lo:               // imul eax, eax, k
+      emit8(0x69); emit8(0xc0); emit32(k); break;
+    default: assert(0);
+  }
+}
+
+static void emit_binary(const JitOp *o) {
+  if (o->src2_k) {
+    emit_mov_rr(RAX, get(o->src1));
+    emit_binary_imm(o);
+    emit_mov_rr(def(o->dest), RAX);
+    return;
+  }
+  int a = get(o->src1);
+  int b = get(o->src2);
+  emit_mov_rr(RAX, a);
+  switch (o->op) {
+    case JOP_add: emit_alu_rr(0x01, RAX, b); break;
+    case JOP_sub: emit_alu_rr(0x29, RAX, b); break;
+    case JOP_and: emit_alu_rr(0x21, RAX, b); break;
+    case JOP_or:  emit_alu_rr(0x09, RAX, b); break;
+    case JOP_xor: emit_alu_rr(0x31, RAX, b); break;
+    case JOP_shl: emit_mov_rr(RCX, b); emit8(0xd3); emit8(0xe0); break;
+    case JOP_shr: emit_mov_rr(RCX, b); emit8(0xd3); emit8(0xe8); break;
+    case JOP_sar: emit_mov_rr(RCX, b); emit8(0xd3); emit8(0xf8); break;
+    case JOP_mul_lo: case JOP_imul_lo:               // imul eax, b
+      emit_rex(false, RAX, b); emit8(0x0f); emit8(0xaf); emit_modrm_rr(RAX, b); break;
+    case JOP_mul_hi:  emit_f7(4, b); emit_mov_rr(RAX, RDX); break;
+    case JOP_imul_hi: emit_f7(5, b); emit_mov_rr(RAX, RDX); break;
+    default: assert(0);
+  }
+  emit_mov_rr(def(o->dest), RAX);
+}
+
+static void emit_cmp(const JitOp *o) {
+  int a = get(o->src1);
+  if (o->src2_k) {
+    emit_rex(false, 0, a);                         // cmp a, k
+    emit8(0x81); emit_modrm_rr(7, a); emit32(o->k);
+    return;
+  }
+  int b = get(o->src2);
+  emit_alu_rr(0x39, a, b);
+}
+
+/* the control transfer of the current instruction, done at its end */
+static struct {
+  int op;
+  uint32_t relop;
+  vaddr_t target;
+} jump;
+
+static void gen_op(const JitOp *o) {
+  stamp ++;
+  switch (o->op) {
+    case JOP_li: emit_mov_ri(def(o->dest), o->imm); break;
+    case JOP_mv: {
+      if (o->dest == o->src1) break;
+      int s = get(o->src1);
+      emit_mov_rr(def(o->dest), s);
+      break;
+    }
+    case JOP_lm: emit_lm(o); break;
+    case JOP_sm: emit_sm(o); break;
+    case JOP_setrelop:
+      if (o->imm == RELOP_FALSE || o->imm == RELOP_TRUE) {
+        emit_mov_ri(def(o->dest), o->imm == RELOP_TRUE);
+        break;
+      }
+      emit_cmp(o);
+      emit8(0x0f); emit8(0x90 | relop2cc(o->imm)); emit8(0xc0);   // setcc al
+      emit8(0x0f); emit8(0xb6); emit8(0xc0);                      // movzx eax, al
+      emit_mov_rr(def(o->dest), RAX);
+      break;
+    case JOP_j: jump.op = JOP_j; jump.target = o->imm; break;
+    case JOP_jr:
+      /* [rsp] <- the target */
+      emit_mov_rr(RAX, get(o->src1));
+      emit8(0x89); emit8(0x04); emit8(0x24);       // mov [rsp], eax
+      jump.op = JOP_jr;
+      break;
+    case JOP_jrelop:
+      /* [rsp] <- whether the branch is taken */
+      if (o->imm2 == RELOP_FALSE || o->imm2 == RELOP_TRUE) {
+        emit_mov_ri(RAX, o->imm2 == RELOP_TRUE);
+      }
+      else {
+        emit_cmp(o);
+        emit8(0x0f); emit8(0x90 | relop2cc(o->imm2)); emit8(0xc0);
+        emit8(0x0f); emit8(0xb6); emit8(0xc0);
+      }
+      emit8(0x89); emit8(0x04); emit8(0x24);       // mov [rsp], eax
+      jump.op = JOP_jrelop;
+      jump.relop = o->imm2;
+      jump.target = o->imm;
+      break;
+    default: emit_binary(o); break;
+  }
+}
+
+vaddr_t exec_once(void);
+
+static void jit_interp(void) {
+  exec_once();
+}
+
+static void emit_side_exit(vaddr_t pc) {
+  emit_add64_imm(&nr_side_exit, 1);
+  emit_exit_to(pc);
+}
+
+/* leave to `pc' if the page of the block is overwritten */
+static void emit_check_gen(uint32_t page, uint32_t gen, vaddr_t pc) {
+  emit_movabs(RDX, &dcache_page_gen[page]);
+  emit8(0x81); emit8(0x3a); emit32(gen);   // cmp dword [rdx], imm32
+  uint8_t *same = emit_jcc(CC_E);
+  emit_exit_to(pc);
+  patch(same);
+}
+
+/* Translate the recorded ops, return NULL if the code buffer is full. */
+static JitCode gen_block(uint32_t page, uint32_t gen, bool trace) {
+  if (code_ptr + nr_op * 256 + 1024 > code_buf + JIT_CODE_SIZE) return NULL;
+
+  uint8_t *start = code_ptr;
+  bool has_sm = false;
+  int i;
+  memset(hreg, 0, sizeof(hreg));
+  stamp = 0;
+  nr_insn = 0;
+  skip_temp = trace;
+
+  for (i = 0; i < 6; i ++) emit_push(callee_saved[i]);
+  emit8(0x48); emit8(0x83); emit8(0xec); emit8(0x08);  // sub rsp, 8
+  emit_movabs(R15, &cpu);
+
+  for (i = 0; i < nr_op; i ++) {
+    const JitOp *o = &ops[i];
+    switch (o->op) {
+      case JOP_insn:
+        cur_pc = o->imm;
+        nr_insn ++;
+        has_sm = false;
+        jump.op = 0;
+        if (o->imm2) {
+          /* call the interpreter for this instruction, and end the block */
+          flush_all();
+          emit_store_imm(&cpu.pc, cur_pc);
+          emit_count_before();
+          emit_call(jit_interp);
+          emit_count_after();
+          emit_exit();
+        }
+        break;
+
+      case JOP_end:
+        if (jump.op != 0 && i < nr_op - 1) {
+          /* inside a trace, go on with the next instruction recorded */
+          vaddr_t next = ops[i + 1].imm;
+          assert(jump.op != JOP_jr);
+          if (jump.op == JOP_jrelop && jump.relop != RELOP_FALSE &&
+              jump.relop != RELOP_TRUE && jump.target != o->imm) {
+            emit8(0x83); emit8(0x3c); emit8(0x24); emit8(0);   // cmp dword [rsp], 0
+            uint8_t *stay = emit_jcc(next == jump.target ? CC_NE : CC_E);
+            emit_side_exit(next == jump.target ? o->imm : jump.target);
+            patch(stay);
+          }
+          if (has_sm) emit_check_gen(page, gen, next);
+        }
+        else if (jump.op == JOP_j) {
+          emit_exit_to(jump.target);
+        }
+        else if (jump.op == JOP_jr) {
+          emit8(0x8b); emit8(0x04); emit8(0x24);   // mov eax, [rsp]
+          emit_store(&cpu.pc, RAX);
+          emit_exit();
+        }
+        else if (jump.op == JOP_jrelop) {
+          emit8(0x83); emit8(0x3c); emit8(0x24); emit8(0);   // cmp dword [rsp], 0
+          uint8_t *not_taken = emit_jcc(CC_E);
+          emit_exit_to(jump.target);
+          patch(not_taken);
+          emit_exit_to(o->imm);
+        }
+        else if (i == nr_op - 1) {
+          emit_exit_to(o->imm);
+        }
+        else if (has_sm) {
+          emit_check_gen(page, gen, o->imm);
+        }
+        break;
+
+      case JOP_sm: has_sm = true; // fall through
+      default: gen_op(o); break;
+    }
+  }
+
+  return (JitCode)start;
+}
+
+/* ---------------- C backend for ahead-of-time translation ---------------- */
+
+/* With `-X FILE.c', every block is also translated into a C function
+ * with the same effect as its x86-64 code, and written to FILE.c with a
+ * table of the blocks at exit. Built with
+ *
+ *   gcc -O2 -shared -fPIC FILE.c -o FILE.so
+ *
+ * it is loaded by `-X FILE.so' in the later runs of the same NEMU binary
+ * with the same size of pmem. Then a block is taken from the table if the
+ * bytes of its instructions in pmem are the same as those translated, and
+ * only translated at runtime otherwise, so indirect jumps, MMIO and the
+ * code not run before are left to the runtime. The RTL registers are
+ * addressed by their offsets from `cpu', like in the x86-64 code, and the
+ * layout is checked when loading. */
+
+typedef struct {
+  uint32_t pc, len;  // [pc, pc + len) are the bytes of the instructions translated
+  uint64_t hash;
+  uint32_t nr_instr;
+  JitCode code;
+} AotBlock;
+
+static FILE *aot_fp = NULL;
+static AotBlock *aot_blocks = NULL;
+static uint32_t nr_aot = 0, aot_cap = 0;
+/* the indices (from 1) of `aot_blocks' by pc, open addressing */
+static uint32_t *aot_index = NULL;
+static uint32_t aot_index_size = 0;
+
+static inline int64_t aot_layout(int i) {
+  switch (i) {
+    case 0: return disp_of(&decinfo);
+    case 1: return sizeof(CPU_state);
+    case 2: return pmem_base();
+    default: return pmem_size;
+  }
+}
+#define NR_AOT_LAYOUT 4
+
+static uint64_t aot_hash(const uint8_t *p, uint32_t len) {
+  uint64_t h = 0xcbf29ce484222325ull;
+  uint32_t i;
+  for (i = 0; i < len; i ++) h = (h ^ p[i]) * 0x100000001b3ull;
+  return h;
+}
+
+static uint32_t* aot_slot(uint32_t pc, uint64_t hash, bool match_hash) {
+  uint32_t i = (pc * 2654435761u) & (aot_index_size - 1);
+  while (aot_index[i] != 0) {
+    AotBlock *a = &aot_blocks[aot_index[i] - 1];
+    if (a->pc == pc && (!match_hash || a->hash == hash)) break;
+    i = (i + 1) & (aot_index_size - 1);
+  }
+  return &aot_index[i];
+}
+
+static void aot_add(const AotBlock *a) {
+  if (nr_aot == aot_cap) {
+    aot_cap = (aot_cap == 0 ? 1024 : aot_cap * 2);
+    aot_blocks = realloc(aot_blocks, aot_cap * sizeof(aot_blocks[0]));
+    assert(aot_blocks != NULL);
+  }
+  if (2 * (nr_aot + 1) > aot_index_size) {
+    free(aot_index);
+    aot_index_size = (aot_index_size == 0 ? 2048 : aot_index_size * 2);
+    aot_index = calloc(aot_index_size, sizeof(aot_index[0]));
+    assert(aot_index != NULL);
+    uint32_t i;
+    for (i = 0; i < nr_aot; i ++) *aot_slot(aot_blocks[i].pc, aot_blocks[i].hash, true) = i + 1;
+  }
+  aot_blocks[nr_aot ++] = *a;
+  *aot_slot(a->pc, a->hash, true) = nr_aot;
+}
+
+static const char* relop_c(uint32_t relop) {
+  switch (relop) {
+    case RELOP_EQ: return "=="; case RELOP_NE: return "!=";
+    case RELOP_LT: case RELOP_LTU: return "<";
+    case RELOP_LE: case RELOP_LEU: return "<=";
+    case RELOP_GT: case RELOP_GTU: return ">";
+    case RELOP_GE: case RELOP_GEU: return ">=";
+    default: panic("unsupported relop %d", relop);
+  }
+}
+
+/* the condition of `relop' on the sources of `o' */
+static void aot_cond(const JitOp *o, uint32_t relop) {
+  if (relop == RELOP_FALSE || relop == RELOP_TRUE) {
+    fprintf(aot_fp, "%d", relop == RELOP_TRUE);
+    return;
+  }
+  const char *cast = ((relop & 8) ? "" : "(int32_t)");
+  fprintf(aot_fp, "(%sR(%d) %s %sR(%d))", cast, disp_of(o->src1), relop_c(relop), cast, disp_of(o->src2));
+}
+
+static void aot_op(const JitOp *o, int nr_before) {
+  FILE *fp = aot_fp;
+  switch (o->op) {
+    case JOP_li: fprintf(fp, "  R(%d) = 0x%xu;\n", disp_of(o->dest), o->imm); return;
+    case JOP_mv: fprintf(fp, "  R(%d) = R(%d);\n", disp_of(o->dest), disp_of(o->src1)); return;
+    case JOP_lm:
+      fprintf(fp, "  { uint32_t a = R(%d), o = a - PMEM_LOW, v = 0;\n"
+          "    if (o <= PMEM_SIZE - %d) memcpy(&v, pmem + o, %d);\n"
+          "    else { PC = 0x%xu; g_nr_guest_instr += %d; v = isa_vaddr_read(a, %d); g_nr_guest_instr -= %d; }\n"
+          "    R(%d) = v; }\n",
+          disp_of(o->src1), o->imm, o->imm, cur_pc, nr_before, o->imm, nr_before, disp_of(o->dest));
+      return;
+    case JOP_sm:
+      fprintf(fp, "  { uint32_t a = R(%d), d = R(%d), o = a - PMEM_LOW;\n"
+          "    if (o <= PMEM_SIZE - %d && dcache_code_page[o >> 12] == 0) {\n"
+          "      pmem_dirty[o >> 12] = pmem_dirty[(o + %d) >> 12] = 0x%x;\n"
+          "      memcpy(pmem + o, &d, %d);\n"
+          "    }\n"
+          "    else { PC = 0x%xu; g_nr_guest_instr += %d; isa_vaddr_write(a, d, %d); g_nr_guest_instr -= %d; } }\n",
+          disp_of(o->src1), disp_of(o->src2), o->imm, o->imm - 1, PMEM_DIRTY_ALL, o->imm,
+          cur_pc, nr_before, o->imm, nr_before);
+      return;
+    case JOP_setrelop:
+      fprintf(fp, "  R(%d) = ", disp_of(o->dest));
+      aot_cond(o, o->imm);
+      fprintf(fp, ";\n");
+      return;
+    case JOP_j: jump.op = JOP_j; jump.target = o->imm; return;
+    case JOP_jr:
+      fprintf(fp, "  target = R(%d);\n", disp_of(o->src1));
+      jump.op = JOP_jr;
+      return;
+    case JOP_jrelop:
+      fprintf(fp, "  taken = ");
+      aot_cond(o, o->imm2);
+      fprintf(fp, ";\n");
+      jump.op = JOP_jrelop;
+      jump.target = o->imm;
+      return;
+  }
+
+  int d = disp_of(o->dest), a = disp_of(o->src1), b = disp_of(o->src2);
+  switch (o->op) {
+    case JOP_add: fprintf(fp, "  R(%d) = R(%d) + R(%d);\n", d, a, b); break;
+    case JOP_sub: fprintf(fp, "  R(%d) = R(%d) - R(%d);\n", d, a, b); break;
+    case JOP_and: fprintf(fp, "  R(%d) = R(%d) & R(%d);\n", d, a, b); break;
+    case JOP_or:  fprintf(fp, "  R(%d) = R(%d) | R(%d);\n", d, a, b); break;
+    case JOP_xor: fprintf(fp, "  R(%d) = R(%d) ^ R(%d);\n", d, a, b); break;
+    case JOP_shl: fprintf(fp, "  R(%d) = R(%d) << (R(%d) & 31);\n", d, a, b); break;
+    case JOP_shr: fprintf(fp, "  R(%d) = R(%d) >> (R(%d) & 31);\n", d, a, b); break;
+    case JOP_sar: fprintf(fp, "  R(%d) = (int32_t)R(%d) >> (R(%d) & 31);\n", d, a, b); break;
+    case JOP_mul_lo: case JOP_imul_lo: fprintf(fp, "  R(%d) = R(%d) * R(%d);\n", d, a, b); break;
+    case JOP_mul_hi:
+      fprintf(fp, "  R(%d) = ((uint64_t)R(%d) * R(%d)) >> 32;\n", d, a, b); break;
+    case JOP_imul_hi:
+      fprintf(fp, "  R(%d) = ((int64_t)(int32_t)R(%d) * (int32_t)R(%d)) >> 32;\n", d, a, b); break;
+    default: assert(0);
+  }
+}
+
+/* write the recorded ops of the block at `pc' as a C function */
+static void aot_emit(vaddr_t pc, uint32_t page, uint32_t len) {
+  uint64_t hash = aot_hash(pmem + pmem_offset(pc), len);
+  if (aot_index != NULL && *aot_slot(pc, hash, true) != 0) return;
+
+  FILE *fp = aot_fp;
+  fprintf(fp, "\nstatic uint32_t b%u(void) {\n", nr_aot);
+  fprintf(fp, "  uint32_t gen = dcache_page_gen[%u], target = 0, taken = 0;\n", page);
+  fprintf(fp, "  (void)gen; (void)target; (void)taken;\n");
+
+  int n = 0, i;
+  bool has_sm = false;
+  for (i = 0; i < nr_op; i ++) {
+    const JitOp *o = &ops[i];
+    switch (o->op) {
+      case JOP_insn:
+        cur_pc = o->imm;
+        n ++;
+        has_sm = false;
+        jump.op = 0;
+        fprintf(fp, "  /* 0x%08x */\n", cur_pc);
+        if (o->imm2) {
+          fprintf(fp, "  PC = 0x%xu; g_nr_guest_instr += %d; exec_once(); g_nr_guest_instr -= %d;\n"
+              "  return %d;\n", cur_pc, n - 1, n - 1, n);
+        }
+        break;
+      case JOP_end:
+        if (jump.op == JOP_j) fprintf(fp, "  PC = 0x%xu; return %d;\n", jump.target, n);
+        else if (jump.op == JOP_jr) fprintf(fp, "  PC = target; return %d;\n", n);
+        else if (jump.op == JOP_jrelop) {
+          fprintf(fp, "  PC = (taken ? 0x%xu : 0x%xu); return %d;\n", jump.target, o->imm, n);
+        }
+        else if (i == nr_op - 1) fprintf(fp, "  PC = 0x%xu; return %d;\n", o->imm, n);
+        else if (has_sm) {
+          fprintf(fp, "  if (dcache_page_gen[%u] != gen) { PC = 0x%xu; return %d; }\n", page, o->imm, n);
+        }
+        break;
+      case JOP_sm: has_sm = true; // fall through
+      default: aot_op(o, n - 1); break;
+    }
+  }
+  fprintf(fp, "}\n");
+
+  aot_add(&(AotBlock) { .pc = pc, .len = len, .hash = hash, .nr_instr = n });
+}
+
+/* write the table of the blocks */
+static void aot_exit(void) {
+  FILE *fp = aot_fp;
+  uint32_t i;
+  fprintf(fp, "\nconst int64_t nemu_aot_layout[] = { ");
+  for (i = 0; i < NR_AOT_LAYOUT; i ++) fprintf(fp, "%ld, ", aot_layout(i));
+  fprintf(fp, "};\n\nconst AotBlock nemu_aot_blocks[] = {\n");
+  for (i = 0; i < nr_aot; i ++) {
+    AotBlock *a = &aot_blocks[i];
+    fprintf(fp, "  { 0x%xu, %u, 0x%lxull, %u, b%u },\n", a->pc, a->len, a->hash, a->nr_instr, i);
+  }
+  fprintf(fp, "};\n\nconst uint32_t nemu_aot_nr = %u;\n", nr_aot);
+  fclose(fp);
+  Log("%u blocks are translated into C", nr_aot);
+}
+
+static void aot_load(const char *file) {
+  void *handle = dlopen(file, RTLD_NOW);
+  Assert(handle != NULL, "%s", dlerror());
+  const int64_t *layout = dlsym(handle, "nemu_aot_layout");
+  const AotBlock *blocks = dlsym(handle, "nemu_aot_blocks");
+  const uint32_t *nr = dlsym(handle, "nemu_aot_nr");
+  Assert(layout != NULL && blocks != NULL && nr != NULL, "'%s' is not translated by NEMU", file);
+  int i;
+  for (i = 0; i < NR_AOT_LAYOUT; i ++) {
+    Assert(layout[i] == aot_layout(i), "'%s' is translated by another build of NEMU, or with another size of pmem", file);
+  }
+  uint32_t k;
+  for (k = 0; k < *nr; k ++) aot_add(&blocks[k]);
+  Log("%u blocks translated into C are loaded from '%s'", *nr, file);
+}
+
+void jit_aot_config(const char *file) {
+  if (file == NULL) return;
+  size_t len = strlen(file);
+  if (len > 3 && strcmp(file + len - 3, ".so") == 0) {
+    aot_load(file);
+    return;
+  }
+
+  aot_fp = fopen(file, "w");
+  Assert(aot_fp != NULL, "can not open '%s'", file);
+  fprintf(aot_fp, "/* blocks of the guest translated by NEMU, see src/cpu/jit.c */\n"
+      "#include <stdint.h>\n#include <string.h>\n\n"
+      "extern uint8_t cpu[];\n"
+      "extern uint8_t *pmem, *pmem_dirty, *dcache_code_page;\n"
+      "extern uint32_t *dcache_page_gen;\n"
+      "extern uint64_t g_nr_guest_instr;\n"
+      "uint32_t isa_vaddr_read(uint32_t addr, int len);\n"
+      "void isa_vaddr_write(uint32_t addr, uint32_t data, int len);\n"
+      "uint32_t exec_once(void);\n\n"
+      "typedef struct {\n  uint32_t pc, len;\n  uint64_t hash;\n  uint32_t nr_instr;\n"
+      "  uint32_t (*code)(void);\n} AotBlock;\n\n"
+      "#define R(disp) (*(uint32_t *)((uintptr_t)cpu + (disp)))\n"
+      "#define PC R(%d)\n#define PMEM_LOW 0x%xu\n#define PMEM_SIZE 0x%xu\n",
+      disp_of(&cpu.pc), pmem_base(), pmem_size);
+  atexit(aot_exit);
+}
+
+/* the translated block of `cpu.pc' loaded from the table, if its bytes are not changed */
+static bool aot_lookup(JitBlock *b) {
+  int offset = pmem_offset(cpu.pc);
+  uint32_t idx = *aot_slot(cpu.pc, 0, false);
+  if (idx == 0 || offset < 0) return false;
+  AotBlock *a = &aot_blocks[idx - 1];
+  if ((offset & PAGE_MASK) + a->len > PAGE_SIZE || aot_hash(pmem + offset, a->len) != a->hash) return false;
+
+  /* not decoded, but to be invalidated when overwritten */
+  dcache_mark(offset, a->len);
+  b->pc = cpu.pc;
+  b->page = offset / PAGE_SIZE;
+  b->gen = dcache_page_gen[b->page];
+  b->nr_instr = a->nr_instr;
+  b->nr_exec = 0;
+  b->trace = false;
+  b->watch = false;
+  b->code = a->code;
+  return true;
+}
+
+/* ------------------------ block management ------------------------ */
+
+static inline uint32_t jit_idx(vaddr_t pc) {
+  return (pc ^ (pc >> 2)) & (NR_JIT_HASH - 1);
+}
+
+static void jit_flush(void) {
+  memset(blocks, 0, sizeof(blocks));
+  code_ptr = code_buf;
+}
+
+/* whether the instruction at `pc' is already recorded */
+static bool is_recorded(vaddr_t pc) {
+  int i;
+  for (i = 0; i < nr_op; i ++) {
+    if (ops[i].op == JOP_insn && ops[i].imm == pc) return true;
+  }
+  return false;
+}
+
+/* Interpret at most `n' instructions from `cpu.pc' while recording them,
+ * then translate them into `b' as a block or a trace. Return the number
+ * of instructions executed. */
+static uint64_t jit_build(JitBlock *b, uint64_t n, bool trace) {
+  vaddr_t pc = cpu.pc;
+  int offset = pmem_offset(pc);
+  uint32_t page = offset / PAGE_SIZE;
+  uint32_t gen = dcache_page_gen[page];
+  uint64_t i, max = (trace ? JIT_MAX_TRACE : JIT_MAX_INSTR);
+
+  pmem_low = pc - offset;
+  nr_op = 0;
+
+  for (i = 0; i < n && i < max; ) {
+    offset = pmem_offset(cpu.pc);
+    if (offset < 0 || offset / PAGE_SIZE != page) break;
+
+    int insn_start = nr_op;
+    vaddr_t insn_pc = cpu.pc;
+    insn_unsupported = false;
+    insn_ctrl = 0;
+    insn_watch = false;
+    jit_record(JOP_insn, NULL, NULL, NULL, insn_pc, false);
+
+    jit_recording = true;
+    vaddr_t seq_pc = exec_once();
+    jit_recording = false;
+    i ++;
+    g_nr_guest_instr ++;
+
+    /* an instruction crossing the page is interpreted, see decode-cache.c */
+    bool cross = (seq_pc - 1) / PAGE_SIZE != insn_pc / PAGE_SIZE;
+    if (insn_unsupported || cross || nr_op >= JIT_MAX_OPS - 1) {
+      nr_op = insn_start;
+      ops[nr_op ++] = (JitOp) { .op = JOP_insn, .imm = insn_pc, .imm2 = true };
+      break;
+    }
+    jit_record(JOP_end, NULL, NULL, NULL, seq_pc, 0);
+    if (insn_watch || nemu_event_pending()) break;
+    /* a trace follows the direct jumps taken */
+    if (insn_ctrl && !(trace && insn_ctrl != JOP_jr && !is_recorded(cpu.pc))) break;
+  }
+
+  /* the block was modified by itself */
+  if (gen != dcache_page_gen[page]) return i;
+
+  if (trace) opt_trace();
+  JitCode code = gen_block(page, gen, trace);
+  if (code == NULL) {
+    jit_flush();
+    return i;
+  }
+  /* the last op is the end of the last instruction, or the instruction interpreted */
+  if (aot_fp != NULL && !trace) aot_emit(pc, page, ops[nr_op - 1].imm - pc);
+
+  b->pc = pc;
+  b->page = page;
+  b->gen = gen;
+  b->nr_instr = nr_insn;
+  b->nr_exec = 0;
+  b->trace = trace;
+  b->watch = insn_watch;
+  b->code = code;
+  return i;
+}
+
+/* Execute at most `n' instructions with translated blocks.
+ * Return the number of instructions executed. */
+uint64_t jit_run(uint64_t n) {
+  if (code_buf == NULL) {
+    code_buf = mmap(NULL, JIT_CODE_SIZE, PROT_READ | PROT_WRITE | PROT_EXEC,
+        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    Assert(code_buf != MAP_FAILED, "can not allocate memory for the JIT");
+    code_ptr = code_buf;
+  }
+
+  uint64_t total = 0;
+  while (total < n) {
+    JitBlock *b = &blocks[jit_idx(cpu.pc)];
+    if (b->code != NULL && b->pc == cpu.pc && b->gen == dcache_page_gen[b->page]) {
+      if (!b->trace && ++ b->nr_exec >= JIT_HOT && n - total >= JIT_MAX_TRACE) {
+        b->code = NULL;
+        total += jit_build(b, n - total, true);
+      }
+      else if (b->nr_instr <= n - total) {
+        iring_push(cpu.pc);
+        uint32_t k = b->code();
+        total += k;
+        g_nr_guest_instr += k;
+        if (b->watch) wp_reg_check();
+      }
+      else { exec_once(); total ++; g_nr_guest_instr ++; }
+    }
+    else if (isa_vm_enabled()) {
+      exec_once();
+      total ++;
+      g_nr_guest_instr ++;
+    }
+    else if (aot_index != NULL && aot_fp == NULL && nr_reg_wp == 0 && aot_lookup(b)) {
+      continue;
+    }
+    else if (pmem_offset(cpu.pc) >= 0) {
+      b->code = NULL;
+      total += jit_build(b, n - total, false);
+    }
+    else {
+      exec_once();
+      total ++;
+      g_nr_guest_instr ++;
+    }
+
+    if (nemu_event_pending() && nemu_handle_event()) break;
+  }
+  return total;
+}
+
+#endif
@@ -0,0 +1,223 @@
+#include "cpu/decode-cache.h"
+#include "cpu/tb.h"
+#include "monitor/monitor.h"
+#include "monitor/sample.h"
+
+#ifdef TB_ENGINE
+
+/* A translation block (TB) is a run of decoded instructions inside one
+ * page of pmem. It is built when it is executed for the first time:
+ * instructions are decoded and appended to the block until one of them
+ * jumps, so a block is sealed at its first taken jump. A conditional
+ * branch which is not taken at building time stays inside the block,
+ * and leaves the block early when it is taken later.
+ *
+ * The last two distinct successors of a block are chained to it, and
+ * `tb_run()' goes on to a chained successor directly, without looking up
+ * the hash table nor leaving the loop over the blocks.
+ *
+ * Adjacent instructions in a block may be fused by the ISA (see
+ * `isa_fuse()'). A fused pair is dispatched once, and it still counts as
+ * two guest instructions.
+ */
+
+#define TB_MAX_INSTR 32
+#define NR_TB 4096
+#define NR_TB_HASH (1 << 12)
+
+typedef struct TB {
+  vaddr_t pc;
+  uint32_t page;
+  uint32_t gen;
+  int nr_instr;
+  bool sealed;
+
+  vaddr_t next_pc[2];
+  struct TB *next[2];
+  int next_victim;
+
+  DCEntry instr[TB_MAX_INSTR];
+  /* fuse[i] executes instr[i] and instr[i + 1] together if not NULL */
+  OpcodeEntry *fuse[TB_MAX_INSTR];
+} TB;
+
+static TB tb_pool[NR_TB];
+static int nr_tb = 0;
+static TB *tb_hash[NR_TB_HASH];
+
+static inline uint32_t tb_idx(vaddr_t pc) {
+  return (pc ^ (pc >> 2)) & (NR_TB_HASH - 1);
+}
+
+void tb_flush(void) {
+  nr_tb = 0;
+  memset(tb_hash, 0, sizeof(tb_hash));
+}
+
+/* Empty the block, whose code may have been rewritten, or moved to
+ * another page by a new translation of fetches. A block whose code is no
+ * longer inside pmem stays sealed and empty, and is tried again after the
+ * next flush, which bumps the generation of every page. */
+static inline void tb_reset(TB *tb) {
+  int offset = ifetch_pmem_offset(tb->pc);
+  tb->page = (offset < 0 ? NR_PMEM_PAGE : offset / PAGE_SIZE);
+  tb->gen = dcache_page_gen[tb->page];
+  tb->nr_instr = 0;
+  tb->sealed = (offset < 0);
+}
+
+/* Return NULL if the code at `pc' can not be cached. */
+static TB* tb_alloc(vaddr_t pc) {
+  int offset = ifetch_pmem_offset(pc);
+  if (offset < 0) return NULL;
+
+  if (nr_tb == NR_TB) tb_flush();
+
+  TB *tb = &tb_pool[nr_tb ++];
+  tb->pc = pc;
+  tb->next[0] = tb->next[1] = NULL;
+  tb->next_pc[0] = tb->next_pc[1] = 0;
+  tb->next_victim = 0;
+  tb_reset(tb);
+  return tb;
+}
+
+/* Return the successor of `tb' at `pc' if it is chained to `tb'. */
+static inline TB* tb_chained(TB *tb, vaddr_t pc) {
+  if (tb->next_pc[0] == pc && tb->next[0] != NULL) return tb->next[0];
+  if (tb->next_pc[1] == pc && tb->next[1] != NULL) return tb->next[1];
+  return NULL;
+}
+
+/* Find the block at `pc' which is entered from block `prev', and chain
+ * it to `prev' if it is found in the hash table. */
+static TB* tb_find(TB *prev, vaddr_t pc) {
+  if (prev != NULL) {
+    TB *tb = tb_chained(prev, pc);
+    if (tb != NULL) return tb;
+  }
+
+  TB **slot = &tb_hash[tb_idx(pc)];
+  TB *tb = *slot;
+  if (tb == NULL || tb->pc != pc) {
+    int old_nr_tb = nr_tb;
+    tb = tb_alloc(pc);
+    if (tb == NULL) return NULL;
+    *slot = tb;
+    /* `prev' is gone if the cache was flushed */
+    if (nr_tb < old_nr_tb) return tb;
+  }
+
+  if (prev != NULL) {
+    int k = prev->next_victim;
+    prev->next[k] = tb;
+    prev->next_pc[k] = pc;
+    prev->next_victim = !k;
+  }
+  return tb;
+}
+
+/* Execute at most `n' instructions from the block.
+ * Return the number of instructions executed. */
+static uint64_t tb_exec(TB *tb, uint64_t n) {
+  if (tb->gen != dcache_page_gen[tb->page]) tb_reset(tb);
+
+  uint64_t i;
+  for (i = 0; i < n; ) {
+    DCEntry *dc = &tb->instr[i];
+
+    int nr_exec = 1;
+    decinfo.seq_pc = cpu.pc;
+    iring_push(cpu.pc);
+    if (i + 1 < tb->nr_instr && tb->fuse[i] != NULL && i + 1 < n) {
+      iring_push(tb->instr[i + 1].pc);
+      dcache_restore(dc);
+      decinfo.seq_pc = tb->instr[i + 1].fetch_pc;
+      idex(&decinfo.seq_pc, tb->fuse[i]);
+      nr_exec = 2;
+    }
+    else if (i < tb->nr_instr) {
+      dcache_idex(&decinfo.seq_pc, dc);
+    }
+    else {
+      int offset = ifetch_pmem_offset(cpu.pc);
+      if (tb->sealed || offset < 0 || offset / PAGE_SIZE != tb->page) {
+        tb->sealed = true;
+        break;
+      }
+      /* an instruction which can not be cached, e.g. one crossing the
+       * page, is executed once and seals the block before it */
+      if (dcache_fetch(dc, cpu.pc)) {
+        tb->nr_instr ++;
+        /* do not fuse an instruction which is already fused with the previous one */
+        /* nor a trap of GDB */
+        if (i > 0) {
+          tb->fuse[i - 1] = ((i > 1 && tb->fuse[i - 2] != NULL) || dc[-1].trap || dc->trap) ?
+            NULL : isa_fuse(dc - 1, dc);
+        }
+      }
+      else tb->sealed = true;
+      decinfo.seq_pc = dc->fetch_pc;
+      idex(&decinfo.seq_pc, dc->e);
+    }
+
+    bool is_jmp = decinfo.is_jmp;
+    update_pc();
+    i += nr_exec;
+    g_nr_guest_instr += nr_exec;
+
+    if (is_jmp) {
+      if (i == tb->nr_instr) tb->sealed = true;
+      break;
+    }
+    if (tb->sealed && i > tb->nr_instr) break;
+    if (nemu_event_pending()) break;
+    if (tb->gen != dcache_page_gen[tb->page]) break;
+    if (i == TB_MAX_INSTR) { tb->sealed = true; break; }
+  }
+
+  return i;
+}
+
+vaddr_t exec_once(void);
+
+/* Execute at most `n' instructions by blocks.
+ * Return the number of instructions executed. */
+uint64_t tb_run(uint64_t n) {
+  uint64_t total = 0;
+  TB *tb = NULL;
+
+  while (total < n) {
+    tb = tb_find(tb, cpu.pc);
+    if (tb == NULL) {
+      if (bbv_on) bbv_count(cpu.pc, 1);
+      exec_once();
+      total ++;
+      g_nr_guest_instr ++;
+    }
+    /* run from block to block through the chain, and only come back to
+     * the hash table for a successor which is not chained yet */
+    while (tb != NULL) {
+      uint64_t nr = tb_exec(tb, n - total);
+      if (nr == 0) {
+        /* nothing can be executed from the block, e.g. its code is not
+         * inside pmem any more, so go on without it */
+        exec_once();
+        nr = 1;
+        g_nr_guest_instr ++;
+      }
+      if (bbv_on) bbv_count(tb->pc, nr);
+      total += nr;
+      if (total == n || nemu_event_pending()) break;
+      TB *next = tb_chained(tb, cpu.pc);
+      if (next == NULL) break;
+      tb = next;
+    }
+
+    if (nemu_event_pending() && nemu_handle_event()) break;
+  }
+
+  return total;
+}
+
+#endif
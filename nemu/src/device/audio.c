@@ -0,0 +1,100 @@
+#include "common.h"
+
+#ifdef HAS_IOE
+
+#include "device/map.h"
+#include "device/idle.h"
+#include <SDL2/SDL.h>
+
+#define AUDIO_PORT 0x500 // Note that this is not the standard
+#define AUDIO_MMIO 0xa1000500
+#define STREAM_BUF 0xa1200000
+#define STREAM_BUF_MAX_SIZE 65536
+
+/* The samples are exchanged through a ring buffer `sbuf' mapped to the
+ * guest, which SDL reads from its audio thread:
+ *   AUDIO_FREQ, AUDIO_CHANNELS, AUDIO_SAMPLES
+ *                    the format, set before AUDIO_INIT, samples are 16-bit
+ *   AUDIO_SBUF_SIZE  the size of `sbuf', read-only
+ *   AUDIO_INIT       write 1 to start playing
+ *   AUDIO_HEAD       the number of bytes written by the guest
+ *   AUDIO_TAIL       the number of bytes played by the device, read-only
+ * Both counters are free-running, and byte i is at sbuf[i % size].
+ *
+ * The guest fills `sbuf' from AUDIO_HEAD, and only writes the register
+ * when it has a batch of samples, e.g. when the data not yet published
+ * crosses a watermark. Neither the samples nor AUDIO_HEAD have side
+ * effects in NEMU, and the audio thread updates AUDIO_TAIL directly, so
+ * playing never stalls the emulation. A buffer running dry plays silence.
+ */
+
+enum { AUDIO_FREQ, AUDIO_CHANNELS, AUDIO_SAMPLES, AUDIO_SBUF_SIZE,
+  AUDIO_INIT, AUDIO_HEAD, AUDIO_TAIL, NR_AUDIO_REG };
+
+static uint8_t *sbuf = NULL;
+static uint32_t *audio_base = NULL;
+static IdlePoll tail_poll = {};
+
+/* called by the audio thread of SDL */
+static void audio_play(void *userdata, uint8_t *stream, int len) {
+  uint32_t head = __atomic_load_n(&audio_base[AUDIO_HEAD], __ATOMIC_ACQUIRE);
+  uint32_t tail = audio_base[AUDIO_TAIL];
+  /* the guest has overwritten the samples not played yet */
+  if (head - tail > STREAM_BUF_MAX_SIZE) tail = head - STREAM_BUF_MAX_SIZE;
+
+  uint32_t n = head - tail;
+  if (n > len) n = len;
+  uint32_t i = tail % STREAM_BUF_MAX_SIZE;
+  uint32_t first = STREAM_BUF_MAX_SIZE - i;
+  if (first > n) first = n;
+  memcpy(stream, sbuf + i, first);
+  memcpy(stream + first, sbuf, n - first);
+  memset(stream + n, 0, len - n);
+
+  __atomic_store_n(&audio_base[AUDIO_TAIL], tail + n, __ATOMIC_RELEASE);
+}
+
+static void audio_init() {
+  SDL_AudioSpec s = {};
+  s.freq = audio_base[AUDIO_FREQ];
+  s.format = AUDIO_S16SYS;
+  s.channels = audio_base[AUDIO_CHANNELS];
+  s.samples = (audio_base[AUDIO_SAMPLES] != 0 ? audio_base[AUDIO_SAMPLES] : 1024);
+  s.callback = audio_play;
+  s.userdata = NULL;
+
+  audio_base[AUDIO_HEAD] = 0;
+  audio_base[AUDIO_TAIL] = 0;
+
+  int ret = SDL_InitSubSystem(SDL_INIT_AUDIO);
+  if (ret == 0) ret = SDL_OpenAudio(&s, NULL);
+  if (ret != 0) {
+    Log("can not open audio: %s", SDL_GetError());
+    return;
+  }
+  SDL_PauseAudio(0);
+}
+
+static void audio_io_handler(uint32_t offset, int len, bool is_write) {
+  if (is_write && offset == AUDIO_INIT * 4) {
+    if (audio_base[AUDIO_INIT] == 1) audio_init();
+  }
+  else if (!is_write && offset == AUDIO_TAIL * 4) {
+    /* waiting for the samples to be played */
+    if (device_poll_is_idle(&tail_poll, audio_base[AUDIO_TAIL])) {
+      device_idle_sleep(1000);
+    }
+  }
+}
+
+void init_audio() {
+  audio_base = (void *)new_space(NR_AUDIO_REG * 4);
+  audio_base[AUDIO_SBUF_SIZE] = STREAM_BUF_MAX_SIZE;
+  /* only reading the tail needs the callback, to sleep while it is polled */
+  map_static_read(add_pio_map("audio", AUDIO_PORT, (void *)audio_base, NR_AUDIO_REG * 4, audio_io_handler), 0, AUDIO_TAIL * 4);
+  map_static_read(add_mmio_map("audio", AUDIO_MMIO, (void *)audio_base, NR_AUDIO_REG * 4, audio_io_handler), 0, AUDIO_TAIL * 4);
+
+  sbuf = (void *)new_space(STREAM_BUF_MAX_SIZE);
+  add_mmio_map("audio-sbuf", STREAM_BUF, (void *)sbuf, STREAM_BUF_MAX_SIZE, NULL);
+}
+#endif	/* HAS_IOE */
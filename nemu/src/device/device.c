@@ -1,49 +1,68 @@
-#include "common.h"
+#include "nemu.h"
+#include "monitor/monitor.h"
+#include "device/idle.h"
+#include "monitor/snapshot.h"
+#include "monitor/reverse.h"
+#include <unistd.h>
+
+/* the number of polls reading nothing new after which the guest is idle */
+#define IDLE_POLLS 64
+
+uint32_t device_nr_write = 0;
+
+/* Called by a device register which is polled by the guest, with the
+ * value it reads. Return true if the same instruction keeps reading the
+ * same value without writing to any device in between, i.e. the guest
+ * is busy-waiting for the device. */
+bool device_poll_is_idle(IdlePoll *p, uint32_t val) {
+  if (p->pc != cpu.pc || p->val != val || p->nr_write != device_nr_write) {
+    p->pc = cpu.pc;
+    p->val = val;
+    p->nr = 0;
+    p->nr_write = device_nr_write;
+    return false;
+  }
+  if (++ p->nr < IDLE_POLLS) return false;
+  p->nr = 0;
+  return true;
+}
 
 void init_argsrom();
+void init_marker();
 
 #ifdef HAS_IOE
 
-#include <sys/time.h>
-#include <signal.h>
+#include "device/event.h"
 #include <SDL2/SDL.h>
 
 #define TIMER_HZ 100
-#define VGA_HZ 50
-
-static struct itimerval it = {};
-static int device_update_flag = false;
 
 void init_serial();
 void init_timer();
 void init_vga();
 void init_i8042();
+void init_disk();
+void init_vcons();
+void init_audio();
 
 void timer_intr();
+void serial_flush();
 void send_key(uint8_t, bool);
 
-static void timer_sig_handler(int signum) {
-  timer_intr();
-
-  device_update_flag = true;
-
-  int ret = setitimer(ITIMER_VIRTUAL, &it, NULL);
-  Assert(ret == 0, "Can not set timer");
-}
-
-void device_update() {
-  if (!device_update_flag) {
-    return;
-  }
-  device_update_flag = false;
+/* set by the render thread when the window is closed */
+static volatile bool quit_requested = false;
 
+/* Called by the render thread after pumping events, see vga.c. Keys are
+ * sent to the keyboard from here, and the emulation thread only checks
+ * `quit_requested', so it never calls SDL. */
+void device_handle_events() {
   SDL_Event event;
-  while (SDL_PollEvent(&event)) {
+  while (SDL_PeepEvents(&event, 1, SDL_GETEVENT, SDL_FIRSTEVENT, SDL_LASTEVENT) > 0) {
     switch (event.type) {
       case SDL_QUIT: {
-                       void monitor_statistic();
-                       monitor_statistic();
-                       exit(0);
+                       quit_requested = true;
+                       nemu_event = true;
+                       break;
                      }
 
                      // If a key was pressed
@@ -59,33 +78,76 @@ void device_update() {
   }
 }
 
+/* Called by nemu_handle_event() on the emulation thread. */
+void device_update() {
+  if (quit_requested) {
+    void monitor_statistic();
+    monitor_statistic();
+    exit(0);
+  }
+
+  device_run_events();
+}
+
+/* Sleep instead of letting an idle guest burn the host CPU. */
+void device_idle_sleep(uint32_t usec) {
+  /* the inputs waited for are already in the log */
+  if (rev_input_is_logged()) return;
+  /* virtual time does not pass while the guest is waiting,
+   * so show what it has printed before sleeping */
+  serial_flush();
+  usleep(usec);
+}
+
 void sdl_clear_event_queue() {
-  SDL_Event event;
-  while (SDL_PollEvent(&event));
+  SDL_FlushEvents(SDL_FIRSTEVENT, SDL_LASTEVENT);
 }
 
 void init_device() {
   init_argsrom();
+  init_marker();
   init_serial();
   init_timer();
   init_vga();
   init_i8042();
+  init_disk();
+  init_vcons();
+  init_audio();
 
-  struct sigaction s;
-  memset(&s, 0, sizeof(s));
-  s.sa_handler = timer_sig_handler;
-  int ret = sigaction(SIGVTALRM, &s, NULL);
-  Assert(ret == 0, "Can not set signal handler");
+  add_device_event("timer", 1000000 / TIMER_HZ, timer_intr);
+}
 
-  it.it_value.tv_sec = 0;
-  it.it_value.tv_usec = 1000000 / TIMER_HZ;
-  ret = setitimer(ITIMER_VIRTUAL, &it, NULL);
-  Assert(ret == 0, "Can not set timer");
+/* The state of the disk image and the audio played by the host are not
+ * in the snapshot. */
+void device_snapshot(Snapshot *s) {
+  /* what the guest has printed belongs to the state before */
+  if (!snapshot_is_restoring(s)) serial_flush();
+  /* the polls of the guest decide when the virtual time is skipped */
+  if (snapshot_is_checkpoint(s)) snapshot_sync(s, "device_nr_write", &device_nr_write, sizeof(device_nr_write));
+  io_snapshot(s);
+  key_snapshot(s);
+  timer_snapshot(s);
+  snapshot_sync(s, "intr", &nemu_intr, sizeof(nemu_intr));
+  if (snapshot_is_restoring(s)) intr_update();
+  vga_snapshot(s);
+  event_snapshot(s);
 }
 #else
 
+void device_idle_sleep(uint32_t usec) {
+  if (rev_input_is_logged()) return;
+  usleep(usec);
+}
+
 void init_device() {
   init_argsrom();
+  init_marker();
+}
+
+void device_snapshot(Snapshot *s) {
+  if (snapshot_is_checkpoint(s)) snapshot_sync(s, "device_nr_write", &device_nr_write, sizeof(device_nr_write));
+  io_snapshot(s);
+  event_snapshot(s);
 }
 
 #endif	/* HAS_IOE */
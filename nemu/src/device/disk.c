@@ -0,0 +1,96 @@
+#include "common.h"
+
+#ifdef HAS_IOE
+
+#include "device/map.h"
+#include "device/disk.h"
+#include "memory/memory.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#define DISK_PORT 0x300 // Note that this is not the standard
+#define DISK_MMIO 0xa1000300
+
+/* A block device backed by a host file. The guest programs a transfer
+ * with the registers below, and writing DISK_CMD copies the sectors
+ * between the file and guest physical memory at once, without going
+ * through the CPU:
+ *   DISK_ADDR       guest physical address of the buffer
+ *   DISK_SECTOR     the first sector
+ *   DISK_COUNT      the number of sectors
+ *   DISK_CMD        write DISK_CMD_READ or DISK_CMD_WRITE to start
+ *   DISK_STATUS     0 if the last transfer succeeded, otherwise 1
+ *   DISK_NR_SECTOR  the size of the disk in sectors, read-only
+ */
+
+enum { DISK_ADDR, DISK_SECTOR, DISK_COUNT, DISK_CMD, DISK_STATUS, DISK_NR_SECTOR, NR_DISK_REG };
+enum { DISK_CMD_READ = 1, DISK_CMD_WRITE = 2 };
+
+#define SECTOR_SIZE 512
+/* the size of the host buffer, a transfer is split into blocks of it */
+#define DISK_BUF_SIZE (64 * 1024)
+
+static uint32_t *disk_base = NULL;
+static const char *disk_file = NULL;
+static int disk_fd = -1;
+
+static bool disk_transfer(bool is_write) {
+  uint64_t sector = disk_base[DISK_SECTOR];
+  uint64_t count = disk_base[DISK_COUNT];
+  if (disk_fd < 0 || sector + count > disk_base[DISK_NR_SECTOR]) return false;
+
+  static uint8_t buf[DISK_BUF_SIZE];
+  paddr_t addr = disk_base[DISK_ADDR];
+  off_t offset = sector * SECTOR_SIZE;
+  uint64_t left = count * SECTOR_SIZE;
+  while (left > 0) {
+    size_t len = (left < DISK_BUF_SIZE ? left : DISK_BUF_SIZE);
+    if (is_write) {
+      paddr_read_host(buf, addr, len);
+      if (pwrite(disk_fd, buf, len, offset) != len) return false;
+    }
+    else {
+      if (pread(disk_fd, buf, len, offset) != len) return false;
+      paddr_write_host(addr, buf, len);
+    }
+    addr += len;
+    offset += len;
+    left -= len;
+  }
+  return true;
+}
+
+static void disk_io_handler(uint32_t offset, int len, bool is_write) {
+  if (is_write && offset == DISK_CMD * 4) {
+    uint32_t cmd = disk_base[DISK_CMD];
+    bool ok = (cmd == DISK_CMD_READ || cmd == DISK_CMD_WRITE) && disk_transfer(cmd == DISK_CMD_WRITE);
+    disk_base[DISK_STATUS] = !ok;
+  }
+}
+
+void disk_config(const char *img_file) {
+  disk_file = img_file;
+}
+
+void init_disk() {
+  disk_base = (void *)new_space(NR_DISK_REG * 4);
+
+  if (disk_file != NULL) {
+    disk_fd = open(disk_file, O_RDWR);
+    if (disk_fd < 0) {
+      disk_fd = open(disk_file, O_RDONLY);
+      Assert(disk_fd >= 0, "Can not open '%s'", disk_file);
+      Log("'%s' is read-only, writes to the disk will fail", disk_file);
+    }
+    struct stat st;
+    int ret = fstat(disk_fd, &st);
+    assert(ret == 0);
+    disk_base[DISK_NR_SECTOR] = st.st_size / SECTOR_SIZE;
+    Log("The disk is %s with %u sectors", disk_file, disk_base[DISK_NR_SECTOR]);
+  }
+
+  map_static_read(add_pio_map("disk", DISK_PORT, (void *)disk_base, NR_DISK_REG * 4, disk_io_handler), 0, NR_DISK_REG * 4);
+  map_static_read(add_mmio_map("disk", DISK_MMIO, (void *)disk_base, NR_DISK_REG * 4, disk_io_handler), 0, NR_DISK_REG * 4);
+}
+#endif	/* HAS_IOE */
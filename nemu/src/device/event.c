@@ -0,0 +1,91 @@
+#include "nemu.h"
+#include "monitor/monitor.h"
+#include "device/event.h"
+#include "monitor/snapshot.h"
+#include <stdio.h>
+
+/* The events are kept in a binary min-heap ordered by their deadlines,
+ * and the earliest deadline is published in `nemu_deadline'. The engines
+ * only compare it with `g_nr_guest_instr', and call nemu_handle_event()
+ * when it is reached, so the cost of checking is the same for any number
+ * of events. */
+
+#define MAX_EVENT 16
+
+typedef struct {
+  const char *name;
+  uint64_t deadline, period;
+  event_handler_t handler;
+} DeviceEvent;
+
+static DeviceEvent heap[MAX_EVENT];
+static int nr_event = 0;
+
+uint64_t device_instr_per_us = 100;
+
+static inline void swap(int i, int j) {
+  DeviceEvent t = heap[i];
+  heap[i] = heap[j];
+  heap[j] = t;
+}
+
+static void sift_up(int i) {
+  while (i > 0 && heap[(i - 1) / 2].deadline > heap[i].deadline) {
+    swap(i, (i - 1) / 2);
+    i = (i - 1) / 2;
+  }
+}
+
+static void sift_down(int i) {
+  while (true) {
+    int min = i, l = 2 * i + 1, r = 2 * i + 2;
+    if (l < nr_event && heap[l].deadline < heap[min].deadline) min = l;
+    if (r < nr_event && heap[r].deadline < heap[min].deadline) min = r;
+    if (min == i) return;
+    swap(i, min);
+    i = min;
+  }
+}
+
+void add_device_event(const char *name, uint64_t period_us, event_handler_t handler) {
+  add_instr_event(name, period_us * device_instr_per_us, handler);
+}
+
+void add_instr_event(const char *name, uint64_t period, event_handler_t handler) {
+  Assert(nr_event < MAX_EVENT, "too many device events");
+  assert(period > 0);
+  heap[nr_event] = (DeviceEvent) { .name = name, .deadline = g_nr_guest_instr + period,
+    .period = period, .handler = handler };
+  sift_up(nr_event ++);
+  nemu_deadline = heap[0].deadline;
+}
+
+void device_run_events(void) {
+  while (nr_event > 0 && heap[0].deadline <= g_nr_guest_instr) {
+    /* reschedule before calling, the handler may add events */
+    event_handler_t handler = heap[0].handler;
+    heap[0].deadline += heap[0].period;
+    /* do not catch up the periods skipped, e.g. by a long block */
+    if (heap[0].deadline <= g_nr_guest_instr) heap[0].deadline = g_nr_guest_instr + heap[0].period;
+    sift_down(0);
+    handler();
+  }
+  nemu_deadline = (nr_event > 0 ? heap[0].deadline : UINT64_MAX);
+}
+
+/* The deadlines are saved by the names of the events, and an event not in
+ * the snapshot keeps its own. */
+void event_snapshot(Snapshot *s) {
+  int i;
+  for (i = 0; i < nr_event; i ++) {
+    char name[32];
+    snprintf(name, sizeof(name), "event:%s", heap[i].name);
+    if (snapshot_has(s, name)) {
+      snapshot_sync(s, name, &heap[i].deadline, sizeof(heap[i].deadline));
+    }
+  }
+  if (!snapshot_is_restoring(s)) return;
+
+  for (i = nr_event / 2 - 1; i >= 0; i --) sift_down(i);
+  nemu_deadline = (nr_event > 0 ? heap[0].deadline : UINT64_MAX);
+}
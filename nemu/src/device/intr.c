@@ -1,4 +1,13 @@
 #include "nemu.h"
+#include "monitor/monitor.h"
+
+bool nemu_intr = false;
+
+void intr_update(void) {
+  if (nemu_intr && isa_intr_enabled()) nemu_event = true;
+}
 
 void dev_raise_intr() {
+  nemu_intr = true;
+  intr_update();
 }
@@ -1,6 +1,9 @@
 #include "memory/memory.h"
 #include "device/map.h"
+#include "device/idle.h"
 #include "nemu.h"
+#include "monitor/snapshot.h"
+#include <time.h>
 
 #define IO_SPACE_MAX (1024 * 1024)
 
@@ -16,23 +19,62 @@ uint8_t* new_space(int size) {
   return p;
 }
 
+/* the registers and the memory of all devices, including vmem */
+void io_snapshot(Snapshot *s) {
+  snapshot_sync(s, "io_space", io_space, p_space - io_space);
+}
+
 static inline void check_bound(IOMap *map, paddr_t addr) {
   Assert(map != NULL && addr <= map->high && addr >= map->low,
       "address (0x%08x) is out of bound {%s} [0x%08x, 0x%08x] at pc = 0x%08x",
       addr, (map ? map->name : "???"), (map ? map->low : 0), (map ? map->high : 0), cpu.pc);
 }
 
-static inline void invoke_callback(io_callback_t c, uint32_t offset, int len, bool is_write) {
-  if (c != NULL) { c(offset, len, is_write); }
+static inline uint64_t host_ns(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec * 1000000000ull + now.tv_nsec;
+}
+
+static inline int bucket(uint64_t ns) {
+  int b = 0;
+  for (; ns > 1 && b < NR_IO_BUCKET - 1; ns >>= 1) b ++;
+  return b;
+}
+
+/* the callback is timed, to find the devices which the guest waits for */
+static inline void invoke_callback(IOMap *map, uint32_t offset, int len, bool is_write) {
+  if (map->callback == NULL) return;
+  uint64_t t = host_ns();
+  map->callback(offset, len, is_write);
+  t = host_ns() - t;
+  map->nr_callback ++;
+  map->callback_ns += t;
+  map->callback_hist[bucket(t)] ++;
+}
+
+void map_static_read(IOMap *map, uint32_t offset, int len) {
+  assert(offset % 4 == 0 && len % 4 == 0 && offset + len <= 32 * 4);
+  uint32_t i;
+  for (i = offset / 4; i < (offset + len) / 4; i ++) map->static_read |= 1u << i;
+}
+
+static inline bool is_static_read(IOMap *map, uint32_t offset, int len) {
+  uint32_t first = offset / 4, last = (offset + len - 1) / 4;
+  return last < 32 && (map->static_read >> first & 1) && (map->static_read >> last & 1);
 }
 
 uint32_t map_read(paddr_t addr, int len, IOMap *map) {
   assert(len >= 1 && len <= 4);
   check_bound(map, addr);
   uint32_t offset = addr - map->low;
-  invoke_callback(map->callback, offset, len, false); // prepare data to read
+  if (!is_static_read(map, offset, len)) {
+    invoke_callback(map, offset, len, false); // prepare data to read
+  }
+  map->nr_read ++;
+  map->read_bytes += len;
 
-  uint32_t data = *(uint32_t *)(map->space + offset) & (~0u >> ((4 - len) << 3));
+  uint32_t data = host_read(map->space + offset, len);
   return data;
 }
 
@@ -41,7 +83,51 @@ void map_write(paddr_t addr, uint32_t data, int len, IOMap *map) {
   check_bound(map, addr);
   uint32_t offset = addr - map->low;
 
-  memcpy(map->space + offset, &data, len);
+  host_write(map->space + offset, data, len);
+  device_nr_write ++;
+  map->nr_write ++;
+  map->write_bytes += len;
+
+  invoke_callback(map, offset, len, true);
+}
+
+void map_perf(PerfOut *o, IOMap *maps, int nr) {
+  int i;
+  for (i = 0; i < nr; i ++) {
+    perf_begin(o, maps[i].name);
+    perf_u64(o, "read", maps[i].nr_read);
+    perf_u64(o, "write", maps[i].nr_write);
+    perf_u64(o, "read_bytes", maps[i].read_bytes);
+    perf_u64(o, "write_bytes", maps[i].write_bytes);
+    perf_u64(o, "callback", maps[i].nr_callback);
+    perf_u64(o, "callback_ns", maps[i].callback_ns);
+    perf_end(o);
+  }
+}
+
+void map_display(const char *kind, IOMap *maps, int nr, bool hist) {
+  int i, b;
+  for (i = 0; i < nr; i ++) {
+    IOMap *m = &maps[i];
+    if (m->nr_read == 0 && m->nr_write == 0) continue;
+    printf("%-5s %-12s %10ld reads %10ld B %10ld writes %10ld B %8ld us in %ld callbacks\n",
+        kind, m->name, m->nr_read, m->read_bytes, m->nr_write, m->write_bytes,
+        m->callback_ns / 1000, m->nr_callback);
+    if (!hist) continue;
+    for (b = 0; b < NR_IO_BUCKET; b ++) {
+      if (m->callback_hist[b] == 0) continue;
+      printf("  < %10ld ns: %ld\n", 2ul << b, m->callback_hist[b]);
+    }
+  }
+}
+
+void io_display(void) {
+  pio_display(true);
+  mmio_display(true);
+}
 
-  invoke_callback(map->callback, offset, len, true);
+void io_statistic(void) {
+  Log("the accesses to each device:");
+  pio_display(false);
+  mmio_display(false);
 }
@@ -1,23 +1,148 @@
 #include "common.h"
+#include "memory/memory.h"
 #include "device/map.h"
+#include "device/idle.h"
+#include <stdlib.h>
 
-#define NR_MAP 8
+#define NR_MAP 16
 
 static IOMap maps[NR_MAP] = {};
 static int nr_map = 0;
 
+/* A two-level table from physical page numbers to the maps on them, so
+ * the map of an address is found without searching `maps'. A page wholly
+ * inside a map without callback, e.g. vmem, is accessed through its host
+ * address directly. A page with several maps on it, e.g. the page holding
+ * the small device registers, still has to be searched.
+ *
+ * Each page also records whether it is written, so a device can find
+ * the parts of its space changed by the guest, see mmio_test_and_clear_dirty().
+ */
+
+#define MMIO_DIR_SHIFT 22
+#define NR_MMIO_PAGE_IN_DIR (1 << (MMIO_DIR_SHIFT - 12))
+
+typedef struct {
+  IOMap *map;     // the only map on this page, or `shared_page'
+  uint8_t *host;  // the host address of this page if it is accessed directly
+  bool dirty;
+} MMIOPage;
+
+static MMIOPage *mmio_dir[1 << (32 - MMIO_DIR_SHIFT)] = {};
+static IOMap shared_page = {};
+
+static inline MMIOPage* mmio_page(paddr_t addr) {
+  MMIOPage *dir = mmio_dir[addr >> MMIO_DIR_SHIFT];
+  return (dir == NULL ? NULL : &dir[(addr / PAGE_SIZE) % NR_MMIO_PAGE_IN_DIR]);
+}
+
+static void add_map_to_pages(IOMap *map) {
+  paddr_t page;
+  for (page = map->low & ~PAGE_MASK; page <= map->high; page += PAGE_SIZE) {
+    MMIOPage **dir = &mmio_dir[page >> MMIO_DIR_SHIFT];
+    if (*dir == NULL) {
+      *dir = calloc(NR_MMIO_PAGE_IN_DIR, sizeof(MMIOPage));
+      assert(*dir != NULL);
+    }
+
+    MMIOPage *p = mmio_page(page);
+    if (p->map == NULL) {
+      p->map = map;
+      bool whole_page = (map->low <= page && page + PAGE_MASK <= map->high);
+      p->host = (map->callback == NULL && whole_page ? map->space + (page - map->low) : NULL);
+    }
+    else {
+      p->map = &shared_page;
+      p->host = NULL;
+    }
+
+    if (page + PAGE_SIZE < page) break;  // wrap around
+  }
+}
+
 /* device interface */
-void add_mmio_map(char *name, paddr_t addr, uint8_t* space, int len, io_callback_t callback) {
+IOMap* add_mmio_map(char *name, paddr_t addr, uint8_t* space, int len, io_callback_t callback) {
   assert(nr_map < NR_MAP);
   maps[nr_map] = (IOMap){ .name = name, .low = addr, .high = addr + len - 1,
     .space = space, .callback = callback };
   Log("Add mmio map '%s' at [0x%08x, 0x%08x]", maps[nr_map].name, maps[nr_map].low, maps[nr_map].high);
 
-  nr_map ++;
+  add_map_to_pages(&maps[nr_map]);
+  return &maps[nr_map ++];
 }
 
 /* bus interface */
 IOMap* fetch_mmio_map(paddr_t addr) {
+  MMIOPage *p = mmio_page(addr);
+  if (p == NULL || p->map == NULL) return NULL;
+  if (p->map != &shared_page) {
+    difftest_skip_ref();
+    return p->map;
+  }
+
   int mapid = find_mapid_by_addr(maps, nr_map, addr);
   return (mapid == -1 ? NULL : &maps[mapid]);
 }
+
+/* Return the host address of an access which does not need a callback,
+ * or NULL if it should go through map_read()/map_write(). */
+static inline uint8_t* mmio_host(MMIOPage *p, paddr_t addr, int len) {
+  if (p != NULL && p->host != NULL && (addr & PAGE_MASK) + len <= PAGE_SIZE) {
+    difftest_skip_ref();
+    return p->host + (addr & PAGE_MASK);
+  }
+  return NULL;
+}
+
+uint32_t mmio_read(paddr_t addr, int len) {
+  MMIOPage *p = mmio_page(addr);
+  uint8_t *host = mmio_host(p, addr, len);
+  if (host != NULL) {
+    p->map->nr_read ++;
+    p->map->read_bytes += len;
+    return host_read(host, len);
+  }
+  return map_read(addr, len, fetch_mmio_map(addr));
+}
+
+void mmio_write(paddr_t addr, uint32_t data, int len) {
+  MMIOPage *p = mmio_page(addr);
+  if (p != NULL) p->dirty = true;
+  if ((addr & PAGE_MASK) + len > PAGE_SIZE) {
+    MMIOPage *p2 = mmio_page(addr + len - 1);
+    if (p2 != NULL) p2->dirty = true;
+  }
+
+  uint8_t *host = mmio_host(p, addr, len);
+  if (host != NULL) {
+    host_write(host, data, len);
+    device_nr_write ++;
+    p->map->nr_write ++;
+    p->map->write_bytes += len;
+    return;
+  }
+  map_write(addr, data, len, fetch_mmio_map(addr));
+}
+
+void mmio_perf(PerfOut *o) {
+  map_perf(o, maps, nr_map);
+}
+
+void mmio_display(bool hist) {
+  map_display("mmio", maps, nr_map, hist);
+}
+
+void mmio_set_dirty(paddr_t addr, size_t len) {
+  paddr_t page;
+  for (page = addr & ~PAGE_MASK; page < addr + len; page += PAGE_SIZE) {
+    MMIOPage *p = mmio_page(page);
+    if (p != NULL) p->dirty = true;
+  }
+}
+
+bool mmio_test_and_clear_dirty(paddr_t addr) {
+  MMIOPage *p = mmio_page(addr);
+  if (p == NULL || !p->dirty) return false;
+  p->dirty = false;
+  return true;
+}
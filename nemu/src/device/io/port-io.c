@@ -1,35 +1,53 @@
-#include "common.h"
+#include "nemu.h"
 #include "device/map.h"
 
 #define PORT_IO_SPACE_MAX 65535
 
-#define NR_MAP 8
+#define NR_MAP 32
 static IOMap maps[NR_MAP] = {};
 static int nr_map = 0;
 
+/* the index plus one in `maps' of the map on each port, or 0 if none */
+static uint8_t port_mapid[PORT_IO_SPACE_MAX + 1] = {};
+
 /* device interface */
-void add_pio_map(char *name, ioaddr_t addr, uint8_t *space, int len, io_callback_t callback) {
+IOMap* add_pio_map(char *name, ioaddr_t addr, uint8_t *space, int len, io_callback_t callback) {
   assert(nr_map < NR_MAP);
   assert(addr + len <= PORT_IO_SPACE_MAX);
   maps[nr_map] = (IOMap){ .name = name, .low = addr, .high = addr + len - 1,
     .space = space, .callback = callback };
   Log("Add port-io map '%s' at [0x%08x, 0x%08x]", maps[nr_map].name, maps[nr_map].low, maps[nr_map].high);
 
-  nr_map ++;
+  int i;
+  for (i = 0; i < len; i ++) {
+    assert(port_mapid[addr + i] == 0);
+    port_mapid[addr + i] = nr_map + 1;
+  }
+
+  return &maps[nr_map ++];
+}
+
+static inline IOMap* fetch_pio_map(ioaddr_t addr) {
+  int mapid = port_mapid[addr];
+  Assert(mapid != 0, "no device at port 0x%04x at pc = 0x%08x", addr, cpu.pc);
+  difftest_skip_ref();
+  return &maps[mapid - 1];
 }
 
 static inline uint32_t pio_read_common(ioaddr_t addr, int len) {
-  assert(addr + len - 1 < PORT_IO_SPACE_MAX);
-  int mapid = find_mapid_by_addr(maps, nr_map, addr);
-  assert(mapid != -1);
-  return map_read(addr, len, &maps[mapid]);
+  return map_read(addr, len, fetch_pio_map(addr));
 }
 
 static inline void pio_write_common(ioaddr_t addr, uint32_t data, int len) {
-  assert(addr + len - 1 < PORT_IO_SPACE_MAX);
-  int mapid = find_mapid_by_addr(maps, nr_map, addr);
-  assert(mapid != -1);
-  map_write(addr, data, len, &maps[mapid]);
+  map_write(addr, data, len, fetch_pio_map(addr));
+}
+
+void pio_perf(PerfOut *o) {
+  map_perf(o, maps, nr_map);
+}
+
+void pio_display(bool hist) {
+  map_display("pio", maps, nr_map, hist);
 }
 
 /* CPU interface */
@@ -1,11 +1,25 @@
 #include "device/map.h"
 #include "monitor/monitor.h"
+#include "device/idle.h"
+#include "device/vga.h"
+#include "monitor/snapshot.h"
+#include "monitor/reverse.h"
+#include "memory/memory.h"
 #include <SDL2/SDL.h>
 
 #define I8042_DATA_PORT 0x60
 #define I8042_DATA_MMIO 0xa1000060
 #define KEYBOARD_IRQ 1
 
+/* Besides the data register, which returns one key for each read, there
+ * are registers to receive many keys with one trap:
+ *   [1] the number of keys pending, when read
+ *   [2] the physical address of an array of keys in the guest
+ *   [3] writing N stores up to N keys into the array, and then reading it
+ *       returns the number of keys stored
+ */
+enum { KBD_DATA, KBD_COUNT, KBD_BUF, KBD_BUF_LEN, NR_KBD_REG };
+
 static uint32_t *i8042_data_port_base = NULL;
 
 // Note that this is not the standard
@@ -30,9 +44,17 @@ static uint32_t keymap[256] = {
   MAP(_KEYS, SDL_KEYMAP)
 };
 
+/* Keys are sent by the render thread, which takes the events from SDL,
+ * and received by the emulation thread reading the data port. The queue
+ * has a single producer and a single consumer (the keyboard or vcons.c,
+ * whichever the guest uses), so it needs no lock: only
+ * the producer writes `key_r', and only the consumer writes `key_f'.
+ * Keys coming when the queue is full are dropped. */
 #define KEY_QUEUE_LEN 1024
 static int key_queue[KEY_QUEUE_LEN] = {};
 static int key_f = 0, key_r = 0;
+static uint32_t nr_key_drop = 0;
+static IdlePoll key_poll = {};
 
 #define KEYDOWN_MASK 0x8000
 
@@ -40,27 +62,95 @@ void send_key(uint8_t scancode, bool is_keydown) {
   if (nemu_state.state == NEMU_RUNNING &&
       keymap[scancode] != _KEY_NONE) {
     uint32_t am_scancode = keymap[scancode] | (is_keydown ? KEYDOWN_MASK : 0);
-    key_queue[key_r] = am_scancode;
-    key_r = (key_r + 1) % KEY_QUEUE_LEN;
-    Assert(key_r != key_f, "key queue overflow!");
+    int r = key_r;
+    int next = (r + 1) % KEY_QUEUE_LEN;
+    if (next == __atomic_load_n(&key_f, __ATOMIC_ACQUIRE)) {
+      if (nr_key_drop ++ == 0) Log("key queue overflow, keys are dropped");
+      return;
+    }
+    key_queue[r] = am_scancode;
+    __atomic_store_n(&key_r, next, __ATOMIC_RELEASE);
   }
 }
 
-static void i8042_data_io_handler(uint32_t offset, int len, bool is_write) {
-  assert(!is_write);
-  assert(offset == 0);
-  if (key_f != key_r) {
-    i8042_data_port_base[0] = key_queue[key_f];
-    key_f = (key_f + 1) % KEY_QUEUE_LEN;
+/* Called by the emulation thread, return _KEY_NONE if there is no key.
+ * The keys received are logged for reverse execution, and they come from
+ * the log instead of the queue when the instructions are executed again. */
+uint32_t recv_key() {
+  if (rev_input_is_logged()) return rev_input_replay();
+
+  int f = key_f;
+  uint32_t key = _KEY_NONE;
+  if (f != __atomic_load_n(&key_r, __ATOMIC_ACQUIRE)) {
+    key = key_queue[f];
+    __atomic_store_n(&key_f, (f + 1) % KEY_QUEUE_LEN, __ATOMIC_RELEASE);
+  }
+  rev_input_record(key);
+  return key;
+}
+
+/* the number of keys in the queue, logged in the same way as the keys */
+static uint32_t nr_key_pending() {
+  if (rev_input_is_logged()) return rev_input_replay();
+  int n = (__atomic_load_n(&key_r, __ATOMIC_ACQUIRE) - key_f + KEY_QUEUE_LEN) % KEY_QUEUE_LEN;
+  rev_input_record(n);
+  return n;
+}
+
+static void recv_keys(paddr_t buf, uint32_t max) {
+  uint32_t keys[64];
+  uint32_t n = 0, nr = 0;
+  while (n < max) {
+    uint32_t key = recv_key();
+    if (key == _KEY_NONE) break;
+    keys[nr ++] = key;
+    n ++;
+    if (nr == sizeof(keys) / sizeof(keys[0])) {
+      paddr_write_host(buf, keys, sizeof(keys));
+      buf += sizeof(keys);
+      nr = 0;
+    }
   }
-  else {
-    i8042_data_port_base[0] = _KEY_NONE;
+  if (nr > 0) paddr_write_host(buf, keys, nr * sizeof(keys[0]));
+  i8042_data_port_base[KBD_BUF_LEN] = n;
+}
+
+static void i8042_data_io_handler(uint32_t offset, int len, bool is_write) {
+  switch (offset / 4) {
+    case KBD_DATA:
+      assert(!is_write);
+#ifdef HAS_IOE
+      /* the keys come from the events of the window */
+      vga_open_window();
+#endif
+      i8042_data_port_base[KBD_DATA] = recv_key();
+
+      /* waiting for a key, new keys come with the events polled after sleeping */
+      if (device_poll_is_idle(&key_poll, i8042_data_port_base[KBD_DATA])) {
+        device_idle_sleep(1000);
+      }
+      break;
+    case KBD_COUNT:
+      if (!is_write) i8042_data_port_base[KBD_COUNT] = nr_key_pending();
+      break;
+    case KBD_BUF_LEN:
+      if (is_write) recv_keys(i8042_data_port_base[KBD_BUF], i8042_data_port_base[KBD_BUF_LEN]);
+      break;
   }
 }
 
 void init_i8042() {
-  i8042_data_port_base = (void *)new_space(4);
-  i8042_data_port_base[0] = _KEY_NONE;
-  add_pio_map("keyboard", I8042_DATA_PORT, (void *)i8042_data_port_base, 4, i8042_data_io_handler);
-  add_mmio_map("keyboard", I8042_DATA_MMIO, (void *)i8042_data_port_base, 4, i8042_data_io_handler);
+  i8042_data_port_base = (void *)new_space(NR_KBD_REG * 4);
+  i8042_data_port_base[KBD_DATA] = _KEY_NONE;
+  add_pio_map("keyboard", I8042_DATA_PORT, (void *)i8042_data_port_base, NR_KBD_REG * 4, i8042_data_io_handler);
+  add_mmio_map("keyboard", I8042_DATA_MMIO, (void *)i8042_data_port_base, NR_KBD_REG * 4, i8042_data_io_handler);
+}
+
+/* The keys not received by the guest yet. The queue is left to the render
+ * thread by the checkpoints, since the keys are replayed from the log. */
+void key_snapshot(Snapshot *s) {
+  if (snapshot_is_checkpoint(s)) return;
+  snapshot_sync(s, "key_queue", key_queue, sizeof(key_queue));
+  snapshot_sync(s, "key_f", &key_f, sizeof(key_f));
+  snapshot_sync(s, "key_r", &key_r, sizeof(key_r));
 }
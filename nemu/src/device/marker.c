@@ -0,0 +1,136 @@
+#include "common.h"
+#include "device/map.h"
+#include "device/marker.h"
+#include "monitor/perf.h"
+#include "memory/memory.h"
+#include "monitor/monitor.h"
+#include "monitor/reverse.h"
+
+#define MARKER_PORT 0x600 // Note that this is not the standard
+#define MARKER_MMIO 0xa1000600
+
+/* The guest marks the regions of its code to measure, e.g. a frame, by
+ * writing the number of a region to MARKER_BEGIN before it and to
+ * MARKER_END after it. Each region counts the guest instructions and the
+ * host time between the two, and keeps a histogram of the host time in
+ * buckets of powers of 2 microseconds. A region can be named by writing
+ * the physical address of a string to MARKER_NAME_ADDR, then the number
+ * of the region to MARKER_NAME.
+ *
+ * The guest reads the number of guest instructions executed before the
+ * current one from MARKER_INSTR_LO and MARKER_INSTR_HI. Reading
+ * MARKER_INSTR_LO latches the whole 64-bit count, so it is read first.
+ *
+ * The regions used are summarized at exit, and reported with the
+ * performance counters. What is executed again for reverse execution is
+ * not counted. */
+
+enum { MARKER_BEGIN, MARKER_END, MARKER_NAME_ADDR, MARKER_NAME, MARKER_INSTR_LO, MARKER_INSTR_HI, NR_MARKER_REG };
+
+#define NR_REGION 64
+#define NR_BUCKET 24
+#define NAME_LEN 32
+
+typedef struct {
+  char name[NAME_LEN];
+  bool open;
+  uint64_t begin_instr, begin_us;
+  uint64_t count, instr, us, max_us;
+  uint64_t hist[NR_BUCKET];
+} Region;
+
+static Region regions[NR_REGION];
+static uint32_t *marker_base = NULL;
+
+static inline int bucket(uint64_t us) {
+  int b = 0;
+  for (; us > 1 && b < NR_BUCKET - 1; us >>= 1) b ++;
+  return b;
+}
+
+static void region_end(Region *r) {
+  if (!r->open) return;
+  r->open = false;
+  uint64_t instr = g_nr_guest_instr - r->begin_instr;
+  uint64_t us = perf_host_us() - r->begin_us;
+  r->count ++;
+  r->instr += instr;
+  r->us += us;
+  if (us > r->max_us) r->max_us = us;
+  r->hist[bucket(us)] ++;
+}
+
+static void marker_io_handler(uint32_t offset, int len, bool is_write) {
+  int reg = offset / 4;
+  if (!is_write) {
+    /* only MARKER_INSTR_LO is not static */
+    marker_base[MARKER_INSTR_LO] = g_nr_guest_instr;
+    marker_base[MARKER_INSTR_HI] = g_nr_guest_instr >> 32;
+    return;
+  }
+  if (rev_is_replaying() || reg == MARKER_NAME_ADDR || reg >= MARKER_INSTR_LO) return;
+
+  uint32_t id = marker_base[reg];
+  if (id >= NR_REGION) return;
+  Region *r = &regions[id];
+  switch (reg) {
+    case MARKER_BEGIN:
+      r->open = true;
+      r->begin_instr = g_nr_guest_instr;
+      r->begin_us = perf_host_us();
+      break;
+    case MARKER_END: region_end(r); break;
+    case MARKER_NAME:
+      paddr_read_host(r->name, marker_base[MARKER_NAME_ADDR], NAME_LEN - 1);
+      r->name[NAME_LEN - 1] = '\0';
+      break;
+  }
+}
+
+static const char *region_name(int id, char *buf) {
+  if (regions[id].name[0] != '\0') return regions[id].name;
+  sprintf(buf, "region%d", id);
+  return buf;
+}
+
+void marker_statistic(void) {
+  int i, b;
+  for (i = 0; i < NR_REGION; i ++) {
+    Region *r = &regions[i];
+    if (r->count == 0) continue;
+    char buf[16];
+    Log("%s: %ld times, %ld instructions and %ld us on average, %ld us at most",
+        region_name(i, buf), r->count, r->instr / r->count, r->us / r->count, r->max_us);
+    for (b = 0; b < NR_BUCKET; b ++) {
+      if (r->hist[b] == 0) continue;
+      Log("  < %8ld us: %ld", 2ul << b, r->hist[b]);
+    }
+  }
+}
+
+void marker_perf(PerfOut *o) {
+  perf_begin(o, "marker");
+  int i;
+  for (i = 0; i < NR_REGION; i ++) {
+    Region *r = &regions[i];
+    if (r->count == 0) continue;
+    char buf[16];
+    perf_begin(o, region_name(i, buf));
+    perf_u64(o, "count", r->count);
+    perf_double(o, "avg_instructions", (double)r->instr / r->count);
+    perf_double(o, "avg_us", (double)r->us / r->count);
+    perf_u64(o, "max_us", r->max_us);
+    perf_end(o);
+  }
+  perf_end(o);
+}
+
+void init_marker() {
+  marker_base = (void *)new_space(NR_MARKER_REG * 4);
+  IOMap *pio = add_pio_map("marker", MARKER_PORT, (void *)marker_base, NR_MARKER_REG * 4, marker_io_handler);
+  IOMap *mmio = add_mmio_map("marker", MARKER_MMIO, (void *)marker_base, NR_MARKER_REG * 4, marker_io_handler);
+  map_static_read(pio, 0, MARKER_INSTR_LO * 4);
+  map_static_read(pio, MARKER_INSTR_HI * 4, 4);
+  map_static_read(mmio, 0, MARKER_INSTR_LO * 4);
+  map_static_read(mmio, MARKER_INSTR_HI * 4, 4);
+}
@@ -1,24 +1,95 @@
 #include "common.h"
 #include "device/map.h"
+#include "device/event.h"
+#include "memory/memory.h"
+#include "monitor/reverse.h"
+#include <signal.h>
+#include <stdlib.h>
+#include <unistd.h>
 
 /* http://en.wikibooks.org/wiki/Serial_Programming/8250_UART_Programming */
 
 #define SERIAL_PORT 0x3F8
 #define SERIAL_MMIO 0xa10003F8
 #define CH_OFFSET 0
+#define SERIAL_TX_PORT 0x3F0 // Note that this is not the standard
+#define SERIAL_TX_MMIO 0xa10003F0
+
+/* The bulk transmit registers print a whole string with one trap: the
+ * guest writes the physical address of the string to SERIAL_TX_ADDR, then
+ * its length to SERIAL_TX_LEN, which prints it. */
+enum { SERIAL_TX_ADDR, SERIAL_TX_LEN, NR_SERIAL_TX_REG };
+
+/* The output is collected in a buffer instead of going through stdio for
+ * every byte. It is flushed when the buffer is full, every SERIAL_FLUSH_US
+ * of virtual time, when the guest is idle, when cpu_exec() returns, and at
+ * exit or abort, so no output is lost. What is output again by the
+ * instructions replayed for reverse execution is dropped. */
+#define SERIAL_BUF_SIZE (64 * 1024)
+#define SERIAL_FLUSH_US 10000
 
 static uint8_t *serial_ch_base = NULL;
+static uint32_t *serial_tx_base = NULL;
+static char serial_buf[SERIAL_BUF_SIZE];
+static int serial_buf_len = 0;
+
+void serial_flush() {
+  if (serial_buf_len == 0) return;
+  fwrite(serial_buf, 1, serial_buf_len, stdout);
+  fflush(stdout);
+  serial_buf_len = 0;
+}
+
+/* stdio can not be used in a signal handler */
+static void serial_abort_handler(int signum) {
+  int i = 0;
+  while (i < serial_buf_len) {
+    int ret = write(STDOUT_FILENO, serial_buf + i, serial_buf_len - i);
+    if (ret <= 0) break;
+    i += ret;
+  }
+  serial_buf_len = 0;
+
+  signal(signum, SIG_DFL);
+  raise(signum);
+}
+
+/* also used by the batched console, see vcons.c */
+void serial_write(const void *buf, size_t len) {
+  if (rev_is_replaying()) return;
+  while (len > 0) {
+    size_t n = SERIAL_BUF_SIZE - serial_buf_len;
+    if (n > len) n = len;
+    memcpy(serial_buf + serial_buf_len, buf, n);
+    serial_buf_len += n;
+    buf += n;
+    len -= n;
+    if (serial_buf_len == SERIAL_BUF_SIZE) serial_flush();
+  }
+}
 
 static void serial_ch_io_handler(uint32_t offset, int len, bool is_write) {
   assert(offset == 0);
   assert(is_write);
   assert(len == 1);
 
-  char c = serial_ch_base[0];
+  if (rev_is_replaying()) return;
   /* We bind the serial port with the host stdout in NEMU. */
-  putc(c, stdout);
-  if (c == '\n') {
-    fflush(stdout);
+  serial_buf[serial_buf_len ++] = serial_ch_base[0];
+  if (serial_buf_len == SERIAL_BUF_SIZE) serial_flush();
+}
+
+static void serial_tx_io_handler(uint32_t offset, int len, bool is_write) {
+  if (!is_write || offset != SERIAL_TX_LEN * 4) return;
+  static uint8_t buf[4096];
+  paddr_t addr = serial_tx_base[SERIAL_TX_ADDR];
+  uint32_t n = serial_tx_base[SERIAL_TX_LEN];
+  while (n > 0) {
+    uint32_t chunk = (n < sizeof(buf) ? n : sizeof(buf));
+    paddr_read_host(buf, addr, chunk);
+    serial_write(buf, chunk);
+    addr += chunk;
+    n -= chunk;
   }
 }
 
@@ -26,4 +97,12 @@ void init_serial() {
   serial_ch_base = new_space(1);
   add_pio_map("serial", SERIAL_PORT + CH_OFFSET, serial_ch_base, 1, serial_ch_io_handler);
   add_mmio_map("serial", SERIAL_MMIO + CH_OFFSET, serial_ch_base, 1, serial_ch_io_handler);
+
+  serial_tx_base = (void *)new_space(NR_SERIAL_TX_REG * 4);
+  map_static_read(add_pio_map("serial-tx", SERIAL_TX_PORT, (void *)serial_tx_base, NR_SERIAL_TX_REG * 4, serial_tx_io_handler), 0, NR_SERIAL_TX_REG * 4);
+  map_static_read(add_mmio_map("serial-tx", SERIAL_TX_MMIO, (void *)serial_tx_base, NR_SERIAL_TX_REG * 4, serial_tx_io_handler), 0, NR_SERIAL_TX_REG * 4);
+
+  add_device_event("serial", SERIAL_FLUSH_US, serial_flush);
+  atexit(serial_flush);
+  signal(SIGABRT, serial_abort_handler);
 }
@@ -1,32 +1,177 @@
 #include "device/map.h"
+#include "device/timer.h"
 #include "monitor/monitor.h"
-#include <sys/time.h>
+#include "device/idle.h"
+#include "device/event.h"
+#include "monitor/snapshot.h"
+#include "monitor/reverse.h"
+#include <stdlib.h>
+#include <time.h>
 
 #define RTC_PORT 0x48   // Note that this is not the standard
 #define RTC_MMIO 0xa1000048
 
+/* The RTC has five registers:
+ *   [0] milliseconds since NEMU starts
+ *   [1] microseconds since NEMU starts, the low 32 bits
+ *   [2] the high 32 bits, latched when [1] is read
+ *   [3] guest instructions executed, the low 32 bits
+ *   [4] the high 32 bits, latched when [3] is read
+ *
+ * The instruction count is the cheapest and the most precise way for the
+ * guest to time a short piece of code, since it reads no clock, is not
+ * logged for reverse execution, and does not depend on the load of the
+ * host.
+ *
+ * The time comes from one of the clocks below, selected by timer_config():
+ *   host        the host monotonic clock, read on every access
+ *   cached      the host monotonic clock, read on timer ticks and when
+ *               the guest is waiting for the time to pass
+ *   virtual[:N] N guest instructions take 1 us (100 by default), so a run
+ *               is reproducible. Waiting for the time to pass skips it.
+ *               N is also the rate of the virtual time of device events.
+ *
+ * The time read from the host clocks is logged for reverse execution.
+ */
+
+enum { CLOCK_HOST, CLOCK_CACHED, CLOCK_VIRTUAL };
+
+static int clock_mode = CLOCK_HOST;
+static struct timespec start_time;
+
+/* the time of CLOCK_CACHED */
+static volatile uint64_t cached_us = 0;
+/* the time skipped by CLOCK_VIRTUAL */
+static uint64_t skipped_us = 0;
+
+static uint32_t *rtc_port_base = NULL;
+static IdlePoll rtc_poll = {};
+
+static uint64_t host_us() {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (now.tv_sec - start_time.tv_sec) * 1000000ull +
+    (now.tv_nsec - start_time.tv_nsec) / 1000;
+}
+
+static uint64_t get_us() {
+  switch (clock_mode) {
+    case CLOCK_CACHED: return cached_us;
+    case CLOCK_VIRTUAL: return g_nr_guest_instr / device_instr_per_us + skipped_us;
+    default: return host_us();
+  }
+}
+
 void timer_intr() {
+  if (clock_mode == CLOCK_CACHED) cached_us = host_us();
+
   if (nemu_state.state == NEMU_RUNNING) {
     extern void dev_raise_intr(void);
     dev_raise_intr();
   }
 }
 
-static uint32_t *rtc_port_base = NULL;
+/* the time read by the guest */
+static uint64_t rtc_read_us() {
+  if (clock_mode == CLOCK_VIRTUAL) return get_us();
+  if (rev_input_is_logged()) return rev_input_replay();
+  uint64_t us = get_us();
+  rev_input_record(us);
+  return us;
+}
+
+/* the guest is waiting until the time reaches `us' */
+static void wait_until(uint64_t us) {
+  if (clock_mode == CLOCK_CACHED) cached_us = host_us();
+  uint64_t now = get_us();
+  if (now >= us) return;
+
+  switch (clock_mode) {
+    case CLOCK_VIRTUAL: skipped_us += us - now; break;
+    case CLOCK_CACHED: device_idle_sleep(us - now); cached_us = host_us(); break;
+    default: device_idle_sleep(us - now); break;
+  }
+}
 
 void rtc_io_handler(uint32_t offset, int len, bool is_write) {
-  assert(offset == 0);
-  if (!is_write) {
-    struct timeval now;
-    gettimeofday(&now, NULL);
-    uint32_t seconds = now.tv_sec;
-    uint32_t useconds = now.tv_usec;
-    rtc_port_base[0] = seconds * 1000 + (useconds + 500) / 1000;
+  if (is_write) return;
+
+  if (offset == 0) {
+    uint64_t us = rtc_read_us();
+    rtc_port_base[0] = (us + 500) / 1000;
+
+    /* waiting for the time to pass, sleep until the value is going to change */
+    if (device_poll_is_idle(&rtc_poll, rtc_port_base[0])) {
+      wait_until((us + 500) / 1000 * 1000 + 500);
+    }
+  }
+  else if (offset == 4) {
+    uint64_t us = rtc_read_us();
+    rtc_port_base[1] = us;
+    rtc_port_base[2] = us >> 32;
+
+    if (device_poll_is_idle(&rtc_poll, rtc_port_base[1])) {
+      wait_until(us + 1);
+    }
+  }
+  else if (offset == 12) {
+    rtc_port_base[3] = g_nr_guest_instr;
+    rtc_port_base[4] = g_nr_guest_instr >> 32;
+  }
+}
+
+void timer_config(const char *spec) {
+  if (spec == NULL || strcmp(spec, "host") == 0) clock_mode = CLOCK_HOST;
+  else if (strcmp(spec, "cached") == 0) clock_mode = CLOCK_CACHED;
+  else if (strncmp(spec, "virtual", 7) == 0) {
+    clock_mode = CLOCK_VIRTUAL;
+    if (spec[7] == ':') {
+      char *end;
+      device_instr_per_us = strtoull(spec + 8, &end, 10);
+      Assert(*end == '\0' && device_instr_per_us > 0, "invalid clock '%s'", spec);
+    }
+    else Assert(spec[7] == '\0', "invalid clock '%s'", spec);
   }
+  else panic("invalid clock '%s', should be host, cached or virtual[:N]", spec);
 }
 
 void init_timer() {
-  rtc_port_base = (void*)new_space(4);
-  add_pio_map("rtc", RTC_PORT, (void *)rtc_port_base, 4, rtc_io_handler);
-  add_mmio_map("rtc", RTC_MMIO, (void *)rtc_port_base, 4, rtc_io_handler);
+  clock_gettime(CLOCK_MONOTONIC, &start_time);
+
+  rtc_port_base = (void*)new_space(20);
+  /* the high words are latched by reading the low words */
+  IOMap *maps[2] = {
+    add_pio_map("rtc", RTC_PORT, (void *)rtc_port_base, 20, rtc_io_handler),
+    add_mmio_map("rtc", RTC_MMIO, (void *)rtc_port_base, 20, rtc_io_handler),
+  };
+  int i;
+  for (i = 0; i < 2; i ++) {
+    map_static_read(maps[i], 8, 4);
+    map_static_read(maps[i], 16, 4);
+  }
+}
+
+/* The time goes on from the snapshot. Only the virtual time is the same
+ * as the original run after restoring. The host clocks are not turned
+ * back by the checkpoints, the time read from them is replayed instead. */
+void timer_snapshot(Snapshot *s) {
+  if (snapshot_is_checkpoint(s)) {
+    snapshot_sync(s, "rtc_skipped_us", &skipped_us, sizeof(skipped_us));
+    snapshot_sync(s, "rtc_poll", &rtc_poll, sizeof(rtc_poll));
+    return;
+  }
+
+  if (clock_mode == CLOCK_CACHED) cached_us = host_us();
+  uint64_t us = get_us();
+  snapshot_sync(s, "rtc_us", &us, sizeof(us));
+  if (!snapshot_is_restoring(s)) return;
+
+  uint64_t instr_us = g_nr_guest_instr / device_instr_per_us;
+  skipped_us = (us > instr_us ? us - instr_us : 0);
+  cached_us = us;
+  /* so that host_us() is `us' now */
+  clock_gettime(CLOCK_MONOTONIC, &start_time);
+  uint64_t ns = start_time.tv_sec * 1000000000ull + start_time.tv_nsec - us * 1000;
+  start_time.tv_sec = ns / 1000000000;
+  start_time.tv_nsec = ns % 1000000000;
 }
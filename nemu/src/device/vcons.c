@@ -0,0 +1,108 @@
+#include "common.h"
+
+#ifdef HAS_IOE
+
+#include "device/map.h"
+#include "device/event.h"
+#include "memory/memory.h"
+
+#define VCONS_PORT 0x400 // Note that this is not the standard
+#define VCONS_MMIO 0xa1000400
+
+/* A console which exchanges data with the guest through rings in guest
+ * memory, in the spirit of virtio, so the guest does not trap for every
+ * byte or key. The guest writes the physical address of this structure
+ * to VCONS_QUEUE to enable it:
+ *
+ *   struct {
+ *     uint32_t tx_avail;  // written by the guest
+ *     uint32_t tx_used;   // written by NEMU
+ *     uint32_t rx_head;   // written by NEMU
+ *     uint32_t rx_tail;   // written by the guest
+ *     struct { uint32_t addr, len; } tx[VCONS_NR_TX];
+ *     uint32_t rx[VCONS_NR_RX];
+ *   };
+ *
+ * The indices are free-running, and the entry of index i is [i % NR].
+ * To print, the guest fills tx[tx_avail % NR] with buffers, increases
+ * tx_avail, and writes VCONS_DOORBELL once for all of them. NEMU prints
+ * the buffers from tx_used to tx_avail and sets tx_used to tx_avail.
+ *
+ * Keys are stored into rx[rx_head % NR] by NEMU on every doorbell and
+ * every VCONS_POLL_US of virtual time, while the guest has consumed
+ * fewer than VCONS_NR_RX keys. The guest reads them without trapping
+ * and increases rx_tail. The keys stored are no longer seen by the keyboard.
+ */
+
+enum { VCONS_QUEUE, VCONS_DOORBELL, NR_VCONS_REG };
+
+#define VCONS_NR_TX 64
+#define VCONS_NR_RX 64
+#define VCONS_POLL_US 1000
+
+#define TX_AVAIL 0
+#define TX_USED  4
+#define RX_HEAD  8
+#define RX_TAIL  12
+#define TX_DESC(i) (16 + ((i) % VCONS_NR_TX) * 8)
+#define RX_ENTRY(i) (16 + VCONS_NR_TX * 8 + ((i) % VCONS_NR_RX) * 4)
+
+static uint32_t *vcons_base = NULL;
+
+void serial_write(const void *buf, size_t len);
+uint32_t recv_key();
+
+static void vcons_tx(paddr_t q) {
+  static uint8_t buf[4096];
+  uint32_t avail = paddr_read(q + TX_AVAIL, 4);
+  uint32_t used = paddr_read(q + TX_USED, 4);
+  Assert(avail - used <= VCONS_NR_TX, "vcons: %u buffers posted for a ring of %d",
+      avail - used, VCONS_NR_TX);
+
+  for (; used != avail; used ++) {
+    paddr_t addr = paddr_read(q + TX_DESC(used), 4);
+    uint32_t len = paddr_read(q + TX_DESC(used) + 4, 4);
+    while (len > 0) {
+      uint32_t n = (len < sizeof(buf) ? len : sizeof(buf));
+      paddr_read_host(buf, addr, n);
+      serial_write(buf, n);
+      addr += n;
+      len -= n;
+    }
+  }
+  paddr_write(q + TX_USED, used, 4);
+}
+
+static void vcons_rx(paddr_t q) {
+  uint32_t head = paddr_read(q + RX_HEAD, 4);
+  uint32_t tail = paddr_read(q + RX_TAIL, 4);
+  uint32_t head0 = head;
+  while (head - tail < VCONS_NR_RX) {
+    uint32_t key = recv_key();
+    if (key == 0) break;  // _KEY_NONE
+    paddr_write(q + RX_ENTRY(head), key, 4);
+    head ++;
+  }
+  if (head != head0) paddr_write(q + RX_HEAD, head, 4);
+}
+
+static void vcons_poll() {
+  if (vcons_base[VCONS_QUEUE] != 0) vcons_rx(vcons_base[VCONS_QUEUE]);
+}
+
+static void vcons_io_handler(uint32_t offset, int len, bool is_write) {
+  if (is_write && offset == VCONS_DOORBELL * 4) {
+    paddr_t q = vcons_base[VCONS_QUEUE];
+    if (q == 0) return;
+    vcons_tx(q);
+    vcons_rx(q);
+  }
+}
+
+void init_vcons() {
+  vcons_base = (void *)new_space(NR_VCONS_REG * 4);
+  map_static_read(add_pio_map("vcons", VCONS_PORT, (void *)vcons_base, NR_VCONS_REG * 4, vcons_io_handler), 0, NR_VCONS_REG * 4);
+  map_static_read(add_mmio_map("vcons", VCONS_MMIO, (void *)vcons_base, NR_VCONS_REG * 4, vcons_io_handler), 0, NR_VCONS_REG * 4);
+  add_device_event("vcons", VCONS_POLL_US, vcons_poll);
+}
+#endif	/* HAS_IOE */
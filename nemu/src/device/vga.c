@@ -3,7 +3,14 @@
 #ifdef HAS_IOE
 
 #include "device/map.h"
+#include "device/vga.h"
+#include "memory/memory.h"
+#include "monitor/snapshot.h"
+#include "monitor/monitor.h"
+#include "monitor/perf.h"
 #include <SDL2/SDL.h>
+#include <sys/mman.h>
+#include <time.h>
 
 #define VMEM 0xa0000000
 
@@ -11,44 +18,347 @@
 #define SCREEN_MMIO 0xa1000100
 #define SYNC_PORT 0x104 // Note that this is not the standard
 #define SYNC_MMIO 0xa1000104
-#define SCREEN_H 300
-#define SCREEN_W 400
+#define BLIT_PORT 0x108 // Note that this is not the standard
+#define BLIT_MMIO 0xa1000108
+/* vmem may take the space up to the device registers */
+#define VMEM_MAX 0x1000000
+
+/* The screen is presented by a render thread, so waiting for vsync in
+ * SDL_RenderPresent() does not stall the guest. The render thread owns
+ * the video state of SDL, including pumping the event queue and handling
+ * the events with device_handle_events().
+ *
+ * vmem is a framebuffer mapped on its own, outside io_space, of the size
+ * given by vga_config() (400x300 by default), which the screen register
+ * reports. On sync, the rows on the pages of vmem written since the last
+ * sync are marked in `row_dirty'. The render thread uploads the marked
+ * rows from vmem straight to a streaming texture and presents it, without
+ * copying the frame first. A row which the guest is drawing the next frame
+ * into meanwhile may be presented half drawn, and it is presented again
+ * at the next sync.
+ *
+ * Frames are presented at most at the refresh rate of the display (VGA_HZ
+ * if it is unknown). The syncs which come faster are coalesced into the
+ * next frame presented, so no host time is spent on frames nobody sees.
+ * The guest instructions between syncs and the host time from the first
+ * sync of a frame until it is presented are summarized at exit.
+ *
+ * The window is opened lazily, at the first sync or the first read of the
+ * keyboard, so a guest which never uses them does not pay for starting
+ * the video of SDL.
+ *
+ * In headless mode, SDL is never initialized and syncs only count frames,
+ * so the speed of the guest can be measured without a display. A frame
+ * dump records the number, the host time and the FNV-1a hash of the
+ * synced frames, which also checks the output of a run against another.
+ *
+ * The blit registers draw a list of rectangles with one trap. The guest
+ * writes the physical address of an array of BlitDesc to BLIT_LIST, then
+ * the number of them to BLIT_COUNT, which executes them in order with
+ * memcpy() into vmem. A rectangle is clipped by the screen. BLIT_SYNC
+ * syncs in the same way as writing SYNC_MMIO, so a whole frame can be
+ * drawn and synced at once.
+ */
+
+enum { BLIT_COPY, BLIT_FILL, BLIT_SYNC };
+enum { BLIT_LIST, BLIT_COUNT, NR_BLIT_REG };
+
+typedef struct {
+  uint32_t op;
+  uint32_t x, y, w, h;
+  uint32_t src;    // the physical address of the pixels, or the color to fill
+  uint32_t pitch;  // the pixels in a row of `src'
+  uint32_t pad;
+} BlitDesc;
+
+static bool headless = false;
+static FILE *dump_fp = NULL;
+static int dump_every = 1;
+static uint32_t nr_frame = 0;
+static struct timespec start_time;
 
 static SDL_Window *window = NULL;
 static SDL_Renderer *renderer = NULL;
 static SDL_Texture *texture = NULL;
 
-static uint32_t (*vmem) [SCREEN_W] = NULL;
+static bool window_opened = false;
+static int screen_w = 400, screen_h = 300;
+static uint32_t *vmem = NULL;
 static uint32_t *screensize_port_base = NULL;
+static uint32_t *blit_base = NULL;
 
-static inline void update_screen() {
-  SDL_UpdateTexture(texture, NULL, vmem, SCREEN_W * sizeof(vmem[0][0]));
-  SDL_RenderClear(renderer);
-  SDL_RenderCopy(renderer, texture, NULL, NULL);
-  SDL_RenderPresent(renderer);
+#define ROW_SIZE (screen_w * sizeof(vmem[0]))
+#define VMEM_SIZE ((screen_h * ROW_SIZE + PAGE_SIZE - 1) & ~PAGE_MASK)
+#define NR_VMEM_PAGE (VMEM_SIZE / PAGE_SIZE)
+
+/* the interval to pump events when there is nothing to present */
+#define EVENT_PUMP_MS 10
+/* the rate to present frames at if the refresh rate is unknown */
+#define VGA_HZ 60
+
+/* protected by `frame_lock' */
+static bool *row_dirty = NULL;
+static bool frame_ready = false;
+static uint64_t frame_sync_us = 0;  // the host time of the first sync of the frame
+static uint32_t frame_nr_sync = 0;  // the syncs coalesced into the frame
+
+typedef struct {
+  uint64_t nr, total, max;
+} FrameStat;
+
+static inline void stat_add(FrameStat *st, uint64_t val) {
+  st->nr ++;
+  st->total += val;
+  if (val > st->max) st->max = val;
 }
 
-static void vga_io_handler(uint32_t offset, int len, bool is_write) {
-  // TODO: call `update_screen()` when writing to the sync register
-  TODO();
+/* the guest instructions between syncs, and the host time to present */
+static FrameStat instr_stat = {}, present_stat = {};
+static uint64_t nr_coalesced = 0;
+static uint64_t last_sync_instr = 0;
+
+static SDL_mutex *frame_lock = NULL;
+static SDL_cond *frame_cond = NULL;
+
+/* the whole screen is uploaded at the first sync */
+static bool frame_valid = false;
+
+/* upload the rows [y0, y1) of vmem to the streaming texture */
+static void upload_rows(int y0, int y1) {
+  SDL_Rect rect = { .x = 0, .y = y0, .w = screen_w, .h = y1 - y0 };
+  SDL_UpdateTexture(texture, &rect, &vmem[y0 * screen_w], ROW_SIZE);
 }
 
-void init_vga() {
+/* upload each run of dirty rows with `frame_lock' held */
+static void upload_dirty_rows() {
+  int y = 0;
+  while (y < screen_h) {
+    if (!row_dirty[y]) { y ++; continue; }
+    int y0 = y;
+    while (y < screen_h && row_dirty[y]) row_dirty[y ++] = false;
+    upload_rows(y0, y);
+  }
+}
+
+void device_handle_events();
+
+static int render_thread(void *arg) {
   char title[128];
   sprintf(title, "%s-NEMU", str(__ISA__));
 
   SDL_Init(SDL_INIT_VIDEO);
-  SDL_CreateWindowAndRenderer(SCREEN_W * 2, SCREEN_H * 2, 0, &window, &renderer);
+  /* a small screen is scaled up */
+  int scale = (screen_w <= 640 && screen_h <= 480 ? 2 : 1);
+  SDL_CreateWindowAndRenderer(screen_w * scale, screen_h * scale, 0, &window, &renderer);
   SDL_SetWindowTitle(window, title);
   texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888,
-      SDL_TEXTUREACCESS_STATIC, SCREEN_W, SCREEN_H);
+      SDL_TEXTUREACCESS_STREAMING, screen_w, screen_h);
+
+  SDL_DisplayMode mode;
+  int hz = VGA_HZ;
+  if (SDL_GetCurrentDisplayMode(SDL_GetWindowDisplayIndex(window), &mode) == 0 && mode.refresh_rate > 0) {
+    hz = mode.refresh_rate;
+  }
+  uint64_t period_us = 1000000 / hz, next_us = 0;
+  Log("frames are presented at most at %d Hz", hz);
+  SDL_SemPost(arg);
+
+  SDL_LockMutex(frame_lock);
+  while (true) {
+    uint64_t now = perf_host_us();
+    if (!frame_ready) SDL_CondWaitTimeout(frame_cond, frame_lock, EVENT_PUMP_MS);
+    else if (now < next_us) SDL_CondWaitTimeout(frame_cond, frame_lock, (next_us - now + 999) / 1000);
+
+    if (frame_ready && perf_host_us() >= next_us) {
+      frame_ready = false;
+      uint64_t sync_us = frame_sync_us;
+      nr_coalesced += frame_nr_sync - 1;
+      frame_nr_sync = 0;
+      upload_dirty_rows();
+      SDL_UnlockMutex(frame_lock);
+
+      SDL_RenderClear(renderer);
+      SDL_RenderCopy(renderer, texture, NULL, NULL);
+      SDL_RenderPresent(renderer);
+
+      now = perf_host_us();
+      stat_add(&present_stat, now - sync_us);
+      next_us = now + period_us;
+    }
+    else {
+      SDL_UnlockMutex(frame_lock);
+    }
+
+    SDL_PumpEvents();
+    device_handle_events();
+    SDL_LockMutex(frame_lock);
+  }
+  return 0;
+}
+
+static void init_window() {
+  frame_lock = SDL_CreateMutex();
+  frame_cond = SDL_CreateCond();
+
+  /* wait until the window is created */
+  SDL_sem *ready = SDL_CreateSemaphore(0);
+  SDL_DetachThread(SDL_CreateThread(render_thread, "render", ready));
+  SDL_SemWait(ready);
+  SDL_DestroySemaphore(ready);
+}
+
+void vga_open_window() {
+  if (headless || window_opened) return;
+  window_opened = true;
+  init_window();
+}
+
+/* Mark the rows on the pages of vmem written since the last sync, and
+ * let the render thread present them. */
+static inline void update_screen() {
+  int page, y;
+  vga_open_window();
+  SDL_LockMutex(frame_lock);
+  for (page = 0; page < NR_VMEM_PAGE; page ++) {
+    bool dirty = mmio_test_and_clear_dirty(VMEM + page * PAGE_SIZE) || !frame_valid;
+    if (!dirty) continue;
+
+    int top = page * PAGE_SIZE / ROW_SIZE;
+    int bottom = ((page + 1) * PAGE_SIZE - 1) / ROW_SIZE + 1;
+    if (bottom > screen_h) bottom = screen_h;
+    for (y = top; y < bottom; y ++) row_dirty[y] = true;
+  }
+  frame_valid = true;
+  if (!frame_ready) frame_sync_us = perf_host_us();
+  frame_nr_sync ++;
+  frame_ready = true;
+  SDL_CondSignal(frame_cond);
+  SDL_UnlockMutex(frame_lock);
+}
+
+static void dump_frame() {
+  uint64_t hash = 0xcbf29ce484222325ull;
+  uint8_t *p = (void *)vmem;
+  int i;
+  for (i = 0; i < screen_h * ROW_SIZE; i ++) {
+    hash = (hash ^ p[i]) * 0x100000001b3ull;
+  }
+
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  uint64_t us = (now.tv_sec - start_time.tv_sec) * 1000000ull +
+    (now.tv_nsec - start_time.tv_nsec) / 1000;
+  fprintf(dump_fp, "%u,%lu,%016lx\n", nr_frame, us, hash);
+}
+
+static void vga_sync() {
+  nr_frame ++;
+  stat_add(&instr_stat, g_nr_guest_instr - last_sync_instr);
+  last_sync_instr = g_nr_guest_instr;
+  if (!headless) update_screen();
+  if (dump_fp != NULL && nr_frame % dump_every == 0) dump_frame();
+}
+
+static void vga_io_handler(uint32_t offset, int len, bool is_write) {
+  if (is_write && offset == SYNC_PORT - SCREEN_PORT) vga_sync();
+}
+
+static void blit(const BlitDesc *d) {
+  if (d->op == BLIT_SYNC) {
+    vga_sync();
+    return;
+  }
+  if (d->x >= screen_w || d->y >= screen_h) return;
+  int w = (d->w < screen_w - d->x ? d->w : screen_w - d->x);
+  int h = (d->h < screen_h - d->y ? d->h : screen_h - d->y);
+  int i, j;
+  for (i = 0; i < h; i ++) {
+    uint32_t *row = &vmem[(d->y + i) * screen_w + d->x];
+    if (d->op == BLIT_COPY) paddr_read_host(row, d->src + i * d->pitch * 4, w * 4);
+    else for (j = 0; j < w; j ++) row[j] = d->src;
+  }
+  mmio_set_dirty(VMEM + d->y * ROW_SIZE, h * ROW_SIZE);
+}
+
+static void blit_io_handler(uint32_t offset, int len, bool is_write) {
+  if (!is_write || offset != BLIT_COUNT * 4) return;
+  paddr_t list = blit_base[BLIT_LIST];
+  uint32_t i;
+  for (i = 0; i < blit_base[BLIT_COUNT]; i ++) {
+    BlitDesc d;
+    paddr_read_host(&d, list + i * sizeof(d), sizeof(d));
+    blit(&d);
+  }
+}
+
+void vga_statistic(void) {
+  if (instr_stat.nr == 0) return;
+  double sec = perf_host_us() / 1e6;
+  Log("%ld frames synced (%.1f per second), %ld instructions per frame on average, %ld at most",
+      instr_stat.nr, instr_stat.nr / sec, instr_stat.total / instr_stat.nr, instr_stat.max);
+  if (present_stat.nr == 0) return;
+  Log("%ld frames presented (%.1f FPS), %ld syncs coalesced, %ld us from sync to present on average, %ld us at most",
+      present_stat.nr, present_stat.nr / sec, nr_coalesced, present_stat.total / present_stat.nr, present_stat.max);
+}
+
+void vga_perf(PerfOut *o) {
+  perf_begin(o, "vga");
+  double sec = perf_host_us() / 1e6;
+  perf_u64(o, "synced", instr_stat.nr);
+  perf_u64(o, "presented", present_stat.nr);
+  perf_u64(o, "coalesced", nr_coalesced);
+  perf_double(o, "fps", present_stat.nr / sec);
+  perf_double(o, "avg_frame_instructions", (instr_stat.nr == 0 ? 0 : (double)instr_stat.total / instr_stat.nr));
+  perf_u64(o, "max_frame_instructions", instr_stat.max);
+  perf_double(o, "avg_present_us", (present_stat.nr == 0 ? 0 : (double)present_stat.total / present_stat.nr));
+  perf_u64(o, "max_present_us", present_stat.max);
+  perf_end(o);
+}
+
+void vga_config(bool is_headless, const char *size, const char *dump_file, int every) {
+  headless = is_headless;
+  if (size != NULL) {
+    Assert(sscanf(size, "%dx%d", &screen_w, &screen_h) == 2 &&
+        screen_w > 0 && screen_w < 0x10000 && screen_h > 0 && screen_h < 0x10000,
+        "invalid screen size '%s', should be WxH", size);
+    Assert(VMEM_SIZE <= VMEM_MAX, "the screen %s is too large", size);
+  }
+  if (dump_file != NULL) {
+    Assert(every > 0, "invalid interval of frame dump %d", every);
+    dump_fp = fopen(dump_file, "w");
+    Assert(dump_fp, "Can not open '%s'", dump_file);
+    /* keep the frames dumped when NEMU aborts */
+    setvbuf(dump_fp, NULL, _IOLBF, 0);
+    fprintf(dump_fp, "frame,time_us,hash\n");
+    dump_every = every;
+  }
+}
+
+/* vmem is not in io_space, and it is presented again */
+void vga_snapshot(Snapshot *s) {
+  snapshot_sync(s, "nr_frame", &nr_frame, sizeof(nr_frame));
+  snapshot_sync(s, "vmem", vmem, VMEM_SIZE);
+  if (!snapshot_is_restoring(s) || headless) return;
+  frame_valid = false;
+  update_screen();
+}
+
+void init_vga() {
+  clock_gettime(CLOCK_MONOTONIC, &start_time);
+  if (headless) Log("headless mode, the screen is not presented");
 
   screensize_port_base = (void *)new_space(8);
-  screensize_port_base[0] = ((SCREEN_W) << 16) | (SCREEN_H);
-  add_pio_map("screen", SCREEN_PORT, (void *)screensize_port_base, 8, vga_io_handler);
-  add_mmio_map("screen", SCREEN_MMIO, (void *)screensize_port_base, 8, vga_io_handler);
+  screensize_port_base[0] = (screen_w << 16) | screen_h;
+  map_static_read(add_pio_map("screen", SCREEN_PORT, (void *)screensize_port_base, 8, vga_io_handler), 0, 8);
+  map_static_read(add_mmio_map("screen", SCREEN_MMIO, (void *)screensize_port_base, 8, vga_io_handler), 0, 8);
+
+  blit_base = (void *)new_space(NR_BLIT_REG * 4);
+  map_static_read(add_pio_map("blit", BLIT_PORT, (void *)blit_base, NR_BLIT_REG * 4, blit_io_handler), 0, NR_BLIT_REG * 4);
+  map_static_read(add_mmio_map("blit", BLIT_MMIO, (void *)blit_base, NR_BLIT_REG * 4, blit_io_handler), 0, NR_BLIT_REG * 4);
 
-  vmem = (void *)new_space(0x80000);
-  add_mmio_map("vmem", VMEM, (void *)vmem, 0x80000, NULL);
+  vmem = mmap(NULL, VMEM_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  Assert(vmem != MAP_FAILED, "can not map the framebuffer of %dx%d", screen_w, screen_h);
+  row_dirty = calloc(screen_h, sizeof(row_dirty[0]));
+  add_mmio_map("vmem", VMEM, (void *)vmem, VMEM_SIZE, NULL);
 }
 #endif	/* HAS_IOE */
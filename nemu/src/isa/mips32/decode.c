@@ -48,3 +48,24 @@ make_DHelper(st) {
   decode_addr(NULL);
   decode_op_r(id_dest, decinfo.isa.instr.rt, true);
 }
+
+/* the operands of a branch are read before its delay slot is executed */
+make_DHelper(B) {
+  decode_op_r(id_src, decinfo.isa.instr.rs, true);
+  decode_op_r(id_src2, decinfo.isa.instr.rt, true);
+  decode_op_i(id_dest, cpu.pc + 4 + (decinfo.isa.instr.simm << 2), true);
+
+  print_Dop(id_dest->str, OP_STR_SIZE, "0x%x", id_dest->imm);
+}
+
+make_DHelper(J) {
+  decode_op_i(id_dest, ((cpu.pc + 4) & 0xf0000000) | (decinfo.isa.instr.jmp_target << 2), true);
+
+  print_Dop(id_dest->str, OP_STR_SIZE, "0x%x", id_dest->imm);
+}
+
+make_DHelper(R) {
+  decode_op_r(id_src, decinfo.isa.instr.rs, true);
+  decode_op_r(id_src2, decinfo.isa.instr.rt, true);
+  decode_op_r(id_dest, decinfo.isa.instr.rd, false);
+}
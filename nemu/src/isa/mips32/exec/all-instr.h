@@ -5,5 +5,20 @@ make_EHelper(lui);
 make_EHelper(ld);
 make_EHelper(st);
 
+make_EHelper(beq);
+make_EHelper(bne);
+make_EHelper(blez);
+make_EHelper(bgtz);
+make_EHelper(bltz);
+make_EHelper(bgez);
+make_EHelper(bltzal);
+make_EHelper(bgezal);
+make_EHelper(j);
+make_EHelper(jal);
+make_EHelper(jr);
+make_EHelper(jalr);
+
+make_EHelper(cop0);
+
 make_EHelper(inv);
 make_EHelper(nemu_trap);
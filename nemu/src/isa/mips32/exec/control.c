@@ -1 +1,94 @@
 #include "cpu/exec.h"
+
+void mips32_exec_slot(vaddr_t *pc);
+
+/* The condition and the target of a branch are computed before its delay
+ * slot, which may overwrite the registers they come from and the operands
+ * in `decinfo', so they are kept here. */
+static rtlreg_t br_cond, br_target;
+static const rtlreg_t zero = 0;
+
+static inline void link(int r) {
+  rtl_li(&s0, cpu.pc + 8);
+  rtl_sr(r, &s0, 4);
+}
+
+/* a conditional branch to `id_dest', linking `link_reg' if it is not 0 */
+static inline void branch(vaddr_t *pc, uint32_t relop, const rtlreg_t *src1,
+    const rtlreg_t *src2, int link_reg) {
+  vaddr_t target = id_dest->imm;
+  rtl_setrelop(relop, &br_cond, src1, src2);
+  if (link_reg != 0) link(link_reg);
+  mips32_exec_slot(pc);
+  rtl_jrelop(RELOP_NE, &br_cond, &zero, target);
+}
+
+make_EHelper(beq) {
+  print_asm("beq %s,%s,%s", id_src->str, id_src2->str, id_dest->str);
+  branch(pc, RELOP_EQ, &id_src->val, &id_src2->val, 0);
+}
+
+make_EHelper(bne) {
+  print_asm("bne %s,%s,%s", id_src->str, id_src2->str, id_dest->str);
+  branch(pc, RELOP_NE, &id_src->val, &id_src2->val, 0);
+}
+
+make_EHelper(blez) {
+  print_asm("blez %s,%s", id_src->str, id_dest->str);
+  branch(pc, RELOP_LE, &id_src->val, &zero, 0);
+}
+
+make_EHelper(bgtz) {
+  print_asm("bgtz %s,%s", id_src->str, id_dest->str);
+  branch(pc, RELOP_GT, &id_src->val, &zero, 0);
+}
+
+make_EHelper(bltz) {
+  print_asm("bltz %s,%s", id_src->str, id_dest->str);
+  branch(pc, RELOP_LT, &id_src->val, &zero, 0);
+}
+
+make_EHelper(bgez) {
+  print_asm("bgez %s,%s", id_src->str, id_dest->str);
+  branch(pc, RELOP_GE, &id_src->val, &zero, 0);
+}
+
+make_EHelper(bltzal) {
+  print_asm("bltzal %s,%s", id_src->str, id_dest->str);
+  branch(pc, RELOP_LT, &id_src->val, &zero, 31);
+}
+
+make_EHelper(bgezal) {
+  print_asm("bgezal %s,%s", id_src->str, id_dest->str);
+  branch(pc, RELOP_GE, &id_src->val, &zero, 31);
+}
+
+make_EHelper(j) {
+  vaddr_t target = id_dest->imm;
+  print_asm("j %s", id_dest->str);
+  mips32_exec_slot(pc);
+  rtl_j(target);
+}
+
+make_EHelper(jal) {
+  vaddr_t target = id_dest->imm;
+  print_asm("jal %s", id_dest->str);
+  link(31);
+  mips32_exec_slot(pc);
+  rtl_j(target);
+}
+
+make_EHelper(jr) {
+  print_asm("jr %s", id_src->str);
+  rtl_mv(&br_target, &id_src->val);
+  mips32_exec_slot(pc);
+  rtl_jr(&br_target);
+}
+
+make_EHelper(jalr) {
+  print_asm("jalr %s,%s", id_dest->str, id_src->str);
+  rtl_mv(&br_target, &id_src->val);
+  link(id_dest->reg);
+  mips32_exec_slot(pc);
+  rtl_jr(&br_target);
+}
@@ -1,9 +1,11 @@
 #include "cpu/exec.h"
 #include "all-instr.h"
+#include "cpu/decode-cache.h"
+#include "cpu/threaded.h"
 
 static OpcodeEntry special_table [64] = {
   /* b000 */ EMPTY, EMPTY, EMPTY, EMPTY, EMPTY, EMPTY, EMPTY, EMPTY,
-  /* b001 */ EMPTY, EMPTY, EMPTY, EMPTY, EMPTY, EMPTY, EMPTY, EMPTY,
+  /* b001 */ IDEX(R, jr), IDEX(R, jalr), EMPTY, EMPTY, EMPTY, EMPTY, EMPTY, EMPTY,
   /* b010 */ EMPTY, EMPTY, EMPTY, EMPTY, EMPTY, EMPTY, EMPTY, EMPTY,
   /* b011 */ EMPTY, EMPTY, EMPTY, EMPTY, EMPTY, EMPTY, EMPTY, EMPTY,
   /* b100 */ EMPTY, EMPTY, EMPTY, EMPTY, EMPTY, EMPTY, EMPTY, EMPTY,
@@ -16,19 +18,106 @@ static make_EHelper(special) {
   idex(pc, &special_table[decinfo.isa.instr.func]);
 }
 
+static OpcodeEntry regimm_table [32] = {
+  /* b00 */ IDEX(B, bltz), IDEX(B, bgez), EMPTY, EMPTY, EMPTY, EMPTY, EMPTY, EMPTY,
+  /* b01 */ EMPTY, EMPTY, EMPTY, EMPTY, EMPTY, EMPTY, EMPTY, EMPTY,
+  /* b10 */ IDEX(B, bltzal), IDEX(B, bgezal), EMPTY, EMPTY, EMPTY, EMPTY, EMPTY, EMPTY,
+  /* b11 */ EMPTY, EMPTY, EMPTY, EMPTY, EMPTY, EMPTY, EMPTY, EMPTY,
+};
+
+static make_EHelper(regimm) {
+  idex(pc, &regimm_table[decinfo.isa.instr.rt]);
+}
+
+#define OPCODE_TABLE(_) \
+  /* b000 */ _(0x00, EX(special)) _(0x01, EX(regimm)) _(0x02, IDEX(J, j)) _(0x03, IDEX(J, jal)) \
+             _(0x04, IDEX(B, beq)) _(0x05, IDEX(B, bne)) _(0x06, IDEX(B, blez)) _(0x07, IDEX(B, bgtz)) \
+  /* b001 */ _(0x08, EMPTY) _(0x09, EMPTY) _(0x0a, EMPTY) _(0x0b, EMPTY) \
+             _(0x0c, EMPTY) _(0x0d, EMPTY) _(0x0e, EMPTY) _(0x0f, IDEX(IU, lui)) \
+  /* b010 */ _(0x10, EX(cop0)) _(0x11, EMPTY) _(0x12, EMPTY) _(0x13, EMPTY) \
+             _(0x14, EMPTY) _(0x15, EMPTY) _(0x16, EMPTY) _(0x17, EMPTY) \
+  /* b011 */ _(0x18, EMPTY) _(0x19, EMPTY) _(0x1a, EMPTY) _(0x1b, EMPTY) \
+             _(0x1c, EMPTY) _(0x1d, EMPTY) _(0x1e, EMPTY) _(0x1f, EMPTY) \
+  /* b100 */ _(0x20, EMPTY) _(0x21, EMPTY) _(0x22, EMPTY) _(0x23, IDEXW(ld, ld, 4)) \
+             _(0x24, EMPTY) _(0x25, EMPTY) _(0x26, EMPTY) _(0x27, EMPTY) \
+  /* b101 */ _(0x28, EMPTY) _(0x29, EMPTY) _(0x2a, EMPTY) _(0x2b, IDEXW(st, st, 4)) \
+             _(0x2c, EMPTY) _(0x2d, EMPTY) _(0x2e, EMPTY) _(0x2f, EMPTY) \
+  /* b110 */ _(0x30, EMPTY) _(0x31, EMPTY) _(0x32, EMPTY) _(0x33, EMPTY) \
+             _(0x34, EMPTY) _(0x35, EMPTY) _(0x36, EMPTY) _(0x37, EMPTY) \
+  /* b111 */ _(0x38, EMPTY) _(0x39, EMPTY) _(0x3a, EMPTY) _(0x3b, EMPTY) \
+             _(0x3c, EX(nemu_trap)) _(0x3d, EMPTY) _(0x3e, EMPTY) _(0x3f, EMPTY)
+
 static OpcodeEntry opcode_table [64] = {
-  /* b000 */ EX(special), EMPTY, EMPTY, EMPTY, EMPTY, EMPTY, EMPTY, EMPTY,
-  /* b001 */ EMPTY, EMPTY, EMPTY, EMPTY, EMPTY, EMPTY, EMPTY, IDEX(IU, lui),
-  /* b010 */ EMPTY, EMPTY, EMPTY, EMPTY, EMPTY, EMPTY, EMPTY, EMPTY,
-  /* b011 */ EMPTY, EMPTY, EMPTY, EMPTY, EMPTY, EMPTY, EMPTY, EMPTY,
-  /* b100 */ EMPTY, EMPTY, EMPTY, IDEXW(ld, ld, 4), EMPTY, EMPTY, EMPTY, EMPTY,
-  /* b101 */ EMPTY, EMPTY, EMPTY, IDEXW(st, st, 4), EMPTY, EMPTY, EMPTY, EMPTY,
-  /* b110 */ EMPTY, EMPTY, EMPTY, EMPTY, EMPTY, EMPTY, EMPTY, EMPTY,
-  /* b111 */ EMPTY, EMPTY, EMPTY, EMPTY, EX(nemu_trap), EMPTY, EMPTY, EMPTY,
+  OPCODE_TABLE(OPCODE_ENTRY)
 };
 
-void isa_exec(vaddr_t *pc) {
+/* A branch and its delay slot are fetched, decoded and cached as one
+ * instruction of 8 bytes, so the engines working on blocks or on the
+ * decode cache never see a slot alone. The slot in the next page is
+ * fetched when the branch is executed, since that page may change
+ * without the page of the branch. */
+static inline uint32_t fetch_opcode(vaddr_t *pc) {
   decinfo.isa.instr.val = instr_fetch(pc, 4);
-  decinfo.width = opcode_table[decinfo.isa.instr.opcode].width;
-  idex(pc, &opcode_table[decinfo.isa.instr.opcode]);
+  decinfo.isa.has_slot = mips32_has_delay_slot(decinfo.isa.instr) && (*pc & PAGE_MASK) != 0;
+  if (decinfo.isa.has_slot) decinfo.isa.slot.val = instr_fetch(pc, 4);
+  return decinfo.isa.instr.opcode;
+}
+
+OpcodeEntry* isa_fetch(vaddr_t *pc) {
+  OpcodeEntry *e = &opcode_table[fetch_opcode(pc)];
+  decinfo.width = e->width;
+  return e;
+}
+
+/* Execute the delay slot of the branch at `cpu.pc', after the branch has
+ * read its operands and before it jumps. `cpu.pc' stays at the branch,
+ * so a fault in the slot is reported at the branch and restarts from it,
+ * as the EPC of MIPS with Cause.BD set. */
+bool mips32_in_slot = false;
+
+void mips32_exec_slot(vaddr_t *pc) {
+  mips32_in_slot = true;
+  if (!decinfo.isa.has_slot) decinfo.isa.slot.val = instr_fetch(pc, 4);
+  Instr slot = decinfo.isa.slot;
+  Assert(!mips32_has_delay_slot(slot), "a branch in the delay slot at pc = 0x%08x", cpu.pc);
+
+  decinfo.isa.instr = slot;
+  OpcodeEntry *e = &opcode_table[slot.opcode];
+  decinfo.width = e->width;
+  vaddr_t slot_pc = cpu.pc + 8;
+  print_asm("; ");
+  idex(&slot_pc, e);
+  mips32_in_slot = false;
+}
+
+void isa_exec(vaddr_t *pc) {
+  idex(pc, isa_fetch(pc));
+}
+
+int isa_instr_len(vaddr_t pc) {
+  return 4;
+}
+
+#ifdef DECODE_CACHE
+OpcodeEntry* isa_fuse(DCEntry *a, const DCEntry *b) {
+  return NULL;
+}
+#endif
+
+#ifdef THREADED_ENGINE
+#define THREADED_FETCH() fetch_opcode(&decinfo.seq_pc)
+
+static inline void threaded_idex(const OpcodeEntry *e) {
+  decinfo.width = e->width;
+  idex(&decinfo.seq_pc, (OpcodeEntry *)e);
+}
+
+uint64_t isa_exec_threaded(uint64_t n) {
+  static const void *dispatch[64] = { OPCODE_TABLE(THREADED_LABEL_ADDR) };
+  uint64_t i = 0;
+
+  if (n == 0) return 0;
+  THREADED_GOTO_NEXT();
+  OPCODE_TABLE(THREADED_LABEL)
 }
+#endif
@@ -1 +1,75 @@
 #include "cpu/exec.h"
+#include "all-instr.h"
+#include "monitor/monitor.h"
+
+void mips32_eret(void);
+
+static const char *cp0_name[32] __attribute__((unused)) = {
+  [0] = "index", [1] = "random", [2] = "entrylo0", [3] = "entrylo1", [4] = "context",
+  [5] = "pagemask", [6] = "wired", [8] = "badvaddr", [10] = "entryhi", [12] = "status",
+  [13] = "cause", [14] = "epc",
+};
+
+static rtlreg_t *cp0_reg(int r) {
+  switch (r) {
+    case 0: return &cpu.index;
+    case 1: return &cpu.random;
+    case 2: return &cpu.entrylo0;
+    case 3: return &cpu.entrylo1;
+    case 4: return &cpu.context;
+    case 5: return &cpu.pagemask;
+    case 6: return &cpu.wired;
+    case 8: return &cpu.badvaddr;
+    case 10: return &cpu.entryhi;
+    case 12: return &cpu.status;
+    case 13: return &cpu.cause;
+    case 14: return &cpu.epc;
+    default: panic("CP0 register %d is not supported at pc = 0x%08x", r, cpu.pc);
+  }
+}
+
+/* the index written by tlbwr, which is not below `wired' */
+static inline int tlb_random(void) {
+  uint32_t wired = (cpu.wired < NR_TLB ? cpu.wired : 0);
+  return wired + g_nr_guest_instr % (NR_TLB - wired);
+}
+
+static inline make_EHelper(mfc0) {
+  Instr i = decinfo.isa.instr;
+  if (i.rd == 1) cpu.random = tlb_random();
+  rtl_sr(i.rt, cp0_reg(i.rd), 4);
+
+  print_asm("mfc0 %s,$%s", reg_name(i.rt, 4), cp0_name[i.rd]);
+}
+
+static inline make_EHelper(mtc0) {
+  Instr i = decinfo.isa.instr;
+  rtlreg_t *r = cp0_reg(i.rd);
+  uint32_t val = reg_l(i.rt);
+  switch (i.rd) {
+    case 1: case 8: break;  // read-only
+    case 10: mips32_entryhi_write(val); break;
+    case 12: *r = val; intr_update(); break;
+    default: *r = val; break;
+  }
+
+  print_asm("mtc0 %s,$%s", reg_name(i.rt, 4), cp0_name[i.rd]);
+}
+
+make_EHelper(cop0) {
+  jit_interpret_only();
+  Instr i = decinfo.isa.instr;
+  switch (i.rs) {
+    case 0x00: exec_mfc0(pc); return;
+    case 0x04: exec_mtc0(pc); return;
+    case 0x10:
+      switch (i.func) {
+        case 0x01: mips32_tlbr(); print_asm("tlbr"); return;
+        case 0x02: mips32_tlbw(cpu.index); print_asm("tlbwi"); return;
+        case 0x06: cpu.random = tlb_random(); mips32_tlbw(cpu.random); print_asm("tlbwr"); return;
+        case 0x08: mips32_tlbp(); print_asm("tlbp"); return;
+        case 0x18: mips32_eret(); print_asm("eret"); return;
+      }
+  }
+  exec_inv(pc);
+}
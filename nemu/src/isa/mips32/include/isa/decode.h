@@ -1,6 +1,14 @@
 #ifndef __MIPS32_DECODE_H__
 #define __MIPS32_DECODE_H__
 
+/* the maximum length of an instruction in bytes */
+#define ISA_INSTR_MAX 4
+
+/* the opcode counted by OPCODE_STAT from the bytes `p' of an
+ * instruction: opcode[31:26] */
+#define ISA_NR_OPCODE 64
+#define isa_opcode(p) ((p)[3] >> 2)
+
 typedef union {
   struct {
     int32_t  simm   : 16;
@@ -32,10 +40,27 @@ typedef union {
 
 struct ISADecodeInfo {
   Instr instr;
+  /* the instruction in the delay slot of a branch, fetched with it when
+   * they are in the same page, see exec.c */
+  Instr slot;
+  bool has_slot;
 };
 
+/* the branches and jumps, which have a delay slot */
+static inline bool mips32_has_delay_slot(Instr i) {
+  switch (i.opcode) {
+    case 0x00: return i.func == 0x08 || i.func == 0x09;  // jr, jalr
+    case 0x01: return (i.rt & 0xe) == 0;                 // bltz, bgez, bltzal, bgezal
+    case 0x02: case 0x03: case 0x04: case 0x05: case 0x06: case 0x07: return true;
+    default: return false;
+  }
+}
+
 make_DHelper(IU);
 make_DHelper(ld);
 make_DHelper(st);
+make_DHelper(B);
+make_DHelper(J);
+make_DHelper(R);
 
 #endif
@@ -0,0 +1,47 @@
+#ifndef __MIPS32_MMU_H__
+#define __MIPS32_MMU_H__
+
+#include <stdint.h>
+
+/* the number of entries in the TLB of the guest */
+#define NR_TLB 32
+
+/* kuseg is mapped by the TLB, the other segments are not */
+#define KSEG0 0x80000000u
+
+/* the exception codes in Cause */
+enum { EXC_INT = 0, EXC_MOD = 1, EXC_TLBL = 2, EXC_TLBS = 3, EXC_SYSCALL = 8 };
+
+#define STATUS_IE  0x00000001
+#define STATUS_EXL 0x00000002
+#define CAUSE_BD   0x80000000
+
+typedef union {
+  struct {
+    uint32_t g   : 1;
+    uint32_t v   : 1;
+    uint32_t d   : 1;
+    uint32_t c   : 3;
+    uint32_t pfn : 20;
+    uint32_t pad : 6;
+  };
+  uint32_t val;
+} EntryLo;
+
+typedef union {
+  struct {
+    uint32_t asid : 8;
+    uint32_t pad  : 5;
+    uint32_t vpn2 : 19;
+  };
+  uint32_t val;
+} EntryHi;
+
+/* tlbwi, tlbwr, tlbp and tlbr */
+void mips32_tlbw(int idx);
+void mips32_tlbp(void);
+void mips32_tlbr(void);
+/* called after EntryHi is written, since the ASID may change */
+void mips32_entryhi_write(uint32_t val);
+
+#endif
@@ -2,6 +2,8 @@
 #define __MIPS32_REG_H__
 
 #include "common.h"
+#include <stddef.h>
+#include "isa/mmu.h"
 
 #define PC_START (0x80000000u + IMAGE_START)
 
@@ -10,17 +12,53 @@ typedef struct {
     rtlreg_t _32;
   } gpr[32];
 
+  /* in the order of DIFFTEST_REG_SIZE */
+  rtlreg_t status, lo, hi, badvaddr, cause;
   vaddr_t pc;
 
+  /* where the writes to $0 go, never read, see reg_dest() */
+  rtlreg_t sink;
+
+  /* the other registers of CP0 */
+  rtlreg_t index, random, entrylo0, entrylo1, context, pagemask, wired, entryhi, epc;
+
+  /* the TLB, see mmu.c */
+  struct {
+    rtlreg_t entryhi, entrylo0, entrylo1, pagemask;
+  } tlb[NR_TLB];
+
 } CPU_state;
 
+/* An exception raised in the middle of an instruction aborts it by
+ * longjmp_raise_intr(), see cpu_exec(). */
+#define ISA_LONGJMP_INTR
+void longjmp_raise_intr(uint32_t NO);
+
 static inline int check_reg_index(int index) {
   assert(index >= 0 && index < 32);
   return index;
 }
 
+uint32_t *isa_reg_str2ptr(const char *s);
+/* the return addresses on the stack by the frame pointer, the innermost first */
+int isa_backtrace(vaddr_t *ret, int max);
+/* FT_CALL or FT_RET if the instruction of `len' bytes is a call or a return */
+int isa_ftrace_kind(const uint8_t *instr, int len);
+/* the i-th register in the order of the 'g' packet of GDB, or NULL past the last one */
+uint32_t *isa_gdb_reg(int i);
+
 #define reg_l(index) (cpu.gpr[check_reg_index(index)]._32)
 
+/* The register to write as `index'. The writes to $0 go to `sink', so
+ * cpu.gpr[0] stays 0 and is read as the others, without testing the index
+ * on either side. `sink' is reached by its index from the start of
+ * CPU_state, which is selected by arithmetic instead of a branch. */
+#define SINK_INDEX (offsetof(CPU_state, sink) / sizeof(rtlreg_t))
+static inline int reg_dest_index(int index) {
+  return check_reg_index(index) + (index == 0) * SINK_INDEX;
+}
+#define reg_dest(index) (((rtlreg_t *)&cpu)[reg_dest_index(index)])
+
 static inline const char* reg_name(int index, int width) {
   extern const char* regsl[];
   assert(index >= 0 && index < 32);
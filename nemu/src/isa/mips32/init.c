@@ -16,6 +16,15 @@ static void restart() {
 
   /* The zero register is always 0. */
   cpu.gpr[0]._32 = 0;
+
+  /* Map the TLB entries to different pages of kseg0, which is not
+   * mapped by the TLB, so none of them matches. */
+  int i;
+  for (i = 0; i < NR_TLB; i ++) {
+    cpu.tlb[i].entryhi = KSEG0 + i * 2 * PAGE_SIZE;
+    cpu.tlb[i].entrylo0 = cpu.tlb[i].entrylo1 = cpu.tlb[i].pagemask = 0;
+  }
+  isa_mmu_flush();
 }
 
 void init_isa(void) {
@@ -1,10 +1,38 @@
+#include "cpu/exec.h"
+#include "monitor/monitor.h"
 #include "rtl/rtl.h"
 #include <setjmp.h>
 
+extern bool mips32_in_slot, mips32_tlb_refill;
+
+#define VEC_REFILL  0x80000000u
+#define VEC_GENERAL 0x80000180u
+
 void raise_intr(uint32_t NO, vaddr_t epc) {
-  /* TODO: Trigger an interrupt/exception with ``NO''.
-   * That is, use ``NO'' to index the IDT.
-   */
+  vaddr_t target = VEC_GENERAL;
+  if (!(cpu.status & STATUS_EXL)) {
+    /* `epc' is already the branch when the exception is in its delay slot */
+    cpu.epc = epc;
+    cpu.cause = (mips32_in_slot ? cpu.cause | CAUSE_BD : cpu.cause & ~CAUSE_BD);
+    cpu.status |= STATUS_EXL;
+    if (mips32_tlb_refill) target = VEC_REFILL;
+  }
+  cpu.cause = (cpu.cause & ~0x7c) | (NO << 2);
+  mips32_in_slot = false;
+  mips32_tlb_refill = false;
+
+  rtl_j(target);
+}
+
+void mips32_eret(void) {
+  cpu.status &= ~STATUS_EXL;
+  intr_update();
+  rtl_j(cpu.epc);
+}
+
+/* there is not any interrupt enable bit yet */
+bool isa_intr_enabled(void) {
+  return false;
 }
 
 bool isa_query_intr(void) {
@@ -14,5 +42,9 @@ bool isa_query_intr(void) {
 jmp_buf intr_buf;
 
 void longjmp_raise_intr(uint32_t NO) {
+#ifdef JIT_ENGINE
+  /* the registers cached in the translated code would be lost */
+  panic("exception %d at pc = 0x%08x is not supported by the JIT", NO, cpu.pc);
+#endif
   longjmp(intr_buf, NO + 1);
 }
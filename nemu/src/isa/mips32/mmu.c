@@ -1,7 +1,163 @@
 #include "nemu.h"
+#include "cpu/decode-cache.h"
+#include "monitor/perf.h"
+
+/* The TLB of the guest is in `cpu.tlb', and it is written by tlbwi and
+ * tlbwr. On the host, the entries are also linked into a hash table by
+ * their VPN2 and ASID, so an access to kuseg finds its entry by looking
+ * up at most two buckets: the one of the current ASID, and the one of the
+ * global entries. Only a real miss raises the refill exception of the
+ * guest. The hash table is updated on every write to the TLB, and built
+ * again from `cpu.tlb' by isa_mmu_flush(), e.g. after loading a snapshot.
+ *
+ * Only the pages of 4KB are supported. The PFN is the physical address
+ * of NEMU, which is the same as the address in kseg0. */
+
+#define NR_HASH 64
+#define ASID_GLOBAL 0x100
+
+static int8_t hash_head[NR_HASH];
+static int8_t hash_next[NR_TLB];
+static uint32_t hash_key[NR_TLB];
+
+bool mips32_tlb_refill = false;
+
+static uint64_t nr_tlb_access = 0, nr_tlb_refill = 0, nr_tlb_invalid = 0, nr_tlb_mod = 0;
+static uint64_t nr_tlb_write = 0;
+
+static inline uint32_t tlb_key(uint32_t vpn2, uint32_t asid) {
+  return (vpn2 << 9) | asid;
+}
+
+static inline int hash_idx(uint32_t key) {
+  return (key * 0x9e3779b1u) >> (32 - 6);
+}
+
+static inline uint32_t entry_key(int i) {
+  EntryHi hi = { .val = cpu.tlb[i].entryhi };
+  EntryLo lo0 = { .val = cpu.tlb[i].entrylo0 };
+  return tlb_key(hi.vpn2, lo0.g ? ASID_GLOBAL : hi.asid);
+}
+
+static void hash_link(int i) {
+  uint32_t key = entry_key(i);
+  int h = hash_idx(key);
+  hash_key[i] = key;
+  hash_next[i] = hash_head[h];
+  hash_head[h] = i;
+}
+
+static void hash_unlink(int i) {
+  int8_t *p = &hash_head[hash_idx(hash_key[i])];
+  while (*p != i) {
+    assert(*p != -1);
+    p = &hash_next[*p];
+  }
+  *p = hash_next[i];
+}
+
+static inline int hash_find(uint32_t key) {
+  int i;
+  for (i = hash_head[hash_idx(key)]; i != -1; i = hash_next[i]) {
+    if (hash_key[i] == key) return i;
+  }
+  return -1;
+}
+
+/* the entry mapping `vpn2' in the current ASID, or -1 */
+static inline int tlb_find(uint32_t vpn2) {
+  EntryHi hi = { .val = cpu.entryhi };
+  int i = hash_find(tlb_key(vpn2, hi.asid));
+  return (i != -1 ? i : hash_find(tlb_key(vpn2, ASID_GLOBAL)));
+}
+
+void isa_mmu_flush(void) {
+  memset(hash_head, -1, sizeof(hash_head));
+  int i;
+  for (i = 0; i < NR_TLB; i ++) hash_link(i);
+}
+
+/* pmem is in kseg0, which is never translated, and kuseg is below it */
+bool isa_vm_enabled(void) {
+  return false;
+}
+
+/* the fetches and the decoded instructions are cached by virtual address */
+static inline void fetch_flush(void) {
+  ifetch_flush();
+  dcache_flush();
+}
+
+void mips32_tlbw(int idx) {
+  Assert(idx >= 0 && idx < NR_TLB, "TLB index %d is out of range at pc = 0x%08x", idx, cpu.pc);
+  Assert(cpu.pagemask == 0, "only the pages of 4KB are supported at pc = 0x%08x", cpu.pc);
+  EntryLo lo0 = { .val = cpu.entrylo0 }, lo1 = { .val = cpu.entrylo1 };
+  /* the entry is global only if both pages are */
+  lo0.g = lo1.g = lo0.g & lo1.g;
+
+  hash_unlink(idx);
+  cpu.tlb[idx].entryhi = cpu.entryhi & ~0x1f00;
+  cpu.tlb[idx].entrylo0 = lo0.val;
+  cpu.tlb[idx].entrylo1 = lo1.val;
+  cpu.tlb[idx].pagemask = cpu.pagemask;
+  hash_link(idx);
+
+  nr_tlb_write ++;
+  fetch_flush();
+}
+
+void mips32_tlbp(void) {
+  EntryHi hi = { .val = cpu.entryhi };
+  int i = tlb_find(hi.vpn2);
+  cpu.index = (i == -1 ? 0x80000000u : i);
+}
+
+void mips32_entryhi_write(uint32_t val) {
+  EntryHi old = { .val = cpu.entryhi };
+  cpu.entryhi = val & ~0x1f00;
+  EntryHi new = { .val = cpu.entryhi };
+  if (old.asid != new.asid) fetch_flush();
+}
+
+void mips32_tlbr(void) {
+  int i = cpu.index & (NR_TLB - 1);
+  cpu.entrylo0 = cpu.tlb[i].entrylo0;
+  cpu.entrylo1 = cpu.tlb[i].entrylo1;
+  cpu.pagemask = cpu.tlb[i].pagemask;
+  mips32_entryhi_write(cpu.tlb[i].entryhi);
+}
+
+/* abort the instruction with a TLB exception at `addr' */
+static void tlb_exception(vaddr_t addr, uint32_t code, bool refill) {
+  cpu.badvaddr = addr;
+  cpu.context = (cpu.context & 0xff800000) | ((addr >> 13) << 4);
+  cpu.entryhi = (addr & ~0x1fff) | (cpu.entryhi & 0xff);
+  mips32_tlb_refill = refill;
+  longjmp_raise_intr(code);
+}
+
+static paddr_t tlb_translate(vaddr_t addr, bool is_write) {
+  nr_tlb_access ++;
+  uint32_t code = (is_write ? EXC_TLBS : EXC_TLBL);
+  int i = tlb_find(addr >> 13);
+  if (i == -1) {
+    nr_tlb_refill ++;
+    tlb_exception(addr, code, true);
+  }
+  EntryLo lo = { .val = (addr & PAGE_SIZE) ? cpu.tlb[i].entrylo1 : cpu.tlb[i].entrylo0 };
+  if (!lo.v) {
+    nr_tlb_invalid ++;
+    tlb_exception(addr, code, false);
+  }
+  if (is_write && !lo.d) {
+    nr_tlb_mod ++;
+    tlb_exception(addr, EXC_MOD, false);
+  }
+  return (lo.pfn << 12) | (addr & PAGE_MASK);
+}
 
 static inline paddr_t va2pa(vaddr_t addr, bool write) {
-  return addr;
+  return (addr >= KSEG0 ? addr : tlb_translate(addr, write));
 }
 
 uint32_t isa_vaddr_read(vaddr_t addr, int len) {
@@ -11,3 +167,31 @@ uint32_t isa_vaddr_read(vaddr_t addr, int len) {
 void isa_vaddr_write(vaddr_t addr, uint32_t data, int len) {
   paddr_write(va2pa(addr, true), data, len);
 }
+
+paddr_t isa_fetch_paddr(vaddr_t addr) {
+  return va2pa(addr, false);
+}
+
+/* look up the TLB without raising exceptions */
+paddr_t isa_fetch_probe(vaddr_t addr, bool *success) {
+  *success = true;
+  if (addr >= KSEG0) return addr;
+  int i = tlb_find(addr >> 13);
+  EntryLo lo = { .val = (i == -1 ? 0 :
+      (addr & PAGE_SIZE) ? cpu.tlb[i].entrylo1 : cpu.tlb[i].entrylo0) };
+  if (!lo.v) {
+    *success = false;
+    return 0;
+  }
+  return (lo.pfn << 12) | (addr & PAGE_MASK);
+}
+
+void isa_perf(PerfOut *o) {
+  perf_begin(o, "tlb");
+  perf_u64(o, "access", nr_tlb_access);
+  perf_u64(o, "refill", nr_tlb_refill);
+  perf_u64(o, "invalid", nr_tlb_invalid);
+  perf_u64(o, "modified", nr_tlb_mod);
+  perf_u64(o, "write", nr_tlb_write);
+  perf_end(o);
+}
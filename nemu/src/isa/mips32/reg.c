@@ -1,4 +1,5 @@
 #include "nemu.h"
+#include "monitor/ftrace.h"
 
 const char *regsl[] = {
   "$0", "at", "v0", "v1", "a0", "a1", "a2", "a3",
@@ -13,3 +14,30 @@ void isa_reg_display() {
 uint32_t isa_reg_str2val(const char *s, bool *success) {
   return 0;
 }
+
+uint32_t *isa_reg_str2ptr(const char *s) {
+  return NULL;
+}
+
+/* The offset of the return address in a frame is only known by the code,
+ * so the stack is not walked. */
+int isa_backtrace(vaddr_t *ret, int max) {
+  return 0;
+}
+
+/* jal and jalr are calls, and jr $ra is a return */
+int isa_ftrace_kind(const uint8_t *instr, int len) {
+  if (len < 4) return 0;
+  uint32_t i = instr[0] | (instr[1] << 8) | (instr[2] << 16) | ((uint32_t)instr[3] << 24);
+  uint32_t opcode = i >> 26, funct = i & 0x3f, rs = (i >> 21) & 0x1f;
+  if (opcode == 0x03) return FT_CALL;
+  if (opcode == 0x00 && funct == 0x09) return FT_CALL;
+  if (opcode == 0x00 && funct == 0x08 && rs == 31) return FT_RET;
+  return 0;
+}
+
+/* 32 GPRs, sr, lo, hi, badvaddr, cause, pc, the same as CPU_state */
+uint32_t *isa_gdb_reg(int i) {
+  if (i < 32) return &reg_l(i);
+  return (i < 38 ? &(&cpu.status)[i - 32] : NULL);
+}
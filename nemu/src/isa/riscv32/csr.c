@@ -0,0 +1,48 @@
+#include "nemu.h"
+#include "monitor/monitor.h"
+
+/* The CSRs are kept in a flat array indexed by their numbers, so most of
+ * them are read and written directly. Only the ones with side effects
+ * have a handler for writing, which is found by a byte per CSR. */
+
+typedef void (*CSRHandler)(uint32_t val);
+
+static void mstatus_write(uint32_t val) {
+  cpu.csr[CSR_MSTATUS] = val;
+  /* the interrupts may be enabled */
+  intr_update();
+}
+
+void riscv32_satp_write(uint32_t val);
+
+enum { H_NONE, H_MSTATUS, H_SATP, NR_HANDLER };
+
+static const CSRHandler handlers[NR_HANDLER] = {
+  [H_MSTATUS] = mstatus_write,
+  [H_SATP] = riscv32_satp_write,
+};
+
+static const uint8_t csr_handler[4096] = {
+  [CSR_MSTATUS] = H_MSTATUS,
+  [CSR_SATP] = H_SATP,
+};
+
+uint32_t csr_read(int csr) {
+  return cpu.csr[csr];
+}
+
+void csr_write(int csr, uint32_t val) {
+  /* csr[11:10] == 3 is read-only */
+  Assert((csr >> 10) != 3, "writing the read-only CSR 0x%03x at pc = 0x%08x", csr, cpu.pc);
+  int h = csr_handler[csr];
+  if (h == H_NONE) cpu.csr[csr] = val;
+  else handlers[h](val);
+}
+
+void init_csr(void) {
+  memset(cpu.csr, 0, sizeof(cpu.csr));
+  /* RV32IMAC */
+  cpu.csr[CSR_MISA] = (1u << 30) | (1 << ('I' - 'A')) | (1 << ('M' - 'A')) |
+    (1 << ('A' - 'A')) | (1 << ('C' - 'A'));
+  cpu.csr[CSR_MSTATUS] = MSTATUS_MPP;
+}
@@ -2,7 +2,21 @@
 #include "monitor/diff-test.h"
 
 bool isa_difftest_checkregs(CPU_state *ref_r, vaddr_t pc) {
-  return false;
+  bool ok = true;
+  int i;
+  for (i = 0; i < 32; i ++) {
+    if (ref_r->gpr[i]._32 != reg_l(i)) {
+      printf("%s is different after executing instruction at pc = 0x%08x, "
+          "right = 0x%08x, wrong = 0x%08x\n", reg_name(i, 4), pc, ref_r->gpr[i]._32, reg_l(i));
+      ok = false;
+    }
+  }
+  if (ref_r->pc != cpu.pc) {
+    printf("pc is different after executing instruction at pc = 0x%08x, "
+        "right = 0x%08x, wrong = 0x%08x\n", pc, ref_r->pc, cpu.pc);
+    ok = false;
+  }
+  return ok;
 }
 
 void isa_difftest_attach(void) {
@@ -5,5 +5,11 @@ make_EHelper(lui);
 make_EHelper(ld);
 make_EHelper(st);
 
+make_EHelper(lui_ld);
+make_EHelper(lui_st);
+
 make_EHelper(inv);
 make_EHelper(nemu_trap);
+
+make_EHelper(system);
+make_EHelper(atomic);
@@ -0,0 +1,76 @@
+#include "cpu/exec.h"
+#include "all-instr.h"
+
+/* The A extension. The harts take turns on the host, see cpu/hart.c, so
+ * the read and the write of an AMO are never interleaved with another
+ * hart, and a reservation is only broken by switching to another hart. */
+
+enum {
+  AMO_ADD = 0x00, AMO_SWAP = 0x01, AMO_LR = 0x02, AMO_SC = 0x03, AMO_XOR = 0x04,
+  AMO_OR = 0x08, AMO_AND = 0x0c, AMO_MIN = 0x10, AMO_MAX = 0x14, AMO_MINU = 0x18, AMO_MAXU = 0x1c
+};
+
+static __attribute__((unused)) const char *amo_name[32] = {
+  [AMO_ADD] = "amoadd", [AMO_SWAP] = "amoswap", [AMO_LR] = "lr", [AMO_SC] = "sc",
+  [AMO_XOR] = "amoxor", [AMO_OR] = "amoor", [AMO_AND] = "amoand",
+  [AMO_MIN] = "amomin", [AMO_MAX] = "amomax", [AMO_MINU] = "amominu", [AMO_MAXU] = "amomaxu",
+};
+
+static inline bool amo_valid(int funct5) {
+  switch (funct5) {
+    case AMO_ADD: case AMO_SWAP: case AMO_LR: case AMO_SC: case AMO_XOR:
+    case AMO_OR: case AMO_AND: case AMO_MIN: case AMO_MAX: case AMO_MINU: case AMO_MAXU:
+      return true;
+    default: return false;
+  }
+}
+
+static inline uint32_t amo_compute(int funct5, uint32_t old, uint32_t src) {
+  switch (funct5) {
+    case AMO_ADD:  return old + src;
+    case AMO_SWAP: return src;
+    case AMO_XOR:  return old ^ src;
+    case AMO_OR:   return old | src;
+    case AMO_AND:  return old & src;
+    case AMO_MIN:  return ((int32_t)old < (int32_t)src ? old : src);
+    case AMO_MAX:  return ((int32_t)old > (int32_t)src ? old : src);
+    case AMO_MINU: return (old < src ? old : src);
+    case AMO_MAXU: return (old > src ? old : src);
+    default: assert(0);
+  }
+}
+
+make_EHelper(atomic) {
+  jit_interpret_only();
+  Instr i = decinfo.isa.instr;
+  /* funct7[1:0] are aq and rl, nothing to order between the harts */
+  int funct5 = i.funct7 >> 2;
+  if (i.funct3 != 2 || !amo_valid(funct5) || (funct5 == AMO_LR && i.rs2 != 0)) {
+    exec_inv(pc);
+    return;
+  }
+
+  vaddr_t addr = reg_l(i.rs1);
+  uint32_t src = reg_l(i.rs2);
+  Assert((addr & 0x3) == 0, "misaligned atomic access to 0x%08x at pc = 0x%08x", addr, cpu.pc);
+  switch (funct5) {
+    case AMO_LR:
+      s0 = vaddr_read(addr, 4);
+      cpu.reserve = addr;
+      cpu.reserved = true;
+      break;
+    case AMO_SC:
+      /* 0 for success */
+      s0 = !(cpu.reserved && cpu.reserve == addr);
+      if (s0 == 0) vaddr_write(addr, src, 4);
+      cpu.reserved = false;
+      break;
+    default:
+      s0 = vaddr_read(addr, 4);
+      vaddr_write(addr, amo_compute(funct5, s0, src), 4);
+  }
+  rtl_sr(i.rd, &s0, 4);
+
+  if (funct5 == AMO_LR) print_asm("lr.w %s,(%s)", reg_name(i.rd, 4), reg_name(i.rs1, 4));
+  else print_asm("%s.w %s,%s,(%s)", amo_name[funct5], reg_name(i.rd, 4), reg_name(i.rs2, 4), reg_name(i.rs1, 4));
+}
@@ -1,5 +1,7 @@
 #include "cpu/exec.h"
 #include "all-instr.h"
+#include "cpu/decode-cache.h"
+#include "cpu/threaded.h"
 
 static OpcodeEntry load_table [8] = {
   EMPTY, EMPTY, EXW(ld, 4), EMPTY, EMPTY, EMPTY, EMPTY, EMPTY
@@ -19,15 +21,80 @@ static make_EHelper(store) {
   idex(pc, &store_table[decinfo.isa.instr.funct3]);
 }
 
+#define OPCODE_TABLE(_) \
+  /* b00 */ _(0x00, IDEX(ld, load)) _(0x01, EMPTY) _(0x02, EMPTY) _(0x03, EMPTY) \
+            _(0x04, EMPTY) _(0x05, EMPTY) _(0x06, EMPTY) _(0x07, EMPTY) \
+  /* b01 */ _(0x08, IDEX(st, store)) _(0x09, EMPTY) _(0x0a, EMPTY) _(0x0b, EX(atomic)) \
+            _(0x0c, EMPTY) _(0x0d, IDEX(U, lui)) _(0x0e, EMPTY) _(0x0f, EMPTY) \
+  /* b10 */ _(0x10, EMPTY) _(0x11, EMPTY) _(0x12, EMPTY) _(0x13, EMPTY) \
+            _(0x14, EMPTY) _(0x15, EMPTY) _(0x16, EMPTY) _(0x17, EMPTY) \
+  /* b11 */ _(0x18, EMPTY) _(0x19, EMPTY) _(0x1a, EX(nemu_trap)) _(0x1b, EMPTY) \
+            _(0x1c, EX(system)) _(0x1d, EMPTY) _(0x1e, EMPTY) _(0x1f, EMPTY)
+
 static OpcodeEntry opcode_table [32] = {
-  /* b00 */ IDEX(ld, load), EMPTY, EMPTY, EMPTY, EMPTY, EMPTY, EMPTY, EMPTY,
-  /* b01 */ IDEX(st, store), EMPTY, EMPTY, EMPTY, EMPTY, IDEX(U, lui), EMPTY, EMPTY,
-  /* b10 */ EMPTY, EMPTY, EMPTY, EMPTY, EMPTY, EMPTY, EMPTY, EMPTY,
-  /* b11 */ EMPTY, EMPTY, EX(nemu_trap), EMPTY, EMPTY, EMPTY, EMPTY, EMPTY,
+  OPCODE_TABLE(OPCODE_ENTRY)
 };
 
+/* An instruction of 16 bits is compressed, and it is expanded into the
+ * instruction of 32 bits, see rvc.c. */
+static inline uint32_t fetch_opcode(vaddr_t *pc) {
+  uint32_t instr = instr_fetch(pc, 2);
+  if ((instr & 0x3) == 0x3) instr |= instr_fetch(pc, 2) << 16;
+  else instr = rvc_table[instr];
+  decinfo.isa.instr.val = instr;
+  return decinfo.isa.instr.opcode6_2;
+}
+
+OpcodeEntry* isa_fetch(vaddr_t *pc) {
+  return &opcode_table[fetch_opcode(pc)];
+}
+
 void isa_exec(vaddr_t *pc) {
-  decinfo.isa.instr.val = instr_fetch(pc, 4);
-  assert(decinfo.isa.instr.opcode1_0 == 0x3);
-  idex(pc, &opcode_table[decinfo.isa.instr.opcode6_2]);
+  idex(pc, isa_fetch(pc));
+}
+
+int isa_instr_len(vaddr_t pc) {
+  bool success;
+  paddr_t paddr = isa_fetch_probe(pc, &success);
+  int offset = (success ? pmem_offset(paddr) : -1);
+  if (offset < 0) return 0;
+  return ((pmem[offset] & 0x3) == 0x3 ? 4 : 2);
+}
+
+#ifdef DECODE_CACHE
+/* `lui' followed by a word access based on the register it just set,
+ * i.e. an access to an absolute address */
+static OpcodeEntry lui_ld_entry = EXW(lui_ld, 4);
+static OpcodeEntry lui_st_entry = EXW(lui_st, 4);
+
+OpcodeEntry* isa_fuse(DCEntry *a, const DCEntry *b) {
+  Instr i0 = a->isa.instr, i1 = b->isa.instr;
+  if (i0.opcode6_2 != 0x0d || i0.rd == 0 || i1.rs1 != i0.rd || i1.funct3 != 2) return NULL;
+
+  OpcodeEntry *e;
+  switch (i1.opcode6_2) {
+    case 0x00: e = &lui_ld_entry; break;
+    case 0x08: e = &lui_st_entry; break;
+    default: return NULL;
+  }
+  a->isa.instr2 = i1;
+  return e;
+}
+#endif
+
+#ifdef THREADED_ENGINE
+#define THREADED_FETCH() fetch_opcode(&decinfo.seq_pc)
+
+static inline void threaded_idex(const OpcodeEntry *e) {
+  idex(&decinfo.seq_pc, (OpcodeEntry *)e);
+}
+
+uint64_t isa_exec_threaded(uint64_t n) {
+  static const void *dispatch[32] = { OPCODE_TABLE(THREADED_LABEL_ADDR) };
+  uint64_t i = 0;
+
+  if (n == 0) return 0;
+  THREADED_GOTO_NEXT();
+  OPCODE_TABLE(THREADED_LABEL)
 }
+#endif
@@ -22,3 +22,23 @@ make_EHelper(st) {
     default: assert(0);
   }
 }
+
+/* fused `lui rd, hi; lw rd2, lo(rd)' */
+make_EHelper(lui_ld) {
+  Instr lui = decinfo.isa.instr, ld = decinfo.isa.instr2;
+  rtl_li(&s0, lui.imm31_12 << 12);
+  rtl_sr(lui.rd, &s0, 4);
+  rtl_addi(&s1, &s0, ld.simm11_0);
+  rtl_lm(&s0, &s1, 4);
+  rtl_sr(ld.rd, &s0, 4);
+}
+
+/* fused `lui rd, hi; sw rs2, lo(rd)' */
+make_EHelper(lui_st) {
+  Instr lui = decinfo.isa.instr, st = decinfo.isa.instr2;
+  rtl_li(&s0, lui.imm31_12 << 12);
+  rtl_sr(lui.rd, &s0, 4);
+  rtl_addi(&s1, &s0, (st.simm11_5 << 5) | st.imm4_0);
+  rtl_lr(&s0, st.rs2, 4);
+  rtl_sm(&s1, &s0, 4);
+}
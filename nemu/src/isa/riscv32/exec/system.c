@@ -1 +1,59 @@
 #include "cpu/exec.h"
+#include "all-instr.h"
+
+void raise_intr(uint32_t NO, vaddr_t epc);
+void riscv32_mret(void);
+
+#define EXC_ECALL_M 11
+
+/* csrrw, csrrs, csrrc and their forms with an immediate */
+static inline make_EHelper(csr) {
+  Instr i = decinfo.isa.instr;
+  uint32_t src = (i.funct3 & 0x4 ? i.rs1 : reg_l(i.rs1));
+  s0 = csr_read(i.csr);
+  switch (i.funct3 & 0x3) {
+    case 1: csr_write(i.csr, src); break;
+    /* no write with x0 or 0 */
+    case 2: if (i.rs1 != 0) csr_write(i.csr, s0 | src); break;
+    case 3: if (i.rs1 != 0) csr_write(i.csr, s0 & ~src); break;
+    default: assert(0);
+  }
+  rtl_sr(i.rd, &s0, 4);
+
+  if (i.funct3 & 0x4) print_asm("csrr%ci %s,0x%03x,%d", " wsc"[i.funct3 & 0x3], reg_name(i.rd, 4), i.csr, i.rs1);
+  else print_asm("csrr%c %s,0x%03x,%s", " wsc"[i.funct3 & 0x3], reg_name(i.rd, 4), i.csr, reg_name(i.rs1, 4));
+}
+
+/* sfence.vma rs1, rs2: the register x0 selects all the addresses or ASIDs */
+static inline make_EHelper(sfence_vma) {
+  Instr i = decinfo.isa.instr;
+  int64_t addr = (i.rs1 == 0 ? -1 : reg_l(i.rs1));
+  int asid = (i.rs2 == 0 ? -1 : reg_l(i.rs2) & 0x1ff);
+  riscv32_sfence_vma(addr, asid);
+
+  print_asm("sfence.vma %s,%s", reg_name(i.rs1, 4), reg_name(i.rs2, 4));
+}
+
+make_EHelper(system) {
+  jit_interpret_only();
+  Instr i = decinfo.isa.instr;
+  if (i.funct3 != 0 && i.funct3 != 4) {
+    exec_csr(pc);
+    return;
+  }
+  if (i.funct3 == 0 && i.rd == 0 && i.funct7 == 0x09) {
+    exec_sfence_vma(pc);
+    return;
+  }
+  switch (i.val) {
+    case 0x00000073:
+      raise_intr(EXC_ECALL_M, cpu.pc);
+      print_asm("ecall");
+      break;
+    case 0x30200073:
+      riscv32_mret();
+      print_asm("mret");
+      break;
+    default: exec_inv(pc);
+  }
+}
@@ -0,0 +1,24 @@
+#include "nemu.h"
+#include "cpu/decode-cache.h"
+#include "monitor/monitor.h"
+
+/* Every hart starts from PC_START, and is told from the others by
+ * mhartid. */
+void isa_hart_init(int id) {
+  cpu.csr[CSR_MHARTID] = id;
+  cpu.reserved = false;
+}
+
+/* The other harts may have written to the reservation since this one
+ * stopped, so it is dropped. The TLB and the fetches cached for the
+ * previous hart are kept if this one is in the same address space. */
+void isa_hart_switch(const CPU_state *prev) {
+  cpu.reserved = false;
+  if (prev->csr[CSR_SATP] != cpu.csr[CSR_SATP]) {
+    isa_mmu_flush();
+    ifetch_flush();
+    dcache_flush();
+  }
+  /* the interrupts may be enabled in this one */
+  intr_update();
+}
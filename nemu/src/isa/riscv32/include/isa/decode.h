@@ -1,6 +1,14 @@
 #ifndef __RISCV32_DECODE_H__
 #define __RISCV32_DECODE_H__
 
+/* the maximum length of an instruction in bytes */
+#define ISA_INSTR_MAX 4
+
+/* the opcode counted by OPCODE_STAT from the bytes `p' of an
+ * instruction: opcode[6:2] */
+#define ISA_NR_OPCODE 32
+#define isa_opcode(p) (((p)[0] >> 2) & 0x1f)
+
 typedef union {
   struct {
     uint32_t opcode1_0 : 2;
@@ -48,8 +56,15 @@ typedef union {
 } Instr;
 
 
+/* The 32-bit instructions expanded from the compressed ones, indexed by
+ * the 16 bits, see rvc.c. The opcode of RVC_ILLEGAL is not in the
+ * opcode table, so it is executed as an invalid instruction. */
+#define RVC_ILLEGAL 0xffffffffu
+extern uint32_t rvc_table[1 << 16];
+
 struct ISADecodeInfo {
   Instr instr;
+  Instr instr2;  // the second instruction of a fused pair, see isa_fuse()
 };
 
 make_DHelper(U);
@@ -0,0 +1,39 @@
+#ifndef __RISCV32_MMU_H__
+#define __RISCV32_MMU_H__
+
+#include <stdint.h>
+
+/* the Supervisor Address Translation and Protection register */
+typedef union {
+  struct {
+    uint32_t ppn  : 22;
+    uint32_t asid : 9;
+    uint32_t mode : 1;  // 1 for Sv32
+  };
+  uint32_t val;
+} SATP;
+
+/* the page table entry of Sv32 */
+typedef union {
+  struct {
+    uint32_t v    : 1;
+    uint32_t r    : 1;
+    uint32_t w    : 1;
+    uint32_t x    : 1;
+    uint32_t u    : 1;
+    uint32_t g    : 1;
+    uint32_t a    : 1;
+    uint32_t d    : 1;
+    uint32_t rsw  : 2;
+    uint32_t ppn0 : 10;
+    uint32_t ppn1 : 12;
+  };
+  uint32_t val;
+} PTE;
+
+/* Write `satp'. The translation cached for another ASID is kept. */
+void riscv32_satp_write(uint32_t val);
+/* sfence.vma, with `addr' or `asid' of -1 for all of them */
+void riscv32_sfence_vma(int64_t addr, int asid);
+
+#endif
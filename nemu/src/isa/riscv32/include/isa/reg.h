@@ -2,6 +2,8 @@
 #define __RISCV32_REG_H__
 
 #include "common.h"
+#include <stddef.h>
+#include "isa/mmu.h"
 
 #define PC_START (0x80000000u + IMAGE_START)
 
@@ -12,8 +14,32 @@ typedef struct {
 
   vaddr_t pc;
 
+  /* where the writes to $0 go, never read, see reg_dest() */
+  rtlreg_t sink;
+
+  /* the reservation of lr.w, see exec/atomic.c */
+  vaddr_t reserve;
+  bool reserved;
+
+  /* the CSRs indexed by their numbers, see csr.c */
+  rtlreg_t csr[4096];
+
 } CPU_state;
 
+enum {
+  CSR_SATP = 0x180,
+  CSR_MSTATUS = 0x300, CSR_MISA = 0x301, CSR_MIE = 0x304, CSR_MTVEC = 0x305,
+  CSR_MSCRATCH = 0x340, CSR_MEPC = 0x341, CSR_MCAUSE = 0x342, CSR_MTVAL = 0x343, CSR_MIP = 0x344,
+  CSR_MHARTID = 0xf14,
+};
+
+/* Several harts can run, each with its ID in mhartid, see cpu/hart.c. */
+#define ISA_SMP
+
+#define MSTATUS_MIE  0x00000008
+#define MSTATUS_MPIE 0x00000080
+#define MSTATUS_MPP  0x00001800
+
 static inline int check_reg_index(int index) {
   assert(index >= 0 && index < 32);
   return index;
@@ -22,9 +48,30 @@ static inline int check_reg_index(int index) {
 void isa_reg_display();
 
 uint32_t isa_reg_str2val(const char *s, bool *success);
+uint32_t *isa_reg_str2ptr(const char *s);
+/* the return addresses on the stack by the frame pointer, the innermost first */
+int isa_backtrace(vaddr_t *ret, int max);
+/* FT_CALL or FT_RET if the instruction of `len' bytes is a call or a return */
+int isa_ftrace_kind(const uint8_t *instr, int len);
+/* the i-th register in the order of the 'g' packet of GDB, or NULL past the last one */
+uint32_t *isa_gdb_reg(int i);
+
+/* CSR accesses with their side effects */
+uint32_t csr_read(int csr);
+void csr_write(int csr, uint32_t val);
 
 #define reg_l(index) (cpu.gpr[check_reg_index(index)]._32)
 
+/* The register to write as `index'. The writes to $0 go to `sink', so
+ * cpu.gpr[0] stays 0 and is read as the others, without testing the index
+ * on either side. `sink' is reached by its index from the start of
+ * CPU_state, which is selected by arithmetic instead of a branch. */
+#define SINK_INDEX (offsetof(CPU_state, sink) / sizeof(rtlreg_t))
+static inline int reg_dest_index(int index) {
+  return check_reg_index(index) + (index == 0) * SINK_INDEX;
+}
+#define reg_dest(index) (((rtlreg_t *)&cpu)[reg_dest_index(index)])
+
 static inline const char* reg_name(int index, int width) {
   extern const char* regsl[];
   assert(index >= 0 && index < 32);
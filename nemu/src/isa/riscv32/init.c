@@ -16,12 +16,19 @@ static void restart() {
 
   /* The zero register is always 0. */
   cpu.gpr[0]._32 = 0;
+
+  void init_csr(void);
+  init_csr();
 }
 
 void init_isa(void) {
   /* Setup physical memory address space. */
   register_pmem(0x80000000u);
 
+  /* Expand the compressed instructions. */
+  void init_rvc(void);
+  init_rvc();
+
   /* Initialize this virtual computer system. */
   restart();
 }
@@ -1,11 +1,46 @@
+#include "cpu/exec.h"
+#include "monitor/monitor.h"
 #include "rtl/rtl.h"
 
+/* Trap into the machine mode: everything is read from and written to the
+ * array of CSRs, without going through csr_write(). */
 void raise_intr(uint32_t NO, vaddr_t epc) {
-  /* TODO: Trigger an interrupt/exception with ``NO''.
-   * That is, use ``NO'' to index the IDT.
-   */
+  rtlreg_t *csr = cpu.csr;
+  uint32_t mstatus = csr[CSR_MSTATUS];
+  csr[CSR_MEPC] = epc;
+  csr[CSR_MCAUSE] = NO;
+  mstatus = (mstatus & ~(MSTATUS_MIE | MSTATUS_MPIE)) | MSTATUS_MPP |
+    ((mstatus & MSTATUS_MIE) ? MSTATUS_MPIE : 0);
+  csr[CSR_MSTATUS] = mstatus;
+
+  vaddr_t mtvec = csr[CSR_MTVEC];
+  vaddr_t target = mtvec & ~0x3;
+  /* the vectored mode for interrupts */
+  if ((mtvec & 0x1) && (int32_t)NO < 0) target += (NO & 0x7fffffff) * 4;
+  rtl_j(target);
+}
+
+/* mret, the mode is always the machine mode */
+void riscv32_mret(void) {
+  rtlreg_t *csr = cpu.csr;
+  uint32_t mstatus = csr[CSR_MSTATUS];
+  mstatus = (mstatus & ~MSTATUS_MIE) | MSTATUS_MPIE |
+    ((mstatus & MSTATUS_MPIE) ? MSTATUS_MIE : 0);
+  csr[CSR_MSTATUS] = mstatus;
+  intr_update();
+  rtl_j(csr[CSR_MEPC]);
+}
+
+#define IRQ_TIMER 0x80000007
+
+bool isa_intr_enabled(void) {
+  return cpu.csr[CSR_MSTATUS] & MSTATUS_MIE;
 }
 
 bool isa_query_intr(void) {
-  return false;
+  if (!isa_intr_enabled()) return false;
+  raise_intr(IRQ_TIMER, cpu.pc);
+  /* between instructions, so the jump is taken here */
+  update_pc();
+  return true;
 }
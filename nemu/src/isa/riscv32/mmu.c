@@ -1,9 +1,254 @@
 #include "nemu.h"
+#include "cpu/decode-cache.h"
+#include "memory/cache.h"
+#include "memory/heatmap.h"
+#include "monitor/perf.h"
+
+/* Sv32 with a direct-mapped software TLB from virtual pages to pages of
+ * pmem, in the same way as x86. There are separate entries for reading,
+ * writing and fetching, so a write only hits on a page whose dirty bit is
+ * already set. Pages outside pmem are never cached.
+ *
+ * Each entry is tagged by the ASID of `satp' when it is filled, and only
+ * hits with the same ASID unless the page is global. So switching to
+ * another address space with its own ASID keeps the entries of the others.
+ * `sfence.vma' only drops the entries it names. Since the kernels which do
+ * not use ASIDs switch the page table without `sfence.vma', a new page
+ * table with the same ASID drops the entries of that ASID as well.
+ */
+
+#define NR_TLB 256
+#define NR_VPN0 1024
+#define SATP_SV32 1
+
+enum { TLB_READ, TLB_WRITE, TLB_FETCH, NR_TLB_TYPE };
+
+typedef struct {
+  vaddr_t vpn;
+  paddr_t ppn;
+  uint8_t *host;  // the page in pmem
+  uint16_t asid;
+  bool global;
+} TLBEntry;
+
+static TLBEntry tlb[NR_TLB_TYPE][NR_TLB];
+static uint64_t nr_tlb_access = 0, nr_tlb_miss = 0;
+static uint64_t nr_satp_write = 0, nr_sfence = 0, nr_tlb_drop = 0;
+
+static inline SATP satp(void) {
+  return (SATP) { .val = cpu.csr[CSR_SATP] };
+}
+
+static inline bool vm_enabled(void) {
+  return satp().mode == SATP_SV32;
+}
+
+static inline bool tlb_hit(TLBEntry *e, vaddr_t vpn) {
+  return e->vpn == vpn && (e->global || e->asid == satp().asid);
+}
+
+/* Drop the entries of `vpn' (or -1 for all) in `asid' (or -1 for all).
+ * The global entries are kept when an ASID is given. */
+static void tlb_drop(vaddr_t vpn, int asid) {
+  int t, i;
+  for (t = 0; t < NR_TLB_TYPE; t ++) {
+    for (i = 0; i < NR_TLB; i ++) {
+      TLBEntry *e = &tlb[t][i];
+      if (e->vpn == (vaddr_t)-1) continue;
+      if (vpn != (vaddr_t)-1 && e->vpn != vpn) continue;
+      if (asid != -1 && (e->global || e->asid != asid)) continue;
+      e->vpn = -1;
+      nr_tlb_drop ++;
+    }
+  }
+}
+
+void isa_mmu_flush(void) {
+  memset(tlb, 0xff, sizeof(tlb));
+}
+
+bool isa_vm_enabled(void) {
+  return vm_enabled();
+}
+
+/* the fetches and the decoded instructions are cached by virtual address */
+static inline void fetch_flush(void) {
+  ifetch_flush();
+  dcache_flush();
+}
+
+void riscv32_satp_write(uint32_t val) {
+  SATP old = satp(), new = { .val = val };
+  cpu.csr[CSR_SATP] = val;
+  if (old.val == val) return;
+  nr_satp_write ++;
+  if (old.mode != new.mode) isa_mmu_flush();
+  else if (old.asid == new.asid) tlb_drop(-1, new.asid);
+  fetch_flush();
+}
+
+void riscv32_sfence_vma(int64_t addr, int asid) {
+  nr_sfence ++;
+  tlb_drop(addr == -1 ? (vaddr_t)-1 : (vaddr_t)addr / PAGE_SIZE, asid);
+  fetch_flush();
+}
+
+static inline paddr_t pte_page(PTE pte) {
+  /* the physical address of Sv32 has 34 bits */
+  Assert(pte.ppn1 < 0x400, "physical page 0x%x is beyond 4GB at pc = 0x%08x",
+      (pte.ppn1 << 10) | pte.ppn0, cpu.pc);
+  return (pte.ppn1 << 22) | (pte.ppn0 << 12);
+}
+
+static inline bool pte_is_leaf(PTE pte) {
+  return pte.r || pte.x;
+}
+
+static paddr_t page_walk(vaddr_t addr, int type, bool *global) {
+  paddr_t pte_addr = (satp().ppn << 12) | ((addr >> 22) << 2);
+  PTE pte = { .val = paddr_read(pte_addr, 4) };
+  Assert(pte.v && !(pte.w && !pte.r), "level 1 page table entry of vaddr 0x%08x is invalid at pc = 0x%08x", addr, cpu.pc);
+
+  bool super = pte_is_leaf(pte);
+  *global = pte.g;
+  if (!super) {
+    pte_addr = pte_page(pte) | (((addr >> 12) & (NR_VPN0 - 1)) << 2);
+    pte.val = paddr_read(pte_addr, 4);
+    Assert(pte.v && !(pte.w && !pte.r) && pte_is_leaf(pte),
+        "level 0 page table entry of vaddr 0x%08x is invalid at pc = 0x%08x", addr, cpu.pc);
+    *global |= pte.g;
+  }
+  else {
+    Assert(pte.ppn0 == 0, "superpage of vaddr 0x%08x is misaligned at pc = 0x%08x", addr, cpu.pc);
+  }
+
+  switch (type) {
+    case TLB_READ:  Assert(pte.r, "reading vaddr 0x%08x is not permitted at pc = 0x%08x", addr, cpu.pc); break;
+    case TLB_WRITE: Assert(pte.w, "writing vaddr 0x%08x is not permitted at pc = 0x%08x", addr, cpu.pc); break;
+    default:        Assert(pte.x, "fetching vaddr 0x%08x is not permitted at pc = 0x%08x", addr, cpu.pc); break;
+  }
+
+  bool is_write = (type == TLB_WRITE);
+  if (!pte.a || (is_write && !pte.d)) {
+    pte.a = 1;
+    pte.d |= is_write;
+    paddr_write(pte_addr, pte.val, 4);
+  }
+
+  paddr_t page = pte_page(pte);
+  if (super) page |= addr & ((NR_VPN0 - 1) << 12);
+  return page;
+}
+
+/* Return the TLB entry of `addr' for accessing with `type'. */
+static inline TLBEntry* tlb_lookup(vaddr_t addr, int type) {
+  vaddr_t vpn = addr / PAGE_SIZE;
+  TLBEntry *e = &tlb[type][vpn % NR_TLB];
+  nr_tlb_access ++;
+  if (!tlb_hit(e, vpn)) {
+    nr_tlb_miss ++;
+    bool global;
+    paddr_t ppn = page_walk(addr, type, &global);
+    int offset = pmem_offset(ppn);
+    e->vpn = vpn;
+    e->ppn = ppn;
+    e->asid = satp().asid;
+    e->global = global;
+    /* the walk is done again for each access outside pmem */
+    if (offset < 0) e->vpn = -1;
+    e->host = (offset < 0 ? NULL : pmem + offset);
+  }
+  return e;
+}
+
+static inline paddr_t page_translate(vaddr_t addr, int type) {
+  return tlb_lookup(addr, type)->ppn | (addr & PAGE_MASK);
+}
+
+static inline bool cross_page(vaddr_t addr, int len) {
+  return (addr & PAGE_MASK) + len > PAGE_SIZE;
+}
 
 uint32_t isa_vaddr_read(vaddr_t addr, int len) {
-  return paddr_read(addr, len);
+  if (!vm_enabled()) return paddr_read(addr, len);
+
+  if (cross_page(addr, len)) {
+    /* read the two parts separately */
+    int len1 = PAGE_SIZE - (addr & PAGE_MASK);
+    uint32_t lo = isa_vaddr_read(addr, len1);
+    uint32_t hi = isa_vaddr_read(addr + len1, len - len1);
+    return lo | (hi << (len1 * 8));
+  }
+
+  TLBEntry *e = tlb_lookup(addr, TLB_READ);
+  if (e->vpn == addr / PAGE_SIZE) {
+    cache_access(e->ppn | (addr & PAGE_MASK), len, CACHE_READ);
+    heatmap_count(e->host - pmem, HEAT_READ);
+    return host_read(e->host + (addr & PAGE_MASK), len);
+  }
+  return paddr_read(e->ppn | (addr & PAGE_MASK), len);
 }
 
 void isa_vaddr_write(vaddr_t addr, uint32_t data, int len) {
-  paddr_write(addr, data, len);
+  if (!vm_enabled()) {
+    paddr_write(addr, data, len);
+    return;
+  }
+
+  if (cross_page(addr, len)) {
+    int len1 = PAGE_SIZE - (addr & PAGE_MASK);
+    isa_vaddr_write(addr, data, len1);
+    isa_vaddr_write(addr + len1, data >> (len1 * 8), len - len1);
+    return;
+  }
+
+  TLBEntry *e = tlb_lookup(addr, TLB_WRITE);
+  if (e->vpn == addr / PAGE_SIZE) {
+    host_write(e->host + (addr & PAGE_MASK), data, len);
+    pmem_after_write(e->host - pmem + (addr & PAGE_MASK), len);
+    return;
+  }
+  paddr_write(e->ppn | (addr & PAGE_MASK), data, len);
+}
+
+paddr_t isa_fetch_paddr(vaddr_t addr) {
+  if (!vm_enabled()) return addr;
+  return page_translate(addr, TLB_FETCH);
+}
+
+/* read a page table entry, 0 (invalid) if it is not in pmem */
+static inline PTE probe_entry(paddr_t addr) {
+  int offset = pmem_offset(addr);
+  return (PTE) { .val = (offset < 0 ? 0 : host_read(pmem + offset, 4)) };
+}
+
+/* walk the page table without the TLB and the accessed bits */
+paddr_t isa_fetch_probe(vaddr_t addr, bool *success) {
+  *success = true;
+  if (!vm_enabled()) return addr;
+
+  PTE pte = probe_entry((satp().ppn << 12) | ((addr >> 22) << 2));
+  bool super = pte.v && pte_is_leaf(pte);
+  if (pte.v && !super && pte.ppn1 < 0x400) {
+    pte = probe_entry(pte_page(pte) | (((addr >> 12) & (NR_VPN0 - 1)) << 2));
+  }
+  if (!pte.v || !pte.x || pte.ppn1 >= 0x400 || (super && pte.ppn0 != 0)) {
+    *success = false;
+    return 0;
+  }
+  paddr_t page = pte_page(pte);
+  if (super) page |= addr & ((NR_VPN0 - 1) << 12);
+  return page | (addr & PAGE_MASK);
+}
+
+void isa_perf(PerfOut *o) {
+  perf_begin(o, "tlb");
+  perf_u64(o, "access", nr_tlb_access);
+  perf_u64(o, "miss", nr_tlb_miss);
+  perf_double(o, "hit_rate", nr_tlb_access == 0 ? 0.0 :
+      1.0 - (double)nr_tlb_miss / nr_tlb_access);
+  perf_u64(o, "satp_write", nr_satp_write);
+  perf_u64(o, "sfence", nr_sfence);
+  perf_u64(o, "drop", nr_tlb_drop);
+  perf_end(o);
 }
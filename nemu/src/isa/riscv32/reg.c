@@ -1,4 +1,6 @@
 #include "nemu.h"
+#include "monitor/ftrace.h"
+#include "cpu/decode.h"
 
 const char *regsl[] = {
   "$0", "ra", "sp", "gp", "tp", "t0", "t1", "t2",
@@ -14,16 +16,65 @@ void isa_reg_display() {
   printf("pc\t0x%x\n", cpu.pc);
 }
 
-uint32_t isa_reg_str2val(const char *s, bool *success) {
+/* the register named `s', or NULL if there is not such one */
+uint32_t *isa_reg_str2ptr(const char *s) {
   assert(s != NULL);
   if (strcmp(s, "pc") == 0) {
-    return cpu.pc;
+    return &cpu.pc;
   }
   for (int i = 0; i < 32; ++i) {
     if (strcmp(reg_name(i, -1), s) == 0) {
-      return reg_l(i);
+      return &reg_l(i);
     }
   }
-  *success = false;
+  return NULL;
+}
+
+uint32_t isa_reg_str2val(const char *s, bool *success) {
+  uint32_t *p = isa_reg_str2ptr(s);
+  if (p == NULL) {
+    *success = false;
+    return 0;
+  }
+  return *p;
+}
+
+/* With the frame pointer, s0 points to the top of the frame, below which
+ * are the return address and the frame pointer of the caller. */
+int isa_backtrace(vaddr_t *ret, int max) {
+  vaddr_t fp = reg_l(8);
+  int n = 0;
+  while (n < max) {
+    uint32_t ra, prev;
+    if (!vaddr_probe_word(fp - 4, &ra) || !vaddr_probe_word(fp - 8, &prev)) break;
+    ret[n ++] = ra;
+    /* the stack grows downwards */
+    if (prev <= fp) break;
+    fp = prev;
+  }
+  return n;
+}
+
+/* jal and jalr linking ra or t0 are calls, and jalr to them without
+ * linking is a return */
+int isa_ftrace_kind(const uint8_t *instr, int len) {
+  if (len < 2) return 0;
+  uint32_t i = instr[0] | (instr[1] << 8);
+  if ((i & 0x3) != 0x3) i = rvc_table[i];
+  else if (len < 4) return 0;
+  else i |= (instr[2] << 16) | ((uint32_t)instr[3] << 24);
+  uint32_t opcode = i & 0x7f, rd = (i >> 7) & 0x1f, rs1 = (i >> 15) & 0x1f;
+  bool rd_link = (rd == 1 || rd == 5), rs1_link = (rs1 == 1 || rs1 == 5);
+  if (opcode == 0x6f) return (rd_link ? FT_CALL : 0);
+  if (opcode == 0x67) {
+    if (rd_link) return FT_CALL;
+    if (rd == 0 && rs1_link) return FT_RET;
+  }
   return 0;
 }
+
+/* x0-x31, pc */
+uint32_t *isa_gdb_reg(int i) {
+  if (i < 32) return &reg_l(i);
+  return (i == 32 ? &cpu.pc : NULL);
+}
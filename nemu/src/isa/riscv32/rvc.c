@@ -0,0 +1,145 @@
+#include "nemu.h"
+#include "cpu/decode.h"
+
+/* The compressed instructions (RVC) are expanded into the 32-bit
+ * instructions with the same effect, so they are decoded and executed by
+ * the helpers of those. The expansions of all the 16-bit encodings are
+ * computed by init_rvc(), so fetching one is a lookup. An encoding which
+ * is illegal in RV32C, or only used by the F and D extensions, expands to
+ * RVC_ILLEGAL, whose opcode is not in the opcode table. */
+
+uint32_t rvc_table[1 << 16];
+
+#define BITS(c, hi, lo) (((c) >> (lo)) & ((1u << ((hi) - (lo) + 1)) - 1))
+/* sign-extend the lowest `n' bits */
+#define SEXT(x, n) ((int32_t)((uint32_t)(x) << (32 - (n))) >> (32 - (n)))
+
+enum {
+  OP_LOAD = 0x03, OP_IMM = 0x13, OP_STORE = 0x23, OP_OP = 0x33, OP_LUI = 0x37,
+  OP_BRANCH = 0x63, OP_JALR = 0x67, OP_JAL = 0x6f
+};
+
+static inline uint32_t enc_r(int funct7, int rs2, int rs1, int funct3, int rd, int opcode) {
+  return (funct7 << 25) | (rs2 << 20) | (rs1 << 15) | (funct3 << 12) | (rd << 7) | opcode;
+}
+
+static inline uint32_t enc_i(int32_t imm, int rs1, int funct3, int rd, int opcode) {
+  return ((imm & 0xfff) << 20) | (rs1 << 15) | (funct3 << 12) | (rd << 7) | opcode;
+}
+
+static inline uint32_t enc_s(int32_t imm, int rs2, int rs1, int funct3) {
+  return (BITS(imm, 11, 5) << 25) | (rs2 << 20) | (rs1 << 15) | (funct3 << 12) |
+    (BITS(imm, 4, 0) << 7) | OP_STORE;
+}
+
+static inline uint32_t enc_b(int32_t imm, int rs2, int rs1, int funct3) {
+  return (BITS(imm, 12, 12) << 31) | (BITS(imm, 10, 5) << 25) | (rs2 << 20) | (rs1 << 15) |
+    (funct3 << 12) | (BITS(imm, 4, 1) << 8) | (BITS(imm, 11, 11) << 7) | OP_BRANCH;
+}
+
+static inline uint32_t enc_j(int32_t imm, int rd) {
+  return (BITS(imm, 20, 20) << 31) | (BITS(imm, 10, 1) << 21) | (BITS(imm, 11, 11) << 20) |
+    (BITS(imm, 19, 12) << 12) | (rd << 7) | OP_JAL;
+}
+
+/* the offset of c.j and c.jal */
+static inline int32_t cj_imm(uint32_t c) {
+  return SEXT((BITS(c, 12, 12) << 11) | (BITS(c, 11, 11) << 4) | (BITS(c, 10, 9) << 8) |
+      (BITS(c, 8, 8) << 10) | (BITS(c, 7, 7) << 6) | (BITS(c, 6, 6) << 7) |
+      (BITS(c, 5, 3) << 1) | (BITS(c, 2, 2) << 5), 12);
+}
+
+static uint32_t rvc_expand(uint32_t c) {
+  int funct3 = BITS(c, 15, 13);
+  int rd = BITS(c, 11, 7), rs2 = BITS(c, 6, 2);
+  /* the registers x8-x15 of the 3-bit fields */
+  int rd_ = 8 + BITS(c, 4, 2), rs1_ = 8 + BITS(c, 9, 7);
+  int32_t imm6 = SEXT((BITS(c, 12, 12) << 5) | BITS(c, 6, 2), 6);
+
+  switch (BITS(c, 1, 0)) {
+    case 0:
+      switch (funct3) {
+        case 0: {  // c.addi4spn
+          uint32_t imm = (BITS(c, 12, 11) << 4) | (BITS(c, 10, 7) << 6) |
+            (BITS(c, 6, 6) << 2) | (BITS(c, 5, 5) << 3);
+          return (imm == 0 ? RVC_ILLEGAL : enc_i(imm, 2, 0, rd_, OP_IMM));
+        }
+        case 2:    // c.lw
+        case 6: {  // c.sw
+          uint32_t imm = (BITS(c, 12, 10) << 3) | (BITS(c, 6, 6) << 2) | (BITS(c, 5, 5) << 6);
+          return (funct3 == 2 ? enc_i(imm, rs1_, 2, rd_, OP_LOAD) : enc_s(imm, rd_, rs1_, 2));
+        }
+        default: return RVC_ILLEGAL;
+      }
+
+    case 1:
+      switch (funct3) {
+        case 0: return enc_i(imm6, rd, 0, rd, OP_IMM);  // c.addi
+        case 1: return enc_j(cj_imm(c), 1);             // c.jal
+        case 2: return enc_i(imm6, 0, 0, rd, OP_IMM);   // c.li
+        case 3:
+          if (rd == 2) {  // c.addi16sp
+            int32_t imm = SEXT((BITS(c, 12, 12) << 9) | (BITS(c, 6, 6) << 4) | (BITS(c, 5, 5) << 6) |
+                (BITS(c, 4, 3) << 7) | (BITS(c, 2, 2) << 5), 10);
+            return (imm == 0 ? RVC_ILLEGAL : enc_i(imm, 2, 0, 2, OP_IMM));
+          }
+          /* c.lui */
+          return (imm6 == 0 ? RVC_ILLEGAL : ((uint32_t)imm6 << 12) | (rd << 7) | OP_LUI);
+        case 4: {
+          int rs1 = rs1_;
+          switch (BITS(c, 11, 10)) {
+            case 0:  // c.srli, shamt[5] must be 0 in RV32
+              return (BITS(c, 12, 12) ? RVC_ILLEGAL : enc_i(BITS(c, 6, 2), rs1, 5, rs1, OP_IMM));
+            case 1:  // c.srai
+              return (BITS(c, 12, 12) ? RVC_ILLEGAL : enc_i(0x400 | BITS(c, 6, 2), rs1, 5, rs1, OP_IMM));
+            case 2:  // c.andi
+              return enc_i(imm6, rs1, 7, rs1, OP_IMM);
+            default:
+              if (BITS(c, 12, 12)) return RVC_ILLEGAL;
+              switch (BITS(c, 6, 5)) {
+                case 0: return enc_r(0x20, rd_, rs1, 0, rs1, OP_OP);  // c.sub
+                case 1: return enc_r(0, rd_, rs1, 4, rs1, OP_OP);     // c.xor
+                case 2: return enc_r(0, rd_, rs1, 6, rs1, OP_OP);     // c.or
+                default: return enc_r(0, rd_, rs1, 7, rs1, OP_OP);    // c.and
+              }
+          }
+        }
+        case 5: return enc_j(cj_imm(c), 0);  // c.j
+        default: {  // c.beqz, c.bnez
+          int32_t imm = SEXT((BITS(c, 12, 12) << 8) | (BITS(c, 11, 10) << 3) | (BITS(c, 6, 5) << 6) |
+              (BITS(c, 4, 3) << 1) | (BITS(c, 2, 2) << 5), 9);
+          return enc_b(imm, 0, rs1_, funct3 == 6 ? 0 : 1);
+        }
+      }
+
+    default:
+      switch (funct3) {
+        case 0:  // c.slli
+          return (BITS(c, 12, 12) ? RVC_ILLEGAL : enc_i(BITS(c, 6, 2), rd, 1, rd, OP_IMM));
+        case 2: {  // c.lwsp
+          uint32_t imm = (BITS(c, 12, 12) << 5) | (BITS(c, 6, 4) << 2) | (BITS(c, 3, 2) << 6);
+          return (rd == 0 ? RVC_ILLEGAL : enc_i(imm, 2, 2, rd, OP_LOAD));
+        }
+        case 4:
+          if (!BITS(c, 12, 12)) {
+            if (rs2 != 0) return enc_r(0, rs2, 0, 0, rd, OP_OP);           // c.mv
+            return (rd == 0 ? RVC_ILLEGAL : enc_i(0, rd, 0, 0, OP_JALR));  // c.jr
+          }
+          if (rs2 != 0) return enc_r(0, rs2, rd, 0, rd, OP_OP);            // c.add
+          if (rd == 0) return 0x00100073;                                  // c.ebreak
+          return enc_i(0, rd, 0, 1, OP_JALR);                              // c.jalr
+        case 6: {  // c.swsp
+          uint32_t imm = (BITS(c, 12, 9) << 2) | (BITS(c, 8, 7) << 6);
+          return enc_s(imm, rs2, 2, 2);
+        }
+        default: return RVC_ILLEGAL;
+      }
+  }
+}
+
+void init_rvc(void) {
+  uint32_t c;
+  for (c = 0; c < (1 << 16); c ++) {
+    rvc_table[c] = ((c & 0x3) == 0x3 ? RVC_ILLEGAL : rvc_expand(c));
+  }
+}
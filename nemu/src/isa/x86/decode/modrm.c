@@ -1,76 +1,114 @@
 #include "cpu/exec.h"
 
-void load_addr(vaddr_t *pc, ModR_M *m, Operand *rm) {
-  assert(m->mod != 3);
-
-  int32_t disp = 0;
-  int disp_size = 4;
-  int base_reg = -1, index_reg = -1, scale = 0;
-  rtl_li(&s0, 0);
-
-  if (m->R_M == R_ESP) {
-    SIB s;
-    s.val = instr_fetch(pc, 1);
-    base_reg = s.base;
-    scale = s.ss;
+/* The addressing form of a memory operand is decided by the ModR/M byte,
+ * and by the SIB byte if there is one. The forms of all the bytes are
+ * computed once by init_modrm(), so decoding an operand only looks them
+ * up, fetches the displacement and calls the routine of its form. */
+
+enum { EA_DISP, EA_BASE, EA_INDEX, EA_BASE_INDEX };
+
+typedef struct {
+  uint8_t form;
+  uint8_t has_sib;
+  uint8_t disp_size;
+  uint8_t scale;
+  int8_t base, index;  // -1 if none
+} AddrForm;
+
+static AddrForm modrm_table[256];
+/* indexed by mod, which decides the displacement when the base is EBP */
+static AddrForm sib_table[3][256];
+
+static inline AddrForm make_form(int mod, int base, int index, int scale) {
+  int disp_size = (mod == 0 ? 0 : (mod == 1 ? 1 : 4));
+  if (mod == 0 && base == R_EBP) { base = -1; disp_size = 4; }
+  int form = (base == -1 ? (index == -1 ? EA_DISP : EA_INDEX) : (index == -1 ? EA_BASE : EA_BASE_INDEX));
+  return (AddrForm) { .form = form, .disp_size = disp_size, .scale = scale, .base = base, .index = index };
+}
 
-    if (s.index != R_ESP) { index_reg = s.index; }
+void init_modrm(void) {
+  int i, mod;
+  for (i = 0; i < 256; i ++) {
+    ModR_M m = { .val = i };
+    if (m.mod == 3) continue;
+    if (m.R_M == R_ESP) modrm_table[i] = (AddrForm) { .has_sib = 1 };
+    else modrm_table[i] = make_form(m.mod, m.R_M, -1, 0);
   }
-  else {
-    /* no SIB */
-    base_reg = m->R_M;
+  for (mod = 0; mod < 3; mod ++) {
+    for (i = 0; i < 256; i ++) {
+      SIB s = { .val = i };
+      sib_table[mod][i] = make_form(mod, s.base, (s.index == R_ESP ? -1 : s.index), s.ss);
+    }
   }
+}
 
-  if (m->mod == 0) {
-    if (base_reg == R_EBP) { base_reg = -1; }
-    else { disp_size = 0; }
-  }
-  else if (m->mod == 1) { disp_size = 1; }
+static inline vaddr_t ea_disp(const AddrForm *f, int32_t disp) {
+  return disp;
+}
 
-  if (disp_size != 0) {
-    /* has disp */
-    disp = instr_fetch(pc, disp_size);
-    if (disp_size == 1) { disp = (int8_t)disp; }
+static inline vaddr_t ea_base(const AddrForm *f, int32_t disp) {
+  return reg_l(f->base) + disp;
+}
 
-    rtl_addi(&s0, &s0, disp);
-  }
+static inline vaddr_t ea_index(const AddrForm *f, int32_t disp) {
+  return (reg_l(f->index) << f->scale) + disp;
+}
+
+static inline vaddr_t ea_base_index(const AddrForm *f, int32_t disp) {
+  return reg_l(f->base) + (reg_l(f->index) << f->scale) + disp;
+}
 
-  if (base_reg != -1) {
-    rtl_add(&s0, &s0, &reg_l(base_reg));
+void load_addr(vaddr_t *pc, ModR_M *m, Operand *rm) {
+  assert(m->mod != 3);
+
+  const AddrForm *f = &modrm_table[m->val];
+  if (f->has_sib) {
+    SIB s;
+    s.val = instr_fetch(pc, 1);
+    f = &sib_table[m->mod][s.val];
   }
 
-  if (index_reg != -1) {
-    rtl_shli(&s1, &reg_l(index_reg), scale);
-    rtl_add(&s0, &s0, &s1);
+  int32_t disp = 0;
+  if (f->disp_size == 1) { disp = (int8_t)instr_fetch(pc, 1); }
+  else if (f->disp_size == 4) { disp = instr_fetch(pc, 4); }
+
+  switch (f->form) {
+    case EA_DISP: rm->addr = ea_disp(f, disp); break;
+    case EA_BASE: rm->addr = ea_base(f, disp); break;
+    case EA_INDEX: rm->addr = ea_index(f, disp); break;
+    default: rm->addr = ea_base_index(f, disp); break;
   }
-  rtl_mv(&rm->addr, &s0);
 
 #ifdef DEBUG
-  char disp_buf[16];
-  char base_buf[8];
-  char index_buf[8];
-
-  if (disp_size != 0) {
-    /* has disp */
-    sprintf(disp_buf, "%s%#x", (disp < 0 ? "-" : ""), (disp < 0 ? -disp : disp));
-  }
-  else { disp_buf[0] = '\0'; }
+  if (log_asm) {
+    int disp_size = f->disp_size;
+    int base_reg = f->base, index_reg = f->index, scale = f->scale;
+    char disp_buf[16];
+    char base_buf[8];
+    char index_buf[8];
+
+    if (disp_size != 0) {
+      /* has disp */
+      sprintf(disp_buf, "%s%#x", (disp < 0 ? "-" : ""), (disp < 0 ? -disp : disp));
+    }
+    else { disp_buf[0] = '\0'; }
 
-  if (base_reg == -1) { base_buf[0] = '\0'; }
-  else { 
-    sprintf(base_buf, "%%%s", reg_name(base_reg, 4));
-  }
+    if (base_reg == -1) { base_buf[0] = '\0'; }
+    else { 
+      sprintf(base_buf, "%%%s", reg_name(base_reg, 4));
+    }
 
-  if (index_reg == -1) { index_buf[0] = '\0'; }
-  else { 
-    sprintf(index_buf, ",%%%s,%d", reg_name(index_reg, 4), 1 << scale);
-  }
+    if (index_reg == -1) { index_buf[0] = '\0'; }
+    else { 
+      sprintf(index_buf, ",%%%s,%d", reg_name(index_reg, 4), 1 << scale);
+    }
 
-  if (base_reg == -1 && index_reg == -1) {
-    sprintf(rm->str, "%s", disp_buf);
-  }
-  else {
-    sprintf(rm->str, "%s(%s%s)", disp_buf, base_buf, index_buf);
+    if (base_reg == -1 && index_reg == -1) {
+      sprintf(rm->str, "%s", disp_buf);
+    }
+    else {
+      sprintf(rm->str, "%s(%s%s)", disp_buf, base_buf, index_buf);
+    }
   }
 #endif
 
@@ -89,7 +127,7 @@ void read_ModR_M(vaddr_t *pc, Operand *rm, bool load_rm_val, Operand *reg, bool
     }
 
 #ifdef DEBUG
-    snprintf(reg->str, OP_STR_SIZE, "%%%s", reg_name(reg->reg, reg->width));
+    if (log_asm) snprintf(reg->str, OP_STR_SIZE, "%%%s", reg_name(reg->reg, reg->width));
 #endif
   }
 
@@ -101,7 +139,7 @@ void read_ModR_M(vaddr_t *pc, Operand *rm, bool load_rm_val, Operand *reg, bool
     }
 
 #ifdef DEBUG
-    sprintf(rm->str, "%%%s", reg_name(m.R_M, rm->width));
+    if (log_asm) sprintf(rm->str, "%%%s", reg_name(m.R_M, rm->width));
 #endif
   }
   else {
@@ -0,0 +1,193 @@
+#include "nemu.h"
+#include "cpu/decode.h"
+#include "monitor/perf.h"
+#include <stdlib.h>
+
+/* The pre-decoder finds the length of the instruction starting at every
+ * byte of a page of pmem in one pass over the page, with the attributes
+ * of the opcodes: prefixes, ModR/M, and the sizes of the immediate. The
+ * lengths of a page are kept until the page is written, which is found by
+ * the dirty bits of PMEM_DIRTY_PREDECODE, so the boundaries are known
+ * without fetching the bytes one by one through the decode helpers.
+ *
+ * A length of 0 means unknown: an invalid opcode, the address size prefix
+ * (16-bit addressing is not supported), the three-byte opcodes, or an
+ * instruction crossing the end of the page. */
+
+#define A_MODRM   0x01
+#define A_IMM8    0x02
+#define A_IMMZ    0x04  // 2 or 4 bytes by the operand size
+#define A_IMM16   0x08
+#define A_MOFFS   0x10  // 4 bytes, by the address size
+#define A_PREFIX  0x20
+#define A_GRP3    0x40  // test in group 3 has an immediate
+#define A_BAD     0x80
+
+/* indexed by the opcode, 0x100 | the second byte for 0x0f */
+static uint8_t attr[512];
+static bool attr_ready = false;
+
+static inline void set_range(int lo, int hi, uint8_t a) {
+  for (; lo <= hi; lo ++) attr[lo] |= a;
+}
+
+static void init_attr(void) {
+  int i;
+  /* add/or/adc/sbb/and/sub/xor/cmp: E,G forms with ModR/M, then al,imm8 and eax,immz */
+  for (i = 0; i < 0x40; i += 8) {
+    set_range(i, i + 3, A_MODRM);
+    attr[i + 4] |= A_IMM8;
+    attr[i + 5] |= A_IMMZ;
+  }
+  attr[0x26] = attr[0x2e] = attr[0x36] = attr[0x3e] = A_PREFIX;
+  attr[0x64] = attr[0x65] = attr[0x66] = attr[0xf0] = attr[0xf2] = attr[0xf3] = A_PREFIX;
+  attr[0x67] = A_BAD;
+  set_range(0x62, 0x63, A_MODRM);
+  attr[0x68] |= A_IMMZ;
+  attr[0x69] |= A_MODRM | A_IMMZ;
+  attr[0x6a] |= A_IMM8;
+  attr[0x6b] |= A_MODRM | A_IMM8;
+  set_range(0x70, 0x7f, A_IMM8);
+  set_range(0x80, 0x8f, A_MODRM);
+  attr[0x80] |= A_IMM8;
+  attr[0x81] |= A_IMMZ;
+  attr[0x82] |= A_IMM8;
+  attr[0x83] |= A_IMM8;
+  attr[0x9a] |= A_IMMZ | A_IMM16;
+  set_range(0xa0, 0xa3, A_MOFFS);
+  attr[0xa8] |= A_IMM8;
+  attr[0xa9] |= A_IMMZ;
+  set_range(0xb0, 0xb7, A_IMM8);
+  set_range(0xb8, 0xbf, A_IMMZ);
+  set_range(0xc0, 0xc1, A_MODRM | A_IMM8);
+  attr[0xc2] |= A_IMM16;
+  set_range(0xc4, 0xc7, A_MODRM);
+  attr[0xc6] |= A_IMM8;
+  attr[0xc7] |= A_IMMZ;
+  attr[0xc8] |= A_IMM16 | A_IMM8;
+  attr[0xca] |= A_IMM16;
+  attr[0xcd] |= A_IMM8;
+  set_range(0xd0, 0xd3, A_MODRM);
+  set_range(0xd4, 0xd5, A_IMM8);
+  set_range(0xd8, 0xdf, A_MODRM);
+  set_range(0xe0, 0xe7, A_IMM8);
+  set_range(0xe8, 0xe9, A_IMMZ);
+  attr[0xea] |= A_IMMZ | A_IMM16;
+  attr[0xeb] |= A_IMM8;
+  set_range(0xf6, 0xf7, A_MODRM | A_GRP3);
+  set_range(0xfe, 0xff, A_MODRM);
+
+  /* two-byte opcodes, most of which have ModR/M */
+  set_range(0x100, 0x1ff, A_MODRM);
+  for (i = 0x104; i <= 0x10e; i ++) attr[i] = (i == 0x10d ? A_MODRM : 0);
+  attr[0x10f] = A_BAD;
+  for (i = 0x130; i <= 0x137; i ++) attr[i] = 0;
+  /* 0x0f 0x38 and 0x0f 0x3a are three-byte opcodes */
+  for (i = 0x138; i <= 0x13f; i ++) attr[i] = A_BAD;
+  attr[0x177] = 0;
+  for (i = 0x180; i <= 0x18f; i ++) attr[i] = A_IMMZ;
+  attr[0x1a0] = attr[0x1a1] = attr[0x1a2] = 0;
+  attr[0x1a8] = attr[0x1a9] = attr[0x1aa] = 0;
+  for (i = 0x1c8; i <= 0x1cf; i ++) attr[i] = 0;
+  set_range(0x170, 0x173, A_IMM8);
+  attr[0x1a4] |= A_IMM8;
+  attr[0x1ac] |= A_IMM8;
+  attr[0x1ba] |= A_IMM8;
+  attr[0x1c2] |= A_IMM8;
+  set_range(0x1c4, 0x1c6, A_IMM8);
+  attr[0x1ff] = A_BAD;
+
+  attr_ready = true;
+}
+
+/* the length of the instruction at `p', not reading beyond `end' */
+static int instr_len(const uint8_t *p, const uint8_t *end) {
+  const uint8_t *start = p;
+  int opsize = 4;
+  while (p < end && (attr[*p] & A_PREFIX)) {
+    if (*p == 0x66) opsize = 2;
+    p ++;
+  }
+  if (p >= end) return 0;
+
+  int op = *p ++;
+  if (op == 0x0f) {
+    if (p >= end) return 0;
+    op = 0x100 | *p ++;
+  }
+  uint8_t a = attr[op];
+  if (a & A_BAD) return 0;
+
+  if (a & A_MODRM) {
+    if (p >= end) return 0;
+    ModR_M m = { .val = *p ++ };
+    if (m.mod != 3) {
+      if (m.R_M == R_ESP) {
+        if (p >= end) return 0;
+        SIB s = { .val = *p ++ };
+        if (m.mod == 0 && s.base == R_EBP) p += 4;
+      }
+      if (m.mod == 0 && m.R_M == R_EBP) p += 4;
+      else if (m.mod == 1) p += 1;
+      else if (m.mod == 2) p += 4;
+    }
+    /* only test, i.e. /0 and /1, of group 3 has an immediate */
+    if ((a & A_GRP3) && m.reg <= 1) a |= (op == 0xf6 ? A_IMM8 : A_IMMZ);
+  }
+
+  if (a & A_IMM8) p += 1;
+  if (a & A_IMMZ) p += opsize;
+  if (a & A_IMM16) p += 2;
+  if (a & A_MOFFS) p += 4;
+
+  int len = p - start;
+  return (p > end || len > ISA_INSTR_MAX ? 0 : len);
+}
+
+#define NR_PAGE (pmem_size / PAGE_SIZE)
+
+/* the lengths of the instructions in each page, NULL if not pre-decoded */
+static uint8_t **page_len = NULL;
+static uint64_t nr_predecode = 0, nr_repredecode = 0;
+
+static void predecode_page(uint32_t page) {
+  if (!attr_ready) init_attr();
+  if (page_len[page] == NULL) {
+    page_len[page] = malloc(PAGE_SIZE);
+    assert(page_len[page] != NULL);
+    nr_predecode ++;
+  }
+  else nr_repredecode ++;
+
+  const uint8_t *base = pmem + page * PAGE_SIZE;
+  int i;
+  for (i = 0; i < PAGE_SIZE; i ++) {
+    page_len[page][i] = instr_len(base + i, base + PAGE_SIZE);
+  }
+  pmem_clear_dirty(page, 1, PMEM_DIRTY_PREDECODE);
+}
+
+/* the length of the instruction at `pmem_offset', or 0 if it is unknown */
+int x86_predecode_len(uint32_t pmem_offset) {
+  if (page_len == NULL) {
+    page_len = calloc(NR_PAGE, sizeof(page_len[0]));
+    assert(page_len != NULL);
+  }
+  uint32_t page = pmem_offset / PAGE_SIZE;
+  if (page_len[page] == NULL || pmem_is_dirty(page, PMEM_DIRTY_PREDECODE)) predecode_page(page);
+  return page_len[page][pmem_offset & PAGE_MASK];
+}
+
+int isa_instr_len(vaddr_t pc) {
+  bool success;
+  paddr_t paddr = isa_fetch_probe(pc, &success);
+  int offset = (success ? pmem_offset(paddr) : -1);
+  return (offset < 0 ? 0 : x86_predecode_len(offset));
+}
+
+void x86_predecode_perf(PerfOut *o) {
+  perf_begin(o, "predecode");
+  perf_u64(o, "page", nr_predecode);
+  perf_u64(o, "again", nr_repredecode);
+  perf_end(o);
+}
@@ -1,8 +1,23 @@
 #include "cpu/exec.h"
+#include "width.h"
 
-make_EHelper(mov);
+declare_EHelperW(mov);
 
 make_EHelper(operand_size);
+declare_EHelperW(rep);
+declare_EHelperW(lock);
+
+declare_EHelperW(movs);
+declare_EHelperW(stos);
+make_EHelper(cld);
+make_EHelper(std);
+
+make_EHelper(mov_r2cr);
+make_EHelper(mov_cr2r);
+make_EHelper(hlt);
+make_EHelper(lidt);
+make_EHelper(int);
+make_EHelper(iret);
 
 make_EHelper(inv);
 make_EHelper(nemu_trap);
@@ -1,55 +1,70 @@
 #include "cpu/exec.h"
+#include "width.h"
 
-make_EHelper(add) {
-  TODO();
+make_EHelperW(add) {
+  rtl_add(&s0, &id_dest->val, &id_src->val);
+  operand_write_w(id_dest, &s0, width);
+  rtl_set_cc(CC_OP_ADD, &s0, &id_dest->val, &id_src->val, width);
 
   print_asm_template2(add);
 }
 
-make_EHelper(sub) {
-  TODO();
+make_EHelperW(sub) {
+  rtl_sub(&s0, &id_dest->val, &id_src->val);
+  operand_write_w(id_dest, &s0, width);
+  rtl_set_cc(CC_OP_SUB, &s0, &id_dest->val, &id_src->val, width);
 
   print_asm_template2(sub);
 }
 
-make_EHelper(cmp) {
-  TODO();
+make_EHelperW(cmp) {
+  rtl_sub(&s0, &id_dest->val, &id_src->val);
+  rtl_set_cc(CC_OP_SUB, &s0, &id_dest->val, &id_src->val, width);
 
   print_asm_template2(cmp);
 }
 
-make_EHelper(inc) {
-  TODO();
+make_EHelperW(inc) {
+  rtl_li(&s1, 1);
+  rtl_add(&s0, &id_dest->val, &s1);
+  operand_write_w(id_dest, &s0, width);
+  rtl_set_cc(CC_OP_INC, &s0, &id_dest->val, &s1, width);
 
   print_asm_template1(inc);
 }
 
-make_EHelper(dec) {
-  TODO();
+make_EHelperW(dec) {
+  rtl_li(&s1, 1);
+  rtl_sub(&s0, &id_dest->val, &s1);
+  operand_write_w(id_dest, &s0, width);
+  rtl_set_cc(CC_OP_DEC, &s0, &id_dest->val, &s1, width);
 
   print_asm_template1(dec);
 }
 
-make_EHelper(neg) {
-  TODO();
+make_EHelperW(neg) {
+  rtl_li(&s1, 0);
+  rtl_sub(&s0, &s1, &id_dest->val);
+  operand_write_w(id_dest, &s0, width);
+  rtl_set_cc(CC_OP_SUB, &s0, &s1, &id_dest->val, width);
 
   print_asm_template1(neg);
 }
 
-make_EHelper(adc) {
+make_EHelperW(adc) {
   // s0 = dest + src
   rtl_add(&s0, &id_dest->val, &id_src->val);
   // s1 = s0 + CF
   rtl_get_CF(&s1);
   rtl_add(&s1, &s0, &s1);
 
-  operand_write(id_dest, &s1);
+  operand_write_w(id_dest, &s1, width);
 
-  if (id_dest->width != 4) {
-    rtl_andi(&s1, &s1, 0xffffffffu >> ((4 - id_dest->width) * 8));
+  if (width != 4) {
+    rtl_andi(&s1, &s1, 0xffffffffu >> ((4 - width) * 8));
   }
 
-  rtl_update_ZFSF(&s1, id_dest->width);
+  rtl_update_ZFSF(&s1, width);
 
   // update CF
   rtl_is_add_carry(&s1, &s1, &s0);
@@ -58,26 +73,26 @@ make_EHelper(adc) {
   rtl_set_CF(&s0);
 
   // update OF
-  rtl_is_add_overflow(&s0, &s1, &id_dest->val, &id_src->val, id_dest->width);
+  rtl_is_add_overflow(&s0, &s1, &id_dest->val, &id_src->val, width);
   rtl_set_OF(&s0);
 
   print_asm_template2(adc);
 }
 
-make_EHelper(sbb) {
+make_EHelperW(sbb) {
   // s0 = dest - src
   rtl_sub(&s0, &id_dest->val, &id_src->val);
   // s1 = s0 - CF
   rtl_get_CF(&s1);
   rtl_sub(&s1, &s0, &s1);
 
-  operand_write(id_dest, &s1);
+  operand_write_w(id_dest, &s1, width);
 
-  if (id_dest->width != 4) {
-    rtl_andi(&s1, &s1, 0xffffffffu >> ((4 - id_dest->width) * 8));
+  if (width != 4) {
+    rtl_andi(&s1, &s1, 0xffffffffu >> ((4 - width) * 8));
   }
 
-  rtl_update_ZFSF(&s1, id_dest->width);
+  rtl_update_ZFSF(&s1, width);
 
   // update CF
   rtl_is_sub_carry(&s1, &s1, &s0);
@@ -86,17 +101,17 @@ make_EHelper(sbb) {
   rtl_set_CF(&s0);
 
   // update OF
-  rtl_is_sub_overflow(&s0, &s1, &id_dest->val, &id_src->val, id_dest->width);
+  rtl_is_sub_overflow(&s0, &s1, &id_dest->val, &id_src->val, width);
   rtl_set_OF(&s0);
 
   print_asm_template2(sbb);
 }
 
-make_EHelper(mul) {
-  rtl_lr(&s0, R_EAX, id_dest->width);
+make_EHelperW(mul) {
+  rtl_lr(&s0, R_EAX, width);
   rtl_mul_lo(&s1, &id_dest->val, &s0);
 
-  switch (id_dest->width) {
+  switch (width) {
     case 1:
       rtl_sr(R_AX, &s1, 2);
       break;
@@ -117,11 +132,11 @@ make_EHelper(mul) {
 }
 
 // imul with one operand
-make_EHelper(imul1) {
-  rtl_lr(&s0, R_EAX, id_dest->width);
+make_EHelperW(imul1) {
+  rtl_lr(&s0, R_EAX, width);
   rtl_imul_lo(&s1, &id_dest->val, &s0);
 
-  switch (id_dest->width) {
+  switch (width) {
     case 1:
       rtl_sr(R_AX, &s1, 2);
       break;
@@ -142,29 +157,29 @@ make_EHelper(imul1) {
 }
 
 // imul with two operands
-make_EHelper(imul2) {
+make_EHelperW(imul2) {
   rtl_sext(&s0, &id_src->val, id_src->width);
-  rtl_sext(&s1, &id_dest->val, id_dest->width);
+  rtl_sext(&s1, &id_dest->val, width);
 
   rtl_imul_lo(&s0, &s1, &s0);
-  operand_write(id_dest, &s0);
+  operand_write_w(id_dest, &s0, width);
 
   print_asm_template2(imul);
 }
 
 // imul with three operands
-make_EHelper(imul3) {
+make_EHelperW(imul3) {
   rtl_sext(&s0, &id_src->val, id_src->width);
   rtl_sext(&s1, &id_src2->val, id_src->width);
 
   rtl_imul_lo(&s0, &s1, &s0);
-  operand_write(id_dest, &s0);
+  operand_write_w(id_dest, &s0, width);
 
   print_asm_template3(imul);
 }
 
-make_EHelper(div) {
-  switch (id_dest->width) {
+make_EHelperW(div) {
+  switch (width) {
     case 1:
       rtl_lr(&s0, R_AX, 2);
       rtl_div_q(&s1, &s0, &id_dest->val);
@@ -194,8 +209,8 @@ make_EHelper(div) {
   print_asm_template1(div);
 }
 
-make_EHelper(idiv) {
-  switch (id_dest->width) {
+make_EHelperW(idiv) {
+  switch (width) {
     case 1:
       rtl_lr(&s0, R_AX, 2);
       rtl_idiv_q(&s1, &s0, &id_dest->val);
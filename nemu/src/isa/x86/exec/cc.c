@@ -2,28 +2,85 @@
 
 /* Condition Code */
 
+enum {
+  CC_O, CC_NO, CC_B,  CC_NB,
+  CC_E, CC_NE, CC_BE, CC_NBE,
+  CC_S, CC_NS, CC_P,  CC_NP,
+  CC_L, CC_NL, CC_LE, CC_NLE
+};
+
+void rtl_compute_cc(uint32_t op, rtlreg_t res, rtlreg_t src1, rtlreg_t src2, int width) {
+  int shift = (4 - width) * 8;
+  res <<= shift;
+  src1 <<= shift;
+  src2 <<= shift;
+
+  cpu.eflags.ZF = (res == 0);
+  cpu.eflags.SF = res >> 31;
+
+  switch (op) {
+    case CC_OP_ADD: cpu.eflags.CF = (res < src1); // fall through
+    case CC_OP_INC: cpu.eflags.OF = (~(src1 ^ src2) & (src1 ^ res)) >> 31; break;
+    case CC_OP_SUB: cpu.eflags.CF = (src1 < src2); // fall through
+    case CC_OP_DEC: cpu.eflags.OF = ((src1 ^ src2) & (src1 ^ res)) >> 31; break;
+    case CC_OP_LOGIC: cpu.eflags.CF = cpu.eflags.OF = 0; break;
+    default: panic("unknown cc op = %d", op);
+  }
+}
+
+#ifdef LAZY_CC
+/* Evaluate the condition directly from the pending operation.
+ * Return false if it is not covered here. */
+static inline bool lazy_setcc(rtlreg_t* dest, uint32_t cc) {
+  int shift = (4 - cpu.cc.width) * 8;
+  uint32_t res = cpu.cc.res << shift;
+  uint32_t src1 = cpu.cc.src1 << shift;
+  uint32_t src2 = cpu.cc.src2 << shift;
+
+  switch (cpu.cc.op) {
+    case CC_OP_SUB:
+      switch (cc) {
+        case CC_B:  *dest = (src1 < src2); return true;
+        case CC_E:  *dest = (res == 0); return true;
+        case CC_BE: *dest = (src1 <= src2); return true;
+        case CC_S:  *dest = res >> 31; return true;
+        case CC_L:  *dest = ((int32_t)src1 < (int32_t)src2); return true;
+        case CC_LE: *dest = ((int32_t)src1 <= (int32_t)src2); return true;
+      }
+      break;
+    case CC_OP_LOGIC:
+      switch (cc) {
+        case CC_O: case CC_B: *dest = 0; return true;
+        case CC_E: case CC_BE: *dest = (res == 0); return true;
+        case CC_S: case CC_L: *dest = res >> 31; return true;
+        case CC_LE: *dest = (res == 0) || (res >> 31); return true;
+      }
+      break;
+  }
+  return false;
+}
+#endif
+
 void rtl_setcc(rtlreg_t* dest, uint8_t subcode) {
   bool invert = subcode & 0x1;
-  enum {
-    CC_O, CC_NO, CC_B,  CC_NB,
-    CC_E, CC_NE, CC_BE, CC_NBE,
-    CC_S, CC_NS, CC_P,  CC_NP,
-    CC_L, CC_NL, CC_LE, CC_NLE
-  };
-
-  // TODO: Query EFLAGS to determine whether the condition code is satisfied.
+
   // dest <- ( cc is satisfied ? 1 : 0)
-  switch (subcode & 0xe) {
-    case CC_O:
-    case CC_B:
-    case CC_E:
-    case CC_BE:
-    case CC_S:
-    case CC_L:
-    case CC_LE:
-      TODO();
-    default: panic("should not reach here");
-    case CC_P: panic("n86 does not have PF");
+#ifdef LAZY_CC
+  if (cpu.cc.op == CC_OP_NONE || !lazy_setcc(dest, subcode & 0xe))
+#endif
+  {
+    rtl_cc_sync();
+    switch (subcode & 0xe) {
+      case CC_O: *dest = cpu.eflags.OF; break;
+      case CC_B: *dest = cpu.eflags.CF; break;
+      case CC_E: *dest = cpu.eflags.ZF; break;
+      case CC_BE: *dest = cpu.eflags.CF | cpu.eflags.ZF; break;
+      case CC_S: *dest = cpu.eflags.SF; break;
+      case CC_L: *dest = cpu.eflags.SF ^ cpu.eflags.OF; break;
+      case CC_LE: *dest = cpu.eflags.ZF | (cpu.eflags.SF ^ cpu.eflags.OF); break;
+      default: panic("should not reach here");
+      case CC_P: panic("n86 does not have PF");
+    }
   }
 
   if (invert) {
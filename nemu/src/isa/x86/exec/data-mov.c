@@ -1,7 +1,8 @@
 #include "cpu/exec.h"
+#include "width.h"
 
-make_EHelper(mov) {
-  operand_write(id_dest, &id_src->val);
+make_EHelperW(mov) {
+  operand_write_w(id_dest, &id_src->val, width);
   print_asm_template2(mov);
 }
 
@@ -36,41 +37,43 @@ make_EHelper(leave) {
 }
 
 make_EHelper(cltd) {
-  if (decinfo.isa.is_operand_size_16) {
+  if (id_dest->width == 2) {
     TODO();
   }
   else {
     TODO();
   }
 
-  print_asm(decinfo.isa.is_operand_size_16 ? "cwtl" : "cltd");
+  print_asm(id_dest->width == 2 ? "cwtl" : "cltd");
 }
 
 make_EHelper(cwtl) {
-  if (decinfo.isa.is_operand_size_16) {
+  if (id_dest->width == 2) {
     TODO();
   }
   else {
     TODO();
   }
 
-  print_asm(decinfo.isa.is_operand_size_16 ? "cbtw" : "cwtl");
+  print_asm(id_dest->width == 2 ? "cbtw" : "cwtl");
 }
 
-make_EHelper(movsx) {
-  id_dest->width = decinfo.isa.is_operand_size_16 ? 2 : 4;
+make_EHelperW(movsx) {
+  // `width' is the width of the destination
+  id_dest->width = width;
   rtl_sext(&s0, &id_src->val, id_src->width);
-  operand_write(id_dest, &s0);
+  operand_write_w(id_dest, &s0, width);
   print_asm_template2(movsx);
 }
 
-make_EHelper(movzx) {
-  id_dest->width = decinfo.isa.is_operand_size_16 ? 2 : 4;
-  operand_write(id_dest, &id_src->val);
+make_EHelperW(movzx) {
+  // `width' is the width of the destination
+  id_dest->width = width;
+  operand_write_w(id_dest, &id_src->val, width);
   print_asm_template2(movzx);
 }
 
-make_EHelper(lea) {
-  operand_write(id_dest, &id_src->addr);
+make_EHelperW(lea) {
+  operand_write_w(id_dest, &id_src->addr, width);
   print_asm_template2(lea);
 }
@@ -1,200 +1,253 @@
 #include "cpu/exec.h"
 #include "all-instr.h"
+#include "cpu/decode-cache.h"
+#include "cpu/threaded.h"
 
-static inline void set_width(int width) {
-  if (width == 0) {
-    width = decinfo.isa.is_operand_size_16 ? 2 : 4;
-  }
-  decinfo.src.width = decinfo.dest.width = decinfo.src2.width = width;
-}
+#ifdef THREADED_ENGINE
+#error "threaded dispatch is not supported by x86 yet"
+#endif
 
-static make_EHelper(2byte_esc);
+/* some x86 helpers compute with C code besides RTL */
+#ifdef JIT_ENGINE
+#error "the RTL JIT is not supported by x86 yet"
+#endif
 
-#define make_group(name, item0, item1, item2, item3, item4, item5, item6, item7) \
-  static OpcodeEntry concat(opcode_table_, name) [8] = { \
-    /* 0x00 */	item0, item1, item2, item3, \
-    /* 0x04 */	item4, item5, item6, item7  \
-  }; \
-static make_EHelper(name) { \
-  idex(pc, &concat(opcode_table_, name)[decinfo.isa.ext_opcode]); \
-}
+/* The opcode table is defined for each operand size. In the entries,
+ * `sz' is the suffix of the operand size selected by the 0x66 prefix,
+ * i.e. `w' or `l', and IDEXV() picks the variant of a width-specialized
+ * EHelper (see make_EHelperW()) for it. The prefix only switches to the
+ * table of `w' for the next byte, and the other prefixes in a table stay
+ * in it, so the operand size is never checked when executing. */
+#define WIDTH_b 1
+#define WIDTH_w 2
+#define WIDTH_l 4
+
+#define IDEXV(id, ex, sz) IDEXW(id, concat3(ex, _, sz), concat(WIDTH_, sz))
+#define EXV(ex, sz)       EXW(concat3(ex, _, sz), concat(WIDTH_, sz))
+
+static make_EHelper(2byte_esc_w);
+static make_EHelper(2byte_esc_l);
+
+/* A group is also defined for each operand size, by `items(sz)'. */
+#define make_group_sz(name, items, sz) \
+  static OpcodeEntry concat4(opcode_table_, name, _, sz) [8] = { items(sz) }; \
+  static __attribute__((unused)) make_EHelper(concat3(name, _, sz)) { \
+    idex(pc, &concat4(opcode_table_, name, _, sz)[decinfo.isa.ext_opcode]); \
+  }
+
+#define make_group(name, items) \
+  make_group_sz(name, items, b) \
+  make_group_sz(name, items, w) \
+  make_group_sz(name, items, l)
 
 /* 0x80, 0x81, 0x83 */
-make_group(gp1,
-    EMPTY, EMPTY, EMPTY, EMPTY,
-    EMPTY, EMPTY, EMPTY, EMPTY)
+#define GP1(sz) \
+    EMPTY, EMPTY, EMPTY, EMPTY, \
+    EMPTY, EMPTY, EMPTY, EMPTY
+make_group(gp1, GP1)
 
 /* 0xc0, 0xc1, 0xd0, 0xd1, 0xd2, 0xd3 */
-make_group(gp2,
-    EMPTY, EMPTY, EMPTY, EMPTY,
-    EMPTY, EMPTY, EMPTY, EMPTY)
+#define GP2(sz) \
+    EMPTY, EMPTY, EMPTY, EMPTY, \
+    EMPTY, EMPTY, EMPTY, EMPTY
+make_group(gp2, GP2)
 
 /* 0xf6, 0xf7 */
-make_group(gp3,
-    EMPTY, EMPTY, EMPTY, EMPTY,
-    EMPTY, EMPTY, EMPTY, EMPTY)
+#define GP3(sz) \
+    EMPTY, EMPTY, EMPTY, EMPTY, \
+    EMPTY, EMPTY, EMPTY, EMPTY
+make_group(gp3, GP3)
 
 /* 0xfe */
-make_group(gp4,
-    EMPTY, EMPTY, EMPTY, EMPTY,
-    EMPTY, EMPTY, EMPTY, EMPTY)
+#define GP4(sz) \
+    EMPTY, EMPTY, EMPTY, EMPTY, \
+    EMPTY, EMPTY, EMPTY, EMPTY
+make_group(gp4, GP4)
 
 /* 0xff */
-make_group(gp5,
-    EMPTY, EMPTY, EMPTY, EMPTY,
-    EMPTY, EMPTY, EMPTY, EMPTY)
+#define GP5(sz) \
+    EMPTY, EMPTY, EMPTY, EMPTY, \
+    EMPTY, EMPTY, EMPTY, EMPTY
+make_group(gp5, GP5)
 
 /* 0x0f 0x01*/
-make_group(gp7,
-    EMPTY, EMPTY, EMPTY, EMPTY,
-    EMPTY, EMPTY, EMPTY, EMPTY)
+#define GP7(sz) \
+    EMPTY, EMPTY, EMPTY, EX(lidt), \
+    EMPTY, EMPTY, EMPTY, EMPTY
+make_group(gp7, GP7)
 
 /* TODO: Add more instructions!!! */
 
-static OpcodeEntry opcode_table [512] = {
-  /* 0x00 */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0x04 */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0x08 */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0x0c */	EMPTY, EMPTY, EMPTY, EX(2byte_esc),
-  /* 0x10 */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0x14 */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0x18 */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0x1c */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0x20 */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0x24 */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0x28 */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0x2c */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0x30 */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0x34 */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0x38 */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0x3c */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0x40 */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0x44 */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0x48 */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0x4c */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0x50 */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0x54 */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0x58 */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0x5c */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0x60 */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0x64 */	EMPTY, EMPTY, EX(operand_size), EMPTY,
-  /* 0x68 */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0x6c */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0x70 */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0x74 */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0x78 */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0x7c */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0x80 */	IDEXW(I2E, gp1, 1), IDEX(I2E, gp1), EMPTY, IDEX(SI2E, gp1),
-  /* 0x84 */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0x88 */	IDEXW(mov_G2E, mov, 1), IDEX(mov_G2E, mov), IDEXW(mov_E2G, mov, 1), IDEX(mov_E2G, mov),
-  /* 0x8c */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0x90 */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0x94 */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0x98 */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0x9c */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0xa0 */	IDEXW(O2a, mov, 1), IDEX(O2a, mov), IDEXW(a2O, mov, 1), IDEX(a2O, mov),
-  /* 0xa4 */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0xa8 */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0xac */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0xb0 */	IDEXW(mov_I2r, mov, 1), IDEXW(mov_I2r, mov, 1), IDEXW(mov_I2r, mov, 1), IDEXW(mov_I2r, mov, 1),
-  /* 0xb4 */	IDEXW(mov_I2r, mov, 1), IDEXW(mov_I2r, mov, 1), IDEXW(mov_I2r, mov, 1), IDEXW(mov_I2r, mov, 1),
-  /* 0xb8 */	IDEX(mov_I2r, mov), IDEX(mov_I2r, mov), IDEX(mov_I2r, mov), IDEX(mov_I2r, mov),
-  /* 0xbc */	IDEX(mov_I2r, mov), IDEX(mov_I2r, mov), IDEX(mov_I2r, mov), IDEX(mov_I2r, mov),
-  /* 0xc0 */	IDEXW(gp2_Ib2E, gp2, 1), IDEX(gp2_Ib2E, gp2), EMPTY, EMPTY,
-  /* 0xc4 */	EMPTY, EMPTY, IDEXW(mov_I2E, mov, 1), IDEX(mov_I2E, mov),
-  /* 0xc8 */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0xcc */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0xd0 */	IDEXW(gp2_1_E, gp2, 1), IDEX(gp2_1_E, gp2), IDEXW(gp2_cl2E, gp2, 1), IDEX(gp2_cl2E, gp2),
-  /* 0xd4 */	EMPTY, EMPTY, EX(nemu_trap), EMPTY,
-  /* 0xd8 */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0xdc */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0xe0 */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0xe4 */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0xe8 */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0xec */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0xf0 */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0xf4 */	EMPTY, EMPTY, IDEXW(E, gp3, 1), IDEX(E, gp3),
-  /* 0xf8 */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0xfc */	EMPTY, EMPTY, IDEXW(E, gp4, 1), IDEX(E, gp5),
-
-/*2 byte_opcode_table */
-
-  /* 0x00 */	EMPTY, IDEX(gp7_E, gp7), EMPTY, EMPTY,
-  /* 0x04 */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0x08 */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0x0c */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0x10 */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0x14 */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0x18 */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0x1c */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0x20 */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0x24 */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0x28 */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0x2c */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0x30 */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0x34 */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0x38 */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0x3c */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0x40 */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0x44 */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0x48 */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0x4c */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0x50 */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0x54 */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0x58 */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0x5c */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0x60 */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0x64 */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0x68 */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0x6c */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0x70 */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0x74 */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0x78 */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0x7c */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0x80 */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0x84 */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0x88 */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0x8c */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0x90 */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0x94 */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0x98 */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0x9c */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0xa0 */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0xa4 */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0xa8 */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0xac */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0xb0 */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0xb4 */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0xb8 */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0xbc */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0xc0 */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0xc4 */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0xc8 */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0xcc */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0xd0 */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0xd4 */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0xd8 */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0xdc */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0xe0 */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0xe4 */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0xe8 */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0xec */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0xf0 */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0xf4 */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0xf8 */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0xfc */	EMPTY, EMPTY, EMPTY, EMPTY
-};
-
-static make_EHelper(2byte_esc) {
-  uint32_t opcode = instr_fetch(pc, 1) | 0x100;
+#define OPCODE_TABLE(sz) { \
+  /* 0x00 */	EMPTY, EMPTY, EMPTY, EMPTY, \
+  /* 0x04 */	EMPTY, EMPTY, EMPTY, EMPTY, \
+  /* 0x08 */	EMPTY, EMPTY, EMPTY, EMPTY, \
+  /* 0x0c */	EMPTY, EMPTY, EMPTY, EXV(2byte_esc, sz), \
+  /* 0x10 */	EMPTY, EMPTY, EMPTY, EMPTY, \
+  /* 0x14 */	EMPTY, EMPTY, EMPTY, EMPTY, \
+  /* 0x18 */	EMPTY, EMPTY, EMPTY, EMPTY, \
+  /* 0x1c */	EMPTY, EMPTY, EMPTY, EMPTY, \
+  /* 0x20 */	EMPTY, EMPTY, EMPTY, EMPTY, \
+  /* 0x24 */	EMPTY, EMPTY, EMPTY, EMPTY, \
+  /* 0x28 */	EMPTY, EMPTY, EMPTY, EMPTY, \
+  /* 0x2c */	EMPTY, EMPTY, EMPTY, EMPTY, \
+  /* 0x30 */	EMPTY, EMPTY, EMPTY, EMPTY, \
+  /* 0x34 */	EMPTY, EMPTY, EMPTY, EMPTY, \
+  /* 0x38 */	EMPTY, EMPTY, EMPTY, EMPTY, \
+  /* 0x3c */	EMPTY, EMPTY, EMPTY, EMPTY, \
+  /* 0x40 */	EMPTY, EMPTY, EMPTY, EMPTY, \
+  /* 0x44 */	EMPTY, EMPTY, EMPTY, EMPTY, \
+  /* 0x48 */	EMPTY, EMPTY, EMPTY, EMPTY, \
+  /* 0x4c */	EMPTY, EMPTY, EMPTY, EMPTY, \
+  /* 0x50 */	EMPTY, EMPTY, EMPTY, EMPTY, \
+  /* 0x54 */	EMPTY, EMPTY, EMPTY, EMPTY, \
+  /* 0x58 */	EMPTY, EMPTY, EMPTY, EMPTY, \
+  /* 0x5c */	EMPTY, EMPTY, EMPTY, EMPTY, \
+  /* 0x60 */	EMPTY, EMPTY, EMPTY, EMPTY, \
+  /* 0x64 */	EMPTY, EMPTY, EX(operand_size), EMPTY, \
+  /* 0x68 */	EMPTY, EMPTY, EMPTY, EMPTY, \
+  /* 0x6c */	EMPTY, EMPTY, EMPTY, EMPTY, \
+  /* 0x70 */	EMPTY, EMPTY, EMPTY, EMPTY, \
+  /* 0x74 */	EMPTY, EMPTY, EMPTY, EMPTY, \
+  /* 0x78 */	EMPTY, EMPTY, EMPTY, EMPTY, \
+  /* 0x7c */	EMPTY, EMPTY, EMPTY, EMPTY, \
+  /* 0x80 */	IDEXV(I2E, gp1, b), IDEXV(I2E, gp1, sz), EMPTY, IDEXV(SI2E, gp1, sz), \
+  /* 0x84 */	EMPTY, EMPTY, EMPTY, EMPTY, \
+  /* 0x88 */	IDEXV(mov_G2E, mov, b), IDEXV(mov_G2E, mov, sz), IDEXV(mov_E2G, mov, b), IDEXV(mov_E2G, mov, sz), \
+  /* 0x8c */	EMPTY, EMPTY, EMPTY, EMPTY, \
+  /* 0x90 */	EMPTY, EMPTY, EMPTY, EMPTY, \
+  /* 0x94 */	EMPTY, EMPTY, EMPTY, EMPTY, \
+  /* 0x98 */	EMPTY, EMPTY, EMPTY, EMPTY, \
+  /* 0x9c */	EMPTY, EMPTY, EMPTY, EMPTY, \
+  /* 0xa0 */	IDEXV(O2a, mov, b), IDEXV(O2a, mov, sz), IDEXV(a2O, mov, b), IDEXV(a2O, mov, sz), \
+  /* 0xa4 */	EXV(movs, b), EXV(movs, sz), EMPTY, EMPTY, \
+  /* 0xa8 */	EMPTY, EMPTY, EXV(stos, b), EXV(stos, sz), \
+  /* 0xac */	EMPTY, EMPTY, EMPTY, EMPTY, \
+  /* 0xb0 */	IDEXV(mov_I2r, mov, b), IDEXV(mov_I2r, mov, b), IDEXV(mov_I2r, mov, b), IDEXV(mov_I2r, mov, b), \
+  /* 0xb4 */	IDEXV(mov_I2r, mov, b), IDEXV(mov_I2r, mov, b), IDEXV(mov_I2r, mov, b), IDEXV(mov_I2r, mov, b), \
+  /* 0xb8 */	IDEXV(mov_I2r, mov, sz), IDEXV(mov_I2r, mov, sz), IDEXV(mov_I2r, mov, sz), IDEXV(mov_I2r, mov, sz), \
+  /* 0xbc */	IDEXV(mov_I2r, mov, sz), IDEXV(mov_I2r, mov, sz), IDEXV(mov_I2r, mov, sz), IDEXV(mov_I2r, mov, sz), \
+  /* 0xc0 */	IDEXV(gp2_Ib2E, gp2, b), IDEXV(gp2_Ib2E, gp2, sz), EMPTY, EMPTY, \
+  /* 0xc4 */	EMPTY, EMPTY, IDEXV(mov_I2E, mov, b), IDEXV(mov_I2E, mov, sz), \
+  /* 0xc8 */	EMPTY, EMPTY, EMPTY, EMPTY, \
+  /* 0xcc */	EMPTY, IDEXW(I, int, 1), EMPTY, EX(iret), \
+  /* 0xd0 */	IDEXV(gp2_1_E, gp2, b), IDEXV(gp2_1_E, gp2, sz), IDEXV(gp2_cl2E, gp2, b), IDEXV(gp2_cl2E, gp2, sz), \
+  /* 0xd4 */	EMPTY, EMPTY, EX(nemu_trap), EMPTY, \
+  /* 0xd8 */	EMPTY, EMPTY, EMPTY, EMPTY, \
+  /* 0xdc */	EMPTY, EMPTY, EMPTY, EMPTY, \
+  /* 0xe0 */	EMPTY, EMPTY, EMPTY, EMPTY, \
+  /* 0xe4 */	EMPTY, EMPTY, EMPTY, EMPTY, \
+  /* 0xe8 */	EMPTY, EMPTY, EMPTY, EMPTY, \
+  /* 0xec */	EMPTY, EMPTY, EMPTY, EMPTY, \
+  /* 0xf0 */	EXV(lock, sz), EMPTY, EMPTY, EXV(rep, sz), \
+  /* 0xf4 */	EX(hlt), EMPTY, IDEXV(E, gp3, b), IDEXV(E, gp3, sz), \
+  /* 0xf8 */	EMPTY, EMPTY, EMPTY, EMPTY, \
+  /* 0xfc */	EX(cld), EX(std), IDEXV(E, gp4, b), IDEXV(E, gp5, sz), \
+ \
+/*2 byte_opcode_table */ \
+ \
+  /* 0x00 */	EMPTY, IDEXV(gp7_E, gp7, sz), EMPTY, EMPTY, \
+  /* 0x04 */	EMPTY, EMPTY, EMPTY, EMPTY, \
+  /* 0x08 */	EMPTY, EMPTY, EMPTY, EMPTY, \
+  /* 0x0c */	EMPTY, EMPTY, EMPTY, EMPTY, \
+  /* 0x10 */	EMPTY, EMPTY, EMPTY, EMPTY, \
+  /* 0x14 */	EMPTY, EMPTY, EMPTY, EMPTY, \
+  /* 0x18 */	EMPTY, EMPTY, EMPTY, EMPTY, \
+  /* 0x1c */	EMPTY, EMPTY, EMPTY, EMPTY, \
+  /* 0x20 */	IDEXW(mov_G2E, mov_cr2r, 4), EMPTY, IDEXW(mov_E2G, mov_r2cr, 4), EMPTY, \
+  /* 0x24 */	EMPTY, EMPTY, EMPTY, EMPTY, \
+  /* 0x28 */	EMPTY, EMPTY, EMPTY, EMPTY, \
+  /* 0x2c */	EMPTY, EMPTY, EMPTY, EMPTY, \
+  /* 0x30 */	EMPTY, EMPTY, EMPTY, EMPTY, \
+  /* 0x34 */	EMPTY, EMPTY, EMPTY, EMPTY, \
+  /* 0x38 */	EMPTY, EMPTY, EMPTY, EMPTY, \
+  /* 0x3c */	EMPTY, EMPTY, EMPTY, EMPTY, \
+  /* 0x40 */	EMPTY, EMPTY, EMPTY, EMPTY, \
+  /* 0x44 */	EMPTY, EMPTY, EMPTY, EMPTY, \
+  /* 0x48 */	EMPTY, EMPTY, EMPTY, EMPTY, \
+  /* 0x4c */	EMPTY, EMPTY, EMPTY, EMPTY, \
+  /* 0x50 */	EMPTY, EMPTY, EMPTY, EMPTY, \
+  /* 0x54 */	EMPTY, EMPTY, EMPTY, EMPTY, \
+  /* 0x58 */	EMPTY, EMPTY, EMPTY, EMPTY, \
+  /* 0x5c */	EMPTY, EMPTY, EMPTY, EMPTY, \
+  /* 0x60 */	EMPTY, EMPTY, EMPTY, EMPTY, \
+  /* 0x64 */	EMPTY, EMPTY, EMPTY, EMPTY, \
+  /* 0x68 */	EMPTY, EMPTY, EMPTY, EMPTY, \
+  /* 0x6c */	EMPTY, EMPTY, EMPTY, EMPTY, \
+  /* 0x70 */	EMPTY, EMPTY, EMPTY, EMPTY, \
+  /* 0x74 */	EMPTY, EMPTY, EMPTY, EMPTY, \
+  /* 0x78 */	EMPTY, EMPTY, EMPTY, EMPTY, \
+  /* 0x7c */	EMPTY, EMPTY, EMPTY, EMPTY, \
+  /* 0x80 */	EMPTY, EMPTY, EMPTY, EMPTY, \
+  /* 0x84 */	EMPTY, EMPTY, EMPTY, EMPTY, \
+  /* 0x88 */	EMPTY, EMPTY, EMPTY, EMPTY, \
+  /* 0x8c */	EMPTY, EMPTY, EMPTY, EMPTY, \
+  /* 0x90 */	EMPTY, EMPTY, EMPTY, EMPTY, \
+  /* 0x94 */	EMPTY, EMPTY, EMPTY, EMPTY, \
+  /* 0x98 */	EMPTY, EMPTY, EMPTY, EMPTY, \
+  /* 0x9c */	EMPTY, EMPTY, EMPTY, EMPTY, \
+  /* 0xa0 */	EMPTY, EMPTY, EMPTY, EMPTY, \
+  /* 0xa4 */	EMPTY, EMPTY, EMPTY, EMPTY, \
+  /* 0xa8 */	EMPTY, EMPTY, EMPTY, EMPTY, \
+  /* 0xac */	EMPTY, EMPTY, EMPTY, EMPTY, \
+  /* 0xb0 */	EMPTY, EMPTY, EMPTY, EMPTY, \
+  /* 0xb4 */	EMPTY, EMPTY, EMPTY, EMPTY, \
+  /* 0xb8 */	EMPTY, EMPTY, EMPTY, EMPTY, \
+  /* 0xbc */	EMPTY, EMPTY, EMPTY, EMPTY, \
+  /* 0xc0 */	EMPTY, EMPTY, EMPTY, EMPTY, \
+  /* 0xc4 */	EMPTY, EMPTY, EMPTY, EMPTY, \
+  /* 0xc8 */	EMPTY, EMPTY, EMPTY, EMPTY, \
+  /* 0xcc */	EMPTY, EMPTY, EMPTY, EMPTY, \
+  /* 0xd0 */	EMPTY, EMPTY, EMPTY, EMPTY, \
+  /* 0xd4 */	EMPTY, EMPTY, EMPTY, EMPTY, \
+  /* 0xd8 */	EMPTY, EMPTY, EMPTY, EMPTY, \
+  /* 0xdc */	EMPTY, EMPTY, EMPTY, EMPTY, \
+  /* 0xe0 */	EMPTY, EMPTY, EMPTY, EMPTY, \
+  /* 0xe4 */	EMPTY, EMPTY, EMPTY, EMPTY, \
+  /* 0xe8 */	EMPTY, EMPTY, EMPTY, EMPTY, \
+  /* 0xec */	EMPTY, EMPTY, EMPTY, EMPTY, \
+  /* 0xf0 */	EMPTY, EMPTY, EMPTY, EMPTY, \
+  /* 0xf4 */	EMPTY, EMPTY, EMPTY, EMPTY, \
+  /* 0xf8 */	EMPTY, EMPTY, EMPTY, EMPTY, \
+  /* 0xfc */	EMPTY, EMPTY, EMPTY, EMPTY \
+}
+
+static OpcodeEntry opcode_table_l [512] = OPCODE_TABLE(l);
+static OpcodeEntry opcode_table_w [512] = OPCODE_TABLE(w);
+
+/* `size' is the operand size of `table', used by the entries without a width */
+static inline OpcodeEntry* fetch_entry(vaddr_t *pc, OpcodeEntry *table, uint32_t esc, const int size) {
+  uint32_t opcode = instr_fetch(pc, 1) | esc;
   decinfo.opcode = opcode;
-  set_width(opcode_table[opcode].width);
-  idex(pc, &opcode_table[opcode]);
+  int width = (table[opcode].width == 0 ? size : table[opcode].width);
+  decinfo.src.width = decinfo.dest.width = decinfo.src2.width = width;
+  return &table[opcode];
+}
+
+static make_EHelper(2byte_esc_w) {
+  idex(pc, fetch_entry(pc, opcode_table_w, 0x100, 2));
+}
+
+static make_EHelper(2byte_esc_l) {
+  idex(pc, fetch_entry(pc, opcode_table_l, 0x100, 4));
+}
+
+OpcodeEntry* isa_fetch(vaddr_t *pc) {
+  return fetch_entry(pc, opcode_table_l, 0, 4);
 }
 
 void isa_exec(vaddr_t *pc) {
-  uint32_t opcode = instr_fetch(pc, 1);
-  decinfo.opcode = opcode;
-  set_width(opcode_table[opcode].width);
-  idex(pc, &opcode_table[opcode]);
+  idex(pc, isa_fetch(pc));
+}
+
+/* execute the instruction after a prefix with the operand size `size' */
+void isa_exec_prefixed(vaddr_t *pc, int size) {
+  if (size == 2) idex(pc, fetch_entry(pc, opcode_table_w, 0, 2));
+  else idex(pc, fetch_entry(pc, opcode_table_l, 0, 4));
+}
+
+#ifdef DECODE_CACHE
+OpcodeEntry* isa_fuse(DCEntry *a, const DCEntry *b) {
+  return NULL;
 }
+#endif
@@ -1,26 +1,34 @@
 #include "cpu/exec.h"
+#include "width.h"
 #include "cc.h"
 
-make_EHelper(test) {
-  TODO();
+make_EHelperW(test) {
+  rtl_and(&s0, &id_dest->val, &id_src->val);
+  rtl_set_cc(CC_OP_LOGIC, &s0, &id_dest->val, &id_src->val, width);
 
   print_asm_template2(test);
 }
 
-make_EHelper(and) {
-  TODO();
+make_EHelperW(and) {
+  rtl_and(&s0, &id_dest->val, &id_src->val);
+  operand_write_w(id_dest, &s0, width);
+  rtl_set_cc(CC_OP_LOGIC, &s0, &id_dest->val, &id_src->val, width);
 
   print_asm_template2(and);
 }
 
-make_EHelper(xor) {
-  TODO();
+make_EHelperW(xor) {
+  rtl_xor(&s0, &id_dest->val, &id_src->val);
+  operand_write_w(id_dest, &s0, width);
+  rtl_set_cc(CC_OP_LOGIC, &s0, &id_dest->val, &id_src->val, width);
 
   print_asm_template2(xor);
 }
 
-make_EHelper(or) {
-  TODO();
+make_EHelperW(or) {
+  rtl_or(&s0, &id_dest->val, &id_src->val);
+  operand_write_w(id_dest, &s0, width);
+  rtl_set_cc(CC_OP_LOGIC, &s0, &id_dest->val, &id_src->val, width);
 
   print_asm_template2(or);
 }
@@ -1,9 +1,20 @@
 #include "cpu/exec.h"
+#include "width.h"
 
-void isa_exec(vaddr_t *pc);
+void isa_exec_prefixed(vaddr_t *pc, int size);
 
 make_EHelper(operand_size) {
-  decinfo.isa.is_operand_size_16 = true;
-  isa_exec(pc);
-  decinfo.isa.is_operand_size_16 = false;
+  isa_exec_prefixed(pc, 2);
+}
+
+/* `width' is the operand size of the table with the prefix */
+make_EHelperW(rep) {
+  decinfo.isa.is_rep = true;
+  isa_exec_prefixed(pc, width);
+  decinfo.isa.is_rep = false;
+}
+
+/* Only one CPU runs at a time, so every instruction is atomic already. */
+make_EHelperW(lock) {
+  isa_exec_prefixed(pc, width);
 }
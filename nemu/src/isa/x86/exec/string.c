@@ -0,0 +1,106 @@
+#include "cpu/exec.h"
+#include "width.h"
+
+/* String instructions with only 32-bit addressing. With the `rep' prefix,
+ * the whole run is executed in one step. Elements moving forward inside
+ * one page of pmem are accessed in bulk with paddr_memcpy() and
+ * paddr_memset(), and the others are accessed one by one. */
+
+/* the number of whole elements from `addr' to the end of its page */
+static inline uint32_t elems_in_page(vaddr_t addr, int width) {
+  return (PAGE_SIZE - (addr & PAGE_MASK)) / width;
+}
+
+static inline uint32_t min(uint32_t a, uint32_t b) {
+  return (a < b ? a : b);
+}
+
+static inline bool inside_pmem(paddr_t addr, uint32_t len) {
+  return pmem_offset(addr) >= 0 && pmem_offset(addr + len - 1) >= 0;
+}
+
+/* Return the number of elements copied, or 0 if the next one
+ * should be copied alone. */
+static uint32_t movs_bulk(vaddr_t dest, vaddr_t src, int width, uint32_t count) {
+  uint32_t n = min(count, min(elems_in_page(dest, width), elems_in_page(src, width)));
+  if (n <= 1) return 0;
+
+  uint32_t len = n * width;
+  paddr_t psrc = isa_vaddr_translate(src, false);
+  paddr_t pdest = isa_vaddr_translate(dest, true);
+  if (!inside_pmem(psrc, len) || !inside_pmem(pdest, len)) return 0;
+  /* paddr_memcpy() copies byte by byte, which is wrong for wider
+   * elements if the destination overlaps the source behind it */
+  if (width > 1 && pdest > psrc && pdest < psrc + len) return 0;
+
+  paddr_memcpy(pdest, psrc, len);
+  return n;
+}
+
+static uint32_t stos_bulk(vaddr_t dest, uint32_t data, int width, uint32_t count) {
+  uint32_t n = min(count, elems_in_page(dest, width));
+  if (n <= 1) return 0;
+
+  uint32_t len = n * width;
+  paddr_t pdest = isa_vaddr_translate(dest, true);
+  if (!inside_pmem(pdest, len)) return 0;
+
+  uint32_t mask = ~0u >> ((4 - width) * 8);
+  if (((data & 0xff) * 0x01010101u & mask) == (data & mask)) {
+    paddr_memset(pdest, data & 0xff, len);
+  }
+  else {
+    /* repeat the first element by an overlapping copy */
+    paddr_write(pdest, data, width);
+    paddr_memcpy(pdest + width, pdest, len - width);
+  }
+  return n;
+}
+
+make_EHelperW(movs) {
+  uint32_t count = (decinfo.isa.is_rep ? reg_l(R_ECX) : 1);
+  int step = (cpu.eflags.DF ? -width : width);
+
+  while (count > 0) {
+    uint32_t n = (step > 0 ? movs_bulk(reg_l(R_EDI), reg_l(R_ESI), width, count) : 0);
+    if (n == 0) {
+      vaddr_write(reg_l(R_EDI), vaddr_read(reg_l(R_ESI), width), width);
+      n = 1;
+    }
+    reg_l(R_ESI) += n * step;
+    reg_l(R_EDI) += n * step;
+    count -= n;
+  }
+  if (decinfo.isa.is_rep) reg_l(R_ECX) = 0;
+
+  print_asm("%smovs%c", decinfo.isa.is_rep ? "rep " : "", suffix_char(width));
+}
+
+make_EHelperW(stos) {
+  uint32_t count = (decinfo.isa.is_rep ? reg_l(R_ECX) : 1);
+  int step = (cpu.eflags.DF ? -width : width);
+
+  rtl_lr(&s0, R_EAX, width);
+  while (count > 0) {
+    uint32_t n = (step > 0 ? stos_bulk(reg_l(R_EDI), s0, width, count) : 0);
+    if (n == 0) {
+      vaddr_write(reg_l(R_EDI), s0, width);
+      n = 1;
+    }
+    reg_l(R_EDI) += n * step;
+    count -= n;
+  }
+  if (decinfo.isa.is_rep) reg_l(R_ECX) = 0;
+
+  print_asm("%sstos%c", decinfo.isa.is_rep ? "rep " : "", suffix_char(width));
+}
+
+make_EHelper(cld) {
+  cpu.eflags.DF = 0;
+  print_asm("cld");
+}
+
+make_EHelper(std) {
+  cpu.eflags.DF = 1;
+  print_asm("std");
+}
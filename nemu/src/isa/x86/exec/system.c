@@ -1,19 +1,41 @@
 #include "cpu/exec.h"
+#include "cpu/decode-cache.h"
+#include "monitor/monitor.h"
+
+void x86_gate_flush(void);
+void x86_pop_frame(uint32_t *frame, int n);
+void raise_intr(uint32_t NO, vaddr_t ret_addr);
 
 make_EHelper(lidt) {
-  TODO();
+  cpu.idtr.limit = vaddr_read(id_dest->addr, 2);
+  cpu.idtr.base = vaddr_read(id_dest->addr + 2, 4);
+  x86_gate_flush();
 
   print_asm_template1(lidt);
 }
 
 make_EHelper(mov_r2cr) {
-  TODO();
+  switch (id_dest->reg) {
+    case 0: cpu.cr0.val = id_src->val; break;
+    case 3: cpu.cr3.val = id_src->val; break;
+    default: panic("writing to cr%d is not supported", id_dest->reg);
+  }
+
+  /* the translation may change */
+  isa_mmu_flush();
+  ifetch_flush();
+  dcache_flush();
 
   print_asm("movl %%%s,%%cr%d", reg_name(id_src->reg, 4), id_dest->reg);
 }
 
 make_EHelper(mov_cr2r) {
-  TODO();
+  switch (id_src->reg) {
+    case 0: rtl_li(&s0, cpu.cr0.val); break;
+    case 3: rtl_li(&s0, cpu.cr3.val); break;
+    default: panic("reading cr%d is not supported", id_src->reg);
+  }
+  rtl_sr(id_dest->reg, &s0, 4);
 
   print_asm("movl %%cr%d,%%%s", id_src->reg, reg_name(id_dest->reg, 4));
 
@@ -21,7 +43,7 @@ make_EHelper(mov_cr2r) {
 }
 
 make_EHelper(int) {
-  TODO();
+  raise_intr(id_dest->val, *pc);
 
   print_asm("int %s", id_dest->str);
 
@@ -29,11 +51,22 @@ make_EHelper(int) {
 }
 
 make_EHelper(iret) {
-  TODO();
+  /* eip, cs and eflags from the top */
+  uint32_t frame[3];
+  x86_pop_frame(frame, 3);
+  cpu.cs = frame[1];
+#ifdef LAZY_CC
+  cpu.cc.op = CC_OP_NONE;
+#endif
+  cpu.eflags.val = frame[2];
+  intr_update();
+  rtl_j(frame[0]);
 
   print_asm("iret");
 }
 
+void device_idle_sleep(uint32_t usec);
+
 uint32_t pio_read_l(ioaddr_t);
 uint32_t pio_read_w(ioaddr_t);
 uint32_t pio_read_b(ioaddr_t);
@@ -52,3 +85,11 @@ make_EHelper(out) {
 
   print_asm_template2(out);
 }
+
+make_EHelper(hlt) {
+  /* stay halted until an interrupt arrives, without burning the host CPU */
+  device_idle_sleep(1000);
+  rtl_j(cpu.pc);
+
+  print_asm("hlt");
+}
@@ -0,0 +1,32 @@
+#ifndef __X86_WIDTH_H__
+#define __X86_WIDTH_H__
+
+#include "cpu/exec.h"
+
+/* EHelpers specialized for each operand width.
+ *
+ * `make_EHelperW(name)' defines exec_name_b(), exec_name_w() and exec_name_l()
+ * for 8-, 16- and 32-bit operands. In the body, `width' is the width of the
+ * operands, which is a constant in each variant, so the branches on the
+ * width in rtl_lr(), rtl_sr() and the flag helpers are resolved at compile
+ * time. The opcode table picks a variant with IDEXV(), see exec.c.
+ */
+#define make_EHelperW(name) \
+  static inline __attribute__((always_inline)) void concat(width_exec_, name) (vaddr_t *pc, const int width); \
+  make_EHelper(concat(name, _b)) { concat(width_exec_, name) (pc, 1); } \
+  make_EHelper(concat(name, _w)) { concat(width_exec_, name) (pc, 2); } \
+  make_EHelper(concat(name, _l)) { concat(width_exec_, name) (pc, 4); } \
+  static inline __attribute__((always_inline)) void concat(width_exec_, name) (vaddr_t *pc, const int width)
+
+#define declare_EHelperW(name) \
+  make_EHelper(concat(name, _b)); \
+  make_EHelper(concat(name, _w)); \
+  make_EHelper(concat(name, _l))
+
+static inline void operand_write_w(Operand *op, rtlreg_t* src, int width) {
+  if (op->type == OP_TYPE_REG) { rtl_sr(op->reg, src, width); }
+  else if (op->type == OP_TYPE_MEM) { rtl_sm(&op->addr, src, width); }
+  else { assert(0); }
+}
+
+#endif
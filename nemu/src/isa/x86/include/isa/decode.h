@@ -4,8 +4,16 @@
 #include "common.h"
 #include "cpu/decode.h"
 
+/* the maximum length of an instruction in bytes */
+#define ISA_INSTR_MAX 15
+
+/* the opcode counted by OPCODE_STAT from the bytes `p' of an
+ * instruction: first byte, prefixes are not skipped */
+#define ISA_NR_OPCODE 256
+#define isa_opcode(p) ((p)[0])
+
 struct ISADecodeInfo {
-  bool is_operand_size_16;
+  bool is_rep;
   uint8_t ext_opcode;
 };
 
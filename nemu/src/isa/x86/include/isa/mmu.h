@@ -68,6 +68,9 @@ typedef union PageTableEntry {
 
 typedef PTE (*PT) [NR_PTE];
 
+/* translate `addr' for accessing data, with the same side effects as the access */
+paddr_t isa_vaddr_translate(vaddr_t addr, bool is_write);
+
 typedef union GateDescriptor {
   struct {
     uint32_t offset_15_0      : 16;
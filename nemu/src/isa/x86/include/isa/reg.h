@@ -2,6 +2,7 @@
 #define __X86_REG_H__
 
 #include "common.h"
+#include "isa/mmu.h"
 
 #define PC_START IMAGE_START
 
@@ -32,6 +33,41 @@ typedef struct {
 
   vaddr_t pc;
 
+  /* With LAZY_CC, some flags may be pending in `cc' below,
+   * so always access them with rtl_get_*() and rtl_set_*(). */
+  union {
+    struct {
+      uint32_t CF : 1;
+      uint32_t    : 5;
+      uint32_t ZF : 1;
+      uint32_t SF : 1;
+      uint32_t    : 1;
+      uint32_t IF : 1;
+      uint32_t DF : 1;
+      uint32_t OF : 1;
+      uint32_t    : 20;
+    };
+    rtlreg_t val;
+  } eflags;
+
+  CR0 cr0;
+  CR3 cr3;
+
+  struct {
+    uint16_t limit;
+    uint32_t base;
+  } idtr;
+  rtlreg_t cs;
+
+#ifdef LAZY_CC
+  /* the last flag-producing operation not yet reflected in `eflags' */
+  struct {
+    uint32_t op;
+    int width;
+    rtlreg_t res, src1, src2;
+  } cc;
+#endif
+
 } CPU_state;
 
 static inline int check_reg_index(int index) {
@@ -39,6 +75,14 @@ static inline int check_reg_index(int index) {
   return index;
 }
 
+uint32_t *isa_reg_str2ptr(const char *s);
+/* the return addresses on the stack by the frame pointer, the innermost first */
+int isa_backtrace(vaddr_t *ret, int max);
+/* FT_CALL or FT_RET if the instruction of `len' bytes is a call or a return */
+int isa_ftrace_kind(const uint8_t *instr, int len);
+/* the i-th register in the order of the 'g' packet of GDB, or NULL past the last one */
+uint32_t *isa_gdb_reg(int i);
+
 #define reg_l(index) (cpu.gpr[check_reg_index(index)]._32)
 #define reg_w(index) (cpu.gpr[check_reg_index(index)]._16)
 #define reg_b(index) (cpu.gpr[check_reg_index(index) & 0x3]._8[index >> 2])
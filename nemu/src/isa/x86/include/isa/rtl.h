@@ -38,33 +38,78 @@ static inline void rtl_pop(rtlreg_t* dest) {
 static inline void rtl_is_sub_overflow(rtlreg_t* dest,
     const rtlreg_t* res, const rtlreg_t* src1, const rtlreg_t* src2, int width) {
   // dest <- is_overflow(src1 - src2)
-  TODO();
+  rtl_xor(&t0, src1, src2);
+  rtl_xor(&t1, src1, res);
+  rtl_and(dest, &t0, &t1);
+  rtl_shri(dest, dest, width * 8 - 1);
+  rtl_andi(dest, dest, 0x1);
 }
 
 static inline void rtl_is_sub_carry(rtlreg_t* dest,
     const rtlreg_t* res, const rtlreg_t* src1) {
   // dest <- is_carry(src1 - src2)
-  TODO();
+  rtl_setrelop(RELOP_GTU, dest, res, src1);
 }
 
 static inline void rtl_is_add_overflow(rtlreg_t* dest,
     const rtlreg_t* res, const rtlreg_t* src1, const rtlreg_t* src2, int width) {
   // dest <- is_overflow(src1 + src2)
-  TODO();
+  rtl_xor(&t0, src1, src2);
+  rtl_xori(&t0, &t0, -1);
+  rtl_xor(&t1, src1, res);
+  rtl_and(dest, &t0, &t1);
+  rtl_shri(dest, dest, width * 8 - 1);
+  rtl_andi(dest, dest, 0x1);
 }
 
 static inline void rtl_is_add_carry(rtlreg_t* dest,
     const rtlreg_t* res, const rtlreg_t* src1) {
   // dest <- is_carry(src1 + src2)
-  TODO();
+  rtl_setrelop(RELOP_LTU, dest, res, src1);
+}
+
+/* Flag-producing operations recorded by rtl_set_cc(). */
+enum { CC_OP_NONE, CC_OP_ADD, CC_OP_SUB, CC_OP_INC, CC_OP_DEC, CC_OP_LOGIC };
+
+/* eflags <- flags of `op' with the given operands, defined in exec/cc.c */
+void rtl_compute_cc(uint32_t op, rtlreg_t res, rtlreg_t src1, rtlreg_t src2, int width);
+
+#ifdef LAZY_CC
+static inline void rtl_cc_sync(void) {
+  if (cpu.cc.op != CC_OP_NONE) {
+    rtl_compute_cc(cpu.cc.op, cpu.cc.res, cpu.cc.src1, cpu.cc.src2, cpu.cc.width);
+    cpu.cc.op = CC_OP_NONE;
+  }
+}
+#else
+#define rtl_cc_sync()
+#endif
+
+/* Update CF, OF, ZF and SF as the result of `op'. INC and DEC keep CF.
+ * With LAZY_CC the flags are only recorded here, and computed when
+ * they are read. */
+static inline void rtl_set_cc(uint32_t op, const rtlreg_t* res,
+    const rtlreg_t* src1, const rtlreg_t* src2, int width) {
+#ifdef LAZY_CC
+  if (op == CC_OP_INC || op == CC_OP_DEC) rtl_cc_sync();
+  cpu.cc.op = op;
+  cpu.cc.width = width;
+  cpu.cc.res = *res;
+  cpu.cc.src1 = *src1;
+  cpu.cc.src2 = *src2;
+#else
+  rtl_compute_cc(op, *res, *src1, *src2, width);
+#endif
 }
 
 #define make_rtl_setget_eflags(f) \
   static inline void concat(rtl_set_, f) (const rtlreg_t* src) { \
-    TODO(); \
+    rtl_cc_sync(); \
+    cpu.eflags.f = *src; \
   } \
   static inline void concat(rtl_get_, f) (rtlreg_t* dest) { \
-    TODO(); \
+    rtl_cc_sync(); \
+    *dest = cpu.eflags.f; \
   }
 
 make_rtl_setget_eflags(CF)
@@ -74,12 +119,14 @@ make_rtl_setget_eflags(SF)
 
 static inline void rtl_update_ZF(const rtlreg_t* result, int width) {
   // eflags.ZF <- is_zero(result[width * 8 - 1 .. 0])
-  TODO();
+  rtl_cc_sync();
+  cpu.eflags.ZF = ((*result << ((4 - width) * 8)) == 0);
 }
 
 static inline void rtl_update_SF(const rtlreg_t* result, int width) {
   // eflags.SF <- is_sign(result[width * 8 - 1 .. 0])
-  TODO();
+  rtl_cc_sync();
+  cpu.eflags.SF = ((*result >> (width * 8 - 1)) & 0x1);
 }
 
 static inline void rtl_update_ZFSF(const rtlreg_t* result, int width) {
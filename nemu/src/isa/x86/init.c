@@ -16,6 +16,7 @@ const long isa_default_img_size = sizeof(isa_default_img);
 static void restart() {
   /* Set the initial program counter. */
   cpu.pc = PC_START;
+  cpu.cs = 8;
 }
 
 void init_isa(void) {
@@ -26,6 +27,10 @@ void init_isa(void) {
   /* Setup physical memory address space. */
   register_pmem(0);
 
+  /* Compute the addressing forms of the ModR/M and SIB bytes. */
+  void init_modrm(void);
+  init_modrm();
+
   /* Initialize this virtual computer system. */
   restart();
 }
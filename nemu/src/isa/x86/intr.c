@@ -1,11 +1,120 @@
-#include "rtl/rtl.h"
+#include "cpu/exec.h"
+#include "monitor/monitor.h"
+#include "monitor/perf.h"
+
+/* The gate descriptors are cached after they are read from the IDT, with
+ * the page of pmem they come from. A page of the IDT written since then
+ * is found by its dirty bit of PMEM_DIRTY_IDT, and all the gates from it
+ * are dropped. Everything is dropped by `lidt' and by isa_mmu_flush(),
+ * since the IDT is read through the translation. */
+
+typedef struct {
+  vaddr_t target;
+  int page;  // -1 if invalid
+} GateCache;
+
+static GateCache gates[256];
+static uint64_t nr_intr = 0, nr_gate_miss = 0;
+
+void x86_gate_flush(void) {
+  int i;
+  for (i = 0; i < 256; i ++) gates[i].page = -1;
+}
+
+/* drop the gates from `page' if it has been written */
+static inline void gate_check_page(int page) {
+  if (!pmem_is_dirty(page, PMEM_DIRTY_IDT)) return;
+  int i;
+  for (i = 0; i < 256; i ++) {
+    if (gates[i].page == page) gates[i].page = -1;
+  }
+  pmem_clear_dirty(page, 1, PMEM_DIRTY_IDT);
+}
+
+static vaddr_t gate_target(uint32_t NO) {
+  Assert(NO * 8 + 7 <= cpu.idtr.limit, "interrupt %d is out of the IDT at pc = 0x%08x", NO, cpu.pc);
+  GateCache *g = &gates[NO];
+  if (g->page != -1) gate_check_page(g->page);
+  if (g->page != -1) return g->target;
+
+  nr_gate_miss ++;
+  vaddr_t addr = cpu.idtr.base + NO * 8;
+  /* `val' of GateDesc is only the low word */
+  uint32_t w[2] = { vaddr_read(addr, 4), vaddr_read(addr + 4, 4) };
+  GateDesc gate;
+  memcpy(&gate, w, sizeof(gate));
+  Assert(gate.present, "the gate of interrupt %d is not present at pc = 0x%08x", NO, cpu.pc);
+  vaddr_t target = (gate.offset_31_16 << 16) | gate.offset_15_0;
+
+  /* only cache a gate inside one page of pmem */
+  int offset = pmem_offset(isa_vaddr_translate(addr, false));
+  if (offset >= 0 && (addr & PAGE_MASK) <= PAGE_SIZE - 8) {
+    int page = offset / PAGE_SIZE;
+    gate_check_page(page);
+    *g = (GateCache) { .target = target, .page = page };
+  }
+  return target;
+}
+
+/* Push the words of `frame' onto the stack, the last one at the top. The
+ * frame is written at once when the stack does not cross a page. */
+static inline void push_frame(const uint32_t *frame, int n) {
+  vaddr_t top = cpu.esp - n * 4;
+  if ((top & PAGE_MASK) <= PAGE_SIZE - n * 4) {
+    uint32_t buf[n];
+    int i;
+    for (i = 0; i < n; i ++) buf[i] = frame[n - 1 - i];
+    paddr_write_host(isa_vaddr_translate(top, true), buf, n * 4);
+  }
+  else {
+    int i;
+    for (i = 0; i < n; i ++) vaddr_write(cpu.esp - (i + 1) * 4, frame[i], 4);
+  }
+  cpu.esp = top;
+}
+
+/* pop the words of `frame' from the stack, the first one at the top */
+void x86_pop_frame(uint32_t *frame, int n) {
+  vaddr_t top = cpu.esp;
+  if ((top & PAGE_MASK) <= PAGE_SIZE - n * 4) {
+    paddr_read_host(frame, isa_vaddr_translate(top, false), n * 4);
+  }
+  else {
+    int i;
+    for (i = 0; i < n; i ++) frame[i] = vaddr_read(top + i * 4, 4);
+  }
+  cpu.esp = top + n * 4;
+}
 
 void raise_intr(uint32_t NO, vaddr_t ret_addr) {
-  /* TODO: Trigger an interrupt/exception with ``NO''.
-   * That is, use ``NO'' to index the IDT.
-   */
+  nr_intr ++;
+  vaddr_t target = gate_target(NO);
+
+  rtl_cc_sync();
+  uint32_t frame[3] = { cpu.eflags.val, cpu.cs, ret_addr };
+  push_frame(frame, 3);
+  cpu.eflags.IF = 0;
+
+  rtl_j(target);
+}
+
+#define IRQ_TIMER 32
+
+bool isa_intr_enabled(void) {
+  return cpu.eflags.IF;
 }
 
 bool isa_query_intr(void) {
-  return false;
+  if (!cpu.eflags.IF) return false;
+  raise_intr(IRQ_TIMER, cpu.pc);
+  /* between instructions, so the jump is taken here */
+  update_pc();
+  return true;
+}
+
+void x86_intr_perf(PerfOut *o) {
+  perf_begin(o, "intr");
+  perf_u64(o, "raise", nr_intr);
+  perf_u64(o, "gate_miss", nr_gate_miss);
+  perf_end(o);
 }
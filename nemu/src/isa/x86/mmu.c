@@ -1,9 +1,172 @@
 #include "nemu.h"
+#include "cpu/decode-cache.h"
+#include "memory/cache.h"
+#include "memory/heatmap.h"
+#include "monitor/perf.h"
+
+/* A direct-mapped software TLB from virtual pages to pages of pmem.
+ * There are separate entries for reading, writing and fetching, so a
+ * write only hits on a page whose dirty bit is already set. Pages outside
+ * pmem are never cached. The TLB is flushed on every write to CR0 or CR3.
+ */
+
+#define NR_TLB 256
+
+enum { TLB_READ, TLB_WRITE, TLB_FETCH, NR_TLB_TYPE };
+
+typedef struct {
+  vaddr_t vpn;
+  paddr_t ppn;
+  uint8_t *host;  // the page in pmem
+} TLBEntry;
+
+static TLBEntry tlb[NR_TLB_TYPE][NR_TLB];
+
+void isa_mmu_flush(void) {
+  memset(tlb, 0xff, sizeof(tlb));
+
+  /* the gates are read through the translation */
+  void x86_gate_flush(void);
+  x86_gate_flush();
+}
+
+bool isa_vm_enabled(void) {
+  return cpu.cr0.paging;
+}
+
+static paddr_t page_walk(vaddr_t addr, bool is_write) {
+  paddr_t pde_addr = (cpu.cr3.page_directory_base << 12) | ((addr >> 22) << 2);
+  PDE pde = { .val = paddr_read(pde_addr, 4) };
+  Assert(pde.present, "page directory entry of vaddr 0x%08x is not present at pc = 0x%08x", addr, cpu.pc);
+
+  paddr_t pte_addr = (pde.page_frame << 12) | (((addr >> 12) & (NR_PTE - 1)) << 2);
+  PTE pte = { .val = paddr_read(pte_addr, 4) };
+  Assert(pte.present, "page table entry of vaddr 0x%08x is not present at pc = 0x%08x", addr, cpu.pc);
+
+  if (!pde.accessed) {
+    pde.accessed = 1;
+    paddr_write(pde_addr, pde.val, 4);
+  }
+  if (!pte.accessed || (is_write && !pte.dirty)) {
+    pte.accessed = 1;
+    pte.dirty |= is_write;
+    paddr_write(pte_addr, pte.val, 4);
+  }
+
+  return pte.page_frame << 12;
+}
+
+/* Return the TLB entry of `addr' for accessing with `type'. */
+static uint64_t nr_tlb_access = 0, nr_tlb_miss = 0;
+
+static inline TLBEntry* tlb_lookup(vaddr_t addr, int type) {
+  vaddr_t vpn = addr / PAGE_SIZE;
+  TLBEntry *e = &tlb[type][vpn % NR_TLB];
+  nr_tlb_access ++;
+  if (e->vpn != vpn) {
+    nr_tlb_miss ++;
+    paddr_t ppn = page_walk(addr, type == TLB_WRITE);
+    int offset = pmem_offset(ppn);
+    e->vpn = vpn;
+    e->ppn = ppn;
+    /* the walk is done again for each access outside pmem */
+    if (offset < 0) e->vpn = -1;
+    e->host = (offset < 0 ? NULL : pmem + offset);
+  }
+  return e;
+}
+
+static inline paddr_t page_translate(vaddr_t addr, int type) {
+  return tlb_lookup(addr, type)->ppn | (addr & PAGE_MASK);
+}
+
+static inline bool cross_page(vaddr_t addr, int len) {
+  return (addr & PAGE_MASK) + len > PAGE_SIZE;
+}
 
 uint32_t isa_vaddr_read(vaddr_t addr, int len) {
-  return paddr_read(addr, len);
+  if (!cpu.cr0.paging) return paddr_read(addr, len);
+
+  if (cross_page(addr, len)) {
+    /* read the two parts separately */
+    int len1 = PAGE_SIZE - (addr & PAGE_MASK);
+    uint32_t lo = isa_vaddr_read(addr, len1);
+    uint32_t hi = isa_vaddr_read(addr + len1, len - len1);
+    return lo | (hi << (len1 * 8));
+  }
+
+  TLBEntry *e = tlb_lookup(addr, TLB_READ);
+  if (e->vpn == addr / PAGE_SIZE) {
+    cache_access(e->ppn | (addr & PAGE_MASK), len, CACHE_READ);
+    heatmap_count(e->host - pmem, HEAT_READ);
+    return host_read(e->host + (addr & PAGE_MASK), len);
+  }
+  return paddr_read(e->ppn | (addr & PAGE_MASK), len);
 }
 
 void isa_vaddr_write(vaddr_t addr, uint32_t data, int len) {
-  paddr_write(addr, data, len);
+  if (!cpu.cr0.paging) {
+    paddr_write(addr, data, len);
+    return;
+  }
+
+  if (cross_page(addr, len)) {
+    int len1 = PAGE_SIZE - (addr & PAGE_MASK);
+    isa_vaddr_write(addr, data, len1);
+    isa_vaddr_write(addr + len1, data >> (len1 * 8), len - len1);
+    return;
+  }
+
+  TLBEntry *e = tlb_lookup(addr, TLB_WRITE);
+  if (e->vpn == addr / PAGE_SIZE) {
+    host_write(e->host + (addr & PAGE_MASK), data, len);
+    pmem_after_write(e->host - pmem + (addr & PAGE_MASK), len);
+    return;
+  }
+  paddr_write(e->ppn | (addr & PAGE_MASK), data, len);
+}
+
+paddr_t isa_vaddr_translate(vaddr_t addr, bool is_write) {
+  if (!cpu.cr0.paging) return addr;
+  return page_translate(addr, is_write ? TLB_WRITE : TLB_READ);
+}
+
+paddr_t isa_fetch_paddr(vaddr_t addr) {
+  if (!cpu.cr0.paging) return addr;
+  return page_translate(addr, TLB_FETCH);
+}
+
+/* read an entry of the page table, 0 (not present) if it is not in pmem */
+static inline uint32_t probe_entry(paddr_t addr) {
+  int offset = pmem_offset(addr);
+  return (offset < 0 ? 0 : host_read(pmem + offset, 4));
+}
+
+/* walk the page table without the TLB and the accessed bits */
+paddr_t isa_fetch_probe(vaddr_t addr, bool *success) {
+  *success = true;
+  if (!cpu.cr0.paging) return addr;
+
+  PDE pde = { .val = probe_entry((cpu.cr3.page_directory_base << 12) | ((addr >> 22) << 2)) };
+  PTE pte = { .val = (pde.present ?
+    probe_entry((pde.page_frame << 12) | (((addr >> 12) & (NR_PTE - 1)) << 2)) : 0) };
+  if (!pte.present) {
+    *success = false;
+    return 0;
+  }
+  return (pte.page_frame << 12) | (addr & PAGE_MASK);
+}
+
+void isa_perf(PerfOut *o) {
+  perf_begin(o, "tlb");
+  perf_u64(o, "access", nr_tlb_access);
+  perf_u64(o, "miss", nr_tlb_miss);
+  perf_double(o, "hit_rate", nr_tlb_access == 0 ? 0.0 :
+      1.0 - (double)nr_tlb_miss / nr_tlb_access);
+  perf_end(o);
+
+  void x86_predecode_perf(PerfOut *o);
+  x86_predecode_perf(o);
+  void x86_intr_perf(PerfOut *o);
+  x86_intr_perf(o);
 }
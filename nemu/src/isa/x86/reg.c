@@ -1,4 +1,6 @@
 #include "nemu.h"
+#include "monitor/ftrace.h"
+#include "rtl/rtl.h"
 #include <stdlib.h>
 #include <time.h>
 
@@ -46,3 +48,49 @@ void isa_reg_display() {
 uint32_t isa_reg_str2val(const char *s, bool *success) {
   return 0;
 }
+
+uint32_t *isa_reg_str2ptr(const char *s) {
+  return NULL;
+}
+
+/* With the frame pointer, ebp points to the frame pointer of the caller,
+ * above which is the return address. */
+int isa_backtrace(vaddr_t *ret, int max) {
+  vaddr_t fp = cpu.ebp;
+  int n = 0;
+  while (n < max) {
+    uint32_t ra, prev;
+    if (!vaddr_probe_word(fp + 4, &ra) || !vaddr_probe_word(fp, &prev)) break;
+    ret[n ++] = ra;
+    /* the stack grows downwards */
+    if (prev <= fp) break;
+    fp = prev;
+  }
+  return n;
+}
+
+/* call rel32, call r/m and near ret, after the operand-size prefix */
+int isa_ftrace_kind(const uint8_t *instr, int len) {
+  int k = 0;
+  while (k < len && instr[k] == 0x66) k ++;
+  if (k >= len) return 0;
+  switch (instr[k]) {
+    case 0xe8: return FT_CALL;
+    case 0xff: return (k + 1 < len && ((instr[k + 1] >> 3) & 7) == 2 ? FT_CALL : 0);
+    case 0xc2: case 0xc3: return FT_RET;
+    default: return 0;
+  }
+}
+
+/* eax-edi, eip, eflags, cs, ss, ds, es, fs, gs. Segments are not
+ * simulated, so they read as 0 and writes are dropped. */
+uint32_t *isa_gdb_reg(int i) {
+  static uint32_t dummy;
+  if (i < 8) return &reg_l(i);
+  switch (i) {
+    case 8: return &cpu.pc;
+    case 9: rtl_cc_sync(); return &cpu.eflags.val;
+  }
+  if (i < 16) { dummy = 0; return &dummy; }
+  return NULL;
+}
@@ -0,0 +1,222 @@
+#include "nemu.h"
+#include "memory/cache.h"
+#include "monitor/perf.h"
+#include "monitor/sample.h"
+#include <stdlib.h>
+#include <strings.h>
+
+#ifdef CACHE_SIM
+
+/* A model of a cache hierarchy with split L1 instruction and data caches
+ * backed by a unified L2. Each cache is set associative with LRU
+ * replacement, write-back and write-allocate. Only the tags are kept,
+ * the data still comes from pmem, so the simulation never changes what
+ * the guest sees. Accesses to MMIO are not cached.
+ *
+ * The hierarchy is configured by a string of comma separated items:
+ *   l1i=SIZE:WAYS:BLOCK, l1d=SIZE:WAYS:BLOCK, l2=SIZE:WAYS:BLOCK
+ *     SIZE may end with K or M, and `off' removes the cache
+ *   sample=ON/PERIOD
+ *     only simulate the first ON accesses in every PERIOD accesses
+ * Sampling trades accuracy for speed: the caches are not updated by the
+ * accesses skipped, so the state is stale at the start of each window.
+ */
+
+typedef struct {
+  uint32_t tag;
+  bool valid, dirty;
+  uint64_t last_use;
+} CacheLine;
+
+typedef struct Cache {
+  const char *name;
+  uint32_t size, ways, block;
+  uint32_t nr_set;
+  CacheLine *lines;
+  struct Cache *next;
+
+  uint64_t nr_access, nr_hit, nr_miss, nr_evict, nr_writeback;
+} Cache;
+
+static Cache l1i = { .name = "L1I", .size = 32 * 1024, .ways = 8, .block = 64 };
+static Cache l1d = { .name = "L1D", .size = 32 * 1024, .ways = 8, .block = 64 };
+static Cache l2  = { .name = "L2",  .size = 256 * 1024, .ways = 8, .block = 64 };
+static Cache *caches[] = { &l1i, &l1d, &l2 };
+#define NR_CACHE (sizeof(caches) / sizeof(caches[0]))
+
+static uint64_t sample_on = 1, sample_period = 1;
+static uint64_t nr_access = 0, nr_sampled = 0;
+static uint64_t lru_clock = 0;
+
+static inline bool is_pow2(uint32_t x) {
+  return x != 0 && (x & (x - 1)) == 0;
+}
+
+static void cache_access_level(Cache *c, paddr_t addr, int len, bool is_write);
+
+static void cache_access_block(Cache *c, paddr_t addr, bool is_write) {
+  uint32_t blk = addr / c->block;
+  uint32_t set = blk & (c->nr_set - 1);
+  uint32_t tag = blk / c->nr_set;
+  CacheLine *l = &c->lines[set * c->ways];
+  CacheLine *victim = &l[0];
+  int i;
+
+  c->nr_access ++;
+  lru_clock ++;
+  for (i = 0; i < c->ways; i ++) {
+    if (l[i].valid && l[i].tag == tag) {
+      c->nr_hit ++;
+      l[i].last_use = lru_clock;
+      l[i].dirty |= is_write;
+      return;
+    }
+    if (victim->valid && (!l[i].valid || l[i].last_use < victim->last_use)) victim = &l[i];
+  }
+
+  c->nr_miss ++;
+  if (victim->valid) {
+    c->nr_evict ++;
+    if (victim->dirty) {
+      c->nr_writeback ++;
+      if (c->next != NULL) {
+        paddr_t victim_addr = (victim->tag * c->nr_set + set) * c->block;
+        cache_access_level(c->next, victim_addr, c->block, true);
+      }
+    }
+  }
+
+  /* fill the block from the next level */
+  if (c->next != NULL) cache_access_level(c->next, addr, c->block, false);
+  *victim = (CacheLine) { .tag = tag, .valid = true, .dirty = is_write, .last_use = lru_clock };
+}
+
+static void cache_access_level(Cache *c, paddr_t addr, int len, bool is_write) {
+  uint32_t first = addr / c->block;
+  uint32_t nr_block = (addr + len - 1) / c->block - first + 1;
+  uint32_t i;
+  for (i = 0; i < nr_block; i ++) {
+    cache_access_block(c, (first + i) * c->block, is_write);
+  }
+}
+
+void cache_access(paddr_t addr, int len, int type) {
+  if (!sample_detailed) return;
+  if (nr_access ++ % sample_period >= sample_on) return;
+  nr_sampled ++;
+
+  Cache *c = (type == CACHE_FETCH ? &l1i : &l1d);
+  if (c->size == 0) c = (l2.size == 0 ? NULL : &l2);
+  if (c != NULL) cache_access_level(c, addr, len, type == CACHE_WRITE);
+}
+
+static uint32_t parse_size(const char *s, char **end) {
+  uint32_t size = strtoul(s, end, 10);
+  switch (**end) {
+    case 'K': case 'k': size <<= 10; (*end) ++; break;
+    case 'M': case 'm': size <<= 20; (*end) ++; break;
+  }
+  return size;
+}
+
+static void parse_item(char *item) {
+  char *val = strchr(item, '=');
+  Assert(val != NULL, "invalid cache configuration '%s'", item);
+  *val ++ = '\0';
+
+  if (strcmp(item, "sample") == 0) {
+    char *end;
+    sample_on = strtoull(val, &end, 10);
+    Assert(*end == '/', "invalid sampling '%s', should be ON/PERIOD", val);
+    sample_period = strtoull(end + 1, &end, 10);
+    Assert(*end == '\0' && sample_on > 0 && sample_on <= sample_period,
+        "invalid sampling '%s', should be ON/PERIOD", val);
+    return;
+  }
+
+  int i;
+  for (i = 0; i < NR_CACHE; i ++) {
+    Cache *c = caches[i];
+    if (strcasecmp(item, c->name) != 0) continue;
+
+    if (strcmp(val, "off") == 0) {
+      c->size = 0;
+      return;
+    }
+
+    char *end;
+    c->size = parse_size(val, &end);
+    Assert(*end == ':', "invalid cache '%s', should be SIZE:WAYS:BLOCK", val);
+    c->ways = strtoul(end + 1, &end, 10);
+    Assert(*end == ':', "invalid cache '%s', should be SIZE:WAYS:BLOCK", val);
+    c->block = parse_size(end + 1, &end);
+    Assert(*end == '\0', "invalid cache '%s', should be SIZE:WAYS:BLOCK", val);
+    return;
+  }
+
+  panic("unknown cache '%s'", item);
+}
+
+void init_cache(const char *spec) {
+  if (spec != NULL) {
+    char *s = strdup(spec);
+    char *item;
+    for (item = strtok(s, ","); item != NULL; item = strtok(NULL, ",")) {
+      parse_item(item);
+    }
+    free(s);
+  }
+
+  int i;
+  for (i = 0; i < NR_CACHE; i ++) {
+    Cache *c = caches[i];
+    if (c->size == 0) continue;
+    Assert(c->ways > 0 && is_pow2(c->block) && c->size % (c->ways * c->block) == 0,
+        "invalid geometry of %s", c->name);
+    c->nr_set = c->size / (c->ways * c->block);
+    Assert(is_pow2(c->nr_set), "the number of sets of %s should be a power of 2", c->name);
+    c->lines = calloc(c->nr_set * c->ways, sizeof(c->lines[0]));
+    assert(c->lines != NULL);
+    Log("%s: %u KB, %u-way, %u-byte blocks", c->name, c->size >> 10, c->ways, c->block);
+  }
+
+  Cache *next = (l2.size == 0 ? NULL : &l2);
+  l1i.next = next;
+  l1d.next = next;
+}
+
+void cache_statistic(void) {
+  Log("cache: %ld of %ld accesses simulated", nr_sampled, nr_access);
+
+  int i;
+  for (i = 0; i < NR_CACHE; i ++) {
+    Cache *c = caches[i];
+    if (c->size == 0) continue;
+    Log("%-3s: access = %ld, hit = %ld, miss = %ld (%.2f%%), eviction = %ld, writeback = %ld",
+        c->name, c->nr_access, c->nr_hit, c->nr_miss,
+        c->nr_access == 0 ? 0.0 : 100.0 * c->nr_miss / c->nr_access,
+        c->nr_evict, c->nr_writeback);
+  }
+}
+
+void cache_perf(PerfOut *o) {
+  perf_begin(o, "cache");
+  perf_u64(o, "accesses", nr_access);
+  perf_u64(o, "simulated", nr_sampled);
+  int i;
+  for (i = 0; i < NR_CACHE; i ++) {
+    Cache *c = caches[i];
+    if (c->size == 0) continue;
+    perf_begin(o, c->name);
+    perf_u64(o, "access", c->nr_access);
+    perf_u64(o, "hit", c->nr_hit);
+    perf_u64(o, "miss", c->nr_miss);
+    perf_double(o, "hit_rate", c->nr_access == 0 ? 0.0 : (double)c->nr_hit / c->nr_access);
+    perf_u64(o, "eviction", c->nr_evict);
+    perf_u64(o, "writeback", c->nr_writeback);
+    perf_end(o);
+  }
+  perf_end(o);
+}
+
+#endif
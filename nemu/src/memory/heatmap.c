@@ -0,0 +1,74 @@
+#include "nemu.h"
+#include "memory/heatmap.h"
+#include <stdlib.h>
+
+#ifdef PMEM_HEATMAP
+
+/* Pages are counted by their offset in pmem, and reported by their
+ * physical address. Accesses to MMIO are not counted. */
+
+uint64_t *pmem_heat[NR_HEAT_TYPE];
+static const char *heat_file = NULL;
+
+void init_heatmap(const char *csv_file) {
+  int i;
+  for (i = 0; i < NR_HEAT_TYPE; i ++) {
+    pmem_heat[i] = calloc(pmem_size / PAGE_SIZE, sizeof(pmem_heat[i][0]));
+    assert(pmem_heat[i] != NULL);
+  }
+  heat_file = csv_file;
+}
+
+static inline uint64_t page_heat(uint32_t page) {
+  return pmem_heat[HEAT_READ][page] + pmem_heat[HEAT_WRITE][page] + pmem_heat[HEAT_FETCH][page];
+}
+
+static int cmp_heat(const void *a, const void *b) {
+  uint64_t ha = page_heat(*(const uint32_t *)a);
+  uint64_t hb = page_heat(*(const uint32_t *)b);
+  return (ha < hb) - (ha > hb);
+}
+
+/* print the `n' hottest pages */
+void heatmap_dump(int n) {
+  uint32_t nr_page = pmem_size / PAGE_SIZE;
+  uint32_t *pages = malloc(nr_page * sizeof(pages[0]));
+  uint32_t i, nr_touched = 0;
+  assert(pages != NULL);
+
+  for (i = 0; i < nr_page; i ++) {
+    if (page_heat(i) != 0) pages[nr_touched ++] = i;
+  }
+  qsort(pages, nr_touched, sizeof(pages[0]), cmp_heat);
+
+  printf("%10s %16s %16s %16s\n", "page", "read", "write", "fetch");
+  for (i = 0; i < nr_touched && i < n; i ++) {
+    uint32_t p = pages[i];
+    printf("0x%08x %16ld %16ld %16ld\n", pmem_base() + p * PAGE_SIZE,
+        pmem_heat[HEAT_READ][p], pmem_heat[HEAT_WRITE][p], pmem_heat[HEAT_FETCH][p]);
+  }
+  printf("%u of %u pages are accessed\n", nr_touched, nr_page);
+  free(pages);
+}
+
+void heatmap_statistic(void) {
+  if (heat_file == NULL) return;
+
+  FILE *fp = fopen(heat_file, "w");
+  if (fp == NULL) {
+    Log("can not open '%s' for the heatmap", heat_file);
+    return;
+  }
+
+  uint32_t i;
+  fprintf(fp, "page,read,write,fetch\n");
+  for (i = 0; i < pmem_size / PAGE_SIZE; i ++) {
+    if (page_heat(i) == 0) continue;
+    fprintf(fp, "0x%08x,%ld,%ld,%ld\n", pmem_base() + i * PAGE_SIZE,
+        pmem_heat[HEAT_READ][i], pmem_heat[HEAT_WRITE][i], pmem_heat[HEAT_FETCH][i]);
+  }
+  fclose(fp);
+  Log("the heatmap is written to %s", heat_file);
+}
+
+#endif
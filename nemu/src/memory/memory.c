@@ -1,41 +1,411 @@
 #include "nemu.h"
 #include "device/map.h"
+#include "cpu/decode-cache.h"
+#include "memory/cache.h"
+#include "memory/heatmap.h"
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <unistd.h>
 
-uint8_t pmem[PMEM_SIZE] PG_ALIGN = {};
+uint8_t *pmem = NULL;
+uint8_t *pmem_dirty = NULL;
+uint8_t *pmem_watch = NULL;
+uint32_t pmem_size = PMEM_SIZE_DEFAULT;
+static bool pmem_hugepage = false;
 
 static IOMap pmem_map = {
   .name = "pmem",
-  .space = pmem,
   .callback = NULL
 };
 
+/* set the size of pmem in bytes, called before register_pmem() */
+void pmem_config(uint32_t size, bool hugepage) {
+  Assert(size > 0 && size % PAGE_SIZE == 0, "invalid size of pmem 0x%x", size);
+  pmem_size = size;
+  pmem_hugepage = hugepage;
+}
+
+/* Host pages of pmem are only allocated when the guest touches them.
+ * Map it at `at', or anywhere if it is NULL. */
+static uint8_t *map_pmem(uint8_t *at) {
+  size_t size = pmem_size;
+  uint8_t *p = mmap(at, size, PROT_READ | PROT_WRITE,
+      MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | (at == NULL ? 0 : MAP_FIXED), -1, 0);
+  Assert(p != MAP_FAILED, "can not allocate %u MB for pmem", pmem_size >> 20);
+
+#ifdef MADV_HUGEPAGE
+  if (pmem_hugepage && madvise(p, size, MADV_HUGEPAGE) != 0) {
+    Log("huge pages are not available for pmem");
+  }
+#endif
+  return p;
+}
+
+void pmem_space_alloc(PmemSpace *sp) {
+  sp->pmem = map_pmem(NULL);
+  sp->dirty = calloc(pmem_size / PAGE_SIZE + 1, sizeof(sp->dirty[0]));
+  assert(sp->dirty != NULL);
+  sp->watch = calloc(pmem_size / PAGE_SIZE + 1, sizeof(sp->watch[0]));
+  assert(sp->watch != NULL);
+}
+
+void pmem_space_free(PmemSpace *sp) {
+  munmap(sp->pmem, pmem_size);
+  free(sp->dirty);
+  free(sp->watch);
+}
+
+void pmem_swap(PmemSpace *sp) {
+  PmemSpace cur = { .pmem = pmem, .dirty = pmem_dirty, .watch = pmem_watch };
+  pmem = sp->pmem;
+  pmem_dirty = sp->dirty;
+  pmem_watch = sp->watch;
+  pmem_map.space = pmem;
+  *sp = cur;
+}
+
+static void alloc_pmem(void) {
+  PmemSpace sp;
+  pmem_space_alloc(&sp);
+  pmem_swap(&sp);
+}
+
+/* The old pages are dropped by mapping pmem again at the same place. */
+void pmem_reset(void) {
+  map_pmem(pmem);
+}
+
+bool pmem_page_is_zero(uint32_t page) {
+  const uint64_t *p = (const void *)(pmem + page * PAGE_SIZE);
+  int i;
+  for (i = 0; i < PAGE_SIZE / sizeof(p[0]); i ++) {
+    if (p[i] != 0) return false;
+  }
+  return true;
+}
+
+/* The aligned values are compared by blocks of 32, which the compiler
+ * turns into vector compares, and a block with a match is scanned again. */
+#define def_find_aligned(type) \
+static int64_t concat(find_, type)(uint32_t offset, type val) { \
+  const type *p = (const void *)pmem; \
+  uint32_t i = offset / sizeof(type), n = pmem_size / sizeof(type); \
+  for (; i < n && i % 32 != 0; i ++) { \
+    if (p[i] == val) return (int64_t)i * sizeof(type); \
+  } \
+  for (; i + 32 <= n; i += 32) { \
+    bool hit = false; \
+    int j; \
+    for (j = 0; j < 32; j ++) hit |= (p[i + j] == val); \
+    if (hit) break; \
+  } \
+  for (; i < n; i ++) { \
+    if (p[i] == val) return (int64_t)i * sizeof(type); \
+  } \
+  return -1; \
+}
+
+def_find_aligned(uint16_t)
+def_find_aligned(uint32_t)
+
+static int64_t find_bytes(uint32_t offset, const uint8_t *pat, uint32_t len) {
+  if (len > pmem_size) return -1;
+  uint32_t end = pmem_size - len + 1;
+  while (offset < end) {
+    const uint8_t *p = memchr(pmem + offset, pat[0], end - offset);
+    if (p == NULL) return -1;
+    offset = p - pmem;
+    if (memcmp(p, pat, len) == 0) return offset;
+    offset ++;
+  }
+  return -1;
+}
+
+int64_t pmem_find(uint32_t offset, const void *pat, uint32_t len, int align) {
+  offset = (offset + align - 1) & ~(align - 1);
+  if (align == 4 && len == 4) return find_uint32_t(offset, *(uint32_t *)pat);
+  if (align == 2 && len == 2) return find_uint16_t(offset, *(uint16_t *)pat);
+  assert(align == 1);
+  return find_bytes(offset, pat, len);
+}
+
+void pmem_map_file(uint32_t page, uint32_t nr_page, int fd, off_t offset) {
+  assert(page + nr_page <= pmem_size / PAGE_SIZE);
+  void *host = pmem + page * PAGE_SIZE;
+  size_t size = (size_t)nr_page * PAGE_SIZE;
+  if (mmap(host, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fd, offset) != MAP_FAILED) return;
+  ssize_t ret = pread(fd, host, size, offset);
+  Assert(ret == size, "can not read %zu bytes from offset %ld", size, (long)offset);
+}
+
 void register_pmem(paddr_t base) {
+  Assert((paddr_t)(base + pmem_size - 1) >= base, "pmem wraps around the address space");
+  alloc_pmem();
+#ifdef DECODE_CACHE
+  init_dcache();
+#endif
+
+  pmem_map.space = pmem;
   pmem_map.low = base;
-  pmem_map.high = base + PMEM_SIZE - 1;
+  pmem_map.high = base + pmem_size - 1;
 
   Log("Add '%s' at [0x%08x, 0x%08x]", pmem_map.name, pmem_map.low, pmem_map.high);
 }
 
-IOMap* fetch_mmio_map(paddr_t addr);
+/* return the offset of `addr' in pmem, or -1 if it is not inside pmem */
+int pmem_offset(paddr_t addr) {
+  return (map_inside(&pmem_map, addr) ? addr - pmem_map.low : -1);
+}
+
+paddr_t pmem_base(void) {
+  return pmem_map.low;
+}
+
+uint32_t mmio_read(paddr_t addr, int len);
+void mmio_write(paddr_t addr, uint32_t data, int len);
+
+void pmem_dirty_range(uint32_t offset, size_t len) {
+  if (len == 0) return;
+  memset(pmem_dirty + offset / PAGE_SIZE, PMEM_DIRTY_ALL, (offset + len - 1) / PAGE_SIZE - offset / PAGE_SIZE + 1);
+}
+
+bool pmem_is_dirty(uint32_t page, int user) {
+  assert(page < pmem_size / PAGE_SIZE);
+  return pmem_dirty[page] & user;
+}
+
+int pmem_next_dirty(uint32_t page, int user) {
+  uint32_t nr_page = pmem_size / PAGE_SIZE;
+  uint64_t mask = user * 0x0101010101010101ull;
+  for (; page < nr_page && page % 8 != 0; page ++) {
+    if (pmem_dirty[page] & user) return page;
+  }
+  /* skip the clean pages 8 by 8, `pmem_dirty' has one more entry than the
+   * pages, and it is only set with the last page */
+  for (; page + 8 <= nr_page; page += 8) {
+    uint64_t w;
+    memcpy(&w, pmem_dirty + page, sizeof(w));
+    if (w & mask) break;
+  }
+  for (; page < nr_page; page ++) {
+    if (pmem_dirty[page] & user) return page;
+  }
+  return -1;
+}
+
+void pmem_clear_dirty(uint32_t page, uint32_t nr_page, int user) {
+  assert(page + nr_page <= pmem_size / PAGE_SIZE);
+  uint32_t end = page + nr_page;
+  /* the extra entry belongs to the last page */
+  if (end == pmem_size / PAGE_SIZE) end ++;
+  for (; page < end; page ++) pmem_dirty[page] &= ~user;
+}
+
+/* `ifetch_vpn' never matches a page number after flushing */
+vaddr_t ifetch_vpn = -1;
+uint8_t *ifetch_host = NULL;
+
+/* Called when the fetch crosses a page or leaves the cached page.
+ * Cache the host pointer of the new page if it is inside pmem. */
+uint32_t ifetch_slow(vaddr_t addr, int len) {
+  int offset = ifetch_pmem_offset(addr & ~PAGE_MASK);
+  if (offset >= 0) {
+    ifetch_vpn = addr / PAGE_SIZE;
+    ifetch_host = pmem + offset;
+  }
+  else {
+    ifetch_flush();
+  }
+  /* a fetch is not a load of the guest, see vaddr_read() */
+  return isa_vaddr_read(addr, len);
+}
+
+void ifetch_flush(void) {
+  ifetch_vpn = -1;
+  ifetch_host = NULL;
+}
 
 /* Memory accessing interfaces */
 
+/* An access crossing the end of pmem is split into bytes. It is not on
+ * the fast path, which only checks that the whole access is inside pmem. */
+static uint32_t paddr_read_split(paddr_t addr, int len) {
+  uint32_t data = 0;
+  int i;
+  for (i = 0; i < len; i ++) data |= paddr_read(addr + i, 1) << (i * 8);
+  return data;
+}
+
+static void paddr_write_split(paddr_t addr, uint32_t data, int len) {
+  int i;
+  for (i = 0; i < len; i ++) paddr_write(addr + i, data >> (i * 8), 1);
+}
+
 uint32_t paddr_read(paddr_t addr, int len) {
-  if (map_inside(&pmem_map, addr)) {
-    uint32_t offset = addr - pmem_map.low;
-    return *(uint32_t *)(pmem + offset) & (~0u >> ((4 - len) << 3));
+  uint32_t offset = addr - pmem_map.low;
+  if (offset <= pmem_size - len) {
+    cache_access(addr, len, CACHE_READ);
+    heatmap_count(offset, HEAT_READ);
+    return host_read(pmem + offset, len);
+  }
+  else if (offset < pmem_size) {
+    return paddr_read_split(addr, len);
   }
   else {
-    return map_read(addr, len, fetch_mmio_map(addr));
+    return mmio_read(addr, len);
   }
 }
 
 void paddr_write(paddr_t addr, uint32_t data, int len) {
-  if (map_inside(&pmem_map, addr)) {
-    uint32_t offset = addr - pmem_map.low;
-    memcpy(pmem + offset, &data, len);
+  uint32_t offset = addr - pmem_map.low;
+  if (offset <= pmem_size - len) {
+    host_write(pmem + offset, data, len);
+    pmem_after_write(offset, len);
+  }
+  else if (offset < pmem_size) {
+    paddr_write_split(addr, data, len);
   }
   else {
-    return map_write(addr, data, len, fetch_mmio_map(addr));
+    mmio_write(addr, data, len);
+  }
+}
+
+/* Bulk accessing interfaces */
+
+/* the length of the part of [addr, addr + n) inside the page of `addr' */
+static inline uint32_t chunk_len(paddr_t addr, size_t n) {
+  uint32_t left = PAGE_SIZE - (addr & PAGE_MASK);
+  return (n < left ? n : left);
+}
+
+/* return the host address of [addr, addr + len), or NULL if it is not inside pmem */
+static inline uint8_t* pmem_host(paddr_t addr, uint32_t len) {
+  if (map_inside(&pmem_map, addr) && map_inside(&pmem_map, addr + len - 1)) {
+    return pmem + (addr - pmem_map.low);
+  }
+  return NULL;
+}
+
+/* called after writing at most PAGE_SIZE bytes to pmem from the host */
+static inline void pmem_bulk_write(paddr_t addr, uint32_t len) {
+  pmem_after_write(addr - pmem_map.low, len);
+}
+
+void paddr_memcpy(paddr_t dest, paddr_t src, size_t n) {
+  while (n > 0) {
+    uint32_t len = chunk_len(dest, chunk_len(src, n));
+    uint8_t *d = pmem_host(dest, len);
+    uint8_t *s = pmem_host(src, len);
+    uint32_t i;
+    if (d != NULL && s != NULL) {
+      cache_access(src, len, CACHE_READ);
+      heatmap_count(src - pmem_map.low, HEAT_READ);
+      if (d > s && d < s + len) {
+        /* memmove() would not repeat the overlapped bytes */
+        for (i = 0; i < len; i ++) d[i] = s[i];
+      }
+      else {
+        memmove(d, s, len);
+      }
+      pmem_bulk_write(dest, len);
+    }
+    else {
+      for (i = 0; i < len; i ++) paddr_write(dest + i, paddr_read(src + i, 1), 1);
+    }
+    dest += len;
+    src += len;
+    n -= len;
+  }
+}
+
+void paddr_memset(paddr_t dest, int c, size_t n) {
+  while (n > 0) {
+    uint32_t len = chunk_len(dest, n);
+    uint8_t *d = pmem_host(dest, len);
+    if (d != NULL) {
+      memset(d, c, len);
+      pmem_bulk_write(dest, len);
+    }
+    else {
+      uint32_t i;
+      for (i = 0; i < len; i ++) paddr_write(dest + i, c, 1);
+    }
+    dest += len;
+    n -= len;
+  }
+}
+
+void paddr_write_host(paddr_t dest, const void *src, size_t n) {
+  const uint8_t *s = src;
+  while (n > 0) {
+    uint32_t len = chunk_len(dest, n);
+    uint8_t *d = pmem_host(dest, len);
+    if (d != NULL) {
+      memcpy(d, s, len);
+      pmem_bulk_write(dest, len);
+    }
+    else {
+      uint32_t i;
+      for (i = 0; i < len; i ++) paddr_write(dest + i, s[i], 1);
+    }
+    dest += len;
+    s += len;
+    n -= len;
+  }
+}
+
+void pmem_host_written(paddr_t addr, size_t n) {
+  while (n > 0) {
+    uint32_t len = chunk_len(addr, n);
+    if (pmem_host(addr, len) != NULL) pmem_bulk_write(addr, len);
+    addr += len;
+    n -= len;
+  }
+}
+
+void paddr_read_host(void *dest, paddr_t src, size_t n) {
+  uint8_t *d = dest;
+  while (n > 0) {
+    uint32_t len = chunk_len(src, n);
+    uint8_t *s = pmem_host(src, len);
+    if (s != NULL) {
+      cache_access(src, len, CACHE_READ);
+      heatmap_count(src - pmem_map.low, HEAT_READ);
+      memcpy(d, s, len);
+    }
+    else {
+      uint32_t i;
+      for (i = 0; i < len; i ++) d[i] = paddr_read(src + i, 1);
+    }
+    src += len;
+    d += len;
+    n -= len;
+  }
+}
+
+int paddr_memcmp(paddr_t s1, paddr_t s2, size_t n) {
+  while (n > 0) {
+    uint32_t len = chunk_len(s1, chunk_len(s2, n));
+    uint8_t *h1 = pmem_host(s1, len);
+    uint8_t *h2 = pmem_host(s2, len);
+    uint32_t i;
+    if (h1 != NULL && h2 != NULL) {
+      cache_access(s1, len, CACHE_READ);
+      cache_access(s2, len, CACHE_READ);
+      heatmap_count(s1 - pmem_map.low, HEAT_READ);
+      heatmap_count(s2 - pmem_map.low, HEAT_READ);
+      int ret = memcmp(h1, h2, len);
+      if (ret != 0) return ret;
+    }
+    else {
+      for (i = 0; i < len; i ++) {
+        int ret = (int)paddr_read(s1 + i, 1) - (int)paddr_read(s2 + i, 1);
+        if (ret != 0) return ret;
+      }
+    }
+    s1 += len;
+    s2 += len;
+    n -= len;
   }
+  return 0;
 }
@@ -0,0 +1,111 @@
+#include "nemu.h"
+#include "memory/mtrace.h"
+#include "monitor/reverse.h"
+#include <stdlib.h>
+
+#ifdef MTRACE
+
+/* The memory access trace written with '-M FILE[:r|w][:LO-HI,...]'. The
+ * loads (r) and stores (w) of the guest, both by default, with a virtual
+ * address in [LO, HI) (hex) of any range given, everything by default,
+ * are written to FILE as the fixed-size records of MTraceRecord, which
+ * are printed by tools/mtrace. An access is traced if any of its bytes
+ * is in a range.
+ *
+ * Every page touched by a range is marked in `mtrace_page', and only the
+ * accesses to the marked pages check the ranges. The accesses of the
+ * guest are the ones through vaddr_read() and vaddr_write(), so the walks
+ * of the page tables are not traced. What is executed again for reverse
+ * execution is not traced either. */
+
+#define NR_RANGE 16
+
+typedef struct {
+  uint32_t pc, vaddr, paddr, data;
+  uint8_t len, is_write;
+  uint16_t pad;
+} MTraceRecord;
+
+typedef struct {
+  vaddr_t lo, hi;
+} Range;
+
+uint8_t mtrace_page[(1ull << 32) / PAGE_SIZE] = {};
+
+static const char *mtrace_file = NULL;
+static FILE *mtrace_fp = NULL;
+static Range ranges[NR_RANGE];
+static int nr_range = 0;
+static int mtrace_type = 0;
+static uint64_t nr_record = 0;
+
+static void mark_range(vaddr_t lo, vaddr_t hi) {
+  uint32_t page;
+  for (page = lo / PAGE_SIZE; page <= (hi - 1) / PAGE_SIZE; page ++) {
+    mtrace_page[page] = mtrace_type;
+  }
+}
+
+static void parse_ranges(char *s) {
+  char *r;
+  for (r = strtok(s, ","); r != NULL; r = strtok(NULL, ",")) {
+    char *end;
+    Assert(nr_range < NR_RANGE, "too many ranges to trace");
+    Range *range = &ranges[nr_range ++];
+    range->lo = strtoul(r, &end, 16);
+    Assert(*end == '-', "invalid range '%s' to trace", r);
+    range->hi = strtoul(end + 1, &end, 16);
+    Assert(*end == '\0' && range->lo < range->hi, "invalid range '%s' to trace", r);
+  }
+}
+
+void init_mtrace(const char *spec) {
+  if (spec == NULL) return;
+  char *s = strdup(spec);
+  char *p = strchr(s, ':');
+  if (p != NULL) *p ++ = '\0';
+  mtrace_file = s;
+
+  mtrace_type = MTRACE_READ | MTRACE_WRITE;
+  if (p != NULL && (p[0] == 'r' || p[0] == 'w') && (p[1] == '\0' || p[1] == ':')) {
+    mtrace_type = (p[0] == 'r' ? MTRACE_READ : MTRACE_WRITE);
+    p = (p[1] == ':' ? p + 2 : NULL);
+  }
+  if (p != NULL) parse_ranges(p);
+
+  mtrace_fp = fopen(mtrace_file, "wb");
+  Assert(mtrace_fp != NULL, "Can not open '%s'", mtrace_file);
+  setvbuf(mtrace_fp, NULL, _IOFBF, 1 << 20);
+
+  if (nr_range == 0) memset(mtrace_page, mtrace_type, sizeof(mtrace_page));
+  int i;
+  for (i = 0; i < nr_range; i ++) mark_range(ranges[i].lo, ranges[i].hi);
+  Log("Memory accesses are traced to %s", mtrace_file);
+}
+
+static bool in_ranges(vaddr_t addr, int len) {
+  if (nr_range == 0) return true;
+  int i;
+  for (i = 0; i < nr_range; i ++) {
+    if (addr < ranges[i].hi && addr + len > ranges[i].lo) return true;
+  }
+  return false;
+}
+
+void mtrace_record(vaddr_t addr, uint32_t data, int len, int type) {
+  if (!(mtrace_type & type) || !in_ranges(addr, len) || rev_is_replaying()) return;
+  bool success;
+  paddr_t paddr = isa_fetch_probe(addr, &success);
+  MTraceRecord r = { .pc = cpu.pc, .vaddr = addr, .paddr = (success ? paddr : 0),
+    .data = data, .len = len, .is_write = (type == MTRACE_WRITE) };
+  fwrite(&r, sizeof(r), 1, mtrace_fp);
+  nr_record ++;
+}
+
+void mtrace_statistic(void) {
+  if (mtrace_fp == NULL) return;
+  fflush(mtrace_fp);
+  Log("%ld memory accesses are traced to %s", nr_record, mtrace_file);
+}
+
+#endif
@@ -1,6 +1,25 @@
 #include "nemu.h"
 #include "monitor/monitor.h"
 #include "monitor/watchpoint.h"
+#include "cpu/decode.h"
+#include "cpu/decode-cache.h"
+#include "cpu/tb.h"
+#include "cpu/hart.h"
+#include "cpu/threaded.h"
+#include "rtl/jit.h"
+#include "memory/cache.h"
+#include "memory/heatmap.h"
+#include "monitor/prof.h"
+#include "monitor/ftrace.h"
+#include "monitor/perf.h"
+#include "monitor/breakpoint.h"
+#include "monitor/reverse.h"
+#include "monitor/sample.h"
+#include "monitor/diff-test.h"
+#include "device/marker.h"
+#include "device/map.h"
+#include "device/vga.h"
+#include <setjmp.h>
 
 /* The assembly code of instructions executed is only output to the screen
  * when the number of instructions executed is less than this value.
@@ -13,46 +32,229 @@
 #define LOG_MAX (1024 * 1024)
 
 NEMUState nemu_state = {.state = NEMU_STOP};
+volatile int nemu_event = false;
+uint64_t nemu_deadline = UINT64_MAX;
 
 void interpret_rtl_exit(int state, vaddr_t halt_pc, uint32_t halt_ret) {
   nemu_state = (NEMUState) { .state = state, .halt_pc = halt_pc, .halt_ret = halt_ret };
+  nemu_event = true;
+}
+
+/* Service the pending event. Return true if cpu_exec() should stop. */
+bool nemu_handle_event(void) {
+  nemu_event = false;
+
+#ifdef HAS_IOE
+  extern void device_update();
+  device_update();
+#else
+  /* e.g. the samples of the profiler */
+  extern void device_run_events();
+  device_run_events();
+#endif
+
+  if (prof_pending) prof_sample();
+
+  if (nemu_intr && isa_query_intr()) nemu_intr = false;
+
+  return nemu_state.state != NEMU_RUNNING;
 }
 
 vaddr_t exec_once(void);
-void difftest_step(vaddr_t ori_pc, vaddr_t next_pc);
 void asm_print(vaddr_t ori_pc, int instr_len, bool print_flag);
+void asm_clear(void);
+void itrace_write(vaddr_t pc, int len);
 
-static uint64_t g_nr_guest_instr = 0;
+uint64_t g_nr_guest_instr = 0;
 
 void monitor_statistic(void) {
+  rev_input_finish();
   Log("total guest instructions = %ld", g_nr_guest_instr);
+#ifdef CACHE_SIM
+  cache_statistic();
+#endif
+#ifdef PMEM_HEATMAP
+  heatmap_statistic();
+#endif
+#ifdef MTRACE
+  mtrace_statistic();
+#endif
+  prof_statistic();
+  ftrace_statistic();
+  marker_statistic();
+#ifdef DECODE_CACHE
+  dcache_statistic();
+#endif
+#ifdef JIT_ENGINE
+  jit_statistic();
+#endif
+#ifdef HAS_IOE
+  vga_statistic();
+#endif
+  io_statistic();
+  perf_statistic();
 }
 
-/* Simulate how the CPU works. */
-void cpu_exec(uint64_t n) {
-  switch (nemu_state.state) {
-    case NEMU_END: case NEMU_ABORT:
-      printf("Program execution has ended. To restart the program, exit NEMU and run again.\n");
-      return;
-    default: nemu_state.state = NEMU_RUNNING;
+/* the host time spent in cpu_exec() */
+static uint64_t exec_us = 0;
+#ifdef OPCODE_STAT
+static uint64_t nr_opcode[ISA_NR_OPCODE];
+#endif
+
+void cpu_perf(PerfOut *o) {
+  perf_begin(o, "cpu");
+  perf_u64(o, "instructions", g_nr_guest_instr);
+  perf_double(o, "exec_seconds", exec_us / 1e6);
+  perf_double(o, "mips", exec_us == 0 ? 0.0 : (double)g_nr_guest_instr / exec_us);
+#ifdef OPCODE_STAT
+  perf_begin(o, "opcodes");
+  int i;
+  for (i = 0; i < ISA_NR_OPCODE; i ++) {
+    if (nr_opcode[i] == 0) continue;
+    char name[8];
+    sprintf(name, "0x%02x", i);
+    perf_u64(o, name, nr_opcode[i]);
+  }
+  perf_end(o);
+#endif
+  perf_end(o);
+}
+
+#if !defined(JIT_ENGINE) && !defined(THREADED_ENGINE) && !defined(TB_ENGINE)
+#if defined(DEBUG) || defined(DIFF_TEST) || defined(MEM_INSTRUMENT)
+/* Both the instrumented loop and fast_run() are built, see exec_set_fast(). */
+#define EXEC_SWITCH
+#endif
+
+#ifdef EXEC_SWITCH
+static bool exec_fast = false;
+/* leave fast_run() for good at this instruction count or this pc */
+static uint64_t fast_until_nr = UINT64_MAX;
+static vaddr_t fast_until_pc = (vaddr_t)-1;
+#endif
+
+/* Nothing has to be done after each instruction without DEBUG and
+ * DIFF_TEST, so execute instructions in a tight loop, and only leave
+ * it to service events. Return the number of instructions executed. */
+static uint64_t fast_run(uint64_t n) {
+  uint64_t i;
+  for (i = 0; i < n; ) {
+    vaddr_t pc = cpu.pc;
+    vaddr_t seq_pc = exec_once();
+    if (bbv_on) bbv_step(pc, seq_pc, cpu.pc);
+    i ++;
+    g_nr_guest_instr ++;
+    if (nemu_event_pending() && nemu_handle_event()) break;
+#ifdef EXEC_SWITCH
+    if (cpu.pc == fast_until_pc) {
+      exec_set_fast(false);
+      break;
+    }
+#endif
+  }
+  return i;
+}
+#endif
+
+void exec_set_fast(bool fast) {
+#ifdef EXEC_SWITCH
+  fast_until_nr = UINT64_MAX;
+  fast_until_pc = (vaddr_t)-1;
+  if (fast == exec_fast) return;
+  exec_fast = fast;
+#ifdef DIFF_TEST
+  /* REF is synced again with the memory written in between */
+  if (fast) difftest_detach();
+  else difftest_attach();
+#endif
+  Log("switch to the %s engine at instruction %lu, pc = 0x%08x",
+      (fast ? "fast" : "instrumented"), g_nr_guest_instr, cpu.pc);
+#endif
+}
+
+void exec_fast_until(uint64_t nr_instr, vaddr_t pc) {
+#ifdef EXEC_SWITCH
+  exec_set_fast(true);
+  fast_until_nr = nr_instr;
+  fast_until_pc = pc;
+#endif
+}
+
+bool exec_is_fast(void) {
+#ifdef EXEC_SWITCH
+  return exec_fast;
+#else
+  return true;
+#endif
+}
+
+/* Execute at most `n' instructions by the engine. */
+static void exec_run(uint64_t n) {
+#if defined(JIT_ENGINE)
+  jit_run(n);
+#elif defined(THREADED_ENGINE)
+  isa_exec_threaded(n);
+#elif defined(TB_ENGINE)
+  tb_run(n);
+#elif !defined(EXEC_SWITCH)
+  fast_run(n);
+#else
+  while (exec_fast && n > 0) {
+    if (g_nr_guest_instr >= fast_until_nr) {
+      exec_set_fast(false);
+      break;
+    }
+    uint64_t left = fast_until_nr - g_nr_guest_instr;
+    n -= fast_run(n < left ? n : left);
+    if (nemu_state.state != NEMU_RUNNING) return;
   }
 
   for (; n > 0; n --) {
     __attribute__((unused)) vaddr_t ori_pc = cpu.pc;
 
+#ifdef DEBUG
+    /* format the instruction only if it is going to be printed */
+    log_asm = g_nr_guest_instr < LOG_MAX && (log_fp != NULL || n < MAX_INSTR_TO_PRINT);
+#endif
+
     /* Execute one instruction, including instruction fetch,
      * instruction decode, and the actual execution. */
     __attribute__((unused)) vaddr_t seq_pc = exec_once();
 
+    if (bp_trapped) {
+      /* counted like in the other engines, and undone by bp_exec() */
+      g_nr_guest_instr ++;
+      break;
+    }
+
 #if defined(DIFF_TEST)
   difftest_step(ori_pc, cpu.pc);
 #endif
 
+  if (bbv_on) bbv_step(ori_pc, seq_pc, cpu.pc);
+
+#ifdef MEM_INSTRUMENT
+  paddr_t fetch_paddr = isa_fetch_paddr(ori_pc);
+  int fetch_offset = pmem_offset(fetch_paddr);
+  if (fetch_offset >= 0 && sample_detailed) {
+    cache_access(fetch_paddr, seq_pc - ori_pc, CACHE_FETCH);
+    heatmap_count(fetch_offset, HEAT_FETCH);
+#ifdef OPCODE_STAT
+    nr_opcode[isa_opcode(pmem + fetch_offset)] ++;
+#endif
+  }
+#endif
+
 #ifdef DEBUG
-  if (g_nr_guest_instr < LOG_MAX) {
-    asm_print(ori_pc, seq_pc - ori_pc, n < MAX_INSTR_TO_PRINT);
+  itrace_write(ori_pc, seq_pc - ori_pc);
+  ftrace_step(ori_pc, seq_pc);
+  if (log_asm) {
+    asm_print(ori_pc, seq_pc - ori_pc, n < MAX_INSTR_TO_PRINT && !rev_quiet);
   }
-  else if (g_nr_guest_instr == LOG_MAX) {
+  else {
+    asm_clear();
+  }
+  if (g_nr_guest_instr == LOG_MAX) {
     log_write("\n[Warning] To restrict the size of log file, "
               "we do not record more instruction trace beyond this point.\n"
               "To capture more trace, you can modify the LOG_MAX macro in %s\n\n", __FILE__);
@@ -67,13 +269,70 @@ void cpu_exec(uint64_t n) {
 
   g_nr_guest_instr ++;
 
-#ifdef HAS_IOE
-    extern void device_update();
-    device_update();
-#endif
+    if (nemu_event_pending()) nemu_handle_event();
 
     if (nemu_state.state != NEMU_RUNNING) break;
   }
+#endif
+}
+
+/* The harts take turns to run `hart_quantum' instructions. */
+static void smp_run(uint64_t n) {
+  while (n > 0) {
+    hart_schedule();
+    uint64_t len = (n < hart_quantum_left ? n : hart_quantum_left);
+    uint64_t start = g_nr_guest_instr;
+    exec_run(len);
+    uint64_t nr_done = g_nr_guest_instr - start;
+    if (nr_done > len) nr_done = len;
+    n -= nr_done;
+    hart_quantum_left -= nr_done;
+    if (nemu_state.state != NEMU_RUNNING || bp_trapped) break;
+  }
+}
+
+/* Simulate how the CPU works. */
+void cpu_exec(uint64_t n) {
+  switch (nemu_state.state) {
+    case NEMU_END: case NEMU_ABORT:
+      printf("Program execution has ended. To restart the program, exit NEMU and run again.\n");
+      return;
+    default: nemu_state.state = NEMU_RUNNING;
+  }
+
+  uint64_t start_us = perf_host_us();
+
+#ifdef ISA_LONGJMP_INTR
+  /* An exception in the middle of an instruction aborts it, and comes
+   * back here by longjmp_raise_intr(). It is raised as if it were raised
+   * before the instruction, and the instructions left go on. */
+  extern jmp_buf intr_buf;
+  volatile uint64_t nr_left = n, nr_start = g_nr_guest_instr;
+  int intr = setjmp(intr_buf);
+  if (intr != 0) {
+    uint64_t nr_done = g_nr_guest_instr - nr_start;
+    nr_left = (nr_done < nr_left ? nr_left - nr_done : 0);
+    nr_start = g_nr_guest_instr;
+#ifdef DEBUG
+    asm_clear();
+#endif
+    void raise_intr(uint32_t NO, vaddr_t epc);
+    raise_intr(intr - 1, cpu.pc);
+    /* the jump to the handler is taken here */
+    decinfo.is_jmp = false;
+  }
+  n = nr_left;
+#endif
+
+  if (nr_hart == 1) exec_run(n);
+  else smp_run(n);
+
+#ifdef HAS_IOE
+  extern void serial_flush();
+  serial_flush();
+#endif
+
+  exec_us += perf_host_us() - start_us;
 
   switch (nemu_state.state) {
     case NEMU_RUNNING: nemu_state.state = NEMU_STOP; break;
@@ -83,6 +342,7 @@ void cpu_exec(uint64_t n) {
           (nemu_state.state == NEMU_ABORT ? "\33[1;31mABORT" :
            (nemu_state.halt_ret == 0 ? "\33[1;32mHIT GOOD TRAP" : "\33[1;31mHIT BAD TRAP")),
           nemu_state.halt_pc);
+      if (nemu_state.state == NEMU_ABORT) iring_dump();
       monitor_statistic();
   }
 }
@@ -0,0 +1,112 @@
+#include "cpu/exec.h"
+#include "cpu/decode-cache.h"
+#include "monitor/monitor.h"
+#include "monitor/breakpoint.h"
+#include "rtl/jit.h"
+
+/* The breakpoints of the monitor ('b') and of GDB.
+ *
+ * A breakpoint does not patch the guest memory, and nothing is compared
+ * with the pc of each instruction. Instead, the instruction at a
+ * breakpoint is decoded into `bp_trap_entry' by dcache_fetch(), which
+ * stops the guest before executing it. Setting or removing a breakpoint
+ * only invalidates the code decoded from its page, so the engines run at
+ * full speed with any number of breakpoints, and only reaching one leaves
+ * the translated code. Breakpoints need DECODE_CACHE, and are not seen by
+ * THREADED_DISPATCH.
+ *
+ * The trap is counted as an instruction by the engines, which is undone
+ * after it stops. To resume from a breakpoint, its instruction is executed
+ * once with the breakpoint disabled. */
+
+#define NR_BP 64
+
+void cpu_exec(uint64_t);
+
+int nr_bp = 0;
+bool bp_trapped = false;
+static vaddr_t bp[NR_BP];
+/* the breakpoint disabled while stepping over it */
+static bool has_bp_skip = false;
+static vaddr_t bp_skip;
+
+static int bp_find(vaddr_t pc) {
+  int i;
+  for (i = 0; i < nr_bp; i ++) {
+    if (bp[i] == pc) return i;
+  }
+  return -1;
+}
+
+bool bp_is_trap(vaddr_t pc) {
+  return bp_find(pc) >= 0 && !(has_bp_skip && pc == bp_skip);
+}
+
+static make_EHelper(bp_trap) {
+#ifdef JIT_ENGINE
+  /* interpret it every time instead of translating it */
+  JIT_REC(JOP_unsupported, NULL, NULL, NULL, 0, 0);
+#endif
+  /* stay at the pc */
+  decinfo_set_jmp(true);
+  bp_trapped = true;
+  nemu_state.state = NEMU_STOP;
+  nemu_event = true;
+}
+
+OpcodeEntry bp_trap_entry = EX(bp_trap);
+
+bool bp_add(vaddr_t pc) {
+  if (bp_find(pc) >= 0) return true;
+  if (nr_bp == NR_BP) return false;
+  bp[nr_bp ++] = pc;
+  dcache_invalidate_pc(pc);
+  return true;
+}
+
+void bp_remove(vaddr_t pc) {
+  int i = bp_find(pc);
+  if (i < 0) return;
+  bp[i] = bp[-- nr_bp];
+  dcache_invalidate_pc(pc);
+}
+
+void bp_clear(void) {
+  while (nr_bp > 0) bp_remove(bp[0]);
+}
+
+void bp_display(void) {
+  if (nr_bp == 0) {
+    printf("No breakpoints.\n");
+    return;
+  }
+  int i;
+  for (i = 0; i < nr_bp; i ++) printf("0x%08x\n", bp[i]);
+}
+
+static void exec(uint64_t n) {
+  cpu_exec(n);
+  if (bp_trapped) {
+    g_nr_guest_instr --;
+    iring_idx --;
+  }
+}
+
+bool bp_exec(uint64_t n) {
+  bp_trapped = false;
+  if (n == 0) return false;
+  if (bp_is_trap(cpu.pc)) {
+    has_bp_skip = true;
+    bp_skip = cpu.pc;
+    dcache_invalidate_pc(bp_skip);
+    exec(1);
+    has_bp_skip = false;
+    dcache_invalidate_pc(bp_skip);
+    n --;
+    if (n == 0 || nemu_state.state == NEMU_END || nemu_state.state == NEMU_ABORT) return false;
+  }
+  exec(n);
+  bool trapped = bp_trapped;
+  bp_trapped = false;
+  return trapped;
+}
@@ -0,0 +1,175 @@
+#include "nemu.h"
+#include "monitor/expr.h"
+#include "monitor/perf.h"
+#include <regex.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/* The throughput of the expression evaluator on the expressions generated
+ * by tools/gen-expr, each line of which is
+ *   RESULT EXPRESSION
+ * Every phase goes through all the expressions in a loop, so the timer is
+ * only read around a loop:
+ *   tokenize        expr_tokenize()
+ *   tokenize_regex  the POSIX regex rules which make_token() replaces
+ *   parse           expr_tokenize() and expr_parse(), less tokenize
+ *   evaluate        expr_run() of the compiled code
+ *   expr            expr(), which tokenizes and evaluates the tree
+ * The times are reported per expression, and also by 'info perf' and
+ * '-j FILE' after the benchmark. Only the expressions compiled and
+ * evaluated to their results are counted as correct. */
+
+static const char *rules[] = {
+  " +", "\\+", "\\-", "\\*", "/", "\\(", "\\)", "\\$[a-zA-Z0-9]+",
+  "0[xX][0-9a-fA-F]+", "0|[1-9][0-9]*", "!=", "&&", "\\|\\|", "==",
+};
+
+#define NR_REGEX (sizeof(rules) / sizeof(rules[0]))
+
+static regex_t re[NR_REGEX];
+
+/* return the number of tokens, or -1 if it is invalid */
+static int regex_tokenize(const char *e) {
+  int n = 0;
+  while (*e != '\0') {
+    int i;
+    regmatch_t pmatch;
+    for (i = 0; i < NR_REGEX; i ++) {
+      if (regexec(&re[i], e, 1, &pmatch, 0) == 0 && pmatch.rm_so == 0) break;
+    }
+    if (i == NR_REGEX) return -1;
+    if (i != 0) n ++;
+    e += pmatch.rm_eo;
+  }
+  return n;
+}
+
+static struct {
+  int nr_expr, nr_round;
+  int nr_correct, nr_invalid, nr_wrong;
+  uint64_t tokenize_us, tokenize_regex_us, parse_us, evaluate_us, expr_us;
+} bench;
+
+static inline double ns_per_expr(uint64_t us, uint64_t nr) {
+  return nr == 0 ? 0.0 : us * 1000.0 / nr;
+}
+
+void expr_bench_perf(PerfOut *o) {
+  if (bench.nr_round == 0) return;
+  /* only the expressions which can be parsed are run */
+  uint64_t nr = (uint64_t)(bench.nr_expr - bench.nr_invalid) * bench.nr_round;
+  perf_begin(o, "expr_bench");
+  perf_u64(o, "expressions", bench.nr_expr);
+  perf_u64(o, "rounds", bench.nr_round);
+  perf_u64(o, "correct", bench.nr_correct);
+  perf_u64(o, "invalid", bench.nr_invalid);
+  perf_u64(o, "wrong", bench.nr_wrong);
+  perf_double(o, "tokenize_ns", ns_per_expr(bench.tokenize_us, nr));
+  perf_double(o, "tokenize_regex_ns", ns_per_expr(bench.tokenize_regex_us, nr));
+  perf_double(o, "parse_ns", ns_per_expr(bench.parse_us, nr));
+  perf_double(o, "evaluate_ns", ns_per_expr(bench.evaluate_us, (uint64_t)bench.nr_correct * bench.nr_round));
+  perf_double(o, "expr_ns", ns_per_expr(bench.expr_us, nr));
+  perf_double(o, "expr_per_second", bench.expr_us == 0 ? 0.0 : nr * 1e6 / bench.expr_us);
+  perf_double(o, "compiled_per_second", bench.evaluate_us == 0 ? 0.0 :
+      (uint64_t)bench.nr_correct * bench.nr_round * 1e6 / bench.evaluate_us);
+  perf_end(o);
+}
+
+/* Run the benchmark `nr_round' times on the expressions in `file'. */
+void expr_bench(const char *file, int nr_round) {
+  FILE *fp = fopen(file, "r");
+  Assert(fp != NULL, "Can not open '%s'", file);
+
+  int i, cap = 0, n = 0;
+  char **exprs = NULL;
+  uint32_t *results = NULL;
+  char *line = NULL;
+  size_t line_size = 0;
+  while (getline(&line, &line_size, fp) != -1) {
+    uint32_t result;
+    int pos;
+    if (sscanf(line, "%u %n", &result, &pos) != 1) continue;
+    line[strcspn(line, "\n")] = '\0';
+    if (n == cap) {
+      cap = (cap == 0 ? 1024 : cap * 2);
+      exprs = realloc(exprs, cap * sizeof(exprs[0]));
+      results = realloc(results, cap * sizeof(results[0]));
+      assert(exprs != NULL && results != NULL);
+    }
+    exprs[n] = strdup(line + pos);
+    results[n ++] = result;
+  }
+  free(line);
+  fclose(fp);
+
+  for (i = 0; i < NR_REGEX; i ++) {
+    int ret = regcomp(&re[i], rules[i], REG_EXTENDED);
+    Assert(ret == 0, "regex compilation failed: %s", rules[i]);
+  }
+
+  /* check the results, and keep the code which is correct */
+  ExprCode *codes = malloc((n + 1) * sizeof(codes[0]));
+  assert(codes != NULL);
+  int nr_code = 0, nr_mismatch = 0;
+  bench = (typeof(bench)) { .nr_expr = n, .nr_round = nr_round };
+  for (i = 0; i < n; i ++) {
+    if (regex_tokenize(exprs[i]) != expr_tokenize(exprs[i])) nr_mismatch ++;
+    if (!expr_compile(exprs[i], &codes[nr_code])) {
+      bench.nr_invalid ++;
+      free(exprs[i]);
+      exprs[i] = NULL;
+    }
+    else if (expr_run(&codes[nr_code]) != results[i]) {
+      bench.nr_wrong ++;
+      expr_free(&codes[nr_code]);
+    }
+    else nr_code ++;
+  }
+  bench.nr_correct = nr_code;
+  if (nr_mismatch > 0) printf("The regex rules find different tokens in %d expressions\n", nr_mismatch);
+
+  /* expr() does not check the expressions which can not be parsed */
+  int nr_valid = 0;
+  for (i = 0; i < n; i ++) {
+    if (exprs[i] != NULL) exprs[nr_valid ++] = exprs[i];
+  }
+
+  int r;
+  for (r = 0; r < nr_round; r ++) {
+    uint64_t t0 = perf_host_us();
+    for (i = 0; i < nr_valid; i ++) expr_tokenize(exprs[i]);
+    uint64_t t1 = perf_host_us();
+    for (i = 0; i < nr_valid; i ++) regex_tokenize(exprs[i]);
+    uint64_t t2 = perf_host_us();
+    for (i = 0; i < nr_valid; i ++) {
+      ExprCode code;
+      expr_tokenize(exprs[i]);
+      expr_parse(&code);
+      expr_free(&code);
+    }
+    uint64_t t3 = perf_host_us();
+    for (i = 0; i < nr_code; i ++) expr_run(&codes[i]);
+    uint64_t t4 = perf_host_us();
+    for (i = 0; i < nr_valid; i ++) {
+      bool success = true;
+      expr(exprs[i], &success);
+    }
+    uint64_t t5 = perf_host_us();
+
+    bench.tokenize_us += t1 - t0;
+    bench.tokenize_regex_us += t2 - t1;
+    bench.parse_us += (t3 - t2 > t1 - t0 ? (t3 - t2) - (t1 - t0) : 0);
+    bench.evaluate_us += t4 - t3;
+    bench.expr_us += t5 - t4;
+  }
+
+  PerfOut o = { .fp = stdout, .json = false, .depth = 0, .first = true };
+  expr_bench_perf(&o);
+
+  for (i = 0; i < nr_code; i ++) expr_free(&codes[i]);
+  for (i = 0; i < nr_valid; i ++) free(exprs[i]);
+  for (i = 0; i < NR_REGEX; i ++) regfree(&re[i]);
+  free(codes);
+  free(exprs);
+  free(results);
+}
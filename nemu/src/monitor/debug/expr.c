@@ -1,11 +1,8 @@
 #include "nemu.h"
 #include "monitor/expr.h"
 
-/* We use the POSIX regex functions to process regular expressions.
- * Type 'man regex' for more information about POSIX regex functions.
- */
-#include <sys/types.h>
-#include <regex.h>
+#include <stdlib.h>
+#include <ctype.h>
 
 enum {
   TK_NOTYPE = 256, TK_EQ, TK_NUMBER, TK_REGISTER, TK_MINUS, TK_DEREFERENCE,
@@ -15,52 +12,6 @@ enum {
 
 };
 
-static struct rule {
-  char *regex;
-  int token_type;
-} rules[] = {
-
-  /* TODO: Add more rules.
-   * Pay attention to the precedence level of different rules.
-   */
-
-  {" +", TK_NOTYPE},    // spaces
-  {"\\+", '+'},         // plus
-  {"\\-", '-'},
-  {"\\*", '*'},
-  {"/", '/'},
-  {"\\(", '('},
-  {"\\)", ')'},
-  {"\\$[a-zA-Z0-9]+", TK_REGISTER},
-  {"0[xX][0-9a-fA-F]+", TK_NUMBER},  // hex
-  {"0|[1-9][0-9]*", TK_NUMBER},
-  {"!=", TK_NOTEQ},
-  {"&&", TK_AND},
-  {"\\|\\|", TK_OR},
-  {"==", TK_EQ}         // equal
-};
-
-#define NR_REGEX (sizeof(rules) / sizeof(rules[0]) )
-
-static regex_t re[NR_REGEX] = {};
-
-/* Rules are used for many times.
- * Therefore we compile them only once before any usage.
- */
-void init_regex() {
-  int i;
-  char error_msg[128];
-  int ret;
-
-  for (i = 0; i < NR_REGEX; i ++) {
-    ret = regcomp(&re[i], rules[i].regex, REG_EXTENDED);
-    if (ret != 0) {
-      regerror(ret, &re[i], error_msg, 128);
-      panic("regex compilation failed: %s\n%s", error_msg, rules[i].regex);
-    }
-  }
-}
-
 // Operator Precedence of C
 // https://en.cppreference.com/w/c/language/operator_precedence
 enum {
@@ -75,93 +26,73 @@ enum {
   OP_LV12 = 120, // ||
 };
 
-static Token tokens[32] __attribute__((used)) = {};
-static int nr_token __attribute__((used))  = 0;
+/* the tokens of the last expression, the buffer grows with it */
+static Token *tokens = NULL;
+static int nr_token = 0;
+static int max_token = 0;
 
+static void add_token(int type, int precedence, const char *str, int len) {
+  if (nr_token == max_token) {
+    max_token = (max_token == 0 ? 32 : max_token * 2);
+    tokens = realloc(tokens, max_token * sizeof(tokens[0]));
+    assert(tokens != NULL);
+  }
+  Token *t = &tokens[nr_token ++];
+  t->type = type;
+  t->precedence = precedence;
+  snprintf(t->str, sizeof(t->str), "%.*s", len, str);
+}
+
+/* the length of the two-character operator `op' at `e', or 0 */
+static inline int match2(const char *e, const char *op) {
+  return (e[0] == op[0] && e[1] == op[1] ? 2 : 0);
+}
+
+/* Scan `e' in a single pass. The tokens are the same as those matched
+ * by the first matching rule of:
+ *   spaces, + - * / ( ), \$[a-zA-Z0-9]+, 0[xX][0-9a-fA-F]+, 0|[1-9][0-9]*,
+ *   !=, &&, ||, ==
+ */
 static bool make_token(char *e) {
   int position = 0;
-  int i;
-  regmatch_t pmatch;
 
   nr_token = 0;
 
   while (e[position] != '\0') {
-    /* Try all rules one by one. */
-    for (i = 0; i < NR_REGEX; i ++) {
-      if (regexec(&re[i], e + position, 1, &pmatch, 0) == 0 && pmatch.rm_so == 0) {
-        char *substr_start = e + position;
-        int substr_len = pmatch.rm_eo;
-
-        Log("match rules[%d] = \"%s\" at position %d with len %d: %.*s",
-            i, rules[i].regex, position, substr_len, substr_len, substr_start);
-        position += substr_len;
-
-        /* TODO: Now a new token is recognized with rules[i]. Add codes
-         * to record the token in the array `tokens'. For certain types
-         * of tokens, some extra actions should be performed.
-         */
-
-        switch (rules[i].token_type) {
-          case TK_NOTYPE: break;
-          case '+':
-          case '-':
-            tokens[nr_token].type = rules[i].token_type;
-            tokens[nr_token].precedence = OP_LV4;
-            ++nr_token;
-            break;
-          case '*':
-          case '/':
-            tokens[nr_token].type = rules[i].token_type;
-            tokens[nr_token].precedence = OP_LV3;
-            ++nr_token;
-            break;
-          case '(':
-          case ')':
-            tokens[nr_token].type = rules[i].token_type;
-            tokens[nr_token].precedence = OP_LV1;
-            ++nr_token;
-            break;
-          case TK_NUMBER:
-            tokens[nr_token].type = rules[i].token_type;
-            strncpy(tokens[nr_token].str, substr_start, substr_len);
-            tokens[nr_token].precedence = OP_LV0;
-            ++nr_token;
-            break;
-          case TK_REGISTER:
-            tokens[nr_token].type = rules[i].token_type;
-            strncpy(tokens[nr_token].str, substr_start, substr_len);
-            tokens[nr_token].precedence = OP_LV0;
-            ++nr_token;
-            break;
-          case TK_EQ:
-          case TK_NOTEQ:
-            tokens[nr_token].type = rules[i].token_type;
-            tokens[nr_token].precedence = OP_LV7;
-            ++nr_token;
-            break;
-          case TK_AND:
-            tokens[nr_token].type = rules[i].token_type;
-            tokens[nr_token].precedence = OP_LV11;
-            ++nr_token;
-            break;
-          case TK_OR:
-            tokens[nr_token].type = rules[i].token_type;
-            tokens[nr_token].precedence = OP_LV12;
-            ++nr_token;
-            break;
-          default:
-            Log("Unhandled token found!\n");
-            assert(0);
-            break;
+    char *start = e + position;
+    int len = 0;
+    switch (*start) {
+      case ' ': position ++; continue;
+      case '+': case '-': add_token(*start, OP_LV4, start, 1); len = 1; break;
+      case '*': case '/': add_token(*start, OP_LV3, start, 1); len = 1; break;
+      case '(': case ')': add_token(*start, OP_LV1, start, 1); len = 1; break;
+      case '$':
+        for (len = 1; isalnum((unsigned char)start[len]); len ++) ;
+        if (len == 1) len = 0;
+        else add_token(TK_REGISTER, OP_LV0, start, len);
+        break;
+      case '0':
+        if ((start[1] == 'x' || start[1] == 'X') && isxdigit((unsigned char)start[2])) {
+          for (len = 2; isxdigit((unsigned char)start[len]); len ++) ;
         }
+        else len = 1;
+        add_token(TK_NUMBER, OP_LV0, start, len);
         break;
-      }
+      case '1' ... '9':
+        for (len = 1; isdigit((unsigned char)start[len]); len ++) ;
+        add_token(TK_NUMBER, OP_LV0, start, len);
+        break;
+      case '!': if ((len = match2(start, "!=")) != 0) add_token(TK_NOTEQ, OP_LV7, start, len); break;
+      case '&': if ((len = match2(start, "&&")) != 0) add_token(TK_AND, OP_LV11, start, len); break;
+      case '|': if ((len = match2(start, "||")) != 0) add_token(TK_OR, OP_LV12, start, len); break;
+      case '=': if ((len = match2(start, "==")) != 0) add_token(TK_EQ, OP_LV7, start, len); break;
     }
 
-    if (i == NR_REGEX) {
+    if (len == 0) {
       printf("no match at position %d\n%s\n%*.s^\n", position, e, position, "");
       return false;
     }
+    position += len;
   }
 
   return true;
@@ -303,13 +234,12 @@ bool check_unary(int token_type) {
   );
 }
 
-uint32_t expr(char *e, bool *success) {
+/* tokenize `e', and recognize TK_DEREFERENCE and TK_MINUS */
+static bool tokenize(char *e) {
   if (!make_token(e)) {
-    *success = false;
-    return 0;
+    return false;
   }
 
-  // recognize TK_DEREFERENCE and TK_MINUS
   for (int i = 0; i < nr_token; ++i) {
     if (tokens[i].type == '*' && (i == 0 || check_unary(tokens[i - 1].type))) {
       tokens[i].type = TK_DEREFERENCE;
@@ -320,24 +250,145 @@ uint32_t expr(char *e, bool *success) {
       tokens[i].precedence = OP_LV2_1;
     }
   }
-  
-  // Log("nr_token: %d", nr_token);
-  // for (int i = 0; i < nr_token; ++i) {
-  //   if (tokens[i].type < 256) {
-  //     Log("%c", tokens[i].type);
-  //   } else {
-  //     if (tokens[i].type == TK_NUMBER) {
-  //       Log("number: %s", tokens[i].str);
-  //     } else if (tokens[i].type == TK_REGISTER) {
-  //       Log("register: %s", tokens[i].str);
-  //     } else if (tokens[i].type == TK_MINUS) {
-  //       Log("minus: %s", "-");
-  //     } else if (tokens[i].type == TK_DEREFERENCE) {
-  //       Log("dereference: %s", "*");
-  //     }
-  //   }
-  // }
+  return true;
+}
+
+uint32_t expr(char *e, bool *success) {
+  if (!tokenize(e)) {
+    *success = false;
+    return 0;
+  }
 
-  /* TODO: Insert codes to evaluate the expression. */
   return eval(0, nr_token - 1, success);
 }
+
+/* Append the postfix code of tokens[p..q] to `code'. The expression is
+ * split in the same way as eval(). */
+static bool compile(int p, int q, ExprCode *code) {
+  int error;
+  if (p > q) {
+    return false;
+  } else if (p == q) {
+    ExprInst *inst = &code->inst[code->len ++];
+    inst->type = tokens[p].type;
+    if (tokens[p].type == TK_NUMBER) {
+      bool is_hex = strlen(tokens[p].str) > 2 && (tokens[p].str[1] == 'x' || tokens[p].str[1] == 'X');
+      return sscanf(tokens[p].str, (is_hex ? "%x" : "%u"), &inst->imm) == 1;
+    } else if (tokens[p].type == TK_REGISTER) {
+      inst->reg = isa_reg_str2ptr(tokens[p].str + 1);
+      return inst->reg != NULL;
+    }
+    return false;
+  } else if (check_parentheses(p, q, &error)) {
+    return compile(p + 1, q - 1, code);
+  } else {
+    if (error == BAD_EXPR) {
+      return false;
+    }
+    int op = 0;
+    int cur = 0;
+    int max_precedence = -1;
+    for (int i = p; i <= q; ++i) {
+      if (tokens[i].type == '(') {
+        ++cur;
+      } else if (tokens[i].type == ')') {
+        --cur;
+      }
+      if (cur == 0 && tokens[i].precedence >= max_precedence) {
+        max_precedence = tokens[i].precedence;
+        op = i;
+      }
+    }
+    if (tokens[op].type != TK_DEREFERENCE && tokens[op].type != TK_MINUS) {
+      if (!compile(p, op - 1, code)) return false;
+    }
+    if (!compile(op + 1, q, code)) return false;
+    code->inst[code->len ++].type = tokens[op].type;
+    return true;
+  }
+}
+
+int expr_tokenize(char *e) {
+  return (tokenize(e) ? nr_token : -1);
+}
+
+bool expr_parse(ExprCode *code) {
+  code->len = 0;
+  code->inst = NULL;
+  if (nr_token == 0) {
+    return false;
+  }
+  code->inst = malloc(nr_token * sizeof(code->inst[0]));
+  assert(code->inst != NULL);
+  if (!compile(0, nr_token - 1, code)) {
+    expr_free(code);
+    return false;
+  }
+  return true;
+}
+
+/* Compile `e' into `code', return false if it is invalid. The code has
+ * at most one instruction for a token. It should be freed by expr_free(). */
+bool expr_compile(char *e, ExprCode *code) {
+  code->len = 0;
+  code->inst = NULL;
+  return expr_tokenize(e) > 0 && expr_parse(code);
+}
+
+void expr_free(ExprCode *code) {
+  free(code->inst);
+  code->inst = NULL;
+  code->len = 0;
+}
+
+uint32_t expr_run(const ExprCode *code) {
+  uint32_t stack[code->len];
+  int sp = 0;
+  const ExprInst *inst = code->inst, *end = code->inst + code->len;
+  for (; inst < end; inst ++) {
+    uint32_t b;
+    switch (inst->type) {
+      case TK_NUMBER: stack[sp ++] = inst->imm; continue;
+      case TK_REGISTER: stack[sp ++] = *inst->reg; continue;
+      case TK_DEREFERENCE: stack[sp - 1] = vaddr_read(stack[sp - 1], 4); continue;
+      case TK_MINUS: stack[sp - 1] = -stack[sp - 1]; continue;
+    }
+
+    b = stack[-- sp];
+    uint32_t *a = &stack[sp - 1];
+    switch (inst->type) {
+      case '+': *a += b; break;
+      case '-': *a -= b; break;
+      case '*': *a *= b; break;
+      case '/':
+        if (b == 0) {
+          panic("Division by zero!!");
+        }
+        *a /= b;
+        break;
+      case TK_EQ: *a = (*a == b); break;
+      case TK_NOTEQ: *a = (*a != b); break;
+      case TK_AND: *a = (*a && b); break;
+      case TK_OR: *a = (*a || b); break;
+      default: assert(0);
+    }
+  }
+  assert(sp == 1);
+  return stack[0];
+}
+
+bool expr_is_const_deref(const ExprCode *code, uint32_t *addr) {
+  if (code->len == 2 && code->inst[0].type == TK_NUMBER && code->inst[1].type == TK_DEREFERENCE) {
+    *addr = code->inst[0].imm;
+    return true;
+  }
+  return false;
+}
+
+bool expr_is_reg(const ExprCode *code, const uint32_t **reg) {
+  if (code->len == 1 && code->inst[0].type == TK_REGISTER) {
+    *reg = code->inst[0].reg;
+    return true;
+  }
+  return false;
+}
@@ -0,0 +1,141 @@
+#include "nemu.h"
+#include "monitor/monitor.h"
+#include "monitor/ftrace.h"
+#include "monitor/symbol.h"
+#include <stdlib.h>
+
+#ifdef DEBUG
+
+/* The function call trace written with '-f FILE'. Calls and returns are
+ * recognized by isa_ftrace_kind() from the bytes of each instruction
+ * executed, and traced as
+ *   80100010: call [f@80100100]
+ *   80100120: ret [f]
+ * indented by the depth of calls, with the names from the ELF given by
+ * '-e'. The calls are kept in a shadow stack with their return addresses.
+ * A return pops the frames up to the one it returns to, so longjmp and
+ * switching the stack do not confuse it, and a return to no frame is only
+ * traced. At exit, the number of calls and the instructions executed by
+ * each function, including those it calls, are appended to the trace. */
+
+#define MAX_INDENT 32
+
+typedef struct {
+  vaddr_t ret;
+  int func;        // the index in `symtab', nr_symbol if unknown
+  uint64_t start;  // `g_nr_guest_instr' at the call
+} Frame;
+
+typedef struct {
+  uint64_t nr_call;
+  uint64_t nr_instr;
+  int nr_active;   // the frames of the function in the stack
+} FuncStat;
+
+static FILE *ftrace_fp = NULL;
+static Frame *stack = NULL;
+static int depth = 0, max_depth = 0;
+static FuncStat *stat = NULL;
+
+void init_ftrace(const char *file) {
+  if (file == NULL) return;
+  ftrace_fp = fopen(file, "w");
+  Assert(ftrace_fp != NULL, "Can not open '%s'", file);
+  stat = calloc(nr_symbol + 1, sizeof(stat[0]));
+  assert(stat != NULL);
+  if (nr_symbol == 0) Log("no symbols are given by '-e', the functions are traced by addresses");
+  Log("The function calls are traced to %s", file);
+}
+
+static const char *func_name(int func) {
+  return (func < nr_symbol ? symtab[func].name : "??");
+}
+
+static void trace(vaddr_t pc, int kind, int func, vaddr_t target) {
+  int indent = (depth < MAX_INDENT ? depth : MAX_INDENT);
+  fprintf(ftrace_fp, "%08x: %*s%s [%s", pc, 2 * indent, "",
+      (kind == FT_CALL ? "call" : "ret"), func_name(func));
+  if (kind == FT_CALL && (func == nr_symbol || target != symtab[func].addr)) {
+    fprintf(ftrace_fp, "@%08x", target);
+  }
+  fprintf(ftrace_fp, "]\n");
+}
+
+static void pop(void) {
+  Frame *f = &stack[-- depth];
+  FuncStat *s = &stat[f->func];
+  /* only count the outermost frame of a recursive function */
+  if (-- s->nr_active == 0) s->nr_instr += g_nr_guest_instr - f->start;
+}
+
+void ftrace_step(vaddr_t pc, vaddr_t seq_pc) {
+  if (ftrace_fp == NULL) return;
+  int kind = isa_ftrace_kind(log_instr, log_instr_len);
+  if (kind == 0) return;
+
+  vaddr_t target = cpu.pc;
+  int func = symbol_find(target);
+  if (func < 0) func = nr_symbol;
+
+  if (kind == FT_CALL) {
+    trace(pc, FT_CALL, func, target);
+    if (depth == max_depth) {
+      max_depth = (max_depth == 0 ? 256 : max_depth * 2);
+      stack = realloc(stack, max_depth * sizeof(stack[0]));
+      assert(stack != NULL);
+    }
+    /* the current instruction is counted in the callee */
+    stack[depth ++] = (Frame) { .ret = seq_pc, .func = func, .start = g_nr_guest_instr };
+    stat[func].nr_call ++;
+    stat[func].nr_active ++;
+    return;
+  }
+
+  int i;
+  for (i = depth - 1; i >= 0 && stack[i].ret != target; i --) ;
+  if (i >= 0) {
+    int callee = stack[depth - 1].func;
+    while (depth > i) pop();
+    trace(pc, FT_RET, callee, target);
+  }
+  else {
+    trace(pc, FT_RET, func, target);
+  }
+}
+
+static int cmp_instr(const void *a, const void *b) {
+  uint64_t ia = stat[*(const int *)a].nr_instr, ib = stat[*(const int *)b].nr_instr;
+  return (ia < ib) - (ia > ib);
+}
+
+void ftrace_statistic(void) {
+  if (ftrace_fp == NULL) return;
+  /* the functions not returned yet run until now */
+  while (depth > 0) pop();
+
+  int nr = nr_symbol + 1, j;
+  int *order = malloc(nr * sizeof(order[0]));
+  assert(order != NULL);
+  for (j = 0; j < nr; j ++) order[j] = j;
+  qsort(order, nr, sizeof(order[0]), cmp_instr);
+
+  fprintf(ftrace_fp, "\n%12s %16s  %s\n", "calls", "instructions", "function");
+  for (j = 0; j < nr; j ++) {
+    FuncStat *s = &stat[order[j]];
+    if (s->nr_call == 0) continue;
+    fprintf(ftrace_fp, "%12lu %16lu  %s\n", s->nr_call, s->nr_instr, func_name(order[j]));
+  }
+  fflush(ftrace_fp);
+  free(order);
+}
+
+#else
+
+void init_ftrace(const char *file) {
+  if (file != NULL) Log("DEBUG is not enabled, '-f %s' is ignored", file);
+}
+
+void ftrace_statistic(void) {
+}
+
+#endif
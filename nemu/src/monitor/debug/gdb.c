@@ -0,0 +1,299 @@
+#include "cpu/exec.h"
+#include "monitor/monitor.h"
+#include "monitor/gdb.h"
+#include "monitor/breakpoint.h"
+#include "device/event.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+
+/* A stub of the remote serial protocol of GDB, started by '-G PORT'.
+ *
+ * The software breakpoints are those of the monitor, see
+ * src/monitor/debug/breakpoint.c.
+ *
+ * Ctrl-C from GDB is polled every GDB_POLL_PERIOD guest instructions. */
+
+#define GDB_PACKET_SIZE 4096
+#define GDB_POLL_PERIOD 1000000
+
+static int gdb_port = 0;
+static int fd = -1;
+static bool interrupted = false;
+
+static char rbuf[GDB_PACKET_SIZE];
+static int rbuf_pos = 0, rbuf_len = 0;
+
+void init_gdb(int port) {
+  gdb_port = port;
+}
+
+/* ------------------------ execution ------------------------ */
+
+static void gdb_poll(void) {
+  if (rbuf_pos == rbuf_len) {
+    int n = recv(fd, rbuf, sizeof(rbuf), MSG_DONTWAIT);
+    if (n <= 0) return;
+    rbuf_pos = 0;
+    rbuf_len = n;
+  }
+  if (rbuf[rbuf_pos] == 0x03) {
+    rbuf_pos ++;
+    interrupted = true;
+    nemu_state.state = NEMU_STOP;
+  }
+}
+
+static bool is_ended(void) {
+  return nemu_state.state == NEMU_END || nemu_state.state == NEMU_ABORT;
+}
+
+static void resume(bool is_step) {
+  interrupted = false;
+  if (is_ended()) return;
+  bp_exec(is_step ? 1 : -1);
+}
+
+/* ------------------------ packets ------------------------ */
+
+static int gdb_getc(void) {
+  if (rbuf_pos == rbuf_len) {
+    int n = recv(fd, rbuf, sizeof(rbuf), 0);
+    if (n <= 0) return -1;
+    rbuf_pos = 0;
+    rbuf_len = n;
+  }
+  return (uint8_t)rbuf[rbuf_pos ++];
+}
+
+static int hex2int(int c) {
+  if (c >= '0' && c <= '9') return c - '0';
+  if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+  if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+  return -1;
+}
+
+/* Receive a packet without the framing. Return its length, or -1 if
+ * the connection is closed. */
+static int recv_packet(char *pkt) {
+  while (true) {
+    int c;
+    do {
+      c = gdb_getc();
+      if (c < 0) return -1;
+    } while (c != '$');
+
+    int len = 0;
+    uint8_t sum = 0;
+    while ((c = gdb_getc()) != '#') {
+      if (c < 0) return -1;
+      if (len < GDB_PACKET_SIZE - 1) pkt[len ++] = c;
+      sum += c;
+    }
+    int hi = gdb_getc(), lo = gdb_getc();
+    if (lo < 0) return -1;
+    pkt[len] = '\0';
+
+    if (hex2int(hi) * 16 + hex2int(lo) == sum) {
+      send(fd, "+", 1, 0);
+      return len;
+    }
+    send(fd, "-", 1, 0);
+  }
+}
+
+static void send_packet(const char *data) {
+  static char out[GDB_PACKET_SIZE + 4];
+  uint8_t sum = 0;
+  int len = 0;
+  out[len ++] = '$';
+  for (; *data != '\0' && len < GDB_PACKET_SIZE; data ++) {
+    out[len ++] = *data;
+    sum += *data;
+  }
+  len += sprintf(out + len, "#%02x", sum);
+
+  int c;
+  do {
+    send(fd, out, len, 0);
+    c = gdb_getc();
+  } while (c == '-');
+}
+
+static char *put_hex32(char *p, uint32_t val) {
+  /* in the byte order of the guest */
+  int i;
+  for (i = 0; i < 4; i ++) p += sprintf(p, "%02x", (val >> (8 * i)) & 0xff);
+  return p;
+}
+
+static const char *get_hex32(const char *p, uint32_t *val) {
+  *val = 0;
+  int i;
+  for (i = 0; i < 4; i ++) {
+    int hi = hex2int(p[0]), lo = hex2int(p[1]);
+    if (hi < 0 || lo < 0) return NULL;
+    *val |= (uint32_t)(hi * 16 + lo) << (8 * i);
+    p += 2;
+  }
+  return p;
+}
+
+/* only the guest memory is accessed, but not the devices */
+static bool mem_ok(vaddr_t addr) {
+  bool success;
+  paddr_t paddr = isa_fetch_probe(addr, &success);
+  return success && pmem_offset(paddr) >= 0;
+}
+
+static void reply_stop(char *reply) {
+  switch (nemu_state.state) {
+    case NEMU_END: sprintf(reply, "W%02x", nemu_state.halt_ret & 0xff); break;
+    case NEMU_ABORT: strcpy(reply, "X06"); break;
+    default: strcpy(reply, (interrupted ? "S02" : "S05"));
+  }
+}
+
+/* Handle a packet and fill the reply. Return false if GDB is leaving. */
+static bool handle_packet(char *pkt, char *reply) {
+  char *p = pkt + 1;
+  uint32_t *r;
+  uint32_t addr, len, val;
+  int i;
+
+  reply[0] = '\0';
+  switch (pkt[0]) {
+    case '?': reply_stop(reply); break;
+
+    case 'g':
+      for (i = 0; (r = isa_gdb_reg(i)) != NULL; i ++) reply = put_hex32(reply, *r);
+      break;
+
+    case 'G':
+      for (i = 0; (r = isa_gdb_reg(i)) != NULL && *p != '\0'; i ++) {
+        if ((p = (char *)get_hex32(p, &val)) == NULL) break;
+        *r = val;
+      }
+      strcpy(reply, (p == NULL ? "E01" : "OK"));
+      break;
+
+    case 'p':
+      r = isa_gdb_reg(strtoul(p, NULL, 16));
+      if (r == NULL) strcpy(reply, "E01");
+      else put_hex32(reply, *r);
+      break;
+
+    case 'P':
+      r = isa_gdb_reg(strtoul(p, &p, 16));
+      if (r == NULL || *p != '=' || get_hex32(p + 1, &val) == NULL) strcpy(reply, "E01");
+      else { *r = val; strcpy(reply, "OK"); }
+      break;
+
+    case 'm':
+      addr = strtoul(p, &p, 16);
+      len = strtoul(p + 1, NULL, 16);
+      if (len > (GDB_PACKET_SIZE - 1) / 2) len = (GDB_PACKET_SIZE - 1) / 2;
+      for (i = 0; i < len && mem_ok(addr + i); i ++) {
+        reply += sprintf(reply, "%02x", vaddr_read(addr + i, 1));
+      }
+      if (i == 0 && len > 0) strcpy(reply, "E14");
+      break;
+
+    case 'M':
+      addr = strtoul(p, &p, 16);
+      len = strtoul(p + 1, &p, 16);
+      if (*p ++ != ':') { strcpy(reply, "E01"); break; }
+      for (i = 0; i < len; i ++, p += 2) {
+        int hi = hex2int(p[0]), lo = hex2int(p[1]);
+        if (hi < 0 || lo < 0 || !mem_ok(addr + i)) break;
+        /* the decoded instructions are invalidated as usual */
+        vaddr_write(addr + i, hi * 16 + lo, 1);
+      }
+      strcpy(reply, (i == len ? "OK" : "E14"));
+      break;
+
+    case 'c': case 's':
+      if (*p != '\0') cpu.pc = strtoul(p, NULL, 16);
+      resume(pkt[0] == 's');
+      reply_stop(reply);
+      break;
+
+    case 'Z': case 'z':
+      /* only software breakpoints */
+      if (p[0] != '0' || p[1] != ',') break;
+      addr = strtoul(p + 2, NULL, 16);
+      if (pkt[0] == 'z') bp_remove(addr);
+      else if (!bp_add(addr)) { strcpy(reply, "E01"); break; }
+      strcpy(reply, "OK");
+      break;
+
+    case 'H': strcpy(reply, "OK"); break;
+
+    case 'q':
+      if (strncmp(p, "Supported", 9) == 0) sprintf(reply, "PacketSize=%x", GDB_PACKET_SIZE - 1);
+      else if (strcmp(p, "Attached") == 0) strcpy(reply, "1");
+      else if (strcmp(p, "C") == 0) strcpy(reply, "QC1");
+      break;
+
+    case 'D':
+      strcpy(reply, "OK");
+      return false;
+
+    case 'k': return false;
+  }
+  return true;
+}
+
+/* ------------------------ main loop ------------------------ */
+
+static int gdb_accept(void) {
+  int s = socket(AF_INET, SOCK_STREAM, 0);
+  Assert(s >= 0, "can not create the socket for GDB");
+  int one = 1;
+  setsockopt(s, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+  struct sockaddr_in sa = { .sin_family = AF_INET, .sin_port = htons(gdb_port),
+    .sin_addr.s_addr = htonl(INADDR_LOOPBACK) };
+  Assert(bind(s, (struct sockaddr *)&sa, sizeof(sa)) == 0 && listen(s, 1) == 0,
+      "can not listen on port %d for GDB", gdb_port);
+  Log("Waiting for GDB on port %d, connect with 'target remote :%d'", gdb_port, gdb_port);
+
+  int c = accept(s, NULL, NULL);
+  Assert(c >= 0, "can not accept the connection of GDB");
+  close(s);
+  setsockopt(c, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  return c;
+}
+
+bool gdb_mainloop(void) {
+  if (gdb_port == 0) return false;
+
+  fd = gdb_accept();
+  Log("GDB is connected");
+  add_instr_event("gdb", GDB_POLL_PERIOD, gdb_poll);
+
+  static char pkt[GDB_PACKET_SIZE], reply[GDB_PACKET_SIZE + 16];
+  bool is_detach = false;
+  while (recv_packet(pkt) >= 0) {
+    bool keep = handle_packet(pkt, reply);
+    if (pkt[0] != 'k') send_packet(reply);
+    if (!keep) {
+      is_detach = (pkt[0] == 'D');
+      break;
+    }
+  }
+  close(fd);
+  fd = -1;
+  Log("GDB is disconnected");
+
+  if (is_detach && !is_ended()) {
+    /* run without breakpoints as if there was no GDB */
+    bp_clear();
+    bp_exec(-1);
+  }
+  return true;
+}
@@ -0,0 +1,243 @@
+#include "nemu.h"
+#include "monitor/monitor.h"
+#include "cpu/decode.h"
+
+#include <stdlib.h>
+#include <pthread.h>
+#include <zlib.h>
+
+/* The binary instruction trace written with '-i FILE'. With DEBUG, it
+ * covers the whole run, not only the first LOG_MAX instructions of the
+ * text log, since it is written without formatting anything. Without
+ * DEBUG, it is the last NR_IRING instructions written when NEMU aborts.
+ * The trace is a sequence of fixed-size records, which are printed and
+ * disassembled offline by tools/itrace.
+ *
+ * The records are cut into frames of NR_FRAME_RECORD, and each frame is
+ * compressed by zlib into a gzip member of its own, so the file is still
+ * a gzip file. A compressor thread compresses the frames, while NEMU
+ * fills the next one. For every frame, the number of its first record
+ * and its offset in the file are appended to FILE.idx as two uint64_t,
+ * so a reader can start at any instruction by decompressing one frame
+ * from the offset. */
+
+#define ITRACE_BYTES 15
+
+typedef struct {
+  uint32_t pc;
+  uint8_t len;
+  uint8_t bytes[ITRACE_BYTES];
+} ITraceRecord;
+
+#define NR_FRAME_RECORD 65536
+#define NR_FRAME 4
+
+typedef struct {
+  ITraceRecord r[NR_FRAME_RECORD];
+  int nr;
+} Frame;
+
+static const char *itrace_file = NULL;
+static FILE *itrace_fp = NULL, *idx_fp = NULL;
+/* the number of records written, and the offset of the next frame */
+static uint64_t nr_written = 0, file_off = 0;
+
+/* the frames filled by NEMU and compressed by the thread in turn */
+static Frame frames[NR_FRAME];
+static Frame *cur = NULL;
+static int fill_idx = 0, nr_full = 0;
+static bool threaded = false;
+static pthread_t tid;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t cond = PTHREAD_COND_INITIALIZER;
+static uint8_t *zbuf = NULL;
+static uLong zbuf_size = 0;
+
+static void frame_write(Frame *f) {
+  if (f->nr == 0) return;
+  z_stream zs = {};
+  // compress fast, the trace is usually large, and as gzip
+  int ret = deflateInit2(&zs, 1, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY);
+  Assert(ret == Z_OK, "deflateInit2() fails");
+  uLong in_size = f->nr * sizeof(f->r[0]);
+  uLong bound = deflateBound(&zs, in_size);
+  if (bound > zbuf_size) {
+    zbuf = realloc(zbuf, bound);
+    zbuf_size = bound;
+  }
+  zs.next_in = (void *)f->r;
+  zs.avail_in = in_size;
+  zs.next_out = zbuf;
+  zs.avail_out = bound;
+  ret = deflate(&zs, Z_FINISH);
+  Assert(ret == Z_STREAM_END, "deflate() fails");
+  deflateEnd(&zs);
+
+  uint64_t idx[2] = { nr_written, file_off };
+  fwrite(idx, sizeof(idx), 1, idx_fp);
+  fwrite(zbuf, zs.total_out, 1, itrace_fp);
+  nr_written += f->nr;
+  file_off += zs.total_out;
+  f->nr = 0;
+}
+
+static void *compress_thread(void *arg) {
+  int i = 0;
+  pthread_mutex_lock(&lock);
+  while (true) {
+    while (nr_full == 0) pthread_cond_wait(&cond, &lock);
+    Frame *f = &frames[i];
+    pthread_mutex_unlock(&lock);
+
+    // an empty frame from itrace_close() ends the thread
+    bool end = (f->nr == 0);
+    frame_write(f);
+
+    pthread_mutex_lock(&lock);
+    nr_full --;
+    pthread_cond_broadcast(&cond);
+    if (end) break;
+    i = (i + 1) % NR_FRAME;
+  }
+  pthread_mutex_unlock(&lock);
+  return NULL;
+}
+
+/* hand the current frame to the thread, and wait for a free one */
+static void frame_submit(void) {
+  pthread_mutex_lock(&lock);
+  nr_full ++;
+  pthread_cond_broadcast(&cond);
+  fill_idx = (fill_idx + 1) % NR_FRAME;
+  while (nr_full == NR_FRAME) pthread_cond_wait(&cond, &lock);
+  pthread_mutex_unlock(&lock);
+  cur = &frames[fill_idx];
+}
+
+static void itrace_open(bool use_thread) {
+  itrace_fp = fopen(itrace_file, "wb");
+  Assert(itrace_fp != NULL, "Can not open '%s'", itrace_file);
+  char idx_file[strlen(itrace_file) + 5];
+  sprintf(idx_file, "%s.idx", itrace_file);
+  idx_fp = fopen(idx_file, "wb");
+  Assert(idx_fp != NULL, "Can not open '%s'", idx_file);
+
+  cur = &frames[fill_idx];
+  if (use_thread) {
+    int ret = pthread_create(&tid, NULL, compress_thread, NULL);
+    threaded = (ret == 0);
+  }
+}
+
+static void itrace_close(void) {
+  if (threaded) {
+    // the last frame, then an empty one which ends the thread
+    if (cur->nr > 0) frame_submit();
+    frame_submit();
+    pthread_join(tid, NULL);
+    threaded = false;
+  }
+  else frame_write(cur);
+  fclose(itrace_fp);
+  fclose(idx_fp);
+  itrace_fp = idx_fp = NULL;
+}
+
+static void itrace_add(vaddr_t pc, const uint8_t *bytes, int len) {
+  ITraceRecord *r = &cur->r[cur->nr ++];
+  r->pc = pc;
+  r->len = (len < ITRACE_BYTES ? len : ITRACE_BYTES);
+  memcpy(r->bytes, bytes, r->len);
+  memset(r->bytes + r->len, 0, ITRACE_BYTES - r->len);
+  if (cur->nr == NR_FRAME_RECORD) {
+    if (threaded) frame_submit();
+    else frame_write(cur);
+  }
+}
+
+#ifdef DEBUG
+
+void init_itrace(const char *file) {
+  if (file == NULL) return;
+  itrace_file = file;
+  itrace_open(true);
+  atexit(itrace_close);
+  Log("The instructions executed are traced to %s", file);
+}
+
+/* called after executing the instruction of `len' bytes at `pc' */
+void itrace_write(vaddr_t pc, int len) {
+  if (itrace_fp == NULL) return;
+  itrace_add(pc, log_instr, (len < log_instr_len ? len : log_instr_len));
+}
+
+#else
+
+void init_itrace(const char *file) {
+  if (file == NULL) return;
+  itrace_file = file;
+  Log("The last %d instructions are traced to %s if NEMU aborts", NR_IRING, file);
+}
+
+#endif
+
+vaddr_t iring[NR_IRING] = {};
+uint32_t iring_idx = 0;
+
+/* the number of instructions of the ring printed on the screen */
+#define NR_IRING_PRINT 16
+
+/* Read the bytes of the instruction at `pc' from pmem without side
+ * effects. The length is given by the ISA, or else it is only known if
+ * `next_pc' follows it. */
+static int iring_fetch(vaddr_t pc, vaddr_t next_pc, uint8_t *bytes) {
+  bool success;
+  paddr_t paddr = isa_fetch_probe(pc, &success);
+  int offset = (success ? pmem_offset(paddr) : -1);
+  if (offset < 0) return 0;
+
+  int len = isa_instr_len(pc);
+  if (len == 0) len = (next_pc - pc > 0 && next_pc - pc <= ISA_INSTR_MAX ? next_pc - pc : ISA_INSTR_MAX);
+  if (offset + len > pmem_size) len = pmem_size - offset;
+  memcpy(bytes, pmem + offset, len);
+  return len;
+}
+
+/* Print the last instructions executed, the last one is usually the
+ * reason of aborting. With '-i FILE' and without DEBUG, the whole ring
+ * is also written to FILE. */
+void iring_dump(void) {
+  uint32_t nr = (iring_idx < NR_IRING ? iring_idx : NR_IRING);
+  uint32_t nr_print = (nr < NR_IRING_PRINT ? nr : NR_IRING_PRINT);
+  bool to_file = false;
+#ifndef DEBUG
+  if (itrace_file != NULL) {
+    itrace_open(false);
+    to_file = true;
+  }
+#endif
+
+  _Log("The last %u instructions executed:\n", nr_print);
+  uint32_t i;
+  for (i = iring_idx - nr; i != iring_idx; i ++) {
+    vaddr_t pc = iring[i % NR_IRING];
+    bool is_print = (iring_idx - i <= nr_print);
+    if (!to_file && !is_print) continue;
+
+    uint8_t bytes[ISA_INSTR_MAX];
+    vaddr_t next_pc = (i + 1 == iring_idx ? cpu.pc : iring[(i + 1) % NR_IRING]);
+    int len = iring_fetch(pc, next_pc, bytes);
+    if (to_file) itrace_add(pc, bytes, len);
+    if (is_print) {
+      char bytebuf[3 * ISA_INSTR_MAX + 1] = {};
+      int j;
+      for (j = 0; j < len; j ++) sprintf(bytebuf + 3 * j, "%02x ", bytes[j]);
+      _Log("%s %8x:   %s\n", (i + 1 == iring_idx ? "-->" : "   "), pc, (len > 0 ? bytebuf : "??"));
+    }
+  }
+
+  if (to_file) {
+    itrace_close();
+    Log("They are written to %s, see tools/itrace to disassemble them", itrace_file);
+  }
+}
@@ -1,15 +1,132 @@
 #include "common.h"
 #include <stdarg.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
 
 FILE *log_fp = NULL;
 
+/* The records of log_write() are formatted into a ring, and a writer
+ * thread writes them to `log_fp' with large buffered writes, so the
+ * emulation does not wait for stdio. The ring is bounded: a record which
+ * does not fit is dropped and counted, and the count is reported at exit.
+ * Only the writer advances `ring_tail', and the writers of records advance
+ * `ring_head' one at a time, since Log() is also called by the render
+ * thread. Both are free-running, and byte i is at ring[i % LOG_RING_SIZE].
+ *
+ * log_flush() waits until the writer has written the whole ring, and is
+ * called by Assert() and at exit, so nothing is lost when NEMU aborts. */
+
+#define LOG_RING_SIZE (4 * 1024 * 1024)
+#define LOG_FILE_BUF_SIZE (1024 * 1024)
+#define LOG_IDLE_US 1000
+
+static char ring[LOG_RING_SIZE];
+/* in different cache lines, since they are written by different threads */
+static uint64_t ring_head __attribute__((aligned(64))) = 0;
+static uint64_t ring_tail __attribute__((aligned(64))) = 0;
+static bool ring_busy = false;
+static uint64_t nr_drop = 0, drop_bytes = 0;
+static bool writer_running = false;
+
+static void *log_writer(void *arg) {
+  while (true) {
+    uint64_t t = ring_tail;
+    uint64_t h = __atomic_load_n(&ring_head, __ATOMIC_ACQUIRE);
+    if (t == h) {
+      fflush(log_fp);
+      usleep(LOG_IDLE_US);
+      continue;
+    }
+    /* at most two pieces, split at the end of the ring */
+    while (t != h) {
+      uint32_t off = t % LOG_RING_SIZE;
+      uint32_t n = (h - t < LOG_RING_SIZE - off ? h - t : LOG_RING_SIZE - off);
+      fwrite(ring + off, 1, n, log_fp);
+      t += n;
+    }
+    __atomic_store_n(&ring_tail, t, __ATOMIC_RELEASE);
+  }
+  return NULL;
+}
+
+static void ring_push(const char *buf, size_t len) {
+  while (__atomic_test_and_set(&ring_busy, __ATOMIC_ACQUIRE)) sched_yield();
+  uint64_t h = ring_head;
+  if (len > LOG_RING_SIZE - (h - __atomic_load_n(&ring_tail, __ATOMIC_ACQUIRE))) {
+    nr_drop ++;
+    drop_bytes += len;
+  }
+  else {
+    uint32_t off = h % LOG_RING_SIZE;
+    uint32_t n = (len < LOG_RING_SIZE - off ? len : LOG_RING_SIZE - off);
+    memcpy(ring + off, buf, n);
+    memcpy(ring, buf + n, len - n);
+    __atomic_store_n(&ring_head, h + len, __ATOMIC_RELEASE);
+  }
+  __atomic_clear(&ring_busy, __ATOMIC_RELEASE);
+}
+
+void log_printf(const char *fmt, ...) {
+  char buf[512];
+  va_list ap;
+  va_start(ap, fmt);
+  int len = vsnprintf(buf, sizeof(buf), fmt, ap);
+  va_end(ap);
+  if (len < 0) return;
+  if (!writer_running) {
+    fwrite(buf, 1, (len < sizeof(buf) ? len : sizeof(buf) - 1), log_fp);
+    return;
+  }
+  if (len < sizeof(buf)) {
+    ring_push(buf, len);
+    return;
+  }
+
+  /* a long record, formatted again */
+  char *p = malloc(len + 1);
+  va_start(ap, fmt);
+  vsnprintf(p, len + 1, fmt, ap);
+  va_end(ap);
+  ring_push(p, len);
+  free(p);
+}
+
+void log_flush(void) {
+  if (log_fp == NULL) return;
+  if (writer_running) {
+    uint64_t h = __atomic_load_n(&ring_head, __ATOMIC_ACQUIRE);
+    while (__atomic_load_n(&ring_tail, __ATOMIC_ACQUIRE) < h) sched_yield();
+  }
+  fflush(log_fp);
+}
+
+static void log_close(void) {
+  log_flush();
+  if (nr_drop > 0) {
+    printf("%ld records (%ld bytes) of the log are dropped since the ring is full\n", nr_drop, drop_bytes);
+    fprintf(log_fp, "\n[Warning] %ld records (%ld bytes) are dropped since the ring is full\n", nr_drop, drop_bytes);
+    fflush(log_fp);
+  }
+}
+
 void init_log(const char *log_file) {
   if (log_file == NULL) return;
   log_fp = fopen(log_file, "w");
   Assert(log_fp, "Can not open '%s'", log_file);
+  setvbuf(log_fp, NULL, _IOFBF, LOG_FILE_BUF_SIZE);
+
+  pthread_t tid;
+  if (pthread_create(&tid, NULL, log_writer, NULL) == 0) {
+    pthread_detach(tid);
+    writer_running = true;
+  }
+  atexit(log_close);
 }
 
-char log_bytebuf[80] = {};
+uint8_t log_instr[LOG_INSTR_MAX] = {};
+int log_instr_len = 0;
+bool log_asm = true;
 char log_asmbuf[80] = {};
 static char tempbuf[256] = {};
 
@@ -21,14 +138,24 @@ void strcatf(char *buf, const char *fmt, ...) {
   strcat(buf, tempbuf);
 }
 
+/* drop the trace of an instruction not printed */
+void asm_clear(void) {
+  log_instr_len = 0;
+  log_asmbuf[0] = '\0';
+}
+
 void asm_print(vaddr_t ori_pc, int instr_len, bool print_flag) {
-  snprintf(tempbuf, sizeof(tempbuf), "%8x:   %s%*.s%s", ori_pc, log_bytebuf,
+  char bytebuf[3 * LOG_INSTR_MAX + 1] = {};
+  int i;
+  for (i = 0; i < log_instr_len; i ++) {
+    sprintf(bytebuf + 3 * i, "%02x ", log_instr[i]);
+  }
+  snprintf(tempbuf, sizeof(tempbuf), "%8x:   %s%*.s%s", ori_pc, bytebuf,
       50 - (12 + 3 * instr_len), "", log_asmbuf);
   log_write("%s\n", tempbuf);
   if (print_flag) {
     puts(tempbuf);
   }
 
-  log_bytebuf[0] = '\0';
-  log_asmbuf[0] = '\0';
+  asm_clear();
 }
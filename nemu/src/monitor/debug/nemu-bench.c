@@ -0,0 +1,125 @@
+#include "nemu.h"
+#include "monitor/expr.h"
+#include "monitor/perf.h"
+#include "monitor/watchpoint.h"
+#include "memory/memory.h"
+#include "device/map.h"
+
+/* The time of the primitives of NEMU in isolation, each run `nr_op' times
+ * in a loop, so the timer is only read around a loop:
+ *   exec_once       the first instruction of the image, with the state of
+ *                   the CPU restored before each time
+ *   paddr_read      4 bytes of pmem
+ *   paddr_write     4 bytes of pmem, at the end of it
+ *   mmio_read       4 bytes of the marker device through paddr_read()
+ *   map_read        the same through map_read() of the map found at once
+ *   expr            expr() of a constant expression
+ *   expr_run        the same compiled by expr_compile()
+ *   wp_check        with NR_BENCH_WP watchpoints which do not change
+ * The times are reported in ns per operation, and also by '-j FILE'.
+ * The guest memory and devices are changed, so NEMU exits after it. */
+
+#define NR_BENCH_WP 4
+#define MARKER_MMIO 0xa1000600
+#define BENCH_EXPR "0x100 + 4 * (8 - 2) == 0x118"
+
+enum { B_EXEC, B_PREAD, B_PWRITE, B_MMIO, B_MAP, B_EXPR, B_EXPR_RUN, B_WP, NR_BENCH };
+
+static const char *bench_name[NR_BENCH] = {
+  "exec_once", "paddr_read", "paddr_write", "mmio_read", "map_read", "expr", "expr_run", "wp_check",
+};
+
+static uint64_t bench_us[NR_BENCH];
+static uint64_t bench_nr_op = 0;
+
+/* the results are kept, so the loops are not optimized away */
+static volatile uint32_t sink;
+
+vaddr_t exec_once(void);
+void asm_clear(void);
+
+void nemu_bench_perf(PerfOut *o) {
+  if (bench_nr_op == 0) return;
+  perf_begin(o, "nemu_bench");
+  perf_u64(o, "ops", bench_nr_op);
+  int i;
+  for (i = 0; i < NR_BENCH; i ++) {
+    char name[32];
+    sprintf(name, "%s_ns", bench_name[i]);
+    perf_double(o, name, bench_us[i] * 1000.0 / bench_nr_op);
+  }
+  perf_end(o);
+}
+
+void nemu_bench(uint64_t nr_op) {
+  uint64_t i, t;
+  uint32_t acc = 0;
+  bench_nr_op = nr_op;
+
+  CPU_state saved = cpu;
+  t = perf_host_us();
+  for (i = 0; i < nr_op; i ++) {
+    cpu = saved;
+    exec_once();
+    /* the disassembly is not printed */
+    asm_clear();
+  }
+  bench_us[B_EXEC] = perf_host_us() - t;
+  cpu = saved;
+
+  paddr_t base = pmem_base();
+  t = perf_host_us();
+  for (i = 0; i < nr_op; i ++) acc += paddr_read(base + IMAGE_START + (i & 0xffc), 4);
+  bench_us[B_PREAD] = perf_host_us() - t;
+
+  paddr_t scratch = base + pmem_size - PAGE_SIZE;
+  t = perf_host_us();
+  for (i = 0; i < nr_op; i ++) paddr_write(scratch + (i & 0xffc), i, 4);
+  bench_us[B_PWRITE] = perf_host_us() - t;
+
+  IOMap *map = fetch_mmio_map(MARKER_MMIO);
+  if (map != NULL) {
+    t = perf_host_us();
+    for (i = 0; i < nr_op; i ++) acc += paddr_read(MARKER_MMIO, 4);
+    bench_us[B_MMIO] = perf_host_us() - t;
+
+    t = perf_host_us();
+    for (i = 0; i < nr_op; i ++) acc += map_read(MARKER_MMIO, 4, map);
+    bench_us[B_MAP] = perf_host_us() - t;
+  }
+
+  char e[] = BENCH_EXPR;
+  t = perf_host_us();
+  for (i = 0; i < nr_op; i ++) {
+    bool success = true;
+    acc += expr(e, &success);
+  }
+  bench_us[B_EXPR] = perf_host_us() - t;
+
+  ExprCode code;
+  bool ok = expr_compile(e, &code);
+  assert(ok);
+  t = perf_host_us();
+  for (i = 0; i < nr_op; i ++) acc += expr_run(&code);
+  bench_us[B_EXPR_RUN] = perf_host_us() - t;
+  expr_free(&code);
+
+  WP *wps[NR_BENCH_WP];
+  for (i = 0; i < NR_BENCH_WP; i ++) {
+    wps[i] = new_wp();
+    strcpy(wps[i]->expression, BENCH_EXPR);
+    ok = expr_compile(wps[i]->expression, &wps[i]->code);
+    assert(ok);
+    wps[i]->val = expr_run(&wps[i]->code);
+    arm_wp(wps[i]);
+  }
+  t = perf_host_us();
+  for (i = 0; i < nr_op; i ++) acc += wp_check();
+  bench_us[B_WP] = perf_host_us() - t;
+  for (i = 0; i < NR_BENCH_WP; i ++) free_wp(wps[i]);
+
+  sink = acc;
+
+  PerfOut o = { .fp = stdout, .json = false, .depth = 0, .first = true };
+  nemu_bench_perf(&o);
+}
@@ -0,0 +1,238 @@
+#include "nemu.h"
+#include "monitor/monitor.h"
+#include "monitor/prof.h"
+#include "monitor/symbol.h"
+#include "monitor/sample.h"
+#include "device/event.h"
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/time.h>
+
+/* A sampling profiler of the guest. A sample is the pc, followed by the
+ * return addresses on the stack with '-g', and the samples are counted by
+ * their stacks in a hash table. At exit, they are symbolized by the guest
+ * ELF given by '-e' and written to
+ *   FILE         the flat profile, the samples in each function by itself
+ *                (self) and together with the functions it calls (total)
+ *   FILE.folded  a line "outer;...;inner count" for each stack, which can
+ *                be drawn by flamegraph.pl
+ * Addresses without a symbol are written as they are. */
+
+#define PROF_PERIOD 10000
+#define PROF_MAX_DEPTH 32
+
+typedef struct {
+  uint64_t count;  // 0 if the entry is empty
+  int depth;
+  vaddr_t pc[PROF_MAX_DEPTH];
+} Stack;
+
+volatile int prof_pending = false;
+static const char *prof_file = NULL;
+static bool prof_backtrace = false;
+static char prof_unit[64] = "";
+
+/* open addressing, `table_size' is a power of 2 */
+static Stack *table = NULL;
+static uint32_t table_size = 0, nr_stack = 0;
+static uint64_t nr_sample = 0;
+
+static uint32_t stack_hash(const Stack *s) {
+  uint32_t h = 2166136261u;
+  int i;
+  for (i = 0; i < s->depth; i ++) h = (h ^ s->pc[i]) * 16777619u;
+  return h;
+}
+
+static Stack *lookup(const Stack *s) {
+  uint32_t i = stack_hash(s) & (table_size - 1);
+  while (table[i].count != 0) {
+    Stack *e = &table[i];
+    if (e->depth == s->depth && memcmp(e->pc, s->pc, s->depth * sizeof(s->pc[0])) == 0) break;
+    i = (i + 1) & (table_size - 1);
+  }
+  return &table[i];
+}
+
+static void grow_table(void) {
+  Stack *old = table;
+  uint32_t i, old_size = table_size;
+  table_size = (table_size == 0 ? 1024 : table_size * 2);
+  table = calloc(table_size, sizeof(table[0]));
+  assert(table != NULL);
+  for (i = 0; i < old_size; i ++) {
+    if (old[i].count != 0) *lookup(&old[i]) = old[i];
+  }
+  free(old);
+}
+
+void prof_sample(void) {
+  prof_pending = false;
+  if (prof_file == NULL || !sample_detailed) return;
+
+  Stack s;
+  s.pc[0] = cpu.pc;
+  s.depth = 1 + (prof_backtrace ? isa_backtrace(s.pc + 1, PROF_MAX_DEPTH - 1) : 0);
+
+  if (2 * (nr_stack + 1) > table_size) grow_table();
+  Stack *e = lookup(&s);
+  if (e->count == 0) {
+    *e = s;
+    e->count = 0;
+    nr_stack ++;
+  }
+  e->count ++;
+  nr_sample ++;
+}
+
+static void prof_alarm(int sig) {
+  prof_pending = true;
+  nemu_event = true;
+}
+
+void init_prof(const char *file, const char *spec, bool backtrace) {
+  if (file == NULL) return;
+  prof_file = file;
+  prof_backtrace = backtrace;
+
+  char *end = "";
+  uint64_t period = (spec == NULL ? PROF_PERIOD : strtoull(spec, &end, 10));
+  Assert(period > 0 && (*end == '\0' || strcmp(end, "us") == 0),
+      "invalid period of profiling '%s'", spec);
+
+  if (*end == '\0') {
+    add_instr_event("prof", period, prof_sample);
+    snprintf(prof_unit, sizeof(prof_unit), "%lu instructions", period);
+  }
+  else {
+    struct sigaction sa = { .sa_handler = prof_alarm, .sa_flags = SA_RESTART };
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGPROF, &sa, NULL);
+    struct timeval tv = { .tv_sec = period / 1000000, .tv_usec = period % 1000000 };
+    struct itimerval it = { .it_interval = tv, .it_value = tv };
+    setitimer(ITIMER_PROF, &it, NULL);
+    snprintf(prof_unit, sizeof(prof_unit), "%lu us", period);
+  }
+  Log("The guest is profiled every %s to %s", prof_unit, file);
+}
+
+/* the function of the i-th address of a stack, nr_symbol if unknown */
+static int frame_symbol(const Stack *s, int i) {
+  /* a return address may be past the end of the calling function */
+  int k = symbol_find(i == 0 ? s->pc[0] : s->pc[i] - 1);
+  return (k < 0 ? nr_symbol : k);
+}
+
+static uint64_t *self = NULL, *total = NULL;
+
+static int cmp_self(const void *a, const void *b) {
+  int ka = *(const int *)a, kb = *(const int *)b;
+  if (self[ka] != self[kb]) return (self[ka] < self[kb]) - (self[ka] > self[kb]);
+  return (total[ka] < total[kb]) - (total[ka] > total[kb]);
+}
+
+static void write_flat(FILE *fp) {
+  int nr = nr_symbol + 1;
+  self = calloc(nr, sizeof(self[0]));
+  total = calloc(nr, sizeof(total[0]));
+  /* the last stack counted in `total' for each function, for recursion */
+  uint32_t *last = malloc(nr * sizeof(last[0]));
+  int *order = malloc(nr * sizeof(order[0]));
+  assert(self != NULL && total != NULL && last != NULL && order != NULL);
+  memset(last, 0xff, nr * sizeof(last[0]));
+
+  uint32_t i;
+  int j;
+  for (i = 0; i < table_size; i ++) {
+    Stack *s = &table[i];
+    if (s->count == 0) continue;
+    self[frame_symbol(s, 0)] += s->count;
+    for (j = 0; j < s->depth; j ++) {
+      int k = frame_symbol(s, j);
+      if (last[k] == i) continue;
+      last[k] = i;
+      total[k] += s->count;
+    }
+  }
+
+  for (j = 0; j < nr; j ++) order[j] = j;
+  qsort(order, nr, sizeof(order[0]), cmp_self);
+
+  fprintf(fp, "# %lu samples, one every %s\n", nr_sample, prof_unit);
+  fprintf(fp, "%8s %10s %8s %10s  %s\n", "self%", "self", "total%", "total", "function");
+  for (j = 0; j < nr && total[order[j]] != 0; j ++) {
+    int k = order[j];
+    fprintf(fp, "%7.2f%% %10lu %7.2f%% %10lu  %s\n", 100.0 * self[k] / nr_sample, self[k],
+        100.0 * total[k] / nr_sample, total[k], (k < nr_symbol ? symtab[k].name : "??"));
+  }
+
+  free(self);
+  free(total);
+  free(last);
+  free(order);
+}
+
+typedef struct {
+  char *frames;
+  uint64_t count;
+} Folded;
+
+static int cmp_folded(const void *a, const void *b) {
+  return strcmp(((const Folded *)a)->frames, ((const Folded *)b)->frames);
+}
+
+/* the stacks are merged by their functions */
+static void write_folded(FILE *fp) {
+  Folded *f = malloc(nr_stack * sizeof(f[0]));
+  assert(f != NULL);
+  uint32_t i, nr = 0;
+  int j;
+  for (i = 0; i < table_size; i ++) {
+    Stack *s = &table[i];
+    if (s->count == 0) continue;
+    char *p = f[nr].frames = malloc(PROF_MAX_DEPTH * 64);
+    assert(p != NULL);
+    for (j = s->depth - 1; j >= 0; j --) {
+      int k = frame_symbol(s, j);
+      if (k < nr_symbol) p += sprintf(p, "%.62s", symtab[k].name);
+      else p += sprintf(p, "0x%08x", s->pc[j]);
+      if (j > 0) *p ++ = ';';
+    }
+    *p = '\0';
+    f[nr ++].count = s->count;
+  }
+  qsort(f, nr, sizeof(f[0]), cmp_folded);
+
+  for (i = 0; i < nr; i ++) {
+    uint64_t count = f[i].count;
+    while (i + 1 < nr && strcmp(f[i].frames, f[i + 1].frames) == 0) {
+      free(f[i].frames);
+      count += f[++ i].count;
+    }
+    fprintf(fp, "%s %lu\n", f[i].frames, count);
+    free(f[i].frames);
+  }
+  free(f);
+}
+
+void prof_statistic(void) {
+  if (prof_file == NULL || nr_sample == 0) return;
+
+  char *folded = malloc(strlen(prof_file) + sizeof(".folded"));
+  assert(folded != NULL);
+  sprintf(folded, "%s.folded", prof_file);
+  FILE *fp = fopen(prof_file, "w");
+  FILE *fp_folded = fopen(folded, "w");
+  if (fp == NULL || fp_folded == NULL) {
+    Log("can not open '%s' or '%s' for the profile", prof_file, folded);
+  }
+  else {
+    write_flat(fp);
+    write_folded(fp_folded);
+    Log("the profile of %lu samples is written to %s and %s", nr_sample, prof_file, folded);
+  }
+  if (fp != NULL) fclose(fp);
+  if (fp_folded != NULL) fclose(fp_folded);
+  free(folded);
+}
@@ -0,0 +1,130 @@
+#include "nemu.h"
+#include "monitor/monitor.h"
+#include "monitor/perf.h"
+#include "monitor/script.h"
+#include <stdlib.h>
+#include <unistd.h>
+
+/* The script mode, started by '-B SCRIPT[:JSON]', runs the commands of the
+ * monitor in the file SCRIPT, one per line, without readline. Empty lines
+ * and the lines starting with '#' are skipped. It stops after 'q' or the
+ * last line. The results are written as a JSON object, e.g.
+ *
+ *   { "script": "t.txt", "commands": [
+ *     { "command": "si 10", "output": "...", "state": "stop",
+ *       "pc": 2148532264, "instructions": 10, "us": 3 }, ... ],
+ *     "state": "end", "halt_ret": 0, "good": true, "instructions": 10 }
+ *
+ * where "output" is everything written to stdout by the command, e.g. by
+ * the guest, and "us" is the host time it takes. */
+
+#define CMD_MAX 4096
+
+static char *script_file = NULL;
+static char *json_file = NULL;
+
+void init_script(char *spec) {
+  char *json = strrchr(spec, ':');
+  if (json != NULL) {
+    *json ++ = '\0';
+    json_file = json;
+  }
+  script_file = spec;
+}
+
+static void json_string(FILE *fp, const char *s, size_t len) {
+  size_t i;
+  fputc('"', fp);
+  for (i = 0; i < len; i ++) {
+    unsigned char c = s[i];
+    switch (c) {
+      case '"': fputs("\\\"", fp); break;
+      case '\\': fputs("\\\\", fp); break;
+      case '\n': fputs("\\n", fp); break;
+      case '\t': fputs("\\t", fp); break;
+      default:
+        if (c < 0x20) fprintf(fp, "\\u%04x", c);
+        else fputc(c, fp);
+    }
+  }
+  fputc('"', fp);
+}
+
+static const char *state_name(int state) {
+  switch (state) {
+    case NEMU_STOP: return "stop";
+    case NEMU_RUNNING: return "running";
+    case NEMU_END: return "end";
+    case NEMU_ABORT: return "abort";
+    default: return "unknown";
+  }
+}
+
+/* Execute `line' with stdout redirected to `out', and write its result to
+ * `fp'. Return the value of ui_exec(). */
+static int run_command(FILE *fp, char *line, FILE *out) {
+  fprintf(fp, "\n    { \"command\": ");
+  json_string(fp, line, strlen(line));
+
+  fflush(stdout);
+  int saved = dup(STDOUT_FILENO);
+  int fd = fileno(out);
+  Assert(ftruncate(fd, 0) == 0, "can not truncate the file for the outputs");
+  lseek(fd, 0, SEEK_SET);
+  dup2(fd, STDOUT_FILENO);
+  uint64_t us = perf_host_us();
+  int ret = ui_exec(line);
+  us = perf_host_us() - us;
+  fflush(stdout);
+  dup2(saved, STDOUT_FILENO);
+  close(saved);
+
+  off_t len = lseek(fd, 0, SEEK_CUR);
+  char *buf = malloc(len + 1);
+  len = pread(fd, buf, len, 0);
+  fprintf(fp, ", \"output\": ");
+  json_string(fp, buf, (len > 0 ? len : 0));
+  free(buf);
+
+  fprintf(fp, ", \"state\": \"%s\", \"pc\": %u, \"instructions\": %lu, \"us\": %lu }",
+      state_name(nemu_state.state), cpu.pc, g_nr_guest_instr, us);
+  return ret;
+}
+
+bool script_mainloop(void) {
+  if (script_file == NULL) return false;
+
+  FILE *script = fopen(script_file, "r");
+  Assert(script != NULL, "can not open the script '%s'", script_file);
+  FILE *fp = (json_file == NULL ? stdout : fopen(json_file, "w"));
+  Assert(fp != NULL, "can not open '%s' for the results of the script", json_file);
+  FILE *out = tmpfile();
+  Assert(out != NULL, "can not create the file for the outputs of the script");
+
+  fprintf(fp, "{ \"script\": ");
+  json_string(fp, script_file, strlen(script_file));
+  fprintf(fp, ", \"commands\": [");
+
+  char line[CMD_MAX];
+  bool first = true;
+  while (fgets(line, sizeof(line), script) != NULL) {
+    line[strcspn(line, "\r\n")] = '\0';
+    char *p = line + strspn(line, " \t");
+    if (*p == '\0' || *p == '#') continue;
+
+    if (!first) fputc(',', fp);
+    first = false;
+    /* the results of the previous commands are kept if NEMU aborts */
+    if (run_command(fp, p, out) < 0) break;
+    fflush(fp);
+  }
+
+  fprintf(fp, " ],\n  \"state\": \"%s\", \"halt_ret\": %u, \"good\": %s, \"instructions\": %lu }\n",
+      state_name(nemu_state.state), nemu_state.halt_ret,
+      (nemu_state.state == NEMU_END && nemu_state.halt_ret == 0 ? "true" : "false"), g_nr_guest_instr);
+
+  fclose(out);
+  fclose(script);
+  if (fp != stdout) fclose(fp);
+  return true;
+}
@@ -0,0 +1,76 @@
+#include "common.h"
+#include "monitor/symbol.h"
+#include <elf.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/* Only the image is loaded to memory, and the ELF is just read for the
+ * names of the functions. The strings are kept in the buffer of the
+ * whole file. */
+
+Symbol *symtab = NULL;
+int nr_symbol = 0;
+static char *elf = NULL;
+
+static int cmp_symbol(const void *a, const void *b) {
+  const Symbol *sa = a, *sb = b;
+  return (sa->addr > sb->addr) - (sa->addr < sb->addr);
+}
+
+void init_symbol(const char *elf_file) {
+  if (elf_file == NULL) return;
+
+  FILE *fp = fopen(elf_file, "rb");
+  Assert(fp != NULL, "Can not open '%s'", elf_file);
+  fseek(fp, 0, SEEK_END);
+  long size = ftell(fp);
+  elf = malloc(size);
+  assert(elf != NULL);
+  fseek(fp, 0, SEEK_SET);
+  int ret = fread(elf, size, 1, fp);
+  assert(ret == 1);
+  fclose(fp);
+
+  Elf32_Ehdr *eh = (void *)elf;
+  Assert(size >= sizeof(*eh) && memcmp(eh->e_ident, ELFMAG, SELFMAG) == 0 &&
+      eh->e_ident[EI_CLASS] == ELFCLASS32, "'%s' is not a 32-bit ELF", elf_file);
+  Elf32_Shdr *sh = (void *)(elf + eh->e_shoff);
+
+  int i, j;
+  for (i = 0; i < eh->e_shnum; i ++) {
+    if (sh[i].sh_type != SHT_SYMTAB) continue;
+    Elf32_Sym *sym = (void *)(elf + sh[i].sh_offset);
+    const char *strtab = elf + sh[sh[i].sh_link].sh_offset;
+    int nr = sh[i].sh_size / sizeof(sym[0]);
+    symtab = realloc(symtab, (nr_symbol + nr) * sizeof(symtab[0]));
+    assert(symtab != NULL);
+    for (j = 0; j < nr; j ++) {
+      if (ELF32_ST_TYPE(sym[j].st_info) != STT_FUNC || sym[j].st_value == 0) continue;
+      symtab[nr_symbol ++] = (Symbol) { .addr = sym[j].st_value,
+        .size = sym[j].st_size, .name = strtab + sym[j].st_name };
+    }
+  }
+  qsort(symtab, nr_symbol, sizeof(symtab[0]), cmp_symbol);
+
+  Log("%d functions are loaded from %s", nr_symbol, elf_file);
+}
+
+int symbol_find(vaddr_t addr) {
+  /* the last symbol not above `addr' */
+  int lo = 0, hi = nr_symbol;
+  while (lo < hi) {
+    int mid = (lo + hi) / 2;
+    if (symtab[mid].addr <= addr) lo = mid + 1;
+    else hi = mid;
+  }
+  if (lo == 0) return -1;
+  Symbol *s = &symtab[lo - 1];
+  /* a symbol without size extends to the next one */
+  if (s->size != 0 && addr - s->addr >= s->size) return -1;
+  return lo - 1;
+}
+
+const char *symbol_name(vaddr_t addr) {
+  int i = symbol_find(addr);
+  return (i < 0 ? NULL : symtab[i].name);
+}
@@ -2,13 +2,23 @@
 #include "monitor/expr.h"
 #include "monitor/watchpoint.h"
 #include "nemu.h"
+#include "memory/heatmap.h"
+#include "monitor/diff-test.h"
+#include "monitor/perf.h"
+#include "monitor/gdb.h"
+#include "monitor/breakpoint.h"
+#include "monitor/snapshot.h"
+#include "monitor/reverse.h"
+#include "monitor/machine.h"
+#include "monitor/fork-server.h"
+#include "monitor/script.h"
+#include "monitor/fuzz.h"
+#include "device/map.h"
 
 #include <stdlib.h>
 #include <readline/readline.h>
 #include <readline/history.h>
 
-void cpu_exec(uint64_t);
-
 /* We use the `readline' library to provide more flexibility to read from stdin. */
 static char* rl_gets() {
   static char *line_read = NULL;
@@ -27,8 +37,13 @@ static char* rl_gets() {
   return line_read;
 }
 
+/* run, starting from the instruction at a breakpoint if stopped there */
+static void run(uint64_t n) {
+  if (bp_exec(n)) printf("Breakpoint at 0x%08x\n", cpu.pc);
+}
+
 static int cmd_c(char *args) {
-  cpu_exec(-1);
+  run(-1);
   return 0;
 }
 
@@ -44,7 +59,7 @@ static int cmd_si(char *args) {
   if (arg != NULL) {
     N = strtoull(arg, NULL, 10);
   }
-  cpu_exec(N);
+  run(N);
   return 0;
 }
 
@@ -54,6 +69,12 @@ static int cmd_info(char *args) {
     isa_reg_display();
   } else if (strcmp(arg, "w") == 0) {
     wp_display();
+  } else if (strcmp(arg, "b") == 0) {
+    bp_display();
+  } else if (strcmp(arg, "perf") == 0) {
+    perf_dump(stdout, false);
+  } else if (strcmp(arg, "io") == 0) {
+    io_display();
   } else {
     printf("Unknown command '%s'\n", arg);
   }
@@ -62,32 +83,89 @@ static int cmd_info(char *args) {
 
 static int cmd_x(char *args) {
   char *scan_num_str = strtok(NULL, " ");
-  if (scan_num_str == NULL) {
+  char *expression = strtok(NULL, "");
+  if (scan_num_str == NULL || expression == NULL) {
     printf("invalid args\nusage: x N address\n");
     return 0;
   }
   int scan_num = atoi(scan_num_str);
-  char *expression = scan_num_str + strlen(scan_num_str) + 1;
-  if (expression == NULL) {
-    printf("invalid args\nusage: x N address\n");
-    return 0;
-  }
-  uint32_t expr_val;
   bool success = true;
-  expr_val = expr(expression, &success);
+  vaddr_t addr = expr(expression, &success);
   if (success == false) {
-    Log("Expr evaluation failed.");
-    assert(0);
+    printf("Expr evaluation failed.\n");
+    return 0;
   }
-  uint32_t val;
-  for (int i = 0; i < scan_num; ++i) {
-    val = vaddr_read(expr_val + (i << 2), 4);
-    printf("%08x ", val);
+  /* Translate each page once, and read the words in pmem directly. The
+   * others, e.g. MMIO, are read one by one. */
+  int i = 0;
+  while (i < scan_num) {
+    vaddr_t va = addr + (i << 2);
+    int n = scan_num - i;
+    if (n > (PAGE_SIZE - (va & PAGE_MASK)) / 4) n = (PAGE_SIZE - (va & PAGE_MASK)) / 4;
+    bool ok;
+    paddr_t pa = isa_fetch_probe(va, &ok);
+    int offset = (ok && (va & 3) == 0 ? pmem_offset(pa) : -1);
+    if (n > 0 && offset >= 0 && pmem_offset(pa + n * 4 - 1) >= 0) {
+      int j;
+      for (j = 0; j < n; j ++) printf("%08x ", host_read(pmem + offset + j * 4, 4));
+      i += n;
+    }
+    else {
+      printf("%08x ", vaddr_read(va, 4));
+      i ++;
+    }
   }
   printf("\n");
   return 0;
 }
 
+#define NR_FIND_SHOW 32
+
+static int cmd_find(char *args) {
+  /* the width is optional */
+  char *rest = args;
+  int len = 4;
+  if (args != NULL && args[0] != '\0' && strchr("bhws", args[0]) != NULL && args[1] == ' ') {
+    len = (args[0] == 'b' ? 1 : args[0] == 'h' ? 2 : args[0] == 'w' ? 4 : 0);
+    rest = args + 2;
+  }
+  if (rest == NULL || rest[0] == '\0') {
+    printf("usage: find [b|h|w] EXPR, or find s STRING\n");
+    return 0;
+  }
+
+  uint32_t val = 0;
+  const void *pat = rest;
+  int align = 1;
+  if (len == 0) len = strlen(rest);
+  else {
+    bool success = true;
+    val = expr(rest, &success);
+    if (!success) {
+      printf("Expr evaluation failed.\n");
+      return 0;
+    }
+    if (len < 4 && (val >> (len * 8)) != 0) {
+      printf("0x%x does not fit in %d bytes\n", val, len);
+      return 0;
+    }
+    pat = &val;
+    align = len;
+  }
+
+  /* the physical addresses of the matches in pmem */
+  uint64_t nr = 0;
+  int64_t offset = 0;
+  while ((offset = pmem_find(offset, pat, len, align)) >= 0) {
+    if (nr < NR_FIND_SHOW) printf("0x%08x\n", pmem_base() + (uint32_t)offset);
+    nr ++;
+    offset += align;
+  }
+  if (nr > NR_FIND_SHOW) printf("...\n");
+  printf("%ld match%s\n", nr, (nr == 1 ? "" : "es"));
+  return 0;
+}
+
 static int cmd_p(char *args) {
   bool success = true;
   uint32_t val = expr(args, &success);
@@ -100,16 +178,18 @@ static int cmd_p(char *args) {
 }
 
 static int cmd_w(char *args) {
-  bool success = true;
-  uint32_t val = expr(args, &success);
-  if (success == false) {
+  ExprCode code;
+  if (args == NULL || !expr_compile(args, &code)) {
     printf("Expr evaluation failed.\n");
-    return 0;    
+    return 0;
   }
   WP* wp = new_wp();
-  wp->val = val;
-  strcpy(wp->expression, args);
-  Log("wp %d set: %s = 0x%08x", wp->NO, wp->expression, wp->val);
+  wp->code = code;
+  wp->val = expr_run(&code);
+  snprintf(wp->expression, sizeof(wp->expression), "%s", args);
+  arm_wp(wp);
+  Log("wp %d set: %s = 0x%08x%s", wp->NO, wp->expression, wp->val,
+      (wp->is_mem ? ", checked by the writes to memory" : ""));
   return 0;
 }
 
@@ -120,6 +200,136 @@ static int cmd_d(char *args) {
   return 0;
 }
 
+static int cmd_b(char *args) {
+  bool success = true;
+  vaddr_t pc = (args == NULL ? 0 : expr(args, &success));
+  if (args == NULL || !success) {
+    printf("usage: b EXPR\n");
+    return 0;
+  }
+  if (!bp_add(pc)) printf("Too many breakpoints\n");
+  else Log("breakpoint set at 0x%08x", pc);
+  return 0;
+}
+
+static int cmd_bd(char *args) {
+  bool success = true;
+  vaddr_t pc = (args == NULL ? 0 : expr(args, &success));
+  if (args == NULL || !success) {
+    printf("usage: bd EXPR\n");
+    return 0;
+  }
+  bp_remove(pc);
+  return 0;
+}
+
+static int cmd_save(char *args) {
+  char *arg = strtok(NULL, " ");
+  if (arg == NULL) printf("usage: save FILE\n");
+  else snapshot_save(arg);
+  return 0;
+}
+
+static int cmd_load(char *args) {
+  char *arg = strtok(NULL, " ");
+  if (arg == NULL) printf("usage: load FILE\n");
+  else snapshot_load(arg);
+  return 0;
+}
+
+/* The machines in one process, 0 is the one started by NEMU. The slot
+ * of the running machine is NULL. */
+#define NR_MACHINE 16
+static Machine *machines[NR_MACHINE];
+static int nr_machine = 1, cur_machine = 0;
+
+static int cmd_machine(char *args) {
+  char *arg = strtok(NULL, " ");
+  if (arg != NULL && strcmp(arg, "new") == 0) {
+    char *file = strtok(NULL, " ");
+    if (nr_machine == NR_MACHINE) printf("There are already %d machines\n", NR_MACHINE);
+    else if (file == NULL) printf("usage: machine new FILE\n");
+    else {
+      machines[nr_machine] = machine_new(file);
+      printf("machine %d: %s\n", nr_machine ++, file);
+    }
+    return 0;
+  }
+  if (arg == NULL) {
+    printf("machine %d of %d is running\n", cur_machine, nr_machine);
+    return 0;
+  }
+  int NO = atoi(arg);
+  if (NO < 0 || NO >= nr_machine) printf("usage: machine [new FILE|N]\n");
+  else if (NO != cur_machine) {
+    Machine *m = machines[NO];
+    machine_swap(m);
+    machines[NO] = NULL;
+    machines[cur_machine] = m;
+    cur_machine = NO;
+  }
+  return 0;
+}
+
+/* a checkpoint every N (10 by default) million instructions */
+static int cmd_record(char *args) {
+  char *arg = strtok(NULL, " ");
+  if (arg != NULL && strcmp(arg, "off") == 0) {
+    rev_stop();
+    return 0;
+  }
+  uint64_t N = (arg == NULL ? 10 : strtoull(arg, NULL, 10));
+  if (N == 0) printf("usage: record [N|off]\n");
+  else rev_start(N * 1000000);
+  return 0;
+}
+
+static int cmd_rsi(char *args) {
+  char *arg = strtok(NULL, " ");
+  uint64_t N = 1;
+  if (arg != NULL) {
+    N = strtoull(arg, NULL, 10);
+  }
+  rev_step(N);
+  return 0;
+}
+
+static int cmd_rc(char *args) {
+  rev_continue();
+  return 0;
+}
+
+/* fast [N|pc=ADDR|off] */
+static int cmd_fast(char *args) {
+  char *arg = strtok(NULL, " ");
+  if (arg == NULL) exec_set_fast(true);
+  else if (strcmp(arg, "off") == 0) exec_set_fast(false);
+  else if (strncmp(arg, "pc=", 3) == 0) exec_fast_until(UINT64_MAX, strtoul(arg + 3, NULL, 0));
+  else exec_fast_until(g_nr_guest_instr + strtoull(arg, NULL, 10), (vaddr_t)-1);
+  printf("the %s engine is running\n", (exec_is_fast() ? "fast" : "instrumented"));
+  return 0;
+}
+
+#ifdef DIFF_TEST
+static int cmd_detach(char *args) {
+  difftest_detach();
+  return 0;
+}
+
+static int cmd_attach(char *args) {
+  difftest_attach();
+  return 0;
+}
+#endif
+
+#ifdef PMEM_HEATMAP
+static int cmd_heat(char *args) {
+  char *arg = strtok(NULL, " ");
+  heatmap_dump(arg == NULL ? 10 : atoi(arg));
+  return 0;
+}
+#endif
+
 static struct {
   char *name;
   char *description;
@@ -131,9 +341,26 @@ static struct {
   { "si", "Single execution", cmd_si },
   { "info", "Show information of program status", cmd_info },
   { "x", "Scan memory", cmd_x },
+  { "find", "Search pmem for a byte (b), half word (h) or word (w, by default) equal to EXPR, or for STRING (s)", cmd_find },
   { "p", "Expr evaluation", cmd_p },
   { "w", "Set watchpoint", cmd_w },
   { "d", "Delete watchpoint", cmd_d },
+  { "b", "Set breakpoint at the pc of EXPR, checked only when the instruction is decoded", cmd_b },
+  { "bd", "Delete the breakpoint at the pc of EXPR", cmd_bd },
+  { "save", "Save a snapshot of the machine to FILE", cmd_save },
+  { "load", "Restore the machine from the snapshot in FILE", cmd_load },
+  { "machine", "Start another machine with the image FILE, or switch to machine N", cmd_machine },
+  { "record", "Record for reverse execution with a checkpoint every N (10 by default) million instructions, or stop with 'off'", cmd_record },
+  { "rsi", "Reverse single execution", cmd_rsi },
+  { "rc", "Continue backwards to the last change of a watchpoint", cmd_rc },
+  { "fast", "Run without tracing, watchpoints and differential testing, for N more instructions, until pc=ADDR, or until 'fast off'", cmd_fast },
+#ifdef DIFF_TEST
+  { "detach", "Stop differential testing", cmd_detach },
+  { "attach", "Restart differential testing, and sync the memory written since detaching", cmd_attach },
+#endif
+#ifdef PMEM_HEATMAP
+  { "heat", "Show the N (10 by default) most accessed pages", cmd_heat },
+#endif
 
   /* TODO: Add more commands */
 
@@ -164,40 +391,49 @@ static int cmd_help(char *args) {
   return 0;
 }
 
-void ui_mainloop(int is_batch_mode) {
-  if (is_batch_mode) {
-    cmd_c(NULL);
-    return;
-  }
+int ui_exec(char *str) {
+  char *str_end = str + strlen(str);
 
-  for (char *str; (str = rl_gets()) != NULL; ) {
-    char *str_end = str + strlen(str);
-
-    /* extract the first token as the command */
-    char *cmd = strtok(str, " ");
-    if (cmd == NULL) { continue; }
-
-    /* treat the remaining string as the arguments,
-     * which may need further parsing
-     */
-    char *args = cmd + strlen(cmd) + 1;
-    if (args >= str_end) {
-      args = NULL;
-    }
+  /* extract the first token as the command */
+  char *cmd = strtok(str, " ");
+  if (cmd == NULL) { return 0; }
+
+  /* treat the remaining string as the arguments,
+   * which may need further parsing
+   */
+  char *args = cmd + strlen(cmd) + 1;
+  if (args >= str_end) {
+    args = NULL;
+  }
 
 #ifdef HAS_IOE
-    extern void sdl_clear_event_queue(void);
-    sdl_clear_event_queue();
+  extern void sdl_clear_event_queue(void);
+  sdl_clear_event_queue();
 #endif
 
-    int i;
-    for (i = 0; i < NR_CMD; i ++) {
-      if (strcmp(cmd, cmd_table[i].name) == 0) {
-        if (cmd_table[i].handler(args) < 0) { return; }
-        break;
-      }
+  int i;
+  for (i = 0; i < NR_CMD; i ++) {
+    if (strcmp(cmd, cmd_table[i].name) == 0) {
+      return cmd_table[i].handler(args);
     }
+  }
+
+  printf("Unknown command '%s'\n", cmd);
+  return 0;
+}
+
+void ui_mainloop(int is_batch_mode) {
+  if (gdb_mainloop()) return;
+  if (fork_server_mainloop()) return;
+  if (script_mainloop()) return;
+  if (fuzz_mainloop()) return;
 
-    if (i == NR_CMD) { printf("Unknown command '%s'\n", cmd); }
+  if (is_batch_mode) {
+    cmd_c(NULL);
+    return;
+  }
+
+  for (char *str; (str = rl_gets()) != NULL; ) {
+    if (ui_exec(str) < 0) { return; }
   }
 }
@@ -1,11 +1,31 @@
+#include "nemu.h"
+#include "monitor/monitor.h"
 #include "monitor/watchpoint.h"
 #include "monitor/expr.h"
+#include "monitor/reverse.h"
+#include "cpu/decode-cache.h"
+
+/* A watchpoint of `*ADDR' with a constant ADDR inside pmem is a memory
+ * watchpoint, like a data breakpoint of hardware: it is not evaluated
+ * after every instruction, but checked by the writes to the pages of
+ * its bytes, see pmem_dirty_write(). ADDR is taken as a physical address.
+ * The stores translated by RTL_JIT are not checked.
+ *
+ * A watchpoint of a register alone, e.g. `$sp', is a register watchpoint:
+ * the register is compared with the value kept in the watchpoint, without
+ * evaluating the expression. With DEBUG, this is done after every
+ * instruction. RTL_JIT ends a block after each instruction writing a
+ * watched register, and checks them after such blocks only, see
+ * wp_reg_check(). The other engines do not check them. */
 
 #define NR_WP 32
 
 static WP wp_pool[NR_WP] = {};
 static WP *head = NULL, *free_ = NULL;
 
+uint64_t wp_nr_hit = 0;
+int nr_reg_wp = 0;
+
 void init_wp_pool() {
   int i;
   for (i = 0; i < NR_WP; i ++) {
@@ -25,14 +45,45 @@ WP* new_wp() {
   free_ = free_->next;
   ret->next = head;
   head = ret;
+  ret->is_mem = false;
+  ret->is_reg = false;
   return ret;
 }
 
+static void watch_pages(WP *wp, int delta) {
+  pmem_watch[wp->pmem_offset / PAGE_SIZE] += delta;
+  if ((wp->pmem_offset + 3) / PAGE_SIZE != wp->pmem_offset / PAGE_SIZE) {
+    pmem_watch[(wp->pmem_offset + 3) / PAGE_SIZE] += delta;
+  }
+}
+
+/* called after `code' and `val' of `wp' are set */
+void arm_wp(WP *wp) {
+  uint32_t addr;
+  if (expr_is_const_deref(&wp->code, &addr) && pmem_offset(addr) >= 0 && pmem_offset(addr + 3) >= 0) {
+    wp->is_mem = true;
+    wp->pmem_offset = pmem_offset(addr);
+    watch_pages(wp, 1);
+  }
+  else if (expr_is_reg(&wp->code, &wp->reg)) {
+    wp->is_reg = true;
+    nr_reg_wp ++;
+    /* translate the code writing it again */
+    dcache_flush();
+  }
+}
+
 void free_wp(WP* wp) {
   assert(wp != NULL);
   assert(head != NULL);
+  if (wp->is_mem) watch_pages(wp, -1);
+  if (wp->is_reg) {
+    nr_reg_wp --;
+    dcache_flush();
+  }
+  expr_free(&wp->code);
   if (head == wp) {
-    head = NULL;
+    head = wp->next;
   } else {
     WP* prev = head;
     while (prev->next != wp) {
@@ -69,17 +120,66 @@ void wp_display() {
 
 bool wp_check() {
   WP* curr = head;
-  bool success;
   uint32_t new_val;
   while (curr) {
-    success = true;
-    new_val = expr(curr->expression, &success);
-    assert(success != false);
+    if (curr->is_mem) {
+      curr = curr->next;
+      continue;
+    }
+    new_val = (curr->is_reg ? *curr->reg : expr_run(&curr->code));
     if (new_val != curr->val) {
-      printf("wp %d\t%s = 0x%08x != 0x%08x\n", curr->NO, curr->expression, curr->val, new_val);
+      if (!rev_quiet) printf("wp %d\t%s = 0x%08x != 0x%08x\n", curr->NO, curr->expression, curr->val, new_val);
+      /* like a memory watchpoint, a register watchpoint keeps the new value */
+      if (curr->is_reg) curr->val = new_val;
+      wp_nr_hit ++;
       return true;
     }
     curr = curr->next;
   }
   return false;
-}
\ No newline at end of file
+}
+
+/* `len' bytes at `offset' of pmem are written, and they touch a watched page */
+void wp_mem_check(uint32_t offset, int len) {
+  WP* curr;
+  for (curr = head; curr; curr = curr->next) {
+    if (!curr->is_mem || offset >= curr->pmem_offset + 4 || offset + len <= curr->pmem_offset) continue;
+    uint32_t new_val = host_read(pmem + curr->pmem_offset, 4);
+    if (new_val != curr->val) {
+      if (!rev_quiet) printf("wp %d\t%s = 0x%08x != 0x%08x\n", curr->NO, curr->expression, curr->val, new_val);
+      curr->val = new_val;
+      wp_nr_hit ++;
+      if (nemu_state.state == NEMU_RUNNING) nemu_state.state = NEMU_STOP;
+      nemu_event = true;
+    }
+  }
+}
+
+bool wp_reg_watched(const void *reg) {
+  WP* curr;
+  for (curr = head; curr; curr = curr->next) {
+    if (curr->is_reg && curr->reg == reg) return true;
+  }
+  return false;
+}
+
+void wp_reg_check(void) {
+  WP* curr;
+  for (curr = head; curr; curr = curr->next) {
+    if (!curr->is_reg || *curr->reg == curr->val) continue;
+    if (!rev_quiet) printf("wp %d\t%s = 0x%08x != 0x%08x\n", curr->NO, curr->expression, curr->val, *curr->reg);
+    curr->val = *curr->reg;
+    wp_nr_hit ++;
+    if (nemu_state.state == NEMU_RUNNING) nemu_state.state = NEMU_STOP;
+    nemu_event = true;
+  }
+}
+
+/* take the current values as the values of the watchpoints */
+void wp_update() {
+  WP* curr;
+  for (curr = head; curr; curr = curr->next) {
+    curr->val = (curr->is_mem ? host_read(pmem + curr->pmem_offset, 4) :
+        curr->is_reg ? *curr->reg : expr_run(&curr->code));
+  }
+}
@@ -1,20 +1,70 @@
 #include <dlfcn.h>
+#include <sys/mman.h>
 
 #include "nemu.h"
 #include "monitor/monitor.h"
+#include "monitor/perf.h"
+#include "isa/diff-test.h"
 
 void (*ref_difftest_memcpy_from_dut)(paddr_t dest, void *src, size_t n) = NULL;
 void (*ref_difftest_getregs)(void *c) = NULL;
 void (*ref_difftest_setregs)(const void *c) = NULL;
 void (*ref_difftest_exec)(uint64_t n) = NULL;
+uint64_t (*ref_difftest_memhash)(paddr_t addr, size_t n) = NULL;
+void (*ref_difftest_memcpy_to_dut)(void *dest, paddr_t src, size_t n) = NULL;
+int (*ref_difftest_dirty_next)(uint32_t page) = NULL;
+void (*ref_difftest_dirty_clear)(void) = NULL;
 
 static bool is_skip_ref = false;
 static int skip_dut_nr_instr = 0;
 static bool is_detach = false;
 
+/* In batch mode, REF runs `nr_batch' instructions at once, and the states
+ * are only compared after them. A batch starts at a checkpoint of both:
+ *   cp_cpu    the registers at the checkpoint
+ *   shadow    pmem at the checkpoint, the pages changed since then are
+ *             those set in pmem_dirty
+ * On a mismatch, both are restored to the checkpoint several times to
+ * find the first instruction after which they differ by bisection.
+ * The instructions letting REF skip or DUT catch up end a batch, so a
+ * batch never accesses devices and can be run again.
+ *
+ * If REF provides the functions, memory is also compared at the end of a
+ * batch: the pages written by either side since the checkpoint are
+ * compared by hashes, and by bytes on a mismatch. */
+static int nr_batch = 1;
+static bool mem_check = false;
+static int nr_pending = 0;
+static int nr_mismatch = 0;
+static CPU_state cp_cpu;
+static uint32_t cp_iring_idx;
+/* the registers before the current instruction */
+static CPU_state last_cpu;
+static uint8_t *shadow = NULL;
+
+/* In pipelined mode, REF checks the instructions of DUT on another
+ * thread, see pipeline.c. The instructions letting REF skip or DUT catch
+ * up wait for it to check all the instructions before. */
+static bool is_pipelined = false;
+
+void difftest_pipeline_start(void);
+void difftest_pipeline_push(vaddr_t pc);
+void difftest_pipeline_drain(void);
+bool difftest_pipeline_mismatch(vaddr_t *pc, CPU_state *ref, CPU_state *dut);
+
+vaddr_t exec_once(void);
+void asm_clear(void);
+static bool batch_run_ref(const CPU_state *dut);
+
 // this is used to let ref skip instructions which
 // can not produce consistent behavior with NEMU
 void difftest_skip_ref() {
+  /* end the batch before this instruction accesses devices, which may
+   * write memory by DMA, and report a mismatch after it */
+  if (!is_detach && nr_pending > 0 && !batch_run_ref(&last_cpu)) {
+    nr_mismatch = nr_pending;
+  }
+  nr_pending = 0;
   is_skip_ref = true;
 }
 
@@ -25,6 +75,14 @@ void difftest_skip_ref() {
 //   Let REF run `nr_ref` instructions first.
 //   We expect that DUT will catch up with REF within `nr_dut` instructions.
 void difftest_skip_dut(int nr_ref, int nr_dut) {
+  /* REF first catches up with the state before this instruction, and
+   * a mismatch is reported after it, see difftest_step() */
+  if (!is_detach && nr_pending > 0 && !batch_run_ref(&last_cpu)) {
+    nr_mismatch = nr_pending;
+  }
+  nr_pending = 0;
+  if (is_pipelined) difftest_pipeline_drain();
+
   skip_dut_nr_instr += nr_dut;
 
   while (nr_ref -- > 0) {
@@ -35,11 +93,174 @@ void difftest_skip_dut(int nr_ref, int nr_dut) {
 bool isa_difftest_checkregs(CPU_state *ref_r, vaddr_t pc);
 void isa_difftest_attach(void);
 
-void init_difftest(char *ref_so_file, long img_size) {
-#ifndef DIFF_TEST
-  return;
-#endif
+/* A trace of REF is recorded to `trace_record', or replayed from
+ * `trace_replay' instead of running REF, see trace.c. */
+static const char *trace_record = NULL;
+static const char *trace_replay = NULL;
+
+void difftest_trace_record(const char *file);
+void (*difftest_trace_replay(const char *file))(void);
+
+/* Compare the states every `n' instructions, or check them on another
+ * thread if `pipelined'. Called before init_difftest(). */
+void difftest_config(int n, bool pipelined, const char *record, const char *replay) {
+  Assert(n > 0, "invalid size of difftest batch %d", n);
+  Assert(n == 1 || !pipelined, "difftest can not be both batched and pipelined");
+  Assert(n == 1 || (record == NULL && replay == NULL), "difftest trace can not be used in batch mode");
+  Assert(record == NULL || replay == NULL, "difftest trace can not be both recorded and replayed");
+  nr_batch = n;
+  is_pipelined = pipelined;
+  trace_record = record;
+  trace_replay = replay;
+}
+
+/* if `sync_ref', also copy the pages written since the last checkpoint to REF */
+static void checkpoint(bool sync_ref) {
+  uint32_t p;
+  for (p = pmem_next_dirty(0, PMEM_DIRTY_DIFFTEST); p != -1; p = pmem_next_dirty(p + 1, PMEM_DIRTY_DIFFTEST)) {
+    memcpy(shadow + p * PAGE_SIZE, pmem + p * PAGE_SIZE, PAGE_SIZE);
+    if (sync_ref) ref_difftest_memcpy_from_dut(pmem_base() + p * PAGE_SIZE, pmem + p * PAGE_SIZE, PAGE_SIZE);
+  }
+  if (mem_check) ref_difftest_dirty_clear();
+  pmem_clear_dirty(0, pmem_size / PAGE_SIZE, PMEM_DIRTY_DIFFTEST);
+  cp_cpu = cpu;
+  cp_iring_idx = iring_idx;
+  last_cpu = cpu;
+  nr_pending = 0;
+}
+
+/* The pages only written by REF are not restored, since they are unknown. */
+static void restore_checkpoint(void) {
+  uint32_t p;
+  for (p = pmem_next_dirty(0, PMEM_DIRTY_DIFFTEST); p != -1; p = pmem_next_dirty(p + 1, PMEM_DIRTY_DIFFTEST)) {
+    paddr_t addr = pmem_base() + p * PAGE_SIZE;
+    paddr_write_host(addr, shadow + p * PAGE_SIZE, PAGE_SIZE);
+    ref_difftest_memcpy_from_dut(addr, shadow + p * PAGE_SIZE, PAGE_SIZE);
+  }
+  cpu = cp_cpu;
+  iring_idx = cp_iring_idx;
+  ref_difftest_setregs(&cp_cpu);
+}
+
+/* FNV-1a by 64-bit words, `n' should be a multiple of 8 */
+uint64_t difftest_hash(const void *p, size_t n) {
+  const uint64_t *w = p;
+  uint64_t h = 0xcbf29ce484222325ull;
+  size_t i;
+  for (i = 0; i < n / 8; i ++) {
+    h = (h ^ w[i]) * 0x100000001b3ull;
+  }
+  return h;
+}
+
+static bool mem_page_match(uint32_t page, bool verbose) {
+  paddr_t addr = pmem_base() + page * PAGE_SIZE;
+  uint8_t *host = pmem + page * PAGE_SIZE;
+  if (difftest_hash(host, PAGE_SIZE) == ref_difftest_memhash(addr, PAGE_SIZE)) return true;
+
+  if (verbose && ref_difftest_memcpy_to_dut != NULL) {
+    static uint8_t ref_page[PAGE_SIZE];
+    ref_difftest_memcpy_to_dut(ref_page, addr, PAGE_SIZE);
+    int i;
+    for (i = 0; i < PAGE_SIZE && ref_page[i] == host[i]; i ++) ;
+    if (i < PAGE_SIZE) {
+      printf("memory is different at paddr = 0x%08x, right = 0x%02x, wrong = 0x%02x\n",
+          addr + i, ref_page[i], host[i]);
+    }
+  }
+  return false;
+}
+
+/* compare the pages written by either side since the checkpoint */
+static bool mem_match(bool verbose) {
+  int nr_page = pmem_size / PAGE_SIZE;
+  int p = pmem_next_dirty(0, PMEM_DIRTY_DIFFTEST), q = ref_difftest_dirty_next(0);
+  while (p != -1 || q != -1) {
+    int page = (q == -1 || (p != -1 && p < q) ? p : q);
+    if (page >= nr_page) break;
+    if (!mem_page_match(page, verbose)) return false;
+    if (p == page) p = pmem_next_dirty(page + 1, PMEM_DIRTY_DIFFTEST);
+    if (q == page) q = ref_difftest_dirty_next(page + 1);
+  }
+  return true;
+}
+
+/* let REF run the pending instructions and compare its registers with
+ * `dut', and the memory if it is checked */
+static bool batch_run_ref(const CPU_state *dut) {
+  CPU_state ref_r;
+  ref_difftest_exec(nr_pending);
+  ref_difftest_getregs(&ref_r);
+  if (memcmp(&ref_r, dut, DIFFTEST_REG_SIZE) != 0) return false;
+  return !mem_check || mem_match(false);
+}
+
+static void checkregs(CPU_state *ref, vaddr_t pc);
+
+/* the registers differ after the instruction at `pc' */
+static void report_mismatch(CPU_state *ref, vaddr_t pc) {
+  checkregs(ref, pc);
+  if (nemu_state.state != NEMU_ABORT) {
+    /* the registers differ in the part not checked by the ISA */
+    extern void isa_reg_display(void);
+    isa_reg_display();
+    nemu_state.state = NEMU_ABORT;
+    nemu_state.halt_pc = pc;
+  }
+}
+
+/* run the instructions of a batch again without tracing them */
+static void replay(int n) {
+  for (; n > 0; n --) {
+    exec_once();
+    asm_clear();
+  }
+}
+
+/* The states differ after `nr' instructions from the checkpoint. Find the
+ * first instruction after which they differ, and report it. */
+static void batch_bisect(int nr) {
+  int lo = 0, hi = nr;
+  while (hi - lo > 1) {
+    int mid = (lo + hi) / 2;
+    restore_checkpoint();
+    replay(mid);
+    nr_pending = mid;
+    if (batch_run_ref(&cpu)) lo = mid;
+    else hi = mid;
+  }
+
+  restore_checkpoint();
+  replay(lo);
+  nr_pending = lo;
+  batch_run_ref(&cpu);
+  vaddr_t pc = cpu.pc;
+  replay(1);
+  ref_difftest_exec(1);
+  nr_pending = 0;
+
+  Log("difftest: the states differ after instruction %d of the batch", hi);
+  if (mem_check) mem_match(true);
+  CPU_state ref_r;
+  ref_difftest_getregs(&ref_r);
+  report_mismatch(&ref_r, pc);
+}
 
+/* report the mismatch found by the thread of REF, if any */
+static bool pipeline_check(void) {
+  CPU_state ref_r, dut_r;
+  vaddr_t pc;
+  if (!difftest_pipeline_mismatch(&pc, &ref_r, &dut_r)) return false;
+
+  Log("difftest: the states differ after pc = 0x%08x, "
+      "the registers of DUT below are those after it, but not the memory", pc);
+  memcpy(&cpu, &dut_r, DIFFTEST_REG_SIZE);
+  report_mismatch(&ref_r, pc);
+  return true;
+}
+
+/* load the functions of REF, returns its init function */
+static void (*load_ref(char *ref_so_file))(void) {
   assert(ref_so_file != NULL);
 
   void *handle;
@@ -61,6 +282,29 @@ void init_difftest(char *ref_so_file, long img_size) {
   void (*ref_difftest_init)(void) = dlsym(handle, "difftest_init");
   assert(ref_difftest_init);
 
+  ref_difftest_memhash = dlsym(handle, "difftest_memhash");
+  ref_difftest_memcpy_to_dut = dlsym(handle, "difftest_memcpy_to_dut");
+  ref_difftest_dirty_next = dlsym(handle, "difftest_dirty_next");
+  ref_difftest_dirty_clear = dlsym(handle, "difftest_dirty_clear");
+
+  return ref_difftest_init;
+}
+
+void init_difftest(char *ref_so_file, long img_size) {
+#ifndef DIFF_TEST
+  return;
+#endif
+
+  void (*ref_difftest_init)(void);
+  if (trace_replay != NULL) {
+    ref_difftest_init = difftest_trace_replay(trace_replay);
+    ref_so_file = (char *)trace_replay;
+  }
+  else {
+    ref_difftest_init = load_ref(ref_so_file);
+    if (trace_record != NULL) difftest_trace_record(trace_record);
+  }
+
   Log("Differential testing: \33[1;32m%s\33[0m", "ON");
   Log("The result of every instruction will be compared with %s. "
       "This will help you a lot for debugging, but also significantly reduce the performance. "
@@ -69,6 +313,23 @@ void init_difftest(char *ref_so_file, long img_size) {
   ref_difftest_init();
   ref_difftest_memcpy_from_dut(PC_START, guest_to_host(IMAGE_START), img_size);
   ref_difftest_setregs(&cpu);
+
+  if (nr_batch > 1) {
+    mem_check = (ref_difftest_memhash != NULL && ref_difftest_dirty_next != NULL &&
+        ref_difftest_dirty_clear != NULL);
+    Log("The states will be compared every %d instructions, %s memory.", nr_batch,
+        (mem_check ? "including" : "excluding"));
+    shadow = mmap(NULL, pmem_size, PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    Assert(shadow != MAP_FAILED, "can not allocate the checkpoint of pmem");
+    /* the pages before the image may be written by init_isa() */
+    pmem_dirty_range(0, IMAGE_START + img_size);
+    checkpoint(false);
+  }
+  if (is_pipelined) {
+    Log("The states will be checked by another thread.");
+    difftest_pipeline_start();
+  }
 }
 
 static void checkregs(CPU_state *ref, vaddr_t pc) {
@@ -80,16 +341,44 @@ static void checkregs(CPU_state *ref, vaddr_t pc) {
   }
 }
 
+/* the instructions seen by difftest_step(), and those not checked */
+static uint64_t nr_step = 0, nr_detached = 0, nr_skip_ref = 0, nr_skip_dut = 0, nr_bisect = 0;
+
+void difftest_perf(PerfOut *o) {
+  perf_begin(o, "difftest");
+  perf_u64(o, "instructions", nr_step);
+  perf_u64(o, "detached", nr_detached);
+  perf_u64(o, "skip_ref", nr_skip_ref);
+  perf_u64(o, "skip_dut", nr_skip_dut);
+  perf_u64(o, "batch", nr_batch);
+  perf_u64(o, "bisect", nr_bisect);
+  perf_end(o);
+}
+
 void difftest_step(vaddr_t ori_pc, vaddr_t next_pc) {
   CPU_state ref_r;
 
-  if (is_detach) return;
+  nr_step ++;
+  if (is_detach) {
+    nr_detached ++;
+    return;
+  }
+
+  if (nr_mismatch > 0) {
+    nr_bisect ++;
+    batch_bisect(nr_mismatch);
+    nr_mismatch = 0;
+    return;
+  }
+  if (is_pipelined && pipeline_check()) return;
 
   if (skip_dut_nr_instr > 0) {
+    nr_skip_dut ++;
     ref_difftest_getregs(&ref_r);
     if (ref_r.pc == next_pc) {
       checkregs(&ref_r, next_pc);
       skip_dut_nr_instr = 0;
+      if (nr_batch > 1) checkpoint(false);
       return;
     }
     skip_dut_nr_instr --;
@@ -99,9 +388,39 @@ void difftest_step(vaddr_t ori_pc, vaddr_t next_pc) {
   }
 
   if (is_skip_ref) {
+    is_skip_ref = false;
+    nr_skip_ref ++;
+    if (is_pipelined) {
+      difftest_pipeline_drain();
+      if (pipeline_check()) return;
+    }
     // to skip the checking of an instruction, just copy the reg state to reference design
     ref_difftest_setregs(&cpu);
-    is_skip_ref = false;
+    // and the memory written, e.g. by DMA
+    if (nr_batch > 1) checkpoint(true);
+    return;
+  }
+
+  if (nr_batch > 1) {
+    nr_pending ++;
+    if (nr_pending < nr_batch && nemu_state.state == NEMU_RUNNING) {
+      last_cpu = cpu;
+      return;
+    }
+    if (!batch_run_ref(&cpu)) {
+      nr_bisect ++;
+      batch_bisect(nr_pending);
+    }
+    else checkpoint(false);
+    return;
+  }
+
+  if (is_pipelined) {
+    difftest_pipeline_push(ori_pc);
+    if (nemu_state.state != NEMU_RUNNING) {
+      difftest_pipeline_drain();
+      pipeline_check();
+    }
     return;
   }
 
@@ -111,7 +430,15 @@ void difftest_step(vaddr_t ori_pc, vaddr_t next_pc) {
   checkregs(&ref_r, ori_pc);
 }
 
+/* While detached, the pages written by DUT are those set in pmem_dirty,
+ * so attaching only copies them to REF. In batch mode, they are the pages
+ * written since the last checkpoint, which also covers the instructions
+ * pending when detaching, since REF has not run them. */
 void difftest_detach() {
+  if (is_detach) return;
+  if (is_pipelined) difftest_pipeline_drain();
+  if (nr_batch == 1) pmem_clear_dirty(0, pmem_size / PAGE_SIZE, PMEM_DIRTY_DIFFTEST);
+  nr_pending = 0;
   is_detach = true;
 }
 
@@ -120,9 +447,47 @@ void difftest_attach() {
   return;
 #endif
 
+  if (!is_detach) return;
   is_detach = false;
   is_skip_ref = false;
   skip_dut_nr_instr = 0;
+  nr_mismatch = 0;
 
+  if (nr_batch > 1) checkpoint(true);
+  else {
+    int p, nr = 0;
+    for (p = pmem_next_dirty(0, PMEM_DIRTY_DIFFTEST); p != -1; p = pmem_next_dirty(p + 1, PMEM_DIRTY_DIFFTEST), nr ++) {
+      ref_difftest_memcpy_from_dut(pmem_base() + p * PAGE_SIZE, pmem + p * PAGE_SIZE, PAGE_SIZE);
+    }
+    pmem_clear_dirty(0, pmem_size / PAGE_SIZE, PMEM_DIRTY_DIFFTEST);
+    Log("difftest: %d pages are copied to REF when attaching", nr);
+  }
+  ref_difftest_setregs(&cpu);
   isa_difftest_attach();
 }
+
+/* The whole state of DUT is replaced, e.g. by loading a snapshot, and
+ * pmem is already marked dirty. */
+void difftest_reset_ref(void) {
+  if (is_detach) return;
+  /* detaching clears the dirty pages */
+  difftest_detach();
+  pmem_dirty_range(0, pmem_size);
+  difftest_attach();
+}
+
+/* Run once in REF the instruction of `len' bytes at `addr', from the
+ * state `before' of DUT, for the fuzzer, see fuzz.c. Return false if the
+ * registers of REF after it differ from those of DUT. */
+bool difftest_run_once(const void *before, paddr_t addr, void *code, size_t len) {
+  if (is_skip_ref) {
+    is_skip_ref = false;
+    return true;
+  }
+  CPU_state ref_r;
+  ref_difftest_memcpy_from_dut(addr, code, len);
+  ref_difftest_setregs(before);
+  ref_difftest_exec(1);
+  ref_difftest_getregs(&ref_r);
+  return memcmp(&ref_r, &cpu, DIFFTEST_REG_SIZE) == 0;
+}
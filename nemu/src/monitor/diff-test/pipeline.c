@@ -0,0 +1,101 @@
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+
+#include "nemu.h"
+#include "monitor/diff-test.h"
+
+/* In pipelined mode, DUT pushes the registers after every instruction
+ * into a ring, and a thread of REF runs the same instructions and checks
+ * the records, so DUT and REF run on two cores. The ring has a single
+ * producer and a single consumer, so it needs no lock: only DUT writes
+ * `rec_head', and only the thread of REF writes `rec_tail'. Both are
+ * free-running, and record i is at ring[i % NR_RECORD].
+ *
+ * REF is only touched by its thread while the ring is not empty, so DUT
+ * can access REF after difftest_pipeline_drain(), e.g. to skip an
+ * instruction which accesses devices. */
+
+#define NR_RECORD 4096
+
+typedef struct {
+  vaddr_t pc;      // the pc of the instruction
+  CPU_state dut;   // the registers of DUT after it
+} Record;
+
+static Record ring[NR_RECORD];
+/* in different cache lines, since they are written by different threads */
+static uint32_t rec_head __attribute__((aligned(64))) = 0;
+static uint32_t rec_tail __attribute__((aligned(64))) = 0;
+/* the last `rec_tail' seen by DUT */
+static uint32_t rec_tail_seen = 0;
+
+/* the first record which does not match, kept after it is found */
+static bool mismatch = false;
+static Record bad_rec;
+static CPU_state bad_ref;
+
+static void wait_a_moment(int *nr_wait) {
+  // spin for a short while, but sleep when DUT is stopped, e.g. in the UI
+  if (++ *nr_wait < 1000) sched_yield();
+  else usleep(100);
+}
+
+static void *ref_thread(void *arg) {
+  while (true) {
+    uint32_t t = rec_tail, h;
+    int nr_wait = 0;
+    while (t == (h = __atomic_load_n(&rec_head, __ATOMIC_ACQUIRE))) wait_a_moment(&nr_wait);
+
+    // check all the records available, the records after a mismatch are dropped
+    for (; t != h && !mismatch; t ++) {
+      Record *r = &ring[t % NR_RECORD];
+      CPU_state ref_r;
+      ref_difftest_exec(1);
+      ref_difftest_getregs(&ref_r);
+      if (memcmp(&ref_r, &r->dut, DIFFTEST_REG_SIZE) != 0) {
+        bad_rec = *r;
+        bad_ref = ref_r;
+        __atomic_store_n(&mismatch, true, __ATOMIC_RELEASE);
+      }
+    }
+    __atomic_store_n(&rec_tail, h, __ATOMIC_RELEASE);
+  }
+  return NULL;
+}
+
+void difftest_pipeline_start(void) {
+  pthread_t tid;
+  int ret = pthread_create(&tid, NULL, ref_thread, NULL);
+  Assert(ret == 0, "can not create the thread of difftest");
+  pthread_detach(tid);
+}
+
+void difftest_pipeline_push(vaddr_t pc) {
+  uint32_t h = rec_head;
+  int nr_wait = 0;
+  while (h - rec_tail_seen >= NR_RECORD) {
+    rec_tail_seen = __atomic_load_n(&rec_tail, __ATOMIC_ACQUIRE);
+    if (h - rec_tail_seen >= NR_RECORD) wait_a_moment(&nr_wait);
+  }
+
+  ring[h % NR_RECORD].pc = pc;
+  memcpy(&ring[h % NR_RECORD].dut, &cpu, DIFFTEST_REG_SIZE);
+  __atomic_store_n(&rec_head, h + 1, __ATOMIC_RELEASE);
+}
+
+/* wait until REF has checked all the records */
+void difftest_pipeline_drain(void) {
+  int nr_wait = 0;
+  while (__atomic_load_n(&rec_tail, __ATOMIC_ACQUIRE) != rec_head) wait_a_moment(&nr_wait);
+}
+
+/* Return whether a record does not match. If so, `pc' is the instruction,
+ * and `ref' and `dut' are the registers after it. */
+bool difftest_pipeline_mismatch(vaddr_t *pc, CPU_state *ref, CPU_state *dut) {
+  if (!__atomic_load_n(&mismatch, __ATOMIC_ACQUIRE)) return false;
+  *pc = bad_rec.pc;
+  *ref = bad_ref;
+  *dut = bad_rec.dut;
+  return true;
+}
@@ -4,8 +4,9 @@
 
 void cpu_exec(uint64_t);
 
+/* `dest' is a guest physical address, not an offset in pmem */
 void difftest_memcpy_from_dut(paddr_t dest, void *src, size_t n) {
-  memcpy(guest_to_host(dest), src, n);
+  paddr_write_host(dest, src, n);
 }
 
 void difftest_getregs(void *r) {
@@ -25,3 +26,24 @@ void difftest_init(void) {
   void init_isa();
   init_isa();
 }
+
+/* The functions below are optional, for DUT to compare memory. */
+
+uint64_t difftest_memhash(paddr_t addr, size_t n) {
+  int offset = pmem_offset(addr);
+  assert(offset >= 0 && offset + n <= pmem_size);
+  return difftest_hash(pmem + offset, n);
+}
+
+void difftest_memcpy_to_dut(void *dest, paddr_t src, size_t n) {
+  paddr_read_host(dest, src, n);
+}
+
+/* the pages written since difftest_dirty_clear(), in page numbers of pmem */
+int difftest_dirty_next(uint32_t page) {
+  return pmem_next_dirty(page, PMEM_DIRTY_DIFFTEST);
+}
+
+void difftest_dirty_clear(void) {
+  pmem_clear_dirty(0, pmem_size / PAGE_SIZE, PMEM_DIRTY_DIFFTEST);
+}
@@ -0,0 +1,162 @@
+#include <stdlib.h>
+#include <zlib.h>
+
+#include "nemu.h"
+#include "monitor/diff-test.h"
+
+/* A difftest trace records the registers of REF after every instruction,
+ * so later runs can be checked against the file instead of REF. It is
+ * recorded by wrapping the functions of REF, and replayed by a REF which
+ * only reads the file. The file is compressed by zlib, and after a header
+ * it is a sequence of records:
+ *   'S' mask words  REF runs an instruction, and the registers set in
+ *                   `mask' (LEB128, one bit per 32-bit word of the
+ *                   registers) change to `words'
+ *   'R' words       the registers of REF are set by DUT, e.g. to skip an
+ *                   instruction accessing devices
+ * Since REF is never rewound, a trace can not be used in batch mode. */
+
+#define NR_WORD (DIFFTEST_REG_SIZE / 4)
+#define TRACE_MAGIC "NEMUTRC1"
+
+static gzFile trace_fp = NULL;
+static uint32_t cur[NR_WORD];
+
+/* the functions of REF wrapped when recording */
+static void (*real_exec)(uint64_t n) = NULL;
+static void (*real_setregs)(const void *c) = NULL;
+
+/* the trace does not cover all the instructions of the program */
+static bool trace_end = false;
+
+static void trace_close(void) {
+  if (trace_fp != NULL) gzclose(trace_fp);
+  trace_fp = NULL;
+}
+
+static void write_varint(uint64_t v) {
+  while (v >= 0x80) {
+    gzputc(trace_fp, (v & 0x7f) | 0x80);
+    v >>= 7;
+  }
+  gzputc(trace_fp, v);
+}
+
+static uint64_t read_varint(void) {
+  uint64_t v = 0;
+  int shift, c;
+  for (shift = 0; (c = gzgetc(trace_fp)) != -1; shift += 7) {
+    v |= (uint64_t)(c & 0x7f) << shift;
+    if (!(c & 0x80)) break;
+  }
+  return v;
+}
+
+static void rec_exec(uint64_t n) {
+  for (; n > 0; n --) {
+    uint32_t regs[NR_WORD];
+    uint32_t words[NR_WORD];
+    uint64_t mask = 0;
+    int i, nr = 0;
+    real_exec(1);
+    ref_difftest_getregs(regs);
+    for (i = 0; i < NR_WORD; i ++) {
+      if (regs[i] != cur[i]) {
+        mask |= 1ull << i;
+        words[nr ++] = cur[i] = regs[i];
+      }
+    }
+    gzputc(trace_fp, 'S');
+    write_varint(mask);
+    gzwrite(trace_fp, words, nr * sizeof(words[0]));
+  }
+}
+
+static void rec_setregs(const void *c) {
+  real_setregs(c);
+  memcpy(cur, c, sizeof(cur));
+  gzputc(trace_fp, 'R');
+  gzwrite(trace_fp, cur, sizeof(cur));
+}
+
+static void read_words(uint32_t *w, int n) {
+  if (gzread(trace_fp, w, n * sizeof(w[0])) != n * sizeof(w[0])) trace_end = true;
+}
+
+static void replay_exec(uint64_t n) {
+  while (n > 0 && !trace_end) {
+    int tag = gzgetc(trace_fp);
+    if (tag == 'R') read_words(cur, NR_WORD);
+    else if (tag == 'S') {
+      uint32_t words[NR_WORD];
+      uint64_t mask = read_varint();
+      int i, nr = 0;
+      for (i = 0; i < NR_WORD; i ++) nr += (mask >> i) & 1;
+      read_words(words, nr);
+      for (i = 0, nr = 0; i < NR_WORD; i ++) {
+        if ((mask >> i) & 1) cur[i] = words[nr ++];
+      }
+      n --;
+    }
+    else trace_end = true;
+
+    if (trace_end) Log("difftest: the trace ends, REF will not run any more");
+  }
+}
+
+static void replay_setregs(const void *c) {
+  int tag = gzgetc(trace_fp);
+  if (tag == 'R') {
+    uint32_t words[NR_WORD];
+    read_words(words, NR_WORD);
+  }
+  else if (tag != -1) {
+    /* DUT skips an instruction which REF did not skip */
+    gzungetc(tag, trace_fp);
+  }
+  memcpy(cur, c, sizeof(cur));
+}
+
+static void replay_getregs(void *c) {
+  memcpy(c, cur, sizeof(cur));
+}
+
+static void replay_memcpy_from_dut(paddr_t dest, void *src, size_t n) {
+}
+
+static void replay_init(void) {
+}
+
+/* Record the states of REF to `file', called after REF is loaded. */
+void difftest_trace_record(const char *file) {
+  assert(NR_WORD <= 64);
+  trace_fp = gzopen(file, "wb");
+  Assert(trace_fp != NULL, "can not open the difftest trace '%s'", file);
+  gzwrite(trace_fp, TRACE_MAGIC, strlen(TRACE_MAGIC));
+  gzputc(trace_fp, NR_WORD);
+  atexit(trace_close);
+
+  real_exec = ref_difftest_exec;
+  real_setregs = ref_difftest_setregs;
+  ref_difftest_exec = rec_exec;
+  ref_difftest_setregs = rec_setregs;
+  Log("The states of REF are recorded to %s", file);
+}
+
+/* Use the states in `file' as REF, returns the init function of REF. */
+void (*difftest_trace_replay(const char *file))(void) {
+  char magic[sizeof(TRACE_MAGIC)] = {};
+  assert(NR_WORD <= 64);
+  trace_fp = gzopen(file, "rb");
+  Assert(trace_fp != NULL, "can not open the difftest trace '%s'", file);
+  gzread(trace_fp, magic, strlen(TRACE_MAGIC));
+  Assert(strcmp(magic, TRACE_MAGIC) == 0 && gzgetc(trace_fp) == NR_WORD,
+      "'%s' is not a difftest trace of %s", file, str(__ISA__));
+  atexit(trace_close);
+
+  ref_difftest_memcpy_from_dut = replay_memcpy_from_dut;
+  ref_difftest_getregs = replay_getregs;
+  ref_difftest_setregs = replay_setregs;
+  ref_difftest_exec = replay_exec;
+  return replay_init;
+}
@@ -0,0 +1,101 @@
+#include "nemu.h"
+#include "monitor/monitor.h"
+#include "monitor/embed.h"
+#include "device/map.h"
+#include "isa/diff-test.h"
+
+void init_isa(void);
+void cpu_exec(uint64_t);
+
+void nemu_init(uint32_t mem_size) {
+  pmem_config(mem_size, false);
+  init_isa();
+}
+
+void nemu_load(uint32_t paddr, const void *buf, size_t n) {
+  paddr_write_host(paddr, buf, n);
+}
+
+int nemu_run(uint64_t n, uint64_t *nr_done) {
+  uint64_t start = g_nr_guest_instr;
+  if (nemu_state.state != NEMU_END && nemu_state.state != NEMU_ABORT) cpu_exec(n);
+  if (nr_done != NULL) *nr_done = g_nr_guest_instr - start;
+  return (nemu_state.state == NEMU_END ? NEMU_EMBED_END :
+      nemu_state.state == NEMU_ABORT ? NEMU_EMBED_ABORT : NEMU_EMBED_STOP);
+}
+
+void nemu_stop(void) {
+  if (nemu_state.state == NEMU_RUNNING) nemu_state.state = NEMU_STOP;
+  nemu_event = true;
+}
+
+uint32_t nemu_halt_ret(void) {
+  return nemu_state.halt_ret;
+}
+
+size_t nemu_regs_size(void) {
+  return DIFFTEST_REG_SIZE;
+}
+
+void nemu_get_regs(void *regs) {
+  memcpy(regs, &cpu, DIFFTEST_REG_SIZE);
+}
+
+void nemu_set_regs(const void *regs) {
+  memcpy(&cpu, regs, DIFFTEST_REG_SIZE);
+}
+
+uint32_t nemu_get_pc(void) {
+  return cpu.pc;
+}
+
+void nemu_set_pc(uint32_t pc) {
+  cpu.pc = pc;
+}
+
+void* nemu_mem_map(uint32_t paddr, size_t *len) {
+  int offset = pmem_offset(paddr);
+  if (offset < 0) return NULL;
+  *len = pmem_size - offset;
+  return pmem + offset;
+}
+
+void nemu_mem_written(uint32_t paddr, size_t n) {
+  pmem_host_written(paddr, n);
+}
+
+/* The callbacks of the maps have no argument to tell them apart, so each
+ * device of the embedding program has its own one calling it. */
+#define NR_EMBED_MMIO 8
+
+static struct {
+  nemu_mmio_callback_t callback;
+  void *opaque;
+} devices[NR_EMBED_MMIO];
+static int nr_device = 0;
+
+#define MMIO_TRAMPOLINE(i) \
+  static void mmio_callback_##i(uint32_t offset, int len, bool is_write) { \
+    devices[i].callback(devices[i].opaque, offset, len, is_write); \
+  }
+
+MMIO_TRAMPOLINE(0) MMIO_TRAMPOLINE(1) MMIO_TRAMPOLINE(2) MMIO_TRAMPOLINE(3)
+MMIO_TRAMPOLINE(4) MMIO_TRAMPOLINE(5) MMIO_TRAMPOLINE(6) MMIO_TRAMPOLINE(7)
+
+static io_callback_t trampolines[NR_EMBED_MMIO] = {
+  mmio_callback_0, mmio_callback_1, mmio_callback_2, mmio_callback_3,
+  mmio_callback_4, mmio_callback_5, mmio_callback_6, mmio_callback_7,
+};
+
+uint8_t* nemu_add_mmio(const char *name, uint32_t paddr, int len,
+    nemu_mmio_callback_t callback, void *opaque) {
+  Assert(nr_device < NR_EMBED_MMIO, "too many devices, at most %d", NR_EMBED_MMIO);
+  Assert(pmem_offset(paddr) < 0 && pmem_offset(paddr + len - 1) < 0,
+      "device '%s' overlaps the memory", name);
+  devices[nr_device].callback = callback;
+  devices[nr_device].opaque = opaque;
+  uint8_t *space = new_space(len);
+  add_mmio_map(strdup(name), paddr, space, len, (callback == NULL ? NULL : trampolines[nr_device]));
+  nr_device ++;
+  return space;
+}
@@ -0,0 +1,133 @@
+#include "nemu.h"
+#include "monitor/monitor.h"
+#include "monitor/fork-server.h"
+#include "monitor/diff-test.h"
+#include <errno.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+/* The fork server, started by '-k PATH[:N]', pays for the start of NEMU
+ * and of the guest once. The guest runs N instructions, e.g. to boot the
+ * OS, then NEMU listens on the UNIX socket PATH. Each connection is a job
+ * served by a child forked from the paused machine, which shares all the
+ * pages with the server until it writes them. The job is a line of
+ *
+ *   FILE [ADDR]
+ *
+ * The child loads FILE into the guest physical memory at ADDR (hex, the
+ * image by default), and runs the guest to the end, with the outputs of
+ * NEMU going to the connection. Its exit status is 0 for the good trap.
+ * Start the server with '-N' if there are devices, since the children
+ * share the window. */
+
+#define JOB_MAX 1024
+
+void cpu_exec(uint64_t);
+
+static char *server_path = NULL;
+static uint64_t server_warmup = 0;
+
+void init_fork_server(char *spec) {
+  char *n = strrchr(spec, ':');
+  if (n != NULL) {
+    *n ++ = '\0';
+    server_warmup = strtoull(n, NULL, 10);
+  }
+  server_path = spec;
+}
+
+/* read the line of the job from `c' */
+static bool read_job(int c, char *job) {
+  int len = 0;
+  while (len < JOB_MAX - 1) {
+    ssize_t ret = read(c, job + len, 1);
+    if (ret < 0 && errno == EINTR) continue;
+    if (ret <= 0 || job[len] == '\n') break;
+    len ++;
+  }
+  job[len] = '\0';
+  return len > 0;
+}
+
+static bool load_payload(const char *file, paddr_t addr) {
+  FILE *fp = fopen(file, "rb");
+  if (fp == NULL) return false;
+  fseek(fp, 0, SEEK_END);
+  long size = ftell(fp);
+  fseek(fp, 0, SEEK_SET);
+  void *buf = malloc(size + 1);
+  assert(buf != NULL);
+  bool ok = (fread(buf, 1, size, fp) == size);
+  if (ok) paddr_write_host(addr, buf, size);
+  free(buf);
+  fclose(fp);
+  return ok;
+}
+
+/* in the child */
+static void serve_job(int c) {
+  char job[JOB_MAX], file[JOB_MAX];
+  paddr_t addr = pmem_base() + IMAGE_START;
+  bool ok = read_job(c, job) && sscanf(job, "%s %x", file, &addr) >= 1;
+
+  dup2(c, 1);
+  dup2(c, 2);
+  close(c);
+  if (!ok || !load_payload(file, addr)) {
+    printf("fork server: can not load the job '%s'\n", job);
+    exit(1);
+  }
+#ifdef DIFF_TEST
+  difftest_reset_ref();
+#endif
+
+  cpu_exec(-1);
+  exit(nemu_state.state == NEMU_END && nemu_state.halt_ret == 0 ? 0 : 1);
+}
+
+bool fork_server_mainloop(void) {
+  if (server_path == NULL) return false;
+
+  if (server_warmup > 0) {
+    cpu_exec(server_warmup);
+    Assert(nemu_state.state == NEMU_STOP, "the guest ends before the fork server starts");
+  }
+
+  int s = socket(AF_UNIX, SOCK_STREAM, 0);
+  Assert(s >= 0, "can not create the socket for the fork server");
+  struct sockaddr_un sa = { .sun_family = AF_UNIX };
+  Assert(strlen(server_path) < sizeof(sa.sun_path), "the path '%s' is too long", server_path);
+  strcpy(sa.sun_path, server_path);
+  unlink(server_path);
+  Assert(bind(s, (struct sockaddr *)&sa, sizeof(sa)) == 0 && listen(s, 64) == 0,
+      "can not listen on '%s' for the fork server", server_path);
+
+  /* the children are reaped by the kernel */
+  signal(SIGCHLD, SIG_IGN);
+  Log("The fork server is waiting for the jobs on %s after %lu instructions",
+      server_path, g_nr_guest_instr);
+
+  uint64_t nr_job = 0;
+  while (true) {
+    int c = accept(s, NULL, NULL);
+    if (c < 0) {
+      if (errno == EINTR) continue;
+      break;
+    }
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == 0) {
+      close(s);
+      serve_job(c);
+    }
+    if (pid < 0) Log("can not fork for a job");
+    else nr_job ++;
+    close(c);
+  }
+  close(s);
+  Log("The fork server stops after %lu jobs", nr_job);
+  return true;
+}
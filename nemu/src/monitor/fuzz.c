@@ -0,0 +1,373 @@
+#include "cpu/exec.h"
+#include "monitor/monitor.h"
+#include "monitor/fuzz.h"
+#include "monitor/diff-test.h"
+#include "monitor/perf.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <setjmp.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+/* The fuzzer of the decoders, started by '-Z DIR[:N[:JOBS]]' in the binary
+ * built by `make FUZZ=1'. The state after the start of NEMU, e.g. loaded
+ * by '-S', is the snapshot every input starts from. An input is the
+ * ISA_INSTR_MAX bytes of an instruction written at the pc, which is run
+ * once by exec_once(). With DIFF_TEST, it is also run once by REF from
+ * the same state, and the registers after it are compared, except when
+ * it raises an exception. Only the registers of DIFFTEST_REG_SIZE are
+ * set in REF, so reading the others, e.g. the rest of CP0 of mips32, may
+ * differ.
+ *
+ * JOBS workers, one per core by default, run N inputs in total, or run
+ * forever by default. A worker forks a child from the snapshot for each
+ * batch of inputs, so a crash only loses the rest of the batch, and what
+ * the inputs write to memory goes away with the child.
+ *
+ * In the FUZZ build, the code of the ISA and of the CPU is instrumented by
+ * -fsanitize-coverage=trace-pc, and the edges it takes are counted in
+ * `cov_map'. An input which takes an edge, or takes it a number of times
+ * in a power of 2, not seen by any worker before, is kept in the corpus
+ * shared by the workers, from which the inputs are mutated. The inputs
+ * are written to DIR as
+ *
+ *   queue-HASH        taking new edges
+ *   crash-sigN-HASH   killed by signal N, e.g. by Assert()
+ *   exit-N-HASH       calling exit(N)
+ *   hang-HASH         its batch not finished in FUZZ_TIMEOUT seconds
+ *   diff-HASH         the registers differ from REF
+ *
+ * where HASH is the hash of the input. Like the corpus, only the crashes
+ * and the hangs taking edges not seen by the ones before are written. An input is loaded at the pc by
+ * the fork server to run it again, see fork-server.c. */
+
+#ifdef FUZZ
+
+#define INPUT_LEN ISA_INSTR_MAX
+#define COV_SIZE (1 << 16)
+#define NR_CORPUS 4096
+#define NR_JOB_MAX 256
+#define FUZZ_BATCH 4096
+#define FUZZ_TIMEOUT 10
+#define FUZZ_REPORT_US 5000000
+
+typedef struct {
+  /* the counts seen of each edge, in bits of the powers of 2 */
+  uint8_t seen[COV_SIZE];
+  uint8_t crash_seen[COV_SIZE];
+  uint8_t corpus[NR_CORPUS][INPUT_LEN];
+  uint32_t nr_corpus;
+  uint64_t nr_exec, nr_abort, nr_intr, nr_crash, nr_hang, nr_diff;
+  struct {
+    /* the input being run, left here by a crash */
+    uint8_t input[INPUT_LEN];
+    uint64_t nr_run;
+    uint8_t cov[COV_SIZE];
+  } job[NR_JOB_MAX];
+} FuzzShared;
+
+static FuzzShared *shm = NULL;
+static char *fuzz_dir = NULL;
+static uint64_t fuzz_nr_input = 0;
+static int fuzz_nr_job = 0;
+
+/* written by the instrumented code, the one of the job in a worker */
+static uint8_t cov_buf[COV_SIZE];
+static uint8_t *cov_map = cov_buf;
+static uintptr_t cov_prev = 0;
+
+void __sanitizer_cov_trace_pc(void) {
+  uintptr_t pc = (uintptr_t)__builtin_return_address(0);
+  pc = (pc >> 4) ^ (pc << 8);
+  cov_map[(pc ^ cov_prev) & (COV_SIZE - 1)] ++;
+  cov_prev = pc >> 1;
+}
+
+void init_fuzz(char *spec) {
+  char *n = strchr(spec, ':');
+  if (n != NULL) {
+    *n ++ = '\0';
+    char *jobs = strchr(n, ':');
+    if (jobs != NULL) {
+      *jobs ++ = '\0';
+      fuzz_nr_job = atoi(jobs);
+      Assert(fuzz_nr_job > 0 && fuzz_nr_job <= NR_JOB_MAX, "invalid number of jobs '%s'", jobs);
+    }
+    fuzz_nr_input = strtoull(n, NULL, 10);
+  }
+  fuzz_dir = spec;
+}
+
+static uint64_t rng = 0;
+
+static inline uint32_t rand32(void) {
+  rng ^= rng >> 12;
+  rng ^= rng << 25;
+  rng ^= rng >> 27;
+  return (rng * 0x2545f4914f6cdd1dull) >> 32;
+}
+
+/* FNV-1a */
+static uint64_t input_hash(const uint8_t *input) {
+  uint64_t h = 0xcbf29ce484222325ull;
+  int i;
+  for (i = 0; i < INPUT_LEN; i ++) h = (h ^ input[i]) * 0x100000001b3ull;
+  return h;
+}
+
+static void save_input(const char *kind, const uint8_t *input) {
+  char path[1024];
+  snprintf(path, sizeof(path), "%s/%s-%016lx", fuzz_dir, kind, input_hash(input));
+  /* already saved */
+  int fd = open(path, O_WRONLY | O_CREAT | O_EXCL, 0644);
+  if (fd < 0) return;
+  if (write(fd, input, INPUT_LEN) != INPUT_LEN) Log("can not write the input to %s", path);
+  close(fd);
+}
+
+static void corpus_add(const uint8_t *input) {
+  uint32_t idx = __atomic_fetch_add(&shm->nr_corpus, 1, __ATOMIC_RELAXED);
+  memcpy(shm->corpus[idx % NR_CORPUS], input, INPUT_LEN);
+}
+
+static void mutate(uint8_t *input) {
+  uint32_t nr = __atomic_load_n(&shm->nr_corpus, __ATOMIC_RELAXED);
+  int i;
+  if (nr == 0 || rand32() % 4 == 0) {
+    for (i = 0; i < INPUT_LEN; i ++) input[i] = rand32();
+    return;
+  }
+
+  if (nr > NR_CORPUS) nr = NR_CORPUS;
+  memcpy(input, shm->corpus[rand32() % nr], INPUT_LEN);
+  int k = 1 + rand32() % 4;
+  while (k -- > 0) {
+    int pos = rand32() % INPUT_LEN;
+    switch (rand32() % 4) {
+      case 0: input[pos] ^= 1 << (rand32() % 8); break;
+      case 1: input[pos] = rand32(); break;
+      case 2: input[pos] += (int)(rand32() % 33) - 16; break;
+      default:
+        /* the tail of another one */
+        memcpy(input + pos, shm->corpus[rand32() % nr] + pos, INPUT_LEN - pos);
+    }
+  }
+}
+
+static inline uint8_t cov_bucket(uint8_t n) {
+  return 1u << (31 - __builtin_clz(n));
+}
+
+/* Add the edges taken in `cov_map' to `seen'. Return true if any of them
+ * is new. */
+static bool cov_is_new(uint8_t *seen) {
+  const uint64_t *w = (const uint64_t *)cov_map;
+  bool is_new = false;
+  int i, j;
+  for (i = 0; i < COV_SIZE / 8; i ++) {
+    if (w[i] == 0) continue;
+    for (j = i * 8; j < i * 8 + 8; j ++) {
+      if (cov_map[j] == 0) continue;
+      uint8_t b = cov_bucket(cov_map[j]);
+      if (b & ~seen[j]) {
+        __atomic_fetch_or(&seen[j], b, __ATOMIC_RELAXED);
+        is_new = true;
+      }
+    }
+  }
+  return is_new;
+}
+
+vaddr_t exec_once(void);
+void asm_clear(void);
+
+/* Return false if an exception aborts the instruction. */
+static bool exec_input(void) {
+#ifdef ISA_LONGJMP_INTR
+  /* see cpu_exec() */
+  extern jmp_buf intr_buf;
+  int intr = setjmp(intr_buf);
+  if (intr != 0) {
+    void raise_intr(uint32_t NO, vaddr_t epc);
+    raise_intr(intr - 1, cpu.pc);
+    return false;
+  }
+#endif
+  exec_once();
+  return true;
+}
+
+/* in the child of worker `id' */
+static void run_batch(int id, uint64_t n, const CPU_state *snap, paddr_t addr) {
+  uint8_t *input = shm->job[id].input;
+  uint64_t i;
+  alarm(FUZZ_TIMEOUT);
+  for (i = 0; i < n; i ++) {
+    mutate(input);
+    shm->job[id].nr_run = i + 1;
+    paddr_write_host(addr, input, INPUT_LEN);
+    cpu = *snap;
+    nemu_state.state = NEMU_RUNNING;
+    /* left by an instruction aborted by an exception */
+    decinfo.is_jmp = false;
+
+    memset(cov_map, 0, COV_SIZE);
+    cov_prev = 0;
+    bool is_done = exec_input();
+    asm_clear();
+    __atomic_fetch_add(&shm->nr_exec, 1, __ATOMIC_RELAXED);
+
+    if (cov_is_new(shm->seen)) {
+      corpus_add(input);
+      save_input("queue", input);
+    }
+    if (nemu_state.state == NEMU_ABORT) {
+      __atomic_fetch_add(&shm->nr_abort, 1, __ATOMIC_RELAXED);
+      continue;
+    }
+    if (!is_done) {
+      /* REF goes on to run the handler of the exception, see cpu_exec() */
+      __atomic_fetch_add(&shm->nr_intr, 1, __ATOMIC_RELAXED);
+      continue;
+    }
+#ifdef DIFF_TEST
+    if (!difftest_run_once(snap, addr, input, INPUT_LEN)) {
+      __atomic_fetch_add(&shm->nr_diff, 1, __ATOMIC_RELAXED);
+      save_input("diff", input);
+      /* REF may be left stopped, e.g. by an invalid opcode */
+      break;
+    }
+#endif
+  }
+}
+
+static void save_crash(int id, int status) {
+  char kind[32];
+  if (WIFSIGNALED(status) && WTERMSIG(status) == SIGALRM) {
+    strcpy(kind, "hang");
+    __atomic_fetch_add(&shm->nr_hang, 1, __ATOMIC_RELAXED);
+  }
+  else {
+    if (WIFSIGNALED(status)) sprintf(kind, "crash-sig%d", WTERMSIG(status));
+    else sprintf(kind, "exit-%d", WEXITSTATUS(status));
+    __atomic_fetch_add(&shm->nr_crash, 1, __ATOMIC_RELAXED);
+  }
+  /* the edges taken by the child before it */
+  if (cov_is_new(shm->crash_seen)) save_input(kind, shm->job[id].input);
+}
+
+/* Run `nr_input' inputs, or forever if it is 0. */
+static void run_worker(int id, uint64_t nr_input, const CPU_state *snap, paddr_t addr) {
+  cov_map = shm->job[id].cov;
+  rng = perf_host_us() ^ ((uint64_t)getpid() << 32) ^ id;
+  uint64_t done = 0;
+  while (nr_input == 0 || done < nr_input) {
+    uint64_t n = FUZZ_BATCH;
+    if (nr_input != 0 && nr_input - done < n) n = nr_input - done;
+    /* not a state of the parent shifted by a few steps */
+    uint64_t seed = ((uint64_t)rand32() << 32) | rand32() | 1;
+
+    shm->job[id].nr_run = 0;
+    pid_t pid = fork();
+    if (pid == 0) {
+      rng = seed;
+      run_batch(id, n, snap, addr);
+      _exit(0);
+    }
+    Assert(pid > 0, "can not fork for a batch of inputs");
+    int status;
+    while (waitpid(pid, &status, 0) < 0 && errno == EINTR) ;
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) save_crash(id, status);
+
+    uint64_t nr_run = shm->job[id].nr_run;
+    done += (nr_run > 0 ? nr_run : 1);
+  }
+  _exit(0);
+}
+
+static void fuzz_report(uint64_t us) {
+  int i, nr_edge = 0;
+  for (i = 0; i < COV_SIZE; i ++) nr_edge += (shm->seen[i] != 0);
+  uint64_t nr_exec = shm->nr_exec;
+  Log("fuzz: %lu inputs (%lu/s), %u kept, %d edges, %lu invalid, %lu exceptions, %lu crashes, %lu hangs, %lu differ from REF",
+      nr_exec, (us > 0 ? nr_exec * 1000000 / us : 0), shm->nr_corpus, nr_edge,
+      shm->nr_abort, shm->nr_intr, shm->nr_crash, shm->nr_hang, shm->nr_diff);
+}
+
+bool fuzz_mainloop(void) {
+  if (fuzz_dir == NULL) return false;
+
+  Assert(mkdir(fuzz_dir, 0755) == 0 || errno == EEXIST, "can not create the directory '%s'", fuzz_dir);
+  if (fuzz_nr_job == 0) {
+    long nr_cpu = sysconf(_SC_NPROCESSORS_ONLN);
+    fuzz_nr_job = (nr_cpu < 1 ? 1 : (nr_cpu > NR_JOB_MAX ? NR_JOB_MAX : nr_cpu));
+  }
+  shm = mmap(NULL, sizeof(FuzzShared), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  Assert(shm != MAP_FAILED, "can not allocate the memory shared by the fuzzers");
+
+  CPU_state snap = cpu;
+  bool success;
+  paddr_t addr = isa_fetch_probe(cpu.pc, &success);
+  Assert(success, "can not translate the pc 0x%08x to fuzz", cpu.pc);
+  /* the instruction at the pc is the first input */
+  paddr_read_host(shm->corpus[0], addr, INPUT_LEN);
+  shm->nr_corpus = 1;
+
+  Log("Fuzzing the decoders at pc = 0x%08x by %d jobs, the inputs are written to %s",
+      cpu.pc, fuzz_nr_job, fuzz_dir);
+
+  /* the outputs of the inputs, e.g. for invalid opcodes, are thrown away */
+  int null = open("/dev/null", O_WRONLY);
+  Assert(null >= 0, "can not open /dev/null");
+  fflush(stdout);
+  fflush(stderr);
+
+  uint64_t start_us = perf_host_us();
+  int i, nr_alive = 0;
+  for (i = 0; i < fuzz_nr_job; i ++) {
+    uint64_t n = fuzz_nr_input / fuzz_nr_job + (i < fuzz_nr_input % fuzz_nr_job);
+    if (fuzz_nr_input != 0 && n == 0) continue;
+    pid_t pid = fork();
+    if (pid == 0) {
+      dup2(null, STDOUT_FILENO);
+      dup2(null, STDERR_FILENO);
+      run_worker(i, n, &snap, addr);
+    }
+    if (pid < 0) Log("can not fork for the job %d", i);
+    else nr_alive ++;
+  }
+  close(null);
+
+  uint64_t last_us = start_us;
+  while (nr_alive > 0) {
+    int status;
+    if (waitpid(-1, &status, WNOHANG) > 0) {
+      nr_alive --;
+      continue;
+    }
+    usleep(100000);
+    uint64_t now = perf_host_us();
+    if (now - last_us >= FUZZ_REPORT_US) {
+      fuzz_report(now - start_us);
+      last_us = now;
+    }
+  }
+  fuzz_report(perf_host_us() - start_us);
+  return true;
+}
+
+#else
+
+void init_fuzz(char *spec) {
+  panic("'-Z' needs NEMU built by `make FUZZ=1'");
+}
+
+bool fuzz_mainloop(void) {
+  return false;
+}
+
+#endif
@@ -0,0 +1,67 @@
+#include "nemu.h"
+#include "monitor/monitor.h"
+#include "monitor/machine.h"
+#include "monitor/snapshot.h"
+#include "monitor/reverse.h"
+#include "cpu/decode-cache.h"
+#include "cpu/hart.h"
+#include <stdlib.h>
+
+/* The state of a machine is everything in a checkpoint of reverse
+ * execution, see snapshot.c, and pmem is swapped by its pointer, so
+ * swapping the machines copies neither pmem nor the pages of the guest.
+ * The caches of decoding and translation belong to the running machine,
+ * and are dropped by a swap. */
+
+struct Machine {
+  Snapshot *state;  // NULL at the reset
+  PmemSpace mem;
+};
+
+static Snapshot *reset_state = NULL;
+
+void init_machine(void) {
+  reset_state = snapshot_take();
+}
+
+Machine *machine_new(const char *img_file) {
+  Assert(reset_state != NULL, "the state at the reset is not taken");
+  Machine *m = malloc(sizeof(*m));
+  assert(m != NULL);
+  m->state = NULL;
+  pmem_space_alloc(&m->mem);
+
+  /* load the image into the pmem of `m' */
+  long load_img(const char *file);
+  machine_swap(m);
+  load_img(img_file);
+  machine_swap(m);
+  return m;
+}
+
+void machine_swap(Machine *m) {
+#ifdef DIFF_TEST
+  panic("differential testing only supports one machine");
+#endif
+  Assert(nr_hart == 1, "only the machines with one hart can be swapped");
+
+  Snapshot *running = snapshot_take();
+  snapshot_restore(m->state == NULL ? reset_state : m->state);
+  if (m->state != NULL) snapshot_free(m->state);
+  m->state = running;
+  pmem_swap(&m->mem);
+
+  /* everything cached from the old pmem and translation is stale */
+  dcache_flush();
+  ifetch_flush();
+  isa_mmu_flush();
+  pmem_dirty_range(0, pmem_size);
+  /* the recording is of the other machine */
+  rev_reset();
+}
+
+void machine_free(Machine *m) {
+  if (m->state != NULL) snapshot_free(m->state);
+  pmem_space_free(&m->mem);
+  free(m);
+}
@@ -1,19 +1,76 @@
 #include "nemu.h"
 #include "monitor/monitor.h"
 #include <unistd.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include "memory/cache.h"
+#include "memory/heatmap.h"
+#include "device/vga.h"
+#include "device/timer.h"
+#include "device/disk.h"
+#include "monitor/symbol.h"
+#include "monitor/prof.h"
+#include "monitor/ftrace.h"
+#include "monitor/perf.h"
+#include "monitor/gdb.h"
+#include "monitor/script.h"
+#include "monitor/fork-server.h"
+#include "monitor/fuzz.h"
+#include "monitor/snapshot.h"
+#include "cpu/hart.h"
+#include "monitor/machine.h"
+#include "monitor/sample.h"
+#include "monitor/reverse.h"
+#include "rtl/jit.h"
 
 void init_log(const char *log_file);
+void init_itrace(const char *file);
 void init_isa();
-void init_regex();
 void init_wp_pool();
 void init_device();
 void init_difftest(char *ref_so_file, long img_size);
+void difftest_config(int n, bool pipelined, const char *record, const char *replay);
+void expr_bench(const char *file, int nr_round);
+void nemu_bench(uint64_t nr_op);
 
 static char *mainargs = "";
 static char *log_file = NULL;
+static char *itrace_file = NULL;
 static char *diff_so_file = NULL;
 static char *img_file = NULL;
 static int is_batch_mode = false;
+static uint32_t pmem_mb = PMEM_SIZE_DEFAULT >> 20;
+static bool pmem_hugepage = false;
+static int nr_harts = 1;
+static uint64_t hart_quantum_arg = HART_QUANTUM_DEFAULT;
+static char *cache_spec = NULL;
+static char *heat_file = NULL;
+static char *mtrace_spec = NULL;
+static bool is_headless = false;
+static char *frame_file = NULL;
+static char *screen_size = NULL;
+static int frame_every = 1;
+static char *clock_spec = NULL;
+static char *disk_file = NULL;
+static int difftest_batch = 1;
+static bool difftest_pipelined = false;
+static char *trace_record = NULL;
+static char *trace_replay = NULL;
+static char *elf_file = NULL;
+static char *ftrace_file = NULL;
+static char *perf_file = NULL;
+static char *snapshot_file = NULL;
+static char *prof_file = NULL;
+static char *prof_spec = NULL;
+static char *sample_spec = NULL;
+static char *fast_spec = NULL;
+static char *aot_file = NULL;
+static bool prof_backtrace = false;
+static char *expr_bench_file = NULL;
+static int expr_bench_rounds = 10;
+static uint64_t nemu_bench_ops = 0;
+static char *input_save_file = NULL;
+static char *input_load_file = NULL;
 
 static inline void welcome() {
 #ifdef DEBUG
@@ -30,9 +87,10 @@ static inline void welcome() {
   printf("For help, type \"help\"\n");
 }
 
-static inline long load_img() {
+/* Load the image `file', or the built-in one if it is NULL, into pmem. */
+long load_img(const char *file) {
   long size;
-  if (img_file == NULL) {
+  if (file == NULL) {
     Log("No image is given. Use the default build-in image.");
     extern uint8_t isa_default_img[];
     extern long isa_default_img_size;
@@ -42,17 +100,26 @@ static inline long load_img() {
   else {
     int ret;
 
-    FILE *fp = fopen(img_file, "rb");
-    Assert(fp, "Can not open '%s'", img_file);
+    FILE *fp = fopen(file, "rb");
+    Assert(fp, "Can not open '%s'", file);
 
-    Log("The image is %s", img_file);
+    Log("The image is %s", file);
 
     fseek(fp, 0, SEEK_END);
     size = ftell(fp);
+    Assert(IMAGE_START + size <= pmem_size, "the image is too large for %u MB of memory", pmem_size >> 20);
 
-    fseek(fp, 0, SEEK_SET);
-    ret = fread(guest_to_host(IMAGE_START), size, 1, fp);
-    assert(ret == 1);
+    /* Map the image copy-on-write over pmem, so only the pages touched
+     * by the guest are read from the file. Fall back to reading it if the
+     * file can not be mapped, e.g. it is a pipe. */
+    void *host = guest_to_host(IMAGE_START);
+    size_t map_size = (size + PAGE_MASK) & ~PAGE_MASK;
+    if (size == 0 || mmap(host, map_size, PROT_READ | PROT_WRITE,
+          MAP_PRIVATE | MAP_FIXED, fileno(fp), 0) == MAP_FAILED) {
+      fseek(fp, 0, SEEK_SET);
+      ret = fread(host, size, 1, fp);
+      assert(ret == 1);
+    }
 
     fclose(fp);
   }
@@ -61,18 +128,91 @@ static inline long load_img() {
 
 static inline void parse_args(int argc, char *argv[]) {
   int o;
-  while ( (o = getopt(argc, argv, "-bl:d:a:")) != -1) {
+  while ( (o = getopt(argc, argv, "-bB:l:d:a:m:n:Hc:p:M:NF:t:D:C:PT:R:i:e:s:gf:j:G:k:S:x:w:I:X:U:W:Y:V:Z:")) != -1) {
     switch (o) {
       case 'b': is_batch_mode = true; break;
+      case 'B': init_script(optarg); break;
       case 'a': mainargs = optarg; break;
       case 'l': log_file = optarg; break;
+      case 'i': itrace_file = optarg; break;
+      case 'e': elf_file = optarg; break;
+      case 'f': ftrace_file = optarg; break;
+      case 'j': perf_file = optarg; break;
+      case 'G': init_gdb(atoi(optarg)); break;
+      case 'k': init_fork_server(optarg); break;
+      case 'Z': init_fuzz(optarg); break;
+      case 'S': snapshot_file = optarg; break;
+      case 'g': prof_backtrace = true; break;
+      case 'w': sample_spec = optarg; break;
+      case 'I': fast_spec = optarg; break;
+      case 'X': aot_file = optarg; break;
+      case 's': {
+                  /* FILE[:PERIOD] */
+                  prof_file = optarg;
+                  char *period = strrchr(optarg, ':');
+                  if (period != NULL) {
+                    *period ++ = '\0';
+                    prof_spec = period;
+                  }
+                  break;
+                }
       case 'd': diff_so_file = optarg; break;
+      case 'm':
+                pmem_mb = atoi(optarg);
+                Assert(pmem_mb > 0 && pmem_mb < 2048, "invalid size of memory '%s'", optarg);
+                break;
+      case 'n': {
+                  /* N[:K], K instructions in turn */
+                  char *k = strchr(optarg, ':');
+                  nr_harts = atoi(optarg);
+                  if (k != NULL) hart_quantum_arg = strtoull(k + 1, NULL, 10);
+                  break;
+                }
+      case 'H': pmem_hugepage = true; break;
+      case 'c': cache_spec = optarg; break;
+      case 'p': heat_file = optarg; break;
+      case 'M': mtrace_spec = optarg; break;
+      case 'N': is_headless = true; break;
+      case 'V': screen_size = optarg; break;
+      case 't': clock_spec = optarg; break;
+      case 'D': disk_file = optarg; break;
+      case 'C': difftest_batch = atoi(optarg); break;
+      case 'P': difftest_pipelined = true; break;
+      case 'T': trace_record = optarg; break;
+      case 'R': trace_replay = optarg; break;
+      case 'x': {
+                  /* FILE[:ROUNDS] */
+                  expr_bench_file = optarg;
+                  char *rounds = strrchr(optarg, ':');
+                  if (rounds != NULL) {
+                    *rounds ++ = '\0';
+                    expr_bench_rounds = atoi(rounds);
+                    Assert(expr_bench_rounds > 0, "invalid rounds of the benchmark '%s'", rounds);
+                  }
+                  break;
+                }
+      case 'W': input_save_file = optarg; break;
+      case 'Y': input_load_file = optarg; break;
+      case 'U':
+                nemu_bench_ops = strtoull(optarg, NULL, 10);
+                Assert(nemu_bench_ops > 0, "invalid number of operations '%s'", optarg);
+                break;
+      case 'F': {
+                  /* FILE[:N] */
+                  frame_file = optarg;
+                  char *every = strrchr(optarg, ':');
+                  if (every != NULL) {
+                    *every ++ = '\0';
+                    frame_every = atoi(every);
+                  }
+                  break;
+                }
       case 1:
                 if (img_file != NULL) Log("too much argument '%s', ignored", optarg);
                 else img_file = optarg;
                 break;
       default:
-                panic("Usage: %s [-b] [-l log_file] [img_file]", argv[0]);
+                panic("Usage: %s [-b] [-B script[:json]] [-l log_file] [-i itrace_file] [-e elf_file] [-f ftrace_file] [-j perf_json] [-G gdb_port] [-k fork_server_socket[:N]] [-Z fuzz_dir[:N[:jobs]]] [-S snapshot] [-x expr_corpus[:rounds]] [-U nr_op] [-s profile[:period]] [-g] [-w sample_spec] [-I N|pc=ADDR] [-X aot_c_or_so] [-m size_in_MB] [-n harts[:quantum]] [-H] [-c cache_spec] [-p heatmap_csv] [-M mtrace_file[:r|w][:lo-hi,...]] [-N] [-V WxH] [-F frame_csv[:N]] [-t clock] [-D disk_img] [-C difftest_batch] [-P] [-T trace_to_record] [-R trace_to_replay] [-W inputs_to_save] [-Y inputs_to_replay] [img_file]", argv[0]);
     }
   }
 }
@@ -81,32 +221,156 @@ char* get_mainargs(void) {
   return mainargs;
 }
 
+/* The host time of each phase of the startup, logged at the end of it. */
+#define NR_PHASE 8
+
+static struct {
+  const char *name;
+  uint64_t us;
+} phases[NR_PHASE];
+static int nr_phase = 0;
+static uint64_t phase_start = 0;
+
+static void phase_end(const char *name) {
+  uint64_t now = perf_host_us();
+  assert(nr_phase < NR_PHASE);
+  phases[nr_phase].name = name;
+  phases[nr_phase ++].us = now - phase_start;
+  phase_start = now;
+}
+
+static void phase_log(void) {
+  char buf[256];
+  int i, n = 0;
+  for (i = 0; i < nr_phase; i ++) {
+    n += snprintf(buf + n, sizeof(buf) - n, "%s%s %ld", (i == 0 ? "" : ", "), phases[i].name, phases[i].us);
+  }
+  Log("Initialized in %ld us (%s)", perf_host_us(), buf);
+}
+
 int init_monitor(int argc, char *argv[]) {
   /* Perform some global initialization. */
 
   /* Parse arguments. */
   parse_args(argc, argv);
 
+  /* Start the clock of the performance counters. */
+  init_perf(perf_file);
+
   /* Open the log file. */
   init_log(log_file);
+  init_itrace(itrace_file);
+  phase_end("log");
+
+  /* Perform ISA dependent initialization, which also allocates memory. */
+  pmem_config(pmem_mb << 20, pmem_hugepage);
+  init_isa();
+  phase_end("isa");
 
   /* Load the image to memory. */
-  long img_size = load_img();
+  long img_size = load_img(img_file);
+  phase_end("load_img");
 
-  /* Perform ISA dependent initialization. */
-  init_isa();
+  /* Load the symbols of the guest, and start profiling and tracing it. */
+  init_symbol(elf_file);
+  init_prof(prof_file, prof_spec, prof_backtrace);
+  init_ftrace(ftrace_file);
+
+  /* Setup the simulated caches. */
+#ifdef CACHE_SIM
+  init_cache(cache_spec);
+#else
+  if (cache_spec != NULL) Log("CACHE_SIM is not enabled, '-c %s' is ignored", cache_spec);
+#endif
+
+  /* Setup the counters of memory accesses. */
+#ifdef PMEM_HEATMAP
+  init_heatmap(heat_file);
+#else
+  if (heat_file != NULL) Log("PMEM_HEATMAP is not enabled, '-p %s' is ignored", heat_file);
+#endif
+#ifdef MTRACE
+  init_mtrace(mtrace_spec);
+#else
+  if (mtrace_spec != NULL) Log("MTRACE is not enabled, '-M %s' is ignored", mtrace_spec);
+#endif
 
-  /* Compile the regular expressions. */
-  init_regex();
+  phase_end("debug");
 
   /* Initialize the watchpoint pool. */
   init_wp_pool();
 
   /* Initialize devices. */
+#ifdef HAS_IOE
+  vga_config(is_headless, screen_size, frame_file, frame_every);
+  timer_config(clock_spec);
+  disk_config(disk_file);
+#else
+  if (is_headless || screen_size != NULL || frame_file != NULL || clock_spec != NULL || disk_file != NULL) {
+    Log("HAS_IOE is not enabled, '-N', '-V', '-F', '-t' and '-D' are ignored");
+  }
+#endif
   init_device();
+  phase_end("device");
+
+  /* Save the inputs from the host, or replay those saved. */
+  if (input_save_file != NULL) rev_input_save(input_save_file);
+  if (input_load_file != NULL) rev_input_load(input_load_file);
+
+  /* Alternate between fast-forwarding and the detailed windows. */
+  init_sample(sample_spec);
 
   /* Initialize differential testing. */
+  difftest_config(difftest_batch, difftest_pipelined, trace_record, trace_replay);
   init_difftest(diff_so_file, img_size);
+  phase_end("difftest");
+
+  /* Start the harts. Only the running one is in a snapshot, and the REF
+   * of differential testing only has one. */
+  init_hart(nr_harts, hart_quantum_arg);
+#ifdef DIFF_TEST
+  Assert(nr_harts == 1, "differential testing only supports one hart");
+#endif
+  Assert(nr_harts == 1 || snapshot_file == NULL, "snapshots only support one hart");
+
+  /* The other machines start from here, see monitor/machine.c. */
+  init_machine();
+
+  /* Start from a snapshot instead of the image. */
+  if (snapshot_file != NULL && !snapshot_load(snapshot_file)) {
+    panic("can not load the snapshot '%s'", snapshot_file);
+  }
+  phase_end("machine");
+
+  /* Only benchmark the expression evaluator. */
+  if (expr_bench_file != NULL) {
+    expr_bench(expr_bench_file, expr_bench_rounds);
+    perf_statistic();
+    exit(0);
+  }
+
+  /* Only benchmark the primitives of NEMU. */
+  if (nemu_bench_ops > 0) {
+    nemu_bench(nemu_bench_ops);
+    perf_statistic();
+    exit(0);
+  }
+
+  /* Translate the blocks into C, or load those translated before. */
+#ifdef JIT_ENGINE
+  jit_aot_config(aot_file);
+#else
+  if (aot_file != NULL) Log("RTL_JIT is not enabled, '-X %s' is ignored", aot_file);
+#endif
+
+  /* Run fast until the instrumentation is needed. */
+  if (fast_spec != NULL) {
+    if (strncmp(fast_spec, "pc=", 3) == 0) exec_fast_until(UINT64_MAX, strtoul(fast_spec + 3, NULL, 0));
+    else exec_fast_until(strtoull(fast_spec, NULL, 10), (vaddr_t)-1);
+  }
+
+  /* The host time to start, also for the boot-time benchmark of nanos-lite. */
+  phase_log();
 
   /* Display welcome message. */
   welcome();
@@ -0,0 +1,99 @@
+#include "common.h"
+#include "monitor/perf.h"
+#include <time.h>
+
+static const char *perf_json_file = NULL;
+static struct timespec start_time;
+
+uint64_t perf_host_us(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (now.tv_sec - start_time.tv_sec) * 1000000ull +
+    (now.tv_nsec - start_time.tv_nsec) / 1000;
+}
+
+void init_perf(const char *json_file) {
+  clock_gettime(CLOCK_MONOTONIC, &start_time);
+  perf_json_file = json_file;
+}
+
+/* start a member of the current group, or a line of text */
+static void perf_key(PerfOut *o, const char *name) {
+  if (o->json) {
+    fprintf(o->fp, "%s\n%*s\"%s\": ", (o->first ? "" : ","), 2 * o->depth, "", name);
+  }
+  else {
+    fprintf(o->fp, "%*s%-24s", 2 * o->depth, "", name);
+  }
+  o->first = false;
+}
+
+void perf_begin(PerfOut *o, const char *group) {
+  if (o->json) {
+    perf_key(o, group);
+    fprintf(o->fp, "{");
+  }
+  else {
+    fprintf(o->fp, "%*s%s\n", 2 * o->depth, "", group);
+  }
+  o->depth ++;
+  o->first = true;
+}
+
+void perf_end(PerfOut *o) {
+  o->depth --;
+  if (o->json) fprintf(o->fp, "\n%*s}", 2 * o->depth, "");
+  o->first = false;
+}
+
+void perf_u64(PerfOut *o, const char *name, uint64_t val) {
+  perf_key(o, name);
+  fprintf(o->fp, o->json ? "%lu" : "%lu\n", val);
+}
+
+void perf_double(PerfOut *o, const char *name, double val) {
+  perf_key(o, name);
+  fprintf(o->fp, o->json ? "%.6g" : "%.6g\n", val);
+}
+
+void perf_dump(FILE *fp, bool json) {
+  PerfOut o = { .fp = fp, .json = json, .depth = (json ? 1 : 0), .first = true };
+  if (json) fprintf(fp, "{");
+
+  perf_double(&o, "host_seconds", perf_host_us() / 1e6);
+  cpu_perf(&o);
+  hart_perf(&o);
+  isa_perf(&o);
+#ifdef CACHE_SIM
+  cache_perf(&o);
+#endif
+  perf_begin(&o, "pio");
+  pio_perf(&o);
+  perf_end(&o);
+  perf_begin(&o, "mmio");
+  mmio_perf(&o);
+  perf_end(&o);
+#ifdef DIFF_TEST
+  difftest_perf(&o);
+#endif
+  expr_bench_perf(&o);
+  nemu_bench_perf(&o);
+  marker_perf(&o);
+#ifdef HAS_IOE
+  vga_perf(&o);
+#endif
+
+  if (json) fprintf(fp, "\n}\n");
+}
+
+void perf_statistic(void) {
+  if (perf_json_file == NULL) return;
+  FILE *fp = fopen(perf_json_file, "w");
+  if (fp == NULL) {
+    Log("can not open '%s' for the performance counters", perf_json_file);
+    return;
+  }
+  perf_dump(fp, true);
+  fclose(fp);
+  Log("the performance counters are written to %s", perf_json_file);
+}
@@ -0,0 +1,389 @@
+#include "nemu.h"
+#include "monitor/monitor.h"
+#include "monitor/reverse.h"
+#include "monitor/snapshot.h"
+#include "monitor/watchpoint.h"
+#include "monitor/diff-test.h"
+#include "device/event.h"
+#include "cpu/decode-cache.h"
+#include "memory/memory.h"
+#include "isa/diff-test.h"
+#include <stdlib.h>
+
+/* A checkpoint keeps the state of the machine except pmem in a Snapshot,
+ * and the pages of pmem written since the previous checkpoint, found by
+ * the dirty bits of PMEM_DIRTY_REVERSE. So only the pages changed are
+ * copied, and the first checkpoint has all the pages which are not zero.
+ * A page at a checkpoint is the copy in the latest checkpoint up to it
+ * with the page, or zero if there is not any.
+ *
+ * The checkpoints are taken by an event every REV_TICK instructions, when
+ * `rev_interval' instructions have passed since the last one. When there
+ * are too many, the oldest one is merged into the next one.
+ *
+ * The inputs from the host are logged in order with the number of
+ * instructions executed before them. Each checkpoint remembers the length
+ * of the log, so replaying from it reads the inputs after that. */
+
+#define MAX_CHECKPOINT 64
+#define REV_TICK 1000000
+
+typedef struct {
+  uint64_t instr;
+  uint32_t nr_input;
+  Snapshot *state;
+  uint32_t nr_page;
+  uint32_t *pages;  // in ascending order
+  uint8_t *data;
+} Checkpoint;
+
+typedef struct {
+  uint64_t instr;
+  uint64_t val;
+} RevInput;
+
+static Checkpoint cps[MAX_CHECKPOINT];
+static int nr_cp = 0;
+static uint64_t rev_interval = 0;
+static bool event_added = false;
+
+static RevInput *inputs = NULL;
+static uint32_t nr_input = 0, input_cap = 0;
+/* the next input to read or log */
+static uint32_t input_pos = 0;
+
+void cpu_exec(uint64_t);
+
+uint64_t rev_replay_end = 0;
+bool rev_quiet = false;
+
+/* The inputs of a whole run can also be saved into a file, and replayed
+ * from it in a later run, so the same instructions are executed again
+ * whatever the host does, e.g. to time the execution engines on them.
+ * The file has the inputs in the same form as the log, and ends with one
+ * with INPUT_END in `instr', which has the number of instructions executed
+ * and the hash of the state of the machine at the end. The replay checks
+ * that it ends in the same state. */
+
+#define INPUT_END ((uint64_t)1 << 63)
+
+static FILE *save_fp = NULL;
+static RevInput *loaded = NULL;
+static uint32_t nr_loaded = 0, loaded_pos = 0;
+static RevInput loaded_end = { 0 };
+bool rev_input_loaded = false;
+
+void rev_input_record(uint64_t val) {
+  if (save_fp != NULL) {
+    RevInput in = { .instr = g_nr_guest_instr, .val = val };
+    fwrite(&in, sizeof(in), 1, save_fp);
+  }
+  if (nr_cp == 0) return;
+  if (input_pos == input_cap) {
+    input_cap = (input_cap == 0 ? 1024 : input_cap * 2);
+    inputs = realloc(inputs, input_cap * sizeof(inputs[0]));
+    assert(inputs != NULL);
+  }
+  inputs[input_pos ++] = (RevInput) { .instr = g_nr_guest_instr, .val = val };
+  nr_input = input_pos;
+}
+
+uint64_t rev_input_replay(void) {
+  if (rev_is_replaying()) {
+    Assert(input_pos < nr_input && inputs[input_pos].instr == g_nr_guest_instr,
+        "the replay goes differently from the recording at instruction %lu", g_nr_guest_instr);
+    return inputs[input_pos ++].val;
+  }
+
+  Assert(loaded_pos < nr_loaded && loaded[loaded_pos].instr == g_nr_guest_instr,
+      "the replay goes differently from the saved inputs at instruction %lu", g_nr_guest_instr);
+  uint64_t val = loaded[loaded_pos ++].val;
+  /* for reverse execution while replaying */
+  rev_input_record(val);
+  return val;
+}
+
+static uint64_t state_hash(void) {
+  return difftest_hash(&cpu, DIFFTEST_REG_SIZE) * 31 + difftest_hash(pmem, pmem_size);
+}
+
+void rev_input_save(const char *file) {
+  save_fp = fopen(file, "wb");
+  Assert(save_fp != NULL, "Can not open '%s'", file);
+  Log("The inputs are saved to %s", file);
+}
+
+void rev_input_load(const char *file) {
+  FILE *fp = fopen(file, "rb");
+  Assert(fp != NULL, "Can not open '%s'", file);
+  uint32_t cap = 0;
+  RevInput in;
+  while (fread(&in, sizeof(in), 1, fp) == 1) {
+    if (in.instr & INPUT_END) {
+      loaded_end = in;
+      break;
+    }
+    if (nr_loaded == cap) {
+      cap = (cap == 0 ? 1024 : cap * 2);
+      loaded = realloc(loaded, cap * sizeof(loaded[0]));
+      assert(loaded != NULL);
+    }
+    loaded[nr_loaded ++] = in;
+  }
+  fclose(fp);
+  Assert(loaded_end.instr & INPUT_END, "'%s' is not complete", file);
+  rev_input_loaded = true;
+  Log("Replay %u inputs from %s", nr_loaded, file);
+}
+
+/* called at the end of the run */
+void rev_input_finish(void) {
+  if (save_fp != NULL) {
+    RevInput end = { .instr = g_nr_guest_instr | INPUT_END, .val = state_hash() };
+    fwrite(&end, sizeof(end), 1, save_fp);
+    fclose(save_fp);
+    save_fp = NULL;
+  }
+  if (rev_input_loaded) {
+    rev_input_loaded = false;
+    uint64_t hash = state_hash();
+    if (g_nr_guest_instr == (loaded_end.instr & ~INPUT_END) && hash == loaded_end.val) {
+      Log("The replay ends in the same state as the saved run, hash = %016lx", hash);
+    }
+    else {
+      printf("\33[1;31mThe replay ends differently: %lu instructions and hash = %016lx, "
+          "instead of %lu and %016lx\33[0m\n", g_nr_guest_instr, hash,
+          loaded_end.instr & ~INPUT_END, loaded_end.val);
+    }
+  }
+}
+
+static void free_checkpoint(Checkpoint *c) {
+  snapshot_free(c->state);
+  free(c->pages);
+  free(c->data);
+}
+
+static void take_checkpoint(bool all) {
+  uint32_t nr = pmem_size / PAGE_SIZE, nr_page = 0, i;
+  int p;
+  if (all) {
+    for (i = 0; i < nr; i ++) nr_page += !pmem_page_is_zero(i);
+  }
+  else {
+    for (p = pmem_next_dirty(0, PMEM_DIRTY_REVERSE); p != -1; p = pmem_next_dirty(p + 1, PMEM_DIRTY_REVERSE)) nr_page ++;
+  }
+
+  Checkpoint *c = &cps[nr_cp ++];
+  *c = (Checkpoint) { .instr = g_nr_guest_instr, .nr_input = input_pos, .state = snapshot_take(),
+    .nr_page = nr_page };
+  c->pages = malloc(nr_page * sizeof(c->pages[0]) + 1);
+  c->data = malloc((size_t)nr_page * PAGE_SIZE + 1);
+  assert(c->pages != NULL && c->data != NULL);
+
+  nr_page = 0;
+  for (i = 0; i < nr; i ++) {
+    if (all ? pmem_page_is_zero(i) : !pmem_is_dirty(i, PMEM_DIRTY_REVERSE)) continue;
+    memcpy(c->data + (size_t)nr_page * PAGE_SIZE, pmem + i * PAGE_SIZE, PAGE_SIZE);
+    c->pages[nr_page ++] = i;
+  }
+  pmem_clear_dirty(0, nr, PMEM_DIRTY_REVERSE);
+}
+
+/* Merge the first checkpoint into the second one, which becomes the first.
+ * The pages of the first one not in the second one are moved into it, and
+ * the inputs before the second one are dropped. */
+static void drop_first_checkpoint(void) {
+  Checkpoint *a = &cps[0], *b = &cps[1];
+  uint32_t nr_page = a->nr_page + b->nr_page;
+  uint32_t *pages = malloc(nr_page * sizeof(pages[0]) + 1);
+  uint8_t *data = malloc((size_t)nr_page * PAGE_SIZE + 1);
+  assert(pages != NULL && data != NULL);
+
+  uint32_t i = 0, j = 0, k = 0;
+  while (i < a->nr_page || j < b->nr_page) {
+    bool from_b = (j < b->nr_page && (i == a->nr_page || b->pages[j] <= a->pages[i]));
+    if (from_b && i < a->nr_page && a->pages[i] == b->pages[j]) i ++;
+    Checkpoint *c = (from_b ? b : a);
+    uint32_t n = (from_b ? j ++ : i ++);
+    pages[k] = c->pages[n];
+    memcpy(data + (size_t)k * PAGE_SIZE, c->data + (size_t)n * PAGE_SIZE, PAGE_SIZE);
+    k ++;
+  }
+  free(b->pages);
+  free(b->data);
+  b->pages = pages;
+  b->data = data;
+  b->nr_page = k;
+
+  uint32_t nr_drop = b->nr_input;
+  memmove(inputs, inputs + nr_drop, (nr_input - nr_drop) * sizeof(inputs[0]));
+  nr_input -= nr_drop;
+  input_pos -= nr_drop;
+
+  free_checkpoint(a);
+  memmove(cps, cps + 1, (nr_cp - 1) * sizeof(cps[0]));
+  nr_cp --;
+  int n;
+  for (n = 0; n < nr_cp; n ++) cps[n].nr_input -= nr_drop;
+}
+
+static void checkpoint_event(void) {
+  if (nr_cp == 0 || rev_is_replaying()) return;
+  if (g_nr_guest_instr - cps[nr_cp - 1].instr < rev_interval) return;
+  if (nr_cp == MAX_CHECKPOINT) drop_first_checkpoint();
+  take_checkpoint(false);
+}
+
+/* the copy of `page' at the checkpoint `n', or NULL if it is zero */
+static const uint8_t *page_at(int n, uint32_t page) {
+  for (; n >= 0; n --) {
+    Checkpoint *c = &cps[n];
+    uint32_t l = 0, r = c->nr_page;
+    while (l < r) {
+      uint32_t m = (l + r) / 2;
+      if (c->pages[m] < page) l = m + 1;
+      else r = m;
+    }
+    if (l < c->nr_page && c->pages[l] == page) return c->data + (size_t)l * PAGE_SIZE;
+  }
+  return NULL;
+}
+
+/* The pages changed after the checkpoint `n' are those in the later
+ * checkpoints, and those written since the last checkpoint or restoring. */
+static void restore_checkpoint(int n) {
+  uint32_t nr = pmem_size / PAGE_SIZE, i;
+  uint8_t *changed = calloc(nr, 1);
+  assert(changed != NULL);
+  int p, k;
+  for (p = pmem_next_dirty(0, PMEM_DIRTY_REVERSE); p != -1; p = pmem_next_dirty(p + 1, PMEM_DIRTY_REVERSE)) changed[p] = 1;
+  for (k = n + 1; k < nr_cp; k ++) {
+    for (i = 0; i < cps[k].nr_page; i ++) changed[cps[k].pages[i]] = 1;
+  }
+
+  for (i = 0; i < nr; i ++) {
+    if (!changed[i]) continue;
+    const uint8_t *src = page_at(n, i);
+    if (src != NULL) memcpy(pmem + i * PAGE_SIZE, src, PAGE_SIZE);
+    else memset(pmem + i * PAGE_SIZE, 0, PAGE_SIZE);
+    pmem_dirty_range(i * PAGE_SIZE, PAGE_SIZE);
+  }
+  free(changed);
+
+  snapshot_restore(cps[n].state);
+  input_pos = cps[n].nr_input;
+  /* taken in the middle of cpu_exec() */
+  if (nemu_state.state == NEMU_RUNNING) nemu_state.state = NEMU_STOP;
+
+  /* everything cached from the pages and the translation may be stale */
+  dcache_flush();
+  ifetch_flush();
+  isa_mmu_flush();
+#ifdef DIFF_TEST
+  difftest_reset_ref();
+#endif
+  pmem_clear_dirty(0, nr, PMEM_DIRTY_REVERSE);
+}
+
+/* Execute quietly until `target'. Return the number of instructions
+ * executed when a watchpoint is last found changed, or 0 if it is not. */
+static uint64_t replay_to(uint64_t target) {
+  uint64_t hit = 0;
+  rev_quiet = true;
+  wp_update();
+  while (g_nr_guest_instr < target) {
+    uint64_t nr_hit = wp_nr_hit;
+    cpu_exec(target - g_nr_guest_instr);
+    if (wp_nr_hit != nr_hit) {
+      hit = g_nr_guest_instr;
+      wp_update();
+    }
+    if (nemu_state.state != NEMU_STOP) break;
+  }
+  rev_quiet = false;
+  return hit;
+}
+
+static void drop_recording(void) {
+  int n;
+  for (n = 0; n < nr_cp; n ++) free_checkpoint(&cps[n]);
+  nr_cp = 0;
+  nr_input = input_pos = 0;
+  rev_replay_end = 0;
+}
+
+void rev_start(uint64_t interval) {
+  assert(interval > 0);
+  drop_recording();
+  rev_interval = interval;
+  if (!event_added) {
+    add_instr_event("reverse", REV_TICK, checkpoint_event);
+    event_added = true;
+  }
+  take_checkpoint(true);
+  Log("Recording from instruction %lu with a checkpoint every %lu instructions, "
+      "%u pages in the first one", g_nr_guest_instr, interval, cps[0].nr_page);
+}
+
+void rev_stop(void) {
+  drop_recording();
+}
+
+void rev_reset(void) {
+  if (nr_cp > 0) rev_start(rev_interval);
+}
+
+/* can `g_nr_guest_instr' go back from here */
+static bool rev_begin(void) {
+  if (nr_cp == 0) {
+    printf("Not recording, start it with 'record'\n");
+    return false;
+  }
+  if (g_nr_guest_instr > rev_replay_end) rev_replay_end = g_nr_guest_instr;
+  return true;
+}
+
+/* the last checkpoint before `instr', or at it if `at' */
+static int find_checkpoint(uint64_t instr, bool at) {
+  int n = nr_cp - 1;
+  while (n > 0 && (cps[n].instr > instr || (!at && cps[n].instr == instr))) n --;
+  return n;
+}
+
+void rev_step(uint64_t n) {
+  if (!rev_begin() || n == 0) return;
+  uint64_t target = g_nr_guest_instr - n;
+  if (n > g_nr_guest_instr - cps[0].instr) {
+    target = cps[0].instr;
+    printf("The recording starts at instruction %lu\n", target);
+  }
+  restore_checkpoint(find_checkpoint(target, true));
+  replay_to(target);
+  printf("Back to instruction %lu, pc = 0x%08x\n", g_nr_guest_instr, cpu.pc);
+}
+
+/* The segments between the checkpoints are executed again one by one from
+ * the last one, until a watchpoint is found changed in a segment. Then the
+ * segment is executed again up to the instruction before the change. */
+void rev_continue(void) {
+  if (!rev_begin()) return;
+  uint64_t end = g_nr_guest_instr;
+  int n;
+  for (n = find_checkpoint(end, false); n >= 0 && cps[n].instr < end; n --) {
+    restore_checkpoint(n);
+    uint64_t hit = replay_to(end);
+    if (hit != 0) {
+      restore_checkpoint(n);
+      replay_to(hit - 1);
+      printf("A watchpoint is changed by instruction %lu, pc = 0x%08x\n", hit, cpu.pc);
+      return;
+    }
+    end = cps[n].instr;
+  }
+
+  restore_checkpoint(0);
+  replay_to(cps[0].instr);
+  printf("No watchpoint is changed since the start of the recording at instruction %lu, pc = 0x%08x\n",
+      g_nr_guest_instr, cpu.pc);
+}
@@ -0,0 +1,148 @@
+#include "nemu.h"
+#include "monitor/monitor.h"
+#include "monitor/sample.h"
+#include "device/event.h"
+#include "cpu/threaded.h"
+#include "rtl/jit.h"
+#include <stdlib.h>
+
+/* Sampled simulation splits the run into intervals of `interval' guest
+ * instructions. Only the first `window' instructions of each interval are
+ * detailed, i.e. counted by the cache simulator, the heat map, the opcode
+ * statistics and the profiler, and the rest are fast-forwarded without
+ * them. The statistics are then those of the windows, taken evenly over
+ * the whole run. `window' should divide `interval'.
+ *
+ * With `bbv=FILE', the basic block vector of each interval is written to
+ * FILE as a line of the frequency vector file of SimPoint:
+ *
+ *   T:ID:COUNT :ID:COUNT ...
+ *
+ * where COUNT is the number of instructions executed in the block ID
+ * (from 1, in the order they are first seen). A block runs from an
+ * instruction to the next taken jump, or is a translation block with
+ * TB_CACHE. The vectors are collected in every instruction, detailed or
+ * not. */
+
+bool sample_detailed = true;
+bool bbv_on = false;
+vaddr_t bbv_block_pc = 0;
+uint64_t bbv_block_len = 0;
+
+static uint64_t interval = 0, window = 0, nr_tick = 0;
+static FILE *bbv_fp = NULL;
+
+/* the IDs of the blocks by their pcs, open addressing */
+typedef struct {
+  vaddr_t pc;
+  uint32_t id;  // 0 if the slot is empty
+} BlockSlot;
+
+static BlockSlot *table = NULL;
+static uint32_t table_size = 0, nr_block = 0;
+/* the counts of the interval by the IDs, and the IDs counted */
+static uint64_t *counts = NULL;
+static uint32_t *touched = NULL;
+static uint32_t nr_touched = 0;
+static uint64_t nr_interval = 0;
+
+static BlockSlot *lookup(vaddr_t pc) {
+  uint32_t i = (pc * 2654435761u) & (table_size - 1);
+  while (table[i].id != 0 && table[i].pc != pc) i = (i + 1) & (table_size - 1);
+  return &table[i];
+}
+
+static void grow(void) {
+  BlockSlot *old = table;
+  uint32_t old_size = table_size, i;
+  table_size = (table_size == 0 ? 4096 : table_size * 2);
+  table = calloc(table_size, sizeof(table[0]));
+  counts = realloc(counts, (table_size / 2 + 1) * sizeof(counts[0]));
+  touched = realloc(touched, (table_size / 2 + 1) * sizeof(touched[0]));
+  assert(table != NULL && counts != NULL && touched != NULL);
+  memset(counts + nr_block + 1, 0, (table_size / 2 - nr_block) * sizeof(counts[0]));
+  for (i = 0; i < old_size; i ++) {
+    if (old[i].id != 0) *lookup(old[i].pc) = old[i];
+  }
+  free(old);
+}
+
+void bbv_count(vaddr_t pc, uint64_t nr) {
+  if (2 * (nr_block + 1) > table_size) grow();
+  BlockSlot *s = lookup(pc);
+  if (s->id == 0) *s = (BlockSlot) { .pc = pc, .id = ++ nr_block };
+  if (counts[s->id] == 0) touched[nr_touched ++] = s->id;
+  counts[s->id] += nr;
+}
+
+static int cmp_id(const void *a, const void *b) {
+  uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+  return (x > y) - (x < y);
+}
+
+/* write the vector of the interval just finished */
+static void bbv_flush(void) {
+  if (bbv_block_len > 0) {
+    bbv_count(bbv_block_pc, bbv_block_len);
+    bbv_block_len = 0;
+  }
+  qsort(touched, nr_touched, sizeof(touched[0]), cmp_id);
+  fputc('T', bbv_fp);
+  uint32_t i;
+  for (i = 0; i < nr_touched; i ++) {
+    fprintf(bbv_fp, ":%u:%lu ", touched[i], counts[touched[i]]);
+    counts[touched[i]] = 0;
+  }
+  fputc('\n', bbv_fp);
+  nr_touched = 0;
+  nr_interval ++;
+}
+
+/* every `window' instructions */
+static void sample_tick(void) {
+  nr_tick ++;
+  if (nr_tick % (interval / window) == 0) {
+    if (bbv_fp != NULL) bbv_flush();
+    sample_detailed = true;
+  }
+  else sample_detailed = false;
+}
+
+static void sample_exit(void) {
+  if (bbv_fp == NULL) return;
+  if (nr_touched > 0) bbv_flush();
+  fclose(bbv_fp);
+  Log("%lu basic block vectors of %lu blocks are written", nr_interval, (uint64_t)nr_block);
+}
+
+void init_sample(const char *spec) {
+  if (spec == NULL) return;
+
+  char *s = strdup(spec), *item;
+  assert(s != NULL);
+  for (item = strtok(s, ","); item != NULL; item = strtok(NULL, ",")) {
+    char *val = strchr(item, '=');
+    Assert(val != NULL, "invalid sampling '%s'", item);
+    *val ++ = '\0';
+    if (strcmp(item, "interval") == 0) interval = strtoull(val, NULL, 10);
+    else if (strcmp(item, "window") == 0) window = strtoull(val, NULL, 10);
+    else if (strcmp(item, "bbv") == 0) {
+      bbv_fp = fopen(val, "w");
+      Assert(bbv_fp != NULL, "can not open '%s' for the basic block vectors", val);
+    }
+    else panic("unknown item '%s' of sampling", item);
+  }
+  free(s);
+
+  if (window == 0) window = interval;
+  Assert(interval > 0 && interval % window == 0,
+      "the interval of sampling should be a multiple of the window");
+#if defined(JIT_ENGINE) || defined(THREADED_ENGINE)
+  Assert(bbv_fp == NULL, "the basic block vectors are not collected with RTL_JIT or THREADED_DISPATCH");
+#endif
+
+  bbv_on = (bbv_fp != NULL);
+  add_instr_event("sample", window, sample_tick);
+  atexit(sample_exit);
+  Log("Sampled simulation: %lu of every %lu instructions are detailed", window, interval);
+}
@@ -0,0 +1,268 @@
+#include "nemu.h"
+#include "monitor/monitor.h"
+#include "monitor/snapshot.h"
+#include "monitor/diff-test.h"
+#include "monitor/reverse.h"
+#include "cpu/decode-cache.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+/* A snapshot file is
+ *   SnapshotHeader
+ *   the sections, each a SectionHeader followed by its data
+ *   the numbers of the pages of pmem which are not all zero
+ *   the data of these pages, from `page_offset'
+ * The pages are aligned in the file, so they are mapped copy-on-write
+ * into pmem when loading, and only read when the guest touches them.
+ * A snapshot is written to a temporary file and renamed, so a file still
+ * mapped by pmem is never overwritten. */
+
+#define SNAPSHOT_MAGIC "NEMUSNAP"
+#define SNAPSHOT_VERSION 1
+/* read the pages instead of mapping so many pieces of the file */
+#define MAX_MAP_RUN 4096
+
+typedef struct {
+  char magic[8];
+  char isa[16];
+  uint32_t version;
+  uint32_t pmem_size;
+  uint32_t sections_size;
+  uint32_t nr_page;
+  uint64_t page_offset;
+} SnapshotHeader;
+
+typedef struct {
+  char name[32];
+  uint32_t size;
+  uint32_t pad;
+} SectionHeader;
+
+struct Snapshot {
+  bool is_load;
+  bool dry;      // only check the sections
+  bool is_checkpoint;
+  bool ok;
+  uint8_t *buf;  // the sections
+  size_t len, cap;
+};
+
+#define ALIGN8(x) (((x) + 7) & ~(size_t)7)
+
+static SectionHeader *find_section(Snapshot *s, const char *name) {
+  size_t pos = 0;
+  while (pos + sizeof(SectionHeader) <= s->len) {
+    SectionHeader *h = (void *)(s->buf + pos);
+    if (strncmp(h->name, name, sizeof(h->name)) == 0) return h;
+    pos += sizeof(*h) + ALIGN8(h->size);
+  }
+  return NULL;
+}
+
+void snapshot_sync(Snapshot *s, const char *name, void *data, size_t size) {
+  assert(strlen(name) < sizeof(((SectionHeader *)0)->name));
+
+  if (!s->is_load) {
+    size_t need = s->len + sizeof(SectionHeader) + ALIGN8(size);
+    if (need > s->cap) {
+      s->cap = (need > 2 * s->cap ? need : 2 * s->cap);
+      s->buf = realloc(s->buf, s->cap);
+      assert(s->buf != NULL);
+    }
+    SectionHeader *h = (void *)(s->buf + s->len);
+    memset(h, 0, sizeof(*h) + ALIGN8(size));
+    strcpy(h->name, name);
+    h->size = size;
+    memcpy(h + 1, data, size);
+    s->len = need;
+    return;
+  }
+
+  SectionHeader *h = find_section(s, name);
+  if (h == NULL || h->size != size) {
+    if (s->ok) {
+      if (h == NULL) printf("The section '%s' is not in the snapshot\n", name);
+      else printf("The section '%s' has %u bytes instead of %zu\n", name, h->size, size);
+    }
+    s->ok = false;
+    return;
+  }
+  if (!s->dry) memcpy(data, h + 1, size);
+}
+
+bool snapshot_has(Snapshot *s, const char *name) {
+  return !s->is_load || find_section(s, name) != NULL;
+}
+
+bool snapshot_is_restoring(Snapshot *s) {
+  return s->is_load && !s->dry;
+}
+
+bool snapshot_is_checkpoint(Snapshot *s) {
+  return s->is_checkpoint;
+}
+
+static void machine_snapshot(Snapshot *s) {
+  snapshot_sync(s, "cpu", &cpu, sizeof(cpu));
+  snapshot_sync(s, "nemu_state", &nemu_state, sizeof(nemu_state));
+  snapshot_sync(s, "nr_guest_instr", &g_nr_guest_instr, sizeof(g_nr_guest_instr));
+  /* after the number of instructions, which the virtual time depends on */
+  device_snapshot(s);
+}
+
+Snapshot *snapshot_take(void) {
+  Snapshot *s = malloc(sizeof(*s));
+  assert(s != NULL);
+  *s = (Snapshot) { .is_load = false, .ok = true, .is_checkpoint = true };
+  machine_snapshot(s);
+  return s;
+}
+
+/* the sections are the same as when taking it, so they are all there */
+void snapshot_restore(Snapshot *s) {
+  assert(s->is_checkpoint);
+  s->is_load = true;
+  machine_snapshot(s);
+  assert(s->ok);
+  s->is_load = false;
+}
+
+void snapshot_free(Snapshot *s) {
+  free(s->buf);
+  free(s);
+}
+
+bool snapshot_save(const char *file) {
+  Snapshot s = { .is_load = false, .ok = true };
+  machine_snapshot(&s);
+
+  uint32_t nr = pmem_size / PAGE_SIZE, nr_page = 0, i;
+  uint32_t *pages = malloc(nr * sizeof(pages[0]));
+  assert(pages != NULL);
+  for (i = 0; i < nr; i ++) {
+    if (!pmem_page_is_zero(i)) pages[nr_page ++] = i;
+  }
+
+  SnapshotHeader h = { .magic = SNAPSHOT_MAGIC, .version = SNAPSHOT_VERSION,
+    .pmem_size = pmem_size, .sections_size = s.len, .nr_page = nr_page };
+  strncpy(h.isa, str(__ISA__), sizeof(h.isa) - 1);
+  uint64_t end = sizeof(h) + s.len + nr_page * sizeof(pages[0]);
+  h.page_offset = (end + PAGE_MASK) & ~(uint64_t)PAGE_MASK;
+
+  char *tmp = malloc(strlen(file) + sizeof(".tmp"));
+  assert(tmp != NULL);
+  sprintf(tmp, "%s.tmp", file);
+  FILE *fp = fopen(tmp, "wb");
+  bool ok = (fp != NULL);
+  if (ok) {
+    ok = fwrite(&h, sizeof(h), 1, fp) == 1 && fwrite(s.buf, s.len, 1, fp) == 1 &&
+      fwrite(pages, sizeof(pages[0]), nr_page, fp) == nr_page &&
+      fseek(fp, h.page_offset, SEEK_SET) == 0;
+    for (i = 0; ok && i < nr_page; i ++) {
+      ok = fwrite(pmem + pages[i] * PAGE_SIZE, PAGE_SIZE, 1, fp) == 1;
+    }
+    ok = (fclose(fp) == 0) && ok && rename(tmp, file) == 0;
+    if (!ok) remove(tmp);
+  }
+
+  if (ok) Log("The snapshot of %u non-zero pages is saved to %s", nr_page, file);
+  else printf("Can not write the snapshot to '%s'\n", file);
+
+  free(tmp);
+  free(pages);
+  free(s.buf);
+  return ok;
+}
+
+/* map the runs of consecutive pages */
+static void load_pages(int fd, const SnapshotHeader *h, const uint32_t *pages) {
+  uint32_t i, j, nr_run = 0;
+  for (i = 0; i < h->nr_page; i ++) {
+    if (i == 0 || pages[i] != pages[i - 1] + 1) nr_run ++;
+  }
+
+  pmem_reset();
+  for (i = 0; i < h->nr_page; i = j) {
+    for (j = i + 1; j < h->nr_page && pages[j] == pages[j - 1] + 1; j ++) ;
+    off_t offset = h->page_offset + (off_t)i * PAGE_SIZE;
+    if (nr_run <= MAX_MAP_RUN) {
+      pmem_map_file(pages[i], j - i, fd, offset);
+    }
+    else {
+      ssize_t ret = pread(fd, pmem + pages[i] * PAGE_SIZE, (size_t)(j - i) * PAGE_SIZE, offset);
+      Assert(ret == (ssize_t)(j - i) * PAGE_SIZE, "can not read the pages of the snapshot");
+    }
+  }
+}
+
+bool snapshot_load(const char *file) {
+  int fd = open(file, O_RDONLY);
+  if (fd < 0) {
+    printf("Can not open '%s'\n", file);
+    return false;
+  }
+
+  SnapshotHeader h;
+  Snapshot s = { .is_load = true, .dry = true, .ok = true };
+  uint32_t *pages = NULL;
+  bool ok = false;
+
+  if (pread(fd, &h, sizeof(h), 0) != sizeof(h) || memcmp(h.magic, SNAPSHOT_MAGIC, 8) != 0 ||
+      h.version != SNAPSHOT_VERSION) {
+    printf("'%s' is not a snapshot of this version of NEMU\n", file);
+    goto out;
+  }
+  if (strncmp(h.isa, str(__ISA__), sizeof(h.isa)) != 0 || h.pmem_size != pmem_size) {
+    printf("The snapshot is taken on %.16s with %u MB of memory\n", h.isa, h.pmem_size >> 20);
+    goto out;
+  }
+
+  s.len = h.sections_size;
+  s.buf = malloc(s.len);
+  pages = malloc(h.nr_page * sizeof(pages[0]) + 1);
+  assert(s.buf != NULL && pages != NULL);
+  size_t pages_size = h.nr_page * sizeof(pages[0]);
+  if (pread(fd, s.buf, s.len, sizeof(h)) != s.len ||
+      pread(fd, pages, pages_size, sizeof(h) + s.len) != pages_size) {
+    printf("The snapshot '%s' is truncated\n", file);
+    goto out;
+  }
+  uint32_t i;
+  for (i = 0; i < h.nr_page; i ++) {
+    if (pages[i] >= pmem_size / PAGE_SIZE || (i > 0 && pages[i] <= pages[i - 1])) break;
+  }
+  if (i < h.nr_page) {
+    printf("The snapshot '%s' is corrupted\n", file);
+    goto out;
+  }
+
+  /* check everything before changing the machine */
+  machine_snapshot(&s);
+  if (!s.ok) goto out;
+
+  load_pages(fd, &h, pages);
+  s.dry = false;
+  machine_snapshot(&s);
+
+  /* everything cached from the old pmem and translation is stale */
+  dcache_flush();
+  ifetch_flush();
+  isa_mmu_flush();
+  pmem_dirty_range(0, pmem_size);
+#ifdef DIFF_TEST
+  difftest_reset_ref();
+#endif
+  /* the recording does not lead here */
+  rev_reset();
+
+  Log("The snapshot of %u non-zero pages is loaded from %s, pc = 0x%08x", h.nr_page, file, cpu.pc);
+  ok = true;
+
+out:
+  close(fd);
+  free(pages);
+  free(s.buf);
+  return ok;
+}
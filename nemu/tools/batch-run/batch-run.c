@@ -0,0 +1,319 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <libgen.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+/* Run many images on NEMU at once in batch mode, and report the results:
+ *
+ *   batch-run [-j JOBS] [-t SECONDS] [-l LOGDIR] [-a NEMU_ARGS]
+ *             [-o JSON] [-x JUNIT_XML] NEMU IMG...
+ *
+ * -j  the number of NEMU processes running at the same time, the number
+ *     of the host cores by default
+ * -t  kill a run after this many seconds, 0 (by default) for never
+ * -l  where the outputs and the logs of the runs are kept, the output of a
+ *     run which passes is removed
+ * -a  more arguments of NEMU, separated by spaces, e.g. "-d REF_SO"
+ *
+ * A run passes if NEMU hits the good trap. The number of instructions is
+ * read from the performance counters NEMU writes with '-j'. The exit
+ * status is 0 if every run passes. */
+
+typedef enum { R_PASS, R_BAD_TRAP, R_ABORT, R_TIMEOUT, R_CRASH } Result;
+
+static const char *result_name[] = {
+  [R_PASS] = "pass", [R_BAD_TRAP] = "bad trap", [R_ABORT] = "abort",
+  [R_TIMEOUT] = "timeout", [R_CRASH] = "crash",
+};
+
+typedef struct {
+  const char *img;
+  char name[256];
+  pid_t pid;
+  double start, seconds;
+  Result result;
+  uint64_t nr_instr;
+} Run;
+
+static Run *runs = NULL;
+static int nr_run = 0;
+static const char *nemu = NULL, *log_dir = "build/batch";
+static char *nemu_args[64];
+static int nr_nemu_arg = 0;
+static int timeout = 0;
+
+static double now(void) {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+static void log_path(char *buf, size_t size, const Run *r, const char *suffix) {
+  snprintf(buf, size, "%s/%s%s", log_dir, r->name, suffix);
+}
+
+/* the image name without the directory and `.bin' */
+static void set_name(Run *r) {
+  char *dup = strdup(r->img);
+  assert(dup != NULL);
+  snprintf(r->name, sizeof(r->name), "%s", basename(dup));
+  free(dup);
+  size_t len = strlen(r->name);
+  if (len > 4 && strcmp(r->name + len - 4, ".bin") == 0) r->name[len - 4] = '\0';
+}
+
+static void start_run(Run *r) {
+  char out[512], log[512], perf[512];
+  log_path(out, sizeof(out), r, "-out.txt");
+  log_path(log, sizeof(log), r, "-log.txt");
+  log_path(perf, sizeof(perf), r, ".json");
+
+  fflush(stdout);
+  r->start = now();
+  r->pid = fork();
+  assert(r->pid >= 0);
+  if (r->pid != 0) return;
+
+  int fd = open(out, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) {
+    perror(out);
+    exit(127);
+  }
+  dup2(fd, 1);
+  dup2(fd, 2);
+  close(fd);
+  fd = open("/dev/null", O_RDONLY);
+  if (fd >= 0) dup2(fd, 0);
+
+  char *argv[sizeof(nemu_args) / sizeof(nemu_args[0]) + 16];
+  int argc = 0, i;
+  argv[argc ++] = (char *)nemu;
+  argv[argc ++] = "-b";
+  argv[argc ++] = "-l";
+  argv[argc ++] = log;
+  argv[argc ++] = "-j";
+  argv[argc ++] = perf;
+  for (i = 0; i < nr_nemu_arg; i ++) argv[argc ++] = nemu_args[i];
+  argv[argc ++] = (char *)r->img;
+  argv[argc] = NULL;
+
+  /* the pending alarm is kept by execv() */
+  if (timeout > 0) alarm(timeout);
+  execv(nemu, argv);
+  perror(nemu);
+  exit(127);
+}
+
+/* read the whole file, NULL if it can not be read */
+static char *read_file(const char *path) {
+  FILE *fp = fopen(path, "r");
+  if (fp == NULL) return NULL;
+  size_t len = 0, cap = 4096;
+  char *buf = malloc(cap);
+  assert(buf != NULL);
+  size_t n;
+  while ((n = fread(buf + len, 1, cap - len - 1, fp)) > 0) {
+    len += n;
+    if (len + 1 == cap) {
+      cap *= 2;
+      buf = realloc(buf, cap);
+      assert(buf != NULL);
+    }
+  }
+  buf[len] = '\0';
+  fclose(fp);
+  return buf;
+}
+
+static void finish_run(Run *r, int status) {
+  r->seconds = now() - r->start;
+  char out[512], perf[512];
+  log_path(out, sizeof(out), r, "-out.txt");
+  log_path(perf, sizeof(perf), r, ".json");
+
+  char *text = read_file(out);
+  if (WIFSIGNALED(status) && WTERMSIG(status) == SIGALRM) r->result = R_TIMEOUT;
+  else if (text != NULL && strstr(text, "HIT GOOD TRAP") != NULL) r->result = R_PASS;
+  else if (text != NULL && strstr(text, "HIT BAD TRAP") != NULL) r->result = R_BAD_TRAP;
+  else if (text != NULL && strstr(text, "ABORT") != NULL) r->result = R_ABORT;
+  else r->result = R_CRASH;
+  free(text);
+
+  /* "instructions" of "cpu", the first one in the file */
+  r->nr_instr = 0;
+  char *json = read_file(perf);
+  char *p = (json == NULL ? NULL : strstr(json, "\"instructions\":"));
+  if (p != NULL) r->nr_instr = strtoull(p + strlen("\"instructions\":"), NULL, 10);
+  free(json);
+
+  if (r->result == R_PASS) remove(out);
+  printf("[%20s] %s%s\33[0m %.2fs\n", r->name,
+      (r->result == R_PASS ? "\33[1;32m" : "\33[1;31m"), result_name[r->result], r->seconds);
+}
+
+static void run_all(int nr_job) {
+  int next = 0, nr_running = 0;
+  while (next < nr_run || nr_running > 0) {
+    for (; next < nr_run && nr_running < nr_job; next ++, nr_running ++) start_run(&runs[next]);
+
+    int status;
+    pid_t pid = waitpid(-1, &status, 0);
+    if (pid < 0) {
+      if (errno == EINTR) continue;
+      perror("waitpid");
+      exit(1);
+    }
+    int i;
+    for (i = 0; i < nr_run; i ++) {
+      if (runs[i].pid == pid) {
+        finish_run(&runs[i], status);
+        nr_running --;
+        break;
+      }
+    }
+  }
+}
+
+static void put_json_str(FILE *fp, const char *s) {
+  fputc('"', fp);
+  for (; *s != '\0'; s ++) {
+    if (*s == '"' || *s == '\\') fprintf(fp, "\\%c", *s);
+    else if ((unsigned char)*s < 0x20) fprintf(fp, "\\u%04x", *s);
+    else fputc(*s, fp);
+  }
+  fputc('"', fp);
+}
+
+static void write_json(const char *file, double seconds) {
+  FILE *fp = fopen(file, "w");
+  if (fp == NULL) {
+    perror(file);
+    return;
+  }
+  fprintf(fp, "{\n  \"seconds\": %.3f,\n  \"runs\": [", seconds);
+  int i;
+  for (i = 0; i < nr_run; i ++) {
+    Run *r = &runs[i];
+    fprintf(fp, "%s\n    { \"name\": ", (i == 0 ? "" : ","));
+    put_json_str(fp, r->name);
+    fprintf(fp, ", \"image\": ");
+    put_json_str(fp, r->img);
+    fprintf(fp, ", \"result\": \"%s\", \"instructions\": %lu, \"seconds\": %.3f }",
+        result_name[r->result], r->nr_instr, r->seconds);
+  }
+  fprintf(fp, "\n  ]\n}\n");
+  fclose(fp);
+}
+
+static void put_xml_str(FILE *fp, const char *s) {
+  for (; *s != '\0'; s ++) {
+    switch (*s) {
+      case '<': fputs("&lt;", fp); break;
+      case '>': fputs("&gt;", fp); break;
+      case '&': fputs("&amp;", fp); break;
+      case '"': fputs("&quot;", fp); break;
+      default: fputc(*s, fp);
+    }
+  }
+}
+
+static void write_junit(const char *file, int nr_fail, double seconds) {
+  FILE *fp = fopen(file, "w");
+  if (fp == NULL) {
+    perror(file);
+    return;
+  }
+  fprintf(fp, "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n");
+  fprintf(fp, "<testsuite name=\"nemu\" tests=\"%d\" failures=\"%d\" time=\"%.3f\">\n",
+      nr_run, nr_fail, seconds);
+  int i;
+  for (i = 0; i < nr_run; i ++) {
+    Run *r = &runs[i];
+    fprintf(fp, "  <testcase name=\"");
+    put_xml_str(fp, r->name);
+    fprintf(fp, "\" classname=\"nemu\" time=\"%.3f\"", r->seconds);
+    if (r->result == R_PASS) {
+      fprintf(fp, "/>\n");
+      continue;
+    }
+    fprintf(fp, ">\n    <failure message=\"%s\">see %s/", result_name[r->result], log_dir);
+    put_xml_str(fp, r->name);
+    fprintf(fp, "-out.txt</failure>\n  </testcase>\n");
+  }
+  fprintf(fp, "</testsuite>\n");
+  fclose(fp);
+}
+
+static void split_args(char *s) {
+  char *arg;
+  for (arg = strtok(s, " "); arg != NULL; arg = strtok(NULL, " ")) {
+    assert(nr_nemu_arg < sizeof(nemu_args) / sizeof(nemu_args[0]));
+    nemu_args[nr_nemu_arg ++] = arg;
+  }
+}
+
+int main(int argc, char *argv[]) {
+  int nr_job = sysconf(_SC_NPROCESSORS_ONLN);
+  const char *json_file = NULL, *junit_file = NULL;
+  int o;
+  while ((o = getopt(argc, argv, "j:t:l:a:o:x:")) != -1) {
+    switch (o) {
+      case 'j': nr_job = atoi(optarg); break;
+      case 't': timeout = atoi(optarg); break;
+      case 'l': log_dir = optarg; break;
+      case 'a': split_args(optarg); break;
+      case 'o': json_file = optarg; break;
+      case 'x': junit_file = optarg; break;
+      default: goto usage;
+    }
+  }
+  if (optind + 1 >= argc || nr_job <= 0) goto usage;
+
+  nemu = argv[optind ++];
+  nr_run = argc - optind;
+  runs = calloc(nr_run, sizeof(runs[0]));
+  assert(runs != NULL);
+  int i;
+  for (i = 0; i < nr_run; i ++) {
+    runs[i].img = argv[optind + i];
+    set_name(&runs[i]);
+  }
+  if (mkdir(log_dir, 0755) != 0 && errno != EEXIST) {
+    perror(log_dir);
+    return 1;
+  }
+
+  double start = now();
+  run_all(nr_job);
+  double seconds = now() - start;
+
+  int nr_fail = 0;
+  uint64_t nr_instr = 0;
+  for (i = 0; i < nr_run; i ++) {
+    if (runs[i].result != R_PASS) nr_fail ++;
+    nr_instr += runs[i].nr_instr;
+  }
+  printf("%d passed, %d failed, %lu instructions in %.2fs with %d jobs\n",
+      nr_run - nr_fail, nr_fail, nr_instr, seconds, nr_job);
+  if (nr_fail > 0) printf("see the outputs of the failed runs in %s\n", log_dir);
+
+  if (json_file != NULL) write_json(json_file, seconds);
+  if (junit_file != NULL) write_junit(junit_file, nr_fail, seconds);
+  return (nr_fail == 0 ? 0 : 1);
+
+usage:
+  fprintf(stderr, "usage: %s [-j JOBS] [-t SECONDS] [-l LOGDIR] [-a NEMU_ARGS] "
+      "[-o JSON] [-x JUNIT_XML] NEMU IMG...\n", argv[0]);
+  return 1;
+}
@@ -1,54 +1,251 @@
 #include <stdint.h>
+#include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <time.h>
 #include <assert.h>
 #include <string.h>
+#include <getopt.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+/* Generate random expressions for expr() of NEMU, each printed as
+ *   RESULT EXPRESSION
+ * where RESULT is computed by gcc. The expressions are generated in
+ * batches, and each batch is put into one C program printing all the
+ * results, so gcc is only called once for a batch. The batches can be
+ * generated by several worker processes.
+ *
+ * An expression is generated top-down with the operators of C, and an
+ * operand is put in parentheses when it is looser than the operator, so
+ * the text is parsed back into the same tree. The value of each operand
+ * is also computed, only to avoid dividing by zero, which would crash the
+ * whole batch. The numbers are unsigned in C, the same as in NEMU, and so
+ * are the results of the comparisons, which are int in C. */
+
+#define MAX_DEPTH 8
+#define MAX_BATCH 100000
 
 // this should be enough
 static char buf[65536];
-static inline void gen_rand_expr() {
-  buf[0] = '\0';
+static char cbuf[65536];
+static int len, clen;
+
+/* the precedences of C, a smaller one binds tighter */
+enum { PREC_PRIMARY = 0, PREC_UNARY = 2, PREC_MUL = 3, PREC_ADD = 4, PREC_EQ = 7, PREC_AND = 11, PREC_OR = 12 };
+
+static const struct {
+  const char *str;
+  int prec;
+} ops[] = {
+  { "+", PREC_ADD }, { "-", PREC_ADD }, { "*", PREC_MUL }, { "/", PREC_MUL },
+  { "==", PREC_EQ }, { "!=", PREC_EQ }, { "&&", PREC_AND }, { "||", PREC_OR },
+};
+
+#define NR_OP (sizeof(ops) / sizeof(ops[0]))
+
+static inline uint32_t choose(uint32_t n) {
+  return rand() % n;
 }
 
-static char code_buf[65536];
-static char *code_format =
-"#include <stdio.h>\n"
-"int main() { "
-"  unsigned result = %s; "
-"  printf(\"%%u\", result); "
-"  return 0; "
-"}";
+/* append to both the expression and the C code */
+static void gen(const char *s) {
+  len += sprintf(buf + len, "%s", s);
+  clen += sprintf(cbuf + clen, "%s", s);
+}
 
-int main(int argc, char *argv[]) {
-  int seed = time(0);
-  srand(seed);
-  int loop = 1;
-  if (argc > 1) {
-    sscanf(argv[1], "%d", &loop);
+static void gen_space() {
+  int n = choose(4);
+  for (; n > 1; n --) buf[len ++] = ' ';
+  buf[len] = '\0';
+}
+
+static uint32_t gen_num() {
+  uint32_t val;
+  switch (choose(8)) {
+    case 0: val = ((uint32_t)rand() << 16) ^ rand(); break;
+    case 1: val = rand(); break;
+    default: val = choose(100); break;
   }
-  int i;
-  for (i = 0; i < loop; i ++) {
-    gen_rand_expr();
+  if (choose(4) == 0) {
+    len += sprintf(buf + len, "0x%x", val);
+    clen += sprintf(cbuf + clen, "0x%xu", val);
+  }
+  else {
+    /* expr() of NEMU reads a decimal number as an int */
+    val &= 0x7fffffff;
+    len += sprintf(buf + len, "%u", val);
+    clen += sprintf(cbuf + clen, "%uu", val);
+  }
+  return val;
+}
+
+/* Generate an expression with a precedence not looser than `limit',
+ * return its value. */
+static uint32_t gen_rand_expr(int depth, int limit) {
+  gen_space();
+  int form = (depth >= MAX_DEPTH ? 0 : choose(8));
+  if (form == 0 || form == 1) return gen_num();
+
+  if (form == 2 || limit < PREC_UNARY) {
+    gen("(");
+    uint32_t val = gen_rand_expr(depth + 1, PREC_OR);
+    gen_space();
+    gen(")");
+    return val;
+  }
+
+  if (form == 3) {
+    /* expr() can not take an unary operator after another */
+    gen("- ");
+    return -gen_rand_expr(depth + 1, PREC_PRIMARY);
+  }
+
+  int op = choose(NR_OP);
+  bool paren = (ops[op].prec > limit);
+  bool is_int = (ops[op].prec >= PREC_EQ);
+  if (paren) gen("(");
+  if (is_int) clen += sprintf(cbuf + clen, "(unsigned)(");
+
+  uint32_t a = gen_rand_expr(depth + 1, ops[op].prec);
+  gen_space();
+  gen(" ");
+  gen(ops[op].str);
+  gen(" ");
+  int pos = len, cpos = clen;
+  uint32_t b = gen_rand_expr(depth + 1, ops[op].prec - 1);
+  while (ops[op].str[0] == '/' && b == 0) {
+    len = pos;
+    clen = cpos;
+    b = gen_rand_expr(depth + 1, ops[op].prec - 1);
+  }
+
+  if (is_int) clen += sprintf(cbuf + clen, ")");
+  if (paren) gen(")");
 
-    sprintf(code_buf, code_format, buf);
+  switch (ops[op].str[0]) {
+    case '+': return a + b;
+    case '-': return a - b;
+    case '*': return a * b;
+    case '/': return a / b;
+    case '=': return a == b;
+    case '!': return a != b;
+    case '&': return a && b;
+    case '|': return a || b;
+    default: assert(0);
+  }
+}
 
-    FILE *fp = fopen("/tmp/.code.c", "w");
-    assert(fp != NULL);
-    fputs(code_buf, fp);
-    fclose(fp);
+static char *exprs[MAX_BATCH];
 
-    int ret = system("gcc /tmp/.code.c -o /tmp/.expr");
-    if (ret != 0) continue;
+/* Generate `n' expressions, and write them with their results to `out'.
+ * The files of the C program are in `dir'. */
+static void gen_batch(int n, const char *dir, FILE *out) {
+  char src[256], bin[256], cmd[600];
+  snprintf(src, sizeof(src), "%s/code.c", dir);
+  snprintf(bin, sizeof(bin), "%s/expr", dir);
 
-    fp = popen("/tmp/.expr", "r");
-    assert(fp != NULL);
+  FILE *fp = fopen(src, "w");
+  assert(fp != NULL);
+  fputs("#include <stdio.h>\nint main() {\n", fp);
+  int i;
+  for (i = 0; i < n; i ++) {
+    len = clen = 0;
+    gen_rand_expr(0, PREC_OR);
+    exprs[i] = strdup(buf);
+    assert(exprs[i] != NULL);
+    fprintf(fp, "  printf(\"%%u\\n\", (unsigned)(%s));\n", cbuf);
+  }
+  fputs("  return 0;\n}\n", fp);
+  fclose(fp);
 
-    int result;
-    fscanf(fp, "%d", &result);
+  snprintf(cmd, sizeof(cmd), "gcc -O0 -w %s -o %s", src, bin);
+  if (system(cmd) == 0 && (fp = popen(bin, "r")) != NULL) {
+    for (i = 0; i < n; i ++) {
+      unsigned result;
+      if (fscanf(fp, "%u", &result) != 1) break;
+      fprintf(out, "%u %s\n", result, exprs[i]);
+    }
     pclose(fp);
+  }
+  else {
+    fprintf(stderr, "gen-expr: can not compile %s\n", src);
+  }
 
-    printf("%u %s\n", result, buf);
+  for (i = 0; i < n; i ++) free(exprs[i]);
+}
+
+/* Generate `n' expressions in batches of `batch' into `out'. */
+static void gen_all(int n, int batch, FILE *out) {
+  char dir[] = "/tmp/gen-expr-XXXXXX";
+  if (mkdtemp(dir) == NULL) {
+    perror("gen-expr: mkdtemp");
+    exit(1);
+  }
+  for (; n > 0; n -= batch) {
+    gen_batch(n < batch ? n : batch, dir, out);
+  }
+  char cmd[64];
+  snprintf(cmd, sizeof(cmd), "rm -rf %s", dir);
+  if (system(cmd) != 0) fprintf(stderr, "gen-expr: can not remove %s\n", dir);
+}
+
+/* Each worker writes its share into a temporary file, which are output
+ * in order when all the workers finish. */
+static void run_workers(int n, int batch, int nr_job, int seed) {
+  FILE *outs[nr_job];
+  pid_t pids[nr_job];
+  int i;
+  for (i = 0; i < nr_job; i ++) {
+    outs[i] = tmpfile();
+    assert(outs[i] != NULL);
+    int share = n / nr_job + (i < n % nr_job);
+    fflush(stdout);
+    pids[i] = fork();
+    assert(pids[i] >= 0);
+    if (pids[i] == 0) {
+      srand(seed + i);
+      gen_all(share, batch, outs[i]);
+      fclose(outs[i]);
+      exit(0);
+    }
+  }
+
+  for (i = 0; i < nr_job; i ++) {
+    waitpid(pids[i], NULL, 0);
+    rewind(outs[i]);
+    char line[sizeof(buf) + 16];
+    while (fgets(line, sizeof(line), outs[i]) != NULL) fputs(line, stdout);
+    fclose(outs[i]);
+  }
+}
+
+int main(int argc, char *argv[]) {
+  int seed = time(0);
+  int batch = 1000, nr_job = 1;
+  int o;
+  while ((o = getopt(argc, argv, "b:j:s:")) != -1) {
+    switch (o) {
+      case 'b': batch = atoi(optarg); break;
+      case 'j': nr_job = atoi(optarg); break;
+      case 's': seed = atoi(optarg); break;
+      default:
+        fprintf(stderr, "usage: %s [-b BATCH] [-j JOBS] [-s SEED] [N]\n", argv[0]);
+        return 1;
+    }
+  }
+  int loop = 1;
+  if (optind < argc) {
+    sscanf(argv[optind], "%d", &loop);
+  }
+  assert(batch > 0 && batch <= MAX_BATCH && nr_job > 0);
+
+  if (nr_job == 1) {
+    srand(seed);
+    gen_all(loop, batch, stdout);
+  }
+  else {
+    run_workers(loop, batch, nr_job, seed);
   }
   return 0;
 }
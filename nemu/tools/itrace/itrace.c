@@ -0,0 +1,246 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <zlib.h>
+
+/* Print the binary instruction trace written by NEMU with '-i FILE' in
+ * the format of the text log:
+ *
+ *   itrace [-s START] [-c COUNT] [-n N] [-d OBJDUMP -m ARCH] FILE
+ *
+ * -s -c  only read COUNT instructions from the START-th one (from 0). The
+ *        frame with it is found by FILE.idx, so the frames before it are
+ *        not decompressed.
+ * -n N   only print the last N instructions
+ * -d -m  disassemble the instructions by `OBJDUMP -D -b binary -m ARCH',
+ *        e.g. -d riscv64-linux-gnu-objdump -m riscv:rv32. Every distinct
+ *        instruction is disassembled once. */
+
+/* the same as ITraceRecord in nemu/src/monitor/debug/itrace.c */
+#define ITRACE_BYTES 15
+
+typedef struct {
+  uint32_t pc;
+  uint8_t len;
+  uint8_t bytes[ITRACE_BYTES];
+} Record;
+
+/* the distinct instructions, at `offset' of the file given to objdump */
+typedef struct {
+  uint8_t len;
+  uint8_t bytes[ITRACE_BYTES];
+  uint32_t offset;
+  char *text;
+} Instr;
+
+static Instr *instrs = NULL;
+static int nr_instr = 0, max_instr = 0;
+static uint32_t blob_size = 0;
+/* open addressing, the entries are indices of `instrs' plus one */
+static int *table = NULL;
+static uint32_t table_size = 0;
+
+static uint32_t hash(const Record *r) {
+  uint32_t h = 2166136261u ^ r->len;
+  int i;
+  for (i = 0; i < r->len; i ++) h = (h ^ r->bytes[i]) * 16777619u;
+  return h;
+}
+
+static int *lookup(const Record *r) {
+  uint32_t i = hash(r) & (table_size - 1);
+  while (table[i] != 0) {
+    Instr *in = &instrs[table[i] - 1];
+    if (in->len == r->len && memcmp(in->bytes, r->bytes, r->len) == 0) break;
+    i = (i + 1) & (table_size - 1);
+  }
+  return &table[i];
+}
+
+static void grow_table(void) {
+  free(table);
+  table_size = (table_size == 0 ? 1024 : table_size * 2);
+  table = calloc(table_size, sizeof(table[0]));
+  int i;
+  for (i = 0; i < nr_instr; i ++) {
+    Record r = { .len = instrs[i].len };
+    memcpy(r.bytes, instrs[i].bytes, r.len);
+    *lookup(&r) = i + 1;
+  }
+}
+
+static Instr *find_instr(const Record *r, int add) {
+  if (table_size == 0) grow_table();
+  int *e = lookup(r);
+  if (*e != 0) return &instrs[*e - 1];
+  if (!add) return NULL;
+
+  if (nr_instr == max_instr) {
+    max_instr = (max_instr == 0 ? 1024 : max_instr * 2);
+    instrs = realloc(instrs, max_instr * sizeof(instrs[0]));
+  }
+  Instr *in = &instrs[nr_instr ++];
+  in->len = r->len;
+  memcpy(in->bytes, r->bytes, r->len);
+  in->offset = blob_size;
+  in->text = NULL;
+  blob_size += r->len;
+  *e = nr_instr;
+  if (nr_instr * 2 > table_size) grow_table();
+  return in;
+}
+
+static Instr *instr_at(uint32_t offset) {
+  int lo = 0, hi = nr_instr - 1;
+  while (lo <= hi) {
+    int mid = (lo + hi) / 2;
+    if (instrs[mid].offset == offset) return &instrs[mid];
+    if (instrs[mid].offset < offset) lo = mid + 1;
+    else hi = mid - 1;
+  }
+  return NULL;
+}
+
+/* write the distinct instructions into a file and disassemble it */
+static void disassemble(const char *objdump, const char *arch) {
+  char path[] = "/tmp/itrace-XXXXXX";
+  int fd = mkstemp(path);
+  if (fd < 0) { perror("mkstemp"); exit(1); }
+  FILE *fp = fdopen(fd, "w");
+  int i;
+  for (i = 0; i < nr_instr; i ++) fwrite(instrs[i].bytes, instrs[i].len, 1, fp);
+  fclose(fp);
+
+  char cmd[1024];
+  snprintf(cmd, sizeof(cmd), "%s -D -b binary -m %s %s", objdump, arch, path);
+  fp = popen(cmd, "r");
+  if (fp == NULL) { perror("popen"); exit(1); }
+
+  // the lines are "offset:\tbytes\tinstruction", or without the instruction
+  // if the bytes take more than one line
+  char line[1024];
+  while (fgets(line, sizeof(line), fp) != NULL) {
+    unsigned offset;
+    char *tab1 = strchr(line, '\t');
+    char *tab2 = (tab1 != NULL ? strchr(tab1 + 1, '\t') : NULL);
+    if (tab2 == NULL || sscanf(line, " %x:", &offset) != 1) continue;
+    Instr *in = instr_at(offset);
+    if (in == NULL) continue;
+    char *text = tab2 + 1, *p;
+    text[strcspn(text, "\n")] = '\0';
+    for (p = text; *p != '\0'; p ++) if (*p == '\t') *p = ' ';
+    in->text = strdup(text);
+  }
+  pclose(fp);
+  unlink(path);
+}
+
+/* the instructions left to read, all of them if < 0 */
+static long count = -1, count_left = -1;
+
+static int next_record(gzFile fp, Record *r) {
+  if (count_left == 0) return 0;
+  if (gzread(fp, r, sizeof(*r)) != sizeof(*r)) return 0;
+  if (count_left > 0) count_left --;
+  return 1;
+}
+
+static void rewind_records(gzFile fp, long skip) {
+  gzrewind(fp);
+  gzseek(fp, skip * sizeof(Record), SEEK_CUR);
+  count_left = count;
+}
+
+/* Open FILE at the START-th instruction. The frames of FILE start at the
+ * offsets in FILE.idx, which are pairs of the number of the first
+ * instruction of a frame and its offset. Return the instructions to skip
+ * in the frame found. */
+static gzFile open_at(const char *file, long start, long *skip) {
+  uint64_t frame_start = 0, frame_off = 0;
+  char idx_file[strlen(file) + 5];
+  sprintf(idx_file, "%s.idx", file);
+  FILE *idx = fopen(idx_file, "rb");
+  if (idx != NULL) {
+    uint64_t e[2];
+    while (fread(e, sizeof(e), 1, idx) == 1 && e[0] <= start) {
+      frame_start = e[0];
+      frame_off = e[1];
+    }
+    fclose(idx);
+  }
+  else if (start > 0) fprintf(stderr, "%s: no index, decompressing from the beginning\n", idx_file);
+
+  int fd = open(file, O_RDONLY);
+  if (fd < 0 || lseek(fd, frame_off, SEEK_SET) < 0) return NULL;
+  *skip = start - frame_start;
+  return gzdopen(fd, "rb");
+}
+
+static void print_record(const Record *r) {
+  char bytebuf[3 * ITRACE_BYTES + 1] = {};
+  int i;
+  for (i = 0; i < r->len; i ++) sprintf(bytebuf + 3 * i, "%02x ", r->bytes[i]);
+  Instr *in = (instrs != NULL ? find_instr(r, 0) : NULL);
+  const char *text = (in != NULL && in->text != NULL ? in->text : "");
+  printf("%8x:   %s%*.s%s\n", r->pc, bytebuf, 50 - (12 + 3 * r->len), "", text);
+}
+
+int main(int argc, char *argv[]) {
+  long last = -1, start = 0;
+  char *objdump = NULL, *arch = NULL;
+  int o;
+  while ((o = getopt(argc, argv, "s:c:n:d:m:")) != -1) {
+    switch (o) {
+      case 's': start = atol(optarg); break;
+      case 'c': count = atol(optarg); break;
+      case 'n': last = atol(optarg); break;
+      case 'd': objdump = optarg; break;
+      case 'm': arch = optarg; break;
+      default: goto usage;
+    }
+  }
+  if (optind != argc - 1 || (objdump == NULL) != (arch == NULL) || last == 0 || start < 0) goto usage;
+
+  long skip;
+  gzFile fp = open_at(argv[optind], start, &skip);
+  if (fp == NULL) { perror(argv[optind]); return 1; }
+  rewind_records(fp, skip);
+
+  // the records to print, all of them if `last' < 0
+  Record *ring = NULL;
+  long nr = 0;
+  Record r;
+  if (last > 0) {
+    ring = malloc(last * sizeof(ring[0]));
+    while (next_record(fp, &r)) ring[nr ++ % last] = r;
+  }
+
+  if (objdump != NULL) {
+    if (ring != NULL) {
+      long i;
+      for (i = 0; i < nr && i < last; i ++) find_instr(&ring[i], 1);
+    }
+    else {
+      while (next_record(fp, &r)) find_instr(&r, 1);
+      rewind_records(fp, skip);
+    }
+    disassemble(objdump, arch);
+  }
+
+  if (ring != NULL) {
+    long i;
+    for (i = (nr > last ? nr - last : 0); i < nr; i ++) print_record(&ring[i % last]);
+  }
+  else {
+    while (next_record(fp, &r)) print_record(&r);
+  }
+  gzclose(fp);
+  return 0;
+
+usage:
+  fprintf(stderr, "Usage: %s [-s START] [-c COUNT] [-n N] [-d OBJDUMP -m ARCH] FILE\n", argv[0]);
+  return 1;
+}
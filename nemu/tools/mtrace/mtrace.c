@@ -0,0 +1,61 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/* Print the memory access trace written by NEMU with '-M FILE':
+ *
+ *   mtrace [-p PC] [-w] FILE
+ *
+ * -p PC  only print the accesses by the instruction at PC (hex)
+ * -w     only print the stores
+ *
+ * Each line is the pc, the virtual and the physical address, R or W with
+ * the number of bytes, and the data. */
+
+/* the same as MTraceRecord in nemu/src/memory/mtrace.c */
+typedef struct {
+  uint32_t pc, vaddr, paddr, data;
+  uint8_t len, is_write;
+  uint16_t pad;
+} Record;
+
+#define NR_BUF 4096
+
+int main(int argc, char *argv[]) {
+  int has_pc = 0, only_write = 0, o;
+  uint32_t pc = 0;
+  while ((o = getopt(argc, argv, "p:w")) != -1) {
+    switch (o) {
+      case 'p': has_pc = 1; pc = strtoul(optarg, NULL, 16); break;
+      case 'w': only_write = 1; break;
+      default:
+        fprintf(stderr, "Usage: %s [-p PC] [-w] FILE\n", argv[0]);
+        return 1;
+    }
+  }
+  if (optind >= argc) {
+    fprintf(stderr, "Usage: %s [-p PC] [-w] FILE\n", argv[0]);
+    return 1;
+  }
+
+  FILE *fp = fopen(argv[optind], "rb");
+  if (fp == NULL) {
+    perror(argv[optind]);
+    return 1;
+  }
+
+  static Record buf[NR_BUF];
+  size_t n, i;
+  while ((n = fread(buf, sizeof(buf[0]), NR_BUF, fp)) > 0) {
+    for (i = 0; i < n; i ++) {
+      Record *r = &buf[i];
+      if ((has_pc && r->pc != pc) || (only_write && !r->is_write)) continue;
+      printf("0x%08x: 0x%08x 0x%08x %c%d 0x%0*x\n", r->pc, r->vaddr, r->paddr,
+          (r->is_write ? 'W' : 'R'), r->len, r->len * 2, r->data);
+    }
+  }
+  fclose(fp);
+  return 0;
+}
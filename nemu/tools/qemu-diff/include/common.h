@@ -14,6 +14,9 @@ typedef uint8_t bool;
 
 typedef uint32_t paddr_t;
 
+#define _str(x) # x
+#define str(x) _str(x)
+
 #include "protocol.h"
 
 #endif
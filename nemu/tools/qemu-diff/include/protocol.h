@@ -35,4 +35,12 @@ void gdb_send(struct gdb_conn *conn, const uint8_t *command, size_t size);
 
 uint8_t *gdb_recv(struct gdb_conn *conn, size_t *size);
 
+int gdb_can_queue(struct gdb_conn *conn);
+
+void gdb_queue(struct gdb_conn *conn, const uint8_t *command, size_t size);
+
+void gdb_flush(struct gdb_conn *conn);
+
+size_t gdb_escape_binary(uint8_t *out, const uint8_t *data, size_t size);
+
 const char * gdb_start_noack(struct gdb_conn *conn);
@@ -0,0 +1,25 @@
+#ifndef __STREAM_H__
+#define __STREAM_H__
+
+#include <stdint.h>
+
+/* The ring in shared memory from the TCG plugin of QEMU to the REF in
+ * NEMU. Each record is the state after an instruction: the first `nr_reg'
+ * registers in the order of GDB, 32 bits each. The plugin writes at
+ * `head' and waits while the ring is full, and the REF reads at `tail'.
+ * Both are only increased, and accessed with the atomic builtins. */
+
+#define STREAM_NR_REC (1 << 16)
+#define STREAM_MAX_REG 64
+
+typedef struct {
+  uint64_t head, tail;
+  uint32_t nr_reg;
+  uint32_t reg[STREAM_NR_REC * STREAM_MAX_REG];
+} StreamRing;
+
+static inline uint32_t *stream_rec(StreamRing *ring, uint64_t i) {
+  return &ring->reg[(i % STREAM_NR_REC) * ring->nr_reg];
+}
+
+#endif
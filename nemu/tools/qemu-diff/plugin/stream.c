@@ -0,0 +1,101 @@
+#include <qemu-plugin.h>
+#include <glib.h>
+#include <assert.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include "stream.h"
+
+/* The TCG plugin which streams the state after each instruction of QEMU
+ * into the ring of stream.h, while QEMU runs at full speed. It is loaded
+ * by the REF built with STREAM=1 as
+ *
+ *   -plugin qemu-stream-plugin.so,shm=NAME,nr=N
+ *
+ * where NAME is the shared memory of the ring, and N is the number of the
+ * registers in a record. It needs the register API of QEMU 9.0 or later.
+ * The callback before an instruction sees the state after the previous
+ * one, so the record of an instruction is written before the next one. */
+
+QEMU_PLUGIN_EXPORT int qemu_plugin_version = QEMU_PLUGIN_VERSION;
+
+static StreamRing *ring = NULL;
+static int nr_reg = 0;
+static struct qemu_plugin_register *handle[STREAM_MAX_REG];
+static GByteArray *buf = NULL;
+static uint64_t head = 0;
+static bool started = false;
+
+static void vcpu_init(qemu_plugin_id_t id, unsigned int vcpu) {
+  if (vcpu != 0) return;
+  GArray *regs = qemu_plugin_get_registers();
+  assert(regs->len >= nr_reg);
+  int i;
+  for (i = 0; i < nr_reg; i ++) {
+    handle[i] = g_array_index(regs, qemu_plugin_reg_descriptor, i).handle;
+  }
+  g_array_free(regs, true);
+}
+
+static void insn_exec(unsigned int vcpu, void *udata) {
+  if (vcpu != 0) return;
+  if (!started) {
+    started = true;
+    return;
+  }
+
+  while (head - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) >= STREAM_NR_REC) {
+    sched_yield();
+  }
+  uint32_t *rec = stream_rec(ring, head);
+  int i;
+  for (i = 0; i < nr_reg; i ++) {
+    g_byte_array_set_size(buf, 0);
+    int len = qemu_plugin_read_register(handle[i], buf);
+    rec[i] = 0;
+    memcpy(&rec[i], buf->data, (len < 4 ? len : 4));
+  }
+  __atomic_store_n(&ring->head, ++ head, __ATOMIC_RELEASE);
+}
+
+static void tb_trans(qemu_plugin_id_t id, struct qemu_plugin_tb *tb) {
+  size_t i, n = qemu_plugin_tb_n_insns(tb);
+  for (i = 0; i < n; i ++) {
+    qemu_plugin_register_vcpu_insn_exec_cb(qemu_plugin_tb_get_insn(tb, i),
+        insn_exec, QEMU_PLUGIN_CB_R_REGS, NULL);
+  }
+}
+
+QEMU_PLUGIN_EXPORT int qemu_plugin_install(qemu_plugin_id_t id,
+    const qemu_info_t *info, int argc, char **argv) {
+  const char *shm = NULL;
+  int i;
+  for (i = 0; i < argc; i ++) {
+    if (strncmp(argv[i], "shm=", 4) == 0) shm = argv[i] + 4;
+    else if (strncmp(argv[i], "nr=", 3) == 0) nr_reg = atoi(argv[i] + 3);
+  }
+  if (shm == NULL || nr_reg <= 0 || nr_reg > STREAM_MAX_REG) {
+    fprintf(stderr, "usage: -plugin qemu-stream-plugin.so,shm=NAME,nr=N\n");
+    return -1;
+  }
+
+  int fd = shm_open(shm, O_RDWR, 0);
+  if (fd < 0) {
+    perror("shm_open");
+    return -1;
+  }
+  ring = mmap(NULL, sizeof(StreamRing), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (ring == MAP_FAILED) {
+    perror("mmap");
+    return -1;
+  }
+  assert(ring->nr_reg == nr_reg);
+  buf = g_byte_array_new();
+
+  qemu_plugin_register_vcpu_init_cb(id, vcpu_init);
+  qemu_plugin_register_vcpu_tb_trans_cb(id, tb_trans);
+  return 0;
+}
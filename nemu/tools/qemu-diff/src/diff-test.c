@@ -7,17 +7,48 @@ bool gdb_connect_qemu(void);
 bool gdb_memcpy_to_qemu(uint32_t, void *, int);
 bool gdb_getregs(union isa_gdb_regs *);
 bool gdb_setregs(union isa_gdb_regs *);
-bool gdb_si(void);
+bool gdb_si(uint64_t n);
+void gdb_continue(void);
 void gdb_exit(void);
 
 void init_isa(void);
 
+#ifdef QEMU_STREAM
+/* With STREAM=1, QEMU is set up through GDB, then it runs freely from the
+ * first difftest_exec(), and the TCG plugin streams its states, see
+ * stream.h. It can not be changed afterwards, so the instructions skipped
+ * by REF, e.g. MMIO, and attaching again are not supported. */
+#define STREAM_PLUGIN str(NEMU_HOME) "/tools/qemu-diff/build/qemu-stream-plugin.so"
+
+const char *stream_init(const char *plugin, int nr_reg);
+void stream_exec(uint64_t n);
+void stream_getregs(void *r, int size);
+
+static bool stream_running = false;
+
+static void check_stopped(void) {
+  if (stream_running) {
+    printf("QEMU runs freely with the plugin and can not be changed\n");
+    assert(0);
+  }
+}
+#else
+static inline void check_stopped(void) {}
+#endif
+
 void difftest_memcpy_from_dut(paddr_t dest, void *src, size_t n) {
+  check_stopped();
   bool ok = gdb_memcpy_to_qemu(dest, src, n);
   assert(ok == 1);
 }
 
 void difftest_getregs(void *r) {
+#ifdef QEMU_STREAM
+  if (stream_running) {
+    stream_getregs(r, DIFFTEST_REG_SIZE);
+    return;
+  }
+#endif
   union isa_gdb_regs qemu_r;
   gdb_getregs(&qemu_r);
   memcpy(r, &qemu_r, DIFFTEST_REG_SIZE);
@@ -25,16 +56,30 @@ void difftest_getregs(void *r) {
 
 void difftest_setregs(const void *r) {
   union isa_gdb_regs qemu_r;
+  check_stopped();
+  // only the registers compared are set, the others are kept
   gdb_getregs(&qemu_r);
   memcpy(&qemu_r, r, DIFFTEST_REG_SIZE);
   gdb_setregs(&qemu_r);
 }
 
 void difftest_exec(uint64_t n) {
-  while (n --) gdb_si();
+#ifdef QEMU_STREAM
+  if (n == 0) return;
+  if (!stream_running) {
+    gdb_continue();
+    stream_running = true;
+  }
+  stream_exec(n);
+#else
+  if (n > 0) gdb_si(n);
+#endif
 }
 
 void difftest_init(void) {
+#ifdef QEMU_STREAM
+  const char *plugin = stream_init(STREAM_PLUGIN, DIFFTEST_REG_SIZE / sizeof(uint32_t));
+#endif
   int ppid_before_fork = getpid();
   int pid = fork();
   if (pid == -1) {
@@ -57,7 +102,11 @@ void difftest_init(void) {
     }
 
     close(STDIN_FILENO);
+#ifdef QEMU_STREAM
+    execlp(ISA_QEMU_BIN, ISA_QEMU_BIN, ISA_QEMU_ARGS "-S", "-s", "-nographic", "-plugin", plugin, NULL);
+#else
     execlp(ISA_QEMU_BIN, ISA_QEMU_BIN, ISA_QEMU_ARGS "-S", "-s", "-nographic", NULL);
+#endif
     perror("exec");
     assert(0);
   }
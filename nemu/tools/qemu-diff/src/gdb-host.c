@@ -2,35 +2,73 @@
 
 static struct gdb_conn *conn;
 
+/* The registers of QEMU are cached, since they only change by stepping,
+ * and every step fetches them in the same exchange. */
+static union isa_gdb_regs regs_cache;
+static bool regs_valid = false;
+/* whether QEMU accepts binary memory writes, -1 if not known yet */
+static int binary_write = -1;
+
 bool gdb_connect_qemu(void) {
   // connect to gdbserver on localhost port 1234
   while ((conn = gdb_begin_inet("127.0.0.1", 1234)) == NULL) {
     usleep(1);
   }
 
+  // without acks, a request costs one round trip, and several requests
+  // can be sent at once
+  gdb_start_noack(conn);
+
   return true;
 }
 
-static bool gdb_memcpy_to_qemu_small(uint32_t dest, void *src, int len) {
-  char *buf = malloc(len * 2 + 128);
-  assert(buf != NULL);
-  int p = sprintf(buf, "M0x%x,%x:", dest, len);
+static void hex_encode_buf(char *buf, const uint8_t *src, int len) {
   int i;
   for (i = 0; i < len; i ++) {
-    p += sprintf(buf + p, "%c%c", hex_encode(((uint8_t *)src)[i] >> 4), hex_encode(((uint8_t *)src)[i] & 0xf));
+    buf[i * 2] = hex_encode(src[i] >> 4);
+    buf[i * 2 + 1] = hex_encode(src[i] & 0xf);
   }
+}
 
-  gdb_send(conn, (const uint8_t *)buf, strlen(buf));
-  free(buf);
-
+static bool recv_ok(void) {
   size_t size;
   uint8_t *reply = gdb_recv(conn, &size);
   bool ok = !strcmp((const char*)reply, "OK");
   free(reply);
-
   return ok;
 }
 
+static bool gdb_memcpy_to_qemu_small(uint32_t dest, void *src, int len) {
+  char *buf = malloc(len * 2 + 128);
+  assert(buf != NULL);
+
+  if (binary_write != 0) {
+    int p = sprintf(buf, "X%x,%x:", dest, len);
+    p += gdb_escape_binary((uint8_t *)buf + p, src, len);
+    gdb_send(conn, (const uint8_t *)buf, p);
+
+    size_t size;
+    uint8_t *reply = gdb_recv(conn, &size);
+    // an empty reply means the packet is not supported
+    bool supported = (size != 0);
+    bool ok = !strcmp((const char*)reply, "OK");
+    free(reply);
+
+    if (binary_write == -1) binary_write = supported;
+    if (supported) {
+      free(buf);
+      return ok;
+    }
+  }
+
+  int p = sprintf(buf, "M%x,%x:", dest, len);
+  hex_encode_buf(buf + p, src, len);
+  gdb_send(conn, (const uint8_t *)buf, p + len * 2);
+  free(buf);
+
+  return recv_ok();
+}
+
 bool gdb_memcpy_to_qemu(uint32_t dest, void *src, int len) {
   const int mtu = 1500;
   bool ok = true;
@@ -44,60 +82,90 @@ bool gdb_memcpy_to_qemu(uint32_t dest, void *src, int len) {
   return ok;
 }
 
-bool gdb_getregs(union isa_gdb_regs *r) {
-  gdb_send(conn, (const uint8_t *)"g", 1);
+static void recv_regs(void) {
   size_t size;
   uint8_t *reply = gdb_recv(conn, &size);
 
   int i;
   uint8_t *p = reply;
   uint8_t c;
-  for (i = 0; i < sizeof(union isa_gdb_regs) / sizeof(uint32_t); i ++) {
+  int nr = sizeof(union isa_gdb_regs) / sizeof(uint32_t);
+  if (size / 8 < nr) nr = size / 8;
+  memset(&regs_cache, 0, sizeof(regs_cache));
+  for (i = 0; i < nr; i ++) {
     c = p[8];
     p[8] = '\0';
-    r->array[i] = gdb_decode_hex_str(p);
+    regs_cache.array[i] = gdb_decode_hex_str(p);
     p[8] = c;
     p += 8;
   }
 
   free(reply);
+  regs_valid = true;
+}
 
+bool gdb_getregs(union isa_gdb_regs *r) {
+  if (!regs_valid) {
+    gdb_send(conn, (const uint8_t *)"g", 1);
+    recv_regs();
+  }
+  memcpy(r, &regs_cache, sizeof(*r));
   return true;
 }
 
 bool gdb_setregs(union isa_gdb_regs *r) {
+  if (regs_valid && memcmp(r, &regs_cache, sizeof(*r)) == 0) return true;
+
   int len = sizeof(union isa_gdb_regs);
   char *buf = malloc(len * 2 + 128);
   assert(buf != NULL);
   buf[0] = 'G';
+  hex_encode_buf(buf + 1, (void *)r, len);
 
-  void *src = r;
-  int p = 1;
-  int i;
-  for (i = 0; i < len; i ++) {
-    p += sprintf(buf + p, "%c%c", hex_encode(((uint8_t *)src)[i] >> 4), hex_encode(((uint8_t *)src)[i] & 0xf));
-  }
-
-  gdb_send(conn, (const uint8_t *)buf, strlen(buf));
+  gdb_send(conn, (const uint8_t *)buf, len * 2 + 1);
   free(buf);
 
-  size_t size;
-  uint8_t *reply = gdb_recv(conn, &size);
-  bool ok = !strcmp((const char*)reply, "OK");
-  free(reply);
-
+  bool ok = recv_ok();
+  // the registers not accepted by QEMU are unknown
+  regs_valid = ok;
+  if (ok) memcpy(&regs_cache, r, sizeof(*r));
   return ok;
 }
 
-bool gdb_si(void) {
-  char buf[] = "vCont;s:1";
-  gdb_send(conn, (const uint8_t *)buf, strlen(buf));
+/* Step `n' instructions and fetch the registers. Without acks, all the
+ * requests are sent at once in chunks, which costs one round trip. */
+bool gdb_si(uint64_t n) {
+  static const char step[] = "vCont;s:1";
+  const int chunk = 256;
   size_t size;
-  uint8_t *reply = gdb_recv(conn, &size);
-  free(reply);
+
+  regs_valid = false;
+  if (!gdb_can_queue(conn)) {
+    while (n --) {
+      gdb_send(conn, (const uint8_t *)step, sizeof(step) - 1);
+      free(gdb_recv(conn, &size));
+    }
+    return true;
+  }
+
+  do {
+    int i, k = (n > chunk ? chunk : n);
+    for (i = 0; i < k; i ++) gdb_queue(conn, (const uint8_t *)step, sizeof(step) - 1);
+    n -= k;
+    if (n == 0) gdb_queue(conn, (const uint8_t *)"g", 1);
+    gdb_flush(conn);
+    for (i = 0; i < k; i ++) free(gdb_recv(conn, &size));
+  } while (n > 0);
+  recv_regs();
   return true;
 }
 
+/* Let QEMU run freely. It does not reply until it stops. */
+void gdb_continue(void) {
+  regs_valid = false;
+  gdb_send(conn, (const uint8_t *)"vCont;c", 7);
+}
+
 void gdb_exit(void) {
   gdb_end(conn);
 }
@@ -1,9 +1,6 @@
 #ifndef __MIPS32_H__
 #define __MIPS32_H__
 
-#define _str(x) # x
-#define str(x) _str(x)
-
 #define ISA_QEMU_BIN "qemu-system-mipsel"
 #define ISA_QEMU_ARGS "-machine", "mipssim",\
   "-kernel", str(NEMU_HOME) "/tools/qemu-diff/src/isa/mips32/mips.dummy",
@@ -65,7 +65,7 @@ uint64_t gdb_decode_hex_str(uint8_t *bytes) {
 
 
 static struct gdb_conn* gdb_begin(int fd) {
-  struct gdb_conn *conn = calloc(1, sizeof(struct gdb_conn *));
+  struct gdb_conn *conn = calloc(1, sizeof(struct gdb_conn));
   if (conn == NULL)
     err(1, "calloc");
 
@@ -136,7 +136,7 @@ void gdb_end(struct gdb_conn *conn) {
   free(conn);
 }
 
-static void send_packet(FILE *out, const uint8_t *command, size_t size) {
+static void write_packet(FILE *out, const uint8_t *command, size_t size) {
   // compute the checksum -- simple mod256 addition
   uint8_t sum = 0;
   size_t i;
@@ -150,6 +150,9 @@ static void send_packet(FILE *out, const uint8_t *command, size_t size) {
   fputc('$', out); // packet start
   fwrite(command, 1, size, out); // payload
   fprintf(out, "#%02X", sum); // packet end, checksum
+}
+
+static void flush_out(FILE *out) {
   fflush(out);
 
   if (ferror(out))
@@ -158,6 +161,11 @@ static void send_packet(FILE *out, const uint8_t *command, size_t size) {
     errx(0, "send: Connection closed");
 }
 
+static void send_packet(FILE *out, const uint8_t *command, size_t size) {
+  write_packet(out, command, size);
+  flush_out(out);
+}
+
 void gdb_send(struct gdb_conn *conn, const uint8_t *command, size_t size) {
   bool acked = false;
   do {
@@ -171,6 +179,37 @@ void gdb_send(struct gdb_conn *conn, const uint8_t *command, size_t size) {
   } while (!acked);
 }
 
+// Without acks, several packets can be in flight: queue them with
+// gdb_queue(), send them all with gdb_flush(), then gdb_recv() the
+// replies in order.
+int gdb_can_queue(struct gdb_conn *conn) {
+  return !conn->ack;
+}
+
+void gdb_queue(struct gdb_conn *conn, const uint8_t *command, size_t size) {
+  assert(!conn->ack);
+  write_packet(conn->out, command, size);
+}
+
+void gdb_flush(struct gdb_conn *conn) {
+  flush_out(conn->out);
+}
+
+// Escape the bytes which can not appear in the binary data of a packet.
+// `out' should have room for twice the size of `data'.
+size_t gdb_escape_binary(uint8_t *out, const uint8_t *data, size_t size) {
+  size_t i, n = 0;
+  for (i = 0; i < size; i ++) {
+    uint8_t c = data[i];
+    if (c == '$' || c == '#' || c == '}' || c == '*') {
+      out[n ++] = '}';
+      c ^= 0x20;
+    }
+    out[n ++] = c;
+  }
+  return n;
+}
+
 static uint8_t* recv_packet(FILE *in, size_t *ret_size, bool* ret_sum_ok) {
   size_t i = 0;
   size_t size = 4096;
@@ -0,0 +1,57 @@
+#include "common.h"
+#include "stream.h"
+#include <fcntl.h>
+#include <sched.h>
+#include <sys/mman.h>
+
+/* The REF side of the ring written by the TCG plugin, see stream.h. */
+
+static StreamRing *ring = NULL;
+static char shm_name[64];
+static uint64_t tail = 0;
+/* the record of the last instruction executed */
+static uint32_t last[STREAM_MAX_REG];
+
+static void stream_exit(void) {
+  shm_unlink(shm_name);
+}
+
+/* return the arguments of '-plugin' */
+const char *stream_init(const char *plugin, int nr_reg) {
+  assert(nr_reg <= STREAM_MAX_REG);
+  sprintf(shm_name, "/qemu-diff-%d", getpid());
+  int fd = shm_open(shm_name, O_RDWR | O_CREAT | O_EXCL, 0600);
+  assert(fd >= 0);
+  atexit(stream_exit);
+  int ret = ftruncate(fd, sizeof(StreamRing));
+  assert(ret == 0);
+  ring = mmap(NULL, sizeof(StreamRing), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  assert(ring != MAP_FAILED);
+  close(fd);
+  ring->nr_reg = nr_reg;
+
+  static char args[256];
+  snprintf(args, sizeof(args), "%s,shm=%s,nr=%d", plugin, shm_name, nr_reg);
+  return args;
+}
+
+/* consume the records of `n' instructions */
+void stream_exec(uint64_t n) {
+  if (n == 0) return;
+  uint64_t end = tail + n;
+  while (tail < end) {
+    uint64_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    if (head == tail) {
+      sched_yield();
+      continue;
+    }
+    if (head > end) head = end;
+    tail = head;
+    memcpy(last, stream_rec(ring, tail - 1), ring->nr_reg * sizeof(last[0]));
+    __atomic_store_n(&ring->tail, tail, __ATOMIC_RELEASE);
+  }
+}
+
+void stream_getregs(void *r, int size) {
+  memcpy(r, last, size);
+}
@@ -0,0 +1,195 @@
+#include "klib.h"
+#include <stdarg.h>
+
+#if !defined(__ISA_NATIVE__) || defined(__NATIVE_USE_KLIB__)
+
+/* All the functions format through vformat() into an Out. sprintf() and
+ * snprintf() write into the buffer of the caller. printf() formats into a
+ * buffer on the stack, and hands the whole text to _putstr() when the
+ * buffer is full and at the end, instead of calling _putc() for every
+ * character. The AM of a platform with a bulk transmit register (e.g. the
+ * serial of NEMU) can provide _putstr() to print it with one trap. */
+
+#define PRINTF_BUF_SIZE 256
+
+void __attribute__((weak)) _putstr(const char *s, size_t len) {
+  for (; len > 0; len --) _putc(*s ++);
+}
+
+typedef struct {
+  char *buf;
+  size_t size, pos;
+  int nr;        // the characters output so far, including those dropped
+  bool console;  // flush to _putstr() when full
+} Out;
+
+static inline void out_flush(Out *o) {
+  if (o->pos > 0) _putstr(o->buf, o->pos);
+  o->pos = 0;
+}
+
+static inline void out_ch(Out *o, char c) {
+  if (o->pos < o->size) o->buf[o->pos ++] = c;
+  o->nr ++;
+  if (o->console && o->pos == o->size) out_flush(o);
+}
+
+static void out_pad(Out *o, char c, int n) {
+  for (; n > 0; n --) out_ch(o, c);
+}
+
+/* output `s' of `len' characters in a field of `width' */
+static void out_field(Out *o, const char *s, int len, int width, bool left, char pad) {
+  if (!left) {
+    /* the sign goes before the zeros */
+    if (pad == '0' && len > 0 && (*s == '-')) {
+      out_ch(o, *s ++);
+      len --;
+      width --;
+    }
+    out_pad(o, pad, width - len);
+  }
+  int i;
+  for (i = 0; i < len; i ++) out_ch(o, s[i]);
+  if (left) out_pad(o, ' ', width - len);
+}
+
+/* the digits of `val' in `base', from the end of `end' backwards */
+static char *format_num(char *end, uint64_t val, int base, bool upper) {
+  const char *digits = (upper ? "0123456789ABCDEF" : "0123456789abcdef");
+  char *p = end;
+  do {
+    *-- p = digits[val % base];
+    val /= base;
+  } while (val != 0);
+  return p;
+}
+
+static int vformat(Out *o, const char *fmt, va_list ap) {
+  char num[24];
+  for (; *fmt != '\0'; fmt ++) {
+    if (*fmt != '%') {
+      out_ch(o, *fmt);
+      continue;
+    }
+
+    bool left = false;
+    char pad = ' ';
+    for (fmt ++; *fmt == '-' || *fmt == '0'; fmt ++) {
+      if (*fmt == '-') left = true;
+      else pad = '0';
+    }
+    int width = 0, prec = -1;
+    if (*fmt == '*') {
+      width = va_arg(ap, int);
+      fmt ++;
+    }
+    else {
+      for (; *fmt >= '0' && *fmt <= '9'; fmt ++) width = width * 10 + *fmt - '0';
+    }
+    if (*fmt == '.') {
+      prec = 0;
+      for (fmt ++; *fmt >= '0' && *fmt <= '9'; fmt ++) prec = prec * 10 + *fmt - '0';
+    }
+    if (left) pad = ' ';
+
+    /* size_t has the size of long */
+    int nr_long = 0;
+    for (; *fmt == 'l' || *fmt == 'z'; fmt ++) nr_long ++;
+
+    uint64_t val;
+    bool neg = false;
+    int base = 10;
+    switch (*fmt) {
+      case 'c':
+        num[0] = va_arg(ap, int);
+        out_field(o, num, 1, width, left, ' ');
+        continue;
+      case 's': {
+        const char *s = va_arg(ap, const char *);
+        if (s == NULL) s = "(null)";
+        int len = 0;
+        for (; s[len] != '\0' && (prec < 0 || len < prec); len ++) ;
+        out_field(o, s, len, width, left, ' ');
+        continue;
+      }
+      case 'd': case 'i': {
+        int64_t v = (nr_long >= 2 ? va_arg(ap, long long) :
+            nr_long == 1 ? va_arg(ap, long) : va_arg(ap, int));
+        neg = (v < 0);
+        val = (neg ? -(uint64_t)v : (uint64_t)v);
+        break;
+      }
+      case 'p':
+        val = (uintptr_t)va_arg(ap, void *);
+        base = 16;
+        out_ch(o, '0');
+        out_ch(o, 'x');
+        width -= 2;
+        break;
+      case 'u': case 'x': case 'X': case 'o':
+        val = (nr_long >= 2 ? va_arg(ap, unsigned long long) :
+            nr_long == 1 ? va_arg(ap, unsigned long) : va_arg(ap, unsigned int));
+        base = (*fmt == 'o' ? 8 : *fmt == 'u' ? 10 : 16);
+        break;
+      case '%':
+        out_ch(o, '%');
+        continue;
+      case '\0':
+        return o->nr;
+      default:
+        out_ch(o, '%');
+        out_ch(o, *fmt);
+        continue;
+    }
+
+    char *end = num + sizeof(num);
+    char *p = format_num(end, val, base, *fmt == 'X');
+    if (neg) *-- p = '-';
+    out_field(o, p, end - p, width, left, pad);
+  }
+  return o->nr;
+}
+
+int printf(const char *fmt, ...) {
+  char buf[PRINTF_BUF_SIZE];
+  Out o = { .buf = buf, .size = sizeof(buf), .console = true };
+  va_list ap;
+  va_start(ap, fmt);
+  int ret = vformat(&o, fmt, ap);
+  va_end(ap);
+  out_flush(&o);
+  return ret;
+}
+
+int vsprintf(char *out, const char *fmt, va_list ap) {
+  Out o = { .buf = out, .size = (size_t)-1 };
+  int ret = vformat(&o, fmt, ap);
+  out[o.pos] = '\0';
+  return ret;
+}
+
+int sprintf(char *out, const char *fmt, ...) {
+  va_list ap;
+  va_start(ap, fmt);
+  int ret = vsprintf(out, fmt, ap);
+  va_end(ap);
+  return ret;
+}
+
+int vsnprintf(char *out, size_t n, const char *fmt, va_list ap) {
+  Out o = { .buf = out, .size = (n == 0 ? 0 : n - 1) };
+  int ret = vformat(&o, fmt, ap);
+  if (n > 0) out[o.pos] = '\0';
+  return ret;
+}
+
+int snprintf(char *out, size_t n, const char *fmt, ...) {
+  va_list ap;
+  va_start(ap, fmt);
+  int ret = vsnprintf(out, n, fmt, ap);
+  va_end(ap);
+  return ret;
+}
+
+#endif
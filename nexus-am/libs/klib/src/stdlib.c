@@ -0,0 +1,183 @@
+#include "klib.h"
+
+#if !defined(__ISA_NATIVE__) || defined(__NATIVE_USE_KLIB__)
+
+static unsigned long int next = 1;
+
+int rand(void) {
+  // RAND_MAX assumed to be 32767
+  next = next * 1103515245 + 12345;
+  return (unsigned int)(next/65536) % 32768;
+}
+
+void srand(unsigned int seed) {
+  next = seed;
+}
+
+int abs(int x) {
+  return (x < 0 ? -x : x);
+}
+
+int atoi(const char* nptr) {
+  int x = 0;
+  while (*nptr == ' ') { nptr ++; }
+  bool neg = (*nptr == '-');
+  if (*nptr == '-' || *nptr == '+') { nptr ++; }
+  while (*nptr >= '0' && *nptr <= '9') {
+    x = x * 10 + *nptr - '0';
+    nptr ++;
+  }
+  return (neg ? -x : x);
+}
+
+/* malloc() rounds a small request up to one of the size classes of
+ * 16 << i bytes, and takes a block from the free list of the class. An
+ * empty list is refilled with a whole arena of blocks cut from _heap at
+ * once, so the common case is popping a list. free() pushes the block back
+ * onto the list of its class, which is kept in the header before it.
+ *
+ * A request larger than the largest class is cut from _heap on its own,
+ * and is kept on the list of the large blocks after free(), to be reused
+ * by a later request which fits in it. The memory is never returned to
+ * _heap.
+ *
+ * With KLIB_MALLOC_STAT defined, malloc_stat() prints the blocks in use
+ * of each class. */
+
+#define NR_CLASS 8
+#define MIN_BLOCK 16
+#define MAX_BLOCK (MIN_BLOCK << (NR_CLASS - 1))
+#define ARENA_SIZE (16 * 1024)
+#define HDR_SIZE 8
+
+#define CLASS_LARGE NR_CLASS
+
+typedef struct Block {
+  struct Block *next;
+} Block;
+
+typedef struct {
+  uint32_t class;
+  uint32_t size;  // of the data, only for a large block
+} Header;
+
+static Block *free_list[NR_CLASS + 1];
+static uintptr_t heap_brk = 0;
+
+#ifdef KLIB_MALLOC_STAT
+static uint32_t nr_alloc[NR_CLASS + 1], nr_free[NR_CLASS + 1], nr_arena = 0;
+#define STAT(x) (x)
+#else
+#define STAT(x)
+#endif
+
+static inline Header *header(void *p) {
+  return (Header *)((char *)p - HDR_SIZE);
+}
+
+static inline int size_class(size_t size) {
+  int c = 0;
+  size_t s = MIN_BLOCK;
+  for (; s < size + HDR_SIZE; s <<= 1) c ++;
+  return c;
+}
+
+/* cut `size' bytes from _heap, NULL if it is exhausted */
+static void *heap_cut(size_t size) {
+  if (heap_brk == 0) heap_brk = ((uintptr_t)_heap.start + HDR_SIZE - 1) & ~(uintptr_t)(HDR_SIZE - 1);
+  if (size > (uintptr_t)_heap.end - heap_brk) return NULL;
+  void *p = (void *)heap_brk;
+  heap_brk += size;
+  return p;
+}
+
+static bool arena_refill(int c) {
+  size_t bsize = MIN_BLOCK << c;
+  char *arena = heap_cut(ARENA_SIZE);
+  if (arena == NULL) return false;
+  STAT(nr_arena ++);
+  int i;
+  for (i = ARENA_SIZE / bsize - 1; i >= 0; i --) {
+    char *p = arena + i * bsize;
+    Block *b = (Block *)(p + HDR_SIZE);
+    ((Header *)p)->class = c;
+    b->next = free_list[c];
+    free_list[c] = b;
+  }
+  return true;
+}
+
+static void *large_alloc(size_t size) {
+  size = (size + HDR_SIZE - 1) & ~(size_t)(HDR_SIZE - 1);
+  Block **pb;
+  for (pb = &free_list[CLASS_LARGE]; *pb != NULL; pb = &(*pb)->next) {
+    if (header(*pb)->size >= size) {
+      Block *b = *pb;
+      *pb = b->next;
+      return b;
+    }
+  }
+  char *p = heap_cut(HDR_SIZE + size);
+  if (p == NULL) return NULL;
+  *(Header *)p = (Header) { .class = CLASS_LARGE, .size = size };
+  return p + HDR_SIZE;
+}
+
+void *malloc(size_t size) {
+  if (size == 0) return NULL;
+  if (size + HDR_SIZE > MAX_BLOCK) {
+    STAT(nr_alloc[CLASS_LARGE] ++);
+    return large_alloc(size);
+  }
+  int c = size_class(size);
+  if (free_list[c] == NULL && !arena_refill(c)) return NULL;
+  Block *b = free_list[c];
+  free_list[c] = b->next;
+  STAT(nr_alloc[c] ++);
+  return b;
+}
+
+void free(void *ptr) {
+  if (ptr == NULL) return;
+  int c = header(ptr)->class;
+  assert(c <= CLASS_LARGE);
+  STAT(nr_free[c] ++);
+  Block *b = ptr;
+  b->next = free_list[c];
+  free_list[c] = b;
+}
+
+void *calloc(size_t nmemb, size_t size) {
+  void *p = malloc(nmemb * size);
+  if (p != NULL) memset(p, 0, nmemb * size);
+  return p;
+}
+
+void *realloc(void *ptr, size_t size) {
+  if (ptr == NULL) return malloc(size);
+  Header *h = header(ptr);
+  size_t old = (h->class == CLASS_LARGE ? h->size : (MIN_BLOCK << h->class) - HDR_SIZE);
+  if (size <= old) return ptr;
+  void *p = malloc(size);
+  if (p != NULL) {
+    memcpy(p, ptr, old);
+    free(ptr);
+  }
+  return p;
+}
+
+#ifdef KLIB_MALLOC_STAT
+void malloc_stat(void) {
+  int c;
+  printf("malloc: %d arenas, %d bytes of _heap used\n", nr_arena,
+      (int)(heap_brk == 0 ? 0 : heap_brk - (uintptr_t)_heap.start));
+  for (c = 0; c <= NR_CLASS; c ++) {
+    if (nr_alloc[c] == 0) continue;
+    if (c == CLASS_LARGE) printf("  large: ");
+    else printf("  %5d: ", MIN_BLOCK << c);
+    printf("%d allocated, %d freed, %d in use\n", nr_alloc[c], nr_free[c], nr_alloc[c] - nr_free[c]);
+  }
+}
+#endif
+
+#endif
@@ -0,0 +1,142 @@
+#include "klib.h"
+
+#if !defined(__ISA_NATIVE__) || defined(__NATIVE_USE_KLIB__)
+
+/* Under NEMU every guest instruction costs a dispatch, so the routines
+ * move a word at a time where they can. A pointer is first aligned byte by
+ * byte (the prologue), then whole words are handled four at a time, and
+ * the remaining bytes at the end again one by one. Two buffers which can
+ * not be aligned together fall back to bytes, since mips32 traps on the
+ * unaligned accesses.
+ *
+ * The string routines find the terminating zero in a word with HAS_ZERO().
+ * Reading the whole aligned word containing the end never crosses a page. */
+
+typedef uintptr_t __attribute__((__may_alias__)) word_t;
+
+#define WSIZE sizeof(word_t)
+#define WMASK (WSIZE - 1)
+#define ONES ((word_t)-1 / 0xff)
+#define HIGHS (ONES * 0x80)
+#define HAS_ZERO(w) (((w) - ONES) & ~(w) & HIGHS)
+
+#define ALIGNED(p) (((uintptr_t)(p) & WMASK) == 0)
+#define CO_ALIGNED(p, q) ((((uintptr_t)(p) ^ (uintptr_t)(q)) & WMASK) == 0)
+
+size_t strlen(const char *s) {
+  const char *p = s;
+  for (; !ALIGNED(p); p ++) {
+    if (*p == '\0') return p - s;
+  }
+  const word_t *w = (const word_t *)p;
+  while (!HAS_ZERO(*w)) w ++;
+  for (p = (const char *)w; *p != '\0'; p ++) ;
+  return p - s;
+}
+
+char *strcpy(char* dst,const char* src) {
+  char *d = dst;
+  if (CO_ALIGNED(d, src)) {
+    for (; !ALIGNED(src); d ++, src ++) {
+      if ((*d = *src) == '\0') return dst;
+    }
+    word_t *wd = (word_t *)d;
+    const word_t *ws = (const word_t *)src;
+    for (; !HAS_ZERO(*ws); wd ++, ws ++) *wd = *ws;
+    d = (char *)wd;
+    src = (const char *)ws;
+  }
+  while ((*d ++ = *src ++) != '\0') ;
+  return dst;
+}
+
+char* strncpy(char* dst, const char* src, size_t n) {
+  size_t i;
+  for (i = 0; i < n && src[i] != '\0'; i ++) dst[i] = src[i];
+  memset(dst + i, 0, n - i);
+  return dst;
+}
+
+char* strcat(char* dst, const char* src) {
+  strcpy(dst + strlen(dst), src);
+  return dst;
+}
+
+int strcmp(const char* s1, const char* s2) {
+  if (CO_ALIGNED(s1, s2)) {
+    for (; !ALIGNED(s1); s1 ++, s2 ++) {
+      if (*s1 != *s2 || *s1 == '\0') goto diff;
+    }
+    const word_t *w1 = (const word_t *)s1, *w2 = (const word_t *)s2;
+    for (; *w1 == *w2 && !HAS_ZERO(*w1); w1 ++, w2 ++) ;
+    s1 = (const char *)w1;
+    s2 = (const char *)w2;
+  }
+  for (; *s1 == *s2 && *s1 != '\0'; s1 ++, s2 ++) ;
+diff:
+  return (unsigned char)*s1 - (unsigned char)*s2;
+}
+
+int strncmp(const char* s1, const char* s2, size_t n) {
+  for (; n > 0; n --, s1 ++, s2 ++) {
+    if (*s1 != *s2 || *s1 == '\0') return (unsigned char)*s1 - (unsigned char)*s2;
+  }
+  return 0;
+}
+
+void* memset(void* v,int c,size_t n) {
+  unsigned char *p = v;
+  if (n >= 2 * WSIZE) {
+    for (; !ALIGNED(p); n --) *p ++ = c;
+    word_t w = ONES * (unsigned char)c;
+    word_t *wp = (word_t *)p;
+    for (; n >= 4 * WSIZE; n -= 4 * WSIZE, wp += 4) {
+      wp[0] = w; wp[1] = w; wp[2] = w; wp[3] = w;
+    }
+    for (; n >= WSIZE; n -= WSIZE) *wp ++ = w;
+    p = (unsigned char *)wp;
+  }
+  while (n -- > 0) *p ++ = c;
+  return v;
+}
+
+void* memcpy(void* out, const void* in, size_t n) {
+  unsigned char *d = out;
+  const unsigned char *s = in;
+  if (n >= 2 * WSIZE && CO_ALIGNED(d, s)) {
+    for (; !ALIGNED(d); n --) *d ++ = *s ++;
+    word_t *wd = (word_t *)d;
+    const word_t *ws = (const word_t *)s;
+    for (; n >= 4 * WSIZE; n -= 4 * WSIZE, wd += 4, ws += 4) {
+      word_t w0 = ws[0], w1 = ws[1], w2 = ws[2], w3 = ws[3];
+      wd[0] = w0; wd[1] = w1; wd[2] = w2; wd[3] = w3;
+    }
+    for (; n >= WSIZE; n -= WSIZE) *wd ++ = *ws ++;
+    d = (unsigned char *)wd;
+    s = (const unsigned char *)ws;
+  }
+  for (; n >= 4; n -= 4, d += 4, s += 4) {
+    d[0] = s[0]; d[1] = s[1]; d[2] = s[2]; d[3] = s[3];
+  }
+  while (n -- > 0) *d ++ = *s ++;
+  return out;
+}
+
+int memcmp(const void* s1, const void* s2, size_t n){
+  const unsigned char *p1 = s1, *p2 = s2;
+  if (n >= 2 * WSIZE && CO_ALIGNED(p1, p2)) {
+    for (; !ALIGNED(p1); n --, p1 ++, p2 ++) {
+      if (*p1 != *p2) return *p1 - *p2;
+    }
+    const word_t *w1 = (const word_t *)p1, *w2 = (const word_t *)p2;
+    for (; n >= WSIZE && *w1 == *w2; n -= WSIZE) w1 ++, w2 ++;
+    p1 = (const unsigned char *)w1;
+    p2 = (const unsigned char *)w2;
+  }
+  for (; n > 0; n --, p1 ++, p2 ++) {
+    if (*p1 != *p2) return *p1 - *p2;
+  }
+  return 0;
+}
+
+#endif
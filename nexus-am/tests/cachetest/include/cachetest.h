@@ -0,0 +1,29 @@
+#ifndef __CACHETEST_H__
+#define __CACHETEST_H__
+
+#include <am.h>
+#include <klib.h>
+
+/* Each test makes NR_ACCESS accesses over working sets from MIN_WSET to
+ * MAX_WSET bytes, doubling each time, and reports the time of each. The
+ * time per access goes up when the working set no longer fits in a level
+ * of the cache, which is where the cache simulator of NEMU is compared
+ * with the host. The working sets are taken from _heap, and the larger
+ * ones are skipped if _heap is too small. */
+
+#define MIN_WSET (1 << 10)
+#define MAX_WSET (4 << 20)
+#define NR_ACCESS (1 << 20)
+#define LINE_SIZE 64
+
+static inline void *wset_buf(size_t size) {
+  uintptr_t p = ((uintptr_t)_heap.start + LINE_SIZE - 1) & ~(uintptr_t)(LINE_SIZE - 1);
+  return (p + size <= (uintptr_t)_heap.end ? (void *)p : NULL);
+}
+
+static inline void report(const char *name, size_t wset, uint32_t ms) {
+  uint32_t ps = (uint64_t)ms * 1000000000 / NR_ACCESS;
+  printf("%-12s %6d KB %6d ms %8d ps/access\n", name, (int)(wset >> 10), ms, ps);
+}
+
+#endif
@@ -0,0 +1,42 @@
+#include <cachetest.h>
+
+/* Follow the pointers through the lines of the working set in a random
+ * cycle, so every access depends on the one before, and neither a
+ * prefetcher nor the overlapping of misses helps. */
+
+typedef struct Node {
+  struct Node *next;
+  uint8_t pad[LINE_SIZE - sizeof(struct Node *)];
+} Node;
+
+static void make_cycle(Node *nodes, int n) {
+  int i;
+  for (i = 0; i < n; i ++) nodes[i].next = &nodes[i];
+  /* Sattolo's algorithm for a random permutation with a single cycle */
+  for (i = n - 1; i > 0; i --) {
+    int j = (((uint32_t)rand() << 15) ^ rand()) % i;
+    Node *t = nodes[i].next;
+    nodes[i].next = nodes[j].next;
+    nodes[j].next = t;
+  }
+}
+
+int main() {
+  _ioe_init();
+  srand(1);
+  size_t wset;
+  for (wset = MIN_WSET; wset <= MAX_WSET; wset <<= 1) {
+    Node *nodes = wset_buf(wset);
+    if (nodes == NULL) break;
+    make_cycle(nodes, wset / sizeof(Node));
+
+    uint32_t t0 = uptime();
+    Node *p = nodes;
+    int k;
+    for (k = 0; k < NR_ACCESS; k ++) p = p->next;
+    report("chase", wset, uptime() - t0);
+    Node * volatile end = p;
+    (void)end;
+  }
+  return 0;
+}
@@ -0,0 +1,23 @@
+#include <cachetest.h>
+
+/* write the words of the working set one after another, from the start
+ * again at the end */
+
+int main() {
+  _ioe_init();
+  size_t wset;
+  for (wset = MIN_WSET; wset <= MAX_WSET; wset <<= 1) {
+    uint32_t *buf = wset_buf(wset);
+    if (buf == NULL) break;
+    size_t n = wset / sizeof(buf[0]), i = 0;
+
+    uint32_t t0 = uptime();
+    int k;
+    for (k = 0; k < NR_ACCESS; k ++) {
+      buf[i] = k;
+      if (++ i == n) i = 0;
+    }
+    report("stream", wset, uptime() - t0);
+  }
+  return 0;
+}
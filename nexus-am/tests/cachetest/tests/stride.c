@@ -0,0 +1,38 @@
+#include <cachetest.h>
+
+/* read words with a stride, the same lines again once the working set is
+ * swept through */
+
+static const int strides[] = { 4, 16, 64, 256 };
+
+static uint32_t sweep(const uint32_t *buf, size_t wset, int stride) {
+  uint32_t sum = 0;
+  size_t n = wset / sizeof(buf[0]), step = stride / sizeof(buf[0]);
+  size_t i = 0, k;
+  for (k = 0; k < NR_ACCESS; k ++) {
+    sum += buf[i];
+    i += step;
+    if (i >= n) i = (i + 1) % step;
+  }
+  return sum;
+}
+
+int main() {
+  _ioe_init();
+  int s;
+  for (s = 0; s < sizeof(strides) / sizeof(strides[0]); s ++) {
+    char name[16];
+    sprintf(name, "stride-%d", strides[s]);
+    size_t wset;
+    for (wset = MIN_WSET; wset <= MAX_WSET; wset <<= 1) {
+      uint32_t *buf = wset_buf(wset);
+      if (buf == NULL) break;
+      memset(buf, 1, wset);
+      uint32_t t0 = uptime();
+      volatile uint32_t sum = sweep(buf, wset, strides[s]);
+      report(name, wset, uptime() - t0);
+      (void)sum;
+    }
+  }
+  return 0;
+}